@@ -16,8 +16,17 @@
 /*************************************************************************
 * The following macro returns a random number in the specified range
 **************************************************************************/
-#define RandomInRange(u) ((rand()>>3)%(u))
-#define RandomInRangeFast(u) ((rand()>>3)%(u))
+#define RandomInRange(u) ((RandomNumber()>>3)%(u))
+#define RandomInRangeFast(u) ((RandomNumber()>>3)%(u))
+
+/*************************************************************************
+* The following macro declares a variable with thread storage duration
+**************************************************************************/
+#ifdef _MSC_VER
+#define THREAD_LOCAL __declspec(thread)
+#else
+#define THREAD_LOCAL __thread
+#endif
 
 
 
@@ -490,6 +490,7 @@ void RandomPermute(int, idxtype *, int);
 void RandomInit(int n, int k, idxtype *label);
 int ispow2(int);
 void InitRandom(int);
+int RandomNumber(void);
 int log2_metis(int);
 
 
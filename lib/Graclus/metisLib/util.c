@@ -585,7 +585,7 @@ void RandomPermute(int n, idxtype *p, int flag)
 
   for(i = 1; i < n; i++)
   {
-    j = rand() % (i+1);
+    j = RandomNumber() % (i+1);
     tmp = p[i];
     p[i] = p[j];
     p[j] = tmp;
@@ -644,17 +644,71 @@ int ispow2(int a)
 }
 
 
+/*************************************************************************
+* The state of the random number generator, which uses the same additive
+* feedback scheme as rand() of the GNU C library. Every thread has its own
+* state, such that concurrent partitionings are independent and reproducible.
+**************************************************************************/
+#define RANDOM_DEGREE 31
+#define RANDOM_SEPARATION 3
+
+static THREAD_LOCAL unsigned int random_table[RANDOM_DEGREE];
+static THREAD_LOCAL int random_front = RANDOM_SEPARATION;
+static THREAD_LOCAL int random_rear = 0;
+static THREAD_LOCAL int random_initialized = 0;
+
 /*************************************************************************
 * This function initializes the random number generator
 **************************************************************************/
 void InitRandom(int seed)
 {
-  if (seed == -1) {
-    srand(4321);
-  }
-  else {
-    srand(seed);
+  int i;
+  long word, hi, lo;
+
+  if (seed == -1)
+    seed = 4321;
+  if (seed == 0)
+    seed = 1;
+
+  /* Fill the table with 16807 * word % 2147483647 without overflow */
+  word = seed;
+  random_table[0] = (unsigned int)word;
+  for (i=1; i<RANDOM_DEGREE; i++) {
+    hi = word / 127773;
+    lo = word % 127773;
+    word = 16807 * lo - 2836 * hi;
+    if (word < 0)
+      word += 2147483647;
+    random_table[i] = (unsigned int)word;
   }
+
+  random_front = RANDOM_SEPARATION;
+  random_rear = 0;
+  random_initialized = 1;
+
+  for (i=0; i<10*RANDOM_DEGREE; i++)
+    RandomNumber();
+}
+
+/*************************************************************************
+* This function returns a random number in [0, 2^31)
+**************************************************************************/
+int RandomNumber(void)
+{
+  int result;
+
+  if (!random_initialized)
+    InitRandom(-1);
+
+  random_table[random_front] += random_table[random_rear];
+  result = (int)(random_table[random_front] >> 1);
+
+  if (++random_front >= RANDOM_DEGREE)
+    random_front = 0;
+  if (++random_rear >= RANDOM_DEGREE)
+    random_rear = 0;
+
+  return result;
 }
 
 /*************************************************************************
@@ -50,7 +50,12 @@ def read_array(path):
                 if num_delimiter >= 3:
                     break
             byte = fid.read(1)
-        array = np.fromfile(fid, np.float32)
+        data = fid.read()
+    # Maps written with 16-bit floating point storage have half the size.
+    if len(data) == 2 * width * height * channels:
+        array = np.frombuffer(data, "<f2").astype(np.float32)
+    else:
+        array = np.frombuffer(data, "<f4").astype(np.float32)
     array = array.reshape((width, height, channels), order="F")
     return np.transpose(array, (1, 0, 2)).squeeze()
 
@@ -705,7 +705,7 @@ namespace colmap {
       }
 
       auto it = std::upper_bound(params_.begin() + 2 + num_control_points, params_.end(), radius);
-      size_t idx = std::max<int>((it - params_.begin()) - 1 - 2 + num_control_points, 0); // (params[idx + 2 + num_control_points] <= radius)
+      size_t idx = std::max<int>((it - params_.begin()) - 1 - 2 - num_control_points, 0); // (params[idx + 2 + num_control_points] <= radius)
 
       double theta = params_[2 + idx];
       double residual = spline_(theta) - radius;
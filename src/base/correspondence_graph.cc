@@ -160,6 +160,45 @@ void CorrespondenceGraph::AddCorrespondences(const image_t image_id1,
   }
 }
 
+void CorrespondenceGraph::LoadSubgraph(
+    const CorrespondenceGraph& correspondence_graph,
+    const std::unordered_set<image_t>& image_ids) {
+  CHECK_EQ(images_.size(), 0);
+  CHECK_EQ(image_pairs_.size(), 0);
+
+  // Keep the correspondences between the given images in their original order.
+  images_.reserve(image_ids.size());
+  for (const auto image_id : image_ids) {
+    const auto it = correspondence_graph.images_.find(image_id);
+    if (it == correspondence_graph.images_.end()) {
+      continue;
+    }
+
+    struct Image& image = images_[image_id];
+    image.corrs.resize(it->second.corrs.size());
+    for (size_t point2D_idx = 0; point2D_idx < image.corrs.size();
+         ++point2D_idx) {
+      for (const auto& corr : it->second.corrs[point2D_idx]) {
+        if (image_ids.count(corr.image_id) > 0) {
+          image.corrs[point2D_idx].push_back(corr);
+          image.num_correspondences += 1;
+        }
+      }
+    }
+  }
+
+  for (const auto& image_pair : correspondence_graph.image_pairs_) {
+    image_t image_id1;
+    image_t image_id2;
+    Database::PairIdToImagePair(image_pair.first, &image_id1, &image_id2);
+    if (image_ids.count(image_id1) > 0 && image_ids.count(image_id2) > 0) {
+      image_pairs_.emplace(image_pair.first, image_pair.second);
+    }
+  }
+
+  Finalize();
+}
+
 std::vector<CorrespondenceGraph::Correspondence>
 CorrespondenceGraph::FindTransitiveCorrespondences(
     const image_t image_id, const point2D_t point2D_idx,
@@ -33,6 +33,7 @@
 #define COLMAP_SRC_BASE_CORRESPONDENCE_GRAPH_H_
 
 #include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 #include "base/database.h"
@@ -101,6 +102,13 @@ class CorrespondenceGraph {
   void AddCorrespondences(const image_t image_id1, const image_t image_id2,
                           const FeatureMatches& matches);
 
+  // Initialize the empty graph as the subgraph of another graph induced by the
+  // given images, i.e., only correspondences between the given images are kept.
+  // The resulting graph is finalized and equivalent to a graph built from the
+  // matches between the given images only.
+  void LoadSubgraph(const CorrespondenceGraph& correspondence_graph,
+                    const std::unordered_set<image_t>& image_ids);
+
   // Find the correspondence of an image observation to all other images.
   inline const std::vector<Correspondence>& FindCorrespondences(
       const image_t image_id, const point2D_t point2D_idx) const;
@@ -371,3 +371,41 @@ BOOST_AUTO_TEST_CASE(TestDuplicate) {
   BOOST_CHECK_EQUAL(
       correspondence_graph.NumCorrespondencesBetweenImages().at(pair_id), 3);
 }
+
+BOOST_AUTO_TEST_CASE(TestLoadSubgraph) {
+  CorrespondenceGraph correspondence_graph;
+  correspondence_graph.AddImage(0, 10);
+  correspondence_graph.AddImage(1, 10);
+  correspondence_graph.AddImage(2, 10);
+  FeatureMatches matches01(2);
+  matches01[0].point2D_idx1 = 0;
+  matches01[0].point2D_idx2 = 0;
+  matches01[1].point2D_idx1 = 1;
+  matches01[1].point2D_idx2 = 1;
+  correspondence_graph.AddCorrespondences(0, 1, matches01);
+  FeatureMatches matches02(1);
+  matches02[0].point2D_idx1 = 0;
+  matches02[0].point2D_idx2 = 5;
+  correspondence_graph.AddCorrespondences(0, 2, matches02);
+  correspondence_graph.Finalize();
+
+  CorrespondenceGraph subgraph;
+  subgraph.LoadSubgraph(correspondence_graph, {0, 1});
+  BOOST_CHECK_EQUAL(subgraph.NumImages(), 2);
+  BOOST_CHECK(subgraph.ExistsImage(0));
+  BOOST_CHECK(subgraph.ExistsImage(1));
+  BOOST_CHECK(!subgraph.ExistsImage(2));
+  BOOST_CHECK_EQUAL(subgraph.NumObservationsForImage(0), 2);
+  BOOST_CHECK_EQUAL(subgraph.NumObservationsForImage(1), 2);
+  BOOST_CHECK_EQUAL(subgraph.NumCorrespondencesForImage(0), 2);
+  BOOST_CHECK_EQUAL(subgraph.NumCorrespondencesForImage(1), 2);
+  BOOST_CHECK_EQUAL(subgraph.NumCorrespondencesBetweenImages().size(), 1);
+  BOOST_CHECK_EQUAL(subgraph.NumCorrespondencesBetweenImages(0, 1), 2);
+  BOOST_CHECK_EQUAL(subgraph.NumCorrespondencesBetweenImages(0, 2), 0);
+  BOOST_CHECK_EQUAL(subgraph.FindCorrespondences(0, 0).size(), 1);
+  BOOST_CHECK_EQUAL(subgraph.FindCorrespondences(0, 0)[0].image_id, 1);
+
+  CorrespondenceGraph single_subgraph;
+  single_subgraph.LoadSubgraph(correspondence_graph, {2});
+  BOOST_CHECK_EQUAL(single_subgraph.NumImages(), 0);
+}
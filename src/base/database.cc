@@ -47,6 +47,12 @@ typedef Eigen::Matrix<uint8_t, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>
 typedef Eigen::Matrix<point2D_t, Eigen::Dynamic, 2, Eigen::RowMajor>
     FeatureMatchesBlob;
 
+// The descriptors of an image are stored in full or only as codes, and the
+// number of descriptors of each image is counted once.
+const char* kDescriptorRowsTable =
+    "(SELECT image_id, rows FROM descriptors UNION SELECT image_id, rows FROM "
+    "descriptor_codes)";
+
 void SwapFeatureMatchesBlob(FeatureMatchesBlob* matches) {
   matches->col(0).swap(matches->col(1));
 }
@@ -308,6 +314,14 @@ bool Database::ExistsDescriptors(const image_t image_id) const {
   return ExistsRowId(sql_stmt_exists_descriptors_, image_id);
 }
 
+bool Database::ExistsDescriptorCodes(const image_t image_id) const {
+  return ExistsRowId(sql_stmt_exists_descriptor_codes_, image_id);
+}
+
+bool Database::ExistsFullDescriptors(const image_t image_id) const {
+  return ExistsRowId(sql_stmt_exists_full_descriptors_, image_id);
+}
+
 bool Database::ExistsMatches(const image_t image_id1,
                              const image_t image_id2) const {
   return ExistsRowId(sql_stmt_exists_matches_,
@@ -335,11 +349,11 @@ size_t Database::NumKeypointsForImage(const image_t image_id) const {
 }
 
 size_t Database::NumDescriptors() const {
-  return SumColumn("rows", "descriptors");
+  return SumColumn("rows", kDescriptorRowsTable);
 }
 
 size_t Database::MaxNumDescriptors() const {
-  return MaxColumn("rows", "descriptors");
+  return MaxColumn("rows", kDescriptorRowsTable);
 }
 
 size_t Database::NumDescriptorsForImage(const image_t image_id) const {
@@ -451,9 +465,93 @@ FeatureDescriptors Database::ReadDescriptors(const image_t image_id) const {
 
   SQLITE3_CALL(sqlite3_reset(sql_stmt_read_descriptors_));
 
+  // Approximate the descriptors by their codes, if only the codes are stored.
+  if (rc != SQLITE_ROW && ExistsDescriptorCodes(image_id)) {
+    return ReadDescriptorCodes(image_id).Decode();
+  }
+
   return descriptors;
 }
 
+FeatureDescriptors Database::ReadDescriptorRows(
+    const image_t image_id, const std::vector<int>& rows) const {
+  SQLITE3_CALL(
+      sqlite3_bind_int64(sql_stmt_read_descriptors_size_, 1, image_id));
+
+  const int rc = SQLITE3_CALL(sqlite3_step(sql_stmt_read_descriptors_size_));
+  CHECK_EQ(rc, SQLITE_ROW) << "Image " << image_id
+                           << " has no full descriptors";
+  const int num_rows = static_cast<int>(
+      sqlite3_column_int64(sql_stmt_read_descriptors_size_, 0));
+  const int num_cols = static_cast<int>(
+      sqlite3_column_int64(sql_stmt_read_descriptors_size_, 1));
+
+  SQLITE3_CALL(sqlite3_reset(sql_stmt_read_descriptors_size_));
+
+  FeatureDescriptors descriptors(rows.size(), num_cols);
+  if (rows.empty()) {
+    return descriptors;
+  }
+
+  sqlite3_blob* blob = nullptr;
+  SQLITE3_CALL(sqlite3_blob_open(database_, "main", "descriptors", "data",
+                                 image_id, 0, &blob));
+
+  // Consecutive rows are read at once.
+  size_t begin = 0;
+  while (begin < rows.size()) {
+    CHECK_GE(rows[begin], 0);
+    CHECK_LT(rows[begin], num_rows);
+    size_t end = begin + 1;
+    while (end < rows.size() && rows[end] == rows[end - 1] + 1 &&
+           rows[end] < num_rows) {
+      ++end;
+    }
+    SQLITE3_CALL(sqlite3_blob_read(blob, descriptors.row(begin).data(),
+                                   static_cast<int>(end - begin) * num_cols,
+                                   rows[begin] * num_cols));
+    begin = end;
+  }
+
+  SQLITE3_CALL(sqlite3_blob_close(blob));
+
+  return descriptors;
+}
+
+FeatureDescriptorCodes Database::ReadDescriptorCodes(
+    const image_t image_id) const {
+  SQLITE3_CALL(
+      sqlite3_bind_int64(sql_stmt_read_descriptor_codes_, 1, image_id));
+
+  FeatureDescriptorCodes codes;
+
+  const int rc = SQLITE3_CALL(sqlite3_step(sql_stmt_read_descriptor_codes_));
+  if (rc == SQLITE_ROW) {
+    codes.format = static_cast<FeatureDescriptorCodes::Format>(
+        sqlite3_column_int64(sql_stmt_read_descriptor_codes_, 0));
+    if (codes.format == FeatureDescriptorCodes::Format::PQ_32x16) {
+      codes.codes = ReadDynamicMatrixBlob<FeatureDescriptors>(
+          sql_stmt_read_descriptor_codes_, rc, 1);
+      CHECK_EQ(codes.codes.cols(), FeatureDescriptorCodes::kNumCodeBytes);
+      codes.codebook.resize(FeatureDescriptorCodes::kNumSubspaces *
+                                FeatureDescriptorCodes::kNumCentroids,
+                            FeatureDescriptorCodes::kNumSubspaceDims);
+      const size_t num_bytes = static_cast<size_t>(
+          sqlite3_column_bytes(sql_stmt_read_descriptor_codes_, 4));
+      CHECK_EQ(num_bytes, codes.codebook.size());
+      memcpy(reinterpret_cast<char*>(codes.codebook.data()),
+             sqlite3_column_blob(sql_stmt_read_descriptor_codes_, 4),
+             num_bytes);
+    } else {
+      LOG(FATAL) << "Descriptor code format not supported";
+    }
+  }
+
+  SQLITE3_CALL(sqlite3_reset(sql_stmt_read_descriptor_codes_));
+
+  return codes;
+}
+
 FeatureMatches Database::ReadMatches(image_t image_id1,
                                      image_t image_id2) const {
   const image_pair_t pair_id = ImagePairToPairId(image_id1, image_id2);
@@ -670,6 +768,25 @@ void Database::WriteDescriptors(const image_t image_id,
   SQLITE3_CALL(sqlite3_reset(sql_stmt_write_descriptors_));
 }
 
+void Database::WriteDescriptorCodes(const image_t image_id,
+                                    const FeatureDescriptorCodes& codes) const {
+  CHECK(codes.format == FeatureDescriptorCodes::Format::PQ_32x16);
+  CHECK_EQ(codes.codebook.rows(), FeatureDescriptorCodes::kNumSubspaces *
+                                      FeatureDescriptorCodes::kNumCentroids);
+  CHECK_EQ(codes.codebook.cols(), FeatureDescriptorCodes::kNumSubspaceDims);
+  CHECK_EQ(codes.codes.cols(), FeatureDescriptorCodes::kNumCodeBytes);
+
+  SQLITE3_CALL(
+      sqlite3_bind_int64(sql_stmt_write_descriptor_codes_, 1, image_id));
+  SQLITE3_CALL(sqlite3_bind_int64(sql_stmt_write_descriptor_codes_, 2,
+                                  static_cast<int>(codes.format)));
+  WriteDynamicMatrixBlob(sql_stmt_write_descriptor_codes_, codes.codes, 3);
+  WriteStaticMatrixBlob(sql_stmt_write_descriptor_codes_, codes.codebook, 6);
+
+  SQLITE3_CALL(sqlite3_step(sql_stmt_write_descriptor_codes_));
+  SQLITE3_CALL(sqlite3_reset(sql_stmt_write_descriptor_codes_));
+}
+
 void Database::WriteMatches(const image_t image_id1, const image_t image_id2,
                             const FeatureMatches& matches) const {
   const image_pair_t pair_id = ImagePairToPairId(image_id1, image_id2);
@@ -842,9 +959,16 @@ void Database::Merge(const Database& database1, const Database& database2,
     const image_t new_image_id = merged_database->WriteImage(image);
     new_image_ids1.emplace(image.ImageId(), new_image_id);
     const auto keypoints = database1.ReadKeypoints(image.ImageId());
-    const auto descriptors = database1.ReadDescriptors(image.ImageId());
     merged_database->WriteKeypoints(new_image_id, keypoints);
-    merged_database->WriteDescriptors(new_image_id, descriptors);
+    if (database1.ExistsFullDescriptors(image.ImageId()) ||
+        !database1.ExistsDescriptorCodes(image.ImageId())) {
+      merged_database->WriteDescriptors(
+          new_image_id, database1.ReadDescriptors(image.ImageId()));
+    }
+    if (database1.ExistsDescriptorCodes(image.ImageId())) {
+      merged_database->WriteDescriptorCodes(
+          new_image_id, database1.ReadDescriptorCodes(image.ImageId()));
+    }
   }
 
   std::unordered_map<image_t, image_t> new_image_ids2;
@@ -857,9 +981,16 @@ void Database::Merge(const Database& database1, const Database& database2,
     const image_t new_image_id = merged_database->WriteImage(image);
     new_image_ids2.emplace(image.ImageId(), new_image_id);
     const auto keypoints = database2.ReadKeypoints(image.ImageId());
-    const auto descriptors = database2.ReadDescriptors(image.ImageId());
     merged_database->WriteKeypoints(new_image_id, keypoints);
-    merged_database->WriteDescriptors(new_image_id, descriptors);
+    if (database2.ExistsFullDescriptors(image.ImageId()) ||
+        !database2.ExistsDescriptorCodes(image.ImageId())) {
+      merged_database->WriteDescriptors(
+          new_image_id, database2.ReadDescriptors(image.ImageId()));
+    }
+    if (database2.ExistsDescriptorCodes(image.ImageId())) {
+      merged_database->WriteDescriptorCodes(
+          new_image_id, database2.ReadDescriptorCodes(image.ImageId()));
+    }
   }
 
   // Merge the matches.
@@ -942,7 +1073,10 @@ void Database::PrepareSQLStatements() {
                                   &sql_stmt_num_keypoints_, 0));
   sql_stmts_.push_back(sql_stmt_num_keypoints_);
 
-  sql = "SELECT rows FROM descriptors WHERE image_id = ?;";
+  // The descriptors of an image are stored in full or only as codes.
+  sql =
+      "SELECT rows FROM descriptors WHERE image_id = ?1 UNION ALL "
+      "SELECT rows FROM descriptor_codes WHERE image_id = ?1 LIMIT 1;";
   SQLITE3_CALL(sqlite3_prepare_v2(database_, sql.c_str(), -1,
                                   &sql_stmt_num_descriptors_, 0));
   sql_stmts_.push_back(sql_stmt_num_descriptors_);
@@ -970,11 +1104,23 @@ void Database::PrepareSQLStatements() {
                                   &sql_stmt_exists_keypoints_, 0));
   sql_stmts_.push_back(sql_stmt_exists_keypoints_);
 
-  sql = "SELECT 1 FROM descriptors WHERE image_id = ?;";
+  sql =
+      "SELECT 1 FROM descriptors WHERE image_id = ?1 UNION ALL "
+      "SELECT 1 FROM descriptor_codes WHERE image_id = ?1 LIMIT 1;";
   SQLITE3_CALL(sqlite3_prepare_v2(database_, sql.c_str(), -1,
                                   &sql_stmt_exists_descriptors_, 0));
   sql_stmts_.push_back(sql_stmt_exists_descriptors_);
 
+  sql = "SELECT 1 FROM descriptors WHERE image_id = ?;";
+  SQLITE3_CALL(sqlite3_prepare_v2(database_, sql.c_str(), -1,
+                                  &sql_stmt_exists_full_descriptors_, 0));
+  sql_stmts_.push_back(sql_stmt_exists_full_descriptors_);
+
+  sql = "SELECT 1 FROM descriptor_codes WHERE image_id = ?;";
+  SQLITE3_CALL(sqlite3_prepare_v2(database_, sql.c_str(), -1,
+                                  &sql_stmt_exists_descriptor_codes_, 0));
+  sql_stmts_.push_back(sql_stmt_exists_descriptor_codes_);
+
   sql = "SELECT 1 FROM matches WHERE pair_id = ?;";
   SQLITE3_CALL(sqlite3_prepare_v2(database_, sql.c_str(), -1,
                                   &sql_stmt_exists_matches_, 0));
@@ -1059,6 +1205,18 @@ void Database::PrepareSQLStatements() {
                                   &sql_stmt_read_descriptors_, 0));
   sql_stmts_.push_back(sql_stmt_read_descriptors_);
 
+  sql =
+      "SELECT format, rows, cols, data, codebook FROM descriptor_codes WHERE "
+      "image_id = ?;";
+  SQLITE3_CALL(sqlite3_prepare_v2(database_, sql.c_str(), -1,
+                                  &sql_stmt_read_descriptor_codes_, 0));
+  sql_stmts_.push_back(sql_stmt_read_descriptor_codes_);
+
+  sql = "SELECT rows, cols FROM descriptors WHERE image_id = ?;";
+  SQLITE3_CALL(sqlite3_prepare_v2(database_, sql.c_str(), -1,
+                                  &sql_stmt_read_descriptors_size_, 0));
+  sql_stmts_.push_back(sql_stmt_read_descriptors_size_);
+
   sql = "SELECT rows, cols, data FROM matches WHERE pair_id = ?;";
   SQLITE3_CALL(sqlite3_prepare_v2(database_, sql.c_str(), -1,
                                   &sql_stmt_read_matches_, 0));
@@ -1101,6 +1259,13 @@ void Database::PrepareSQLStatements() {
                                   &sql_stmt_write_descriptors_, 0));
   sql_stmts_.push_back(sql_stmt_write_descriptors_);
 
+  sql =
+      "INSERT INTO descriptor_codes(image_id, format, rows, cols, data, "
+      "codebook) VALUES(?, ?, ?, ?, ?, ?);";
+  SQLITE3_CALL(sqlite3_prepare_v2(database_, sql.c_str(), -1,
+                                  &sql_stmt_write_descriptor_codes_, 0));
+  sql_stmts_.push_back(sql_stmt_write_descriptor_codes_);
+
   sql = "INSERT INTO matches(pair_id, rows, cols, data) VALUES(?, ?, ?, ?);";
   SQLITE3_CALL(sqlite3_prepare_v2(database_, sql.c_str(), -1,
                                   &sql_stmt_write_matches_, 0));
@@ -1151,6 +1316,7 @@ void Database::CreateTables() const {
   CreateImageTable();
   CreateKeypointsTable();
   CreateDescriptorsTable();
+  CreateDescriptorCodesTable();
   CreateMatchesTable();
   CreateTwoViewGeometriesTable();
 }
@@ -1213,6 +1379,20 @@ void Database::CreateDescriptorsTable() const {
   SQLITE3_EXEC(database_, sql.c_str(), nullptr);
 }
 
+void Database::CreateDescriptorCodesTable() const {
+  const std::string sql =
+      "CREATE TABLE IF NOT EXISTS descriptor_codes"
+      "   (image_id  INTEGER  PRIMARY KEY  NOT NULL,"
+      "    format    INTEGER               NOT NULL,"
+      "    rows      INTEGER               NOT NULL,"
+      "    cols      INTEGER               NOT NULL,"
+      "    data      BLOB,"
+      "    codebook  BLOB,"
+      "FOREIGN KEY(image_id) REFERENCES images(image_id) ON DELETE CASCADE);";
+
+  SQLITE3_EXEC(database_, sql.c_str(), nullptr);
+}
+
 void Database::CreateMatchesTable() const {
   const std::string sql =
       "CREATE TABLE IF NOT EXISTS matches"
@@ -78,6 +78,11 @@ class Database {
   bool ExistsImageWithName(std::string name) const;
   bool ExistsKeypoints(const image_t image_id) const;
   bool ExistsDescriptors(const image_t image_id) const;
+  bool ExistsDescriptorCodes(const image_t image_id) const;
+
+  // Check if the full descriptors of an image are stored, as opposed to only
+  // their codes, which are also reported by `ExistsDescriptors`.
+  bool ExistsFullDescriptors(const image_t image_id) const;
   bool ExistsMatches(const image_t image_id1, const image_t image_id2) const;
   bool ExistsInlierMatches(const image_t image_id1,
                            const image_t image_id2) const;
@@ -97,8 +102,8 @@ class Database {
   // Number of descriptors for specific image.
   size_t NumKeypointsForImage(const image_t image_id) const;
 
-  // Sum of `rows` column in `descriptors` table,
-  // i.e. number of total descriptors.
+  // Sum of `rows` column in `descriptors` and `descriptor_codes` table,
+  // i.e. number of total descriptors, counting each image once.
   size_t NumDescriptors() const;
 
   // The number of descriptors for the image with most features.
@@ -148,6 +153,13 @@ class Database {
 
   FeatureKeypoints ReadKeypoints(const image_t image_id) const;
   FeatureDescriptors ReadDescriptors(const image_t image_id) const;
+  FeatureDescriptorCodes ReadDescriptorCodes(const image_t image_id) const;
+
+  // Read only the given rows of the full descriptors of an image in the given
+  // order. The rows are read incrementally from the blob, which is much faster
+  // than `ReadDescriptors` if only a small subset of the rows is required.
+  FeatureDescriptors ReadDescriptorRows(const image_t image_id,
+                                        const std::vector<int>& rows) const;
 
   FeatureMatches ReadMatches(const image_t image_id1,
                              const image_t image_id2) const;
@@ -181,6 +193,8 @@ class Database {
                       const FeatureKeypoints& keypoints) const;
   void WriteDescriptors(const image_t image_id,
                         const FeatureDescriptors& descriptors) const;
+  void WriteDescriptorCodes(const image_t image_id,
+                            const FeatureDescriptorCodes& codes) const;
   void WriteMatches(const image_t image_id1, const image_t image_id2,
                     const FeatureMatches& matches) const;
   void WriteTwoViewGeometry(const image_t image_id1, const image_t image_id2,
@@ -233,6 +247,7 @@ class Database {
   void CreateImageTable() const;
   void CreateKeypointsTable() const;
   void CreateDescriptorsTable() const;
+  void CreateDescriptorCodesTable() const;
   void CreateMatchesTable() const;
   void CreateTwoViewGeometriesTable() const;
 
@@ -277,6 +292,8 @@ class Database {
   sqlite3_stmt* sql_stmt_exists_image_name_ = nullptr;
   sqlite3_stmt* sql_stmt_exists_keypoints_ = nullptr;
   sqlite3_stmt* sql_stmt_exists_descriptors_ = nullptr;
+  sqlite3_stmt* sql_stmt_exists_descriptor_codes_ = nullptr;
+  sqlite3_stmt* sql_stmt_exists_full_descriptors_ = nullptr;
   sqlite3_stmt* sql_stmt_exists_matches_ = nullptr;
   sqlite3_stmt* sql_stmt_exists_two_view_geometry_ = nullptr;
 
@@ -296,6 +313,8 @@ class Database {
   sqlite3_stmt* sql_stmt_read_images_ = nullptr;
   sqlite3_stmt* sql_stmt_read_keypoints_ = nullptr;
   sqlite3_stmt* sql_stmt_read_descriptors_ = nullptr;
+  sqlite3_stmt* sql_stmt_read_descriptor_codes_ = nullptr;
+  sqlite3_stmt* sql_stmt_read_descriptors_size_ = nullptr;
   sqlite3_stmt* sql_stmt_read_matches_ = nullptr;
   sqlite3_stmt* sql_stmt_read_matches_all_ = nullptr;
   sqlite3_stmt* sql_stmt_read_two_view_geometry_ = nullptr;
@@ -305,6 +324,7 @@ class Database {
   // write_*
   sqlite3_stmt* sql_stmt_write_keypoints_ = nullptr;
   sqlite3_stmt* sql_stmt_write_descriptors_ = nullptr;
+  sqlite3_stmt* sql_stmt_write_descriptor_codes_ = nullptr;
   sqlite3_stmt* sql_stmt_write_matches_ = nullptr;
   sqlite3_stmt* sql_stmt_write_two_view_geometry_ = nullptr;
 
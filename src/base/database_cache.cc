@@ -203,6 +203,58 @@ void DatabaseCache::Load(const Database& database, const size_t min_num_matches,
             << std::endl;
 }
 
+void DatabaseCache::Load(const DatabaseCache& database_cache,
+                         const std::unordered_set<std::string>& image_names) {
+  Timer timer;
+  timer.Start();
+  std::cout << "Loading subset of cached images..." << std::flush;
+
+  cameras_ = database_cache.cameras_;
+
+  // Determines for which images data should be loaded.
+  std::unordered_set<image_t> image_ids;
+  for (const auto& image : database_cache.images_) {
+    if (image_names.empty() || image_names.count(image.second.Name()) > 0) {
+      image_ids.insert(image.first);
+    }
+  }
+
+  // Collect all images that are connected in the correspondence graph. The
+  // other cache only contains image pairs that satisfy the match criteria.
+  std::unordered_set<image_t> connected_image_ids;
+  connected_image_ids.reserve(image_ids.size());
+  for (const auto& image_pair :
+       database_cache.correspondence_graph_.NumCorrespondencesBetweenImages()) {
+    image_t image_id1;
+    image_t image_id2;
+    Database::PairIdToImagePair(image_pair.first, &image_id1, &image_id2);
+    if (image_ids.count(image_id1) > 0 && image_ids.count(image_id2) > 0) {
+      connected_image_ids.insert(image_id1);
+      connected_image_ids.insert(image_id2);
+    }
+  }
+
+  images_.reserve(connected_image_ids.size());
+  for (const auto image_id : connected_image_ids) {
+    images_.emplace(image_id, database_cache.images_.at(image_id));
+  }
+
+  correspondence_graph_.LoadSubgraph(database_cache.correspondence_graph_,
+                                     connected_image_ids);
+
+  // Set number of observations and correspondences per image.
+  for (auto& image : images_) {
+    image.second.SetNumObservations(
+        correspondence_graph_.NumObservationsForImage(image.first));
+    image.second.SetNumCorrespondences(
+        correspondence_graph_.NumCorrespondencesForImage(image.first));
+  }
+
+  std::cout << StringPrintf(" %d in %.3fs", images_.size(),
+                            timer.ElapsedSeconds())
+            << std::endl;
+}
+
 const class Image* DatabaseCache::FindImageWithName(
     const std::string& name) const {
   for (const auto& image : images_) {
@@ -92,6 +92,18 @@ class DatabaseCache {
             const bool ignore_watermarks,
             const std::unordered_set<std::string>& image_names);
 
+  // Load cameras, images, features, and matches for a subset of the images
+  // from another cache, which avoids reading the database again, e.g., when
+  // reconstructing multiple clusters of the same scene. The result is the same
+  // as loading the subset from the database with the same parameters that
+  // were used to load the other cache from the database.
+  //
+  // @param database_cache        Source cache loaded for all images.
+  // @param image_names           Whether to use only load the data for a subset
+  //                              of the images. All images are used if empty.
+  void Load(const DatabaseCache& database_cache,
+            const std::unordered_set<std::string>& image_names);
+
   // Find specific image by name. Note that this uses linear search.
   const class Image* FindImageWithName(const std::string& name) const;
 
@@ -279,6 +279,54 @@ BOOST_AUTO_TEST_CASE(TestDescriptors) {
   BOOST_CHECK_EQUAL(database.NumDescriptorsForImage(image.ImageId()), 20);
 }
 
+BOOST_AUTO_TEST_CASE(TestDescriptorCodes) {
+  Database database(kMemoryDatabasePath);
+  Camera camera;
+  camera.SetCameraId(database.WriteCamera(camera));
+  Image image;
+  image.SetName("test");
+  image.SetCameraId(camera.CameraId());
+  image.SetImageId(database.WriteImage(image));
+  BOOST_CHECK(!database.ExistsDescriptorCodes(image.ImageId()));
+  BOOST_CHECK(database.ReadDescriptorCodes(image.ImageId()).format ==
+              FeatureDescriptorCodes::Format::UNDEFINED);
+  FeatureDescriptorCodes codes;
+  codes.format = FeatureDescriptorCodes::Format::PQ_32x16;
+  codes.codebook = FeatureDescriptors::Random(32 * 16, 4);
+  codes.codes = FeatureDescriptors::Random(10, 16);
+  database.WriteDescriptorCodes(image.ImageId(), codes);
+  BOOST_CHECK(database.ExistsDescriptorCodes(image.ImageId()));
+  const FeatureDescriptorCodes codes_read =
+      database.ReadDescriptorCodes(image.ImageId());
+  BOOST_CHECK(codes_read.format == codes.format);
+  BOOST_CHECK_EQUAL(codes_read.codebook, codes.codebook);
+  BOOST_CHECK_EQUAL(codes_read.codes, codes.codes);
+  // Without full descriptors, the decoded descriptors are read.
+  BOOST_CHECK(database.ExistsDescriptors(image.ImageId()));
+  BOOST_CHECK(!database.ExistsFullDescriptors(image.ImageId()));
+  BOOST_CHECK_EQUAL(database.NumDescriptors(), 10);
+  BOOST_CHECK_EQUAL(database.MaxNumDescriptors(), 10);
+  BOOST_CHECK_EQUAL(database.NumDescriptorsForImage(image.ImageId()), 10);
+  BOOST_CHECK_EQUAL(database.ReadDescriptors(image.ImageId()), codes.Decode());
+  // The descriptors of an image are counted once.
+  const FeatureDescriptors descriptors = FeatureDescriptors::Random(10, 128);
+  database.WriteDescriptors(image.ImageId(), descriptors);
+  BOOST_CHECK(database.ExistsFullDescriptors(image.ImageId()));
+  BOOST_CHECK_EQUAL(database.NumDescriptors(), 10);
+  BOOST_CHECK_EQUAL(database.NumDescriptorsForImage(image.ImageId()), 10);
+  BOOST_CHECK_EQUAL(database.ReadDescriptors(image.ImageId()), descriptors);
+  const std::vector<int> rows = {0, 1, 2, 7, 9, 4};
+  const FeatureDescriptors descriptor_rows =
+      database.ReadDescriptorRows(image.ImageId(), rows);
+  BOOST_CHECK_EQUAL(descriptor_rows.rows(), rows.size());
+  for (size_t i = 0; i < rows.size(); ++i) {
+    BOOST_CHECK_EQUAL(descriptor_rows.row(i), descriptors.row(rows[i]));
+  }
+  BOOST_CHECK_EQUAL(
+      database.ReadDescriptorRows(image.ImageId(), std::vector<int>()).rows(),
+      0);
+}
+
 BOOST_AUTO_TEST_CASE(TestMatches) {
   Database database(kMemoryDatabasePath);
   const image_t image_id1 = 1;
@@ -49,50 +49,18 @@ namespace {
 // Wrapper class for weighted, undirected Graclus graph.
 class GraclusGraph {
  public:
-  GraclusGraph(const std::vector<std::pair<int, int>>& edges,
-               const std::vector<int>& weights) {
-    CHECK_EQ(edges.size(), weights.size());
-
-    std::unordered_map<int, std::vector<std::pair<int, int>>> adjacency_list;
-    for (size_t i = 0; i < edges.size(); ++i) {
-      const auto& edge = edges[i];
-      const auto weight = weights[i];
-      const int vertex_idx1 = GetVertexIdx(edge.first);
-      const int vertex_idx2 = GetVertexIdx(edge.second);
-      adjacency_list[vertex_idx1].emplace_back(vertex_idx2, weight);
-      adjacency_list[vertex_idx2].emplace_back(vertex_idx1, weight);
-    }
-
-    xadj_.reserve(vertex_id_to_idx_.size() + 1);
-    adjncy_.reserve(2 * edges.size());
-    adjwgt_.reserve(2 * edges.size());
-
-    idxtype edge_idx = 0;
-    for (size_t i = 0; i < vertex_id_to_idx_.size(); ++i) {
-      xadj_.push_back(edge_idx);
-
-      if (adjacency_list.count(i) == 0) {
-        continue;
-      }
-
-      for (const auto& edge : adjacency_list[i]) {
-        edge_idx += 1;
-        adjncy_.push_back(edge.first);
-        adjwgt_.push_back(edge.second);
-      }
-    }
-
-    xadj_.push_back(edge_idx);
-
-    CHECK_EQ(edge_idx, 2 * edges.size());
-    CHECK_EQ(xadj_.size(), vertex_id_to_idx_.size() + 1);
-    CHECK_EQ(adjncy_.size(), 2 * edges.size());
-    CHECK_EQ(adjwgt_.size(), 2 * edges.size());
+  explicit GraclusGraph(const CSRGraph& graph)
+      : xadj_(graph.xadj.begin(), graph.xadj.end()),
+        adjncy_(graph.adjncy.begin(), graph.adjncy.end()),
+        adjwgt_(graph.adjwgt.begin(), graph.adjwgt.end()) {
+    CHECK_EQ(xadj_.size(), graph.NumVertices() + 1);
+    CHECK_EQ(xadj_.back(), adjncy_.size());
+    CHECK_EQ(adjncy_.size(), adjwgt_.size());
 
     data.gdata = data.rdata = nullptr;
 
-    data.nvtxs = vertex_id_to_idx_.size();
-    data.nedges = 2 * edges.size();
+    data.nvtxs = graph.NumVertices();
+    data.nedges = adjncy_.size();
     data.mincut = data.minvol = -1;
 
     data.xadj = xadj_.data();
@@ -121,25 +89,9 @@ class GraclusGraph {
     data.coarser = data.finer = nullptr;
   }
 
-  int GetVertexIdx(const int id) {
-    const auto it = vertex_id_to_idx_.find(id);
-    if (it == vertex_id_to_idx_.end()) {
-      const int idx = vertex_id_to_idx_.size();
-      vertex_id_to_idx_.emplace(id, idx);
-      vertex_idx_to_id_.emplace(idx, id);
-      return idx;
-    } else {
-      return it->second;
-    }
-  }
-
-  int GetVertexId(const int idx) { return vertex_idx_to_id_.at(idx); }
-
   GraphType data;
 
  private:
-  std::unordered_map<int, int> vertex_id_to_idx_;
-  std::unordered_map<int, int> vertex_idx_to_id_;
   std::vector<idxtype> xadj_;
   std::vector<idxtype> adjncy_;
   std::vector<idxtype> adjwgt_;
@@ -183,15 +135,84 @@ void ComputeMinGraphCutStoerWagner(
   }
 }
 
+CSRGraph BuildCSRGraph(const std::vector<std::pair<int, int>>& edges,
+                       const std::vector<int>& weights,
+                       std::vector<int>* vertex_ids) {
+  CHECK_EQ(edges.size(), weights.size());
+
+  std::unordered_map<int, int> vertex_id_to_idx;
+  vertex_ids->clear();
+  std::vector<std::pair<int, int>> edge_idxs;
+  edge_idxs.reserve(edges.size());
+  for (const auto& edge : edges) {
+    int vertex_idxs[2];
+    for (const int k : {0, 1}) {
+      const int vertex_id = k == 0 ? edge.first : edge.second;
+      const auto it = vertex_id_to_idx.emplace(vertex_id, vertex_ids->size());
+      if (it.second) {
+        vertex_ids->push_back(vertex_id);
+      }
+      vertex_idxs[k] = it.first->second;
+    }
+    edge_idxs.emplace_back(vertex_idxs[0], vertex_idxs[1]);
+  }
+
+  const size_t num_vertices = vertex_ids->size();
+
+  // Counting sort of the edges by vertex, such that the neighbors of each
+  // vertex are in the order of the edges.
+  CSRGraph graph;
+  graph.xadj.resize(num_vertices + 1, 0);
+  for (const auto& edge : edge_idxs) {
+    graph.xadj[edge.first + 1] += 1;
+    graph.xadj[edge.second + 1] += 1;
+  }
+  for (size_t i = 0; i < num_vertices; ++i) {
+    graph.xadj[i + 1] += graph.xadj[i];
+  }
+
+  graph.adjncy.resize(2 * edges.size());
+  graph.adjwgt.resize(2 * edges.size());
+  std::vector<int> offsets(graph.xadj.begin(), graph.xadj.end() - 1);
+  for (size_t i = 0; i < edge_idxs.size(); ++i) {
+    const auto& edge = edge_idxs[i];
+    const int offset1 = offsets[edge.first]++;
+    graph.adjncy[offset1] = edge.second;
+    graph.adjwgt[offset1] = weights[i];
+    const int offset2 = offsets[edge.second]++;
+    graph.adjncy[offset2] = edge.first;
+    graph.adjwgt[offset2] = weights[i];
+  }
+
+  return graph;
+}
+
 std::unordered_map<int, int> ComputeNormalizedMinGraphCut(
     const std::vector<std::pair<int, int>>& edges,
     const std::vector<int>& weights, const int num_parts) {
-  GraclusGraph graph(edges, weights);
+  std::vector<int> vertex_ids;
+  const CSRGraph graph = BuildCSRGraph(edges, weights, &vertex_ids);
 
-  const int levels =
-      amax((graph.data.nvtxs) / (40 * log2_metis(num_parts)), 20 * (num_parts));
+  const std::vector<int> cut_labels =
+      ComputeNormalizedMinGraphCut(graph, num_parts);
 
-  std::vector<idxtype> cut_labels(graph.data.nvtxs);
+  std::unordered_map<int, int> labels;
+  for (size_t idx = 0; idx < cut_labels.size(); ++idx) {
+    labels.emplace(vertex_ids[idx], cut_labels[idx]);
+  }
+
+  return labels;
+}
+
+std::vector<int> ComputeNormalizedMinGraphCut(const CSRGraph& graph,
+                                              const int num_parts) {
+  GraclusGraph graclus_graph(graph);
+
+  const int levels = amax((graclus_graph.data.nvtxs) /
+                              (40 * log2_metis(num_parts)),
+                          20 * (num_parts));
+
+  std::vector<idxtype> cut_labels(graclus_graph.data.nvtxs);
 
   int options[11];
   options[0] = 0;
@@ -201,22 +222,19 @@ std::unordered_map<int, int> ComputeNormalizedMinGraphCut(
   int edgecut;
   int var_num_parts = num_parts;
 
-  MLKKM_PartGraphKway(&graph.data.nvtxs, graph.data.xadj, graph.data.adjncy,
-                      graph.data.vwgt, graph.data.adjwgt, &wgtflag, &numflag,
+  MLKKM_PartGraphKway(&graclus_graph.data.nvtxs, graclus_graph.data.xadj,
+                      graclus_graph.data.adjncy, graclus_graph.data.vwgt,
+                      graclus_graph.data.adjwgt, &wgtflag, &numflag,
                       &var_num_parts, &chain_length, options, &edgecut,
                       cut_labels.data(), levels);
 
   float lbvec[MAXNCON];
-  ComputePartitionBalance(&graph.data, num_parts, cut_labels.data(), lbvec);
+  ComputePartitionBalance(&graclus_graph.data, num_parts, cut_labels.data(),
+                          lbvec);
 
-  ComputeNCut(&graph.data, &cut_labels[0], num_parts);
+  ComputeNCut(&graclus_graph.data, &cut_labels[0], num_parts);
 
-  std::unordered_map<int, int> labels;
-  for (size_t idx = 0; idx < cut_labels.size(); ++idx) {
-    labels.emplace(graph.GetVertexId(idx), cut_labels[idx]);
-  }
-
-  return labels;
+  return std::vector<int>(cut_labels.begin(), cut_labels.end());
 }
 
 }  // namespace colmap
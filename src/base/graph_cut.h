@@ -50,12 +50,37 @@ void ComputeMinGraphCutStoerWagner(
     const std::vector<int>& weights, int* cut_weight,
     std::vector<char>* cut_labels);
 
+// Undirected, weighted graph in compressed sparse row (CSR) format. The
+// neighbors of vertex i and the weights of the corresponding edges are stored
+// at the indices xadj[i], ..., xadj[i + 1] - 1 of adjncy and adjwgt, where
+// every edge is stored once for each of its two vertices.
+struct CSRGraph {
+  std::vector<int> xadj;
+  std::vector<int> adjncy;
+  std::vector<int> adjwgt;
+
+  inline int NumVertices() const;
+  inline size_t NumEdges() const;
+};
+
+// Build the CSR graph from a list of edges between arbitrary vertex ids. The
+// vertices are indexed in the order of their first occurrence in the edges and
+// the ids of the vertex indices are returned in vertex_ids.
+CSRGraph BuildCSRGraph(const std::vector<std::pair<int, int>>& edges,
+                       const std::vector<int>& weights,
+                       std::vector<int>* vertex_ids);
+
 // Compute the normalized min-cut of an undirected graph using Graclus.
 // Partitions the graph into clusters and returns the cluster labels per vertex.
 std::unordered_map<int, int> ComputeNormalizedMinGraphCut(
     const std::vector<std::pair<int, int>>& edges,
     const std::vector<int>& weights, const int num_parts);
 
+// Same as above for a graph in CSR format with the labels per vertex index.
+// The graph must not contain vertices without edges.
+std::vector<int> ComputeNormalizedMinGraphCut(const CSRGraph& graph,
+                                              const int num_parts);
+
 // Compute the minimum graph cut of a directed S-T graph using the
 // Boykov-Kolmogorov max-flow min-cut algorithm, as descibed in:
 //   "An Experimental Comparison of Min-Cut/Max-Flow Algorithms for Energy
@@ -111,6 +136,12 @@ class MinSTGraphCut {
 // Implementation
 ////////////////////////////////////////////////////////////////////////////////
 
+int CSRGraph::NumVertices() const {
+  return xadj.empty() ? 0 : static_cast<int>(xadj.size()) - 1;
+}
+
+size_t CSRGraph::NumEdges() const { return adjncy.size() / 2; }
+
 template <typename node_t, typename value_t>
 MinSTGraphCut<node_t, value_t>::MinSTGraphCut(const size_t num_nodes)
     : S_node_(num_nodes), T_node_(num_nodes + 1), graph_(num_nodes + 2) {}
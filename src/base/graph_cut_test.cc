@@ -100,6 +100,19 @@ BOOST_AUTO_TEST_CASE(TestComputeMinGraphCutStoerWagnerDisconnected) {
   }
 }
 
+BOOST_AUTO_TEST_CASE(TestBuildCSRGraph) {
+  const std::vector<std::pair<int, int>> edges = {{5, 2}, {2, 7}, {5, 7}};
+  const std::vector<int> weights = {1, 2, 3};
+  std::vector<int> vertex_ids;
+  const CSRGraph graph = BuildCSRGraph(edges, weights, &vertex_ids);
+  BOOST_CHECK_EQUAL(graph.NumVertices(), 3);
+  BOOST_CHECK_EQUAL(graph.NumEdges(), 3);
+  BOOST_CHECK(vertex_ids == std::vector<int>({5, 2, 7}));
+  BOOST_CHECK(graph.xadj == std::vector<int>({0, 2, 4, 6}));
+  BOOST_CHECK(graph.adjncy == std::vector<int>({1, 2, 0, 2, 1, 0}));
+  BOOST_CHECK(graph.adjwgt == std::vector<int>({1, 3, 1, 2, 2, 3}));
+}
+
 BOOST_AUTO_TEST_CASE(TestComputeNormalizedMinGraphCut) {
   const std::vector<std::pair<int, int>> edges = {
       {3, 4}, {3, 6}, {3, 5}, {0, 4}, {0, 1}, {0, 6}, {0, 7}, {0, 5},
@@ -152,6 +165,22 @@ BOOST_AUTO_TEST_CASE(TestComputeNormalizedMinGraphCutDisconnected) {
   }
 }
 
+BOOST_AUTO_TEST_CASE(TestComputeNormalizedMinGraphCutCSR) {
+  const std::vector<std::pair<int, int>> edges = {
+      {3, 4}, {3, 6}, {3, 5}, {0, 4}, {0, 1}, {0, 6}, {0, 7}, {0, 5},
+      {0, 2}, {4, 1}, {1, 6}, {1, 5}, {6, 7}, {7, 5}, {5, 2}, {3, 4}};
+  const std::vector<int> weights = {0, 3, 1, 3,  1, 2, 6, 1,
+                                    8, 1, 1, 80, 2, 1, 1, 4};
+  std::vector<int> vertex_ids;
+  const CSRGraph graph = BuildCSRGraph(edges, weights, &vertex_ids);
+  const auto cut_labels = ComputeNormalizedMinGraphCut(graph, 3);
+  BOOST_CHECK_EQUAL(cut_labels.size(), 8);
+  for (const auto label : cut_labels) {
+    BOOST_CHECK_GE(label, 0);
+    BOOST_CHECK_LT(label, 3);
+  }
+}
+
 BOOST_AUTO_TEST_CASE(TestMinSTGraphCut1) {
   MinSTGraphCut<int, int> graph(2);
   BOOST_CHECK_EQUAL(graph.NumNodes(), 2);
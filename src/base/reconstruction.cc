@@ -44,9 +44,32 @@
 #include "util/bitmap.h"
 #include "util/misc.h"
 #include "util/ply.h"
+#include "util/threading.h"
 #include <cmath>
 
 namespace colmap {
+  namespace {
+
+    // Number of points checked per task in the parallel filtering passes.
+    const size_t kPoints3DGrainSize = 256;
+
+    // Call func(i) for all i in [0, num_items), in parallel if more than one
+    // thread is requested. The calls must only read the shared state.
+    template <typename func_t>
+    void ParallelScan(const int num_threads, const size_t num_items,
+      const size_t grain_size, const func_t& func) {
+      if (GetEffectiveNumThreads(num_threads) == 1 || num_items <= grain_size) {
+        for (size_t i = 0; i < num_items; ++i) {
+          func(i);
+        }
+        return;
+      }
+
+      ThreadPool thread_pool(num_threads);
+      thread_pool.ParallelFor(0, num_items, func, grain_size);
+    }
+
+  }  // namespace
 
   Reconstruction::Reconstruction()
     : correspondence_graph_(nullptr), num_added_points3D_(0) {
@@ -63,6 +86,10 @@ namespace colmap {
     return point3D_ids;
   }
 
+  void Reconstruction::ClearImagesWithChangedVisibility() {
+    images_with_changed_visibility_.clear();
+  }
+
   void Reconstruction::Load(const DatabaseCache& database_cache) {
     correspondence_graph_ = nullptr;
 
@@ -111,6 +138,7 @@ namespace colmap {
     CHECK_NOTNULL(correspondence_graph);
     for (auto& image : images_) {
       image.second.SetUp(Camera(image.second.CameraId()));
+      images_with_changed_visibility_.insert(image.first);
     }
     correspondence_graph_ = correspondence_graph;
 
@@ -170,6 +198,7 @@ namespace colmap {
   void Reconstruction::AddImage(const class Image& image) {
     CHECK(!ExistsImage(image.ImageId()));
     images_[image.ImageId()] = image;
+    images_with_changed_visibility_.insert(image.ImageId());
   }
 
   point3D_t Reconstruction::AddPoint3D(const Eigen::Vector3d& xyz,
@@ -302,6 +331,7 @@ namespace colmap {
       new_image.SetTvec(image.second.Tvec());
       new_image.SetTvecPrior(image.second.TvecPrior());
       image.second = new_image;
+      images_with_changed_visibility_.insert(image.first);
     }
   }
 
@@ -310,6 +340,7 @@ namespace colmap {
     if (!image.IsRegistered()) {
       image.SetRegistered(true);
       reg_image_ids_.push_back(image_id);
+      images_with_changed_visibility_.insert(image_id);
     }
   }
 
@@ -328,6 +359,7 @@ namespace colmap {
     reg_image_ids_.erase(
       std::remove(reg_image_ids_.begin(), reg_image_ids_.end(), image_id),
       reg_image_ids_.end());
+    images_with_changed_visibility_.insert(image_id);
   }
 
   void Reconstruction::Normalize(const double extent, const double p0,
@@ -616,6 +648,14 @@ namespace colmap {
       return false;
     }
 
+    Merge(reconstruction, alignment, max_reproj_error);
+
+    return true;
+  }
+
+  void Reconstruction::Merge(const Reconstruction& reconstruction,
+    const Eigen::Matrix3x4d& alignment,
+    const double max_reproj_error) {
     const SimilarityTransform3 tform(alignment);
 
     // Find common and missing images in the two reconstructions.
@@ -693,9 +733,8 @@ namespace colmap {
       }
     }
 
-    FilterPoints3DWithLargeReprojectionError(max_reproj_error, Point3DIds());
-
-    return true;
+    FilterPoints3DWithLargeReprojectionError(max_reproj_error, Point3DIds(),
+      /*num_threads=*/1);
   }
 
   bool Reconstruction::Align(const std::vector<std::string>& image_names,
@@ -853,18 +892,18 @@ namespace colmap {
 
   size_t Reconstruction::FilterPoints3D(
     const double max_reproj_error, const double min_tri_angle,
-    const std::unordered_set<point3D_t>& point3D_ids) {
+    const std::unordered_set<point3D_t>& point3D_ids, const int num_threads) {
     size_t num_filtered = 0;
-    num_filtered +=
-      FilterPoints3DWithLargeReprojectionError(max_reproj_error, point3D_ids);
-    num_filtered +=
-      FilterPoints3DWithSmallTriangulationAngle(min_tri_angle, point3D_ids);
+    num_filtered += FilterPoints3DWithLargeReprojectionError(
+      max_reproj_error, point3D_ids, num_threads);
+    num_filtered += FilterPoints3DWithSmallTriangulationAngle(
+      min_tri_angle, point3D_ids, num_threads);
     return num_filtered;
   }
 
   size_t Reconstruction::FilterPoints3DInImages(
     const double max_reproj_error, const double min_tri_angle,
-    const std::unordered_set<image_t>& image_ids) {
+    const std::unordered_set<image_t>& image_ids, const int num_threads) {
     std::unordered_set<point3D_t> point3D_ids;
     for (const image_t image_id : image_ids) {
       const class Image& image = Image(image_id);
@@ -874,21 +913,22 @@ namespace colmap {
         }
       }
     }
-    return FilterPoints3D(max_reproj_error, min_tri_angle, point3D_ids);
+    return FilterPoints3D(max_reproj_error, min_tri_angle, point3D_ids,
+      num_threads);
   }
 
   size_t Reconstruction::FilterAllPoints3D(const double max_reproj_error,
-    const double min_tri_angle) {
+    const double min_tri_angle, const int num_threads) {
     // Important: First filter observations and points with large reprojection
     // error, so that observations with large reprojection error do not make
     // a point stable through a large triangulation angle.
     const std::unordered_set<point3D_t>& point3D_ids = Point3DIds();
     size_t num_filtered = 0;
-    num_filtered +=
-      FilterPoints3DWithLargeReprojectionError(max_reproj_error, point3D_ids);
+    num_filtered += FilterPoints3DWithLargeReprojectionError(
+      max_reproj_error, point3D_ids, num_threads);
     std::cout << StringPrintf("(Filtered due to reproj: %d)\n", num_filtered);
-    num_filtered +=
-      FilterPoints3DWithSmallTriangulationAngle(min_tri_angle, point3D_ids);
+    num_filtered += FilterPoints3DWithSmallTriangulationAngle(
+      min_tri_angle, point3D_ids, num_threads);
     return num_filtered;
   }
 
@@ -902,15 +942,21 @@ namespace colmap {
     num_filtered +=
       FilterPoints3DWithLargeReprojectionErrorFinal(max_reproj_error, point3D_ids);
     std::cout << StringPrintf("(Filtered due to reproj in final error: %d)\n", num_filtered);
-    num_filtered +=
-      FilterPoints3DWithSmallTriangulationAngle(min_tri_angle, point3D_ids);
+    num_filtered += FilterPoints3DWithSmallTriangulationAngle(
+      min_tri_angle, point3D_ids, /*num_threads=*/1);
     return num_filtered;
   }
 
-  size_t Reconstruction::FilterObservationsWithNegativeDepth() {
-    size_t num_filtered = 0;
-    for (const auto image_id : reg_image_ids_) {
-      const class Image& image = Image(image_id);
+  size_t Reconstruction::FilterObservationsWithNegativeDepth(
+    const int num_threads) {
+    // Collect the observations with negative depth in parallel and delete them
+    // afterwards in the order of a sequential pass over the images. The depth
+    // test only depends on the poses and the point positions, which are not
+    // changed by deleting observations.
+    std::vector<std::vector<point2D_t>> point2D_idxs_to_delete(
+      reg_image_ids_.size());
+    ParallelScan(num_threads, reg_image_ids_.size(), 1, [&](const size_t i) {
+      const class Image& image = Image(reg_image_ids_[i]);
       const class Camera& camera = Camera(image.CameraId());
 
       const Eigen::Matrix3x4d proj_matrix = image.ProjectionMatrix();
@@ -920,34 +966,44 @@ namespace colmap {
         if (point2D.HasPoint3D()) {
           const class Point3D& point3D = Point3D(point2D.Point3DId());
 
+          bool is_behind = false;
           if (!camera.IsFullyCalibrated(point2D.XY())) {
             // For radial cameras we instead check the half-plane constraint
             const Eigen::Vector2d n =
               proj_matrix.topRows<2>() * point3D.XYZ().homogeneous();
 
             const double dot_product = n.dot(camera.ImageToWorld(point2D.XY()));
-            if (dot_product < 0) {
-              DeleteObservation(image_id, point2D_idx);
-              num_filtered += 1;
-            }
+            is_behind = dot_product < 0;
+          }
+          else if (camera.ModelId() == ImplicitDistortionModel::model_id) {
+            double focal_length = camera.EvalFocalLength(point2D.XY());
+            is_behind = (HasPointPositiveDepth(proj_matrix, point3D.XYZ()) != (focal_length > 0));
           }
           else {
-            bool is_behind = false;
-            if (camera.ModelId() == ImplicitDistortionModel::model_id) {
-              double focal_length = camera.EvalFocalLength(point2D.XY());
-              is_behind = (HasPointPositiveDepth(proj_matrix, point3D.XYZ()) != (focal_length > 0));
-            }
-            else {
-              is_behind = !HasPointPositiveDepth(proj_matrix, point3D.XYZ());
-            }
-            if (is_behind) {
-              DeleteObservation(image_id, point2D_idx);
-              num_filtered += 1;
-            }
+            is_behind = !HasPointPositiveDepth(proj_matrix, point3D.XYZ());
+          }
+
+          if (is_behind) {
+            point2D_idxs_to_delete[i].push_back(point2D_idx);
           }
         }
       }
+    });
+
+    size_t num_filtered = 0;
+    for (size_t i = 0; i < reg_image_ids_.size(); ++i) {
+      const image_t image_id = reg_image_ids_[i];
+      const class Image& image = Image(image_id);
+      for (const point2D_t point2D_idx : point2D_idxs_to_delete[i]) {
+        // The point might have been deleted together with an earlier
+        // observation of a short track.
+        if (image.Point2D(point2D_idx).HasPoint3D()) {
+          DeleteObservation(image_id, point2D_idx);
+          num_filtered += 1;
+        }
+      }
     }
+
     return num_filtered;
   }
 
@@ -972,10 +1028,23 @@ namespace colmap {
     return filtered_image_ids;
   }
 
-  size_t Reconstruction::ComputeNumObservations() const {
+  size_t Reconstruction::ComputeNumObservations(const int num_threads) const {
+    if (GetEffectiveNumThreads(num_threads) == 1) {
+      size_t num_obs = 0;
+      for (const image_t image_id : reg_image_ids_) {
+        num_obs += Image(image_id).NumPoints3D();
+      }
+      return num_obs;
+    }
+
+    std::vector<point2D_t> num_obs_per_image(reg_image_ids_.size(), 0);
+    ParallelScan(num_threads, reg_image_ids_.size(), 1, [&](const size_t i) {
+      num_obs_per_image[i] = Image(reg_image_ids_[i]).NumPoints3D();
+    });
+
     size_t num_obs = 0;
-    for (const image_t image_id : reg_image_ids_) {
-      num_obs += Image(image_id).NumPoints3D();
+    for (const point2D_t num_points3D : num_obs_per_image) {
+      num_obs += num_points3D;
     }
     return num_obs;
   }
@@ -1509,21 +1578,33 @@ namespace colmap {
 
   size_t Reconstruction::FilterPoints3DWithSmallTriangulationAngle(
     const double min_tri_angle,
-    const std::unordered_set<point3D_t>& point3D_ids) {
-    // Number of filtered points.
-    size_t num_filtered = 0;
-    size_t num_registered_images = reg_image_ids_.size();
-
+    const std::unordered_set<point3D_t>& point3D_ids, const int num_threads) {
     // Minimum triangulation angle in radians.
     const double min_tri_angle_rad = DegToRad(min_tri_angle);
 
-    // Cache for image projection centers and viewing directions
+    // Cache for image projection centers and viewing directions, which is
+    // filled before the parallel scan and only read afterwards.
     EIGEN_STL_UMAP(image_t, Eigen::Vector3d) proj_centers;
     EIGEN_STL_UMAP(image_t, Eigen::Vector3d) principal_axes;
-
-    for (const auto point3D_id : point3D_ids) {
+    proj_centers.reserve(images_.size());
+    principal_axes.reserve(images_.size());
+    for (const auto& image : images_) {
+      proj_centers.emplace(image.first, image.second.ProjectionCenter());
+      principal_axes.emplace(image.first,
+        image.second.ProjectionMatrix().block<1, 3>(2, 0).transpose());
+    }
+
+    // Decide in parallel which points to delete. The decision for a point
+    // only depends on the point itself, so the points can be deleted
+    // afterwards in the original order.
+    const std::vector<point3D_t> point3D_ids_vector(point3D_ids.begin(),
+      point3D_ids.end());
+    std::vector<char> delete_point(point3D_ids_vector.size(), 0);
+    ParallelScan(num_threads, point3D_ids_vector.size(), kPoints3DGrainSize,
+      [&](const size_t point_idx) {
+      const point3D_t point3D_id = point3D_ids_vector[point_idx];
       if (!ExistsPoint3D(point3D_id)) {
-        continue;
+        return;
       }
 
       const class Point3D& point3D = Point3D(point3D_id);
@@ -1531,7 +1612,6 @@ namespace colmap {
       // whether the camera model is Radial1DCameraModel
       std::vector<char> is_radial(point3D.Track().Length());
 
-
       // Calculate triangulation angle for all pairwise combinations of image
       // poses in the track. Only delete point if none of the combinations
       // has a sufficient triangulation angle.
@@ -1543,20 +1623,8 @@ namespace colmap {
         is_radial[i1] = (camera1.ModelId() == Radial1DCameraModel::model_id ||
           (camera1.ModelId() == ImplicitDistortionModel::model_id && camera1.GetRawRadii().size() == 0));
 
-        Eigen::Vector3d proj_center1;
-        Eigen::Vector3d principal_axis1;
-
-        if (proj_centers.count(image_id1) == 0) {
-          const class Image& image1 = Image(image_id1);
-          proj_center1 = image1.ProjectionCenter();
-          proj_centers.emplace(image_id1, proj_center1);
-          principal_axis1 = image1.ProjectionMatrix().block<1, 3>(2, 0);
-          principal_axes.emplace(image_id1, principal_axis1);
-        }
-        else {
-          proj_center1 = proj_centers.at(image_id1);
-          principal_axis1 = principal_axes.at(image_id1);
-        }
+        const Eigen::Vector3d& proj_center1 = proj_centers.at(image_id1);
+        const Eigen::Vector3d& principal_axis1 = principal_axes.at(image_id1);
 
         for (size_t i2 = 0; i2 < i1; ++i2) {
           const image_t image_id2 = point3D.Track().Element(i2).image_id;
@@ -1612,9 +1680,16 @@ namespace colmap {
         }
       }
 
-      if (!keep_point) {
+      delete_point[point_idx] = !keep_point;
+    });
+
+    // Number of filtered points.
+    size_t num_filtered = 0;
+    for (size_t point_idx = 0; point_idx < point3D_ids_vector.size();
+      ++point_idx) {
+      if (delete_point[point_idx]) {
         num_filtered += 1;
-        DeletePoint3D(point3D_id);
+        DeletePoint3D(point3D_ids_vector[point_idx]);
       }
     }
 
@@ -1623,19 +1698,36 @@ namespace colmap {
 
   size_t Reconstruction::FilterPoints3DWithLargeReprojectionError(
     const double max_reproj_error,
-    const std::unordered_set<point3D_t>& point3D_ids) {
+    const std::unordered_set<point3D_t>& point3D_ids, const int num_threads) {
     const double max_squared_reproj_error = max_reproj_error * max_reproj_error;
 
-    // Number of filtered points.
-    size_t num_filtered = 0;
-
-    for (const auto point3D_id : point3D_ids) {
+    // Result of checking the observations of a point.
+    struct Point3DFilter {
+      bool exists = false;
+      bool delete_point = false;
+      size_t track_length = 0;
+      double reproj_error_sum = 0.0;
+      std::vector<TrackElement> track_els_to_delete;
+    };
+
+    // Check the points in parallel. The result for a point only depends on
+    // the point itself, so the deletions can be applied afterwards in the
+    // original order.
+    const std::vector<point3D_t> point3D_ids_vector(point3D_ids.begin(),
+      point3D_ids.end());
+    std::vector<Point3DFilter> filters(point3D_ids_vector.size());
+    ParallelScan(num_threads, point3D_ids_vector.size(), kPoints3DGrainSize,
+      [&](const size_t point_idx) {
+      const point3D_t point3D_id = point3D_ids_vector[point_idx];
       if (!ExistsPoint3D(point3D_id)) {
-        continue;
+        return;
       }
 
+      Point3DFilter& filter = filters[point_idx];
+      filter.exists = true;
 
-      class Point3D& point3D = Point3D(point3D_id);
+      const class Point3D& point3D = Point3D(point3D_id);
+      filter.track_length = point3D.Track().Length();
 
       int num_constraints = 0;
       for (const auto& track_el : point3D.Track().Elements()) {
@@ -1651,44 +1743,53 @@ namespace colmap {
       }
       // Remove underconstrained points
       if (num_constraints < 4) {
-        DeletePoint3D(point3D_id);
-        num_filtered += point3D.Track().Length();
-        continue;
+        filter.delete_point = true;
+        return;
       }
 
-      double reproj_error_sum = 0.0;
-
-      std::vector<TrackElement> track_els_to_delete;
-
       for (const auto& track_el : point3D.Track().Elements()) {
         const class Image& image = Image(track_el.image_id);
         const class Camera& camera = Camera(image.CameraId());
         const Point2D& point2D = image.Point2D(track_el.point2D_idx);
-        size_t num_registered_images = reg_image_ids_.size();
         const double squared_reproj_error = std::pow(CalculateAngularError(
           point2D.XY(), point3D.XYZ(), image.Qvec(), image.Tvec(), camera), 2);
 
         if (squared_reproj_error > max_squared_reproj_error) {
-          track_els_to_delete.push_back(track_el);
+          filter.track_els_to_delete.push_back(track_el);
 
           num_constraints -=
             (!camera.IsFullyCalibrated(image.Point2D(track_el.point2D_idx).XY())) ? 1 : 2;
         }
         else {
-          reproj_error_sum += std::sqrt(squared_reproj_error);
+          filter.reproj_error_sum += std::sqrt(squared_reproj_error);
         }
       }
 
-      if (num_constraints < 4) {
-        num_filtered += point3D.Track().Length();
+      filter.delete_point = num_constraints < 4;
+    });
+
+    // Number of filtered points.
+    size_t num_filtered = 0;
+
+    for (size_t point_idx = 0; point_idx < point3D_ids_vector.size();
+      ++point_idx) {
+      const Point3DFilter& filter = filters[point_idx];
+      if (!filter.exists) {
+        continue;
+      }
+
+      const point3D_t point3D_id = point3D_ids_vector[point_idx];
+      if (filter.delete_point) {
+        num_filtered += filter.track_length;
         DeletePoint3D(point3D_id);
       }
       else {
-        num_filtered += track_els_to_delete.size();
-        for (const auto& track_el : track_els_to_delete) {
+        num_filtered += filter.track_els_to_delete.size();
+        for (const auto& track_el : filter.track_els_to_delete) {
           DeleteObservation(track_el.image_id, track_el.point2D_idx);
         }
-        point3D.SetError(reproj_error_sum / point3D.Track().Length());
+        class Point3D& point3D = Point3D(point3D_id);
+        point3D.SetError(filter.reproj_error_sum / point3D.Track().Length());
       }
     }
 
@@ -2354,6 +2455,7 @@ namespace colmap {
       class Image& corr_image = Image(corr.image_id);
       const Point2D& corr_point2D = corr_image.Point2D(corr.point2D_idx);
       corr_image.IncrementCorrespondenceHasPoint3D(corr.point2D_idx);
+      images_with_changed_visibility_.insert(corr.image_id);
       // Update number of shared 3D points between image pairs and make sure to
       // only count the correspondences once (not twice forward and backward).
       if (point2D.Point3DId() == corr_point2D.Point3DId() &&
@@ -2388,6 +2490,7 @@ namespace colmap {
       class Image& corr_image = Image(corr.image_id);
       const Point2D& corr_point2D = corr_image.Point2D(corr.point2D_idx);
       corr_image.DecrementCorrespondenceHasPoint3D(corr.point2D_idx);
+      images_with_changed_visibility_.insert(corr.image_id);
       // Update number of shared 3D points between image pairs and make sure to
       // only count the correspondences once (not twice forward and backward).
       if (point2D.Point3DId() == corr_point2D.Point3DId() &&
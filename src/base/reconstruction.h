@@ -103,6 +103,16 @@ namespace colmap {
     // Identifiers of all 3D points.
     std::unordered_set<point3D_t> Point3DIds() const;
 
+    // Images whose registration or visible 3D points changed since the last
+    // call to `ClearImagesWithChangedVisibility`. This includes the images
+    // whose visibility pyramid was updated through a triangulated
+    // correspondence and newly added images.
+    inline const std::unordered_set<image_t>& ImagesWithChangedVisibility()
+      const;
+
+    // Clear the collection of images with changed visibility.
+    void ClearImagesWithChangedVisibility();
+
     // Check whether specific object exists.
     inline bool ExistsCamera(const camera_t camera_id) const;
     inline bool ExistsImage(const image_t image_id) const;
@@ -194,6 +204,12 @@ namespace colmap {
     bool Merge(const Reconstruction& reconstruction,
       const double max_reproj_error);
 
+    // Merge the given reconstruction using a precomputed alignment from the
+    // frame of the given reconstruction to the frame of this reconstruction,
+    // e.g., as estimated by `ComputeAlignmentBetweenReconstructions`.
+    void Merge(const Reconstruction& reconstruction,
+      const Eigen::Matrix3x4d& alignment, const double max_reproj_error);
+
     // Align the given reconstruction with a set of pre-defined camera positions.
     // Assuming that locations[i] gives the 3D coordinates of the center
     // of projection of the image with name image_names[i].
@@ -221,30 +237,38 @@ namespace colmap {
     // Filter 3D points with large reprojection error, negative depth, or
     // insufficient triangulation angle.
     //
+    // The points are checked in parallel and the filtered points and
+    // observations are deleted afterwards in the same order as a sequential
+    // pass, so the result does not depend on the number of threads.
+    //
     // @param max_reproj_error    The maximum reprojection error.
     // @param min_tri_angle       The minimum triangulation angle.
     // @param point3D_ids         The points to be filtered.
+    // @param num_threads         The number of threads, -1 for all cores.
     //
     // @return                    The number of filtered observations.
     size_t FilterPoints3D(const double max_reproj_error,
       const double min_tri_angle,
-      const std::unordered_set<point3D_t>& point3D_ids);
+      const std::unordered_set<point3D_t>& point3D_ids,
+      const int num_threads = 1);
     size_t FilterPoints3DFinal(const double max_reproj_error,
       const double min_tri_angle,
       const std::unordered_set<point3D_t>& point3D_ids);
     size_t FilterPoints3DInImages(const double max_reproj_error,
       const double min_tri_angle,
-      const std::unordered_set<image_t>& image_ids);
+      const std::unordered_set<image_t>& image_ids,
+      const int num_threads = 1);
     size_t FilterAllPoints3D(const double max_reproj_error,
-      const double min_tri_angle);
+      const double min_tri_angle, const int num_threads = 1);
     size_t FilterAllPoints3DFinal(const double max_reproj_error,
       const double min_tri_angle);
 
     // Filter observations that have negative depth.
     // For radial cameras this checks the half-plane constraint instead.
+    // The images are checked in parallel with the given number of threads.
     //
     // @return    The number of filtered observations.
-    size_t FilterObservationsWithNegativeDepth();
+    size_t FilterObservationsWithNegativeDepth(const int num_threads = 1);
 
     // Filter images without observations or bogus camera parameters.
     //
@@ -253,8 +277,9 @@ namespace colmap {
       const double max_focal_length_ratio,
       const double max_extra_param);
 
-    // Compute statistics for scene.
-    size_t ComputeNumObservations() const;
+    // Compute statistics for scene. The number of observations is counted per
+    // image in parallel with the given number of threads.
+    size_t ComputeNumObservations(const int num_threads = 1) const;
     double ComputeMeanTrackLength() const;
     double ComputeMeanObservationsPerRegImage() const;
     double ComputeMeanReprojectionError() const;
@@ -312,10 +337,12 @@ namespace colmap {
   private:
     size_t FilterPoints3DWithSmallTriangulationAngle(
       const double min_tri_angle,
-      const std::unordered_set<point3D_t>& point3D_ids);
+      const std::unordered_set<point3D_t>& point3D_ids,
+      const int num_threads);
     size_t FilterPoints3DWithLargeReprojectionError(
       const double max_reproj_error,
-      const std::unordered_set<point3D_t>& point3D_ids);
+      const std::unordered_set<point3D_t>& point3D_ids,
+      const int num_threads);
     size_t FilterPoints3DWithLargeReprojectionErrorFinal(
       const double max_reproj_error,
       const std::unordered_set<point3D_t>& point3D_ids);
@@ -351,6 +378,10 @@ namespace colmap {
     // { image_id, ... } where `images_.at(image_id).registered == true`.
     std::vector<image_t> reg_image_ids_;
 
+    // Images whose registration or visible 3D points changed, see
+    // `ImagesWithChangedVisibility`.
+    std::unordered_set<image_t> images_with_changed_visibility_;
+
     // Total number of added 3D points, used to generate unique identifiers.
     point3D_t num_added_points3D_;
   };
@@ -429,6 +460,11 @@ namespace colmap {
     return reg_image_ids_;
   }
 
+  const std::unordered_set<image_t>&
+    Reconstruction::ImagesWithChangedVisibility() const {
+    return images_with_changed_visibility_;
+  }
+
   const EIGEN_STL_UMAP(point3D_t, Point3D)& Reconstruction::Points3D() const {
     return points3D_;
   }
@@ -32,16 +32,71 @@
 #include "base/scene_clustering.h"
 
 #include <set>
+#include <unordered_map>
 
 #include "base/database.h"
 #include "base/graph_cut.h"
 #include "util/random.h"
+#include "util/threading.h"
 
 namespace colmap {
 
+namespace {
+
+// Extract the subgraphs induced by the vertices of each label. Vertices
+// without any edge to another vertex of the same label are not included.
+void ExtractSubgraphs(const CSRGraph& graph,
+                      const std::vector<image_t>& vertex_image_ids,
+                      const std::vector<int>& labels, const int num_labels,
+                      std::vector<CSRGraph>* subgraphs,
+                      std::vector<std::vector<image_t>>* subgraph_image_ids) {
+  const int num_vertices = graph.NumVertices();
+
+  subgraphs->clear();
+  subgraphs->resize(num_labels);
+  subgraph_image_ids->clear();
+  subgraph_image_ids->resize(num_labels);
+
+  // Determine the vertex indices in the subgraphs.
+  std::vector<int> subgraph_vertex_idxs(num_vertices, -1);
+  for (int i = 0; i < num_vertices; ++i) {
+    const int label = labels[i];
+    for (int j = graph.xadj[i]; j < graph.xadj[i + 1]; ++j) {
+      if (labels[graph.adjncy[j]] == label) {
+        subgraph_vertex_idxs[i] = (*subgraph_image_ids)[label].size();
+        (*subgraph_image_ids)[label].push_back(vertex_image_ids[i]);
+        break;
+      }
+    }
+  }
+
+  for (auto& subgraph : *subgraphs) {
+    subgraph.xadj.push_back(0);
+  }
+
+  for (int i = 0; i < num_vertices; ++i) {
+    if (subgraph_vertex_idxs[i] == -1) {
+      continue;
+    }
+    const int label = labels[i];
+    CSRGraph& subgraph = (*subgraphs)[label];
+    for (int j = graph.xadj[i]; j < graph.xadj[i + 1]; ++j) {
+      const int neighbor = graph.adjncy[j];
+      if (labels[neighbor] == label) {
+        subgraph.adjncy.push_back(subgraph_vertex_idxs[neighbor]);
+        subgraph.adjwgt.push_back(graph.adjwgt[j]);
+      }
+    }
+    subgraph.xadj.push_back(subgraph.adjncy.size());
+  }
+}
+
+}  // namespace
+
 bool SceneClustering::Options::Check() const {
   CHECK_OPTION_GT(branching, 0);
   CHECK_OPTION_GE(image_overlap, 0);
+  CHECK_OPTION_GT(leaf_max_num_images, 0);
   return true;
 }
 
@@ -55,107 +110,130 @@ void SceneClustering::Partition(
   CHECK(!root_cluster_);
   CHECK_EQ(image_pairs.size(), num_inliers.size());
 
-  std::set<image_t> image_ids;
   std::vector<std::pair<int, int>> edges;
   edges.reserve(image_pairs.size());
   for (const auto& image_pair : image_pairs) {
-    image_ids.insert(image_pair.first);
-    image_ids.insert(image_pair.second);
     edges.emplace_back(image_pair.first, image_pair.second);
   }
 
+  std::vector<int> vertex_ids;
+  const CSRGraph graph = BuildCSRGraph(edges, num_inliers, &vertex_ids);
+  edges.clear();
+  edges.shrink_to_fit();
+
+  const std::vector<image_t> vertex_image_ids(vertex_ids.begin(),
+                                              vertex_ids.end());
+
   root_cluster_.reset(new Cluster());
-  root_cluster_->image_ids.insert(root_cluster_->image_ids.end(),
-                                  image_ids.begin(), image_ids.end());
-  PartitionCluster(edges, num_inliers, root_cluster_.get());
+  root_cluster_->image_ids = vertex_image_ids;
+  std::sort(root_cluster_->image_ids.begin(), root_cluster_->image_ids.end());
+
+  ThreadPool thread_pool(options_.num_threads);
+  PartitionCluster(graph, vertex_image_ids, &thread_pool, root_cluster_.get());
 }
 
 void SceneClustering::PartitionCluster(
-    const std::vector<std::pair<int, int>>& edges,
-    const std::vector<int>& weights, Cluster* cluster) {
-  CHECK_EQ(edges.size(), weights.size());
+    const CSRGraph& graph, const std::vector<image_t>& vertex_image_ids,
+    ThreadPool* thread_pool, Cluster* cluster) {
+  CHECK_EQ(graph.NumVertices(), vertex_image_ids.size());
 
   // If the cluster is small enough, we return from the recursive clustering.
-  if (edges.size() == 0 ||
+  if (graph.NumEdges() == 0 ||
       cluster->image_ids.size() <=
           static_cast<size_t>(options_.leaf_max_num_images)) {
     return;
   }
 
+  // A flat clustering partitions the root cluster into all leaf clusters.
+  const int num_parts =
+      options_.is_hierarchical
+          ? options_.branching
+          : (cluster->image_ids.size() + options_.leaf_max_num_images - 1) /
+                options_.leaf_max_num_images;
+
   // Partition the cluster using a normalized cut on the scene graph.
-  const auto labels =
-      ComputeNormalizedMinGraphCut(edges, weights, options_.branching);
+  const std::vector<int> labels =
+      ComputeNormalizedMinGraphCut(graph, num_parts);
+
+  std::unordered_map<image_t, int> image_id_to_label;
+  image_id_to_label.reserve(vertex_image_ids.size());
+  for (size_t i = 0; i < vertex_image_ids.size(); ++i) {
+    image_id_to_label.emplace(vertex_image_ids[i], labels[i]);
+  }
 
   // Assign the images to the clustered child clusters.
-  cluster->child_clusters.resize(options_.branching);
+  cluster->child_clusters.resize(num_parts);
   for (const auto image_id : cluster->image_ids) {
-    if (labels.count(image_id)) {
-      auto& child_cluster = cluster->child_clusters.at(labels.at(image_id));
-      child_cluster.image_ids.push_back(image_id);
+    const auto it = image_id_to_label.find(image_id);
+    if (it != image_id_to_label.end()) {
+      cluster->child_clusters.at(it->second).image_ids.push_back(image_id);
     }
   }
 
-  // Collect the edges based on whether they are inter or intra child clusters.
-  std::vector<std::vector<std::pair<int, int>>> child_edges(options_.branching);
-  std::vector<std::vector<int>> child_weights(options_.branching);
-  std::vector<std::vector<std::pair<std::pair<int, int>, int>>>
-      overlapping_edges(options_.branching);
-  for (size_t i = 0; i < edges.size(); ++i) {
-    const int label1 = labels.at(edges[i].first);
-    const int label2 = labels.at(edges[i].second);
-    if (label1 == label2) {
-      child_edges.at(label1).push_back(edges[i]);
-      child_weights.at(label1).push_back(weights[i]);
-    } else {
-      overlapping_edges.at(label1).emplace_back(edges[i], weights[i]);
-      overlapping_edges.at(label2).emplace_back(edges[i], weights[i]);
-    }
+  // Recursively partition all the child clusters in parallel.
+  if (options_.is_hierarchical) {
+    std::vector<CSRGraph> child_graphs;
+    std::vector<std::vector<image_t>> child_vertex_image_ids;
+    ExtractSubgraphs(graph, vertex_image_ids, labels, num_parts, &child_graphs,
+                     &child_vertex_image_ids);
+    thread_pool->ParallelFor(0, num_parts, [&](const size_t i) {
+      PartitionCluster(child_graphs[i], child_vertex_image_ids[i], thread_pool,
+                       &cluster->child_clusters[i]);
+      child_graphs[i] = CSRGraph();
+      child_vertex_image_ids[i].clear();
+      child_vertex_image_ids[i].shrink_to_fit();
+    });
   }
 
-  // Recursively partition all the child clusters.
-  for (int i = 0; i < options_.branching; ++i) {
-    PartitionCluster(child_edges[i], child_weights[i],
-                     &cluster->child_clusters[i]);
+  if (options_.image_overlap <= 0) {
+    return;
   }
 
-  if (options_.image_overlap > 0) {
-    for (int i = 0; i < options_.branching; ++i) {
-      // Sort the overlapping edges by the number of inlier matches, such
-      // that we add overlapping images with many common observations.
-      std::sort(overlapping_edges[i].begin(), overlapping_edges[i].end(),
-                [](const std::pair<std::pair<int, int>, int>& edge1,
-                   const std::pair<std::pair<int, int>, int>& edge2) {
-                  return edge1.second > edge2.second;
-                });
-
-      // Select overlapping edges at random and add image to cluster.
-      std::set<int> overlapping_image_ids;
-      for (const auto& edge : overlapping_edges[i]) {
-        if (labels.at(edge.first.first) == i) {
-          overlapping_image_ids.insert(edge.first.second);
-        } else {
-          overlapping_image_ids.insert(edge.first.first);
-        }
-        if (overlapping_image_ids.size() >=
-            static_cast<size_t>(options_.image_overlap)) {
-          break;
-        }
+  // Collect the edges between the child clusters, where each child cluster
+  // stores its inter-cluster edges as pairs of the weight and the vertex in
+  // the other child cluster.
+  std::vector<std::vector<std::pair<int, int>>> overlapping_edges(num_parts);
+  for (int i = 0; i < graph.NumVertices(); ++i) {
+    for (int j = graph.xadj[i]; j < graph.xadj[i + 1]; ++j) {
+      const int neighbor = graph.adjncy[j];
+      if (labels[i] != labels[neighbor]) {
+        overlapping_edges[labels[i]].emplace_back(graph.adjwgt[j], neighbor);
       }
-
-      // Recursively append the overlapping images to cluster and its children.
-      std::function<void(Cluster*)> InsertOverlappingImageIds =
-          [&](Cluster* cluster) {
-            cluster->image_ids.insert(cluster->image_ids.end(),
-                                      overlapping_image_ids.begin(),
-                                      overlapping_image_ids.end());
-            for (auto& child_cluster : cluster->child_clusters) {
-              InsertOverlappingImageIds(&child_cluster);
-            }
-          };
-
-      InsertOverlappingImageIds(&cluster->child_clusters[i]);
     }
   }
+
+  thread_pool->ParallelFor(0, num_parts, [&](const size_t i) {
+    // Sort the overlapping edges by the number of inlier matches, such
+    // that we add overlapping images with many common observations.
+    std::sort(overlapping_edges[i].begin(), overlapping_edges[i].end(),
+              [](const std::pair<int, int>& edge1,
+                 const std::pair<int, int>& edge2) {
+                return edge1.first > edge2.first;
+              });
+
+    // Select overlapping edges at random and add image to cluster.
+    std::set<image_t> overlapping_image_ids;
+    for (const auto& edge : overlapping_edges[i]) {
+      overlapping_image_ids.insert(vertex_image_ids[edge.second]);
+      if (overlapping_image_ids.size() >=
+          static_cast<size_t>(options_.image_overlap)) {
+        break;
+      }
+    }
+
+    // Recursively append the overlapping images to cluster and its children.
+    std::function<void(Cluster*)> InsertOverlappingImageIds =
+        [&](Cluster* cluster) {
+          cluster->image_ids.insert(cluster->image_ids.end(),
+                                    overlapping_image_ids.begin(),
+                                    overlapping_image_ids.end());
+          for (auto& child_cluster : cluster->child_clusters) {
+            InsertOverlappingImageIds(&child_cluster);
+          }
+        };
+
+    InsertOverlappingImageIds(&cluster->child_clusters[i]);
+  });
 }
 
 const SceneClustering::Cluster* SceneClustering::GetRootCluster() const {
@@ -33,12 +33,16 @@
 #define COLMAP_SRC_BASE_SCENE_CLUSTERING_H_
 
 #include <list>
+#include <memory>
 #include <vector>
 
 #include "util/types.h"
 
 namespace colmap {
 
+struct CSRGraph;
+class ThreadPool;
+
 // Scene clustering approach using normalized cuts on the scene graph. The scene
 // is hierarchically partitioned into overlapping clusters until a maximum
 // number of images is in a leaf node.
@@ -57,6 +61,15 @@ class SceneClustering {
     // overlap` images to satisfy the overlap constraint.
     int leaf_max_num_images = 500;
 
+    // Whether to recursively partition the scene into a hierarchy of clusters
+    // with the given branching factor. Otherwise, the scene is partitioned
+    // into leaf clusters using a single multilevel k-way partition, where the
+    // number of clusters is determined by the maximum number of leaf images.
+    bool is_hierarchical = true;
+
+    // The number of threads used to partition the child clusters in parallel.
+    int num_threads = -1;
+
     bool Check() const;
   };
 
@@ -74,8 +87,9 @@ class SceneClustering {
   std::vector<const Cluster*> GetLeafClusters() const;
 
  private:
-  void PartitionCluster(const std::vector<std::pair<int, int>>& edges,
-                        const std::vector<int>& weights, Cluster* cluster);
+  void PartitionCluster(const CSRGraph& graph,
+                        const std::vector<image_t>& vertex_image_ids,
+                        ThreadPool* thread_pool, Cluster* cluster);
 
   const Options options_;
   std::unique_ptr<Cluster> root_cluster_;
@@ -214,3 +214,90 @@ BOOST_AUTO_TEST_CASE(TestTwoOverlap) {
   BOOST_CHECK(image_ids1.count(2));
   BOOST_CHECK(image_ids1.count(3));
 }
+
+BOOST_AUTO_TEST_CASE(TestFlat) {
+  std::vector<std::pair<image_t, image_t>> image_pairs;
+  std::vector<int> num_inliers;
+  for (image_t image_id1 = 0; image_id1 < 40; ++image_id1) {
+    for (image_t image_id2 = image_id1 + 1;
+         image_id2 < std::min<image_t>(40, image_id1 + 4); ++image_id2) {
+      image_pairs.emplace_back(image_id1, image_id2);
+      num_inliers.push_back(100);
+    }
+  }
+  SceneClustering::Options options;
+  options.is_hierarchical = false;
+  options.image_overlap = 0;
+  options.leaf_max_num_images = 10;
+  SceneClustering scene_clustering(options);
+  scene_clustering.Partition(image_pairs, num_inliers);
+  BOOST_CHECK_EQUAL(scene_clustering.GetRootCluster()->image_ids.size(), 40);
+  BOOST_CHECK_EQUAL(scene_clustering.GetRootCluster()->child_clusters.size(),
+                    4);
+  BOOST_CHECK_EQUAL(scene_clustering.GetLeafClusters().size(), 4);
+  std::set<image_t> image_ids;
+  for (const auto& cluster : scene_clustering.GetLeafClusters()) {
+    BOOST_CHECK(cluster->child_clusters.empty());
+    image_ids.insert(cluster->image_ids.begin(), cluster->image_ids.end());
+  }
+  BOOST_CHECK_EQUAL(image_ids.size(), 40);
+}
+
+BOOST_AUTO_TEST_CASE(TestHierarchicalParallel) {
+  std::vector<std::pair<image_t, image_t>> image_pairs;
+  std::vector<int> num_inliers;
+  for (image_t image_id1 = 0; image_id1 < 200; ++image_id1) {
+    for (image_t image_id2 = image_id1 + 1;
+         image_id2 < std::min<image_t>(200, image_id1 + 5); ++image_id2) {
+      image_pairs.emplace_back(image_id1, image_id2);
+      num_inliers.push_back(100 + image_id1 % 7);
+    }
+  }
+  SceneClustering::Options options;
+  options.image_overlap = 3;
+  options.leaf_max_num_images = 20;
+  options.num_threads = 4;
+  SceneClustering scene_clustering(options);
+  scene_clustering.Partition(image_pairs, num_inliers);
+  BOOST_CHECK_EQUAL(scene_clustering.GetRootCluster()->image_ids.size(), 200);
+  BOOST_CHECK_GE(scene_clustering.GetLeafClusters().size(), 8);
+  for (const auto& cluster : scene_clustering.GetLeafClusters()) {
+    BOOST_CHECK(cluster->child_clusters.empty());
+    BOOST_CHECK_GT(cluster->image_ids.size(), 0);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(TestHierarchicalParallelDeterministic) {
+  std::vector<std::pair<image_t, image_t>> image_pairs;
+  std::vector<int> num_inliers;
+  for (image_t image_id1 = 0; image_id1 < 400; ++image_id1) {
+    for (image_t image_id2 = image_id1 + 1;
+         image_id2 < std::min<image_t>(400, image_id1 + 7); ++image_id2) {
+      image_pairs.emplace_back(image_id1, image_id2);
+      num_inliers.push_back(100 + (image_id1 * image_id2) % 13);
+    }
+  }
+
+  // The concurrent partitions of the child clusters must not influence each
+  // other, such that repeated runs produce identical clusters.
+  auto PartitionLeafClusters = [&](const int num_threads) {
+    SceneClustering::Options options;
+    options.image_overlap = 3;
+    options.leaf_max_num_images = 20;
+    options.num_threads = num_threads;
+    SceneClustering scene_clustering(options);
+    scene_clustering.Partition(image_pairs, num_inliers);
+    std::vector<std::vector<image_t>> leaf_image_ids;
+    for (const auto& cluster : scene_clustering.GetLeafClusters()) {
+      leaf_image_ids.push_back(cluster->image_ids);
+    }
+    return leaf_image_ids;
+  };
+
+  const auto leaf_image_ids = PartitionLeafClusters(1);
+  BOOST_CHECK_GE(leaf_image_ids.size(), 16);
+  for (int i = 0; i < 2; ++i) {
+    const auto parallel_leaf_image_ids = PartitionLeafClusters(8);
+    BOOST_CHECK(parallel_leaf_image_ids == leaf_image_ids);
+  }
+}
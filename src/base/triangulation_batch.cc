@@ -0,0 +1,515 @@
+// Copyright (c) 2018, ETH Zurich and UNC Chapel Hill.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//
+//     * Neither the name of ETH Zurich and UNC Chapel Hill nor the names of
+//       its contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Author: Johannes L. Schoenberger (jsch-at-demuc-dot-de)
+
+
+#include "base/triangulation_batch.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "util/logging.h"
+
+namespace colmap {
+
+const size_t TriangulationBatch::kNumLanes;
+
+namespace {
+
+// Entries of the symmetric 4x4 normal equations, which are accumulated as the
+// packed upper triangle.
+const int kNumUpperEntries = 10;
+const int kUpperIndices[4][4] = {
+    {0, 1, 2, 3}, {1, 4, 5, 6}, {2, 5, 7, 8}, {3, 6, 8, 9}};
+
+typedef Eigen::Array<double, TriangulationBatch::kNumLanes, 1> LaneArray;
+
+// Compute the eigenvector of the smallest eigenvalue of the symmetric 4x4
+// matrices in all lanes with cyclic Jacobi rotations, which, in contrast to
+// the tridiagonal QR iteration of `Eigen::SelfAdjointEigenSolver`, performs
+// the same operations for every matrix and hence vectorizes across lanes.
+void ComputeSmallestEigenvectors(LaneArray A[4][4], LaneArray v[4]) {
+  const int kMaxNumSweeps = 16;
+
+  LaneArray V[4][4];
+  for (int i = 0; i < 4; ++i) {
+    for (int j = 0; j < 4; ++j) {
+      V[i][j].setConstant(i == j ? 1 : 0);
+    }
+  }
+
+  LaneArray norm_squared = LaneArray::Zero();
+  for (int i = 0; i < 4; ++i) {
+    for (int j = 0; j < 4; ++j) {
+      norm_squared += A[i][j].square();
+    }
+  }
+  const LaneArray max_off_diagonal_squared =
+      norm_squared * (std::numeric_limits<double>::epsilon() *
+                      std::numeric_limits<double>::epsilon());
+
+  for (int sweep = 0; sweep < kMaxNumSweeps; ++sweep) {
+    LaneArray off_diagonal_squared = LaneArray::Zero();
+    for (int p = 0; p < 4; ++p) {
+      for (int q = p + 1; q < 4; ++q) {
+        off_diagonal_squared += A[p][q].square();
+      }
+    }
+    if ((off_diagonal_squared <= max_off_diagonal_squared).all()) {
+      break;
+    }
+
+    for (int p = 0; p < 4; ++p) {
+      for (int q = p + 1; q < 4; ++q) {
+        // Rotation that annihilates the entry (p, q), which is the identity
+        // for lanes, in which the entry already vanishes.
+        const LaneArray tau = (A[q][q] - A[p][p]) / (2 * A[p][q]);
+        const LaneArray t = (tau >= 0).select(LaneArray::Ones(), -1.0) /
+                            (tau.abs() + (1 + tau.square()).sqrt());
+        const LaneArray c =
+            (A[p][q] != 0).select(1 / (1 + t.square()).sqrt(), 1.0);
+        const LaneArray s = (A[p][q] != 0).select(t * c, 0.0);
+
+        for (int k = 0; k < 4; ++k) {
+          const LaneArray A_kp = A[k][p];
+          A[k][p] = c * A_kp - s * A[k][q];
+          A[k][q] = s * A_kp + c * A[k][q];
+        }
+        for (int k = 0; k < 4; ++k) {
+          const LaneArray A_pk = A[p][k];
+          A[p][k] = c * A_pk - s * A[q][k];
+          A[q][k] = s * A_pk + c * A[q][k];
+        }
+        for (int k = 0; k < 4; ++k) {
+          const LaneArray V_kp = V[k][p];
+          V[k][p] = c * V_kp - s * V[k][q];
+          V[k][q] = s * V_kp + c * V[k][q];
+        }
+      }
+    }
+  }
+
+  LaneArray min_eigenvalue = A[0][0];
+  for (int k = 0; k < 4; ++k) {
+    v[k] = V[k][0];
+  }
+  for (int i = 1; i < 4; ++i) {
+    const Eigen::Array<bool, TriangulationBatch::kNumLanes, 1> is_smaller =
+        A[i][i] < min_eigenvalue;
+    min_eigenvalue = is_smaller.select(A[i][i], min_eigenvalue);
+    for (int k = 0; k < 4; ++k) {
+      v[k] = is_smaller.select(V[k][i], v[k]);
+    }
+  }
+}
+
+}  // namespace
+
+size_t TriangulationBatch::AddPoint() {
+  if (point_offsets_.empty()) {
+    point_offsets_.push_back(0);
+  }
+  point_offsets_.push_back(points_.size());
+  point_has_radial_.push_back(0);
+  point_num_constraints_.push_back(0);
+  return NumPoints() - 1;
+}
+
+void TriangulationBatch::AddRadialObservation(
+    const Eigen::Matrix3x4d& proj_matrix, const Eigen::Vector3d& proj_center,
+    const Eigen::Vector2d& point) {
+  CHECK_GT(NumPoints(), 0);
+  proj_matrices_.push_back(proj_matrix);
+  proj_centers_.push_back(proj_center);
+  points_.push_back(point);
+  radial_.push_back(1);
+  positive_focal_length_.push_back(1);
+  point_offsets_.back() += 1;
+  point_has_radial_.back() = 1;
+  point_num_constraints_.back() += 1;
+}
+
+void TriangulationBatch::AddPointObservation(
+    const Eigen::Matrix3x4d& proj_matrix, const Eigen::Vector3d& proj_center,
+    const Eigen::Vector2d& point, const bool positive_focal_length) {
+  CHECK_GT(NumPoints(), 0);
+  proj_matrices_.push_back(proj_matrix);
+  proj_centers_.push_back(proj_center);
+  points_.push_back(point);
+  radial_.push_back(0);
+  positive_focal_length_.push_back(positive_focal_length);
+  point_offsets_.back() += 1;
+  point_num_constraints_.back() += 2;
+}
+
+void TriangulationBatch::Triangulate(
+    std::vector<Eigen::Vector3d>* points3D) const {
+  CHECK_NOTNULL(points3D);
+
+  const size_t num_points = NumPoints();
+  points3D->resize(num_points);
+
+  LaneObservationsVector group;
+  for (size_t first_point_idx = 0; first_point_idx < num_points;
+       first_point_idx += kNumLanes) {
+    GatherGroup(first_point_idx, &group);
+
+    // Points with radial observations are triangulated from the planes of
+    // all their observations and all other points from the viewing rays.
+    LaneArray from_planes = LaneArray::Zero();
+    for (size_t l = 0; l < kNumLanes; ++l) {
+      const size_t point_idx = first_point_idx + l;
+      if (point_idx < num_points && point_has_radial_[point_idx]) {
+        from_planes(l) = 1;
+      }
+    }
+
+    LaneArray A[kNumUpperEntries];
+    for (int k = 0; k < kNumUpperEntries; ++k) {
+      A[k].setZero();
+    }
+
+    for (const auto& lanes : group) {
+      const LaneArray* P = lanes.proj_matrix;
+      const LaneArray& x = lanes.x;
+      const LaneArray& y = lanes.y;
+
+      // Planes of the radial line (y, -x, 0) and of the lines (1, 0, -x) and
+      // (0, 1, -y) through a point observation.
+      LaneArray radial_plane[4];
+      LaneArray x_plane[4];
+      LaneArray y_plane[4];
+      for (int c = 0; c < 4; ++c) {
+        radial_plane[c] = y * P[c] - x * P[4 + c];
+        x_plane[c] = P[c] - x * P[8 + c];
+        y_plane[c] = P[4 + c] - y * P[8 + c];
+      }
+
+      // Normalize the planes by the norm of their normals. The selects
+      // discard the planes of masked lanes, whose norm may be zero.
+      const LaneArray radial_norm =
+          (radial_plane[0].square() + radial_plane[1].square() +
+           radial_plane[2].square())
+              .sqrt();
+      const LaneArray x_norm =
+          (x_plane[0].square() + x_plane[1].square() + x_plane[2].square())
+              .sqrt();
+      const LaneArray y_norm =
+          (y_plane[0].square() + y_plane[1].square() + y_plane[2].square())
+              .sqrt();
+      const LaneArray plane_weight = lanes.point * from_planes;
+      for (int c = 0; c < 4; ++c) {
+        radial_plane[c] =
+            (lanes.radial > 0).select(radial_plane[c] / radial_norm, 0.0);
+        x_plane[c] = (plane_weight > 0).select(x_plane[c] / x_norm, 0.0);
+        y_plane[c] = (plane_weight > 0).select(y_plane[c] / y_norm, 0.0);
+      }
+
+      // Component of the projection matrix orthogonal to the normalized
+      // viewing ray p, i.e. P - p * p^T * P.
+      const LaneArray ray_weight = lanes.point * (1 - from_planes);
+      const LaneArray ray_norm = (x.square() + y.square() + 1).sqrt();
+      const LaneArray p[3] = {x / ray_norm, y / ray_norm, 1 / ray_norm};
+      LaneArray term[3][4];
+      for (int c = 0; c < 4; ++c) {
+        const LaneArray p_dot_col =
+            p[0] * P[c] + p[1] * P[4 + c] + p[2] * P[8 + c];
+        for (int r = 0; r < 3; ++r) {
+          term[r][c] = ray_weight * (P[4 * r + c] - p[r] * p_dot_col);
+        }
+      }
+
+      for (int i = 0; i < 4; ++i) {
+        for (int j = i; j < 4; ++j) {
+          A[kUpperIndices[i][j]] +=
+              radial_plane[i] * radial_plane[j] + x_plane[i] * x_plane[j] +
+              y_plane[i] * y_plane[j] + term[0][i] * term[0][j] +
+              term[1][i] * term[1][j] + term[2][i] * term[2][j];
+        }
+      }
+    }
+
+    LaneArray A_full[4][4];
+    for (int i = 0; i < 4; ++i) {
+      for (int j = 0; j < 4; ++j) {
+        A_full[i][j] = A[kUpperIndices[i][j]];
+      }
+    }
+
+    LaneArray v[4];
+    ComputeSmallestEigenvectors(A_full, v);
+
+    for (size_t l = 0; l < kNumLanes; ++l) {
+      const size_t point_idx = first_point_idx + l;
+      if (point_idx >= num_points) {
+        break;
+      }
+      (*points3D)[point_idx] =
+          Eigen::Vector4d(v[0](l), v[1](l), v[2](l), v[3](l)).hnormalized();
+    }
+  }
+}
+
+void TriangulationBatch::Check(const std::vector<Eigen::Vector3d>& points3D,
+                               const double min_tri_angle,
+                               std::vector<char>* valid) const {
+  CHECK_EQ(points3D.size(), NumPoints());
+  CHECK_NOTNULL(valid);
+
+  const size_t num_points = NumPoints();
+  valid->resize(num_points);
+
+  // The triangulation angle min(alpha, pi - alpha) of two rays is at least
+  // the minimum angle, if the absolute cosine of alpha is at most the cosine
+  // of the minimum angle.
+  const bool any_tri_angle = min_tri_angle <= 0;
+  const double max_abs_cos_tri_angle =
+      min_tri_angle > M_PI / 2 ? -1.0 : std::cos(min_tri_angle);
+
+  LaneObservationsVector group;
+  for (size_t first_point_idx = 0; first_point_idx < num_points;
+       first_point_idx += kNumLanes) {
+    GatherGroup(first_point_idx, &group);
+
+    LaneArray X[3];
+    GatherPoints3D(points3D, first_point_idx, X);
+
+    LaneArray cheirality_ok = LaneArray::Ones();
+    for (const auto& lanes : group) {
+      const LaneArray* P = lanes.proj_matrix;
+      LaneArray proj[3];
+      for (int r = 0; r < 3; ++r) {
+        proj[r] = P[4 * r] * X[0] + P[4 * r + 1] * X[1] + P[4 * r + 2] * X[2] +
+                  P[4 * r + 3];
+      }
+      const LaneArray radial_ok =
+          (proj[0] * lanes.x + proj[1] * lanes.y > 0).cast<double>();
+      const LaneArray depth_ok =
+          ((proj[2] >= std::numeric_limits<double>::epsilon()) ==
+           (lanes.sign > 0))
+              .cast<double>();
+      cheirality_ok *= (lanes.radial > 0)
+                           .select(radial_ok,
+                                   (lanes.point > 0).select(depth_ok, 1.0));
+    }
+
+    LaneArray tri_angle_ok = LaneArray::Zero();
+    for (size_t i = 0; i < group.size(); ++i) {
+      for (size_t j = 0; j < i; ++j) {
+        const LaneObservations& lanes1 = group[i];
+        const LaneObservations& lanes2 = group[j];
+        LaneArray baseline_length_squared = LaneArray::Zero();
+        LaneArray ray_length_squared1 = LaneArray::Zero();
+        LaneArray ray_length_squared2 = LaneArray::Zero();
+        for (int r = 0; r < 3; ++r) {
+          baseline_length_squared +=
+              (lanes1.proj_center[r] - lanes2.proj_center[r]).square();
+          ray_length_squared1 += (X[r] - lanes1.proj_center[r]).square();
+          ray_length_squared2 += (X[r] - lanes2.proj_center[r]).square();
+        }
+        const LaneArray denominator =
+            2 * (ray_length_squared1 * ray_length_squared2).sqrt();
+        const LaneArray nominator =
+            ray_length_squared1 + ray_length_squared2 - baseline_length_squared;
+        LaneArray angle_ok = LaneArray::Ones();
+        if (!any_tri_angle) {
+          angle_ok = ((denominator > 0) &&
+                      (nominator.abs() <= max_abs_cos_tri_angle * denominator))
+                         .cast<double>();
+        }
+        tri_angle_ok = tri_angle_ok.max(lanes1.point * lanes2.point * angle_ok);
+      }
+    }
+
+    for (size_t l = 0; l < kNumLanes; ++l) {
+      const size_t point_idx = first_point_idx + l;
+      if (point_idx >= num_points) {
+        break;
+      }
+      (*valid)[point_idx] =
+          cheirality_ok(l) > 0 &&
+          (point_has_radial_[point_idx] || tri_angle_ok(l) > 0);
+    }
+  }
+}
+
+void TriangulationBatch::Residuals(
+    const std::vector<Eigen::Vector3d>& points3D,
+    std::vector<double>* residuals) const {
+  CHECK_EQ(points3D.size(), NumPoints());
+  CHECK_NOTNULL(residuals);
+
+  const size_t num_points = NumPoints();
+  residuals->resize(NumObservations());
+
+  LaneObservationsVector group;
+  for (size_t first_point_idx = 0; first_point_idx < num_points;
+       first_point_idx += kNumLanes) {
+    GatherGroup(first_point_idx, &group);
+
+    LaneArray X[3];
+    GatherPoints3D(points3D, first_point_idx, X);
+
+    for (size_t slot = 0; slot < group.size(); ++slot) {
+      const LaneObservations& lanes = group[slot];
+      const LaneArray* P = lanes.proj_matrix;
+      LaneArray proj[3];
+      for (int r = 0; r < 3; ++r) {
+        proj[r] = P[4 * r] * X[0] + P[4 * r + 1] * X[1] + P[4 * r + 2] * X[2] +
+                  P[4 * r + 3];
+      }
+
+      // Cosine of the angle between the radial directions for radial
+      // observations, folded to the smaller of the two angles, and between
+      // the viewing rays for point observations.
+      const LaneArray dot_xy = lanes.x * proj[0] + lanes.y * proj[1];
+      const LaneArray norm_xy = lanes.x.square() + lanes.y.square();
+      const LaneArray proj_norm_xy = proj[0].square() + proj[1].square();
+      const LaneArray radial_cos =
+          dot_xy.abs() / (norm_xy * proj_norm_xy).sqrt();
+      const LaneArray point_cos =
+          lanes.sign * (dot_xy + proj[2]) /
+          ((norm_xy + 1) * (proj_norm_xy + proj[2].square())).sqrt();
+      const LaneArray angle = (lanes.radial > 0)
+                                  .select(radial_cos, point_cos)
+                                  .max(-1.0)
+                                  .min(1.0)
+                                  .acos();
+
+      for (size_t l = 0; l < kNumLanes; ++l) {
+        const size_t point_idx = first_point_idx + l;
+        if (point_idx >= num_points) {
+          break;
+        }
+        if (slot < NumObservations(point_idx)) {
+          (*residuals)[point_offsets_[point_idx] + slot] = angle(l) * angle(l);
+        }
+      }
+    }
+  }
+}
+
+void TriangulationBatch::Reserve(const size_t num_points,
+                                 const size_t num_observations) {
+  point_offsets_.reserve(num_points + 1);
+  point_has_radial_.reserve(num_points);
+  point_num_constraints_.reserve(num_points);
+  proj_matrices_.reserve(num_observations);
+  proj_centers_.reserve(num_observations);
+  points_.reserve(num_observations);
+  radial_.reserve(num_observations);
+  positive_focal_length_.reserve(num_observations);
+}
+
+void TriangulationBatch::Clear() {
+  point_offsets_.clear();
+  point_has_radial_.clear();
+  point_num_constraints_.clear();
+  proj_matrices_.clear();
+  proj_centers_.clear();
+  points_.clear();
+  radial_.clear();
+  positive_focal_length_.clear();
+}
+
+void TriangulationBatch::GatherGroup(const size_t first_point_idx,
+                                     LaneObservationsVector* group) const {
+  const size_t num_points = NumPoints();
+  const size_t last_point_idx =
+      std::min(first_point_idx + kNumLanes, num_points);
+
+  size_t max_num_observations = 0;
+  for (size_t point_idx = first_point_idx; point_idx < last_point_idx;
+       ++point_idx) {
+    max_num_observations =
+        std::max(max_num_observations, NumObservations(point_idx));
+  }
+
+  group->resize(max_num_observations);
+
+  for (size_t slot = 0; slot < max_num_observations; ++slot) {
+    LaneObservations& lanes = (*group)[slot];
+    for (int k = 0; k < 12; ++k) {
+      lanes.proj_matrix[k].setZero();
+    }
+    for (int r = 0; r < 3; ++r) {
+      lanes.proj_center[r].setZero();
+    }
+    lanes.x.setZero();
+    lanes.y.setZero();
+    lanes.radial.setZero();
+    lanes.point.setZero();
+    lanes.sign.setZero();
+
+    for (size_t l = 0; l < kNumLanes; ++l) {
+      const size_t point_idx = first_point_idx + l;
+      if (point_idx >= last_point_idx || slot >= NumObservations(point_idx)) {
+        continue;
+      }
+
+      const size_t obs_idx = point_offsets_[point_idx] + slot;
+      const Eigen::Matrix3x4d& proj_matrix = proj_matrices_[obs_idx];
+      for (int r = 0; r < 3; ++r) {
+        for (int c = 0; c < 4; ++c) {
+          lanes.proj_matrix[4 * r + c](l) = proj_matrix(r, c);
+        }
+        lanes.proj_center[r](l) = proj_centers_[obs_idx](r);
+      }
+      lanes.x(l) = points_[obs_idx](0);
+      lanes.y(l) = points_[obs_idx](1);
+      if (radial_[obs_idx]) {
+        lanes.radial(l) = 1;
+      } else {
+        lanes.point(l) = 1;
+        lanes.sign(l) = positive_focal_length_[obs_idx] ? 1 : -1;
+      }
+    }
+  }
+}
+
+void TriangulationBatch::GatherPoints3D(
+    const std::vector<Eigen::Vector3d>& points3D, const size_t first_point_idx,
+    LaneArray X[3]) const {
+  for (int r = 0; r < 3; ++r) {
+    X[r].setZero();
+  }
+  for (size_t l = 0; l < kNumLanes; ++l) {
+    const size_t point_idx = first_point_idx + l;
+    if (point_idx >= points3D.size()) {
+      break;
+    }
+    for (int r = 0; r < 3; ++r) {
+      X[r](l) = points3D[point_idx](r);
+    }
+  }
+}
+
+}  // namespace colmap
@@ -0,0 +1,187 @@
+// Copyright (c) 2018, ETH Zurich and UNC Chapel Hill.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//
+//     * Neither the name of ETH Zurich and UNC Chapel Hill nor the names of
+//       its contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Author: Johannes L. Schoenberger (jsch-at-demuc-dot-de)
+
+
+#ifndef COLMAP_SRC_BASE_TRIANGULATION_BATCH_H_
+#define COLMAP_SRC_BASE_TRIANGULATION_BATCH_H_
+
+#include <vector>
+
+#include <Eigen/Core>
+
+#include "util/alignment.h"
+#include "util/types.h"
+
+namespace colmap {
+
+// Triangulation of many 3D points at once from mixed radial and point
+// observations.
+//
+// A radial observation contributes the single constraint that the point lies
+// on the plane through the radial line of the normalized image point, while a
+// point observation of a calibrated camera constrains the point to its viewing
+// ray. Points with at least one radial observation are triangulated from the
+// planes as in `TriangulateMultiViewPointFromLines`, all other points from the
+// rays as in `TriangulateMultiViewPoint`, which is the non-minimal solver of
+// `TriangulationEstimator`.
+//
+// The points are processed in groups of `kNumLanes`. The observations of a
+// group are gathered into fixed-size Eigen arrays with one lane per point, so
+// that the normal equations, the cheirality test, and the residuals of all
+// points in a group are evaluated by the same branch-free, vectorized array
+// operations. Only the final 4x4 eigen decomposition is solved per point.
+class TriangulationBatch {
+ public:
+  // Number of points processed together.
+  static const size_t kNumLanes = 4;
+
+  // Start a new point and return its index in the batch. The observations
+  // added afterwards belong to this point.
+  size_t AddPoint();
+
+  // Add a radial observation with the normalized image point of a radial or
+  // implicitly distorted camera.
+  void AddRadialObservation(const Eigen::Matrix3x4d& proj_matrix,
+                            const Eigen::Vector3d& proj_center,
+                            const Eigen::Vector2d& point);
+
+  // Add a point observation with the normalized image point of a calibrated
+  // camera. The sign of the focal length determines on which side of the
+  // camera a point is in front of it.
+  void AddPointObservation(const Eigen::Matrix3x4d& proj_matrix,
+                           const Eigen::Vector3d& proj_center,
+                           const Eigen::Vector2d& point,
+                           const bool positive_focal_length = true);
+
+  inline size_t NumPoints() const;
+  inline size_t NumObservations() const;
+  inline size_t NumObservations(const size_t point_idx) const;
+
+  // Number of scalar constraints of a point. A point is only determined with
+  // at least 4 constraints.
+  inline size_t NumConstraints(const size_t point_idx) const;
+
+  inline bool HasRadialObservations(const size_t point_idx) const;
+
+  // Triangulate all points in the order of addition.
+  void Triangulate(std::vector<Eigen::Vector3d>* points3D) const;
+
+  // Check the triangulated points with the same criteria as
+  // `TriangulationEstimator`: Radial observations must lie in the half-plane
+  // of the projected point and point observations must have positive depth,
+  // or negative depth for a negative focal length. Points without radial
+  // observations additionally need at least one pair of point observations
+  // with a triangulation angle of at least `min_tri_angle` in radians.
+  void Check(const std::vector<Eigen::Vector3d>& points3D,
+             const double min_tri_angle, std::vector<char>* valid) const;
+
+  // Squared angular error of all observations in the order of addition, with
+  // the same definition as `CalculateAngularError`.
+  void Residuals(const std::vector<Eigen::Vector3d>& points3D,
+                 std::vector<double>* residuals) const;
+
+  void Reserve(const size_t num_points, const size_t num_observations);
+
+  void Clear();
+
+ private:
+  typedef Eigen::Array<double, kNumLanes, 1> LaneArray;
+
+  // Observations of one slot for all points of a group, where lane `l` holds
+  // the observation of the `l`-th point. Lanes without an observation in the
+  // slot are zero.
+  struct LaneObservations {
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+    // Row-major entries of the projection matrices.
+    LaneArray proj_matrix[12];
+    LaneArray proj_center[3];
+    LaneArray x;
+    LaneArray y;
+    // 1 for radial observations and 0 otherwise.
+    LaneArray radial;
+    // 1 for point observations and 0 otherwise.
+    LaneArray point;
+    // 1 for point observations with positive focal length, -1 for negative
+    // focal length, and 0 otherwise.
+    LaneArray sign;
+  };
+
+  typedef std::vector<LaneObservations,
+                      Eigen::aligned_allocator<LaneObservations>>
+      LaneObservationsVector;
+
+  // Gather the observations of the group of points starting at
+  // `first_point_idx` into one entry per observation slot.
+  void GatherGroup(const size_t first_point_idx,
+                   LaneObservationsVector* group) const;
+
+  // Gather the triangulated points of the group into lanes.
+  void GatherPoints3D(const std::vector<Eigen::Vector3d>& points3D,
+                      const size_t first_point_idx, LaneArray X[3]) const;
+
+  // Offsets of the observations of every point, with a final sentinel.
+  std::vector<size_t> point_offsets_;
+  std::vector<char> point_has_radial_;
+  std::vector<size_t> point_num_constraints_;
+
+  std::vector<Eigen::Matrix3x4d, Eigen::aligned_allocator<Eigen::Matrix3x4d>>
+      proj_matrices_;
+  std::vector<Eigen::Vector3d> proj_centers_;
+  std::vector<Eigen::Vector2d> points_;
+  std::vector<char> radial_;
+  std::vector<char> positive_focal_length_;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// Implementation
+////////////////////////////////////////////////////////////////////////////////
+
+size_t TriangulationBatch::NumPoints() const {
+  return point_offsets_.empty() ? 0 : point_offsets_.size() - 1;
+}
+
+size_t TriangulationBatch::NumObservations() const { return points_.size(); }
+
+size_t TriangulationBatch::NumObservations(const size_t point_idx) const {
+  return point_offsets_.at(point_idx + 1) - point_offsets_[point_idx];
+}
+
+size_t TriangulationBatch::NumConstraints(const size_t point_idx) const {
+  return point_num_constraints_.at(point_idx);
+}
+
+bool TriangulationBatch::HasRadialObservations(const size_t point_idx) const {
+  return point_has_radial_.at(point_idx) != 0;
+}
+
+}  // namespace colmap
+
+#endif  // COLMAP_SRC_BASE_TRIANGULATION_BATCH_H_
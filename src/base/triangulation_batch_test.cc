@@ -0,0 +1,287 @@
+// Copyright (c) 2018, ETH Zurich and UNC Chapel Hill.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//
+//     * Neither the name of ETH Zurich and UNC Chapel Hill nor the names of
+//       its contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Author: Johannes L. Schoenberger (jsch-at-demuc-dot-de)
+
+#define TEST_NAME "base/triangulation_batch"
+#include "util/testing.h"
+
+#include <Eigen/Core>
+#include <Eigen/Geometry>
+
+#include "base/triangulation.h"
+#include "base/triangulation_batch.h"
+#include "util/math.h"
+
+using namespace colmap;
+
+namespace {
+
+struct TestCamera {
+  Eigen::Matrix3x4d proj_matrix;
+  Eigen::Vector3d proj_center;
+};
+
+std::vector<TestCamera> GenerateCameras() {
+  std::vector<TestCamera> cameras(5);
+  for (size_t i = 0; i < cameras.size(); ++i) {
+    const Eigen::Matrix3d R =
+        Eigen::AngleAxisd(0.1 * i, Eigen::Vector3d(0.2, 1, 0.1).normalized())
+            .toRotationMatrix();
+    cameras[i].proj_center = Eigen::Vector3d(i - 2.0, 0.3 * i, -5.0);
+    cameras[i].proj_matrix.leftCols<3>() = R;
+    cameras[i].proj_matrix.col(3) = -R * cameras[i].proj_center;
+  }
+  return cameras;
+}
+
+std::vector<Eigen::Vector3d> GeneratePoints3D() {
+  std::vector<Eigen::Vector3d> points3D;
+  for (int i = 0; i < 11; ++i) {
+    points3D.emplace_back(0.3 * i - 1.5, 0.1 * i * i - 0.5, 0.2 * (i % 4));
+  }
+  return points3D;
+}
+
+Eigen::Vector2d ProjectPoint(const TestCamera& camera,
+                             const Eigen::Vector3d& point3D) {
+  return (camera.proj_matrix * point3D.homogeneous()).hnormalized();
+}
+
+// Radial observations are only defined up to a positive scale.
+Eigen::Vector2d ProjectRadial(const TestCamera& camera,
+                              const Eigen::Vector3d& point3D) {
+  return 0.7 * (camera.proj_matrix * point3D.homogeneous()).topRows<2>();
+}
+
+// Observe the i-th point with a varying mix of radial and point observations.
+// Every third point has point observations only, every other point at least
+// one radial observation.
+void AddObservations(const std::vector<TestCamera>& cameras,
+                     const Eigen::Vector3d& point3D, const size_t i,
+                     TriangulationBatch* batch,
+                     std::vector<Eigen::Matrix3x4d>* proj_matrices,
+                     std::vector<Eigen::Vector3d>* lines,
+                     std::vector<Eigen::Vector2d>* points) {
+  batch->AddPoint();
+  const size_t num_observations = 2 + i % (cameras.size() - 1);
+  for (size_t j = 0; j < num_observations; ++j) {
+    const TestCamera& camera = cameras[(i + j) % cameras.size()];
+    if (i % 3 != 0 && (j + i) % 2 == 0) {
+      const Eigen::Vector2d point = ProjectRadial(camera, point3D);
+      batch->AddRadialObservation(camera.proj_matrix, camera.proj_center,
+                                  point);
+      proj_matrices->push_back(camera.proj_matrix);
+      lines->emplace_back(point(1), -point(0), 0.0);
+    } else {
+      const Eigen::Vector2d point = ProjectPoint(camera, point3D);
+      batch->AddPointObservation(camera.proj_matrix, camera.proj_center,
+                                 point);
+      proj_matrices->push_back(camera.proj_matrix);
+      lines->emplace_back(1.0, 0.0, -point(0));
+      proj_matrices->push_back(camera.proj_matrix);
+      lines->emplace_back(0.0, 1.0, -point(1));
+      points->push_back(point);
+    }
+  }
+}
+
+}  // namespace
+
+BOOST_AUTO_TEST_CASE(TestEmpty) {
+  TriangulationBatch batch;
+  BOOST_CHECK_EQUAL(batch.NumPoints(), 0);
+  BOOST_CHECK_EQUAL(batch.NumObservations(), 0);
+  std::vector<Eigen::Vector3d> points3D;
+  batch.Triangulate(&points3D);
+  BOOST_CHECK(points3D.empty());
+  std::vector<char> valid;
+  batch.Check(points3D, 0, &valid);
+  BOOST_CHECK(valid.empty());
+}
+
+BOOST_AUTO_TEST_CASE(TestAddObservations) {
+  const std::vector<TestCamera> cameras = GenerateCameras();
+  TriangulationBatch batch;
+  BOOST_CHECK_EQUAL(batch.AddPoint(), 0);
+  batch.AddRadialObservation(cameras[0].proj_matrix, cameras[0].proj_center,
+                             Eigen::Vector2d(1, 2));
+  batch.AddPointObservation(cameras[1].proj_matrix, cameras[1].proj_center,
+                            Eigen::Vector2d(1, 2));
+  BOOST_CHECK_EQUAL(batch.AddPoint(), 1);
+  batch.AddPointObservation(cameras[2].proj_matrix, cameras[2].proj_center,
+                            Eigen::Vector2d(1, 2));
+  BOOST_CHECK_EQUAL(batch.NumPoints(), 2);
+  BOOST_CHECK_EQUAL(batch.NumObservations(), 3);
+  BOOST_CHECK_EQUAL(batch.NumObservations(0), 2);
+  BOOST_CHECK_EQUAL(batch.NumObservations(1), 1);
+  BOOST_CHECK_EQUAL(batch.NumConstraints(0), 3);
+  BOOST_CHECK_EQUAL(batch.NumConstraints(1), 2);
+  BOOST_CHECK(batch.HasRadialObservations(0));
+  BOOST_CHECK(!batch.HasRadialObservations(1));
+  batch.Clear();
+  BOOST_CHECK_EQUAL(batch.NumPoints(), 0);
+  BOOST_CHECK_EQUAL(batch.NumObservations(), 0);
+}
+
+BOOST_AUTO_TEST_CASE(TestTriangulate) {
+  const std::vector<TestCamera> cameras = GenerateCameras();
+  const std::vector<Eigen::Vector3d> points3D = GeneratePoints3D();
+
+  TriangulationBatch batch;
+  std::vector<Eigen::Vector3d> ref_points3D;
+  for (size_t i = 0; i < points3D.size(); ++i) {
+    std::vector<Eigen::Matrix3x4d> proj_matrices;
+    std::vector<Eigen::Vector3d> lines;
+    std::vector<Eigen::Vector2d> points;
+    AddObservations(cameras, points3D[i], i, &batch, &proj_matrices, &lines,
+                    &points);
+    if (batch.HasRadialObservations(i)) {
+      ref_points3D.push_back(
+          TriangulateMultiViewPointFromLines(proj_matrices, lines));
+    } else {
+      std::vector<Eigen::Matrix3x4d> point_proj_matrices;
+      for (size_t j = 0; j < proj_matrices.size(); j += 2) {
+        point_proj_matrices.push_back(proj_matrices[j]);
+      }
+      ref_points3D.push_back(
+          TriangulateMultiViewPoint(point_proj_matrices, points));
+    }
+  }
+
+  std::vector<Eigen::Vector3d> tri_points3D;
+  batch.Triangulate(&tri_points3D);
+  BOOST_CHECK_EQUAL(tri_points3D.size(), points3D.size());
+  for (size_t i = 0; i < points3D.size(); ++i) {
+    if (batch.NumConstraints(i) < 4) {
+      continue;
+    }
+    BOOST_CHECK_LT((tri_points3D[i] - points3D[i]).norm(), 1e-8);
+    BOOST_CHECK_LT((tri_points3D[i] - ref_points3D[i]).norm(), 1e-8);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(TestCheck) {
+  const std::vector<TestCamera> cameras = GenerateCameras();
+  const std::vector<Eigen::Vector3d> points3D = GeneratePoints3D();
+
+  TriangulationBatch batch;
+  std::vector<Eigen::Matrix3x4d> proj_matrices;
+  std::vector<Eigen::Vector3d> lines;
+  std::vector<Eigen::Vector2d> points;
+  for (size_t i = 0; i < points3D.size(); ++i) {
+    AddObservations(cameras, points3D[i], i, &batch, &proj_matrices, &lines,
+                    &points);
+  }
+
+  std::vector<char> valid;
+  batch.Check(points3D, DegToRad(1.0), &valid);
+  BOOST_CHECK_EQUAL(valid.size(), points3D.size());
+  for (size_t i = 0; i < points3D.size(); ++i) {
+    BOOST_CHECK(valid[i]);
+  }
+
+  // The cameras only have a baseline of a few degrees.
+  batch.Check(points3D, DegToRad(60.0), &valid);
+  for (size_t i = 0; i < points3D.size(); ++i) {
+    BOOST_CHECK_EQUAL(valid[i], batch.HasRadialObservations(i));
+  }
+
+  // Points behind the cameras and on the other side of the radial lines.
+  std::vector<Eigen::Vector3d> mirrored_points3D = points3D;
+  for (auto& point3D : mirrored_points3D) {
+    point3D = 2 * cameras[2].proj_center - point3D;
+  }
+  batch.Check(mirrored_points3D, 0, &valid);
+  for (size_t i = 0; i < points3D.size(); ++i) {
+    BOOST_CHECK(!valid[i]);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(TestCheckNegativeFocalLength) {
+  const std::vector<TestCamera> cameras = GenerateCameras();
+  const Eigen::Vector3d point3D(0.1, 0.2, 0.3);
+
+  TriangulationBatch batch;
+  for (const bool positive_focal_length : {true, false}) {
+    batch.AddPoint();
+    for (size_t i = 0; i < 2; ++i) {
+      batch.AddPointObservation(cameras[2 * i].proj_matrix,
+                                cameras[2 * i].proj_center,
+                                ProjectPoint(cameras[2 * i], point3D),
+                                positive_focal_length);
+    }
+  }
+
+  std::vector<char> valid;
+  batch.Check({point3D, point3D}, 0, &valid);
+  BOOST_CHECK(valid[0]);
+  BOOST_CHECK(!valid[1]);
+}
+
+BOOST_AUTO_TEST_CASE(TestResiduals) {
+  const std::vector<TestCamera> cameras = GenerateCameras();
+  const std::vector<Eigen::Vector3d> points3D = GeneratePoints3D();
+
+  TriangulationBatch batch;
+  std::vector<Eigen::Matrix3x4d> proj_matrices;
+  std::vector<Eigen::Vector3d> lines;
+  std::vector<Eigen::Vector2d> points;
+  for (size_t i = 0; i < points3D.size(); ++i) {
+    AddObservations(cameras, points3D[i], i, &batch, &proj_matrices, &lines,
+                    &points);
+  }
+
+  std::vector<double> residuals;
+  batch.Residuals(points3D, &residuals);
+  BOOST_CHECK_EQUAL(residuals.size(), batch.NumObservations());
+  for (const double residual : residuals) {
+    BOOST_CHECK_LT(residual, 1e-12);
+  }
+
+  // Rotate the viewing ray by a known angle.
+  batch.Clear();
+  const Eigen::Vector3d point3D(0.1, 0.2, 0.3);
+  const Eigen::Vector3d ray = cameras[0].proj_matrix * point3D.homogeneous();
+  const Eigen::Vector3d axis = ray.cross(Eigen::Vector3d::UnitX()).normalized();
+  const Eigen::Vector3d rotated_ray = Eigen::AngleAxisd(0.01, axis) * ray;
+  const Eigen::Vector2d rotated_xy =
+      Eigen::Rotation2Dd(0.02) * ray.topRows<2>();
+  batch.AddPoint();
+  batch.AddPointObservation(cameras[0].proj_matrix, cameras[0].proj_center,
+                            rotated_ray.hnormalized());
+  batch.AddRadialObservation(cameras[0].proj_matrix, cameras[0].proj_center,
+                             rotated_xy);
+  batch.AddRadialObservation(cameras[0].proj_matrix, cameras[0].proj_center,
+                             -rotated_xy);
+  batch.Residuals({point3D}, &residuals);
+  BOOST_CHECK_CLOSE(residuals[0], 0.01 * 0.01, 1e-6);
+  BOOST_CHECK_CLOSE(residuals[1], 0.02 * 0.02, 1e-6);
+  BOOST_CHECK_CLOSE(residuals[2], 0.02 * 0.02, 1e-6);
+}
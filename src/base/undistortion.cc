@@ -146,8 +146,173 @@ void WriteCOLMAPCommands(const bool geometric,
         << std::endl;
 }
 
+// Radial profile of a camera with implicit distortion, which maps the angle
+// between the viewing ray and the optical axis to the distance of the image
+// point from the principal point, as defined by the calibrated control points.
+class ImplicitDistortionProfile {
+ public:
+  explicit ImplicitDistortionProfile(const Camera& camera)
+      : principal_point_(camera.PrincipalPointX(), camera.PrincipalPointY()) {
+    CHECK_EQ(camera.ModelId(), ImplicitDistortionModel::model_id);
+    Camera calibrated_camera = camera;
+    calibrated_camera.SetCalibrated(true);
+    calibrated_camera.SetSplineFromParams();
+    spline_ = calibrated_camera.GetSpline();
+    thetas_ = spline_.get_x();
+    radii_ = spline_.get_y();
+    CHECK_GE(thetas_.size(), 2);
+    min_theta_ = *std::min_element(thetas_.begin(), thetas_.end());
+    max_theta_ = *std::max_element(thetas_.begin(), thetas_.end());
+    min_radius_ = *std::min_element(radii_.begin(), radii_.end());
+    max_radius_ = *std::max_element(radii_.begin(), radii_.end());
+  }
+
+  double MinTheta() const { return min_theta_; }
+  double MaxTheta() const { return max_theta_; }
+
+  // Project a normalized world point, returns false if it is outside the
+  // calibrated range of the camera.
+  bool WorldToImage(const Eigen::Vector2d& world_point,
+                    Eigen::Vector2d* image_point) const {
+    const double rho = world_point.norm();
+    const double theta = std::atan(rho);
+    if (theta < min_theta_ || theta > max_theta_) {
+      return false;
+    }
+    if (rho == 0) {
+      *image_point = principal_point_;
+    } else {
+      *image_point = principal_point_ + (spline_(theta) / rho) * world_point;
+    }
+    return true;
+  }
+
+  // Unproject an image point to a normalized world point by inverting the
+  // profile with Newton's method, starting from the closest control point.
+  // Returns false if the point is outside the calibrated radius range, in
+  // which case the world point is clamped to the calibrated range.
+  bool ImageToWorld(const Eigen::Vector2d& image_point,
+                    Eigen::Vector2d* world_point) const {
+    const Eigen::Vector2d offset = image_point - principal_point_;
+    const double radius = offset.norm();
+    if (radius == 0) {
+      *world_point = Eigen::Vector2d::Zero();
+      return min_theta_ <= 0;
+    }
+
+    size_t closest_idx = 0;
+    for (size_t i = 1; i < radii_.size(); ++i) {
+      if (std::abs(radii_[i] - radius) <
+          std::abs(radii_[closest_idx] - radius)) {
+        closest_idx = i;
+      }
+    }
+
+    double theta = thetas_[closest_idx];
+    const bool in_range = radius >= min_radius_ && radius <= max_radius_;
+    if (in_range) {
+      for (int i = 0; i < 10; ++i) {
+        const double residual = spline_(theta) - radius;
+        const double derivative = spline_.deriv(1, theta);
+        if (std::abs(residual) < 1e-6 || derivative == 0) {
+          break;
+        }
+        theta = std::min(std::max(theta - residual / derivative, min_theta_),
+                         max_theta_);
+      }
+    }
+
+    *world_point = (std::tan(theta) / radius) * offset;
+    return in_range;
+  }
+
+ private:
+  Eigen::Vector2d principal_point_;
+  tk::spline<double> spline_;
+  std::vector<double> thetas_;
+  std::vector<double> radii_;
+  double min_theta_;
+  double max_theta_;
+  double min_radius_;
+  double max_radius_;
+};
+
+// Choose the focal length of the undistorted camera, such that the calibrated
+// field of view (limited by max_fov) touches the image corners (no blank
+// pixels) or the closest image border (all pixels) of the undistorted image.
+Camera UndistortImplicitDistortionCamera(const UndistortCameraOptions& options,
+                                         const Camera& camera) {
+  const ImplicitDistortionProfile profile(camera);
+  const double max_theta =
+      std::min(profile.MaxTheta(), DegToRad(0.5 * options.max_fov));
+
+  const double cx = camera.PrincipalPointX();
+  const double cy = camera.PrincipalPointY();
+  const double dx = std::max(cx, camera.Width() - cx);
+  const double dy = std::max(cy, camera.Height() - cy);
+  const double min_border_dist =
+      std::min(std::min(cx, camera.Width() - cx),
+               std::min(cy, camera.Height() - cy));
+
+  const double min_focal_length = min_border_dist / std::tan(max_theta);
+  const double max_focal_length =
+      std::sqrt(dx * dx + dy * dy) / std::tan(max_theta);
+  const double focal_length =
+      min_focal_length * options.blank_pixels +
+      max_focal_length * (1.0 - options.blank_pixels);
+
+  Camera undistorted_camera;
+  undistorted_camera.SetModelId(PinholeCameraModel::model_id);
+  undistorted_camera.SetWidth(camera.Width());
+  undistorted_camera.SetHeight(camera.Height());
+  undistorted_camera.SetFocalLengthX(focal_length);
+  undistorted_camera.SetFocalLengthY(focal_length);
+  undistorted_camera.SetPrincipalPointX(cx);
+  undistorted_camera.SetPrincipalPointY(cy);
+
+  return undistorted_camera;
+}
+
+void ClampUndistortedCameraSize(const UndistortCameraOptions& options,
+                                Camera* undistorted_camera) {
+  if (options.max_image_size > 0) {
+    const double max_image_scale_x =
+        options.max_image_size /
+        static_cast<double>(undistorted_camera->Width());
+    const double max_image_scale_y =
+        options.max_image_size /
+        static_cast<double>(undistorted_camera->Height());
+    const double max_image_scale =
+        std::min(max_image_scale_x, max_image_scale_y);
+    if (max_image_scale < 1.0) {
+      undistorted_camera->Rescale(max_image_scale);
+    }
+  }
+}
+
 }  // namespace
 
+UndistortionWarpTableCache::UndistortionWarpTableCache(
+    const UndistortCameraOptions& options)
+    : options_(options) {}
+
+std::shared_ptr<const WarpTable> UndistortionWarpTableCache::Get(
+    const Camera& distorted_camera) const {
+  const std::string key = StringPrintf(
+      "%d %d %d %s", distorted_camera.ModelId(),
+      static_cast<int>(distorted_camera.Width()),
+      static_cast<int>(distorted_camera.Height()),
+      distorted_camera.ParamsToString().c_str());
+  std::unique_lock<std::mutex> lock(mutex_);
+  auto& warp_table = warp_tables_[key];
+  if (!warp_table) {
+    warp_table = std::make_shared<const WarpTable>(ComputeUndistortionWarpTable(
+        distorted_camera, UndistortCamera(options_, distorted_camera),
+        /*num_threads=*/-1));
+  }
+  return warp_table;
+}
+
 COLMAPUndistorter::COLMAPUndistorter(const UndistortCameraOptions& options,
                                      const Reconstruction& reconstruction,
                                      const std::string& image_path,
@@ -155,7 +320,8 @@ COLMAPUndistorter::COLMAPUndistorter(const UndistortCameraOptions& options,
     : options_(options),
       image_path_(image_path),
       output_path_(output_path),
-      reconstruction_(reconstruction) {}
+      reconstruction_(reconstruction),
+      warp_tables_(options) {}
 
 void COLMAPUndistorter::Run() {
   PrintHeading1("Image undistortion");
@@ -227,8 +393,8 @@ void COLMAPUndistorter::Undistort(const size_t reg_image_idx) const {
 
   Bitmap undistorted_bitmap;
   Camera undistorted_camera;
-  UndistortImage(options_, distorted_bitmap, camera, &undistorted_bitmap,
-                 &undistorted_camera);
+  UndistortImage(options_, distorted_bitmap, camera, warp_tables_,
+                 &undistorted_bitmap, &undistorted_camera);
 
   undistorted_bitmap.Write(output_image_path);
 }
@@ -273,7 +439,8 @@ PMVSUndistorter::PMVSUndistorter(const UndistortCameraOptions& options,
     : options_(options),
       image_path_(image_path),
       output_path_(output_path),
-      reconstruction_(reconstruction) {}
+      reconstruction_(reconstruction),
+      warp_tables_(options) {}
 
 void PMVSUndistorter::Run() {
   PrintHeading1("Image undistortion (CMVS/PMVS)");
@@ -353,8 +520,8 @@ void PMVSUndistorter::Undistort(const size_t reg_image_idx) const {
 
   Bitmap undistorted_bitmap;
   Camera undistorted_camera;
-  UndistortImage(options_, distorted_bitmap, camera, &undistorted_bitmap,
-                 &undistorted_camera);
+  UndistortImage(options_, distorted_bitmap, camera, warp_tables_,
+                 &undistorted_bitmap, &undistorted_camera);
 
   undistorted_bitmap.Write(output_image_path);
   WriteProjectionMatrix(proj_matrix_path, undistorted_camera, image, "CONTOUR");
@@ -505,7 +672,8 @@ CMPMVSUndistorter::CMPMVSUndistorter(const UndistortCameraOptions& options,
     : options_(options),
       image_path_(image_path),
       output_path_(output_path),
-      reconstruction_(reconstruction) {}
+      reconstruction_(reconstruction),
+      warp_tables_(options) {}
 
 void CMPMVSUndistorter::Run() {
   PrintHeading1("Image undistortion (CMP-MVS)");
@@ -553,8 +721,8 @@ void CMPMVSUndistorter::Undistort(const size_t reg_image_idx) const {
 
   Bitmap undistorted_bitmap;
   Camera undistorted_camera;
-  UndistortImage(options_, distorted_bitmap, camera, &undistorted_bitmap,
-                 &undistorted_camera);
+  UndistortImage(options_, distorted_bitmap, camera, warp_tables_,
+                 &undistorted_bitmap, &undistorted_camera);
 
   undistorted_bitmap.Write(output_image_path);
   WriteProjectionMatrix(proj_matrix_path, undistorted_camera, image, "CONTOUR");
@@ -567,7 +735,8 @@ PureImageUndistorter::PureImageUndistorter(
     : options_(options),
       image_path_(image_path),
       output_path_(output_path),
-      image_names_and_cameras_(image_names_and_cameras) {}
+      image_names_and_cameras_(image_names_and_cameras),
+      warp_tables_(options) {}
 
 void PureImageUndistorter::Run() {
   PrintHeading1("Image undistortion");
@@ -615,8 +784,8 @@ void PureImageUndistorter::Undistort(const size_t image_idx) const {
     
   Bitmap undistorted_bitmap;
   Camera undistorted_camera;
-  UndistortImage(options_, distorted_bitmap, camera, &undistorted_bitmap,
-                 &undistorted_camera);
+  UndistortImage(options_, distorted_bitmap, camera, warp_tables_,
+                 &undistorted_bitmap, &undistorted_camera);
     
   undistorted_bitmap.Write(output_image_path);
 }
@@ -730,6 +899,15 @@ Camera UndistortCamera(const UndistortCameraOptions& options,
   CHECK_LE(options.roi_max_y, 1.0);
   CHECK_LT(options.roi_min_x, options.roi_max_x);
   CHECK_LT(options.roi_min_y, options.roi_max_y);
+  CHECK_GT(options.max_fov, 0);
+  CHECK_LT(options.max_fov, 180);
+
+  if (camera.ModelId() == ImplicitDistortionModel::model_id) {
+    Camera undistorted_camera =
+        UndistortImplicitDistortionCamera(options, camera);
+    ClampUndistortedCameraSize(options, &undistorted_camera);
+    return undistorted_camera;
+  }
 
   Camera undistorted_camera;
   undistorted_camera.SetModelId(PinholeCameraModel::model_id);
@@ -885,19 +1063,7 @@ Camera UndistortCamera(const UndistortCameraOptions& options,
         static_cast<double>(orig_undistorted_camera_height));
   }
 
-  if (options.max_image_size > 0) {
-    const double max_image_scale_x =
-        options.max_image_size /
-        static_cast<double>(undistorted_camera.Width());
-    const double max_image_scale_y =
-        options.max_image_size /
-        static_cast<double>(undistorted_camera.Height());
-    const double max_image_scale =
-        std::min(max_image_scale_x, max_image_scale_y);
-    if (max_image_scale < 1.0) {
-      undistorted_camera.Rescale(max_image_scale);
-    }
-  }
+  ClampUndistortedCameraSize(options, &undistorted_camera);
 
   return undistorted_camera;
 }
@@ -910,6 +1076,13 @@ void UndistortImage(const UndistortCameraOptions& options,
   CHECK_EQ(distorted_camera.Height(), distorted_bitmap.Height());
 
   *undistorted_camera = UndistortCamera(options, distorted_camera);
+
+  if (distorted_camera.ModelId() == ImplicitDistortionModel::model_id) {
+    ComputeUndistortionWarpTable(distorted_camera, *undistorted_camera)
+        .Warp(distorted_bitmap, undistorted_bitmap);
+    return;
+  }
+
   undistorted_bitmap->Allocate(static_cast<int>(undistorted_camera->Width()),
                                static_cast<int>(undistorted_camera->Height()),
                                distorted_bitmap.IsRGB());
@@ -919,6 +1092,66 @@ void UndistortImage(const UndistortCameraOptions& options,
                           distorted_bitmap, undistorted_bitmap);
 }
 
+WarpTable ComputeUndistortionWarpTable(const Camera& distorted_camera,
+                                       const Camera& undistorted_camera,
+                                       const int num_threads) {
+  WarpTable::MapFunc map_func;
+  if (distorted_camera.ModelId() == ImplicitDistortionModel::model_id) {
+    const auto profile =
+        std::make_shared<ImplicitDistortionProfile>(distorted_camera);
+    map_func = [profile, &undistorted_camera](
+                   const Eigen::Vector2d& undistorted_point,
+                   Eigen::Vector2d* distorted_point) {
+      return profile->WorldToImage(
+          undistorted_camera.ImageToWorld(undistorted_point), distorted_point);
+    };
+  } else {
+    map_func = [&distorted_camera, &undistorted_camera](
+                   const Eigen::Vector2d& undistorted_point,
+                   Eigen::Vector2d* distorted_point) {
+      *distorted_point = distorted_camera.WorldToImage(
+          undistorted_camera.ImageToWorld(undistorted_point));
+      return true;
+    };
+  }
+
+  return WarpTable(static_cast<int>(distorted_camera.Width()),
+                   static_cast<int>(distorted_camera.Height()),
+                   static_cast<int>(undistorted_camera.Width()),
+                   static_cast<int>(undistorted_camera.Height()), map_func,
+                   num_threads);
+}
+
+void UndistortImage(const UndistortCameraOptions& options,
+                    const Bitmap& distorted_bitmap,
+                    const Camera& distorted_camera,
+                    const WarpTable& warp_table, Bitmap* undistorted_bitmap,
+                    Camera* undistorted_camera) {
+  CHECK_EQ(distorted_camera.Width(), distorted_bitmap.Width());
+  CHECK_EQ(distorted_camera.Height(), distorted_bitmap.Height());
+
+  *undistorted_camera = UndistortCamera(options, distorted_camera);
+  CHECK_EQ(warp_table.TargetWidth(), undistorted_camera->Width());
+  CHECK_EQ(warp_table.TargetHeight(), undistorted_camera->Height());
+
+  warp_table.Warp(distorted_bitmap, undistorted_bitmap);
+}
+
+void UndistortImage(const UndistortCameraOptions& options,
+                    const Bitmap& distorted_bitmap,
+                    const Camera& distorted_camera,
+                    const UndistortionWarpTableCache& warp_tables,
+                    Bitmap* undistorted_bitmap, Camera* undistorted_camera) {
+  if (distorted_camera.ModelId() == ImplicitDistortionModel::model_id) {
+    UndistortImage(options, distorted_bitmap, distorted_camera,
+                   *warp_tables.Get(distorted_camera), undistorted_bitmap,
+                   undistorted_camera);
+  } else {
+    UndistortImage(options, distorted_bitmap, distorted_camera,
+                   undistorted_bitmap, undistorted_camera);
+  }
+}
+
 void UndistortReconstruction(const UndistortCameraOptions& options,
                              Reconstruction* reconstruction) {
   const auto distorted_cameras = reconstruction->Cameras();
@@ -931,6 +1164,22 @@ void UndistortReconstruction(const UndistortCameraOptions& options,
     auto& image = reconstruction->Image(distorted_image.first);
     const auto& distorted_camera = distorted_cameras.at(image.CameraId());
     const auto& undistorted_camera = reconstruction->Camera(image.CameraId());
+    if (distorted_camera.ModelId() == ImplicitDistortionModel::model_id) {
+      // Observations outside the calibrated radius range have no reliable
+      // undistorted position, so they are removed from their tracks.
+      const ImplicitDistortionProfile profile(distorted_camera);
+      for (point2D_t point2D_idx = 0; point2D_idx < image.NumPoints2D();
+           ++point2D_idx) {
+        auto& point2D = image.Point2D(point2D_idx);
+        Eigen::Vector2d world_point;
+        if (!profile.ImageToWorld(point2D.XY(), &world_point) &&
+            point2D.HasPoint3D()) {
+          reconstruction->DeleteObservation(image.ImageId(), point2D_idx);
+        }
+        point2D.SetXY(undistorted_camera.WorldToImage(world_point));
+      }
+      continue;
+    }
     for (point2D_t point2D_idx = 0; point2D_idx < image.NumPoints2D();
          ++point2D_idx) {
       auto& point2D = image.Point2D(point2D_idx);
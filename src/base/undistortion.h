@@ -32,7 +32,13 @@
 #ifndef COLMAP_SRC_BASE_UNDISTORTION_H_
 #define COLMAP_SRC_BASE_UNDISTORTION_H_
 
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
 #include "base/reconstruction.h"
+#include "base/warp.h"
 #include "util/alignment.h"
 #include "util/bitmap.h"
 #include "util/threading.h"
@@ -59,6 +65,29 @@ struct UndistortCameraOptions {
   double roi_min_y = 0.0;
   double roi_max_x = 1.0;
   double roi_max_y = 1.0;
+
+  // Maximum field of view in degrees of the undistorted camera for cameras
+  // with implicit distortion, whose calibrated field of view can exceed the
+  // field of view that a pinhole camera can represent. Image regions outside
+  // the calibrated radius range are left blank.
+  double max_fov = 120.0;
+};
+
+// Thread-safe cache of the undistortion warp tables of cameras with implicit
+// distortion. A table is only computed once per camera and then shared by all
+// images of the camera. Cameras are identified by their model, size and
+// parameters, such that cameras without identifier can also share tables.
+class UndistortionWarpTableCache {
+ public:
+  explicit UndistortionWarpTableCache(const UndistortCameraOptions& options);
+
+  std::shared_ptr<const WarpTable> Get(const Camera& distorted_camera) const;
+
+ private:
+  const UndistortCameraOptions options_;
+  mutable std::mutex mutex_;
+  mutable std::unordered_map<std::string, std::shared_ptr<const WarpTable>>
+      warp_tables_;
 };
 
 // Undistort images and export undistorted cameras, as required by the
@@ -82,6 +111,7 @@ class COLMAPUndistorter : public Thread {
   std::string image_path_;
   std::string output_path_;
   const Reconstruction& reconstruction_;
+  UndistortionWarpTableCache warp_tables_;
 };
 
 // Undistort images and prepare data for CMVS/PMVS.
@@ -107,6 +137,7 @@ class PMVSUndistorter : public Thread {
   std::string image_path_;
   std::string output_path_;
   const Reconstruction& reconstruction_;
+  UndistortionWarpTableCache warp_tables_;
 };
 
 // Undistort images and prepare data for CMP-MVS.
@@ -126,6 +157,7 @@ class CMPMVSUndistorter : public Thread {
   std::string image_path_;
   std::string output_path_;
   const Reconstruction& reconstruction_;
+  UndistortionWarpTableCache warp_tables_;
 };
   
 // Undistort images and export undistorted cameras without the need for a
@@ -147,6 +179,7 @@ class PureImageUndistorter : public Thread {
   std::string image_path_;
   std::string output_path_;
   const std::vector<std::pair<std::string, Camera>>& image_names_and_cameras_;
+  UndistortionWarpTableCache warp_tables_;
 };
 
 // Rectify stereo image pairs.
@@ -198,6 +231,30 @@ void UndistortImage(const UndistortCameraOptions& options,
                     const Camera& distorted_camera, Bitmap* undistorted_image,
                     Camera* undistorted_camera);
 
+// Compute the table to warp images of the distorted camera to the undistorted
+// camera. For cameras with implicit distortion, the table is restricted to the
+// calibrated radius range of the camera.
+WarpTable ComputeUndistortionWarpTable(const Camera& distorted_camera,
+                                       const Camera& undistorted_camera,
+                                       const int num_threads = 1);
+
+// Undistort image using a precomputed warp table, which avoids evaluating the
+// camera model for every image of the same camera.
+void UndistortImage(const UndistortCameraOptions& options,
+                    const Bitmap& distorted_image,
+                    const Camera& distorted_camera,
+                    const WarpTable& warp_table, Bitmap* undistorted_image,
+                    Camera* undistorted_camera);
+
+// Undistort image and reuse the cached warp table for cameras with implicit
+// distortion, which avoids evaluating the camera model for every image of the
+// same camera.
+void UndistortImage(const UndistortCameraOptions& options,
+                    const Bitmap& distorted_image,
+                    const Camera& distorted_camera,
+                    const UndistortionWarpTableCache& warp_tables,
+                    Bitmap* undistorted_image, Camera* undistorted_camera);
+
 // Undistort all cameras in the reconstruction and accordingly all
 // observations in their corresponding images.
 void UndistortReconstruction(const UndistortCameraOptions& options,
@@ -177,6 +177,151 @@ BOOST_AUTO_TEST_CASE(TestUndistortCameraNoBlankPixels) {
   }
 }
 
+BOOST_AUTO_TEST_CASE(TestUndistortImplicitDistortionCamera) {
+  // Equidistant fisheye profile with radius = 500 * theta.
+  Camera distorted_camera;
+  distorted_camera.InitializeWithName("IMPLICIT_DISTORTION", 1, 1000, 800);
+  const size_t num_control_points = (distorted_camera.NumParams() - 2) / 2;
+  for (size_t i = 0; i < num_control_points; ++i) {
+    const double theta = (i + 1.0) / num_control_points;
+    distorted_camera.Params(2 + i) = theta;
+    distorted_camera.Params(2 + num_control_points + i) = 500 * theta;
+  }
+
+  UndistortCameraOptions options;
+  Camera undistorted_camera = UndistortCamera(options, distorted_camera);
+  BOOST_CHECK_EQUAL(undistorted_camera.ModelName(), "PINHOLE");
+  BOOST_CHECK_EQUAL(undistorted_camera.Width(), 1000);
+  BOOST_CHECK_EQUAL(undistorted_camera.Height(), 800);
+  BOOST_CHECK_EQUAL(undistorted_camera.PrincipalPointX(), 500);
+  BOOST_CHECK_EQUAL(undistorted_camera.PrincipalPointY(), 400);
+  BOOST_CHECK_CLOSE(undistorted_camera.FocalLengthX(),
+                    std::sqrt(500.0 * 500.0 + 400.0 * 400.0) / std::tan(1.0),
+                    1e-6);
+  BOOST_CHECK_EQUAL(undistorted_camera.FocalLengthX(),
+                    undistorted_camera.FocalLengthY());
+
+  options.blank_pixels = 1;
+  options.max_fov = 90;
+  undistorted_camera = UndistortCamera(options, distorted_camera);
+  BOOST_CHECK_CLOSE(undistorted_camera.FocalLengthX(), 400, 1e-6);
+
+  // Horizontal gradient in the distorted image.
+  Bitmap distorted_image;
+  distorted_image.Allocate(1000, 800, false);
+  for (int y = 0; y < 800; ++y) {
+    for (int x = 0; x < 1000; ++x) {
+      distorted_image.SetPixel(x, y, BitmapColor<uint8_t>(x / 4));
+    }
+  }
+
+  options = UndistortCameraOptions();
+  options.max_image_size = 500;
+  Bitmap undistorted_image;
+  UndistortImage(options, distorted_image, distorted_camera,
+                 &undistorted_image, &undistorted_camera);
+  BOOST_CHECK_EQUAL(undistorted_image.Width(), 500);
+  BOOST_CHECK_EQUAL(undistorted_image.Height(), 400);
+
+  const WarpTable warp_table =
+      ComputeUndistortionWarpTable(distorted_camera, undistorted_camera, 2);
+  Bitmap undistorted_image2;
+  UndistortImage(options, distorted_image, distorted_camera, warp_table,
+                 &undistorted_image2, &undistorted_camera);
+
+  // Cameras with the same calibration share the cached warp table.
+  const UndistortionWarpTableCache warp_tables(options);
+  Camera other_distorted_camera = distorted_camera;
+  other_distorted_camera.SetCameraId(2);
+  BOOST_CHECK_EQUAL(warp_tables.Get(distorted_camera),
+                    warp_tables.Get(other_distorted_camera));
+  other_distorted_camera.Params(0) += 1;
+  BOOST_CHECK_NE(warp_tables.Get(distorted_camera),
+                 warp_tables.Get(other_distorted_camera));
+  Bitmap undistorted_image3;
+  UndistortImage(options, distorted_image, distorted_camera, warp_tables,
+                 &undistorted_image3, &undistorted_camera);
+
+  for (int y = 0; y < undistorted_image.Height(); ++y) {
+    for (int x = 0; x < undistorted_image.Width(); ++x) {
+      BitmapColor<uint8_t> color;
+      BOOST_CHECK(undistorted_image.GetPixel(x, y, &color));
+      BitmapColor<uint8_t> color2;
+      BOOST_CHECK(undistorted_image2.GetPixel(x, y, &color2));
+      BOOST_CHECK_EQUAL(color, color2);
+      BitmapColor<uint8_t> color3;
+      BOOST_CHECK(undistorted_image3.GetPixel(x, y, &color3));
+      BOOST_CHECK_EQUAL(color, color3);
+
+      const Eigen::Vector2d world_point =
+          undistorted_camera.ImageToWorld(Eigen::Vector2d(x + 0.5, y + 0.5));
+      const double theta = std::atan(world_point.norm());
+      if (theta < 0.1 || theta > 1.0) {
+        // Outside of the calibrated radius range.
+        BOOST_CHECK_EQUAL(color.r, 0);
+      } else {
+        const double distorted_x =
+            500 + 500 * theta * world_point.x() / world_point.norm();
+        BOOST_CHECK_LE(std::abs(color.r - (distorted_x - 0.5) / 4), 1.5);
+      }
+    }
+  }
+
+  // The undistorted observations must reproject to the distorted ones.
+  const std::vector<Eigen::Vector2d> points2D = {Eigen::Vector2d(800, 400),
+                                                 Eigen::Vector2d(500, 100)};
+  Reconstruction reconstruction;
+  distorted_camera.SetCameraId(1);
+  reconstruction.AddCamera(distorted_camera);
+  Image image;
+  image.SetImageId(1);
+  image.SetCameraId(1);
+  image.SetPoints2D(points2D);
+  reconstruction.AddImage(image);
+  UndistortReconstruction(options, &reconstruction);
+  BOOST_CHECK_EQUAL(reconstruction.Camera(1).ModelName(), "PINHOLE");
+  for (point2D_t point2D_idx = 0; point2D_idx < points2D.size();
+       ++point2D_idx) {
+    const Eigen::Vector2d world_point = reconstruction.Camera(1).ImageToWorld(
+        reconstruction.Image(1).Point2D(point2D_idx).XY());
+    const double theta = std::atan(world_point.norm());
+    const Eigen::Vector2d distorted_point =
+        Eigen::Vector2d(500, 400) + 500 * theta * world_point.normalized();
+    BOOST_CHECK_LT((distorted_point - points2D[point2D_idx]).norm(), 1e-6);
+  }
+
+  // Observations outside the calibrated radius range are removed from their
+  // tracks instead of being extrapolated beyond the calibration.
+  Reconstruction reconstruction2;
+  reconstruction2.AddCamera(distorted_camera);
+  for (image_t image_id = 1; image_id <= 3; ++image_id) {
+    Image image;
+    image.SetImageId(image_id);
+    image.SetCameraId(1);
+    image.SetPoints2D({Eigen::Vector2d(800, 400), Eigen::Vector2d(520, 400),
+                       Eigen::Vector2d(1000, 800)});
+    reconstruction2.AddImage(image);
+  }
+  for (point2D_t point2D_idx = 0; point2D_idx < 3; ++point2D_idx) {
+    Track track;
+    for (image_t image_id = 1; image_id <= 3; ++image_id) {
+      track.AddElement(image_id, point2D_idx);
+    }
+    reconstruction2.AddPoint3D(Eigen::Vector3d::Zero(), track);
+  }
+  UndistortReconstruction(options, &reconstruction2);
+  BOOST_CHECK_EQUAL(reconstruction2.NumPoints3D(), 1);
+  for (image_t image_id = 1; image_id <= 3; ++image_id) {
+    const Image& image = reconstruction2.Image(image_id);
+    BOOST_CHECK(image.Point2D(0).HasPoint3D());
+    BOOST_CHECK(!image.Point2D(1).HasPoint3D());
+    BOOST_CHECK(!image.Point2D(2).HasPoint3D());
+    for (const auto& point2D : image.Points2D()) {
+      BOOST_CHECK(point2D.XY().allFinite());
+    }
+  }
+}
+
 BOOST_AUTO_TEST_CASE(TestUndistortReconstruction) {
   const size_t kNumImages = 10;
   const size_t kNumPoints2D = 10;
@@ -33,10 +33,177 @@
 
 #include "VLFeat/imopv.h"
 #include "util/logging.h"
+#include "util/threading.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define COLMAP_WARP_AVX2_KERNEL
+#include <immintrin.h>
+#endif
 
 namespace colmap {
 namespace {
 
+// Source image in terms of the byte offsets of its rows relative to the first
+// row, such that the rows can be addressed with 32-bit gather instructions.
+struct WarpSource {
+  const uint8_t* data;
+  std::vector<int32_t> row_offsets;
+  int row_size;
+  int channels;
+};
+
+inline uint8_t InterpolateBilinear(const float p00, const float p01,
+                                   const float p10, const float p11,
+                                   const float wx, const float wy) {
+  const float top = p00 + wx * (p01 - p00);
+  const float bottom = p10 + wx * (p11 - p10);
+  return static_cast<uint8_t>(top + wy * (bottom - top) + 0.5f);
+}
+
+void WarpPixelsScalar(const WarpSource& source, const int32_t* x0s,
+                      const int32_t* y0s, const float* wxs, const float* wys,
+                      const int num_pixels, uint8_t* target) {
+  const int channels = source.channels;
+  for (int i = 0; i < num_pixels; ++i) {
+    uint8_t* target_pixel = target + i * channels;
+    if (x0s[i] < 0) {
+      for (int c = 0; c < channels; ++c) {
+        target_pixel[c] = 0;
+      }
+      continue;
+    }
+
+    const uint8_t* row0 =
+        source.data + source.row_offsets[y0s[i]] + x0s[i] * channels;
+    const uint8_t* row1 =
+        source.data + source.row_offsets[y0s[i] + 1] + x0s[i] * channels;
+    for (int c = 0; c < channels; ++c) {
+      target_pixel[c] =
+          InterpolateBilinear(row0[c], row0[c + channels], row1[c],
+                              row1[c + channels], wxs[i], wys[i]);
+    }
+  }
+}
+
+#ifdef COLMAP_WARP_AVX2_KERNEL
+
+// Interpolates the given byte of the gathered 32-bit words.
+__attribute__((target("avx2"))) inline __m256 InterpolateBilinearAVX2(
+    const __m256i g00, const __m256i g01, const __m256i g10, const __m256i g11,
+    const int shift, const __m256 wx, const __m256 wy) {
+  const __m256i mask = _mm256_set1_epi32(0xFF);
+  const __m256 p00 = _mm256_cvtepi32_ps(
+      _mm256_and_si256(_mm256_srli_epi32(g00, shift), mask));
+  const __m256 p01 = _mm256_cvtepi32_ps(
+      _mm256_and_si256(_mm256_srli_epi32(g01, shift), mask));
+  const __m256 p10 = _mm256_cvtepi32_ps(
+      _mm256_and_si256(_mm256_srli_epi32(g10, shift), mask));
+  const __m256 p11 = _mm256_cvtepi32_ps(
+      _mm256_and_si256(_mm256_srli_epi32(g11, shift), mask));
+  const __m256 top =
+      _mm256_add_ps(p00, _mm256_mul_ps(wx, _mm256_sub_ps(p01, p00)));
+  const __m256 bottom =
+      _mm256_add_ps(p10, _mm256_mul_ps(wx, _mm256_sub_ps(p11, p10)));
+  return _mm256_add_ps(_mm256_add_ps(top, _mm256_mul_ps(
+                                              wy, _mm256_sub_ps(bottom, top))),
+                       _mm256_set1_ps(0.5f));
+}
+
+// Processes 8 target pixels at once by gathering the 4 bytes starting at each
+// of the neighboring source pixels. Blocks that would read beyond the end of a
+// source row are processed by the scalar kernel.
+__attribute__((target("avx2"))) void WarpPixelsAVX2(
+    const WarpSource& source, const int32_t* x0s, const int32_t* y0s,
+    const float* wxs, const float* wys, const int num_pixels,
+    uint8_t* target) {
+  const int channels = source.channels;
+  const int* data = reinterpret_cast<const int*>(source.data);
+  const __m256i channels_vec = _mm256_set1_epi32(channels);
+  const __m256i max_x0 =
+      _mm256_set1_epi32((source.row_size - 4) / channels - 1);
+  const __m256i invalid = _mm256_set1_epi32(-1);
+  const __m256i one = _mm256_set1_epi32(1);
+  const __m256i zero = _mm256_setzero_si256();
+
+  int i = 0;
+  for (; i + 8 <= num_pixels; i += 8) {
+    const __m256i x0 =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(x0s + i));
+    const __m256i valid = _mm256_cmpgt_epi32(x0, invalid);
+    if (_mm256_movemask_epi8(_mm256_and_si256(
+            valid, _mm256_cmpgt_epi32(x0, max_x0))) != 0) {
+      WarpPixelsScalar(source, x0s + i, y0s + i, wxs + i, wys + i, 8,
+                       target + i * channels);
+      continue;
+    }
+
+    const __m256i y0 =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(y0s + i));
+    const __m256i x0_offset = _mm256_mullo_epi32(x0, channels_vec);
+    const __m256i offset0 = _mm256_add_epi32(
+        _mm256_mask_i32gather_epi32(zero, source.row_offsets.data(), y0,
+                                    valid, 4),
+        x0_offset);
+    const __m256i offset1 = _mm256_add_epi32(
+        _mm256_mask_i32gather_epi32(zero, source.row_offsets.data(),
+                                    _mm256_add_epi32(y0, one), valid, 4),
+        x0_offset);
+
+    const __m256i g00 =
+        _mm256_mask_i32gather_epi32(zero, data, offset0, valid, 1);
+    const __m256i g10 =
+        _mm256_mask_i32gather_epi32(zero, data, offset1, valid, 1);
+    __m256i g01;
+    __m256i g11;
+    if (channels == 1) {
+      // The right neighbor is in the second byte of the gathered words.
+      g01 = _mm256_srli_epi32(g00, 8);
+      g11 = _mm256_srli_epi32(g10, 8);
+    } else {
+      g01 = _mm256_mask_i32gather_epi32(
+          zero, data, _mm256_add_epi32(offset0, channels_vec), valid, 1);
+      g11 = _mm256_mask_i32gather_epi32(
+          zero, data, _mm256_add_epi32(offset1, channels_vec), valid, 1);
+    }
+
+    const __m256 wx = _mm256_loadu_ps(wxs + i);
+    const __m256 wy = _mm256_loadu_ps(wys + i);
+
+    if (channels == 1) {
+      const __m256i value = _mm256_and_si256(
+          _mm256_cvttps_epi32(
+              InterpolateBilinearAVX2(g00, g01, g10, g11, 0, wx, wy)),
+          valid);
+      __m256i packed = _mm256_packus_epi32(value, value);
+      packed = _mm256_packus_epi16(packed, packed);
+      packed = _mm256_permutevar8x32_epi32(
+          packed, _mm256_setr_epi32(0, 4, 0, 0, 0, 0, 0, 0));
+      _mm_storel_epi64(reinterpret_cast<__m128i*>(target + i),
+                       _mm256_castsi256_si128(packed));
+    } else {
+      alignas(32) int32_t values[3][8];
+      for (int c = 0; c < 3; ++c) {
+        _mm256_store_si256(
+            reinterpret_cast<__m256i*>(values[c]),
+            _mm256_and_si256(_mm256_cvttps_epi32(InterpolateBilinearAVX2(
+                                 g00, g01, g10, g11, 8 * c, wx, wy)),
+                             valid));
+      }
+      uint8_t* target_pixels = target + i * 3;
+      for (int k = 0; k < 8; ++k) {
+        target_pixels[3 * k] = static_cast<uint8_t>(values[0][k]);
+        target_pixels[3 * k + 1] = static_cast<uint8_t>(values[1][k]);
+        target_pixels[3 * k + 2] = static_cast<uint8_t>(values[2][k]);
+      }
+    }
+  }
+
+  WarpPixelsScalar(source, x0s + i, y0s + i, wxs + i, wys + i, num_pixels - i,
+                   target + i * channels);
+}
+
+#endif  // COLMAP_WARP_AVX2_KERNEL
+
 float GetPixelConstantBorder(const float* data, const int rows, const int cols,
                              const int row, const int col) {
   if (row >= 0 && col >= 0 && row < rows && col < cols) {
@@ -171,6 +338,123 @@ void WarpImageWithHomographyBetweenCameras(const Eigen::Matrix3d& H,
   }
 }
 
+WarpTable::WarpTable()
+    : source_width_(0),
+      source_height_(0),
+      target_width_(0),
+      target_height_(0) {}
+
+WarpTable::WarpTable(const int source_width, const int source_height,
+                     const int target_width, const int target_height,
+                     const MapFunc& map_func, const int num_threads)
+    : source_width_(source_width),
+      source_height_(source_height),
+      target_width_(target_width),
+      target_height_(target_height) {
+  CHECK_GT(source_width_, 0);
+  CHECK_GT(source_height_, 0);
+  CHECK_GT(target_width_, 0);
+  CHECK_GT(target_height_, 0);
+
+  const size_t num_pixels = static_cast<size_t>(target_width_) * target_height_;
+  x0_.resize(num_pixels);
+  y0_.resize(num_pixels);
+  wx_.resize(num_pixels);
+  wy_.resize(num_pixels);
+
+  auto BuildRow = [&](const int y) {
+    Eigen::Vector2d source_point;
+    for (int x = 0; x < target_width_; ++x) {
+      const size_t idx = static_cast<size_t>(y) * target_width_ + x;
+      x0_[idx] = -1;
+      y0_[idx] = 0;
+      wx_[idx] = 0;
+      wy_[idx] = 0;
+
+      if (!map_func(Eigen::Vector2d(x + 0.5, y + 0.5), &source_point)) {
+        continue;
+      }
+
+      // Shift the point such that the pixel centers have integer coordinates.
+      const double source_x = source_point.x() - 0.5;
+      const double source_y = source_point.y() - 0.5;
+      if (!(source_x >= 0 && source_y >= 0 && source_x < source_width_ - 1 &&
+            source_y < source_height_ - 1)) {
+        continue;
+      }
+
+      x0_[idx] = static_cast<int32_t>(source_x);
+      y0_[idx] = static_cast<int32_t>(source_y);
+      wx_[idx] = static_cast<float>(source_x - x0_[idx]);
+      wy_[idx] = static_cast<float>(source_y - y0_[idx]);
+    }
+  };
+
+  ThreadPool thread_pool(GetEffectiveNumThreads(num_threads));
+  for (int y = 0; y < target_height_; ++y) {
+    thread_pool.AddTask(BuildRow, y);
+  }
+  thread_pool.Wait();
+}
+
+int WarpTable::SourceWidth() const { return source_width_; }
+
+int WarpTable::SourceHeight() const { return source_height_; }
+
+int WarpTable::TargetWidth() const { return target_width_; }
+
+int WarpTable::TargetHeight() const { return target_height_; }
+
+size_t WarpTable::NumValidPixels() const {
+  return x0_.size() - std::count(x0_.begin(), x0_.end(), -1);
+}
+
+void WarpTable::Warp(const Bitmap& source_image, Bitmap* target_image,
+                     const int num_threads) const {
+  CHECK_EQ(source_image.Width(), source_width_);
+  CHECK_EQ(source_image.Height(), source_height_);
+  CHECK_NOTNULL(target_image);
+
+  target_image->Allocate(target_width_, target_height_, source_image.IsRGB());
+  source_image.CloneMetadata(target_image);
+
+  WarpSource source;
+  source.data = source_image.GetScanline(0);
+  source.row_offsets.resize(source_height_);
+  for (int y = 0; y < source_height_; ++y) {
+    source.row_offsets[y] =
+        static_cast<int32_t>(source_image.GetScanline(y) - source.data);
+  }
+  source.channels = source_image.Channels();
+  source.row_size = source_width_ * source.channels;
+
+  auto WarpPixels = &WarpPixelsScalar;
+#ifdef COLMAP_WARP_AVX2_KERNEL
+  if (__builtin_cpu_supports("avx2")) {
+    WarpPixels = &WarpPixelsAVX2;
+  }
+#endif
+
+  auto WarpRow = [&](const int y) {
+    const size_t idx = static_cast<size_t>(y) * target_width_;
+    WarpPixels(source, x0_.data() + idx, y0_.data() + idx, wx_.data() + idx,
+               wy_.data() + idx, target_width_, target_image->GetScanline(y));
+  };
+
+  const int num_eff_threads = GetEffectiveNumThreads(num_threads);
+  if (num_eff_threads == 1) {
+    for (int y = 0; y < target_height_; ++y) {
+      WarpRow(y);
+    }
+  } else {
+    ThreadPool thread_pool(num_eff_threads);
+    for (int y = 0; y < target_height_; ++y) {
+      thread_pool.AddTask(WarpRow, y);
+    }
+    thread_pool.Wait();
+  }
+}
+
 void ResampleImageBilinear(const float* data, const int rows, const int cols,
                            const int new_rows, const int new_cols,
                            float* resampled) {
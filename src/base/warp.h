@@ -32,6 +32,8 @@
 #ifndef COLMAP_SRC_BASE_WARP_H_
 #define COLMAP_SRC_BASE_WARP_H_
 
+#include <functional>
+
 #include "base/camera.h"
 #include "util/alignment.h"
 #include "util/bitmap.h"
@@ -61,6 +63,55 @@ void WarpImageWithHomographyBetweenCameras(const Eigen::Matrix3d& H,
                                            const Bitmap& source_image,
                                            Bitmap* target_image);
 
+// Precomputed inverse mapping from the pixels of a target image to the pixels
+// of a source image. Repeatedly warping images with the same geometry, e.g.,
+// all images of a camera, then no longer depends on the cost of evaluating the
+// mapping. The source image is bilinearly interpolated and target pixels
+// without a corresponding source pixel are set to black.
+class WarpTable {
+ public:
+  // Maps a target pixel to a source pixel, where the pixel centers have the
+  // coordinates (0.5, 0.5). Returns false if the target pixel has no
+  // corresponding source pixel. Must be thread-safe.
+  typedef std::function<bool(const Eigen::Vector2d& target_point,
+                             Eigen::Vector2d* source_point)>
+      MapFunc;
+
+  WarpTable();
+  WarpTable(const int source_width, const int source_height,
+            const int target_width, const int target_height,
+            const MapFunc& map_func, const int num_threads = 1);
+
+  int SourceWidth() const;
+  int SourceHeight() const;
+  int TargetWidth() const;
+  int TargetHeight() const;
+
+  // Number of target pixels with a corresponding source pixel.
+  size_t NumValidPixels() const;
+
+  // Warp the source image and allocate the target image with the same number
+  // of channels. The rows of the target image are distributed over the given
+  // number of threads and interpolated with AVX2 instructions, if supported by
+  // the CPU.
+  void Warp(const Bitmap& source_image, Bitmap* target_image,
+            const int num_threads = 1) const;
+
+ private:
+  int source_width_;
+  int source_height_;
+  int target_width_;
+  int target_height_;
+
+  // Upper left source pixel and interpolation weights for each target pixel
+  // in row-major order, where the x-coordinate is -1 for invalid pixels. The
+  // values are stored in separate arrays for vectorized loads.
+  std::vector<int32_t> x0_;
+  std::vector<int32_t> y0_;
+  std::vector<float> wx_;
+  std::vector<float> wy_;
+};
+
 // Resample row-major image using bilinear interpolation.
 void ResampleImageBilinear(const float* data, const int rows, const int cols,
                            const int new_rows, const int new_cols,
@@ -219,6 +219,77 @@ BOOST_AUTO_TEST_CASE(TestWarpImageWithHomographyBetweenCamerasTransposed) {
   CheckBitmapsTransposed(source_image_rgb, target_image_rgb);
 }
 
+BOOST_AUTO_TEST_CASE(TestWarpTableIdentity) {
+  // Odd width to test the scalar processing of the remaining pixels.
+  const WarpTable warp_table(
+      37, 20, 37, 20,
+      [](const Eigen::Vector2d& target_point, Eigen::Vector2d* source_point) {
+        *source_point = target_point;
+        return true;
+      });
+  BOOST_CHECK_EQUAL(warp_table.SourceWidth(), 37);
+  BOOST_CHECK_EQUAL(warp_table.SourceHeight(), 20);
+  BOOST_CHECK_EQUAL(warp_table.TargetWidth(), 37);
+  BOOST_CHECK_EQUAL(warp_table.TargetHeight(), 20);
+  // The last row and column have no right or bottom neighbor.
+  BOOST_CHECK_EQUAL(warp_table.NumValidPixels(), 36 * 19);
+
+  for (const bool as_rgb : {false, true}) {
+    Bitmap source_image;
+    GenerateRandomBitmap(37, 20, as_rgb, &source_image);
+    for (const int num_threads : {1, 4}) {
+      Bitmap target_image;
+      warp_table.Warp(source_image, &target_image, num_threads);
+      BOOST_CHECK_EQUAL(target_image.IsRGB(), as_rgb);
+      CheckBitmapsEqual(source_image, target_image);
+    }
+  }
+}
+
+BOOST_AUTO_TEST_CASE(TestWarpTableBilinear) {
+  const WarpTable warp_table(
+      50, 40, 45, 35,
+      [](const Eigen::Vector2d& target_point, Eigen::Vector2d* source_point) {
+        if (target_point.x() < 10) {
+          return false;
+        }
+        *source_point = 1.1 * target_point + Eigen::Vector2d(0.3, 0.7);
+        return true;
+      });
+
+  for (const bool as_rgb : {false, true}) {
+    Bitmap source_image;
+    GenerateRandomBitmap(50, 40, as_rgb, &source_image);
+    Bitmap target_image;
+    warp_table.Warp(source_image, &target_image);
+    BOOST_CHECK_EQUAL(target_image.Width(), 45);
+    BOOST_CHECK_EQUAL(target_image.Height(), 35);
+
+    size_t num_valid_pixels = 0;
+    for (int y = 0; y < target_image.Height(); ++y) {
+      for (int x = 0; x < target_image.Width(); ++x) {
+        BitmapColor<uint8_t> color;
+        BOOST_CHECK(target_image.GetPixel(x, y, &color));
+        BitmapColor<float> expected_color;
+        if (x + 0.5 < 10 ||
+            !source_image.InterpolateBilinear(1.1 * (x + 0.5) + 0.3 - 0.5,
+                                              1.1 * (y + 0.5) + 0.7 - 0.5,
+                                              &expected_color)) {
+          BOOST_CHECK_EQUAL(color, BitmapColor<uint8_t>(0));
+          continue;
+        }
+        num_valid_pixels += 1;
+        BOOST_CHECK_LE(std::abs(color.r - expected_color.r), 1);
+        if (as_rgb) {
+          BOOST_CHECK_LE(std::abs(color.g - expected_color.g), 1);
+          BOOST_CHECK_LE(std::abs(color.b - expected_color.b), 1);
+        }
+      }
+    }
+    BOOST_CHECK_EQUAL(num_valid_pixels, warp_table.NumValidPixels());
+  }
+}
+
 BOOST_AUTO_TEST_CASE(TestResampleImageBilinear) {
   std::vector<float> image(16);
   for (size_t i = 0; i < image.size(); ++i) {
@@ -83,6 +83,8 @@ AutomaticReconstructionController::AutomaticReconstructionController(
   option_manager_.sift_extraction->num_threads = options_.num_threads;
   option_manager_.sift_matching->num_threads = options_.num_threads;
   option_manager_.mapper->num_threads = options_.num_threads;
+  option_manager_.patch_match_stereo->num_threads = options_.num_threads;
+  option_manager_.stereo_fusion->num_threads = options_.num_threads;
   option_manager_.poisson_meshing->num_threads = options_.num_threads;
 
   ImageReaderOptions reader_options = *option_manager_.image_reader;
@@ -274,7 +276,6 @@ void AutomaticReconstructionController::RunDenseMapper() {
 
     // Patch match stereo.
 
-#ifdef CUDA_ENABLED
     {
       mvs::PatchMatchController patch_match_controller(
           *option_manager_.patch_match_stereo, dense_path, "COLMAP", "");
@@ -283,13 +284,6 @@ void AutomaticReconstructionController::RunDenseMapper() {
       patch_match_controller.Wait();
       active_thread_ = nullptr;
     }
-#else   // CUDA_ENABLED
-    std::cout
-        << std::endl
-        << "WARNING: Skipping patch match stereo because CUDA is not available."
-        << std::endl;
-    return;
-#endif  // CUDA_ENABLED
 
     if (IsStopped()) {
       return;
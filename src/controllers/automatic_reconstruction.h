@@ -74,12 +74,8 @@ class AutomaticReconstructionController : public Thread {
     // Whether to perform sparse mapping.
     bool sparse = true;
 
-// Whether to perform dense mapping.
-#ifdef CUDA_ENABLED
+    // Whether to perform dense mapping.
     bool dense = true;
-#else
-    bool dense = false;
-#endif
 
     // The meshing algorithm to be used.
     Mesher mesher = Mesher::POISSON;
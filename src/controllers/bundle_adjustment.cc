@@ -82,7 +82,8 @@ namespace colmap {
     }
 
     // Avoid degeneracies in bundle adjustment.
-    reconstruction_->FilterObservationsWithNegativeDepth();
+    reconstruction_->FilterObservationsWithNegativeDepth(
+      options_.bundle_adjustment->solver_options.num_threads);
 
     BundleAdjustmentOptions ba_options = *options_.bundle_adjustment;
     ba_options.solver_options.minimizer_progress_to_stdout = false;
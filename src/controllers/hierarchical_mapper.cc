@@ -32,65 +32,212 @@
 #include "controllers/hierarchical_mapper.h"
 
 #include "base/scene_clustering.h"
+#include "base/similarity_transform.h"
+#include "optim/bundle_adjustment.h"
 #include "util/misc.h"
 
 namespace colmap {
 namespace {
 
-void MergeClusters(
-    const SceneClustering::Cluster& cluster,
-    std::unordered_map<const SceneClustering::Cluster*, ReconstructionManager>*
-        reconstruction_managers) {
-  // Extract all reconstructions from all child clusters.
-  std::vector<Reconstruction*> reconstructions;
-  for (const auto& child_cluster : cluster.child_clusters) {
-    if (!child_cluster.child_clusters.empty()) {
-      MergeClusters(child_cluster, reconstruction_managers);
-    }
-
-    auto& reconstruction_manager = reconstruction_managers->at(&child_cluster);
-    for (size_t i = 0; i < reconstruction_manager.Size(); ++i) {
-      reconstructions.push_back(&reconstruction_manager.Get(i));
+// Merge the reconstructions of a cluster as long as any two of them can be
+// aligned. The alignments between all pairs of reconstructions are estimated
+// in parallel and are cached until one of the two reconstructions changes.
+void MergeReconstructions(const int num_threads,
+                          std::vector<Reconstruction>* reconstructions) {
+  const double kMaxReprojError = 8.0;
+  const double kMinInlierObservations = 0.3;
+
+  const size_t num_reconstructions = reconstructions->size();
+
+  // The alignment of reconstruction j into reconstruction i for j < i is
+  // stored at index i * num_reconstructions + j.
+  enum AlignmentState { kUnknown, kSuccess, kFailure };
+  std::vector<AlignmentState> alignment_states(
+      num_reconstructions * num_reconstructions, kUnknown);
+  std::vector<Eigen::Matrix3x4d, Eigen::aligned_allocator<Eigen::Matrix3x4d>>
+      alignments(num_reconstructions * num_reconstructions);
+  std::vector<bool> merged(num_reconstructions, false);
+
+  ThreadPool thread_pool(num_threads);
+
+  while (true) {
+    for (size_t i = 0; i < num_reconstructions; ++i) {
+      for (size_t j = 0; j < i; ++j) {
+        const size_t idx = i * num_reconstructions + j;
+        if (merged[i] || merged[j] || alignment_states[idx] != kUnknown) {
+          continue;
+        }
+        thread_pool.AddTask([&, i, j, idx]() {
+          alignment_states[idx] =
+              ComputeAlignmentBetweenReconstructions(
+                  (*reconstructions)[j], (*reconstructions)[i],
+                  kMinInlierObservations, kMaxReprojError, &alignments[idx])
+                  ? kSuccess
+                  : kFailure;
+        });
+      }
     }
-  }
+    thread_pool.Wait();
 
-  // Try to merge all child cluster reconstruction.
-  while (reconstructions.size() > 1) {
+    // Merge the first alignable pair in the same order as a sequential search.
+    size_t merge_i = 0;
+    size_t merge_j = 0;
     bool merge_success = false;
-    for (size_t i = 0; i < reconstructions.size(); ++i) {
+    for (size_t i = 0; i < num_reconstructions && !merge_success; ++i) {
       for (size_t j = 0; j < i; ++j) {
-        const double kMaxReprojError = 8.0;
-        if (reconstructions[i]->Merge(*reconstructions[j], kMaxReprojError)) {
-          reconstructions.erase(reconstructions.begin() + j);
+        if (!merged[i] && !merged[j] &&
+            alignment_states[i * num_reconstructions + j] == kSuccess) {
+          merge_i = i;
+          merge_j = j;
           merge_success = true;
           break;
         }
       }
-
-      if (merge_success) {
-        break;
-      }
     }
 
     if (!merge_success) {
       break;
     }
+
+    (*reconstructions)[merge_i].Merge(
+        (*reconstructions)[merge_j],
+        alignments[merge_i * num_reconstructions + merge_j], kMaxReprojError);
+    (*reconstructions)[merge_j] = Reconstruction();
+    merged[merge_j] = true;
+
+    // Only the alignments involving the changed reconstruction are outdated.
+    for (size_t k = 0; k < num_reconstructions; ++k) {
+      alignment_states[merge_i * num_reconstructions + k] = kUnknown;
+      alignment_states[k * num_reconstructions + merge_i] = kUnknown;
+    }
   }
 
-  // Insert a new reconstruction manager for merged cluster.
-  auto& reconstruction_manager = (*reconstruction_managers)[&cluster];
-  for (const auto& reconstruction : reconstructions) {
-    reconstruction_manager.Add();
-    reconstruction_manager.Get(reconstruction_manager.Size() - 1) =
-        *reconstruction;
+  size_t num_remaining = 0;
+  for (size_t i = 0; i < num_reconstructions; ++i) {
+    if (!merged[i]) {
+      (*reconstructions)[num_remaining] = std::move((*reconstructions)[i]);
+      num_remaining += 1;
+    }
   }
+  reconstructions->resize(num_remaining);
+}
 
-  // Delete all merged child cluster reconstruction managers.
+void MergeCluster(
+    const SceneClustering::Cluster& cluster, const int num_threads,
+    std::unordered_map<const SceneClustering::Cluster*, ReconstructionManager>*
+        reconstruction_managers) {
+  // Move all reconstructions out of the child clusters.
+  std::vector<Reconstruction> reconstructions;
   for (const auto& child_cluster : cluster.child_clusters) {
-    reconstruction_managers->erase(&child_cluster);
+    auto& reconstruction_manager = reconstruction_managers->at(&child_cluster);
+    for (size_t i = 0; i < reconstruction_manager.Size(); ++i) {
+      reconstructions.push_back(std::move(reconstruction_manager.Get(i)));
+    }
+    reconstruction_manager.Clear();
+  }
+
+  MergeReconstructions(num_threads, &reconstructions);
+
+  // Move the merged reconstructions into the manager of the cluster.
+  auto& reconstruction_manager = reconstruction_managers->at(&cluster);
+  for (auto& reconstruction : reconstructions) {
+    reconstruction_manager.Get(reconstruction_manager.Add()) =
+        std::move(reconstruction);
+  }
+}
+
+// Merge the clusters bottom-up, where all clusters on the same level of the
+// cluster tree are independent and therefore merged concurrently.
+void MergeClusters(
+    const SceneClustering::Cluster& root_cluster, const int num_threads,
+    std::unordered_map<const SceneClustering::Cluster*, ReconstructionManager>*
+        reconstruction_managers) {
+  std::vector<std::vector<const SceneClustering::Cluster*>> levels;
+  levels.push_back({&root_cluster});
+  while (true) {
+    std::vector<const SceneClustering::Cluster*> next_level;
+    for (const auto cluster : levels.back()) {
+      for (const auto& child_cluster : cluster->child_clusters) {
+        if (!child_cluster.child_clusters.empty()) {
+          next_level.push_back(&child_cluster);
+        }
+      }
+    }
+    if (next_level.empty()) {
+      break;
+    }
+    levels.push_back(std::move(next_level));
+  }
+
+  for (auto level = levels.rbegin(); level != levels.rend(); ++level) {
+    // Insert the managers before merging, such that the map is not modified
+    // concurrently by the merging threads.
+    for (const auto cluster : *level) {
+      reconstruction_managers->emplace(cluster, ReconstructionManager());
+    }
+
+    const int num_workers =
+        std::min(num_threads, static_cast<int>(level->size()));
+    const int num_threads_per_worker = std::max(1, num_threads / num_workers);
+
+    ThreadPool thread_pool(num_workers);
+    for (const auto cluster : *level) {
+      thread_pool.AddTask(MergeCluster, std::cref(*cluster),
+                          num_threads_per_worker, reconstruction_managers);
+    }
+    thread_pool.Wait();
+
+    // Delete all merged child cluster reconstruction managers.
+    for (const auto cluster : *level) {
+      for (const auto& child_cluster : cluster->child_clusters) {
+        reconstruction_managers->erase(&child_cluster);
+      }
+    }
   }
 }
 
+// Adjust the reconstruction to the calibrations of its cameras that were
+// replaced by the calibrations of other clusters. The replaced calibrations
+// are shared by all reconstructions and are thus kept constant, while the
+// poses and points are refined by a global bundle adjustment. Afterwards, the
+// points that are inconsistent with the new calibrations are filtered.
+// Returns the number of filtered observations.
+size_t AdjustReconciledReconstruction(
+    const IncrementalMapperOptions& options,
+    const std::unordered_set<camera_t>& reconciled_camera_ids,
+    Reconstruction* reconstruction) {
+  const std::vector<image_t>& reg_image_ids = reconstruction->RegImageIds();
+  if (reg_image_ids.size() < 2) {
+    return 0;
+  }
+
+  const IncrementalMapper::Options mapper_options = options.Mapper();
+
+  // Avoid degeneracies in bundle adjustment.
+  reconstruction->FilterObservationsWithNegativeDepth(
+      mapper_options.num_threads);
+
+  BundleAdjustmentConfig ba_config;
+  for (const image_t image_id : reg_image_ids) {
+    ba_config.AddImage(image_id);
+  }
+  for (const camera_t camera_id : reconciled_camera_ids) {
+    ba_config.SetConstantCamera(camera_id);
+  }
+  ba_config.SetConstantPose(reg_image_ids[0]);
+  ba_config.SetConstantTvec(reg_image_ids[1], {0});
+
+  BundleAdjuster bundle_adjuster(options.GlobalBundleAdjustment(), ba_config);
+  bundle_adjuster.Solve(reconstruction);
+
+  // Normalize scene for numerical stability.
+  reconstruction->Normalize();
+
+  return reconstruction->FilterAllPoints3D(
+      mapper_options.filter_max_reproj_error,
+      mapper_options.filter_min_tri_angle, mapper_options.num_threads);
+}
+
 }  // namespace
 
 bool HierarchicalMapperController::Options::Check() const {
@@ -124,6 +271,10 @@ void HierarchicalMapperController::Run() {
 
   std::unordered_map<image_t, std::string> image_id_to_name;
 
+  // The database is loaded only once and shared by all cluster workers, which
+  // extract their own subset of images and correspondences from it.
+  auto database_cache = std::make_shared<DatabaseCache>();
+
   {
     Database database(options_.database_path);
 
@@ -140,6 +291,16 @@ void HierarchicalMapperController::Run() {
 
     std::cout << "Partitioning scene graph..." << std::endl;
     scene_clustering.Partition(image_pairs, num_inliers);
+
+    std::cout << std::endl;
+    PrintHeading1("Loading database");
+    Timer timer;
+    timer.Start();
+    database_cache->Load(database,
+                         static_cast<size_t>(mapper_options_.min_num_matches),
+                         mapper_options_.ignore_watermarks, {});
+    std::cout << std::endl;
+    timer.PrintMinutes();
   }
 
   auto leaf_clusters = scene_clustering.GetLeafClusters();
@@ -173,10 +334,20 @@ void HierarchicalMapperController::Run() {
   const int num_threads_per_worker =
       std::max(1, num_eff_threads / num_eff_workers);
 
-  // Function to reconstruct one cluster using incremental mapping.
+  // Calibrations of IMPLICIT_DISTORTION cameras are shared between clusters,
+  // such that a camera is only calibrated from scratch by one cluster.
+  CameraCalibrationRegistry calibration_registry;
+
+  // Function to reconstruct one cluster using incremental mapping. The
+  // reference to the cache is moved out of the given slot, such that the
+  // mapper holds the only reference of the worker and releases it as soon as
+  // it extracted the subset of the cluster.
   auto ReconstructCluster = [&, this](
                                 const SceneClustering::Cluster& cluster,
+                                std::shared_ptr<const DatabaseCache>* cache,
                                 ReconstructionManager* reconstruction_manager) {
+    std::shared_ptr<const DatabaseCache> cluster_cache = std::move(*cache);
+
     if (cluster.image_ids.empty()) {
       return;
     }
@@ -191,8 +362,9 @@ void HierarchicalMapperController::Run() {
     }
 
     IncrementalMapperController mapper(&custom_options, options_.image_path,
-                                       options_.database_path,
+                                       std::move(cluster_cache),
                                        reconstruction_manager);
+    mapper.SetCalibrationRegistry(&calibration_registry);
     mapper.Start();
     mapper.Wait();
   };
@@ -210,10 +382,19 @@ void HierarchicalMapperController::Run() {
       reconstruction_managers;
   reconstruction_managers.reserve(leaf_clusters.size());
 
+  // Every cluster holds one reference to the cache in its slot, which its
+  // worker releases after the extraction of the cluster. The tasks only hold
+  // pointers to the slots, such that the cache is freed as soon as the last
+  // cluster has extracted its subset.
+  std::vector<std::shared_ptr<const DatabaseCache>> database_cache_slots(
+      leaf_clusters.size(), database_cache);
+  database_cache.reset();
+
   ThreadPool thread_pool(num_eff_workers);
-  for (const auto& cluster : leaf_clusters) {
-    thread_pool.AddTask(ReconstructCluster, *cluster,
-                        &reconstruction_managers[cluster]);
+  for (size_t i = 0; i < leaf_clusters.size(); ++i) {
+    thread_pool.AddTask(ReconstructCluster, *leaf_clusters[i],
+                        &database_cache_slots[i],
+                        &reconstruction_managers[leaf_clusters[i]]);
   }
   thread_pool.Wait();
 
@@ -223,11 +404,37 @@ void HierarchicalMapperController::Run() {
 
   PrintHeading1("Merging clusters");
 
-  MergeClusters(*scene_clustering.GetRootCluster(), &reconstruction_managers);
+  MergeClusters(*scene_clustering.GetRootCluster(), num_eff_threads,
+                &reconstruction_managers);
 
   CHECK_EQ(reconstruction_managers.size(), 1);
   *reconstruction_manager_ = std::move(reconstruction_managers.begin()->second);
 
+  // Reconcile the calibrations of the merged reconstructions. The final
+  // calibrations of all clusters are registered, before the merged
+  // reconstructions use the best calibration of each camera. The
+  // reconstructions are then adjusted to their replaced calibrations.
+  for (size_t i = 0; i < reconstruction_manager_->Size(); ++i) {
+    calibration_registry.Update(reconstruction_manager_->Get(i));
+  }
+  for (size_t i = 0; i < reconstruction_manager_->Size(); ++i) {
+    Reconstruction& reconstruction = reconstruction_manager_->Get(i);
+    std::unordered_set<camera_t> reconciled_camera_ids;
+    const size_t num_reconciled =
+        calibration_registry.Reconcile(&reconstruction, &reconciled_camera_ids);
+    if (num_reconciled == 0) {
+      continue;
+    }
+
+    const size_t num_filtered_observations = AdjustReconciledReconstruction(
+        mapper_options_, reconciled_camera_ids, &reconstruction);
+    std::cout << StringPrintf(
+                     "Reconciled %d camera calibrations in model %d and "
+                     "filtered %d observations",
+                     num_reconciled, i, num_filtered_observations)
+              << std::endl;
+  }
+
   std::cout << std::endl;
   GetTimer().PrintMinutes();
 }
@@ -120,7 +120,8 @@ namespace colmap {
 
       for (int i = 0; i < options.ba_global_max_refinements; ++i) {
         const size_t num_observations =
-          mapper->GetReconstruction().ComputeNumObservations();
+          mapper->GetReconstruction().ComputeNumObservations(
+            options.num_threads);
         size_t num_changed_observations = 0;
         AdjustGlobalBundle(options, mapper);
         num_changed_observations += CompleteAndMergeTracks(options, mapper);
@@ -223,6 +224,7 @@ namespace colmap {
     options.max_extra_param = max_extra_param;
     // related to min_num_reg_images
     options.min_num_reg_images = MIN_NUM_IMAGES_FOR_UPGRADE;
+    options.num_threads = num_threads;
     return options;
   }
 
@@ -326,13 +328,35 @@ namespace colmap {
     : options_(options),
     image_path_(image_path),
     database_path_(database_path),
-    reconstruction_manager_(reconstruction_manager) {
+    reconstruction_manager_(reconstruction_manager),
+    calibration_registry_(nullptr) {
     CHECK(options_->Check());
     RegisterCallback(INITIAL_IMAGE_PAIR_REG_CALLBACK);
     RegisterCallback(NEXT_IMAGE_REG_CALLBACK);
     RegisterCallback(LAST_IMAGE_REG_CALLBACK);
   }
 
+  IncrementalMapperController::IncrementalMapperController(
+    const IncrementalMapperOptions* options, const std::string& image_path,
+    std::shared_ptr<const DatabaseCache> shared_database_cache,
+    ReconstructionManager* reconstruction_manager)
+    : options_(options),
+    image_path_(image_path),
+    reconstruction_manager_(reconstruction_manager),
+    shared_database_cache_(std::move(shared_database_cache)),
+    calibration_registry_(nullptr) {
+    CHECK(options_->Check());
+    CHECK_NOTNULL(shared_database_cache_.get());
+    RegisterCallback(INITIAL_IMAGE_PAIR_REG_CALLBACK);
+    RegisterCallback(NEXT_IMAGE_REG_CALLBACK);
+    RegisterCallback(LAST_IMAGE_REG_CALLBACK);
+  }
+
+  void IncrementalMapperController::SetCalibrationRegistry(
+    CameraCalibrationRegistry* calibration_registry) {
+    calibration_registry_ = calibration_registry;
+  }
+
   void IncrementalMapperController::Run() {
     if (!LoadDatabase()) {
       return;
@@ -378,12 +402,20 @@ namespace colmap {
       }
     }
 
-    Database database(database_path_);
     Timer timer;
     timer.Start();
-    const size_t min_num_matches = static_cast<size_t>(options_->min_num_matches);
-    database_cache_.Load(database, min_num_matches, options_->ignore_watermarks,
-      image_names);
+    if (shared_database_cache_) {
+      database_cache_.Load(*shared_database_cache_, image_names);
+      // Release the shared cache as soon as it is no longer needed.
+      shared_database_cache_.reset();
+    }
+    else {
+      Database database(database_path_);
+      const size_t min_num_matches =
+        static_cast<size_t>(options_->min_num_matches);
+      database_cache_.Load(database, min_num_matches,
+        options_->ignore_watermarks, image_names);
+    }
     std::cout << std::endl;
     timer.PrintMinutes();
 
@@ -399,6 +431,24 @@ namespace colmap {
     return true;
   }
 
+  void IncrementalMapperController::CalibrateCamera(
+    Reconstruction* reconstruction, IncrementalMapper* mapper) {
+    if (calibration_registry_ != nullptr) {
+      const size_t num_warm_started =
+        mapper->WarmStartCameras(*calibration_registry_);
+      if (num_warm_started > 0) {
+        std::cout << "Initialized " << num_warm_started
+          << " cameras from shared calibrations" << std::endl;
+      }
+    }
+
+    mapper->CalibrateCamera(options_->Mapper(), options_->Triangulation());
+
+    if (calibration_registry_ != nullptr) {
+      calibration_registry_->Update(*reconstruction);
+    }
+  }
+
   void IncrementalMapperController::Reconstruct(
     const IncrementalMapper::Options& init_mapper_options) {
     const bool kDiscardReconstruction = true;
@@ -504,7 +554,7 @@ namespace colmap {
 
       // If input already has camera intrinsics, perform calibration
       mapper.FilterImages(options_->Mapper());
-      mapper.CalibrateCamera(options_->Mapper(), options_->Triangulation());
+      CalibrateCamera(&reconstruction, &mapper);
 
 
       while (reg_next_success) {
@@ -515,8 +565,11 @@ namespace colmap {
 
         reg_next_success = false;
 
-        const std::vector<image_t> next_images =
-          mapper.FindNextImages(options_->Mapper());
+        // Usually one of the best candidates can be registered, so only a few
+        // candidates are fetched and more are fetched once all of them failed.
+        const size_t kNumInitialNextImages = 8;
+        std::vector<image_t> next_images =
+          mapper.FindNextImages(options_->Mapper(), kNumInitialNextImages);
 
         if (next_images.empty()) {
           break;
@@ -559,7 +612,7 @@ namespace colmap {
               options_->ba_global_points_freq + ba_prev_num_points) {
 
               // Only Calibrate camera before global bundle adjustment
-              mapper.CalibrateCamera(options_->Mapper(), options_->Triangulation());
+              CalibrateCamera(&reconstruction, &mapper);
               IterativeGlobalRefinement(*options_, &mapper);
               ba_prev_num_points = reconstruction.NumPoints3D();
               ba_prev_num_reg_images = reconstruction.NumRegImages();
@@ -594,6 +647,20 @@ namespace colmap {
               static_cast<size_t>(options_->min_model_size)) {
               break;
             }
+
+            // Fetch the next candidates, which were not tried yet. The tried
+            // candidates might still be among the best candidates, so twice
+            // as many candidates are fetched as were tried.
+            if (reg_trial + 1 == next_images.size()) {
+              const std::unordered_set<image_t> tried_image_ids(
+                next_images.begin(), next_images.end());
+              for (const image_t image_id : mapper.FindNextImages(
+                options_->Mapper(), 2 * next_images.size())) {
+                if (tried_image_ids.count(image_id) == 0) {
+                  next_images.push_back(image_id);
+                }
+              }
+            }
           }
         }
 
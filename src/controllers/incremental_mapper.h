@@ -32,7 +32,10 @@
 #ifndef COLMAP_SRC_CONTROLLERS_INCREMENTAL_MAPPER_H_
 #define COLMAP_SRC_CONTROLLERS_INCREMENTAL_MAPPER_H_
 
+#include <memory>
+
 #include "base/reconstruction_manager.h"
+#include "sfm/camera_calibration_registry.h"
 #include "sfm/incremental_mapper.h"
 #include "util/threading.h"
 #include "estimators/implicit_bundle_adjustment.h"
@@ -167,16 +170,35 @@ namespace colmap {
       const std::string& database_path,
       ReconstructionManager* reconstruction_manager);
 
+    // Load the data from a shared database cache instead of the database, e.g.,
+    // when reconstructing multiple clusters of the same scene concurrently.
+    // The cache must have been loaded for all images with the same minimum
+    // number of matches and watermark options as given in the options.
+    IncrementalMapperController(
+      const IncrementalMapperOptions* options, const std::string& image_path,
+      std::shared_ptr<const DatabaseCache> shared_database_cache,
+      ReconstructionManager* reconstruction_manager);
+
+    // Share the camera calibrations with other concurrent reconstructions of
+    // the same scene. Uncalibrated cameras are initialized from the registry
+    // and the estimated calibrations are published to it.
+    void SetCalibrationRegistry(
+      CameraCalibrationRegistry* calibration_registry);
+
   private:
     void Run();
     bool LoadDatabase();
     void Reconstruct(const IncrementalMapper::Options& init_mapper_options);
+    void CalibrateCamera(Reconstruction* reconstruction,
+      IncrementalMapper* mapper);
 
     const IncrementalMapperOptions* options_;
     const std::string image_path_;
     const std::string database_path_;
     ReconstructionManager* reconstruction_manager_;
+    std::shared_ptr<const DatabaseCache> shared_database_cache_;
     DatabaseCache database_cache_;
+    CameraCalibrationRegistry* calibration_registry_;
   };
 
   // Globally filter points and images in mapper.
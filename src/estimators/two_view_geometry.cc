@@ -31,7 +31,7 @@
 
 #include "estimators/two_view_geometry.h"
 
-#include <unordered_set>
+#include <numeric>
 
 #include "base/camera.h"
 #include "base/essential_matrix.h"
@@ -64,27 +64,64 @@ FeatureMatches ExtractInlierMatches(const FeatureMatches& matches,
   return inlier_matches;
 }
 
-FeatureMatches ExtractOutlierMatches(const FeatureMatches& matches,
-                                     const FeatureMatches& inlier_matches) {
-  CHECK_GE(matches.size(), inlier_matches.size());
-
-  std::unordered_set<std::pair<point2D_t, point2D_t>> inlier_matches_set;
-  inlier_matches_set.reserve(inlier_matches.size());
-  for (const auto& match : inlier_matches) {
-    inlier_matches_set.emplace(match.point2D_idx1, match.point2D_idx2);
+// Corresponding image points of the matches and, for calibrated image pairs,
+// their normalized camera coordinates.
+struct MatchedPoints {
+  std::vector<Eigen::Vector2d> points1;
+  std::vector<Eigen::Vector2d> points2;
+  std::vector<Eigen::Vector2d> points1_normalized;
+  std::vector<Eigen::Vector2d> points2_normalized;
+};
+
+void ExtractMatchedPoints(const Camera& camera1,
+                          const std::vector<Eigen::Vector2d>& points1,
+                          const Camera& camera2,
+                          const std::vector<Eigen::Vector2d>& points2,
+                          const FeatureMatches& matches, const bool normalize,
+                          MatchedPoints* matched_points) {
+  matched_points->points1.resize(matches.size());
+  matched_points->points2.resize(matches.size());
+  for (size_t i = 0; i < matches.size(); ++i) {
+    matched_points->points1[i] = points1[matches[i].point2D_idx1];
+    matched_points->points2[i] = points2[matches[i].point2D_idx2];
   }
 
-  FeatureMatches outlier_matches;
-  outlier_matches.reserve(matches.size() - inlier_matches.size());
-
-  for (const auto& match : matches) {
-    if (inlier_matches_set.count(
-            std::make_pair(match.point2D_idx1, match.point2D_idx2)) == 0) {
-      outlier_matches.push_back(match);
+  if (normalize) {
+    matched_points->points1_normalized.resize(matches.size());
+    matched_points->points2_normalized.resize(matches.size());
+    for (size_t i = 0; i < matches.size(); ++i) {
+      matched_points->points1_normalized[i] =
+          camera1.ImageToWorld(matched_points->points1[i]);
+      matched_points->points2_normalized[i] =
+          camera2.ImageToWorld(matched_points->points2[i]);
     }
+  } else {
+    matched_points->points1_normalized.clear();
+    matched_points->points2_normalized.clear();
   }
+}
 
-  return outlier_matches;
+// Gather the subset of previously extracted points, reusing the memory of the
+// output buffers across calls.
+void GatherMatchedPoints(const MatchedPoints& matched_points,
+                         const std::vector<size_t>& idxs,
+                         MatchedPoints* subset_points) {
+  const bool normalized = !matched_points.points1_normalized.empty();
+  subset_points->points1.resize(idxs.size());
+  subset_points->points2.resize(idxs.size());
+  subset_points->points1_normalized.resize(normalized ? idxs.size() : 0);
+  subset_points->points2_normalized.resize(normalized ? idxs.size() : 0);
+  for (size_t i = 0; i < idxs.size(); ++i) {
+    const size_t idx = idxs[i];
+    subset_points->points1[i] = matched_points.points1[idx];
+    subset_points->points2[i] = matched_points.points2[idx];
+    if (normalized) {
+      subset_points->points1_normalized[i] =
+          matched_points.points1_normalized[idx];
+      subset_points->points2_normalized[i] =
+          matched_points.points2_normalized[idx];
+    }
+  }
 }
 
 inline bool IsImagePointInBoundingBox(const Eigen::Vector2d& point,
@@ -94,6 +131,183 @@ inline bool IsImagePointInBoundingBox(const Eigen::Vector2d& point,
          point.y() <= maxy;
 }
 
+// Estimate the E, F, and H models for the given calibrated correspondences and
+// select the configuration. Returns the number of inliers of the selected
+// model and its inlier mask or zero in case of a degenerate configuration.
+size_t EstimateCalibratedModels(const Camera& camera1, const Camera& camera2,
+                                const MatchedPoints& matched_points,
+                                const TwoViewGeometry::Options& options,
+                                TwoViewGeometry* two_view_geometry,
+                                std::vector<char>* inlier_mask) {
+  // Estimate epipolar models.
+
+  auto E_ransac_options = options.ransac_options;
+  E_ransac_options.max_error =
+      (camera1.ImageToWorldThreshold(options.ransac_options.max_error) +
+       camera2.ImageToWorldThreshold(options.ransac_options.max_error)) /
+      2;
+
+  LORANSAC<EssentialMatrixFivePointEstimator, EssentialMatrixFivePointEstimator>
+      E_ransac(E_ransac_options);
+  const auto E_report = E_ransac.Estimate(matched_points.points1_normalized,
+                                          matched_points.points2_normalized);
+  two_view_geometry->E = E_report.model;
+
+  LORANSAC<FundamentalMatrixSevenPointEstimator,
+           FundamentalMatrixEightPointEstimator>
+      F_ransac(options.ransac_options);
+  const auto F_report =
+      F_ransac.Estimate(matched_points.points1, matched_points.points2);
+  two_view_geometry->F = F_report.model;
+
+  // Estimate planar or panoramic model.
+
+  LORANSAC<HomographyMatrixEstimator, HomographyMatrixEstimator> H_ransac(
+      options.ransac_options);
+  const auto H_report =
+      H_ransac.Estimate(matched_points.points1, matched_points.points2);
+  two_view_geometry->H = H_report.model;
+
+  if ((!E_report.success && !F_report.success && !H_report.success) ||
+      (E_report.support.num_inliers < options.min_num_inliers &&
+       F_report.support.num_inliers < options.min_num_inliers &&
+       H_report.support.num_inliers < options.min_num_inliers)) {
+    two_view_geometry->config = TwoViewGeometry::DEGENERATE;
+    return 0;
+  }
+
+  // Determine inlier ratios of different models.
+
+  const double E_F_inlier_ratio =
+      static_cast<double>(E_report.support.num_inliers) /
+      F_report.support.num_inliers;
+  const double H_F_inlier_ratio =
+      static_cast<double>(H_report.support.num_inliers) /
+      F_report.support.num_inliers;
+  const double H_E_inlier_ratio =
+      static_cast<double>(H_report.support.num_inliers) /
+      E_report.support.num_inliers;
+
+  const std::vector<char>* best_inlier_mask = nullptr;
+  size_t num_inliers = 0;
+
+  if (E_report.success && E_F_inlier_ratio > options.min_E_F_inlier_ratio &&
+      E_report.support.num_inliers >= options.min_num_inliers) {
+    // Calibrated configuration.
+
+    // Always use the model with maximum matches.
+    if (E_report.support.num_inliers >= F_report.support.num_inliers) {
+      num_inliers = E_report.support.num_inliers;
+      best_inlier_mask = &E_report.inlier_mask;
+    } else {
+      num_inliers = F_report.support.num_inliers;
+      best_inlier_mask = &F_report.inlier_mask;
+    }
+
+    if (H_E_inlier_ratio > options.max_H_inlier_ratio) {
+      two_view_geometry->config = TwoViewGeometry::PLANAR_OR_PANORAMIC;
+      if (H_report.support.num_inliers > num_inliers) {
+        num_inliers = H_report.support.num_inliers;
+        best_inlier_mask = &H_report.inlier_mask;
+      }
+    } else {
+      two_view_geometry->config = TwoViewGeometry::CALIBRATED;
+    }
+  } else if (F_report.success &&
+             F_report.support.num_inliers >= options.min_num_inliers) {
+    // Uncalibrated configuration.
+
+    num_inliers = F_report.support.num_inliers;
+    best_inlier_mask = &F_report.inlier_mask;
+
+    if (H_F_inlier_ratio > options.max_H_inlier_ratio) {
+      two_view_geometry->config = TwoViewGeometry::PLANAR_OR_PANORAMIC;
+      if (H_report.support.num_inliers > num_inliers) {
+        num_inliers = H_report.support.num_inliers;
+        best_inlier_mask = &H_report.inlier_mask;
+      }
+    } else {
+      two_view_geometry->config = TwoViewGeometry::UNCALIBRATED;
+    }
+  } else if (H_report.success &&
+             H_report.support.num_inliers >= options.min_num_inliers) {
+    num_inliers = H_report.support.num_inliers;
+    best_inlier_mask = &H_report.inlier_mask;
+    two_view_geometry->config = TwoViewGeometry::PLANAR_OR_PANORAMIC;
+  } else {
+    two_view_geometry->config = TwoViewGeometry::DEGENERATE;
+    return 0;
+  }
+
+  *inlier_mask = *best_inlier_mask;
+
+  if (options.detect_watermark &&
+      TwoViewGeometry::DetectWatermark(
+          camera1, matched_points.points1, camera2, matched_points.points2,
+          num_inliers, *inlier_mask, options)) {
+    two_view_geometry->config = TwoViewGeometry::WATERMARK;
+  }
+
+  return num_inliers;
+}
+
+// Estimate the F and H models for the given uncalibrated correspondences and
+// select the configuration. Returns the number of inliers of the fundamental
+// matrix and its inlier mask or zero in case of a degenerate configuration.
+size_t EstimateUncalibratedModels(const Camera& camera1, const Camera& camera2,
+                                  const MatchedPoints& matched_points,
+                                  const TwoViewGeometry::Options& options,
+                                  TwoViewGeometry* two_view_geometry,
+                                  std::vector<char>* inlier_mask) {
+  // Estimate epipolar model.
+
+  LORANSAC<FundamentalMatrixSevenPointEstimator,
+           FundamentalMatrixEightPointEstimator>
+      F_ransac(options.ransac_options);
+  const auto F_report =
+      F_ransac.Estimate(matched_points.points1, matched_points.points2);
+  two_view_geometry->F = F_report.model;
+
+  // Estimate planar or panoramic model.
+
+  LORANSAC<HomographyMatrixEstimator, HomographyMatrixEstimator> H_ransac(
+      options.ransac_options);
+  const auto H_report =
+      H_ransac.Estimate(matched_points.points1, matched_points.points2);
+  two_view_geometry->H = H_report.model;
+
+  if ((!F_report.success && !H_report.success) ||
+      (F_report.support.num_inliers < options.min_num_inliers &&
+       H_report.support.num_inliers < options.min_num_inliers)) {
+    two_view_geometry->config = TwoViewGeometry::DEGENERATE;
+    return 0;
+  }
+
+  // Determine inlier ratios of different models.
+
+  const double H_F_inlier_ratio =
+      static_cast<double>(H_report.support.num_inliers) /
+      F_report.support.num_inliers;
+
+  if (H_F_inlier_ratio > options.max_H_inlier_ratio) {
+    two_view_geometry->config = TwoViewGeometry::PLANAR_OR_PANORAMIC;
+  } else {
+    two_view_geometry->config = TwoViewGeometry::UNCALIBRATED;
+  }
+
+  *inlier_mask = F_report.inlier_mask;
+
+  if (options.detect_watermark &&
+      TwoViewGeometry::DetectWatermark(camera1, matched_points.points1,
+                                       camera2, matched_points.points2,
+                                       F_report.support.num_inliers,
+                                       *inlier_mask, options)) {
+    two_view_geometry->config = TwoViewGeometry::WATERMARK;
+  }
+
+  return F_report.support.num_inliers;
+}
+
 }  // namespace
 
 void TwoViewGeometry::Invert() {
@@ -127,26 +341,60 @@ void TwoViewGeometry::EstimateMultiple(
     const Camera& camera1, const std::vector<Eigen::Vector2d>& points1,
     const Camera& camera2, const std::vector<Eigen::Vector2d>& points2,
     const FeatureMatches& matches, const Options& options) {
-  FeatureMatches remaining_matches = matches;
+  options.Check();
+
+  const bool calibrated =
+      camera1.HasPriorFocalLength() && camera2.HasPriorFocalLength();
+
+  // Extract and normalize the corresponding points once for all models.
+  MatchedPoints matched_points;
+  ExtractMatchedPoints(camera1, points1, camera2, points2, matches,
+                       /*normalize=*/calibrated, &matched_points);
+
+  // Indices of the matches that are not yet explained by any of the models.
+  std::vector<size_t> remaining_idxs(matches.size());
+  std::iota(remaining_idxs.begin(), remaining_idxs.end(), 0);
+
+  MatchedPoints remaining_points;
+  std::vector<char> inlier_mask;
   std::vector<TwoViewGeometry> two_view_geometries;
-  while (true) {
+  while (remaining_idxs.size() >= options.min_num_inliers) {
+    GatherMatchedPoints(matched_points, remaining_idxs, &remaining_points);
+
     TwoViewGeometry two_view_geometry;
-    two_view_geometry.Estimate(camera1, points1, camera2, points2,
-                               remaining_matches, options);
+    const size_t num_inliers =
+        calibrated
+            ? EstimateCalibratedModels(camera1, camera2, remaining_points,
+                                       options, &two_view_geometry,
+                                       &inlier_mask)
+            : EstimateUncalibratedModels(camera1, camera2, remaining_points,
+                                         options, &two_view_geometry,
+                                         &inlier_mask);
     if (two_view_geometry.config == ConfigurationType::DEGENERATE) {
       break;
     }
 
+    // Split the remaining matches into the inliers of the current model and
+    // the matches for the next model by compacting the indices in-place.
+    two_view_geometry.inlier_matches.reserve(num_inliers);
+    size_t num_remaining = 0;
+    for (size_t i = 0; i < remaining_idxs.size(); ++i) {
+      if (inlier_mask[i]) {
+        two_view_geometry.inlier_matches.push_back(matches[remaining_idxs[i]]);
+      } else {
+        remaining_idxs[num_remaining] = remaining_idxs[i];
+        num_remaining += 1;
+      }
+    }
+    remaining_idxs.resize(num_remaining);
+
     if (options.multiple_ignore_watermark) {
       if (two_view_geometry.config != ConfigurationType::WATERMARK) {
-        two_view_geometries.push_back(two_view_geometry);
+        two_view_geometries.push_back(std::move(two_view_geometry));
       }
     } else {
-      two_view_geometries.push_back(two_view_geometry);
+      two_view_geometries.push_back(std::move(two_view_geometry));
     }
-
-    remaining_matches = ExtractOutlierMatches(remaining_matches,
-                                              two_view_geometry.inlier_matches);
   }
 
   if (two_view_geometries.empty()) {
@@ -238,127 +486,15 @@ void TwoViewGeometry::EstimateCalibrated(
     return;
   }
 
-  // Extract corresponding points.
-  std::vector<Eigen::Vector2d> matched_points1(matches.size());
-  std::vector<Eigen::Vector2d> matched_points2(matches.size());
-  std::vector<Eigen::Vector2d> matched_points1_normalized(matches.size());
-  std::vector<Eigen::Vector2d> matched_points2_normalized(matches.size());
-  for (size_t i = 0; i < matches.size(); ++i) {
-    const point2D_t idx1 = matches[i].point2D_idx1;
-    const point2D_t idx2 = matches[i].point2D_idx2;
-    matched_points1[i] = points1[idx1];
-    matched_points2[i] = points2[idx2];
-    matched_points1_normalized[i] = camera1.ImageToWorld(points1[idx1]);
-    matched_points2_normalized[i] = camera2.ImageToWorld(points2[idx2]);
-  }
-
-  // Estimate epipolar models.
-
-  auto E_ransac_options = options.ransac_options;
-  E_ransac_options.max_error =
-      (camera1.ImageToWorldThreshold(options.ransac_options.max_error) +
-       camera2.ImageToWorldThreshold(options.ransac_options.max_error)) /
-      2;
-
-  LORANSAC<EssentialMatrixFivePointEstimator, EssentialMatrixFivePointEstimator>
-      E_ransac(E_ransac_options);
-  const auto E_report =
-      E_ransac.Estimate(matched_points1_normalized, matched_points2_normalized);
-  E = E_report.model;
-
-  LORANSAC<FundamentalMatrixSevenPointEstimator,
-           FundamentalMatrixEightPointEstimator>
-      F_ransac(options.ransac_options);
-  const auto F_report = F_ransac.Estimate(matched_points1, matched_points2);
-  F = F_report.model;
-
-  // Estimate planar or panoramic model.
-
-  LORANSAC<HomographyMatrixEstimator, HomographyMatrixEstimator> H_ransac(
-      options.ransac_options);
-  const auto H_report = H_ransac.Estimate(matched_points1, matched_points2);
-  H = H_report.model;
-
-  if ((!E_report.success && !F_report.success && !H_report.success) ||
-      (E_report.support.num_inliers < options.min_num_inliers &&
-       F_report.support.num_inliers < options.min_num_inliers &&
-       H_report.support.num_inliers < options.min_num_inliers)) {
-    config = ConfigurationType::DEGENERATE;
-    return;
-  }
-
-  // Determine inlier ratios of different models.
-
-  const double E_F_inlier_ratio =
-      static_cast<double>(E_report.support.num_inliers) /
-      F_report.support.num_inliers;
-  const double H_F_inlier_ratio =
-      static_cast<double>(H_report.support.num_inliers) /
-      F_report.support.num_inliers;
-  const double H_E_inlier_ratio =
-      static_cast<double>(H_report.support.num_inliers) /
-      E_report.support.num_inliers;
-
-  const std::vector<char>* best_inlier_mask = nullptr;
-  size_t num_inliers = 0;
-
-  if (E_report.success && E_F_inlier_ratio > options.min_E_F_inlier_ratio &&
-      E_report.support.num_inliers >= options.min_num_inliers) {
-    // Calibrated configuration.
-
-    // Always use the model with maximum matches.
-    if (E_report.support.num_inliers >= F_report.support.num_inliers) {
-      num_inliers = E_report.support.num_inliers;
-      best_inlier_mask = &E_report.inlier_mask;
-    } else {
-      num_inliers = F_report.support.num_inliers;
-      best_inlier_mask = &F_report.inlier_mask;
-    }
-
-    if (H_E_inlier_ratio > options.max_H_inlier_ratio) {
-      config = PLANAR_OR_PANORAMIC;
-      if (H_report.support.num_inliers > num_inliers) {
-        num_inliers = H_report.support.num_inliers;
-        best_inlier_mask = &H_report.inlier_mask;
-      }
-    } else {
-      config = ConfigurationType::CALIBRATED;
-    }
-  } else if (F_report.success &&
-             F_report.support.num_inliers >= options.min_num_inliers) {
-    // Uncalibrated configuration.
-
-    num_inliers = F_report.support.num_inliers;
-    best_inlier_mask = &F_report.inlier_mask;
-
-    if (H_F_inlier_ratio > options.max_H_inlier_ratio) {
-      config = ConfigurationType::PLANAR_OR_PANORAMIC;
-      if (H_report.support.num_inliers > num_inliers) {
-        num_inliers = H_report.support.num_inliers;
-        best_inlier_mask = &H_report.inlier_mask;
-      }
-    } else {
-      config = ConfigurationType::UNCALIBRATED;
-    }
-  } else if (H_report.success &&
-             H_report.support.num_inliers >= options.min_num_inliers) {
-    num_inliers = H_report.support.num_inliers;
-    best_inlier_mask = &H_report.inlier_mask;
-    config = ConfigurationType::PLANAR_OR_PANORAMIC;
-  } else {
-    config = ConfigurationType::DEGENERATE;
-    return;
-  }
-
-  if (best_inlier_mask != nullptr) {
-    inlier_matches =
-        ExtractInlierMatches(matches, num_inliers, *best_inlier_mask);
+  MatchedPoints matched_points;
+  ExtractMatchedPoints(camera1, points1, camera2, points2, matches,
+                       /*normalize=*/true, &matched_points);
 
-    if (options.detect_watermark &&
-        DetectWatermark(camera1, matched_points1, camera2, matched_points2,
-                        num_inliers, *best_inlier_mask, options)) {
-      config = ConfigurationType::WATERMARK;
-    }
+  std::vector<char> inlier_mask;
+  const size_t num_inliers = EstimateCalibratedModels(
+      camera1, camera2, matched_points, options, this, &inlier_mask);
+  if (config != ConfigurationType::DEGENERATE) {
+    inlier_matches = ExtractInlierMatches(matches, num_inliers, inlier_mask);
   }
 }
 
@@ -373,56 +509,15 @@ void TwoViewGeometry::EstimateUncalibrated(
     return;
   }
 
-  // Extract corresponding points.
-  std::vector<Eigen::Vector2d> matched_points1(matches.size());
-  std::vector<Eigen::Vector2d> matched_points2(matches.size());
-  for (size_t i = 0; i < matches.size(); ++i) {
-    matched_points1[i] = points1[matches[i].point2D_idx1];
-    matched_points2[i] = points2[matches[i].point2D_idx2];
-  }
-
-  // Estimate epipolar model.
-
-  LORANSAC<FundamentalMatrixSevenPointEstimator,
-           FundamentalMatrixEightPointEstimator>
-      F_ransac(options.ransac_options);
-  const auto F_report = F_ransac.Estimate(matched_points1, matched_points2);
-  F = F_report.model;
-
-  // Estimate planar or panoramic model.
-
-  LORANSAC<HomographyMatrixEstimator, HomographyMatrixEstimator> H_ransac(
-      options.ransac_options);
-  const auto H_report = H_ransac.Estimate(matched_points1, matched_points2);
-  H = H_report.model;
-
-  if ((!F_report.success && !H_report.success) ||
-      (F_report.support.num_inliers < options.min_num_inliers &&
-       H_report.support.num_inliers < options.min_num_inliers)) {
-    config = ConfigurationType::DEGENERATE;
-    return;
-  }
-
-  // Determine inlier ratios of different models.
-
-  const double H_F_inlier_ratio =
-      static_cast<double>(H_report.support.num_inliers) /
-      F_report.support.num_inliers;
-
-  if (H_F_inlier_ratio > options.max_H_inlier_ratio) {
-    config = ConfigurationType::PLANAR_OR_PANORAMIC;
-  } else {
-    config = ConfigurationType::UNCALIBRATED;
-  }
+  MatchedPoints matched_points;
+  ExtractMatchedPoints(camera1, points1, camera2, points2, matches,
+                       /*normalize=*/false, &matched_points);
 
-  inlier_matches = ExtractInlierMatches(matches, F_report.support.num_inliers,
-                                        F_report.inlier_mask);
-
-  if (options.detect_watermark &&
-      DetectWatermark(camera1, matched_points1, camera2, matched_points2,
-                      F_report.support.num_inliers, F_report.inlier_mask,
-                      options)) {
-    config = ConfigurationType::WATERMARK;
+  std::vector<char> inlier_mask;
+  const size_t num_inliers = EstimateUncalibratedModels(
+      camera1, camera2, matched_points, options, this, &inlier_mask);
+  if (config != ConfigurationType::DEGENERATE) {
+    inlier_matches = ExtractInlierMatches(matches, num_inliers, inlier_mask);
   }
 }
 
@@ -153,7 +153,8 @@ struct TwoViewGeometry {
   // matches are concatenated and the configuration type is `MULTIPLE` if
   // multiple models could be estimated. This is useful to estimate the two-view
   // geometry for images with large distortion or multiple rigidly moving
-  // objects in the scene.
+  // objects in the scene. The correspondences are extracted and normalized only
+  // once and the remaining matches of each iteration are tracked by index.
   //
   // Note that in case the model type is `MULTIPLE`, only the `inlier_matches`
   // field will be initialized.
@@ -34,6 +34,7 @@
 
 #include "base/pose.h"
 #include "estimators/two_view_geometry.h"
+#include "util/random.h"
 
 using namespace colmap;
 
@@ -83,3 +84,77 @@ BOOST_AUTO_TEST_CASE(TestInvert) {
   BOOST_CHECK_EQUAL(two_view_geometry.inlier_matches[1].point2D_idx1, 2);
   BOOST_CHECK_EQUAL(two_view_geometry.inlier_matches[1].point2D_idx2, 3);
 }
+
+BOOST_AUTO_TEST_CASE(TestEstimateMultiple) {
+  SetPRNGSeed(0);
+
+  Camera camera;
+  camera.InitializeWithName("SIMPLE_PINHOLE", 1000, 1000, 1000);
+
+  // Two rigid objects that move differently relative to the camera, such that
+  // the matches are explained by two different epipolar geometries.
+  const Eigen::Matrix3x4d proj_matrix1 = Eigen::Matrix3x4d::Identity();
+  Eigen::Matrix3x4d proj_matrix2a;
+  proj_matrix2a.leftCols<3>() =
+      Eigen::AngleAxisd(0.1, Eigen::Vector3d::UnitY()).toRotationMatrix();
+  proj_matrix2a.col(3) = Eigen::Vector3d(1, 0, 0);
+  Eigen::Matrix3x4d proj_matrix2b;
+  proj_matrix2b.leftCols<3>() =
+      Eigen::AngleAxisd(-0.1, Eigen::Vector3d::UnitX()).toRotationMatrix();
+  proj_matrix2b.col(3) = Eigen::Vector3d(0, 1, 0.2);
+
+  const size_t kNumPointsA = 100;
+  const size_t kNumPointsB = 60;
+  std::vector<Eigen::Vector2d> points1;
+  std::vector<Eigen::Vector2d> points2;
+  FeatureMatches matches;
+  for (size_t i = 0; i < kNumPointsA + kNumPointsB; ++i) {
+    const Eigen::Vector3d point3D(RandomReal(-2.0, 2.0), RandomReal(-2.0, 2.0),
+                                  RandomReal(4.0, 8.0));
+    const Eigen::Matrix3x4d& proj_matrix2 =
+        i < kNumPointsA ? proj_matrix2a : proj_matrix2b;
+    points1.push_back(camera.WorldToImage(
+        (proj_matrix1 * point3D.homogeneous()).hnormalized()));
+    points2.push_back(camera.WorldToImage(
+        (proj_matrix2 * point3D.homogeneous()).hnormalized()));
+    matches.emplace_back(i, i);
+  }
+
+  TwoViewGeometry::Options options;
+  options.detect_watermark = false;
+  options.ransac_options.max_error = 1;
+
+  TwoViewGeometry single_two_view_geometry;
+  single_two_view_geometry.Estimate(camera, points1, camera, points2, matches,
+                                    options);
+  BOOST_CHECK_EQUAL(single_two_view_geometry.config,
+                    TwoViewGeometry::UNCALIBRATED);
+  BOOST_CHECK_GE(single_two_view_geometry.inlier_matches.size(), kNumPointsA);
+  BOOST_CHECK_LT(single_two_view_geometry.inlier_matches.size(),
+                 kNumPointsA + kNumPointsB);
+
+  TwoViewGeometry multiple_two_view_geometry;
+  multiple_two_view_geometry.EstimateMultiple(camera, points1, camera, points2,
+                                              matches, options);
+  BOOST_CHECK_EQUAL(multiple_two_view_geometry.config,
+                    TwoViewGeometry::MULTIPLE);
+  BOOST_CHECK_EQUAL(multiple_two_view_geometry.inlier_matches.size(),
+                    kNumPointsA + kNumPointsB);
+
+  // Every match is assigned to exactly one of the models.
+  std::vector<bool> is_inlier(matches.size(), false);
+  for (const auto& match : multiple_two_view_geometry.inlier_matches) {
+    BOOST_CHECK_EQUAL(match.point2D_idx1, match.point2D_idx2);
+    BOOST_CHECK(!is_inlier[match.point2D_idx1]);
+    is_inlier[match.point2D_idx1] = true;
+  }
+
+  // Not enough matches for any model.
+  matches.resize(options.min_num_inliers - 1);
+  multiple_two_view_geometry = TwoViewGeometry();
+  multiple_two_view_geometry.EstimateMultiple(camera, points1, camera, points2,
+                                              matches, options);
+  BOOST_CHECK_EQUAL(multiple_two_view_geometry.config,
+                    TwoViewGeometry::DEGENERATE);
+  BOOST_CHECK(multiple_two_view_geometry.inlier_matches.empty());
+}
@@ -418,12 +418,6 @@ int RunDelaunayMesher(int argc, char** argv) {
 }
 
 int RunPatchMatchStereo(int argc, char** argv) {
-#ifndef CUDA_ENABLED
-  std::cerr << "ERROR: Dense stereo reconstruction requires CUDA, which is not "
-               "available on your system."
-            << std::endl;
-  return EXIT_FAILURE;
-#else   // CUDA_ENABLED
   std::string workspace_path;
   std::string workspace_format = "COLMAP";
   std::string pmvs_option_name = "option-all";
@@ -454,7 +448,6 @@ int RunPatchMatchStereo(int argc, char** argv) {
   controller.Wait();
 
   return EXIT_SUCCESS;
-#endif  // CUDA_ENABLED
 }
 
 int RunExhaustiveMatcher(int argc, char** argv) {
@@ -870,6 +863,7 @@ int RunImageUndistorter(int argc, char** argv) {
   options.AddDefaultOption("roi_min_y", &undistort_camera_options.roi_min_y);
   options.AddDefaultOption("roi_max_x", &undistort_camera_options.roi_max_x);
   options.AddDefaultOption("roi_max_y", &undistort_camera_options.roi_max_y);
+  options.AddDefaultOption("max_fov", &undistort_camera_options.max_fov);
   options.Parse(argc, argv);
 
   CreateDirIfNotExists(output_path);
@@ -923,6 +917,7 @@ int RunImageUndistorterStandalone(int argc, char** argv) {
   options.AddDefaultOption("roi_min_y", &undistort_camera_options.roi_min_y);
   options.AddDefaultOption("roi_max_x", &undistort_camera_options.roi_max_x);
   options.AddDefaultOption("roi_max_y", &undistort_camera_options.roi_max_y);
+  options.AddDefaultOption("max_fov", &undistort_camera_options.max_fov);
   options.Parse(argc, argv);
 
   CreateDirIfNotExists(output_path);
@@ -1078,6 +1073,8 @@ int RunHierarchicalMapper(int argc, char** argv) {
   options.AddDefaultOption("image_overlap", &clustering_options.image_overlap);
   options.AddDefaultOption("leaf_max_num_images",
                            &clustering_options.leaf_max_num_images);
+  options.AddDefaultOption("is_hierarchical",
+                           &clustering_options.is_hierarchical);
   options.AddMapperOptions();
   options.Parse(argc, argv);
 
@@ -2423,8 +2420,9 @@ int RunVocabTreeRetriever(int argc, char** argv) {
     std::cout << StringPrintf(" in %.3fs", timer.ElapsedSeconds()) << std::endl;
   }
 
-  // Compute the TF-IDF weights, etc.
-  visual_index.Prepare();
+  // Compute the TF-IDF weights, etc. If the vocabulary tree already indexed
+  // images, only the newly added images are prepared.
+  visual_index.PrepareIncremental();
 
   // Optionally save the indexing data for the database images (as well as the
   // original vocabulary tree data) to speed up future indexing.
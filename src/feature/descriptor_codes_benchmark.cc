@@ -0,0 +1,285 @@
+// Copyright (c) 2018, ETH Zurich and UNC Chapel Hill.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//
+//     * Neither the name of ETH Zurich and UNC Chapel Hill nor the names of
+//       its contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Author: Johannes L. Schoenberger (jsch-at-demuc-dot-de)
+
+// Benchmark of the descriptor codes against matching the full descriptors with
+// FLANN. Synthetic images observe noisy versions of the same scene descriptors
+// in random order, mixed with random outliers. The images are stored in a
+// database for each storage mode, whose size is reported together with the
+// bytes read from the database, the time to read and match an image pair, and
+// the recall of the brute-force matches of the full descriptors:
+//
+//    descriptor_codes_benchmark [num_features] [num_images] [database_dir]
+//
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include "base/database.h"
+#include "feature/sift.h"
+#include "feature/types.h"
+#include "feature/utils.h"
+#include "util/misc.h"
+#include "util/random.h"
+#include "util/timer.h"
+
+using namespace colmap;
+
+namespace {
+
+enum class StorageMode { FULL, FULL_AND_CODES, CODES_ONLY };
+
+struct BenchmarkResult {
+  size_t num_database_bytes = 0;
+  size_t num_read_bytes = 0;
+  double match_time = 0;
+  double recall = 0;
+};
+
+std::vector<FeatureDescriptors> CreateImageDescriptors(
+    const size_t num_features, const size_t num_images) {
+  SetPRNGSeed(0);
+
+  Eigen::MatrixXf scene_descriptors(num_features, 128);
+  for (size_t i = 0; i < num_features; ++i) {
+    for (size_t j = 0; j < 128; ++j) {
+      scene_descriptors(i, j) = std::pow(RandomReal(0.0f, 1.0f), 2);
+    }
+  }
+
+  std::vector<FeatureDescriptors> image_descriptors;
+  for (size_t image_idx = 0; image_idx < num_images; ++image_idx) {
+    std::vector<size_t> order(num_features);
+    for (size_t i = 0; i < num_features; ++i) {
+      order[i] = i;
+    }
+    Shuffle(static_cast<uint32_t>(num_features), &order);
+
+    // A third of the features are outliers that are not seen in other images.
+    Eigen::MatrixXf descriptors(num_features, 128);
+    for (size_t i = 0; i < num_features; ++i) {
+      const bool outlier = i % 3 == 0;
+      for (size_t j = 0; j < 128; ++j) {
+        descriptors(i, j) =
+            outlier ? std::pow(RandomReal(0.0f, 1.0f), 2)
+                    : std::max(0.0f, scene_descriptors(order[i], j) +
+                                         RandomGaussian(0.0f, 0.05f));
+      }
+    }
+
+    image_descriptors.push_back(FeatureDescriptorsToUnsignedByte(
+        L2NormalizeFeatureDescriptors(descriptors)));
+  }
+
+  return image_descriptors;
+}
+
+void WriteDatabase(const std::string& database_path,
+                   const std::vector<FeatureDescriptors>& image_descriptors,
+                   const StorageMode storage_mode,
+                   std::vector<image_t>* image_ids) {
+  if (ExistsFile(database_path)) {
+    boost::filesystem::remove(database_path);
+  }
+
+  Database database(database_path);
+  DatabaseTransaction database_transaction(&database);
+
+  Camera camera;
+  camera.InitializeWithName("SIMPLE_RADIAL", 1000, 1000, 1000);
+  const camera_t camera_id = database.WriteCamera(camera);
+
+  image_ids->clear();
+  for (size_t image_idx = 0; image_idx < image_descriptors.size();
+       ++image_idx) {
+    Image image;
+    image.SetName(std::to_string(image_idx));
+    image.SetCameraId(camera_id);
+    const image_t image_id = database.WriteImage(image);
+    image_ids->push_back(image_id);
+    if (storage_mode != StorageMode::CODES_ONLY) {
+      database.WriteDescriptors(image_id, image_descriptors[image_idx]);
+    }
+    if (storage_mode != StorageMode::FULL) {
+      database.WriteDescriptorCodes(
+          image_id, QuantizeFeatureDescriptors(image_descriptors[image_idx]));
+    }
+  }
+}
+
+size_t NumDescriptorCodesBytes(const FeatureDescriptorCodes& codes) {
+  return codes.codes.size() + codes.codebook.size();
+}
+
+uint64_t MatchToKey(const FeatureMatch& match) {
+  return (static_cast<uint64_t>(match.point2D_idx1) << 32) +
+         match.point2D_idx2;
+}
+
+double ComputeRecall(const FeatureMatches& ref_matches,
+                     const FeatureMatches& matches) {
+  if (ref_matches.empty()) {
+    return 1.0;
+  }
+  std::unordered_set<uint64_t> ref_match_keys;
+  for (const auto& match : ref_matches) {
+    ref_match_keys.insert(MatchToKey(match));
+  }
+  size_t num_found = 0;
+  for (const auto& match : matches) {
+    num_found += ref_match_keys.count(MatchToKey(match));
+  }
+  return static_cast<double>(num_found) / ref_matches.size();
+}
+
+BenchmarkResult RunBenchmark(
+    const std::string& database_path,
+    const std::vector<FeatureDescriptors>& image_descriptors,
+    const std::vector<FeatureMatches>& ref_matches,
+    const StorageMode storage_mode) {
+  std::vector<image_t> image_ids;
+  WriteDatabase(database_path, image_descriptors, storage_mode, &image_ids);
+
+  BenchmarkResult result;
+  result.num_database_bytes = GetFileSize(database_path);
+
+  Database database(database_path);
+
+  SiftMatchingOptions match_options;
+  match_options.use_descriptor_codes = storage_mode != StorageMode::FULL;
+
+  Timer timer;
+  timer.Start();
+
+  std::vector<FeatureMatches> matches(ref_matches.size());
+  for (size_t pair_idx = 0; pair_idx < ref_matches.size(); ++pair_idx) {
+    const image_t image_id1 = image_ids[pair_idx];
+    const image_t image_id2 = image_ids[pair_idx + 1];
+    if (storage_mode == StorageMode::FULL) {
+      const FeatureDescriptors descriptors1 =
+          database.ReadDescriptors(image_id1);
+      const FeatureDescriptors descriptors2 =
+          database.ReadDescriptors(image_id2);
+      result.num_read_bytes += descriptors1.size() + descriptors2.size();
+      MatchSiftFeaturesCPUFLANN(match_options, descriptors1, descriptors2,
+                                &matches[pair_idx]);
+    } else {
+      const FeatureDescriptorCodes codes1 =
+          database.ReadDescriptorCodes(image_id1);
+      const FeatureDescriptorCodes codes2 =
+          database.ReadDescriptorCodes(image_id2);
+      result.num_read_bytes +=
+          NumDescriptorCodesBytes(codes1) + NumDescriptorCodesBytes(codes2);
+      FeatureDescriptorRowsReader read_descriptor_rows1;
+      FeatureDescriptorRowsReader read_descriptor_rows2;
+      if (storage_mode == StorageMode::FULL_AND_CODES) {
+        read_descriptor_rows1 = [&](const std::vector<int>& rows) {
+          const FeatureDescriptors descriptors =
+              database.ReadDescriptorRows(image_id1, rows);
+          result.num_read_bytes += descriptors.size();
+          return descriptors;
+        };
+        read_descriptor_rows2 = [&](const std::vector<int>& rows) {
+          const FeatureDescriptors descriptors =
+              database.ReadDescriptorRows(image_id2, rows);
+          result.num_read_bytes += descriptors.size();
+          return descriptors;
+        };
+      }
+      MatchSiftFeaturesCPUDescriptorCodes(
+          match_options, codes1, codes2, read_descriptor_rows1,
+          read_descriptor_rows2, &matches[pair_idx]);
+    }
+  }
+
+  result.match_time = timer.ElapsedSeconds() / ref_matches.size();
+
+  for (size_t pair_idx = 0; pair_idx < ref_matches.size(); ++pair_idx) {
+    result.recall += ComputeRecall(ref_matches[pair_idx], matches[pair_idx]) /
+                     ref_matches.size();
+  }
+
+  database.Close();
+  boost::filesystem::remove(database_path);
+
+  return result;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  const size_t num_features =
+      argc > 1 ? std::stoul(argv[1]) : static_cast<size_t>(4000);
+  const size_t num_images =
+      argc > 2 ? std::stoul(argv[2]) : static_cast<size_t>(8);
+  const std::string database_dir = argc > 3 ? argv[3] : ".";
+  CHECK_GE(num_images, 2);
+
+  const std::vector<FeatureDescriptors> image_descriptors =
+      CreateImageDescriptors(num_features, num_images);
+
+  // Match consecutive image pairs and compare against brute-force matching.
+  SiftMatchingOptions match_options;
+  std::vector<FeatureMatches> ref_matches(num_images - 1);
+  for (size_t pair_idx = 0; pair_idx < ref_matches.size(); ++pair_idx) {
+    MatchSiftFeaturesCPUBruteForce(match_options, image_descriptors[pair_idx],
+                                   image_descriptors[pair_idx + 1],
+                                   &ref_matches[pair_idx]);
+  }
+
+  const std::vector<std::pair<std::string, StorageMode>> storage_modes = {
+      {"full", StorageMode::FULL},
+      {"full+codes", StorageMode::FULL_AND_CODES},
+      {"codes", StorageMode::CODES_ONLY}};
+
+  std::cout << StringPrintf("%12s %14s %14s %12s %8s", "storage",
+                            "database [MB]", "read/pair [KB]",
+                            "match [ms]", "recall")
+            << std::endl;
+  for (const auto& storage_mode : storage_modes) {
+    const BenchmarkResult result = RunBenchmark(
+        JoinPaths(database_dir, "descriptor_codes_benchmark.db"),
+        image_descriptors, ref_matches, storage_mode.second);
+    std::cout << StringPrintf(
+                     "%12s %14.2f %14.1f %12.2f %8.3f",
+                     storage_mode.first.c_str(),
+                     result.num_database_bytes / (1024.0 * 1024.0),
+                     result.num_read_bytes / (1024.0 * ref_matches.size()),
+                     1000 * result.match_time, result.recall)
+              << std::endl;
+  }
+
+  return EXIT_SUCCESS;
+}
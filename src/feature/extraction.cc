@@ -35,6 +35,7 @@
 
 #include "SiftGPU/SiftGPU.h"
 #include "feature/sift.h"
+#include "feature/utils.h"
 #include "util/cuda.h"
 #include "util/misc.h"
 
@@ -139,7 +140,7 @@ SiftFeatureExtractor::SiftFeatureExtractor(
     for (const auto& gpu_index : gpu_indices) {
       sift_gpu_options.gpu_index = std::to_string(gpu_index);
       extractors_.emplace_back(new internal::SiftFeatureExtractorThread(
-          sift_gpu_options, camera_mask, extractor_queue_.get(),
+          sift_gpu_options, camera_mask, nullptr, extractor_queue_.get(),
           writer_queue_.get()));
     }
   } else {
@@ -158,17 +159,26 @@ SiftFeatureExtractor::SiftFeatureExtractor(
           << std::endl;
     }
 
+    // The views of an image are extracted in parallel by a shared thread pool,
+    // so that fewer images must be kept in memory at the same time.
+    int num_extractors = num_threads;
+    if (sift_options_.split_views) {
+      split_view_thread_pool_.reset(new ThreadPool(num_threads));
+      num_extractors = num_threads / sift_options_.split_num_views + 1;
+    }
+
     auto custom_sift_options = sift_options_;
     custom_sift_options.use_gpu = false;
-    for (int i = 0; i < num_threads; ++i) {
+    for (int i = 0; i < num_extractors; ++i) {
       extractors_.emplace_back(new internal::SiftFeatureExtractorThread(
-          custom_sift_options, camera_mask, extractor_queue_.get(),
-          writer_queue_.get()));
+          custom_sift_options, camera_mask, split_view_thread_pool_.get(),
+          extractor_queue_.get(), writer_queue_.get()));
     }
   }
 
   writer_.reset(new internal::FeatureWriterThread(
-      image_reader_.NumImages(), &database_, writer_queue_.get()));
+      image_reader_.NumImages(), &database_, writer_queue_.get(),
+      !sift_options_.descriptor_codes_only));
 }
 
 void SiftFeatureExtractor::Run() {
@@ -343,9 +353,11 @@ void ImageResizerThread::Run() {
 SiftFeatureExtractorThread::SiftFeatureExtractorThread(
     const SiftExtractionOptions& sift_options,
     const std::shared_ptr<Bitmap>& camera_mask,
-    JobQueue<ImageData>* input_queue, JobQueue<ImageData>* output_queue)
+    ThreadPool* split_view_thread_pool, JobQueue<ImageData>* input_queue,
+    JobQueue<ImageData>* output_queue)
     : sift_options_(sift_options),
       camera_mask_(camera_mask),
+      split_view_thread_pool_(split_view_thread_pool),
       input_queue_(input_queue),
       output_queue_(output_queue) {
   CHECK(sift_options_.Check());
@@ -375,6 +387,21 @@ void SiftFeatureExtractorThread::Run() {
 
   SignalValidSetup();
 
+  auto ExtractFeatures = [&](const Bitmap& bitmap, FeatureKeypoints* keypoints,
+                             FeatureDescriptors* descriptors) {
+    if (sift_options_.estimate_affine_shape ||
+        sift_options_.domain_size_pooling) {
+      return ExtractCovariantSiftFeaturesCPU(sift_options_, bitmap, keypoints,
+                                             descriptors);
+    } else if (sift_options_.use_gpu) {
+      return ExtractSiftFeaturesGPU(sift_options_, bitmap, sift_gpu.get(),
+                                    keypoints, descriptors);
+    } else {
+      return ExtractSiftFeaturesCPU(sift_options_, bitmap, keypoints,
+                                    descriptors);
+    }
+  };
+
   while (true) {
     if (IsStopped()) {
       break;
@@ -386,19 +413,17 @@ void SiftFeatureExtractorThread::Run() {
 
       if (image_data.status == ImageReader::Status::SUCCESS) {
         bool success = false;
-        if (sift_options_.estimate_affine_shape ||
-            sift_options_.domain_size_pooling) {
-          success = ExtractCovariantSiftFeaturesCPU(
-              sift_options_, image_data.bitmap, &image_data.keypoints,
+        if (sift_options_.split_views) {
+          const double scale = static_cast<double>(image_data.bitmap.Width()) /
+                               image_data.camera.Width();
+          success = ExtractSplitViewFeatures(
+              GetSplitViewRemap(image_data), image_data.bitmap,
+              scale * sift_options_.split_max_duplicate_distance,
+              ExtractFeatures, split_view_thread_pool_, &image_data.keypoints,
               &image_data.descriptors);
-        } else if (sift_options_.use_gpu) {
-          success = ExtractSiftFeaturesGPU(
-              sift_options_, image_data.bitmap, sift_gpu.get(),
-              &image_data.keypoints, &image_data.descriptors);
         } else {
-          success = ExtractSiftFeaturesCPU(sift_options_, image_data.bitmap,
-                                           &image_data.keypoints,
-                                           &image_data.descriptors);
+          success = ExtractFeatures(image_data.bitmap, &image_data.keypoints,
+                                    &image_data.descriptors);
         }
         if (success) {
           ScaleKeypoints(image_data.bitmap, image_data.camera,
@@ -411,6 +436,10 @@ void SiftFeatureExtractorThread::Run() {
             MaskKeypoints(image_data.mask, &image_data.keypoints,
                           &image_data.descriptors);
           }
+          if (sift_options_.write_descriptor_codes) {
+            image_data.descriptor_codes =
+                QuantizeFeatureDescriptors(image_data.descriptors);
+          }
         } else {
           image_data.status = ImageReader::Status::FAILURE;
         }
@@ -425,10 +454,41 @@ void SiftFeatureExtractorThread::Run() {
   }
 }
 
+const SplitViewRemap& SiftFeatureExtractorThread::GetSplitViewRemap(
+    const ImageData& image_data) {
+  const double scale_x = static_cast<double>(image_data.bitmap.Width()) /
+                         image_data.camera.Width();
+  const double scale_y = static_cast<double>(image_data.bitmap.Height()) /
+                         image_data.camera.Height();
+  const double principal_point_x =
+      scale_x * image_data.camera.PrincipalPointX();
+  const double principal_point_y =
+      scale_y * image_data.camera.PrincipalPointY();
+  const double min_radius = scale_x * sift_options_.split_min_radius;
+  const double max_radius = scale_x * sift_options_.split_max_radius;
+
+  if (!split_view_remap_ ||
+      !split_view_remap_->IsCompatible(
+          image_data.bitmap.Width(), image_data.bitmap.Height(),
+          principal_point_x, principal_point_y, min_radius, max_radius,
+          sift_options_.split_num_views)) {
+    split_view_remap_.reset(new SplitViewRemap(
+        image_data.bitmap.Width(), image_data.bitmap.Height(),
+        principal_point_x, principal_point_y, min_radius, max_radius,
+        sift_options_.split_num_views));
+  }
+
+  return *split_view_remap_;
+}
+
 FeatureWriterThread::FeatureWriterThread(const size_t num_images,
                                          Database* database,
-                                         JobQueue<ImageData>* input_queue)
-    : num_images_(num_images), database_(database), input_queue_(input_queue) {}
+                                         JobQueue<ImageData>* input_queue,
+                                         const bool write_full_descriptors)
+    : num_images_(num_images),
+      database_(database),
+      input_queue_(input_queue),
+      write_full_descriptors_(write_full_descriptors) {}
 
 void FeatureWriterThread::Run() {
   size_t image_index = 0;
@@ -514,10 +574,18 @@ void FeatureWriterThread::Run() {
                                   image_data.keypoints);
       }
 
-      if (!database_->ExistsDescriptors(image_data.image.ImageId())) {
+      if (write_full_descriptors_ &&
+          !database_->ExistsFullDescriptors(image_data.image.ImageId())) {
         database_->WriteDescriptors(image_data.image.ImageId(),
                                     image_data.descriptors);
       }
+
+      if (image_data.descriptor_codes.format !=
+              FeatureDescriptorCodes::Format::UNDEFINED &&
+          !database_->ExistsDescriptorCodes(image_data.image.ImageId())) {
+        database_->WriteDescriptorCodes(image_data.image.ImageId(),
+                                        image_data.descriptor_codes);
+      }
     } else {
       break;
     }
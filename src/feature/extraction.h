@@ -35,6 +35,7 @@
 #include "base/database.h"
 #include "base/image_reader.h"
 #include "feature/sift.h"
+#include "feature/split_views.h"
 #include "util/opengl_utils.h"
 #include "util/threading.h"
 
@@ -65,6 +66,9 @@ class SiftFeatureExtractor : public Thread {
   std::vector<std::unique_ptr<Thread>> extractors_;
   std::unique_ptr<Thread> writer_;
 
+  // Thread pool for the parallel extraction of split views on the CPU.
+  std::unique_ptr<ThreadPool> split_view_thread_pool_;
+
   std::unique_ptr<JobQueue<internal::ImageData>> resizer_queue_;
   std::unique_ptr<JobQueue<internal::ImageData>> extractor_queue_;
   std::unique_ptr<JobQueue<internal::ImageData>> writer_queue_;
@@ -100,6 +104,7 @@ struct ImageData {
 
   FeatureKeypoints keypoints;
   FeatureDescriptors descriptors;
+  FeatureDescriptorCodes descriptor_codes;
 };
 
 class ImageResizerThread : public Thread {
@@ -120,15 +125,23 @@ class SiftFeatureExtractorThread : public Thread {
  public:
   SiftFeatureExtractorThread(const SiftExtractionOptions& sift_options,
                              const std::shared_ptr<Bitmap>& camera_mask,
+                             ThreadPool* split_view_thread_pool,
                              JobQueue<ImageData>* input_queue,
                              JobQueue<ImageData>* output_queue);
 
  private:
   void Run();
 
+  // Get the split view remap table for the given image, which is only rebuilt
+  // if the image dimensions or the principal point of the camera change.
+  const SplitViewRemap& GetSplitViewRemap(const ImageData& image_data);
+
   const SiftExtractionOptions sift_options_;
   std::shared_ptr<Bitmap> camera_mask_;
 
+  ThreadPool* split_view_thread_pool_;
+  std::unique_ptr<SplitViewRemap> split_view_remap_;
+
   std::unique_ptr<OpenGLContextManager> opengl_context_;
 
   JobQueue<ImageData>* input_queue_;
@@ -138,7 +151,8 @@ class SiftFeatureExtractorThread : public Thread {
 class FeatureWriterThread : public Thread {
  public:
   FeatureWriterThread(const size_t num_images, Database* database,
-                      JobQueue<ImageData>* input_queue);
+                      JobQueue<ImageData>* input_queue,
+                      const bool write_full_descriptors = true);
 
  private:
   void Run();
@@ -146,6 +160,7 @@ class FeatureWriterThread : public Thread {
   const size_t num_images_;
   Database* database_;
   JobQueue<ImageData>* input_queue_;
+  const bool write_full_descriptors_;
 };
 
 }  // namespace internal
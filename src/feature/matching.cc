@@ -48,15 +48,36 @@ void PrintElapsedTime(const Timer& timer) {
   std::cout << StringPrintf(" in %.3fs", timer.ElapsedSeconds()) << std::endl;
 }
 
+size_t GetCacheNumBytes(const SiftMatchingOptions& options) {
+  return static_cast<size_t>(1024.0 * 1024.0 * 1024.0 * options.cache_size);
+}
+
+// Maximum number of queued jobs between two stages of the matching pipeline.
+// Bounding the queues limits the memory of in-flight results, while leaving
+// enough slack to absorb the varying runtime of individual image pairs.
+size_t MaxNumQueuedJobs(const SiftMatchingOptions& options) {
+  return 16 * static_cast<size_t>(GetEffectiveNumThreads(options.num_threads));
+}
+
 void IndexImagesInVisualIndex(const int num_threads, const int num_checks,
                               const int max_num_features,
-                              const std::vector<image_t>& image_ids,
+                              const std::vector<image_t>& all_image_ids,
                               Thread* thread, FeatureMatcherCache* cache,
-                              retrieval::VisualIndex<>* visual_index) {
+                              retrieval::VisualIndex<>* visual_index,
+                              const bool prepare_incrementally = false) {
   retrieval::VisualIndex<>::IndexOptions index_options;
   index_options.num_threads = num_threads;
   index_options.num_checks = num_checks;
 
+  // Skip already indexed images before reading their features.
+  std::vector<image_t> image_ids;
+  image_ids.reserve(all_image_ids.size());
+  for (const auto image_id : all_image_ids) {
+    if (!visual_index->ImageIndexed(image_id)) {
+      image_ids.push_back(image_id);
+    }
+  }
+
   for (size_t i = 0; i < image_ids.size(); ++i) {
     if (thread->IsStopped()) {
       return;
@@ -68,8 +89,8 @@ void IndexImagesInVisualIndex(const int num_threads, const int num_checks,
     std::cout << StringPrintf("Indexing image [%d/%d]", i + 1, image_ids.size())
               << std::flush;
 
-    auto keypoints = cache->GetKeypoints(image_ids[i]);
-    auto descriptors = cache->GetDescriptors(image_ids[i]);
+    auto keypoints = *cache->GetKeypoints(image_ids[i]);
+    auto descriptors = *cache->GetDescriptors(image_ids[i]);
     if (max_num_features > 0 && descriptors.rows() > max_num_features) {
       ExtractTopScaleFeatures(&keypoints, &descriptors, max_num_features);
     }
@@ -80,7 +101,11 @@ void IndexImagesInVisualIndex(const int num_threads, const int num_checks,
   }
 
   // Compute the TF-IDF weights, etc.
-  visual_index->Prepare();
+  if (prepare_incrementally) {
+    visual_index->PrepareIncremental();
+  } else {
+    visual_index->Prepare();
+  }
 }
 
 void MatchNearestNeighborsInVisualIndex(
@@ -94,39 +119,54 @@ void MatchNearestNeighborsInVisualIndex(
     std::vector<retrieval::ImageScore> image_scores;
   };
 
-  // Create a thread pool to retrieve the nearest neighbors.
-  ThreadPool retrieval_thread_pool(num_threads);
-  JobQueue<Retrieval> retrieval_queue(num_threads);
+  // Retrieve the nearest neighbors of batches of query images on a separate
+  // thread, so that the next batch is retrieved while the current batch is
+  // matched. The retrieval queue holds at most one batch of results.
+  const size_t batch_size = 4 * GetEffectiveNumThreads(num_threads);
+  JobQueue<Retrieval> retrieval_queue(batch_size);
+  ThreadPool retrieval_thread_pool(1);
 
-  // The retrieval thread kernel function. Note that the descriptors should be
-  // extracted outside of this function sequentially to avoid any concurrent
-  // access to the database causing race conditions.
+  // The retrieval thread kernel function. The visual words of all images in
+  // the batch are assigned at once and the images are then scored in parallel.
   retrieval::VisualIndex<>::QueryOptions query_options;
   query_options.max_num_images = num_images;
   query_options.num_neighbors = num_neighbors;
   query_options.num_checks = num_checks;
   query_options.num_images_after_verification = num_images_after_verification;
-  auto QueryFunc = [&](const image_t image_id) {
-    auto keypoints = cache->GetKeypoints(image_id);
-    auto descriptors = cache->GetDescriptors(image_id);
-    if (max_num_features > 0 && descriptors.rows() > max_num_features) {
-      ExtractTopScaleFeatures(&keypoints, &descriptors, max_num_features);
+  query_options.num_threads = num_threads;
+  auto QueryBatchFunc = [&](const size_t begin, const size_t end) {
+    std::vector<FeatureKeypoints> keypoints(end - begin);
+    std::vector<retrieval::VisualIndex<>::DescType> descriptors(end - begin);
+    for (size_t i = begin; i < end; ++i) {
+      auto& image_keypoints = keypoints[i - begin];
+      FeatureDescriptors image_descriptors;
+      image_keypoints = *cache->GetKeypoints(image_ids[i]);
+      image_descriptors = *cache->GetDescriptors(image_ids[i]);
+      if (max_num_features > 0 &&
+          image_descriptors.rows() > max_num_features) {
+        ExtractTopScaleFeatures(&image_keypoints, &image_descriptors,
+                                max_num_features);
+      }
+      descriptors[i - begin] = image_descriptors;
     }
 
-    Retrieval retrieval;
-    retrieval.image_id = image_id;
-    visual_index->Query(query_options, keypoints, descriptors,
-                        &retrieval.image_scores);
+    std::vector<std::vector<retrieval::ImageScore>> image_scores;
+    visual_index->QueryBatch(query_options, keypoints, descriptors,
+                             &image_scores);
 
-    CHECK(retrieval_queue.Push(retrieval));
+    for (size_t i = begin; i < end; ++i) {
+      Retrieval retrieval;
+      retrieval.image_id = image_ids[i];
+      retrieval.image_scores = std::move(image_scores[i - begin]);
+      if (!retrieval_queue.Push(retrieval)) {
+        return;
+      }
+    }
   };
 
-  // Initially, make all retrieval threads busy and continue with the matching.
-  size_t image_idx = 0;
-  const size_t init_num_tasks =
-      std::min(image_ids.size(), 2 * retrieval_thread_pool.NumThreads());
-  for (; image_idx < init_num_tasks; ++image_idx) {
-    retrieval_thread_pool.AddTask(QueryFunc, image_ids[image_idx]);
+  for (size_t begin = 0; begin < image_ids.size(); begin += batch_size) {
+    const size_t end = std::min(image_ids.size(), begin + batch_size);
+    retrieval_thread_pool.AddTask(QueryBatchFunc, begin, end);
   }
 
   std::vector<std::pair<image_t, image_t>> image_pairs;
@@ -135,6 +175,7 @@ void MatchNearestNeighborsInVisualIndex(
   for (size_t i = 0; i < image_ids.size(); ++i) {
     if (thread->IsStopped()) {
       retrieval_queue.Stop();
+      retrieval_thread_pool.Stop();
       return;
     }
 
@@ -144,12 +185,6 @@ void MatchNearestNeighborsInVisualIndex(
     std::cout << StringPrintf("Matching image [%d/%d]", i + 1, image_ids.size())
               << std::flush;
 
-    // Push the next image to the retrieval queue.
-    if (image_idx < image_ids.size()) {
-      retrieval_thread_pool.AddTask(QueryFunc, image_ids[image_idx]);
-      image_idx += 1;
-    }
-
     // Pop the next results from the retrieval queue.
     const auto retrieval = retrieval_queue.Pop();
     CHECK(retrieval.IsValid());
@@ -212,9 +247,9 @@ bool ImagePairsMatchingOptions::Check() const {
 
 bool FeaturePairsMatchingOptions::Check() const { return true; }
 
-FeatureMatcherCache::FeatureMatcherCache(const size_t cache_size,
-                                         const Database* database)
-    : cache_size_(cache_size), database_(database) {
+FeatureMatcherCache::FeatureMatcherCache(const size_t max_num_bytes,
+                                         Database* database)
+    : max_num_bytes_(max_num_bytes), database_(database) {
   CHECK_NOTNULL(database_);
 }
 
@@ -231,25 +266,78 @@ void FeatureMatcherCache::Setup() {
     images_cache_.emplace(image.ImageId(), image);
   }
 
-  keypoints_cache_.reset(new LRUCache<image_t, FeatureKeypoints>(
-      cache_size_, [this](const image_t image_id) {
-        return database_->ReadKeypoints(image_id);
-      }));
-
-  descriptors_cache_.reset(new LRUCache<image_t, FeatureDescriptors>(
-      cache_size_, [this](const image_t image_id) {
-        return database_->ReadDescriptors(image_id);
-      }));
+  // Split the memory budget according to the size of a SIFT feature, i.e.,
+  // 24 bytes for the keypoint, 128 bytes for the descriptor, and 16 bytes for
+  // the optional descriptor code.
+  const size_t kNumFeatureBytes = sizeof(FeatureKeypoint) +
+                                  FeatureDescriptorCodes::kNumDims +
+                                  FeatureDescriptorCodes::kNumCodeBytes;
+  const size_t max_num_keypoints_bytes = std::max<size_t>(
+      1, max_num_bytes_ * sizeof(FeatureKeypoint) / kNumFeatureBytes);
+  const size_t max_num_descriptor_codes_bytes = std::max<size_t>(
+      1,
+      max_num_bytes_ * FeatureDescriptorCodes::kNumCodeBytes / kNumFeatureBytes);
+  const size_t max_num_descriptors_bytes = std::max<size_t>(
+      1, max_num_bytes_ - max_num_keypoints_bytes -
+             max_num_descriptor_codes_bytes);
+
+  keypoints_cache_.reset(
+      new ShardedMemoryConstrainedLRUCache<image_t, CachedKeypoints>(
+          max_num_keypoints_bytes, kNumShards, [this](const image_t image_id) {
+            CachedKeypoints cached_keypoints;
+            std::unique_lock<std::mutex> lock(database_mutex_);
+            cached_keypoints.keypoints = std::make_shared<FeatureKeypoints>(
+                database_->ReadKeypoints(image_id));
+            return cached_keypoints;
+          }));
+
+  descriptors_cache_.reset(
+      new ShardedMemoryConstrainedLRUCache<image_t, CachedDescriptors>(
+          max_num_descriptors_bytes, kNumShards,
+          [this](const image_t image_id) {
+            CachedDescriptors cached_descriptors;
+            std::unique_lock<std::mutex> lock(database_mutex_);
+            cached_descriptors.descriptors =
+                std::make_shared<FeatureDescriptors>(
+                    database_->ReadDescriptors(image_id));
+            return cached_descriptors;
+          }));
+
+  descriptor_codes_cache_.reset(
+      new ShardedMemoryConstrainedLRUCache<image_t, CachedDescriptorCodes>(
+          max_num_descriptor_codes_bytes, kNumShards,
+          [this](const image_t image_id) {
+            CachedDescriptorCodes cached_descriptor_codes;
+            std::unique_lock<std::mutex> lock(database_mutex_);
+            cached_descriptor_codes.descriptor_codes =
+                std::make_shared<FeatureDescriptorCodes>(
+                    database_->ReadDescriptorCodes(image_id));
+            return cached_descriptor_codes;
+          }));
 
   keypoints_exists_cache_.reset(new LRUCache<image_t, bool>(
       images.size(), [this](const image_t image_id) {
+        std::unique_lock<std::mutex> lock(database_mutex_);
         return database_->ExistsKeypoints(image_id);
       }));
 
   descriptors_exists_cache_.reset(new LRUCache<image_t, bool>(
       images.size(), [this](const image_t image_id) {
+        std::unique_lock<std::mutex> lock(database_mutex_);
         return database_->ExistsDescriptors(image_id);
       }));
+
+  descriptor_codes_exists_cache_.reset(new LRUCache<image_t, bool>(
+      images.size(), [this](const image_t image_id) {
+        std::unique_lock<std::mutex> lock(database_mutex_);
+        return database_->ExistsDescriptorCodes(image_id);
+      }));
+
+  full_descriptors_exists_cache_.reset(new LRUCache<image_t, bool>(
+      images.size(), [this](const image_t image_id) {
+        std::unique_lock<std::mutex> lock(database_mutex_);
+        return database_->ExistsFullDescriptors(image_id);
+      }));
 }
 
 const Camera& FeatureMatcherCache::GetCamera(const camera_t camera_id) const {
@@ -260,16 +348,25 @@ const Image& FeatureMatcherCache::GetImage(const image_t image_id) const {
   return images_cache_.at(image_id);
 }
 
-const FeatureKeypoints& FeatureMatcherCache::GetKeypoints(
+std::shared_ptr<FeatureKeypoints> FeatureMatcherCache::GetKeypoints(
     const image_t image_id) {
-  std::unique_lock<std::mutex> lock(database_mutex_);
-  return keypoints_cache_->Get(image_id);
+  return keypoints_cache_->Get(image_id).keypoints;
+}
+
+std::shared_ptr<FeatureDescriptors> FeatureMatcherCache::GetDescriptors(
+    const image_t image_id) {
+  return descriptors_cache_->Get(image_id).descriptors;
 }
 
-const FeatureDescriptors& FeatureMatcherCache::GetDescriptors(
+std::shared_ptr<FeatureDescriptorCodes> FeatureMatcherCache::GetDescriptorCodes(
     const image_t image_id) {
+  return descriptor_codes_cache_->Get(image_id).descriptor_codes;
+}
+
+FeatureDescriptors FeatureMatcherCache::GetDescriptorRows(
+    const image_t image_id, const std::vector<int>& rows) {
   std::unique_lock<std::mutex> lock(database_mutex_);
-  return descriptors_cache_->Get(image_id);
+  return database_->ReadDescriptorRows(image_id, rows);
 }
 
 FeatureMatches FeatureMatcherCache::GetMatches(const image_t image_id1,
@@ -288,15 +385,25 @@ std::vector<image_t> FeatureMatcherCache::GetImageIds() const {
 }
 
 bool FeatureMatcherCache::ExistsKeypoints(const image_t image_id) {
-  std::unique_lock<std::mutex> lock(database_mutex_);
+  std::unique_lock<std::mutex> lock(exists_mutex_);
   return keypoints_exists_cache_->Get(image_id);
 }
 
 bool FeatureMatcherCache::ExistsDescriptors(const image_t image_id) {
-  std::unique_lock<std::mutex> lock(database_mutex_);
+  std::unique_lock<std::mutex> lock(exists_mutex_);
   return descriptors_exists_cache_->Get(image_id);
 }
 
+bool FeatureMatcherCache::ExistsDescriptorCodes(const image_t image_id) {
+  std::unique_lock<std::mutex> lock(exists_mutex_);
+  return descriptor_codes_exists_cache_->Get(image_id);
+}
+
+bool FeatureMatcherCache::ExistsFullDescriptors(const image_t image_id) {
+  std::unique_lock<std::mutex> lock(exists_mutex_);
+  return full_descriptors_exists_cache_->Get(image_id);
+}
+
 bool FeatureMatcherCache::ExistsMatches(const image_t image_id1,
                                         const image_t image_id2) {
   std::unique_lock<std::mutex> lock(database_mutex_);
@@ -323,6 +430,19 @@ void FeatureMatcherCache::WriteTwoViewGeometry(
   database_->WriteTwoViewGeometry(image_id1, image_id2, two_view_geometry);
 }
 
+void FeatureMatcherCache::WriteMatchesAndTwoViewGeometries(
+    const std::vector<internal::FeatureMatcherData>& data) {
+  std::unique_lock<std::mutex> lock(database_mutex_);
+  DatabaseTransaction database_transaction(database_);
+  for (const auto& image_pair_data : data) {
+    database_->WriteMatches(image_pair_data.image_id1,
+                            image_pair_data.image_id2, image_pair_data.matches);
+    database_->WriteTwoViewGeometry(image_pair_data.image_id1,
+                                    image_pair_data.image_id2,
+                                    image_pair_data.two_view_geometry);
+  }
+}
+
 void FeatureMatcherCache::DeleteMatches(const image_t image_id1,
                                         const image_t image_id2) {
   std::unique_lock<std::mutex> lock(database_mutex_);
@@ -335,6 +455,40 @@ void FeatureMatcherCache::DeleteInlierMatches(const image_t image_id1,
   database_->DeleteInlierMatches(image_id1, image_id2);
 }
 
+void FeatureMatcherCache::PrintStatistics() const {
+  const auto PrintCacheStatistics = [](const std::string& name,
+                                       const size_t num_hits,
+                                       const size_t num_misses,
+                                       const size_t num_bytes) {
+    const size_t num_accesses = num_hits + num_misses;
+    std::cout << StringPrintf(
+                     "Cached %s: %.1f MB, %d hits, %d misses (%.1f%% hit rate)",
+                     name.c_str(), num_bytes / (1024.0 * 1024.0), num_hits,
+                     num_misses,
+                     num_accesses > 0 ? 100.0 * num_hits / num_accesses : 0.0)
+              << std::endl;
+  };
+
+  if (keypoints_cache_) {
+    PrintCacheStatistics("keypoints", keypoints_cache_->NumHits(),
+                         keypoints_cache_->NumMisses(),
+                         keypoints_cache_->NumBytes());
+  }
+
+  if (descriptors_cache_) {
+    PrintCacheStatistics("descriptors", descriptors_cache_->NumHits(),
+                         descriptors_cache_->NumMisses(),
+                         descriptors_cache_->NumBytes());
+  }
+
+  if (descriptor_codes_cache_) {
+    PrintCacheStatistics("descriptor codes",
+                         descriptor_codes_cache_->NumHits(),
+                         descriptor_codes_cache_->NumMisses(),
+                         descriptor_codes_cache_->NumBytes());
+  }
+}
+
 FeatureMatcherThread::FeatureMatcherThread(const SiftMatchingOptions& options,
                                            FeatureMatcherCache* cache)
     : options_(options), cache_(cache) {}
@@ -343,6 +497,10 @@ void FeatureMatcherThread::SetMaxNumMatches(const int max_num_matches) {
   options_.max_num_matches = max_num_matches;
 }
 
+double FeatureMatcherThread::BusySeconds() const {
+  return busy_timer_.ElapsedSeconds();
+}
+
 SiftCPUFeatureMatcher::SiftCPUFeatureMatcher(const SiftMatchingOptions& options,
                                              FeatureMatcherCache* cache,
                                              JobQueue<Input>* input_queue,
@@ -356,6 +514,9 @@ SiftCPUFeatureMatcher::SiftCPUFeatureMatcher(const SiftMatchingOptions& options,
 void SiftCPUFeatureMatcher::Run() {
   SignalValidSetup();
 
+  busy_timer_.Start();
+  busy_timer_.Pause();
+
   while (true) {
     if (IsStopped()) {
       break;
@@ -371,11 +532,37 @@ void SiftCPUFeatureMatcher::Run() {
         continue;
       }
 
-      const FeatureDescriptors descriptors1 =
-          cache_->GetDescriptors(data.image_id1);
-      const FeatureDescriptors descriptors2 =
-          cache_->GetDescriptors(data.image_id2);
-      MatchSiftFeaturesCPU(options_, descriptors1, descriptors2, &data.matches);
+      busy_timer_.Resume();
+      if (options_.use_descriptor_codes &&
+          cache_->ExistsDescriptorCodes(data.image_id1) &&
+          cache_->ExistsDescriptorCodes(data.image_id2)) {
+        // Only the full descriptors of the candidates are read, if they are
+        // stored for both images.
+        FeatureDescriptorRowsReader read_descriptor_rows1;
+        FeatureDescriptorRowsReader read_descriptor_rows2;
+        if (cache_->ExistsFullDescriptors(data.image_id1) &&
+            cache_->ExistsFullDescriptors(data.image_id2)) {
+          read_descriptor_rows1 = [this, &data](const std::vector<int>& rows) {
+            return cache_->GetDescriptorRows(data.image_id1, rows);
+          };
+          read_descriptor_rows2 = [this, &data](const std::vector<int>& rows) {
+            return cache_->GetDescriptorRows(data.image_id2, rows);
+          };
+        }
+        const auto descriptor_codes1 =
+            cache_->GetDescriptorCodes(data.image_id1);
+        const auto descriptor_codes2 =
+            cache_->GetDescriptorCodes(data.image_id2);
+        MatchSiftFeaturesCPUDescriptorCodes(
+            options_, *descriptor_codes1, *descriptor_codes2,
+            read_descriptor_rows1, read_descriptor_rows2, &data.matches);
+      } else {
+        const auto descriptors1 = cache_->GetDescriptors(data.image_id1);
+        const auto descriptors2 = cache_->GetDescriptors(data.image_id2);
+        MatchSiftFeaturesCPU(options_, *descriptors1, *descriptors2,
+                             &data.matches);
+      }
+      busy_timer_.Pause();
 
       CHECK(output_queue_->Push(data));
     }
@@ -405,6 +592,13 @@ void SiftGPUFeatureMatcher::Run() {
   opengl_context_->MakeCurrent();
 #endif
 
+  if (options_.use_descriptor_codes) {
+    std::cout << "ERROR: Matching of descriptor codes not supported on the GPU"
+              << std::endl;
+    SignalInvalidSetup();
+    return;
+  }
+
   SiftMatchGPU sift_match_gpu;
   if (!CreateSiftGPUMatcher(options_, &sift_match_gpu)) {
     std::cout << "ERROR: SiftGPU not fully supported" << std::endl;
@@ -414,6 +608,9 @@ void SiftGPUFeatureMatcher::Run() {
 
   SignalValidSetup();
 
+  busy_timer_.Start();
+  busy_timer_.Pause();
+
   while (true) {
     if (IsStopped()) {
       break;
@@ -429,12 +626,14 @@ void SiftGPUFeatureMatcher::Run() {
         continue;
       }
 
+      busy_timer_.Resume();
       const FeatureDescriptors* descriptors1_ptr;
       GetDescriptorData(0, data.image_id1, &descriptors1_ptr);
       const FeatureDescriptors* descriptors2_ptr;
       GetDescriptorData(1, data.image_id2, &descriptors2_ptr);
       MatchSiftFeaturesGPU(options_, descriptors1_ptr, descriptors2_ptr,
                            &sift_match_gpu, &data.matches);
+      busy_timer_.Pause();
 
       CHECK(output_queue_->Push(data));
     }
@@ -450,7 +649,7 @@ void SiftGPUFeatureMatcher::GetDescriptorData(
     *descriptors_ptr = nullptr;
   } else {
     prev_uploaded_descriptors_[index] = cache_->GetDescriptors(image_id);
-    *descriptors_ptr = &prev_uploaded_descriptors_[index];
+    *descriptors_ptr = prev_uploaded_descriptors_[index].get();
     prev_uploaded_image_ids_[index] = image_id;
   }
 }
@@ -467,6 +666,9 @@ GuidedSiftCPUFeatureMatcher::GuidedSiftCPUFeatureMatcher(
 void GuidedSiftCPUFeatureMatcher::Run() {
   SignalValidSetup();
 
+  busy_timer_.Start();
+  busy_timer_.Pause();
+
   while (true) {
     if (IsStopped()) {
       break;
@@ -490,14 +692,15 @@ void GuidedSiftCPUFeatureMatcher::Run() {
         continue;
       }
 
-      const FeatureKeypoints keypoints1 = cache_->GetKeypoints(data.image_id1);
-      const FeatureKeypoints keypoints2 = cache_->GetKeypoints(data.image_id2);
-      const FeatureDescriptors descriptors1 =
-          cache_->GetDescriptors(data.image_id1);
-      const FeatureDescriptors descriptors2 =
-          cache_->GetDescriptors(data.image_id2);
-      MatchGuidedSiftFeaturesCPU(options_, keypoints1, keypoints2, descriptors1,
-                                 descriptors2, &data.two_view_geometry);
+      busy_timer_.Resume();
+      const auto keypoints1 = cache_->GetKeypoints(data.image_id1);
+      const auto keypoints2 = cache_->GetKeypoints(data.image_id2);
+      const auto descriptors1 = cache_->GetDescriptors(data.image_id1);
+      const auto descriptors2 = cache_->GetDescriptors(data.image_id2);
+      MatchGuidedSiftFeaturesCPU(options_, *keypoints1, *keypoints2,
+                                 *descriptors1, *descriptors2,
+                                 &data.two_view_geometry);
+      busy_timer_.Pause();
 
       CHECK(output_queue_->Push(data));
     }
@@ -535,6 +738,9 @@ void GuidedSiftGPUFeatureMatcher::Run() {
 
   SignalValidSetup();
 
+  busy_timer_.Start();
+  busy_timer_.Pause();
+
   while (true) {
     if (IsStopped()) {
       break;
@@ -558,6 +764,7 @@ void GuidedSiftGPUFeatureMatcher::Run() {
         continue;
       }
 
+      busy_timer_.Resume();
       const FeatureDescriptors* descriptors1_ptr;
       const FeatureKeypoints* keypoints1_ptr;
       GetFeatureData(0, data.image_id1, &keypoints1_ptr, &descriptors1_ptr);
@@ -568,6 +775,7 @@ void GuidedSiftGPUFeatureMatcher::Run() {
       MatchGuidedSiftFeaturesGPU(options_, keypoints1_ptr, keypoints2_ptr,
                                  descriptors1_ptr, descriptors2_ptr,
                                  &sift_match_gpu, &data.two_view_geometry);
+      busy_timer_.Pause();
 
       CHECK(output_queue_->Push(data));
     }
@@ -586,8 +794,8 @@ void GuidedSiftGPUFeatureMatcher::GetFeatureData(
   } else {
     prev_uploaded_keypoints_[index] = cache_->GetKeypoints(image_id);
     prev_uploaded_descriptors_[index] = cache_->GetDescriptors(image_id);
-    *keypoints_ptr = &prev_uploaded_keypoints_[index];
-    *descriptors_ptr = &prev_uploaded_descriptors_[index];
+    *keypoints_ptr = prev_uploaded_keypoints_[index].get();
+    *descriptors_ptr = prev_uploaded_descriptors_[index].get();
     prev_uploaded_image_ids_[index] = image_id;
   }
 }
@@ -598,7 +806,8 @@ TwoViewGeometryVerifier::TwoViewGeometryVerifier(
     : options_(options),
       cache_(cache),
       input_queue_(input_queue),
-      output_queue_(output_queue) {
+      output_queue_(output_queue),
+      num_verified_pairs_(0) {
   CHECK(options_.Check());
 
   two_view_geometry_options_.min_num_inliers =
@@ -613,7 +822,18 @@ TwoViewGeometryVerifier::TwoViewGeometryVerifier(
       options_.min_inlier_ratio;
 }
 
+size_t TwoViewGeometryVerifier::NumVerifiedPairs() const {
+  return num_verified_pairs_;
+}
+
+double TwoViewGeometryVerifier::VerificationSeconds() const {
+  return verification_timer_.ElapsedSeconds();
+}
+
 void TwoViewGeometryVerifier::Run() {
+  verification_timer_.Start();
+  verification_timer_.Pause();
+
   while (true) {
     if (IsStopped()) {
       break;
@@ -634,9 +854,10 @@ void TwoViewGeometryVerifier::Run() {
           cache_->GetCamera(cache_->GetImage(data.image_id2).CameraId());
       const auto keypoints1 = cache_->GetKeypoints(data.image_id1);
       const auto keypoints2 = cache_->GetKeypoints(data.image_id2);
-      const auto points1 = FeatureKeypointsToPointsVector(keypoints1);
-      const auto points2 = FeatureKeypointsToPointsVector(keypoints2);
+      const auto points1 = FeatureKeypointsToPointsVector(*keypoints1);
+      const auto points2 = FeatureKeypointsToPointsVector(*keypoints2);
 
+      verification_timer_.Resume();
       if (options_.multiple_models) {
         data.two_view_geometry.EstimateMultiple(camera1, points1, camera2,
                                                 points2, data.matches,
@@ -646,16 +867,137 @@ void TwoViewGeometryVerifier::Run() {
                                         data.matches,
                                         two_view_geometry_options_);
       }
+      verification_timer_.Pause();
+      num_verified_pairs_ += 1;
 
       CHECK(output_queue_->Push(data));
     }
   }
 }
 
+FeatureMatcherDatabaseWriter::FeatureMatcherDatabaseWriter(
+    const SiftMatchingOptions& options, FeatureMatcherCache* cache,
+    JobQueue<Input>* input_queue)
+    : options_(options),
+      cache_(cache),
+      input_queue_(input_queue),
+      num_written_pairs_(0),
+      num_transactions_(0) {
+  CHECK(options_.Check());
+}
+
+bool FeatureMatcherDatabaseWriter::AddPendingImagePair(
+    const image_t image_id1, const image_t image_id2) {
+  const image_pair_t pair_id =
+      Database::ImagePairToPairId(image_id1, image_id2);
+  std::unique_lock<std::mutex> lock(pending_mutex_);
+  return pending_image_pair_ids_.insert(pair_id).second;
+}
+
+void FeatureMatcherDatabaseWriter::RemovePendingImagePair(
+    const image_t image_id1, const image_t image_id2) {
+  const image_pair_t pair_id =
+      Database::ImagePairToPairId(image_id1, image_id2);
+  {
+    std::unique_lock<std::mutex> lock(pending_mutex_);
+    pending_image_pair_ids_.erase(pair_id);
+  }
+  pending_condition_.notify_all();
+}
+
+void FeatureMatcherDatabaseWriter::WaitForPendingImagePairs() {
+  std::unique_lock<std::mutex> lock(pending_mutex_);
+  while (!pending_image_pair_ids_.empty()) {
+    pending_condition_.wait(lock);
+  }
+}
+
+size_t FeatureMatcherDatabaseWriter::NumWrittenPairs() const {
+  return num_written_pairs_;
+}
+
+size_t FeatureMatcherDatabaseWriter::NumTransactions() const {
+  return num_transactions_;
+}
+
+double FeatureMatcherDatabaseWriter::BusySeconds() const {
+  return busy_timer_.ElapsedSeconds();
+}
+
+void FeatureMatcherDatabaseWriter::Run() {
+  busy_timer_.Start();
+  busy_timer_.Pause();
+
+  std::vector<Input> written_data;
+
+  while (true) {
+    if (IsStopped()) {
+      break;
+    }
+
+    auto input_job = input_queue_->Pop();
+    if (input_job.IsValid()) {
+      busy_timer_.Resume();
+
+      written_data.clear();
+      written_data.push_back(std::move(input_job.Data()));
+
+      // This is the only consumer of the queue, so popping never blocks as
+      // long as the queue is not empty.
+      while (written_data.size() < kMaxNumWritesPerTransaction &&
+             input_queue_->Size() > 0) {
+        auto next_input_job = input_queue_->Pop();
+        if (!next_input_job.IsValid()) {
+          break;
+        }
+        written_data.push_back(std::move(next_input_job.Data()));
+      }
+
+      for (auto& data : written_data) {
+        Filter(&data);
+      }
+
+      cache_->WriteMatchesAndTwoViewGeometries(written_data);
+
+      num_written_pairs_ += written_data.size();
+      num_transactions_ += 1;
+
+      busy_timer_.Pause();
+
+      {
+        std::unique_lock<std::mutex> lock(pending_mutex_);
+        for (const auto& data : written_data) {
+          pending_image_pair_ids_.erase(
+              Database::ImagePairToPairId(data.image_id1, data.image_id2));
+        }
+      }
+      pending_condition_.notify_all();
+    }
+  }
+}
+
+void FeatureMatcherDatabaseWriter::Filter(Input* output) const {
+  if (output->matches.size() < static_cast<size_t>(options_.min_num_inliers)) {
+    output->matches = {};
+  }
+
+  if (output->two_view_geometry.inlier_matches.size() <
+      static_cast<size_t>(options_.min_num_inliers)) {
+    output->two_view_geometry = TwoViewGeometry();
+  }
+}
+
 SiftFeatureMatcher::SiftFeatureMatcher(const SiftMatchingOptions& options,
                                        Database* database,
                                        FeatureMatcherCache* cache)
-    : options_(options), database_(database), cache_(cache), is_setup_(false) {
+    : options_(options),
+      database_(database),
+      cache_(cache),
+      is_setup_(false),
+      matcher_queue_(MaxNumQueuedJobs(options)),
+      verifier_queue_(MaxNumQueuedJobs(options)),
+      guided_matcher_queue_(MaxNumQueuedJobs(options)),
+      output_queue_(MaxNumQueuedJobs(options)) {
   CHECK(options_.Check());
 
   const int num_threads = GetEffectiveNumThreads(options_.num_threads);
@@ -717,9 +1059,16 @@ SiftFeatureMatcher::SiftFeatureMatcher(const SiftMatchingOptions& options,
           options_, cache, &verifier_queue_, &output_queue_));
     }
   }
+
+  writer_.reset(
+      new FeatureMatcherDatabaseWriter(options_, cache, &output_queue_));
 }
 
 SiftFeatureMatcher::~SiftFeatureMatcher() {
+  if (is_setup_) {
+    Wait();
+  }
+
   matcher_queue_.Wait();
   verifier_queue_.Wait();
   guided_matcher_queue_.Wait();
@@ -737,6 +1086,8 @@ SiftFeatureMatcher::~SiftFeatureMatcher() {
     guided_matcher->Stop();
   }
 
+  writer_->Stop();
+
   matcher_queue_.Stop();
   verifier_queue_.Stop();
   guided_matcher_queue_.Stop();
@@ -753,6 +1104,70 @@ SiftFeatureMatcher::~SiftFeatureMatcher() {
   for (auto& guided_matcher : guided_matchers_) {
     guided_matcher->Wait();
   }
+
+  writer_->Wait();
+
+  cache_->PrintStatistics();
+
+  size_t num_verified_pairs = 0;
+  double verification_seconds = 0;
+  for (const auto& verifier : verifiers_) {
+    num_verified_pairs += verifier->NumVerifiedPairs();
+    verification_seconds += verifier->VerificationSeconds();
+  }
+
+  if (num_verified_pairs > 0 && verification_seconds > 0) {
+    const double pairs_per_second = num_verified_pairs / verification_seconds;
+    std::cout << StringPrintf(
+                     "Geometric verification (%s): %d pairs, %.1f pairs/s "
+                     "per thread, %.1f pairs/s with %d threads",
+                     options_.multiple_models ? "multiple models"
+                                              : "single model",
+                     num_verified_pairs, pairs_per_second,
+                     pairs_per_second * verifiers_.size(), verifiers_.size())
+              << std::endl;
+  }
+
+  const double elapsed_seconds = timer_.ElapsedSeconds();
+  if (writer_->NumWrittenPairs() > 0 && elapsed_seconds > 0) {
+    // The fraction of the wall-clock time that the threads of each stage spent
+    // working rather than waiting for jobs. A stage with low occupancy is
+    // starved by its predecessors, while the stage with the highest occupancy
+    // is the bottleneck of the pipeline.
+    const auto Occupancy = [elapsed_seconds](const double busy_seconds,
+                                             const size_t num_threads) {
+      return 100 * busy_seconds / (elapsed_seconds * num_threads);
+    };
+
+    double matching_seconds = 0;
+    for (const auto& matcher : matchers_) {
+      matching_seconds += matcher->BusySeconds();
+    }
+
+    double guided_matching_seconds = 0;
+    for (const auto& guided_matcher : guided_matchers_) {
+      guided_matching_seconds += guided_matcher->BusySeconds();
+    }
+
+    std::string occupancy = StringPrintf(
+        "matching %.1f%%, verification %.1f%%, ",
+        Occupancy(matching_seconds, matchers_.size()),
+        Occupancy(verification_seconds, verifiers_.size()));
+    if (!guided_matchers_.empty()) {
+      occupancy += StringPrintf(
+          "guided matching %.1f%%, ",
+          Occupancy(guided_matching_seconds, guided_matchers_.size()));
+    }
+    occupancy +=
+        StringPrintf("writing %.1f%%", Occupancy(writer_->BusySeconds(), 1));
+
+    std::cout << StringPrintf(
+                     "Matching pipeline: %d pairs written in %d transactions, "
+                     "stage occupancy: %s",
+                     writer_->NumWrittenPairs(), writer_->NumTransactions(),
+                     occupancy.c_str())
+              << std::endl;
+  }
 }
 
 bool SiftFeatureMatcher::Setup() {
@@ -774,6 +1189,8 @@ bool SiftFeatureMatcher::Setup() {
     guided_matcher->Start();
   }
 
+  writer_->Start();
+
   for (auto& matcher : matchers_) {
     if (!matcher->CheckValidSetup()) {
       return false;
@@ -788,53 +1205,45 @@ bool SiftFeatureMatcher::Setup() {
 
   is_setup_ = true;
 
+  timer_.Start();
+
   return true;
 }
 
 void SiftFeatureMatcher::Match(
     const std::vector<std::pair<image_t, image_t>>& image_pairs) {
+  MatchAsync(image_pairs);
+  Wait();
+}
+
+void SiftFeatureMatcher::MatchAsync(
+    const std::vector<std::pair<image_t, image_t>>& image_pairs) {
   CHECK_NOTNULL(database_);
   CHECK_NOTNULL(cache_);
   CHECK(is_setup_);
 
-  if (image_pairs.empty()) {
-    return;
-  }
-
-  //////////////////////////////////////////////////////////////////////////////
-  // Match the image pairs
-  //////////////////////////////////////////////////////////////////////////////
-
-  std::unordered_set<image_pair_t> image_pair_ids;
-  image_pair_ids.reserve(image_pairs.size());
-
-  size_t num_outputs = 0;
   for (const auto image_pair : image_pairs) {
     // Avoid self-matches.
     if (image_pair.first == image_pair.second) {
       continue;
     }
 
-    // Avoid duplicate image pairs.
-    const image_pair_t pair_id =
-        Database::ImagePairToPairId(image_pair.first, image_pair.second);
-    if (image_pair_ids.count(pair_id) > 0) {
+    // Avoid duplicate image pairs, both within this batch and with respect to
+    // previous batches that are still in the pipeline.
+    if (!writer_->AddPendingImagePair(image_pair.first, image_pair.second)) {
       continue;
     }
 
-    image_pair_ids.insert(pair_id);
-
     const bool exists_matches =
         cache_->ExistsMatches(image_pair.first, image_pair.second);
     const bool exists_inlier_matches =
         cache_->ExistsInlierMatches(image_pair.first, image_pair.second);
 
     if (exists_matches && exists_inlier_matches) {
+      writer_->RemovePendingImagePair(image_pair.first, image_pair.second);
       continue;
     }
 
-    num_outputs += 1;
-
     // If only one of the matches or inlier matches exist, we recompute them
     // from scratch and delete the existing results. This must be done before
     // pushing the jobs to the queue, otherwise database constraints might fail
@@ -856,31 +1265,11 @@ void SiftFeatureMatcher::Match(
       CHECK(matcher_queue_.Push(data));
     }
   }
+}
 
-  //////////////////////////////////////////////////////////////////////////////
-  // Write results to database
-  //////////////////////////////////////////////////////////////////////////////
-
-  for (size_t i = 0; i < num_outputs; ++i) {
-    const auto output_job = output_queue_.Pop();
-    CHECK(output_job.IsValid());
-    auto output = output_job.Data();
-
-    if (output.matches.size() < static_cast<size_t>(options_.min_num_inliers)) {
-      output.matches = {};
-    }
-
-    if (output.two_view_geometry.inlier_matches.size() <
-        static_cast<size_t>(options_.min_num_inliers)) {
-      output.two_view_geometry = TwoViewGeometry();
-    }
-
-    cache_->WriteMatches(output.image_id1, output.image_id2, output.matches);
-    cache_->WriteTwoViewGeometry(output.image_id1, output.image_id2,
-                                 output.two_view_geometry);
-  }
-
-  CHECK_EQ(output_queue_.Size(), 0);
+void SiftFeatureMatcher::Wait() {
+  CHECK(is_setup_);
+  writer_->WaitForPendingImagePairs();
 }
 
 ExhaustiveFeatureMatcher::ExhaustiveFeatureMatcher(
@@ -889,7 +1278,7 @@ ExhaustiveFeatureMatcher::ExhaustiveFeatureMatcher(
     : options_(options),
       match_options_(match_options),
       database_(database_path),
-      cache_(5 * options_.block_size, &database_),
+      cache_(GetCacheNumBytes(match_options_), &database_),
       matcher_(match_options, &database_, &cache_) {
   CHECK(options_.Check());
   CHECK(match_options_.Check());
@@ -914,6 +1303,24 @@ void ExhaustiveFeatureMatcher::Run() {
   std::vector<std::pair<image_t, image_t>> image_pairs;
   image_pairs.reserve(num_pairs_per_block);
 
+  // Load the features of the next block into the cache, while the current
+  // block is matched.
+  ThreadPool prefetch_thread_pool(1);
+  std::future<void> prefetch_future;
+  const auto PrefetchBlock = [this, &image_ids, block_size](
+                                 const size_t start_idx1,
+                                 const size_t start_idx2) {
+    for (const size_t start_idx : {start_idx1, start_idx2}) {
+      const size_t end_idx = std::min(image_ids.size(), start_idx + block_size);
+      for (size_t idx = start_idx; idx < end_idx; ++idx) {
+        if (cache_.ExistsDescriptors(image_ids[idx])) {
+          cache_.GetKeypoints(image_ids[idx]);
+          cache_.GetDescriptors(image_ids[idx]);
+        }
+      }
+    }
+  };
+
   for (size_t start_idx1 = 0; start_idx1 < image_ids.size();
        start_idx1 += block_size) {
     const size_t end_idx1 =
@@ -931,6 +1338,18 @@ void ExhaustiveFeatureMatcher::Run() {
       Timer timer;
       timer.Start();
 
+      if (prefetch_future.valid()) {
+        prefetch_future.wait();
+      }
+
+      if (start_idx2 + block_size < image_ids.size()) {
+        prefetch_future = prefetch_thread_pool.AddTask(
+            PrefetchBlock, start_idx1, start_idx2 + block_size);
+      } else if (start_idx1 + block_size < image_ids.size()) {
+        prefetch_future = prefetch_thread_pool.AddTask(
+            PrefetchBlock, start_idx1 + block_size, 0);
+      }
+
       std::cout << StringPrintf("Matching block [%d/%d, %d/%d]",
                                 start_idx1 / block_size + 1, num_blocks,
                                 start_idx2 / block_size + 1, num_blocks)
@@ -949,13 +1368,16 @@ void ExhaustiveFeatureMatcher::Run() {
         }
       }
 
-      DatabaseTransaction database_transaction(&database_);
-      matcher_.Match(image_pairs);
+      // Only wait for the block to be queued, so that its tail is matched
+      // while the next block is prefetched and queued.
+      matcher_.MatchAsync(image_pairs);
 
       PrintElapsedTime(timer);
     }
   }
 
+  matcher_.Wait();
+
   GetTimer().PrintMinutes();
 }
 
@@ -965,9 +1387,7 @@ SequentialFeatureMatcher::SequentialFeatureMatcher(
     : options_(options),
       match_options_(match_options),
       database_(database_path),
-      cache_(std::max(5 * options_.loop_detection_num_images,
-                      5 * options_.overlap),
-             &database_),
+      cache_(GetCacheNumBytes(match_options_), &database_),
       matcher_(match_options, &database_, &cache_) {
   CHECK(options_.Check());
   CHECK(match_options_.Check());
@@ -1051,7 +1471,6 @@ void SequentialFeatureMatcher::RunSequentialMatching(
       }
     }
 
-    DatabaseTransaction database_transaction(&database_);
     matcher_.Match(image_pairs);
 
     PrintElapsedTime(timer);
@@ -1096,7 +1515,7 @@ VocabTreeFeatureMatcher::VocabTreeFeatureMatcher(
     : options_(options),
       match_options_(match_options),
       database_(database_path),
-      cache_(5 * options_.num_images, &database_),
+      cache_(GetCacheNumBytes(match_options_), &database_),
       matcher_(match_options, &database_, &cache_) {
   CHECK(options_.Check());
   CHECK(match_options_.Check());
@@ -1111,13 +1530,30 @@ void VocabTreeFeatureMatcher::Run() {
 
   cache_.Setup();
 
-  // Read the pre-trained vocabulary tree from disk.
+  // Read the persistent visual index of previously matched images or the
+  // pre-trained vocabulary tree from disk.
+  const bool incremental =
+      !options_.index_path.empty() && ExistsFile(options_.index_path);
   retrieval::VisualIndex<> visual_index;
-  visual_index.Read(options_.vocab_tree_path);
+  if (incremental) {
+    visual_index.Read(options_.index_path);
+  } else {
+    visual_index.Read(options_.vocab_tree_path);
+  }
 
   const std::vector<image_t> all_image_ids = cache_.GetImageIds();
   std::vector<image_t> image_ids;
-  if (options_.match_list_path == "") {
+  if (options_.match_list_path == "" && incremental) {
+    // Only match the images that were added since the index was written.
+    for (const auto image_id : all_image_ids) {
+      if (!visual_index.ImageIndexed(image_id)) {
+        image_ids.push_back(image_id);
+      }
+    }
+    std::cout << StringPrintf("Matching %d new of %d images", image_ids.size(),
+                              all_image_ids.size())
+              << std::endl;
+  } else if (options_.match_list_path == "") {
     image_ids = cache_.GetImageIds();
   } else {
     // Map image names to image identifiers.
@@ -1150,7 +1586,7 @@ void VocabTreeFeatureMatcher::Run() {
   // Index all images in the visual index.
   IndexImagesInVisualIndex(match_options_.num_threads, options_.num_checks,
                            options_.max_num_features, all_image_ids, this,
-                           &cache_, &visual_index);
+                           &cache_, &visual_index, incremental);
 
   if (IsStopped()) {
     GetTimer().PrintMinutes();
@@ -1164,6 +1600,13 @@ void VocabTreeFeatureMatcher::Run() {
       options_.num_images_after_verification, options_.max_num_features,
       image_ids, this, &cache_, &visual_index, &matcher_);
 
+  // Only write the index once all new images are matched, since indexed images
+  // are not matched again in the next incremental run.
+  if (!options_.index_path.empty() && !IsStopped()) {
+    std::cout << "Writing visual index..." << std::endl;
+    visual_index.Write(options_.index_path);
+  }
+
   GetTimer().PrintMinutes();
 }
 
@@ -1173,7 +1616,7 @@ SpatialFeatureMatcher::SpatialFeatureMatcher(
     : options_(options),
       match_options_(match_options),
       database_(database_path),
-      cache_(5 * options_.max_num_neighbors, &database_),
+      cache_(GetCacheNumBytes(match_options_), &database_),
       matcher_(match_options, &database_, &cache_) {
   CHECK(options_.Check());
   CHECK(match_options_.Check());
@@ -1343,7 +1786,6 @@ void SpatialFeatureMatcher::Run() {
       image_pairs.emplace_back(image_id, nn_image_id);
     }
 
-    DatabaseTransaction database_transaction(&database_);
     matcher_.Match(image_pairs);
 
     PrintElapsedTime(timer);
@@ -1358,7 +1800,7 @@ TransitiveFeatureMatcher::TransitiveFeatureMatcher(
     : options_(options),
       match_options_(match_options),
       database_(database_path),
-      cache_(options_.batch_size, &database_),
+      cache_(GetCacheNumBytes(match_options_), &database_),
       matcher_(match_options, &database_, &cache_) {
   CHECK(options_.Check());
   CHECK(match_options_.Check());
@@ -1423,7 +1865,6 @@ void TransitiveFeatureMatcher::Run() {
                 num_batches += 1;
                 std::cout << StringPrintf("  Batch %d", num_batches)
                           << std::flush;
-                DatabaseTransaction database_transaction(&database_);
                 matcher_.Match(image_pairs);
                 image_pairs.clear();
                 PrintElapsedTime(timer);
@@ -1442,7 +1883,6 @@ void TransitiveFeatureMatcher::Run() {
 
     num_batches += 1;
     std::cout << StringPrintf("  Batch %d", num_batches) << std::flush;
-    DatabaseTransaction database_transaction(&database_);
     matcher_.Match(image_pairs);
     PrintElapsedTime(timer);
   }
@@ -1456,7 +1896,7 @@ ImagePairsFeatureMatcher::ImagePairsFeatureMatcher(
     : options_(options),
       match_options_(match_options),
       database_(database_path),
-      cache_(options.block_size, &database_),
+      cache_(GetCacheNumBytes(match_options_), &database_),
       matcher_(match_options, &database_, &cache_) {
   CHECK(options_.Check());
   CHECK(match_options_.Check());
@@ -1556,7 +1996,6 @@ void ImagePairsFeatureMatcher::Run() {
       block_image_pairs.push_back(image_pairs[j]);
     }
 
-    DatabaseTransaction database_transaction(&database_);
     matcher_.Match(block_image_pairs);
 
     PrintElapsedTime(timer);
@@ -1571,7 +2010,7 @@ FeaturePairsFeatureMatcher::FeaturePairsFeatureMatcher(
     : options_(options),
       match_options_(match_options),
       database_(database_path),
-      cache_(kCacheSize, &database_) {
+      cache_(GetCacheNumBytes(match_options_), &database_) {
   CHECK(options_.Check());
   CHECK(match_options_.Check());
 }
@@ -1690,8 +2129,8 @@ void FeaturePairsFeatureMatcher::Run() {
           match_options_.min_inlier_ratio;
 
       two_view_geometry.Estimate(
-          camera1, FeatureKeypointsToPointsVector(keypoints1), camera2,
-          FeatureKeypointsToPointsVector(keypoints2), matches,
+          camera1, FeatureKeypointsToPointsVector(*keypoints1), camera2,
+          FeatureKeypointsToPointsVector(*keypoints2), matches,
           two_view_geometry_options);
 
       database_.WriteTwoViewGeometry(image1.ImageId(), image2.ImageId(),
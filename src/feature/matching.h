@@ -34,6 +34,7 @@
 
 #include <array>
 #include <string>
+#include <unordered_set>
 #include <vector>
 
 #include "base/database.h"
@@ -114,6 +115,13 @@ struct VocabTreeMatchingOptions {
   // Optional path to file with specific image names to match.
   std::string match_list_path = "";
 
+  // Optional path to a persistent visual index of the database images for
+  // incremental matching. If the index exists, it is used instead of the
+  // vocabulary tree and only the images that are not yet indexed are added
+  // and matched against all indexed images. The updated index is written back
+  // after matching. The index is created from the vocabulary tree otherwise.
+  std::string index_path = "";
+
   bool Check() const;
 };
 
@@ -176,22 +184,34 @@ struct FeatureMatcherData {
 
 }  // namespace internal
 
-// Cache for feature matching to minimize database access during matching.
+// Cache for feature matching to minimize database access during matching. The
+// keypoints and descriptors are cached up to a maximum memory budget and are
+// shared with the caller, so that they remain valid after being evicted. All
+// methods are thread-safe, where the cached features are protected by sharded
+// locks and only the actual database access is serialized.
 class FeatureMatcherCache {
  public:
-  FeatureMatcherCache(const size_t cache_size, const Database* database);
+  FeatureMatcherCache(const size_t max_num_bytes, Database* database);
 
   void Setup();
 
   const Camera& GetCamera(const camera_t camera_id) const;
   const Image& GetImage(const image_t image_id) const;
-  const FeatureKeypoints& GetKeypoints(const image_t image_id);
-  const FeatureDescriptors& GetDescriptors(const image_t image_id);
+  std::shared_ptr<FeatureKeypoints> GetKeypoints(const image_t image_id);
+  std::shared_ptr<FeatureDescriptors> GetDescriptors(const image_t image_id);
+  std::shared_ptr<FeatureDescriptorCodes> GetDescriptorCodes(
+      const image_t image_id);
+  // Read the given rows of the full descriptors directly from the database,
+  // without caching them, e.g., to re-rank the candidates of descriptor codes.
+  FeatureDescriptors GetDescriptorRows(const image_t image_id,
+                                       const std::vector<int>& rows);
   FeatureMatches GetMatches(const image_t image_id1, const image_t image_id2);
   std::vector<image_t> GetImageIds() const;
 
   bool ExistsKeypoints(const image_t image_id);
   bool ExistsDescriptors(const image_t image_id);
+  bool ExistsDescriptorCodes(const image_t image_id);
+  bool ExistsFullDescriptors(const image_t image_id);
 
   bool ExistsMatches(const image_t image_id1, const image_t image_id2);
   bool ExistsInlierMatches(const image_t image_id1, const image_t image_id2);
@@ -201,19 +221,61 @@ class FeatureMatcherCache {
   void WriteTwoViewGeometry(const image_t image_id1, const image_t image_id2,
                             const TwoViewGeometry& two_view_geometry);
 
+  // Write the matches and two-view geometries of multiple image pairs in a
+  // single transaction, during which no other thread accesses the database.
+  void WriteMatchesAndTwoViewGeometries(
+      const std::vector<internal::FeatureMatcherData>& data);
+
   void DeleteMatches(const image_t image_id1, const image_t image_id2);
   void DeleteInlierMatches(const image_t image_id1, const image_t image_id2);
 
+  // Print the memory usage and the hit and miss statistics of the keypoints
+  // and descriptors caches.
+  void PrintStatistics() const;
+
  private:
-  const size_t cache_size_;
-  const Database* database_;
+  static const size_t kNumShards = 16;
+
+  struct CachedKeypoints {
+    std::shared_ptr<FeatureKeypoints> keypoints;
+    size_t NumBytes() const {
+      return keypoints->size() * sizeof(FeatureKeypoint);
+    }
+  };
+
+  struct CachedDescriptors {
+    std::shared_ptr<FeatureDescriptors> descriptors;
+    size_t NumBytes() const {
+      return descriptors->size() * sizeof(FeatureDescriptors::Scalar);
+    }
+  };
+
+  struct CachedDescriptorCodes {
+    std::shared_ptr<FeatureDescriptorCodes> descriptor_codes;
+    size_t NumBytes() const {
+      return (descriptor_codes->codebook.size() +
+              descriptor_codes->codes.size()) *
+             sizeof(FeatureDescriptors::Scalar);
+    }
+  };
+
+  const size_t max_num_bytes_;
+  Database* database_;
   std::mutex database_mutex_;
+  std::mutex exists_mutex_;
   EIGEN_STL_UMAP(camera_t, Camera) cameras_cache_;
   EIGEN_STL_UMAP(image_t, Image) images_cache_;
-  std::unique_ptr<LRUCache<image_t, FeatureKeypoints>> keypoints_cache_;
-  std::unique_ptr<LRUCache<image_t, FeatureDescriptors>> descriptors_cache_;
+  std::unique_ptr<ShardedMemoryConstrainedLRUCache<image_t, CachedKeypoints>>
+      keypoints_cache_;
+  std::unique_ptr<ShardedMemoryConstrainedLRUCache<image_t, CachedDescriptors>>
+      descriptors_cache_;
+  std::unique_ptr<
+      ShardedMemoryConstrainedLRUCache<image_t, CachedDescriptorCodes>>
+      descriptor_codes_cache_;
   std::unique_ptr<LRUCache<image_t, bool>> keypoints_exists_cache_;
   std::unique_ptr<LRUCache<image_t, bool>> descriptors_exists_cache_;
+  std::unique_ptr<LRUCache<image_t, bool>> descriptor_codes_exists_cache_;
+  std::unique_ptr<LRUCache<image_t, bool>> full_descriptors_exists_cache_;
 };
 
 class FeatureMatcherThread : public Thread {
@@ -223,9 +285,14 @@ class FeatureMatcherThread : public Thread {
 
   void SetMaxNumMatches(const int max_num_matches);
 
+  // The accumulated time spent matching image pairs, excluding the time spent
+  // waiting for new jobs. Only valid after the thread finished.
+  double BusySeconds() const;
+
  protected:
   SiftMatchingOptions options_;
   FeatureMatcherCache* cache_;
+  Timer busy_timer_;
 };
 
 class SiftCPUFeatureMatcher : public FeatureMatcherThread {
@@ -268,7 +335,7 @@ class SiftGPUFeatureMatcher : public FeatureMatcherThread {
 
   // The previously uploaded images to the GPU.
   std::array<image_t, 2> prev_uploaded_image_ids_;
-  std::array<FeatureDescriptors, 2> prev_uploaded_descriptors_;
+  std::array<std::shared_ptr<FeatureDescriptors>, 2> prev_uploaded_descriptors_;
 };
 
 class GuidedSiftCPUFeatureMatcher : public FeatureMatcherThread {
@@ -312,8 +379,8 @@ class GuidedSiftGPUFeatureMatcher : public FeatureMatcherThread {
 
   // The previously uploaded images to the GPU.
   std::array<image_t, 2> prev_uploaded_image_ids_;
-  std::array<FeatureKeypoints, 2> prev_uploaded_keypoints_;
-  std::array<FeatureDescriptors, 2> prev_uploaded_descriptors_;
+  std::array<std::shared_ptr<FeatureKeypoints>, 2> prev_uploaded_keypoints_;
+  std::array<std::shared_ptr<FeatureDescriptors>, 2> prev_uploaded_descriptors_;
 };
 
 class TwoViewGeometryVerifier : public Thread {
@@ -326,6 +393,12 @@ class TwoViewGeometryVerifier : public Thread {
                           JobQueue<Input>* input_queue,
                           JobQueue<Output>* output_queue);
 
+  // The number of geometrically verified image pairs and the accumulated time
+  // spent in the two-view geometry estimation. Only valid after the thread
+  // finished.
+  size_t NumVerifiedPairs() const;
+  double VerificationSeconds() const;
+
  protected:
   void Run() override;
 
@@ -334,13 +407,68 @@ class TwoViewGeometryVerifier : public Thread {
   FeatureMatcherCache* cache_;
   JobQueue<Input>* input_queue_;
   JobQueue<Output>* output_queue_;
+
+  size_t num_verified_pairs_;
+  Timer verification_timer_;
+};
+
+// Writes the results of the matching pipeline to the database. A single
+// thread commits all results, where each transaction contains as many of the
+// queued results as available (up to `kMaxNumWritesPerTransaction`). The
+// transactions go through the cache, which serializes them with the database
+// reads of the matching and verification threads.
+class FeatureMatcherDatabaseWriter : public Thread {
+ public:
+  typedef internal::FeatureMatcherData Input;
+
+  FeatureMatcherDatabaseWriter(const SiftMatchingOptions& options,
+                               FeatureMatcherCache* cache,
+                               JobQueue<Input>* input_queue);
+
+  // Mark an image pair as in-flight before pushing it into the pipeline.
+  // Returns false if the image pair is already in-flight, in which case it
+  // must not be pushed again.
+  bool AddPendingImagePair(const image_t image_id1, const image_t image_id2);
+
+  // Release an in-flight image pair without writing it.
+  void RemovePendingImagePair(const image_t image_id1, const image_t image_id2);
+
+  // Block until all in-flight image pairs have been committed.
+  void WaitForPendingImagePairs();
+
+  // Statistics of the written results. Only valid after the thread finished.
+  size_t NumWrittenPairs() const;
+  size_t NumTransactions() const;
+  double BusySeconds() const;
+
+ private:
+  static const size_t kMaxNumWritesPerTransaction = 1000;
+
+  void Run() override;
+
+  // Discard results with too few inliers.
+  void Filter(Input* output) const;
+
+  const SiftMatchingOptions options_;
+  FeatureMatcherCache* cache_;
+  JobQueue<Input>* input_queue_;
+
+  std::mutex pending_mutex_;
+  std::condition_variable pending_condition_;
+  std::unordered_set<image_pair_t> pending_image_pair_ids_;
+
+  size_t num_written_pairs_;
+  size_t num_transactions_;
+  Timer busy_timer_;
 };
 
 // Multi-threaded and multi-GPU SIFT feature matcher, which writes the computed
-// results to the database and skips already matched image pairs. To improve
-// performance of the matching by taking advantage of caching and database
-// transactions, pass multiple images to the `Match` function. Note that the
-// database should be in an active transaction while calling `Match`.
+// results to the database and skips already matched image pairs. Matching,
+// geometric verification, and writing run as a pipeline of threads connected
+// by bounded job queues, and a single writer thread commits the results in
+// batched transactions. Hence, the database must not be in an active
+// transaction while calling `Match`. To overlap consecutive batches, push them
+// with `MatchAsync` and call `Wait` once all batches are pushed.
 class SiftFeatureMatcher {
  public:
   SiftFeatureMatcher(const SiftMatchingOptions& options, Database* database,
@@ -351,9 +479,17 @@ class SiftFeatureMatcher {
   // Setup the matchers and return if successful.
   bool Setup();
 
-  // Match one batch of multiple image pairs.
+  // Match one batch of multiple image pairs and wait until the results are
+  // written to the database.
   void Match(const std::vector<std::pair<image_t, image_t>>& image_pairs);
 
+  // Push one batch of multiple image pairs into the pipeline. Returns once all
+  // image pairs are queued, which may be before they are matched.
+  void MatchAsync(const std::vector<std::pair<image_t, image_t>>& image_pairs);
+
+  // Wait until all pushed image pairs are written to the database.
+  void Wait();
+
  private:
   SiftMatchingOptions options_;
   Database* database_;
@@ -361,9 +497,13 @@ class SiftFeatureMatcher {
 
   bool is_setup_;
 
+  // Wall-clock time since setup, used to compute the stage occupancies.
+  Timer timer_;
+
   std::vector<std::unique_ptr<FeatureMatcherThread>> matchers_;
   std::vector<std::unique_ptr<FeatureMatcherThread>> guided_matchers_;
-  std::vector<std::unique_ptr<Thread>> verifiers_;
+  std::vector<std::unique_ptr<TwoViewGeometryVerifier>> verifiers_;
+  std::unique_ptr<FeatureMatcherDatabaseWriter> writer_;
   std::unique_ptr<ThreadPool> thread_pool_;
 
   JobQueue<internal::FeatureMatcherData> matcher_queue_;
@@ -551,8 +691,6 @@ class FeaturePairsFeatureMatcher : public Thread {
                              const std::string& database_path);
 
  private:
-  const static size_t kCacheSize = 100;
-
   void Run() override;
 
   const FeaturePairsMatchingOptions options_;
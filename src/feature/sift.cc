@@ -31,6 +31,7 @@
 
 #include "feature/sift.h"
 
+#include <algorithm>
 #include <array>
 #include <fstream>
 #include <memory>
@@ -39,6 +40,7 @@
 #include "SiftGPU/SiftGPU.h"
 #include "VLFeat/covdet.h"
 #include "VLFeat/sift.h"
+#include "feature/sift_kernels.h"
 #include "feature/utils.h"
 #include "util/cuda.h"
 #include "util/logging.h"
@@ -49,7 +51,7 @@
 namespace colmap {
 namespace {
 
-size_t FindBestMatchesOneWayBruteForce(const Eigen::MatrixXi& dists,
+size_t FindBestMatchesOneWayBruteForce(const SiftNearestNeighbors& neighbors,
                                        const float max_ratio,
                                        const float max_distance,
                                        std::vector<int>* matches) {
@@ -57,22 +59,10 @@ size_t FindBestMatchesOneWayBruteForce(const Eigen::MatrixXi& dists,
   const float kDistNorm = 1.0f / (512.0f * 512.0f);
 
   size_t num_matches = 0;
-  matches->resize(dists.rows(), -1);
+  matches->resize(neighbors.best_idx.size(), -1);
 
-  for (Eigen::Index i1 = 0; i1 < dists.rows(); ++i1) {
-    int best_i2 = -1;
-    int best_dist = 0;
-    int second_best_dist = 0;
-    for (Eigen::Index i2 = 0; i2 < dists.cols(); ++i2) {
-      const int dist = dists(i1, i2);
-      if (dist > best_dist) {
-        best_i2 = i2;
-        second_best_dist = best_dist;
-        best_dist = dist;
-      } else if (dist > second_best_dist) {
-        second_best_dist = dist;
-      }
-    }
+  for (size_t i1 = 0; i1 < neighbors.best_idx.size(); ++i1) {
+    const int best_i2 = neighbors.best_idx[i1];
 
     // Check if any match found.
     if (best_i2 == -1) {
@@ -80,7 +70,7 @@ size_t FindBestMatchesOneWayBruteForce(const Eigen::MatrixXi& dists,
     }
 
     const float best_dist_normed =
-        std::acos(std::min(kDistNorm * best_dist, 1.0f));
+        std::acos(std::min(kDistNorm * neighbors.best_dist[i1], 1.0f));
 
     // Check if match distance passes threshold.
     if (best_dist_normed > max_distance) {
@@ -88,7 +78,7 @@ size_t FindBestMatchesOneWayBruteForce(const Eigen::MatrixXi& dists,
     }
 
     const float second_best_dist_normed =
-        std::acos(std::min(kDistNorm * second_best_dist, 1.0f));
+        std::acos(std::min(kDistNorm * neighbors.second_best_dist[i1], 1.0f));
 
     // Check if match passes ratio test. Keep this comparison >= in order to
     // ensure that the case of best == second_best is detected.
@@ -103,20 +93,28 @@ size_t FindBestMatchesOneWayBruteForce(const Eigen::MatrixXi& dists,
   return num_matches;
 }
 
-void FindBestMatchesBruteForce(const Eigen::MatrixXi& dists,
+void FindBestMatchesBruteForce(const FeatureDescriptors& descriptors1,
+                               const FeatureDescriptors& descriptors2,
+                               const SiftGuidedFilter* guided_filter,
                                const float max_ratio, const float max_distance,
                                const bool cross_check,
                                FeatureMatches* matches) {
   matches->clear();
 
+  SiftNearestNeighbors neighbors12;
+  SiftNearestNeighbors neighbors21;
+  ComputeSiftNearestNeighbors(descriptors1, descriptors2, guided_filter,
+                              &neighbors12,
+                              cross_check ? &neighbors21 : nullptr);
+
   std::vector<int> matches12;
   const size_t num_matches12 = FindBestMatchesOneWayBruteForce(
-      dists, max_ratio, max_distance, &matches12);
+      neighbors12, max_ratio, max_distance, &matches12);
 
   if (cross_check) {
     std::vector<int> matches21;
     const size_t num_matches21 = FindBestMatchesOneWayBruteForce(
-        dists.transpose(), max_ratio, max_distance, &matches21);
+        neighbors21, max_ratio, max_distance, &matches21);
     matches->reserve(std::min(num_matches12, num_matches21));
     for (size_t i1 = 0; i1 < matches12.size(); ++i1) {
       if (matches12[i1] != -1 && matches21[matches12[i1]] != -1 &&
@@ -165,41 +163,6 @@ FeatureDescriptors TransformVLFeatToUBCFeatureDescriptors(
   return ubc_descriptors;
 }
 
-Eigen::MatrixXi ComputeSiftDistanceMatrix(
-    const FeatureKeypoints* keypoints1, const FeatureKeypoints* keypoints2,
-    const FeatureDescriptors& descriptors1,
-    const FeatureDescriptors& descriptors2,
-    const std::function<bool(float, float, float, float)>& guided_filter) {
-  if (guided_filter != nullptr) {
-    CHECK_NOTNULL(keypoints1);
-    CHECK_NOTNULL(keypoints2);
-    CHECK_EQ(keypoints1->size(), descriptors1.rows());
-    CHECK_EQ(keypoints2->size(), descriptors2.rows());
-  }
-
-  const Eigen::Matrix<int, Eigen::Dynamic, 128> descriptors1_int =
-      descriptors1.cast<int>();
-  const Eigen::Matrix<int, Eigen::Dynamic, 128> descriptors2_int =
-      descriptors2.cast<int>();
-
-  Eigen::Matrix<int, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> dists(
-      descriptors1.rows(), descriptors2.rows());
-
-  for (FeatureDescriptors::Index i1 = 0; i1 < descriptors1.rows(); ++i1) {
-    for (FeatureDescriptors::Index i2 = 0; i2 < descriptors2.rows(); ++i2) {
-      if (guided_filter != nullptr &&
-          guided_filter((*keypoints1)[i1].x, (*keypoints1)[i1].y,
-                        (*keypoints2)[i2].x, (*keypoints2)[i2].y)) {
-        dists(i1, i2) = 0;
-      } else {
-        dists(i1, i2) = descriptors1_int.row(i1).dot(descriptors2_int.row(i2));
-      }
-    }
-  }
-
-  return dists;
-}
-
 void FindNearestNeighborsFLANN(
     const FeatureDescriptors& query, const FeatureDescriptors& database,
     Eigen::Matrix<int, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>*
@@ -246,6 +209,150 @@ void FindNearestNeighborsFLANN(
   }
 }
 
+// Select the descriptors, whose two best candidates on the descriptor codes
+// pass the ratio test with the given maximum ratio, where a missing second
+// candidate has zero similarity.
+std::vector<char> SelectDescriptorCodeCandidates(
+    const SiftCodeCandidates& candidates, const float max_ratio) {
+  // SIFT descriptor vectors are normalized to length 512.
+  const float kDistNorm = 1.0f / (512.0f * 512.0f);
+
+  const int num_candidates = candidates.num_candidates;
+  std::vector<char> selected(candidates.idxs.size() / num_candidates, 0);
+  for (size_t i = 0; i < selected.size(); ++i) {
+    const int* idxs = candidates.idxs.data() + i * num_candidates;
+    const int* similarities =
+        candidates.similarities.data() + i * num_candidates;
+    if (idxs[0] == -1) {
+      continue;
+    }
+
+    const int second_best_similarity =
+        (num_candidates > 1 && idxs[1] != -1) ? similarities[1] : 0;
+    const float best_dist_normed =
+        std::acos(std::min(kDistNorm * similarities[0], 1.0f));
+    const float second_best_dist_normed =
+        std::acos(std::min(kDistNorm * second_best_similarity, 1.0f));
+    selected[i] = best_dist_normed <= max_ratio * second_best_dist_normed;
+  }
+
+  return selected;
+}
+
+// Mark the rows of both images that are required to re-rank the candidates of
+// the selected descriptors of the first image.
+void MarkRequiredDescriptorRows(const SiftCodeCandidates& candidates12,
+                                const std::vector<char>& selected1,
+                                std::vector<char>* required1,
+                                std::vector<char>* required2) {
+  const int num_candidates = candidates12.num_candidates;
+  for (size_t i1 = 0; i1 < selected1.size(); ++i1) {
+    if (!selected1[i1]) {
+      continue;
+    }
+    (*required1)[i1] = 1;
+    for (int k = 0; k < num_candidates; ++k) {
+      const int i2 = candidates12.idxs[i1 * num_candidates + k];
+      if (i2 == -1) {
+        break;
+      }
+      (*required2)[i2] = 1;
+    }
+  }
+}
+
+// Read the required rows and store for each row its index in the returned
+// descriptors or -1, if the row is not required.
+FeatureDescriptors ReadRequiredDescriptorRows(
+    const FeatureDescriptorRowsReader& read_descriptor_rows,
+    const std::vector<char>& required, std::vector<int>* descriptor_idxs) {
+  std::vector<int> rows;
+  descriptor_idxs->assign(required.size(), -1);
+  for (size_t row = 0; row < required.size(); ++row) {
+    if (required[row]) {
+      (*descriptor_idxs)[row] = static_cast<int>(rows.size());
+      rows.push_back(static_cast<int>(row));
+    }
+  }
+
+  if (rows.empty()) {
+    return FeatureDescriptors(0, FeatureDescriptorCodes::kNumDims);
+  }
+
+  const FeatureDescriptors descriptors = read_descriptor_rows(rows);
+  CHECK_EQ(descriptors.rows(), rows.size());
+  CHECK_EQ(descriptors.cols(), FeatureDescriptorCodes::kNumDims);
+  return descriptors;
+}
+
+// Find the two nearest neighbors of the selected descriptors among their
+// candidates on the descriptor codes, in the same format as
+// `FindNearestNeighborsFLANN`. If the descriptors are given, the candidates are
+// re-ranked by their exact dot products, where the rows of both images are
+// looked up in `descriptor_idxs1` and `descriptor_idxs2`. Otherwise, the code
+// similarities are used. Descriptors that are not selected get no neighbors.
+void FindNearestNeighborsDescriptorCodes(
+    const SiftCodeCandidates& candidates12, const std::vector<char>& selected1,
+    const FeatureDescriptors* descriptors1,
+    const std::vector<int>& descriptor_idxs1,
+    const FeatureDescriptors* descriptors2,
+    const std::vector<int>& descriptor_idxs2, const int num_descriptors2,
+    Eigen::Matrix<int, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>*
+        indices,
+    Eigen::Matrix<int, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>*
+        distances) {
+  const int kNumNearestNeighbors = 2;
+  const int num_nearest_neighbors =
+      std::min(kNumNearestNeighbors, num_descriptors2);
+  const int num_candidates = candidates12.num_candidates;
+
+  indices->setConstant(selected1.size(), num_nearest_neighbors, -1);
+  distances->setZero(selected1.size(), num_nearest_neighbors);
+
+  std::vector<std::pair<int, int>> ranked_candidates;
+  ranked_candidates.reserve(num_candidates);
+
+  for (size_t i1 = 0; i1 < selected1.size(); ++i1) {
+    if (!selected1[i1]) {
+      continue;
+    }
+
+    ranked_candidates.clear();
+    for (int k = 0; k < num_candidates; ++k) {
+      const int i2 = candidates12.idxs[i1 * num_candidates + k];
+      if (i2 == -1) {
+        break;
+      }
+      if (descriptors1 == nullptr) {
+        ranked_candidates.emplace_back(
+            candidates12.similarities[i1 * num_candidates + k], i2);
+      } else {
+        ranked_candidates.emplace_back(
+            descriptors1->row(descriptor_idxs1[i1])
+                .cast<int>()
+                .dot(descriptors2->row(descriptor_idxs2[i2]).cast<int>()),
+            i2);
+      }
+    }
+
+    CHECK_GE(ranked_candidates.size(), num_nearest_neighbors);
+    std::partial_sort(ranked_candidates.begin(),
+                      ranked_candidates.begin() + num_nearest_neighbors,
+                      ranked_candidates.end(),
+                      [](const std::pair<int, int>& candidate1,
+                         const std::pair<int, int>& candidate2) {
+                        return candidate1.first > candidate2.first ||
+                               (candidate1.first == candidate2.first &&
+                                candidate1.second < candidate2.second);
+                      });
+
+    for (int k = 0; k < num_nearest_neighbors; ++k) {
+      (*indices)(i1, k) = ranked_candidates[k].second;
+      (*distances)(i1, k) = ranked_candidates[k].first;
+    }
+  }
+}
+
 size_t FindBestMatchesOneWayFLANN(
     const Eigen::Matrix<int, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>&
         indices,
@@ -381,6 +488,15 @@ bool SiftExtractionOptions::Check() const {
     CHECK_OPTION_GE(dsp_max_scale, dsp_min_scale);
     CHECK_OPTION_GT(dsp_num_scales, 0);
   }
+  if (split_views) {
+    CHECK_OPTION_GE(split_num_views, 2);
+    CHECK_OPTION_GE(split_min_radius, 0);
+    CHECK_OPTION_GT(split_max_radius, split_min_radius);
+    CHECK_OPTION_GE(split_max_duplicate_distance, 0);
+  }
+  if (descriptor_codes_only) {
+    CHECK_OPTION(write_descriptor_codes);
+  }
   return true;
 }
 
@@ -397,6 +513,10 @@ bool SiftMatchingOptions::Check() const {
   CHECK_OPTION_GE(min_inlier_ratio, 0);
   CHECK_OPTION_LE(min_inlier_ratio, 1);
   CHECK_OPTION_GE(min_num_inliers, 0);
+  CHECK_OPTION_GT(cache_size, 0);
+  CHECK_OPTION_GE(num_descriptor_code_candidates, 2);
+  CHECK_OPTION_GT(descriptor_code_max_ratio, 0.0);
+  CHECK_OPTION_LE(descriptor_code_max_ratio, 1.0);
   return true;
 }
 
@@ -965,11 +1085,8 @@ void MatchSiftFeaturesCPUBruteForce(const SiftMatchingOptions& match_options,
   CHECK(match_options.Check());
   CHECK_NOTNULL(matches);
 
-  const Eigen::MatrixXi distances = ComputeSiftDistanceMatrix(
-      nullptr, nullptr, descriptors1, descriptors2, nullptr);
-
-  FindBestMatchesBruteForce(distances, match_options.max_ratio,
-                            match_options.max_distance,
+  FindBestMatchesBruteForce(descriptors1, descriptors2, nullptr,
+                            match_options.max_ratio, match_options.max_distance,
                             match_options.cross_check, matches);
 }
 
@@ -1009,6 +1126,87 @@ void MatchSiftFeaturesCPU(const SiftMatchingOptions& match_options,
   MatchSiftFeaturesCPUFLANN(match_options, descriptors1, descriptors2, matches);
 }
 
+void MatchSiftFeaturesCPUDescriptorCodes(
+    const SiftMatchingOptions& match_options,
+    const FeatureDescriptorCodes& descriptor_codes1,
+    const FeatureDescriptorCodes& descriptor_codes2,
+    const FeatureDescriptorRowsReader& read_descriptor_rows1,
+    const FeatureDescriptorRowsReader& read_descriptor_rows2,
+    FeatureMatches* matches) {
+  CHECK(match_options.Check());
+  CHECK_NOTNULL(matches);
+
+  const int num_descriptors1 = static_cast<int>(descriptor_codes1.codes.rows());
+  const int num_descriptors2 = static_cast<int>(descriptor_codes2.codes.rows());
+  if (num_descriptors1 == 0 || num_descriptors2 == 0) {
+    matches->clear();
+    return;
+  }
+
+  SiftCodeCandidates candidates12;
+  SiftCodeCandidates candidates21;
+  ComputeSiftCodeCandidates(descriptor_codes1, descriptor_codes2,
+                            match_options.num_descriptor_code_candidates,
+                            &candidates12);
+  std::vector<char> selected1 = SelectDescriptorCodeCandidates(
+      candidates12, match_options.descriptor_code_max_ratio);
+  std::vector<char> selected2;
+  if (match_options.cross_check) {
+    ComputeSiftCodeCandidates(descriptor_codes2, descriptor_codes1,
+                              match_options.num_descriptor_code_candidates,
+                              &candidates21);
+    selected2 = SelectDescriptorCodeCandidates(
+        candidates21, match_options.descriptor_code_max_ratio);
+  }
+
+  // Read only the rows of the full descriptors that are required to re-rank
+  // the candidates of the selected descriptors in both directions.
+  const bool rerank = read_descriptor_rows1 && read_descriptor_rows2;
+  FeatureDescriptors descriptors1;
+  FeatureDescriptors descriptors2;
+  std::vector<int> descriptor_idxs1;
+  std::vector<int> descriptor_idxs2;
+  if (rerank) {
+    std::vector<char> required1(num_descriptors1, 0);
+    std::vector<char> required2(num_descriptors2, 0);
+    MarkRequiredDescriptorRows(candidates12, selected1, &required1,
+                               &required2);
+    if (match_options.cross_check) {
+      MarkRequiredDescriptorRows(candidates21, selected2, &required2,
+                                 &required1);
+    }
+    descriptors1 = ReadRequiredDescriptorRows(read_descriptor_rows1, required1,
+                                              &descriptor_idxs1);
+    descriptors2 = ReadRequiredDescriptorRows(read_descriptor_rows2, required2,
+                                              &descriptor_idxs2);
+  }
+
+  Eigen::Matrix<int, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>
+      indices_1to2;
+  Eigen::Matrix<int, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>
+      distances_1to2;
+  Eigen::Matrix<int, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>
+      indices_2to1;
+  Eigen::Matrix<int, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>
+      distances_2to1;
+
+  FindNearestNeighborsDescriptorCodes(
+      candidates12, selected1, rerank ? &descriptors1 : nullptr,
+      descriptor_idxs1, rerank ? &descriptors2 : nullptr, descriptor_idxs2,
+      num_descriptors2, &indices_1to2, &distances_1to2);
+  if (match_options.cross_check) {
+    FindNearestNeighborsDescriptorCodes(
+        candidates21, selected2, rerank ? &descriptors2 : nullptr,
+        descriptor_idxs2, rerank ? &descriptors1 : nullptr, descriptor_idxs1,
+        num_descriptors1, &indices_2to1, &distances_2to1);
+  }
+
+  FindBestMatchesFLANN(indices_1to2, distances_1to2, indices_2to1,
+                       distances_2to1, match_options.max_ratio,
+                       match_options.max_distance, match_options.cross_check,
+                       matches);
+}
+
 void MatchGuidedSiftFeaturesCPU(const SiftMatchingOptions& match_options,
                                 const FeatureKeypoints& keypoints1,
                                 const FeatureKeypoints& keypoints2,
@@ -1023,62 +1221,29 @@ void MatchGuidedSiftFeaturesCPU(const SiftMatchingOptions& match_options,
   const Eigen::Matrix3f F = two_view_geometry->F.cast<float>();
   const Eigen::Matrix3f H = two_view_geometry->H.cast<float>();
 
-  std::function<bool(float, float, float, float)> guided_filter;
+  std::unique_ptr<SiftGuidedFilter> guided_filter;
   if (two_view_geometry->config == TwoViewGeometry::CALIBRATED ||
       two_view_geometry->config == TwoViewGeometry::UNCALIBRATED) {
-    guided_filter = [&](const float x1, const float y1, const float x2,
-                        const float y2) {
-      const Eigen::Vector3f p1(x1, y1, 1.0f);
-      const Eigen::Vector3f p2(x2, y2, 1.0f);
-      const Eigen::Vector3f Fx1 = F * p1;
-      const Eigen::Vector3f Ftx2 = F.transpose() * p2;
-      const float x2tFx1 = p2.transpose() * Fx1;
-      return x2tFx1 * x2tFx1 /
-                 (Fx1(0) * Fx1(0) + Fx1(1) * Fx1(1) + Ftx2(0) * Ftx2(0) +
-                  Ftx2(1) * Ftx2(1)) >
-             max_residual;
-    };
+    guided_filter.reset(new SiftGuidedFilter(SiftGuidedFilter::Epipolar(
+        F, keypoints1, keypoints2, max_residual)));
   } else if (two_view_geometry->config == TwoViewGeometry::PLANAR ||
              two_view_geometry->config == TwoViewGeometry::PANORAMIC ||
              two_view_geometry->config ==
                  TwoViewGeometry::PLANAR_OR_PANORAMIC) {
-    guided_filter = [&](const float x1, const float y1, const float x2,
-                        const float y2) {
-      const Eigen::Vector3f p1(x1, y1, 1.0f);
-      const Eigen::Vector2f p2(x2, y2);
-      return ((H * p1).hnormalized() - p2).squaredNorm() > max_residual;
-    };
+    guided_filter.reset(new SiftGuidedFilter(SiftGuidedFilter::Homography(
+        H, keypoints1, keypoints2, max_residual)));
   } else {
     return;
   }
 
   CHECK(guided_filter);
+  CHECK_EQ(keypoints1.size(), descriptors1.rows());
+  CHECK_EQ(keypoints2.size(), descriptors2.rows());
 
-  const Eigen::MatrixXi dists = ComputeSiftDistanceMatrix(
-      &keypoints1, &keypoints2, descriptors1, descriptors2, guided_filter);
-
-  Eigen::Matrix<int, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>
-      indices_1to2(dists.rows(), dists.cols());
-  Eigen::Matrix<int, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>
-      indices_2to1(dists.cols(), dists.rows());
-  Eigen::Matrix<int, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>
-      distances_1to2 = dists;
-  Eigen::Matrix<int, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>
-      distances_2to1 = dists.transpose();
-
-  for (int i = 0; i < indices_1to2.rows(); ++i) {
-    indices_1to2.row(i) = Eigen::VectorXi::LinSpaced(indices_1to2.cols(), 0,
-                                                     indices_1to2.cols() - 1);
-  }
-  for (int i = 0; i < indices_2to1.rows(); ++i) {
-    indices_2to1.row(i) = Eigen::VectorXi::LinSpaced(indices_2to1.cols(), 0,
-                                                     indices_2to1.cols() - 1);
-  }
-
-  FindBestMatchesFLANN(indices_1to2, distances_1to2, indices_2to1,
-                       distances_2to1, match_options.max_ratio,
-                       match_options.max_distance, match_options.cross_check,
-                       &two_view_geometry->inlier_matches);
+  FindBestMatchesBruteForce(descriptors1, descriptors2, guided_filter.get(),
+                            match_options.max_ratio, match_options.max_distance,
+                            match_options.cross_check,
+                            &two_view_geometry->inlier_matches);
 }
 
 bool CreateSiftGPUMatcher(const SiftMatchingOptions& match_options,
@@ -32,6 +32,9 @@
 #ifndef COLMAP_SRC_FEATURE_SIFT_H_
 #define COLMAP_SRC_FEATURE_SIFT_H_
 
+#include <functional>
+#include <vector>
+
 #include "estimators/two_view_geometry.h"
 #include "feature/types.h"
 #include "util/bitmap.h"
@@ -110,6 +113,30 @@ struct SiftExtractionOptions {
   };
   Normalization normalization = Normalization::L1_ROOT;
 
+  // Whether to additionally store product-quantized descriptor codes in the
+  // database, which the CPU matcher can search before re-ranking the best
+  // candidates with the full descriptors (see `QuantizeFeatureDescriptors`).
+  bool write_descriptor_codes = false;
+
+  // Whether to store only the descriptor codes and no full descriptors, which
+  // shrinks the stored descriptors by about a factor of 8. The CPU matcher then
+  // ranks the candidates by their code similarities and all other consumers
+  // read the decoded codes (see `Database::ReadDescriptors`).
+  bool descriptor_codes_only = false;
+
+  // Whether to extract features from multiple overlapping views that unwrap
+  // the ring between a minimum and maximum radius around the principal point
+  // of the camera, e.g., for catadioptric cameras or wide fisheye lenses. The
+  // radii are specified in pixels of the original image. The keypoints are
+  // mapped back to the original image and duplicate keypoints in the overlap
+  // of adjacent views are removed. Note that the maximum number of features
+  // applies to each view separately.
+  bool split_views = false;
+  int split_num_views = 8;
+  double split_min_radius = 350.0;
+  double split_max_radius = 1250.0;
+  double split_max_duplicate_distance = 2.0;
+
   bool Check() const;
 };
 
@@ -161,6 +188,25 @@ struct SiftMatchingOptions {
   // Whether to perform guided matching, if geometric verification succeeds.
   bool guided_matching = false;
 
+  // Whether to search for nearest neighbors on the product-quantized
+  // descriptor codes (see `SiftExtractionOptions::write_descriptor_codes`) in
+  // CPU matching. Only the full descriptors of the best candidates are read
+  // for re-ranking. Image pairs without codes are matched as usual. Matching on
+  // the codes is not supported on the GPU.
+  bool use_descriptor_codes = false;
+
+  // Number of nearest neighbor candidates on the descriptor codes, which are
+  // re-ranked with the full descriptors.
+  int num_descriptor_code_candidates = 8;
+
+  // Maximum distance ratio between the two best candidates on the descriptor
+  // codes for a descriptor to be re-ranked. It is less strict than `max_ratio`
+  // due to the quantization error of the codes.
+  double descriptor_code_max_ratio = 0.95;
+
+  // The maximum memory in gigabytes of the cached keypoints and descriptors.
+  double cache_size = 4.0;
+
   bool Check() const;
 };
 
@@ -223,6 +269,27 @@ void MatchSiftFeaturesCPU(const SiftMatchingOptions& match_options,
                           const FeatureDescriptors& descriptors1,
                           const FeatureDescriptors& descriptors2,
                           FeatureMatches* matches);
+
+// Read the full descriptors of the given rows of an image, e.g., on demand from
+// the database (see `Database::ReadDescriptorRows`).
+typedef std::function<FeatureDescriptors(const std::vector<int>& rows)>
+    FeatureDescriptorRowsReader;
+
+// Match the given product-quantized descriptor codes on the CPU. The candidate
+// neighbors of each descriptor are found by a fast scan over the codes of the
+// other image (see `ComputeSiftCodeCandidates`). Only descriptors, whose two
+// best candidates pass the ratio test with `descriptor_code_max_ratio`, are
+// re-ranked with the full descriptors of exactly the required rows, which are
+// read through the given readers. If a reader is empty, e.g., because only the
+// codes are stored, the candidates are ranked by their code similarities.
+void MatchSiftFeaturesCPUDescriptorCodes(
+    const SiftMatchingOptions& match_options,
+    const FeatureDescriptorCodes& descriptor_codes1,
+    const FeatureDescriptorCodes& descriptor_codes2,
+    const FeatureDescriptorRowsReader& read_descriptor_rows1,
+    const FeatureDescriptorRowsReader& read_descriptor_rows2,
+    FeatureMatches* matches);
+
 void MatchGuidedSiftFeaturesCPU(const SiftMatchingOptions& match_options,
                                 const FeatureKeypoints& keypoints1,
                                 const FeatureKeypoints& keypoints2,
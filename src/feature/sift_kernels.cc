@@ -0,0 +1,739 @@
+// Copyright (c) 2018, ETH Zurich and UNC Chapel Hill.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//
+//     * Neither the name of ETH Zurich and UNC Chapel Hill nor the names of
+//       its contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Author: Johannes L. Schoenberger (jsch-at-demuc-dot-de)
+
+
+#include "feature/sift_kernels.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "util/logging.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define COLMAP_SIFT_X86_KERNELS
+#if (defined(__clang__) && __clang_major__ >= 8) || \
+    (!defined(__clang__) && __GNUC__ >= 9)
+#define COLMAP_SIFT_AVX512_VNNI_KERNEL
+#endif
+#include <immintrin.h>
+#endif
+
+#if defined(__aarch64__) && defined(__ARM_NEON)
+#define COLMAP_SIFT_NEON_KERNEL
+#include <arm_neon.h>
+#endif
+
+namespace colmap {
+namespace {
+
+const int kDescriptorDim = 128;
+
+// The tiles of descriptors1 and descriptors2 plus the distance tile together
+// fit into the L2 cache, while a single descriptor row of the first tile stays
+// in registers during the inner loop.
+const int kTileSize1 = 32;
+const int kTileSize2 = 256;
+
+// Computes the dot products between num1 descriptors in descriptors1 and num2
+// descriptors in descriptors2 and stores them in row-major order with a stride
+// of num2 in dists.
+typedef void (*DotTileFunc)(const uint8_t* descriptors1, const int num1,
+                            const uint8_t* descriptors2, const int num2,
+                            int32_t* dists);
+
+struct DotKernel {
+  DotTileFunc compute_tile = nullptr;
+  // Whether the kernel multiplies unsigned with signed bytes. In this case,
+  // descriptors2 must be passed with flipped sign bit, i.e. shifted by -128,
+  // and the caller adds 128 * sum(descriptor1) to each dot product.
+  bool signed_descriptors2 = false;
+};
+
+void ComputeDotTileScalar(const uint8_t* descriptors1, const int num1,
+                          const uint8_t* descriptors2, const int num2,
+                          int32_t* dists) {
+  for (int i = 0; i < num1; ++i) {
+    const uint8_t* descriptor1 = descriptors1 + i * kDescriptorDim;
+    for (int j = 0; j < num2; ++j) {
+      const uint8_t* descriptor2 = descriptors2 + j * kDescriptorDim;
+      int32_t dist = 0;
+      for (int k = 0; k < kDescriptorDim; ++k) {
+        dist += static_cast<int32_t>(descriptor1[k]) *
+                static_cast<int32_t>(descriptor2[k]);
+      }
+      dists[i * num2 + j] = dist;
+    }
+  }
+}
+
+#ifdef COLMAP_SIFT_X86_KERNELS
+
+__attribute__((target("avx2"))) inline __m256i LoadChunkAVX2(
+    const uint8_t* descriptor, const int k) {
+  return _mm256_cvtepu8_epi16(
+      _mm_loadu_si128(reinterpret_cast<const __m128i*>(descriptor + 16 * k)));
+}
+
+// Zero-extends the bytes to 16 bit and multiply-adds pairs into 32 bit, which
+// cannot overflow for values in [0, 255].
+__attribute__((target("avx2"))) void ComputeDotTileAVX2(
+    const uint8_t* descriptors1, const int num1, const uint8_t* descriptors2,
+    const int num2, int32_t* dists) {
+  const int kNumChunks = kDescriptorDim / 16;
+  for (int i = 0; i < num1; ++i) {
+    const uint8_t* descriptor1 = descriptors1 + i * kDescriptorDim;
+    __m256i descriptor1_epi16[kNumChunks];
+    for (int k = 0; k < kNumChunks; ++k) {
+      descriptor1_epi16[k] = LoadChunkAVX2(descriptor1, k);
+    }
+
+    int j = 0;
+    for (; j + 4 <= num2; j += 4) {
+      const uint8_t* descriptor2_0 = descriptors2 + j * kDescriptorDim;
+      const uint8_t* descriptor2_1 = descriptor2_0 + kDescriptorDim;
+      const uint8_t* descriptor2_2 = descriptor2_1 + kDescriptorDim;
+      const uint8_t* descriptor2_3 = descriptor2_2 + kDescriptorDim;
+      __m256i acc0 = _mm256_setzero_si256();
+      __m256i acc1 = _mm256_setzero_si256();
+      __m256i acc2 = _mm256_setzero_si256();
+      __m256i acc3 = _mm256_setzero_si256();
+      for (int k = 0; k < kNumChunks; ++k) {
+        acc0 = _mm256_add_epi32(
+            acc0, _mm256_madd_epi16(descriptor1_epi16[k],
+                                    LoadChunkAVX2(descriptor2_0, k)));
+        acc1 = _mm256_add_epi32(
+            acc1, _mm256_madd_epi16(descriptor1_epi16[k],
+                                    LoadChunkAVX2(descriptor2_1, k)));
+        acc2 = _mm256_add_epi32(
+            acc2, _mm256_madd_epi16(descriptor1_epi16[k],
+                                    LoadChunkAVX2(descriptor2_2, k)));
+        acc3 = _mm256_add_epi32(
+            acc3, _mm256_madd_epi16(descriptor1_epi16[k],
+                                    LoadChunkAVX2(descriptor2_3, k)));
+      }
+      // Horizontal reduction of the four accumulators into one vector.
+      const __m256i sum01 = _mm256_hadd_epi32(acc0, acc1);
+      const __m256i sum23 = _mm256_hadd_epi32(acc2, acc3);
+      const __m256i sum0123 = _mm256_hadd_epi32(sum01, sum23);
+      const __m128i sum = _mm_add_epi32(_mm256_castsi256_si128(sum0123),
+                                        _mm256_extracti128_si256(sum0123, 1));
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(dists + i * num2 + j), sum);
+    }
+
+    for (; j < num2; ++j) {
+      const uint8_t* descriptor2 = descriptors2 + j * kDescriptorDim;
+      __m256i acc = _mm256_setzero_si256();
+      for (int k = 0; k < kNumChunks; ++k) {
+        acc = _mm256_add_epi32(
+            acc, _mm256_madd_epi16(descriptor1_epi16[k],
+                                   LoadChunkAVX2(descriptor2, k)));
+      }
+      const __m128i sum4 = _mm_add_epi32(_mm256_castsi256_si128(acc),
+                                         _mm256_extracti128_si256(acc, 1));
+      const __m128i sum2 = _mm_hadd_epi32(sum4, sum4);
+      const __m128i sum1 = _mm_hadd_epi32(sum2, sum2);
+      dists[i * num2 + j] = _mm_cvtsi128_si32(sum1);
+    }
+  }
+}
+
+#ifdef COLMAP_SIFT_AVX512_VNNI_KERNEL
+
+__attribute__((target("avx512f"))) inline __m512i LoadChunkAVX512(
+    const uint8_t* descriptor, const int k) {
+  return _mm512_loadu_si512(reinterpret_cast<const void*>(descriptor + 64 * k));
+}
+
+// Multiplies the unsigned bytes of descriptors1 with the signed (shifted)
+// bytes of descriptors2 and accumulates groups of four products into 32 bit.
+__attribute__((target("avx512f,avx512vnni"))) void ComputeDotTileAVX512VNNI(
+    const uint8_t* descriptors1, const int num1, const uint8_t* descriptors2,
+    const int num2, int32_t* dists) {
+  for (int i = 0; i < num1; ++i) {
+    const uint8_t* descriptor1 = descriptors1 + i * kDescriptorDim;
+    const __m512i descriptor1_lo = LoadChunkAVX512(descriptor1, 0);
+    const __m512i descriptor1_hi = LoadChunkAVX512(descriptor1, 1);
+
+    int j = 0;
+    for (; j + 4 <= num2; j += 4) {
+      const uint8_t* descriptor2 = descriptors2 + j * kDescriptorDim;
+      __m512i acc[4];
+      for (int l = 0; l < 4; ++l) {
+        acc[l] = _mm512_dpbusd_epi32(
+            _mm512_setzero_si512(), descriptor1_lo,
+            LoadChunkAVX512(descriptor2 + l * kDescriptorDim, 0));
+        acc[l] = _mm512_dpbusd_epi32(
+            acc[l], descriptor1_hi,
+            LoadChunkAVX512(descriptor2 + l * kDescriptorDim, 1));
+      }
+      for (int l = 0; l < 4; ++l) {
+        dists[i * num2 + j + l] = _mm512_reduce_add_epi32(acc[l]);
+      }
+    }
+
+    for (; j < num2; ++j) {
+      const uint8_t* descriptor2 = descriptors2 + j * kDescriptorDim;
+      __m512i acc = _mm512_dpbusd_epi32(_mm512_setzero_si512(), descriptor1_lo,
+                                        LoadChunkAVX512(descriptor2, 0));
+      acc = _mm512_dpbusd_epi32(acc, descriptor1_hi,
+                                LoadChunkAVX512(descriptor2, 1));
+      dists[i * num2 + j] = _mm512_reduce_add_epi32(acc);
+    }
+  }
+}
+
+#endif  // COLMAP_SIFT_AVX512_VNNI_KERNEL
+
+#endif  // COLMAP_SIFT_X86_KERNELS
+
+#ifdef COLMAP_SIFT_NEON_KERNEL
+
+void ComputeDotTileNEON(const uint8_t* descriptors1, const int num1,
+                        const uint8_t* descriptors2, const int num2,
+                        int32_t* dists) {
+  const int kNumChunks = kDescriptorDim / 16;
+  for (int i = 0; i < num1; ++i) {
+    const uint8_t* descriptor1 = descriptors1 + i * kDescriptorDim;
+    uint8x16_t descriptor1_u8[kNumChunks];
+    for (int k = 0; k < kNumChunks; ++k) {
+      descriptor1_u8[k] = vld1q_u8(descriptor1 + 16 * k);
+    }
+    for (int j = 0; j < num2; ++j) {
+      const uint8_t* descriptor2 = descriptors2 + j * kDescriptorDim;
+      uint32x4_t acc = vdupq_n_u32(0);
+      for (int k = 0; k < kNumChunks; ++k) {
+        const uint8x16_t descriptor2_u8 = vld1q_u8(descriptor2 + 16 * k);
+        acc = vpadalq_u16(acc, vmull_u8(vget_low_u8(descriptor1_u8[k]),
+                                        vget_low_u8(descriptor2_u8)));
+        acc =
+            vpadalq_u16(acc, vmull_high_u8(descriptor1_u8[k], descriptor2_u8));
+      }
+      dists[i * num2 + j] = static_cast<int32_t>(vaddvq_u32(acc));
+    }
+  }
+}
+
+#endif  // COLMAP_SIFT_NEON_KERNEL
+
+DotKernel GetDotKernel(const SiftMatchingKernel kernel) {
+  CHECK(IsSiftMatchingKernelSupported(kernel))
+      << SiftMatchingKernelToString(kernel);
+
+  DotKernel dot_kernel;
+  switch (kernel == SiftMatchingKernel::AUTO ? GetBestSiftMatchingKernel()
+                                             : kernel) {
+#ifdef COLMAP_SIFT_X86_KERNELS
+    case SiftMatchingKernel::AVX2:
+      dot_kernel.compute_tile = &ComputeDotTileAVX2;
+      break;
+#ifdef COLMAP_SIFT_AVX512_VNNI_KERNEL
+    case SiftMatchingKernel::AVX512_VNNI:
+      dot_kernel.compute_tile = &ComputeDotTileAVX512VNNI;
+      dot_kernel.signed_descriptors2 = true;
+      break;
+#endif
+#endif
+#ifdef COLMAP_SIFT_NEON_KERNEL
+    case SiftMatchingKernel::NEON:
+      dot_kernel.compute_tile = &ComputeDotTileNEON;
+      break;
+#endif
+    default:
+      dot_kernel.compute_tile = &ComputeDotTileScalar;
+      break;
+  }
+
+  return dot_kernel;
+}
+
+struct NoGuidedFilter {
+  inline bool IsRejected(const int, const int) const { return false; }
+};
+
+// Same update rule as a sequential scan over a row of the distance matrix.
+inline void UpdateNearestNeighbors(const int idx, const int dist,
+                                   int* best_idx, int* best_dist,
+                                   int* second_best_dist) {
+  if (dist > *best_dist) {
+    *best_idx = idx;
+    *second_best_dist = *best_dist;
+    *best_dist = dist;
+  } else if (dist > *second_best_dist) {
+    *second_best_dist = dist;
+  }
+}
+
+void InitializeNearestNeighbors(const size_t num_descriptors,
+                                SiftNearestNeighbors* neighbors) {
+  neighbors->best_idx.assign(num_descriptors, -1);
+  neighbors->best_dist.assign(num_descriptors, 0);
+  neighbors->second_best_dist.assign(num_descriptors, 0);
+}
+
+template <typename GuidedFilter>
+void ComputeSiftNearestNeighborsImpl(const DotKernel& dot_kernel,
+                                     const FeatureDescriptors& descriptors1,
+                                     const FeatureDescriptors& descriptors2,
+                                     const GuidedFilter& guided_filter,
+                                     SiftNearestNeighbors* neighbors12,
+                                     SiftNearestNeighbors* neighbors21) {
+  const int num_descriptors1 = static_cast<int>(descriptors1.rows());
+  const int num_descriptors2 = static_cast<int>(descriptors2.rows());
+
+  const uint8_t* descriptors2_data = descriptors2.data();
+  FeatureDescriptors signed_descriptors2;
+  std::vector<int32_t> dist_offsets1;
+  if (dot_kernel.signed_descriptors2) {
+    signed_descriptors2 = descriptors2;
+    for (Eigen::Index i = 0; i < signed_descriptors2.size(); ++i) {
+      signed_descriptors2.data()[i] ^= 0x80;
+    }
+    descriptors2_data = signed_descriptors2.data();
+    dist_offsets1.resize(num_descriptors1);
+    for (int i = 0; i < num_descriptors1; ++i) {
+      dist_offsets1[i] = 128 * descriptors1.row(i).cast<int32_t>().sum();
+    }
+  }
+
+  std::vector<int32_t> dists(kTileSize1 * kTileSize2);
+
+  for (int tile1 = 0; tile1 < num_descriptors1; tile1 += kTileSize1) {
+    const int tile_size1 = std::min(kTileSize1, num_descriptors1 - tile1);
+    for (int tile2 = 0; tile2 < num_descriptors2; tile2 += kTileSize2) {
+      const int tile_size2 = std::min(kTileSize2, num_descriptors2 - tile2);
+
+      dot_kernel.compute_tile(descriptors1.data() + tile1 * kDescriptorDim,
+                              tile_size1,
+                              descriptors2_data + tile2 * kDescriptorDim,
+                              tile_size2, dists.data());
+
+      // Rows of a tile are visited in increasing order and tiles of the same
+      // row/column are visited in increasing order, so that both directions
+      // see the exact same sequence as a scan over the full distance matrix.
+      for (int i = 0; i < tile_size1; ++i) {
+        const int idx1 = tile1 + i;
+        const int32_t dist_offset =
+            dot_kernel.signed_descriptors2 ? dist_offsets1[idx1] : 0;
+        const int32_t* dists_row = dists.data() + i * tile_size2;
+
+        int best_idx = neighbors12->best_idx[idx1];
+        int best_dist = neighbors12->best_dist[idx1];
+        int second_best_dist = neighbors12->second_best_dist[idx1];
+
+        for (int j = 0; j < tile_size2; ++j) {
+          const int idx2 = tile2 + j;
+          if (guided_filter.IsRejected(idx1, idx2)) {
+            continue;
+          }
+
+          const int dist = dists_row[j] + dist_offset;
+          UpdateNearestNeighbors(idx2, dist, &best_idx, &best_dist,
+                                 &second_best_dist);
+          if (neighbors21 != nullptr) {
+            UpdateNearestNeighbors(idx1, dist, &neighbors21->best_idx[idx2],
+                                   &neighbors21->best_dist[idx2],
+                                   &neighbors21->second_best_dist[idx2]);
+          }
+        }
+
+        neighbors12->best_idx[idx1] = best_idx;
+        neighbors12->best_dist[idx1] = best_dist;
+        neighbors12->second_best_dist[idx1] = second_best_dist;
+      }
+    }
+  }
+}
+
+typedef FeatureDescriptorCodes Codes;
+
+// Number of codes that the fast scan processes together. The codes of a block
+// are interleaved, such that the block stores the first code byte of all its
+// descriptors, followed by the second code byte of all its descriptors, etc.
+const int kCodeBlockSize = 32;
+const int kNumCodeBlockBytes = Codes::kNumCodeBytes * kCodeBlockSize;
+
+// Computes the sum of the quantized similarities in the lookup table, which
+// holds 16 entries per subspace, for all codes in num_blocks interleaved blocks
+// and stores them in scores.
+typedef void (*CodeScanFunc)(const uint8_t* lut, const uint8_t* blocks,
+                             const int num_blocks, uint16_t* scores);
+
+void ScanCodesScalar(const uint8_t* lut, const uint8_t* blocks,
+                     const int num_blocks, uint16_t* scores) {
+  for (int block = 0; block < num_blocks; ++block) {
+    const uint8_t* block_codes = blocks + block * kNumCodeBlockBytes;
+    uint16_t* block_scores = scores + block * kCodeBlockSize;
+    std::fill(block_scores, block_scores + kCodeBlockSize, 0);
+    for (int b = 0; b < Codes::kNumCodeBytes; ++b) {
+      const uint8_t* lut_even = lut + 2 * b * Codes::kNumCentroids;
+      const uint8_t* lut_odd = lut_even + Codes::kNumCentroids;
+      const uint8_t* column = block_codes + b * kCodeBlockSize;
+      for (int k = 0; k < kCodeBlockSize; ++k) {
+        block_scores[k] += lut_even[column[k] & 0xF] + lut_odd[column[k] >> 4];
+      }
+    }
+  }
+}
+
+#ifdef COLMAP_SIFT_X86_KERNELS
+
+// Looks up the 16 entries of a subspace for 32 codes with one byte shuffle and
+// accumulates the sums in 16 bit, which cannot overflow for 32 subspaces.
+__attribute__((target("avx2"))) void ScanCodesAVX2(const uint8_t* lut,
+                                                   const uint8_t* blocks,
+                                                   const int num_blocks,
+                                                   uint16_t* scores) {
+  __m256i luts[Codes::kNumSubspaces];
+  for (int s = 0; s < Codes::kNumSubspaces; ++s) {
+    luts[s] = _mm256_broadcastsi128_si256(_mm_loadu_si128(
+        reinterpret_cast<const __m128i*>(lut + s * Codes::kNumCentroids)));
+  }
+
+  const __m256i low_mask = _mm256_set1_epi8(0xF);
+  const __m256i zero = _mm256_setzero_si256();
+
+  for (int block = 0; block < num_blocks; ++block) {
+    const uint8_t* block_codes = blocks + block * kNumCodeBlockBytes;
+
+    // The sums of the codes 0-7 and 16-23 in acc_lo and of the codes 8-15 and
+    // 24-31 in acc_hi, since the unpacking operates within 128-bit lanes.
+    __m256i acc_lo = zero;
+    __m256i acc_hi = zero;
+    for (int b = 0; b < Codes::kNumCodeBytes; ++b) {
+      const __m256i column = _mm256_loadu_si256(
+          reinterpret_cast<const __m256i*>(block_codes + b * kCodeBlockSize));
+      const __m256i even = _mm256_shuffle_epi8(
+          luts[2 * b], _mm256_and_si256(column, low_mask));
+      const __m256i odd = _mm256_shuffle_epi8(
+          luts[2 * b + 1],
+          _mm256_and_si256(_mm256_srli_epi16(column, 4), low_mask));
+      acc_lo = _mm256_add_epi16(
+          acc_lo, _mm256_add_epi16(_mm256_unpacklo_epi8(even, zero),
+                                   _mm256_unpacklo_epi8(odd, zero)));
+      acc_hi = _mm256_add_epi16(
+          acc_hi, _mm256_add_epi16(_mm256_unpackhi_epi8(even, zero),
+                                   _mm256_unpackhi_epi8(odd, zero)));
+    }
+
+    uint16_t* block_scores = scores + block * kCodeBlockSize;
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(block_scores),
+                        _mm256_permute2x128_si256(acc_lo, acc_hi, 0x20));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(block_scores + 16),
+                        _mm256_permute2x128_si256(acc_lo, acc_hi, 0x31));
+  }
+}
+
+#endif  // COLMAP_SIFT_X86_KERNELS
+
+CodeScanFunc GetCodeScanFunc(const SiftMatchingKernel kernel) {
+  CHECK(IsSiftMatchingKernelSupported(kernel))
+      << SiftMatchingKernelToString(kernel);
+
+  switch (kernel == SiftMatchingKernel::AUTO ? GetBestSiftMatchingKernel()
+                                             : kernel) {
+#ifdef COLMAP_SIFT_X86_KERNELS
+    case SiftMatchingKernel::AVX2:
+    case SiftMatchingKernel::AVX512_VNNI:
+      return &ScanCodesAVX2;
+#endif
+    default:
+      return &ScanCodesScalar;
+  }
+}
+
+}  // namespace
+
+bool IsSiftMatchingKernelSupported(const SiftMatchingKernel kernel) {
+  switch (kernel) {
+    case SiftMatchingKernel::AUTO:
+    case SiftMatchingKernel::SCALAR:
+      return true;
+#ifdef COLMAP_SIFT_X86_KERNELS
+    case SiftMatchingKernel::AVX2:
+      return __builtin_cpu_supports("avx2");
+#ifdef COLMAP_SIFT_AVX512_VNNI_KERNEL
+    case SiftMatchingKernel::AVX512_VNNI:
+      return __builtin_cpu_supports("avx512f") &&
+             __builtin_cpu_supports("avx512vnni");
+#endif
+#endif
+#ifdef COLMAP_SIFT_NEON_KERNEL
+    case SiftMatchingKernel::NEON:
+      return true;
+#endif
+    default:
+      return false;
+  }
+}
+
+SiftMatchingKernel GetBestSiftMatchingKernel() {
+  static const SiftMatchingKernel kBestKernel = []() {
+    for (const auto kernel :
+         {SiftMatchingKernel::AVX512_VNNI, SiftMatchingKernel::AVX2,
+          SiftMatchingKernel::NEON}) {
+      if (IsSiftMatchingKernelSupported(kernel)) {
+        return kernel;
+      }
+    }
+    return SiftMatchingKernel::SCALAR;
+  }();
+  return kBestKernel;
+}
+
+std::string SiftMatchingKernelToString(const SiftMatchingKernel kernel) {
+  switch (kernel) {
+    case SiftMatchingKernel::AUTO:
+      return "AUTO";
+    case SiftMatchingKernel::SCALAR:
+      return "SCALAR";
+    case SiftMatchingKernel::AVX2:
+      return "AVX2";
+    case SiftMatchingKernel::AVX512_VNNI:
+      return "AVX512_VNNI";
+    case SiftMatchingKernel::NEON:
+      return "NEON";
+    default:
+      return "UNKNOWN";
+  }
+}
+
+SiftGuidedFilter SiftGuidedFilter::Epipolar(const Eigen::Matrix3f& F,
+                                            const FeatureKeypoints& keypoints1,
+                                            const FeatureKeypoints& keypoints2,
+                                            const float max_residual) {
+  SiftGuidedFilter filter;
+  filter.type_ = Type::EPIPOLAR;
+  filter.max_residual_ = max_residual;
+
+  filter.terms1_.resize(keypoints1.size());
+  filter.norms1_.resize(keypoints1.size());
+  for (size_t i = 0; i < keypoints1.size(); ++i) {
+    const Eigen::Vector3f p1(keypoints1[i].x, keypoints1[i].y, 1.0f);
+    filter.terms1_[i] = F * p1;
+    filter.norms1_[i] = filter.terms1_[i].head<2>().squaredNorm();
+  }
+
+  filter.points2_.resize(keypoints2.size());
+  filter.norms2_.resize(keypoints2.size());
+  for (size_t i = 0; i < keypoints2.size(); ++i) {
+    const Eigen::Vector3f p2(keypoints2[i].x, keypoints2[i].y, 1.0f);
+    filter.points2_[i] = p2.head<2>();
+    filter.norms2_[i] = (F.transpose() * p2).head<2>().squaredNorm();
+  }
+
+  return filter;
+}
+
+SiftGuidedFilter SiftGuidedFilter::Homography(
+    const Eigen::Matrix3f& H, const FeatureKeypoints& keypoints1,
+    const FeatureKeypoints& keypoints2, const float max_residual) {
+  SiftGuidedFilter filter;
+  filter.type_ = Type::HOMOGRAPHY;
+  filter.max_residual_ = max_residual;
+
+  filter.terms1_.resize(keypoints1.size());
+  for (size_t i = 0; i < keypoints1.size(); ++i) {
+    const Eigen::Vector3f p1(keypoints1[i].x, keypoints1[i].y, 1.0f);
+    filter.terms1_[i] = (H * p1).hnormalized().homogeneous();
+  }
+
+  filter.points2_.resize(keypoints2.size());
+  for (size_t i = 0; i < keypoints2.size(); ++i) {
+    filter.points2_[i] = Eigen::Vector2f(keypoints2[i].x, keypoints2[i].y);
+  }
+
+  return filter;
+}
+
+size_t SiftGuidedFilter::NumPoints1() const { return terms1_.size(); }
+
+size_t SiftGuidedFilter::NumPoints2() const { return points2_.size(); }
+
+void ComputeSiftNearestNeighbors(const FeatureDescriptors& descriptors1,
+                                 const FeatureDescriptors& descriptors2,
+                                 const SiftGuidedFilter* guided_filter,
+                                 SiftNearestNeighbors* neighbors12,
+                                 SiftNearestNeighbors* neighbors21,
+                                 const SiftMatchingKernel kernel) {
+  CHECK_NOTNULL(neighbors12);
+
+  InitializeNearestNeighbors(descriptors1.rows(), neighbors12);
+  if (neighbors21 != nullptr) {
+    InitializeNearestNeighbors(descriptors2.rows(), neighbors21);
+  }
+
+  if (descriptors1.rows() == 0 || descriptors2.rows() == 0) {
+    return;
+  }
+
+  CHECK_EQ(descriptors1.cols(), kDescriptorDim);
+  CHECK_EQ(descriptors2.cols(), kDescriptorDim);
+
+  const DotKernel dot_kernel = GetDotKernel(kernel);
+
+  if (guided_filter == nullptr) {
+    ComputeSiftNearestNeighborsImpl(dot_kernel, descriptors1, descriptors2,
+                                    NoGuidedFilter(), neighbors12,
+                                    neighbors21);
+  } else {
+    CHECK_EQ(guided_filter->NumPoints1(), descriptors1.rows());
+    CHECK_EQ(guided_filter->NumPoints2(), descriptors2.rows());
+    ComputeSiftNearestNeighborsImpl(dot_kernel, descriptors1, descriptors2,
+                                    *guided_filter, neighbors12, neighbors21);
+  }
+}
+
+void ComputeSiftCodeCandidates(const FeatureDescriptorCodes& codes1,
+                               const FeatureDescriptorCodes& codes2,
+                               const int num_candidates,
+                               SiftCodeCandidates* candidates12,
+                               const SiftMatchingKernel kernel) {
+  CHECK_GT(num_candidates, 0);
+  CHECK_NOTNULL(candidates12);
+
+  const int num_codes1 = static_cast<int>(codes1.codes.rows());
+  const int num_codes2 = static_cast<int>(codes2.codes.rows());
+
+  candidates12->num_candidates = num_candidates;
+  candidates12->idxs.assign(num_codes1 * num_candidates, -1);
+  candidates12->similarities.assign(num_codes1 * num_candidates, 0);
+
+  if (num_codes1 == 0 || num_codes2 == 0) {
+    return;
+  }
+
+  CHECK(codes1.format == Codes::Format::PQ_32x16);
+  CHECK(codes2.format == Codes::Format::PQ_32x16);
+
+  const CodeScanFunc scan_codes = GetCodeScanFunc(kernel);
+
+  // The exact similarities between the centroids of both codebooks in the same
+  // subspace, where the row of a centroid in the first codebook holds the
+  // similarities to the 16 centroids in the second codebook.
+  const Eigen::MatrixXi centroids1 = codes1.codebook.cast<int>();
+  const Eigen::MatrixXi centroids2 = codes2.codebook.cast<int>();
+  Eigen::Matrix<int, Eigen::Dynamic, Codes::kNumCentroids, Eigen::RowMajor>
+      table(Codes::kNumSubspaces * Codes::kNumCentroids, Codes::kNumCentroids);
+  for (int s = 0; s < Codes::kNumSubspaces; ++s) {
+    table.middleRows<Codes::kNumCentroids>(s * Codes::kNumCentroids) =
+        centroids1.middleRows<Codes::kNumCentroids>(s * Codes::kNumCentroids) *
+        centroids2.middleRows<Codes::kNumCentroids>(s * Codes::kNumCentroids)
+            .transpose();
+  }
+
+  const int num_blocks = (num_codes2 + kCodeBlockSize - 1) / kCodeBlockSize;
+  std::vector<uint8_t> blocks(num_blocks * kNumCodeBlockBytes, 0);
+  for (int idx2 = 0; idx2 < num_codes2; ++idx2) {
+    uint8_t* block_codes =
+        blocks.data() + (idx2 / kCodeBlockSize) * kNumCodeBlockBytes;
+    for (int b = 0; b < Codes::kNumCodeBytes; ++b) {
+      block_codes[b * kCodeBlockSize + idx2 % kCodeBlockSize] =
+          codes2.codes(idx2, b);
+    }
+  }
+
+  const size_t num_candidates_per_code =
+      static_cast<size_t>(std::min(num_candidates, num_codes2));
+
+  std::vector<const int*> table_rows(Codes::kNumSubspaces);
+  std::vector<uint8_t> lut(Codes::kNumSubspaces * Codes::kNumCentroids);
+  std::vector<uint16_t> scores(num_blocks * kCodeBlockSize);
+  // The candidates with their quantized and later exact similarity.
+  std::vector<std::pair<int, int>> candidates;
+  candidates.reserve(num_candidates_per_code + 1);
+
+  for (int idx1 = 0; idx1 < num_codes1; ++idx1) {
+    // Quantize the similarities of each subspace relative to their minimum,
+    // which shifts all sums by the same value, with a common scale.
+    int max_range = 0;
+    Eigen::Matrix<int, Codes::kNumSubspaces, 1> min_similarities;
+    for (int s = 0; s < Codes::kNumSubspaces; ++s) {
+      table_rows[s] =
+          table.row(s * Codes::kNumCentroids + codes1.Code(idx1, s)).data();
+      const auto row =
+          Eigen::Map<const Eigen::Matrix<int, Codes::kNumCentroids, 1>>(
+              table_rows[s]);
+      min_similarities(s) = row.minCoeff();
+      max_range = std::max(max_range, row.maxCoeff() - min_similarities(s));
+    }
+
+    const float scale = max_range > 0 ? 255.0f / max_range : 0.0f;
+    for (int s = 0; s < Codes::kNumSubspaces; ++s) {
+      for (int c = 0; c < Codes::kNumCentroids; ++c) {
+        lut[s * Codes::kNumCentroids + c] = static_cast<uint8_t>(std::round(
+            scale * (table_rows[s][c] - min_similarities(s))));
+      }
+    }
+
+    scan_codes(lut.data(), blocks.data(), num_blocks, scores.data());
+
+    // Select the best candidates on the quantized similarities, where earlier
+    // candidates are kept in case of ties.
+    candidates.clear();
+    for (int idx2 = 0; idx2 < num_codes2; ++idx2) {
+      const int score = scores[idx2];
+      if (candidates.size() < num_candidates_per_code ||
+          score > candidates.back().first) {
+        auto it = candidates.end();
+        while (it != candidates.begin() && (it - 1)->first < score) {
+          --it;
+        }
+        candidates.emplace(it, score, idx2);
+        if (candidates.size() > num_candidates_per_code) {
+          candidates.pop_back();
+        }
+      }
+    }
+
+    // Order the candidates by their exact similarities.
+    for (auto& candidate : candidates) {
+      candidate.first = 0;
+      for (int s = 0; s < Codes::kNumSubspaces; ++s) {
+        candidate.first += table_rows[s][codes2.Code(candidate.second, s)];
+      }
+    }
+    std::sort(candidates.begin(), candidates.end(),
+              [](const std::pair<int, int>& candidate1,
+                 const std::pair<int, int>& candidate2) {
+                return candidate1.first > candidate2.first ||
+                       (candidate1.first == candidate2.first &&
+                        candidate1.second < candidate2.second);
+              });
+
+    for (size_t k = 0; k < candidates.size(); ++k) {
+      candidates12->idxs[idx1 * num_candidates + k] = candidates[k].second;
+      candidates12->similarities[idx1 * num_candidates + k] =
+          candidates[k].first;
+    }
+  }
+}
+
+}  // namespace colmap
@@ -0,0 +1,168 @@
+// Copyright (c) 2018, ETH Zurich and UNC Chapel Hill.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//
+//     * Neither the name of ETH Zurich and UNC Chapel Hill nor the names of
+//       its contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Author: Johannes L. Schoenberger (jsch-at-demuc-dot-de)
+
+
+#ifndef COLMAP_SRC_FEATURE_SIFT_KERNELS_H_
+#define COLMAP_SRC_FEATURE_SIFT_KERNELS_H_
+
+#include <string>
+#include <vector>
+
+#include <Eigen/Core>
+
+#include "feature/types.h"
+
+namespace colmap {
+
+// Instruction set used to compute the uint8 descriptor dot products in the
+// brute-force matcher. AUTO selects the fastest kernel supported by the CPU at
+// runtime, while the other values force a specific implementation.
+enum class SiftMatchingKernel {
+  AUTO,
+  SCALAR,
+  AVX2,
+  AVX512_VNNI,
+  NEON,
+};
+
+// Check whether the given kernel was compiled in and is supported by the CPU.
+bool IsSiftMatchingKernelSupported(const SiftMatchingKernel kernel);
+
+// Resolve AUTO to the kernel that is actually used on this machine.
+SiftMatchingKernel GetBestSiftMatchingKernel();
+
+std::string SiftMatchingKernelToString(const SiftMatchingKernel kernel);
+
+// The two nearest neighbors of each descriptor in terms of the descriptor dot
+// product, i.e. a larger distance value means more similar. The neighbor index
+// is -1 and the distances are zero if no neighbor with positive similarity
+// exists. Ties are resolved in favor of the smaller index.
+struct SiftNearestNeighbors {
+  std::vector<int> best_idx;
+  std::vector<int> best_dist;
+  std::vector<int> second_best_dist;
+};
+
+// Geometric constraint for guided brute-force matching. Instead of evaluating
+// an arbitrary predicate per descriptor pair, the per-keypoint terms of the
+// Sampson error or the homography transfer error are precomputed once, so that
+// each pair only costs a handful of multiply-adds.
+class SiftGuidedFilter {
+ public:
+  // Reject pairs with a squared Sampson error above max_residual.
+  static SiftGuidedFilter Epipolar(const Eigen::Matrix3f& F,
+                                   const FeatureKeypoints& keypoints1,
+                                   const FeatureKeypoints& keypoints2,
+                                   const float max_residual);
+
+  // Reject pairs with a squared transfer error above max_residual.
+  static SiftGuidedFilter Homography(const Eigen::Matrix3f& H,
+                                     const FeatureKeypoints& keypoints1,
+                                     const FeatureKeypoints& keypoints2,
+                                     const float max_residual);
+
+  size_t NumPoints1() const;
+  size_t NumPoints2() const;
+
+  // Check whether the given pair violates the geometric constraint.
+  inline bool IsRejected(const int idx1, const int idx2) const;
+
+ private:
+  enum class Type { EPIPOLAR, HOMOGRAPHY };
+
+  Type type_;
+  float max_residual_;
+  // For EPIPOLAR, F * x1 for each point in the first image and the squared
+  // norm of the first two components of F * x1 and F^T * x2. For HOMOGRAPHY,
+  // the transferred point H * x1 in the first two components of terms1_.
+  std::vector<Eigen::Vector3f> terms1_;
+  std::vector<float> norms1_;
+  std::vector<float> norms2_;
+  std::vector<Eigen::Vector2f> points2_;
+};
+
+// Find the two nearest neighbors of descriptors1 in descriptors2 and, if
+// neighbors21 is not NULL, of descriptors2 in descriptors1 by exhaustive
+// search. The distance matrix is computed in cache-sized tiles and reduced on
+// the fly, so that memory usage is independent of the number of descriptors.
+// The result is identical to a full distance matrix followed by a sequential
+// row-wise/column-wise scan. Optionally, pairs rejected by the guided filter
+// are excluded from the search.
+void ComputeSiftNearestNeighbors(
+    const FeatureDescriptors& descriptors1,
+    const FeatureDescriptors& descriptors2,
+    const SiftGuidedFilter* guided_filter, SiftNearestNeighbors* neighbors12,
+    SiftNearestNeighbors* neighbors21,
+    const SiftMatchingKernel kernel = SiftMatchingKernel::AUTO);
+
+// Candidate nearest neighbors of product-quantized descriptors (see
+// `FeatureDescriptorCodes`) in terms of the code similarity, i.e. the dot
+// product between the coded centroids of two descriptors. The candidates of
+// each descriptor are stored consecutively in order of decreasing similarity,
+// where ties are resolved in favor of the smaller index. If the other image has
+// fewer descriptors than candidates, the remaining entries have index -1.
+struct SiftCodeCandidates {
+  int num_candidates = 0;
+  std::vector<int> idxs;
+  std::vector<int> similarities;
+};
+
+// Find the candidates of codes1 in codes2 by a fast scan over the 4-bit codes.
+// The similarities of a descriptor to the 16 centroids of each subspace are
+// quantized to 8 bits, so that the AVX2 kernel looks up one subspace of 32
+// codes with a single byte shuffle. The best candidates on the quantized
+// similarities are then ordered by their exact code similarities. The result
+// is identical for all kernels, where NEON and AVX512_VNNI use the scalar and
+// the AVX2 kernel, respectively.
+void ComputeSiftCodeCandidates(
+    const FeatureDescriptorCodes& codes1, const FeatureDescriptorCodes& codes2,
+    const int num_candidates, SiftCodeCandidates* candidates12,
+    const SiftMatchingKernel kernel = SiftMatchingKernel::AUTO);
+
+////////////////////////////////////////////////////////////////////////////////
+// Implementation
+////////////////////////////////////////////////////////////////////////////////
+
+bool SiftGuidedFilter::IsRejected(const int idx1, const int idx2) const {
+  if (type_ == Type::EPIPOLAR) {
+    const Eigen::Vector3f& Fx1 = terms1_[idx1];
+    const float x2tFx1 =
+        points2_[idx2](0) * Fx1(0) + points2_[idx2](1) * Fx1(1) + Fx1(2);
+    return x2tFx1 * x2tFx1 / (norms1_[idx1] + norms2_[idx2]) > max_residual_;
+  } else {
+    return (terms1_[idx1].head<2>() - points2_[idx2]).squaredNorm() >
+           max_residual_;
+  }
+}
+
+}  // namespace colmap
+
+#endif  // COLMAP_SRC_FEATURE_SIFT_KERNELS_H_
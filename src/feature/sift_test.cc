@@ -36,6 +36,7 @@
 
 #include "SiftGPU/SiftGPU.h"
 #include "feature/sift.h"
+#include "feature/sift_kernels.h"
 #include "feature/utils.h"
 #include "util/math.h"
 #include "util/opengl_utils.h"
@@ -430,6 +431,242 @@ BOOST_AUTO_TEST_CASE(TestMatchSiftFeaturesCPUFLANNvsBruteForce) {
   }
 }
 
+BOOST_AUTO_TEST_CASE(TestMatchSiftFeaturesCPUDescriptorCodes) {
+  const FeatureDescriptors descriptors1 = CreateRandomFeatureDescriptors(100);
+  const FeatureDescriptors descriptors2 = descriptors1.colwise().reverse();
+  const FeatureDescriptorCodes empty_codes =
+      QuantizeFeatureDescriptors(CreateRandomFeatureDescriptors(0));
+  const FeatureDescriptorCodes codes1 =
+      QuantizeFeatureDescriptors(descriptors1);
+  const FeatureDescriptorCodes codes2 =
+      QuantizeFeatureDescriptors(descriptors2);
+
+  size_t num_read_rows = 0;
+  const auto MakeRowsReader = [&num_read_rows](
+                                  const FeatureDescriptors& descriptors) {
+    return [&num_read_rows, &descriptors](const std::vector<int>& rows) {
+      BOOST_CHECK(std::is_sorted(rows.begin(), rows.end()));
+      FeatureDescriptors descriptor_rows(rows.size(), descriptors.cols());
+      for (size_t i = 0; i < rows.size(); ++i) {
+        descriptor_rows.row(i) = descriptors.row(rows[i]);
+      }
+      num_read_rows += rows.size();
+      return descriptor_rows;
+    };
+  };
+  const FeatureDescriptorRowsReader read_descriptor_rows1 =
+      MakeRowsReader(descriptors1);
+  const FeatureDescriptorRowsReader read_descriptor_rows2 =
+      MakeRowsReader(descriptors2);
+
+  SiftMatchingOptions match_options;
+  match_options.use_descriptor_codes = true;
+
+  FeatureMatches matches_bf;
+  FeatureMatches matches_codes;
+
+  // Re-ranking all candidates of all descriptors is equivalent to exhaustive
+  // matching.
+  match_options.num_descriptor_code_candidates = 100;
+  match_options.descriptor_code_max_ratio = 1.0;
+  MatchSiftFeaturesCPUBruteForce(match_options, descriptors1, descriptors2,
+                                 &matches_bf);
+  MatchSiftFeaturesCPUDescriptorCodes(match_options, codes1, codes2,
+                                      read_descriptor_rows1,
+                                      read_descriptor_rows2, &matches_codes);
+  BOOST_CHECK_EQUAL(matches_bf.size(), 100);
+  CheckEqualMatches(matches_bf, matches_codes);
+  BOOST_CHECK_EQUAL(num_read_rows, 200);
+
+  match_options.num_descriptor_code_candidates = 8;
+  match_options.descriptor_code_max_ratio = 0.95;
+  MatchSiftFeaturesCPUDescriptorCodes(match_options, codes1, codes2,
+                                      read_descriptor_rows1,
+                                      read_descriptor_rows2, &matches_codes);
+  CheckEqualMatches(matches_bf, matches_codes);
+
+  match_options.cross_check = false;
+  MatchSiftFeaturesCPUBruteForce(match_options, descriptors1, descriptors2,
+                                 &matches_bf);
+  MatchSiftFeaturesCPUDescriptorCodes(match_options, codes1, codes2,
+                                      read_descriptor_rows1,
+                                      read_descriptor_rows2, &matches_codes);
+  CheckEqualMatches(matches_bf, matches_codes);
+  match_options.cross_check = true;
+
+  // Without the full descriptors, the candidates are ranked by their codes,
+  // which finds most of the identical descriptors.
+  num_read_rows = 0;
+  MatchSiftFeaturesCPUDescriptorCodes(match_options, codes1, codes2,
+                                      FeatureDescriptorRowsReader(),
+                                      FeatureDescriptorRowsReader(),
+                                      &matches_codes);
+  BOOST_CHECK_EQUAL(num_read_rows, 0);
+  BOOST_CHECK_GE(matches_codes.size(), 95);
+  for (const auto& match : matches_codes) {
+    BOOST_CHECK_EQUAL(match.point2D_idx1 + match.point2D_idx2, 99);
+  }
+
+  // Descriptors with ambiguous codes and their candidates are not read.
+  MatchSiftFeaturesCPUDescriptorCodes(match_options, codes1, codes2,
+                                      read_descriptor_rows1,
+                                      read_descriptor_rows2, &matches_codes);
+  const size_t num_read_rows_default = num_read_rows;
+  num_read_rows = 0;
+  match_options.descriptor_code_max_ratio = 0.1;
+  MatchSiftFeaturesCPUDescriptorCodes(match_options, codes1, codes2,
+                                      read_descriptor_rows1,
+                                      read_descriptor_rows2, &matches_codes);
+  BOOST_CHECK_LT(num_read_rows, num_read_rows_default);
+  BOOST_CHECK_LT(matches_codes.size(), matches_bf.size());
+  match_options.descriptor_code_max_ratio = 0.95;
+
+  MatchSiftFeaturesCPUDescriptorCodes(match_options, empty_codes, codes2,
+                                      read_descriptor_rows1,
+                                      read_descriptor_rows2, &matches_codes);
+  BOOST_CHECK_EQUAL(matches_codes.size(), 0);
+  MatchSiftFeaturesCPUDescriptorCodes(match_options, codes1, empty_codes,
+                                      read_descriptor_rows1,
+                                      read_descriptor_rows2, &matches_codes);
+  BOOST_CHECK_EQUAL(matches_codes.size(), 0);
+}
+
+BOOST_AUTO_TEST_CASE(TestSiftMatchingKernels) {
+  BOOST_CHECK(IsSiftMatchingKernelSupported(SiftMatchingKernel::AUTO));
+  BOOST_CHECK(IsSiftMatchingKernelSupported(SiftMatchingKernel::SCALAR));
+  BOOST_CHECK(IsSiftMatchingKernelSupported(GetBestSiftMatchingKernel()));
+
+  // Sizes that are not multiples of the tile and vector sizes.
+  const FeatureDescriptors descriptors1 = CreateRandomFeatureDescriptors(77);
+  const FeatureDescriptors descriptors2 =
+      CreateRandomFeatureDescriptors(301).colwise().reverse();
+
+  FeatureKeypoints keypoints1(descriptors1.rows());
+  for (auto& keypoint : keypoints1) {
+    keypoint = FeatureKeypoint(RandomReal(0.0f, 100.0f),
+                               RandomReal(0.0f, 100.0f));
+  }
+  FeatureKeypoints keypoints2(descriptors2.rows());
+  for (auto& keypoint : keypoints2) {
+    keypoint = FeatureKeypoint(RandomReal(0.0f, 100.0f),
+                               RandomReal(0.0f, 100.0f));
+  }
+
+  Eigen::Matrix3f F;
+  F << 0, -1, 50, 1, 0, -50, -50, 50, 0;
+  const SiftGuidedFilter guided_filter =
+      SiftGuidedFilter::Epipolar(F, keypoints1, keypoints2, 16.0f);
+
+  const std::vector<const SiftGuidedFilter*> filters = {nullptr,
+                                                        &guided_filter};
+  for (const SiftGuidedFilter* filter : filters) {
+    SiftNearestNeighbors ref_neighbors12;
+    SiftNearestNeighbors ref_neighbors21;
+    ComputeSiftNearestNeighbors(descriptors1, descriptors2, filter,
+                                &ref_neighbors12, &ref_neighbors21,
+                                SiftMatchingKernel::SCALAR);
+
+    // Compare against a sequential scan of the full distance matrix.
+    for (Eigen::Index i1 = 0; i1 < descriptors1.rows(); ++i1) {
+      int best_i2 = -1;
+      int best_dist = 0;
+      for (Eigen::Index i2 = 0; i2 < descriptors2.rows(); ++i2) {
+        if (filter != nullptr && filter->IsRejected(i1, i2)) {
+          continue;
+        }
+        const int dist = descriptors1.row(i1).cast<int>().dot(
+            descriptors2.row(i2).cast<int>());
+        if (dist > best_dist) {
+          best_i2 = i2;
+          best_dist = dist;
+        }
+      }
+      BOOST_CHECK_EQUAL(ref_neighbors12.best_idx[i1], best_i2);
+      BOOST_CHECK_EQUAL(ref_neighbors12.best_dist[i1], best_dist);
+    }
+
+    for (const auto kernel :
+         {SiftMatchingKernel::AUTO, SiftMatchingKernel::AVX2,
+          SiftMatchingKernel::AVX512_VNNI, SiftMatchingKernel::NEON}) {
+      if (!IsSiftMatchingKernelSupported(kernel)) {
+        continue;
+      }
+
+      SiftNearestNeighbors neighbors12;
+      SiftNearestNeighbors neighbors21;
+      ComputeSiftNearestNeighbors(descriptors1, descriptors2, filter,
+                                  &neighbors12, &neighbors21, kernel);
+      BOOST_CHECK(neighbors12.best_idx == ref_neighbors12.best_idx);
+      BOOST_CHECK(neighbors12.best_dist == ref_neighbors12.best_dist);
+      BOOST_CHECK(neighbors12.second_best_dist ==
+                  ref_neighbors12.second_best_dist);
+      BOOST_CHECK(neighbors21.best_idx == ref_neighbors21.best_idx);
+      BOOST_CHECK(neighbors21.best_dist == ref_neighbors21.best_dist);
+      BOOST_CHECK(neighbors21.second_best_dist ==
+                  ref_neighbors21.second_best_dist);
+    }
+  }
+}
+
+BOOST_AUTO_TEST_CASE(TestComputeSiftCodeCandidates) {
+  // Sizes that are not multiples of the code block size.
+  const FeatureDescriptorCodes codes1 =
+      QuantizeFeatureDescriptors(CreateRandomFeatureDescriptors(45));
+  const FeatureDescriptorCodes codes2 =
+      QuantizeFeatureDescriptors(CreateRandomFeatureDescriptors(77));
+  const Eigen::MatrixXi decoded_descriptors1 = codes1.Decode().cast<int>();
+  const Eigen::MatrixXi decoded_descriptors2 = codes2.Decode().cast<int>();
+
+  // With all codes as candidates, the candidates are ordered by the exact
+  // similarities of the decoded descriptors.
+  SiftCodeCandidates ref_candidates12;
+  ComputeSiftCodeCandidates(codes1, codes2, 80, &ref_candidates12,
+                            SiftMatchingKernel::SCALAR);
+  BOOST_CHECK_EQUAL(ref_candidates12.num_candidates, 80);
+  for (int i1 = 0; i1 < 45; ++i1) {
+    std::vector<int> idxs;
+    for (int k = 0; k < 80; ++k) {
+      const int i2 = ref_candidates12.idxs[i1 * 80 + k];
+      const int similarity = ref_candidates12.similarities[i1 * 80 + k];
+      if (k >= 77) {
+        BOOST_CHECK_EQUAL(i2, -1);
+        continue;
+      }
+      idxs.push_back(i2);
+      BOOST_CHECK_EQUAL(similarity, decoded_descriptors1.row(i1).dot(
+                                        decoded_descriptors2.row(i2)));
+      if (k > 0) {
+        BOOST_CHECK_LE(similarity,
+                       ref_candidates12.similarities[i1 * 80 + k - 1]);
+      }
+    }
+    std::sort(idxs.begin(), idxs.end());
+    for (int i2 = 0; i2 < 77; ++i2) {
+      BOOST_CHECK_EQUAL(idxs[i2], i2);
+    }
+  }
+
+  for (const int num_candidates : {2, 16, 80}) {
+    SiftCodeCandidates ref_candidates;
+    ComputeSiftCodeCandidates(codes1, codes2, num_candidates, &ref_candidates,
+                              SiftMatchingKernel::SCALAR);
+    for (const auto kernel :
+         {SiftMatchingKernel::AUTO, SiftMatchingKernel::AVX2,
+          SiftMatchingKernel::AVX512_VNNI, SiftMatchingKernel::NEON}) {
+      if (!IsSiftMatchingKernelSupported(kernel)) {
+        continue;
+      }
+
+      SiftCodeCandidates candidates;
+      ComputeSiftCodeCandidates(codes1, codes2, num_candidates, &candidates,
+                                kernel);
+      BOOST_CHECK_EQUAL(candidates.num_candidates, num_candidates);
+      BOOST_CHECK(candidates.idxs == ref_candidates.idxs);
+      BOOST_CHECK(candidates.similarities == ref_candidates.similarities);
+    }
+  }
+}
+
 BOOST_AUTO_TEST_CASE(TestMatchGuidedSiftFeaturesCPU) {
   FeatureKeypoints empty_keypoints(0);
   FeatureKeypoints keypoints1(2);
@@ -0,0 +1,346 @@
+// Copyright (c) 2018, ETH Zurich and UNC Chapel Hill.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//
+//     * Neither the name of ETH Zurich and UNC Chapel Hill nor the names of
+//       its contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Author: Johannes L. Schoenberger (jsch-at-demuc-dot-de)
+
+
+#include "feature/split_views.h"
+
+#include <unordered_map>
+
+#include "util/logging.h"
+#include "util/math.h"
+
+namespace colmap {
+namespace {
+
+// Drop the keypoints and descriptors for which `retain` is false, while
+// keeping the order of the remaining features.
+void CompactFeatures(const std::vector<bool>& retain,
+                     FeatureKeypoints* keypoints,
+                     FeatureDescriptors* descriptors) {
+  CHECK_EQ(retain.size(), keypoints->size());
+  CHECK_EQ(keypoints->size(), static_cast<size_t>(descriptors->rows()));
+  size_t out_index = 0;
+  for (size_t i = 0; i < keypoints->size(); ++i) {
+    if (retain[i]) {
+      if (out_index != i) {
+        (*keypoints)[out_index] = (*keypoints)[i];
+        descriptors->row(out_index) = descriptors->row(i);
+      }
+      out_index += 1;
+    }
+  }
+  keypoints->resize(out_index);
+  descriptors->conservativeResize(out_index, descriptors->cols());
+}
+
+}  // namespace
+
+SplitViewRemap::SplitViewRemap(const int image_width, const int image_height,
+                               const double principal_point_x,
+                               const double principal_point_y,
+                               const double min_radius,
+                               const double max_radius, const int num_views)
+    : image_width_(image_width),
+      image_height_(image_height),
+      principal_point_x_(principal_point_x),
+      principal_point_y_(principal_point_y),
+      min_radius_(min_radius),
+      max_radius_(max_radius),
+      num_views_(num_views) {
+  CHECK_GT(image_width_, 0);
+  CHECK_GT(image_height_, 0);
+  CHECK_GE(min_radius_, 0);
+  CHECK_GT(max_radius_, min_radius_);
+  CHECK_GE(num_views_, 2);
+
+  const double view_angle = 4 * M_PI / num_views_;
+  angular_scale_ = 0.5 * (min_radius_ + max_radius_);
+  view_width_ = static_cast<int>(std::ceil(view_angle * angular_scale_));
+  view_height_ = static_cast<int>(std::ceil(max_radius_ - min_radius_));
+
+  offsets_.resize(static_cast<size_t>(view_width_) * view_height_);
+  for (int y = 0; y < view_height_; ++y) {
+    const double radius = max_radius_ - (y + 0.5);
+    for (int x = 0; x < view_width_; ++x) {
+      const double angle = (x + 0.5) / angular_scale_;
+      offsets_[y * view_width_ + x] =
+          Eigen::Vector2f(radius * std::cos(angle), radius * std::sin(angle));
+    }
+  }
+}
+
+int SplitViewRemap::ImageWidth() const { return image_width_; }
+
+int SplitViewRemap::ImageHeight() const { return image_height_; }
+
+int SplitViewRemap::NumViews() const { return num_views_; }
+
+int SplitViewRemap::ViewWidth() const { return view_width_; }
+
+int SplitViewRemap::ViewHeight() const { return view_height_; }
+
+bool SplitViewRemap::IsCompatible(const int image_width, const int image_height,
+                                  const double principal_point_x,
+                                  const double principal_point_y,
+                                  const double min_radius,
+                                  const double max_radius,
+                                  const int num_views) const {
+  return image_width_ == image_width && image_height_ == image_height &&
+         principal_point_x_ == principal_point_x &&
+         principal_point_y_ == principal_point_y &&
+         min_radius_ == min_radius && max_radius_ == max_radius &&
+         num_views_ == num_views;
+}
+
+Bitmap SplitViewRemap::ExtractView(const std::vector<uint8_t>& image_data,
+                                   const int view_idx) const {
+  CHECK_EQ(image_data.size(),
+           static_cast<size_t>(image_width_) * image_height_);
+  CHECK_GE(view_idx, 0);
+  CHECK_LT(view_idx, num_views_);
+
+  const float rotation = static_cast<float>(2 * M_PI * view_idx / num_views_);
+  const float cos_rotation = std::cos(rotation);
+  const float sin_rotation = std::sin(rotation);
+
+  // Shift the principal point by half a pixel, since the pixel centers of the
+  // image data are at integer coordinates.
+  const float principal_point_x = static_cast<float>(principal_point_x_ - 0.5);
+  const float principal_point_y = static_cast<float>(principal_point_y_ - 0.5);
+
+  Bitmap view;
+  view.Allocate(view_width_, view_height_, false);
+  view.Fill(BitmapColor<uint8_t>(0));
+
+  for (int y = 0; y < view_height_; ++y) {
+    const Eigen::Vector2f* offsets = offsets_.data() + y * view_width_;
+    for (int x = 0; x < view_width_; ++x) {
+      const float u = principal_point_x + cos_rotation * offsets[x].x() -
+                      sin_rotation * offsets[x].y();
+      const float v = principal_point_y + sin_rotation * offsets[x].x() +
+                      cos_rotation * offsets[x].y();
+
+      const int u0 = static_cast<int>(std::floor(u));
+      const int v0 = static_cast<int>(std::floor(v));
+      if (u0 < 0 || v0 < 0 || u0 + 1 >= image_width_ ||
+          v0 + 1 >= image_height_) {
+        continue;
+      }
+
+      const float du = u - u0;
+      const float dv = v - v0;
+      const uint8_t* row0 = image_data.data() + v0 * image_width_ + u0;
+      const uint8_t* row1 = row0 + image_width_;
+      const float value =
+          (1 - dv) * ((1 - du) * row0[0] + du * row0[1]) +
+          dv * ((1 - du) * row1[0] + du * row1[1]);
+
+      view.SetPixel(x, y, BitmapColor<float>(value).Cast<uint8_t>());
+    }
+  }
+
+  return view;
+}
+
+bool SplitViewRemap::MapToImage(const int view_idx,
+                                FeatureKeypoint* keypoint) const {
+  CHECK_GE(view_idx, 0);
+  CHECK_LT(view_idx, num_views_);
+
+  const double radius = max_radius_ - keypoint->y;
+  const double angle =
+      2 * M_PI * view_idx / num_views_ + keypoint->x / angular_scale_;
+  const double cos_angle = std::cos(angle);
+  const double sin_angle = std::sin(angle);
+
+  const double x = principal_point_x_ + radius * cos_angle;
+  const double y = principal_point_y_ + radius * sin_angle;
+  if (x < 0 || y < 0 || x >= image_width_ || y >= image_height_) {
+    return false;
+  }
+
+  // Transform the affine shape with the Jacobian of the view to image mapping.
+  Eigen::Matrix2d J;
+  J << -radius * sin_angle / angular_scale_, -cos_angle,
+      radius * cos_angle / angular_scale_, -sin_angle;
+  Eigen::Matrix2d A;
+  A << keypoint->a11, keypoint->a12, keypoint->a21, keypoint->a22;
+  const Eigen::Matrix2d JA = J * A;
+
+  *keypoint = FeatureKeypoint(x, y, JA(0, 0), JA(0, 1), JA(1, 0), JA(1, 1));
+
+  return true;
+}
+
+bool ExtractSplitViewFeatures(const SplitViewRemap& remap,
+                              const Bitmap& bitmap,
+                              const double max_duplicate_distance,
+                              const SplitViewExtractionFunc& extraction_func,
+                              ThreadPool* thread_pool,
+                              FeatureKeypoints* keypoints,
+                              FeatureDescriptors* descriptors) {
+  CHECK(bitmap.IsGrey());
+  CHECK_EQ(bitmap.Width(), remap.ImageWidth());
+  CHECK_EQ(bitmap.Height(), remap.ImageHeight());
+  CHECK_NOTNULL(keypoints);
+  CHECK_NOTNULL(descriptors);
+
+  const std::vector<uint8_t> image_data = bitmap.ConvertToRowMajorArray();
+
+  const int num_views = remap.NumViews();
+  std::vector<FeatureKeypoints> view_keypoints(num_views);
+  std::vector<FeatureDescriptors> view_descriptors(num_views);
+
+  auto ExtractView = [&](const int view_idx) {
+    const Bitmap view = remap.ExtractView(image_data, view_idx);
+    auto& keypoints = view_keypoints[view_idx];
+    auto& descriptors = view_descriptors[view_idx];
+    if (!extraction_func(view, &keypoints, &descriptors)) {
+      return false;
+    }
+
+    std::vector<bool> retain(keypoints.size());
+    for (size_t i = 0; i < keypoints.size(); ++i) {
+      retain[i] = remap.MapToImage(view_idx, &keypoints[i]);
+    }
+    CompactFeatures(retain, &keypoints, &descriptors);
+
+    return true;
+  };
+
+  bool success = true;
+  if (thread_pool == nullptr) {
+    for (int view_idx = 0; view_idx < num_views; ++view_idx) {
+      success = success && ExtractView(view_idx);
+    }
+  } else {
+    std::vector<std::future<bool>> futures;
+    futures.reserve(num_views);
+    for (int view_idx = 0; view_idx < num_views; ++view_idx) {
+      futures.push_back(thread_pool->AddTask(ExtractView, view_idx));
+    }
+    for (auto& future : futures) {
+      success = future.get() && success;
+    }
+  }
+
+  if (!success) {
+    return false;
+  }
+
+  size_t num_features = 0;
+  int num_dims = 0;
+  for (int view_idx = 0; view_idx < num_views; ++view_idx) {
+    num_features += view_keypoints[view_idx].size();
+    if (view_descriptors[view_idx].rows() > 0) {
+      num_dims = view_descriptors[view_idx].cols();
+    }
+  }
+
+  keypoints->clear();
+  keypoints->reserve(num_features);
+  descriptors->resize(num_features, num_dims);
+  std::vector<int> view_idxs;
+  view_idxs.reserve(num_features);
+  for (int view_idx = 0; view_idx < num_views; ++view_idx) {
+    const auto& keypoints_view = view_keypoints[view_idx];
+    if (keypoints_view.empty()) {
+      continue;
+    }
+    CHECK_EQ(view_descriptors[view_idx].cols(), num_dims);
+    descriptors->middleRows(keypoints->size(), keypoints_view.size()) =
+        view_descriptors[view_idx];
+    keypoints->insert(keypoints->end(), keypoints_view.begin(),
+                      keypoints_view.end());
+    view_idxs.resize(keypoints->size(), view_idx);
+  }
+
+  RemoveSplitViewDuplicates(view_idxs, max_duplicate_distance, keypoints,
+                            descriptors);
+
+  return true;
+}
+
+void RemoveSplitViewDuplicates(const std::vector<int>& view_idxs,
+                               const double max_distance,
+                               FeatureKeypoints* keypoints,
+                               FeatureDescriptors* descriptors) {
+  CHECK_EQ(view_idxs.size(), keypoints->size());
+  if (max_distance <= 0) {
+    return;
+  }
+
+  const double max_squared_distance = max_distance * max_distance;
+
+  // Maps the cell coordinates to the indices of the retained keypoints.
+  std::unordered_map<uint64_t, std::vector<size_t>> grid;
+  auto CellKey = [](const int64_t cell_x, const int64_t cell_y) {
+    return (static_cast<uint64_t>(cell_x) << 32) ^
+           static_cast<uint64_t>(static_cast<uint32_t>(cell_y));
+  };
+
+  std::vector<bool> retain(keypoints->size(), true);
+  for (size_t i = 0; i < keypoints->size(); ++i) {
+    const auto& keypoint = (*keypoints)[i];
+    const int64_t cell_x =
+        static_cast<int64_t>(std::floor(keypoint.x / max_distance));
+    const int64_t cell_y =
+        static_cast<int64_t>(std::floor(keypoint.y / max_distance));
+
+    for (int64_t y = cell_y - 1; y <= cell_y + 1 && retain[i]; ++y) {
+      for (int64_t x = cell_x - 1; x <= cell_x + 1 && retain[i]; ++x) {
+        const auto cell = grid.find(CellKey(x, y));
+        if (cell == grid.end()) {
+          continue;
+        }
+        for (const size_t j : cell->second) {
+          if (view_idxs[j] == view_idxs[i]) {
+            continue;
+          }
+          const double dx = keypoint.x - (*keypoints)[j].x;
+          const double dy = keypoint.y - (*keypoints)[j].y;
+          if (dx * dx + dy * dy < max_squared_distance) {
+            retain[i] = false;
+            break;
+          }
+        }
+      }
+    }
+
+    if (retain[i]) {
+      grid[CellKey(cell_x, cell_y)].push_back(i);
+    }
+  }
+
+  CompactFeatures(retain, keypoints, descriptors);
+}
+
+}  // namespace colmap
@@ -0,0 +1,133 @@
+// Copyright (c) 2018, ETH Zurich and UNC Chapel Hill.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//
+//     * Neither the name of ETH Zurich and UNC Chapel Hill nor the names of
+//       its contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Author: Johannes L. Schoenberger (jsch-at-demuc-dot-de)
+
+
+#ifndef COLMAP_SRC_FEATURE_SPLIT_VIEWS_H_
+#define COLMAP_SRC_FEATURE_SPLIT_VIEWS_H_
+
+#include <functional>
+#include <vector>
+
+#include <Eigen/Core>
+
+#include "feature/types.h"
+#include "util/bitmap.h"
+#include "util/threading.h"
+
+namespace colmap {
+
+// Remap table to unwrap the ring between an inner and an outer radius around
+// the principal point of a catadioptric or wide fisheye image into multiple
+// overlapping views. The views are evenly distributed around the principal
+// point and each view spans twice the angular spacing of the views, such that
+// every part of the ring is covered by two adjacent views. The columns of a
+// view correspond to the polar angle and the rows to the radius, which
+// decreases from the top to the bottom of the view. The radial and angular
+// sampling rates are equal at the mean radius and the mapping preserves the
+// orientation of the image, so that descriptors of the views are compatible
+// with descriptors of the original image.
+class SplitViewRemap {
+ public:
+  SplitViewRemap(const int image_width, const int image_height,
+                 const double principal_point_x, const double principal_point_y,
+                 const double min_radius, const double max_radius,
+                 const int num_views);
+
+  int ImageWidth() const;
+  int ImageHeight() const;
+  int NumViews() const;
+  int ViewWidth() const;
+  int ViewHeight() const;
+
+  // Check whether the remap table was built for the given parameters.
+  bool IsCompatible(const int image_width, const int image_height,
+                    const double principal_point_x,
+                    const double principal_point_y, const double min_radius,
+                    const double max_radius, const int num_views) const;
+
+  // Sample a view by bilinear interpolation from the row-major grayscale
+  // image data. Pixels outside the image are set to black.
+  Bitmap ExtractView(const std::vector<uint8_t>& image_data,
+                     const int view_idx) const;
+
+  // Map the location and affine shape of a keypoint detected in a view back
+  // into the original image. Returns false if the keypoint falls outside the
+  // image.
+  bool MapToImage(const int view_idx, FeatureKeypoint* keypoint) const;
+
+ private:
+  int image_width_;
+  int image_height_;
+  double principal_point_x_;
+  double principal_point_y_;
+  double min_radius_;
+  double max_radius_;
+  int num_views_;
+  int view_width_;
+  int view_height_;
+
+  // Number of view pixels per radian of the polar angle.
+  double angular_scale_;
+
+  // Offsets from the principal point of the view pixels for the first view,
+  // from which the other views follow by rotation around the principal point.
+  std::vector<Eigen::Vector2f> offsets_;
+};
+
+// Extract features from all views of the grayscale bitmap using the given
+// extraction function and map them back into the bitmap. The views are
+// extracted in parallel if a thread pool is given, and the features are
+// concatenated in the order of the views. Duplicate keypoints in the overlap
+// of different views with a distance of less than `max_duplicate_distance`
+// pixels are removed.
+typedef std::function<bool(const Bitmap&, FeatureKeypoints*,
+                           FeatureDescriptors*)>
+    SplitViewExtractionFunc;
+bool ExtractSplitViewFeatures(const SplitViewRemap& remap,
+                              const Bitmap& bitmap,
+                              const double max_duplicate_distance,
+                              const SplitViewExtractionFunc& extraction_func,
+                              ThreadPool* thread_pool,
+                              FeatureKeypoints* keypoints,
+                              FeatureDescriptors* descriptors);
+
+// Remove keypoints that are closer than `max_distance` to a previously
+// retained keypoint from another view, where `view_idxs` contains the view of
+// each keypoint. The neighbors are found using a spatial hash grid with a cell
+// size equal to the maximum distance.
+void RemoveSplitViewDuplicates(const std::vector<int>& view_idxs,
+                               const double max_distance,
+                               FeatureKeypoints* keypoints,
+                               FeatureDescriptors* descriptors);
+
+}  // namespace colmap
+
+#endif  // COLMAP_SRC_FEATURE_SPLIT_VIEWS_H_
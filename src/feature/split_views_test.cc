@@ -0,0 +1,175 @@
+// Copyright (c) 2018, ETH Zurich and UNC Chapel Hill.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//
+//     * Neither the name of ETH Zurich and UNC Chapel Hill nor the names of
+//       its contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Author: Johannes L. Schoenberger (jsch-at-demuc-dot-de)
+
+
+#define TEST_NAME "feature/split_views"
+#include "util/testing.h"
+
+#include "feature/split_views.h"
+
+using namespace colmap;
+
+BOOST_AUTO_TEST_CASE(TestSplitViewRemapDimensions) {
+  const SplitViewRemap remap(100, 80, 50, 40, 10, 30, 8);
+  BOOST_CHECK_EQUAL(remap.ImageWidth(), 100);
+  BOOST_CHECK_EQUAL(remap.ImageHeight(), 80);
+  BOOST_CHECK_EQUAL(remap.NumViews(), 8);
+  BOOST_CHECK_EQUAL(remap.ViewWidth(), 32);
+  BOOST_CHECK_EQUAL(remap.ViewHeight(), 20);
+  BOOST_CHECK(remap.IsCompatible(100, 80, 50, 40, 10, 30, 8));
+  BOOST_CHECK(!remap.IsCompatible(100, 80, 50, 41, 10, 30, 8));
+  BOOST_CHECK(!remap.IsCompatible(100, 80, 50, 40, 10, 30, 4));
+}
+
+BOOST_AUTO_TEST_CASE(TestSplitViewRemapExtractView) {
+  // Horizontal gradient, such that the intensity equals the column index.
+  const int kWidth = 100;
+  const int kHeight = 80;
+  std::vector<uint8_t> image_data(kWidth * kHeight);
+  for (int y = 0; y < kHeight; ++y) {
+    for (int x = 0; x < kWidth; ++x) {
+      image_data[y * kWidth + x] = x;
+    }
+  }
+
+  const SplitViewRemap remap(kWidth, kHeight, 50, 40, 10, 30, 8);
+  for (int view_idx = 0; view_idx < remap.NumViews(); ++view_idx) {
+    const Bitmap view = remap.ExtractView(image_data, view_idx);
+    BOOST_CHECK(view.IsGrey());
+    BOOST_CHECK_EQUAL(view.Width(), remap.ViewWidth());
+    BOOST_CHECK_EQUAL(view.Height(), remap.ViewHeight());
+    for (int y = 0; y < view.Height(); ++y) {
+      for (int x = 0; x < view.Width(); ++x) {
+        FeatureKeypoint keypoint(x + 0.5f, y + 0.5f);
+        BOOST_CHECK(remap.MapToImage(view_idx, &keypoint));
+        BitmapColor<uint8_t> color;
+        BOOST_CHECK(view.GetPixel(x, y, &color));
+        BOOST_CHECK_LE(std::abs(color.r - (keypoint.x - 0.5f)), 1.0f);
+      }
+    }
+  }
+}
+
+BOOST_AUTO_TEST_CASE(TestSplitViewRemapMapToImage) {
+  const SplitViewRemap remap(100, 80, 50, 40, 10, 30, 4);
+
+  // The top left corner of the first view is on the outer radius.
+  FeatureKeypoint keypoint(0, 0);
+  BOOST_CHECK(remap.MapToImage(0, &keypoint));
+  BOOST_CHECK_CLOSE(keypoint.x, 80, 1e-4);
+  BOOST_CHECK_CLOSE(keypoint.y, 40, 1e-4);
+
+  // The second view starts at a quarter rotation.
+  keypoint = FeatureKeypoint(0, remap.ViewHeight());
+  BOOST_CHECK(remap.MapToImage(1, &keypoint));
+  BOOST_CHECK_CLOSE(keypoint.x, 50, 1e-4);
+  BOOST_CHECK_CLOSE(keypoint.y, 50, 1e-4);
+
+  // The mapping preserves the orientation and is isotropic at the mean radius.
+  keypoint = FeatureKeypoint(10, 10, 1, 0, 0, 1);
+  BOOST_CHECK(remap.MapToImage(0, &keypoint));
+  BOOST_CHECK_CLOSE(keypoint.a11 * keypoint.a22 - keypoint.a12 * keypoint.a21,
+                    1, 1e-4);
+  BOOST_CHECK_CLOSE(keypoint.ComputeScaleX(), 1, 1e-4);
+  BOOST_CHECK_CLOSE(keypoint.ComputeScaleY(), 1, 1e-4);
+
+  // Keypoints outside the image are rejected.
+  const SplitViewRemap large_remap(100, 80, 50, 40, 10, 60, 4);
+  keypoint = FeatureKeypoint(0, 0);
+  BOOST_CHECK(!large_remap.MapToImage(0, &keypoint));
+}
+
+BOOST_AUTO_TEST_CASE(TestRemoveSplitViewDuplicates) {
+  FeatureKeypoints keypoints = {
+      FeatureKeypoint(10, 10), FeatureKeypoint(10.5, 10),
+      FeatureKeypoint(11, 10), FeatureKeypoint(20, 20),
+      FeatureKeypoint(21.9, 20), FeatureKeypoint(-1, -1),
+      FeatureKeypoint(-1.5, -1)};
+  const std::vector<int> view_idxs = {0, 0, 1, 1, 2, 2, 3};
+  FeatureDescriptors descriptors(keypoints.size(), 2);
+  for (int i = 0; i < descriptors.rows(); ++i) {
+    descriptors.row(i).setConstant(i);
+  }
+
+  RemoveSplitViewDuplicates(view_idxs, 2, &keypoints, &descriptors);
+
+  BOOST_CHECK_EQUAL(keypoints.size(), 4);
+  BOOST_CHECK_EQUAL(descriptors.rows(), 4);
+  BOOST_CHECK_EQUAL(keypoints[0].x, 10);
+  BOOST_CHECK_EQUAL(keypoints[1].x, 10.5);
+  BOOST_CHECK_EQUAL(keypoints[2].x, 20);
+  BOOST_CHECK_EQUAL(keypoints[3].x, -1);
+  BOOST_CHECK_EQUAL(descriptors(0, 0), 0);
+  BOOST_CHECK_EQUAL(descriptors(1, 0), 1);
+  BOOST_CHECK_EQUAL(descriptors(2, 0), 3);
+  BOOST_CHECK_EQUAL(descriptors(3, 0), 5);
+}
+
+BOOST_AUTO_TEST_CASE(TestExtractSplitViewFeatures) {
+  Bitmap bitmap;
+  bitmap.Allocate(100, 80, false);
+  const SplitViewRemap remap(100, 80, 50, 40, 10, 30, 8);
+
+  // Detect one feature in the center of each view and one feature close to
+  // the left border, which is a duplicate of the right part of the previous
+  // view.
+  std::atomic<int> num_calls(0);
+  auto ExtractionFunc = [&](const Bitmap& view, FeatureKeypoints* keypoints,
+                            FeatureDescriptors* descriptors) {
+    num_calls += 1;
+    BOOST_CHECK_EQUAL(view.Width(), remap.ViewWidth());
+    BOOST_CHECK_EQUAL(view.Height(), remap.ViewHeight());
+    keypoints->clear();
+    keypoints->emplace_back(view.Width() / 2.0f, view.Height() / 2.0f);
+    keypoints->emplace_back(1.0f, view.Height() / 2.0f);
+    descriptors->resize(2, 128);
+    descriptors->setZero();
+    return true;
+  };
+
+  ThreadPool thread_pool(4);
+  for (ThreadPool* pool : {static_cast<ThreadPool*>(nullptr), &thread_pool}) {
+    num_calls = 0;
+    FeatureKeypoints keypoints;
+    FeatureDescriptors descriptors;
+    BOOST_CHECK(ExtractSplitViewFeatures(remap, bitmap, 0, ExtractionFunc,
+                                         pool, &keypoints, &descriptors));
+    BOOST_CHECK_EQUAL(num_calls, 8);
+    BOOST_CHECK_EQUAL(keypoints.size(), 16);
+    BOOST_CHECK_EQUAL(descriptors.rows(), 16);
+    BOOST_CHECK_EQUAL(descriptors.cols(), 128);
+
+    BOOST_CHECK(ExtractSplitViewFeatures(remap, bitmap, 2, ExtractionFunc,
+                                         pool, &keypoints, &descriptors));
+    BOOST_CHECK_EQUAL(keypoints.size(), 8);
+    BOOST_CHECK_EQUAL(descriptors.rows(), 8);
+  }
+}
@@ -104,4 +104,21 @@ float FeatureKeypoint::ComputeShear() const {
   return std::atan2(-a12, a22) - ComputeOrientation();
 }
 
+const int FeatureDescriptorCodes::kNumDims;
+const int FeatureDescriptorCodes::kNumSubspaces;
+const int FeatureDescriptorCodes::kNumSubspaceDims;
+const int FeatureDescriptorCodes::kNumCentroids;
+const int FeatureDescriptorCodes::kNumCodeBytes;
+
+FeatureDescriptors FeatureDescriptorCodes::Decode() const {
+  FeatureDescriptors descriptors(codes.rows(), kNumDims);
+  for (Eigen::Index row = 0; row < codes.rows(); ++row) {
+    for (int s = 0; s < kNumSubspaces; ++s) {
+      descriptors.block<1, kNumSubspaceDims>(row, s * kNumSubspaceDims) =
+          codebook.row(s * kNumCentroids + Code(row, s));
+    }
+  }
+  return descriptors;
+}
+
 }  // namespace colmap
@@ -98,6 +98,53 @@ typedef Eigen::Matrix<uint8_t, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>
     FeatureDescriptors;
 typedef std::vector<FeatureMatch> FeatureMatches;
 
+// Product-quantized feature descriptors, which are stored in addition to or
+// instead of the full descriptors and allow to search for nearest neighbors on
+// compact codes. The descriptor dimensions are split into consecutive
+// subspaces and each subspace of a descriptor is encoded by the index of its
+// nearest centroid in the per-image codebook.
+struct FeatureDescriptorCodes {
+  enum class Format {
+    UNDEFINED = 0,
+    // 32 subspaces of 4 dimensions with 16 centroids each, where two 4-bit
+    // codes are packed into one byte.
+    PQ_32x16 = 1,
+  };
+
+  static const int kNumDims = 128;
+  static const int kNumSubspaces = 32;
+  static const int kNumSubspaceDims = kNumDims / kNumSubspaces;
+  static const int kNumCentroids = 16;
+  static const int kNumCodeBytes = kNumSubspaces / 2;
+
+  // Extract the centroid index of the given subspace for the given row.
+  inline int Code(const Eigen::Index row, const int subspace) const;
+
+  // Approximate the descriptors by the centroids of their codes.
+  FeatureDescriptors Decode() const;
+
+  Format format = Format::UNDEFINED;
+
+  // The centroids of the subspace `s` are stored in the rows
+  // `[s * kNumCentroids, (s + 1) * kNumCentroids)`, i.e., the codebook has
+  // `kNumSubspaces * kNumCentroids` rows and `kNumSubspaceDims` columns.
+  FeatureDescriptors codebook;
+
+  // The codes with one row per descriptor and `kNumCodeBytes` columns, where
+  // the code of the even subspace is stored in the lower 4 bits.
+  FeatureDescriptors codes;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// Implementation
+////////////////////////////////////////////////////////////////////////////////
+
+int FeatureDescriptorCodes::Code(const Eigen::Index row,
+                                 const int subspace) const {
+  const uint8_t code = codes(row, subspace / 2);
+  return (subspace % 2 == 0) ? (code & 0xF) : (code >> 4);
+}
+
 }  // namespace colmap
 
 #endif  // COLMAP_SRC_FEATURE_TYPES_H_
@@ -31,9 +31,28 @@
 
 #include "feature/utils.h"
 
+#include "util/logging.h"
 #include "util/math.h"
 
 namespace colmap {
+namespace {
+
+typedef Eigen::Matrix<float, FeatureDescriptorCodes::kNumCentroids,
+                      FeatureDescriptorCodes::kNumSubspaceDims, Eigen::RowMajor>
+    SubspaceCentroids;
+
+template <typename Derived>
+int FindNearestCentroid(const SubspaceCentroids& centroids,
+                        const Eigen::MatrixBase<Derived>& values) {
+  int nearest_idx;
+  (centroids.rowwise() - values.template cast<float>())
+      .rowwise()
+      .squaredNorm()
+      .minCoeff(&nearest_idx);
+  return nearest_idx;
+}
+
+}  // namespace
 
 std::vector<Eigen::Vector2d> FeatureKeypointsToPointsVector(
     const FeatureKeypoints& keypoints) {
@@ -76,6 +95,99 @@ FeatureDescriptors FeatureDescriptorsToUnsignedByte(
   return descriptors_unsigned_byte;
 }
 
+FeatureDescriptorCodes QuantizeFeatureDescriptors(
+    const FeatureDescriptors& descriptors) {
+  typedef FeatureDescriptorCodes Codes;
+  CHECK_EQ(descriptors.cols(), Codes::kNumDims);
+
+  const Eigen::Index kMaxNumTrainingDescriptors = 4096;
+  const int kMaxNumIterations = 10;
+
+  Codes codes;
+  codes.format = Codes::Format::PQ_32x16;
+  codes.codebook = FeatureDescriptors::Zero(
+      Codes::kNumSubspaces * Codes::kNumCentroids, Codes::kNumSubspaceDims);
+  codes.codes = FeatureDescriptors::Zero(descriptors.rows(),
+                                         Codes::kNumCodeBytes);
+
+  if (descriptors.rows() == 0) {
+    return codes;
+  }
+
+  const Eigen::Index num_training_descriptors =
+      std::min(descriptors.rows(), kMaxNumTrainingDescriptors);
+  std::vector<Eigen::Index> training_rows(num_training_descriptors);
+  for (Eigen::Index i = 0; i < num_training_descriptors; ++i) {
+    training_rows[i] = i * descriptors.rows() / num_training_descriptors;
+  }
+
+  std::vector<int> assignments(num_training_descriptors);
+
+  for (int subspace = 0; subspace < Codes::kNumSubspaces; ++subspace) {
+    const auto SubspaceValues = [&](const Eigen::Index row) {
+      return descriptors.block<1, Codes::kNumSubspaceDims>(
+          row, subspace * Codes::kNumSubspaceDims);
+    };
+
+    // Initialize the centroids with evenly spaced training descriptors.
+    SubspaceCentroids centroids;
+    for (int c = 0; c < Codes::kNumCentroids; ++c) {
+      centroids.row(c) =
+          SubspaceValues(training_rows[c * num_training_descriptors /
+                                       Codes::kNumCentroids])
+              .cast<float>();
+    }
+
+    for (int iteration = 0; iteration < kMaxNumIterations; ++iteration) {
+      SubspaceCentroids sums = SubspaceCentroids::Zero();
+      Eigen::Matrix<int, Codes::kNumCentroids, 1> counts =
+          Eigen::Matrix<int, Codes::kNumCentroids, 1>::Zero();
+      bool changed = iteration == 0;
+      for (Eigen::Index i = 0; i < num_training_descriptors; ++i) {
+        const auto values = SubspaceValues(training_rows[i]);
+        const int nearest_idx = FindNearestCentroid(centroids, values);
+        if (assignments[i] != nearest_idx) {
+          assignments[i] = nearest_idx;
+          changed = true;
+        }
+        sums.row(nearest_idx) += values.cast<float>();
+        counts(nearest_idx) += 1;
+      }
+
+      if (!changed) {
+        break;
+      }
+
+      // Empty clusters keep their previous centroid.
+      for (int c = 0; c < Codes::kNumCentroids; ++c) {
+        if (counts(c) > 0) {
+          centroids.row(c) = sums.row(c) / counts(c);
+        }
+      }
+    }
+
+    // Encode with the rounded centroids that are actually stored.
+    for (int c = 0; c < Codes::kNumCentroids; ++c) {
+      for (int d = 0; d < Codes::kNumSubspaceDims; ++d) {
+        const uint8_t value =
+            TruncateCast<float, uint8_t>(std::round(centroids(c, d)));
+        codes.codebook(subspace * Codes::kNumCentroids + c, d) = value;
+        centroids(c, d) = value;
+      }
+    }
+
+    const int shift = (subspace % 2 == 0) ? 0 : 4;
+    for (Eigen::Index row = 0; row < descriptors.rows(); ++row) {
+      const int nearest_idx =
+          FindNearestCentroid(centroids, SubspaceValues(row));
+      codes.codes(row, subspace / 2) |=
+          static_cast<uint8_t>(nearest_idx << shift);
+    }
+  }
+
+  return codes;
+}
+
 void ExtractTopScaleFeatures(FeatureKeypoints* keypoints,
                              FeatureDescriptors* descriptors,
                              const size_t num_features) {
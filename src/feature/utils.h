@@ -57,6 +57,13 @@ Eigen::MatrixXf L1RootNormalizeFeatureDescriptors(
 FeatureDescriptors FeatureDescriptorsToUnsignedByte(
     const Eigen::MatrixXf& descriptors);
 
+// Product-quantize unsigned byte feature descriptors (see
+// `FeatureDescriptorCodes`). The codebook is trained by k-means on a strided
+// subset of the given descriptors, so the codes of an image only refer to its
+// own codebook. The quantization is deterministic.
+FeatureDescriptorCodes QuantizeFeatureDescriptors(
+    const FeatureDescriptors& descriptors);
+
 // Extract the descriptors corresponding to the largest-scale features.
 void ExtractTopScaleFeatures(FeatureKeypoints* keypoints,
                              FeatureDescriptors* descriptors,
@@ -80,6 +80,47 @@ BOOST_AUTO_TEST_CASE(TestFeatureDescriptorsToUnsignedByte) {
   }
 }
 
+BOOST_AUTO_TEST_CASE(TestQuantizeFeatureDescriptors) {
+  const FeatureDescriptorCodes empty_codes =
+      QuantizeFeatureDescriptors(FeatureDescriptors(0, 128));
+  BOOST_CHECK(empty_codes.format == FeatureDescriptorCodes::Format::PQ_32x16);
+  BOOST_CHECK_EQUAL(empty_codes.codes.rows(), 0);
+  BOOST_CHECK_EQUAL(empty_codes.codebook.rows(), 32 * 16);
+  BOOST_CHECK_EQUAL(empty_codes.codebook.cols(), 4);
+
+  // As many descriptors as centroids are represented exactly.
+  const FeatureDescriptors descriptors16 = FeatureDescriptors::Random(16, 128);
+  const FeatureDescriptorCodes codes16 =
+      QuantizeFeatureDescriptors(descriptors16);
+  BOOST_CHECK_EQUAL(codes16.codes.rows(), 16);
+  BOOST_CHECK_EQUAL(codes16.codes.cols(), 16);
+  BOOST_CHECK_EQUAL(codes16.Decode(), descriptors16);
+
+  Eigen::MatrixXf descriptors = Eigen::MatrixXf::Random(1000, 128);
+  descriptors.array() += 1.0f;
+  const FeatureDescriptors descriptors_uint8 = FeatureDescriptorsToUnsignedByte(
+      L2NormalizeFeatureDescriptors(descriptors));
+  const FeatureDescriptorCodes codes =
+      QuantizeFeatureDescriptors(descriptors_uint8);
+  BOOST_CHECK_EQUAL(codes.codes.rows(), 1000);
+
+  const Eigen::MatrixXf decoded_descriptors = codes.Decode().cast<float>();
+  const Eigen::MatrixXf original_descriptors =
+      descriptors_uint8.cast<float>();
+  const Eigen::RowVectorXf mean_descriptor =
+      original_descriptors.colwise().mean();
+  const float quantization_error =
+      (decoded_descriptors - original_descriptors).squaredNorm();
+  const float mean_error =
+      (original_descriptors.rowwise() - mean_descriptor).squaredNorm();
+  BOOST_CHECK_LT(quantization_error, 0.5f * mean_error);
+
+  const FeatureDescriptorCodes codes2 =
+      QuantizeFeatureDescriptors(descriptors_uint8);
+  BOOST_CHECK_EQUAL(codes.codebook, codes2.codebook);
+  BOOST_CHECK_EQUAL(codes.codes, codes2.codes);
+}
+
 BOOST_AUTO_TEST_CASE(TestExtractTopScaleFeatures) {
   FeatureKeypoints keypoints(5);
   keypoints[0].Rescale(3);
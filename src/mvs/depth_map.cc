@@ -47,11 +47,8 @@ DepthMap::DepthMap(const size_t width, const size_t height,
 
 DepthMap::DepthMap(const Mat<float>& mat, const float depth_min,
                    const float depth_max)
-    : Mat<float>(mat.GetWidth(), mat.GetHeight(), mat.GetDepth()),
-      depth_min_(depth_min),
-      depth_max_(depth_max) {
+    : Mat<float>(mat), depth_min_(depth_min), depth_max_(depth_max) {
   CHECK_EQ(mat.GetDepth(), 1);
-  data_ = mat.GetData();
 }
 
 void DepthMap::Rescale(const float factor) {
@@ -59,6 +56,8 @@ void DepthMap::Rescale(const float factor) {
     return;
   }
 
+  Unmap();
+
   const size_t new_width = std::round(width_ * factor);
   const size_t new_height = std::round(height_ * factor);
   std::vector<float> new_data(new_width * new_height);
@@ -89,11 +88,14 @@ Bitmap DepthMap::ToBitmap(const float min_percentile,
   Bitmap bitmap;
   bitmap.Allocate(width_, height_, true);
 
+  const float* data = GetPtr();
+  const size_t num_pixels = width_ * height_;
+
   std::vector<float> valid_depths;
-  valid_depths.reserve(data_.size());
-  for (const float depth : data_) {
-    if (depth > 0) {
-      valid_depths.push_back(depth);
+  valid_depths.reserve(num_pixels);
+  for (size_t i = 0; i < num_pixels; ++i) {
+    if (data[i] > 0) {
+      valid_depths.push_back(data[i]);
     }
   }
 
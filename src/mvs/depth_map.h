@@ -72,7 +72,7 @@ float DepthMap::GetDepthMin() const { return depth_min_; }
 float DepthMap::GetDepthMax() const { return depth_max_; }
 
 float DepthMap::Get(const size_t row, const size_t col) const {
-  return data_.at(row * width_ + col);
+  return Mat<float>::Get(row, col, 0);
 }
 
 }  // namespace mvs
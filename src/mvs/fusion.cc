@@ -78,6 +78,115 @@ int FindNextImage(const std::vector<std::vector<int>>& overlapping_images,
   return -1;
 }
 
+// Split the reference images into waves, whose images are fused concurrently.
+// The images are greedily assigned to the first wave without an overlapping
+// image in the given order, so that the images of a wave rarely fuse the same
+// pixels. The waves only depend on the given order and not on the number of
+// threads.
+std::vector<std::vector<int>> GroupImagesIntoWaves(
+    const std::vector<std::vector<int>>& overlapping_images,
+    const std::vector<int>& image_idxs, const size_t max_num_images_per_wave) {
+  CHECK_GT(max_num_images_per_wave, 0);
+
+  std::vector<std::vector<int>> waves;
+
+  std::vector<char> wave_images(overlapping_images.size(), false);
+  std::vector<char> wave_overlapping_images(overlapping_images.size(), false);
+
+  std::vector<int> remaining_image_idxs = image_idxs;
+  std::vector<int> next_remaining_image_idxs;
+  while (!remaining_image_idxs.empty()) {
+    std::vector<int> wave;
+    next_remaining_image_idxs.clear();
+    for (const int image_idx : remaining_image_idxs) {
+      bool overlaps_wave = wave.size() >= max_num_images_per_wave ||
+                           wave_overlapping_images.at(image_idx);
+      for (const int overlapping_image_idx :
+           overlapping_images.at(image_idx)) {
+        if (overlaps_wave) {
+          break;
+        }
+        overlaps_wave = wave_images.at(overlapping_image_idx);
+      }
+
+      if (overlaps_wave) {
+        next_remaining_image_idxs.push_back(image_idx);
+        continue;
+      }
+
+      wave.push_back(image_idx);
+      wave_images.at(image_idx) = true;
+      for (const int overlapping_image_idx :
+           overlapping_images.at(image_idx)) {
+        wave_overlapping_images.at(overlapping_image_idx) = true;
+      }
+    }
+
+    for (const int image_idx : wave) {
+      wave_images.at(image_idx) = false;
+      for (const int overlapping_image_idx :
+           overlapping_images.at(image_idx)) {
+        wave_overlapping_images.at(overlapping_image_idx) = false;
+      }
+    }
+
+    waves.push_back(std::move(wave));
+    std::swap(remaining_image_idxs, next_remaining_image_idxs);
+  }
+
+  return waves;
+}
+
+FusedPixelMask::FusedPixelMask(const int width, const int height)
+    : words_((static_cast<size_t>(width) * height + 63) / 64, 0) {}
+
+bool FusedPixelMask::IsFused(const int pixel_idx) const {
+  return (words_[pixel_idx / 64] & (uint64_t(1) << (pixel_idx % 64))) != 0;
+}
+
+void FusedPixelMask::SetFused(const int pixel_idx) {
+  words_[pixel_idx / 64] |= uint64_t(1) << (pixel_idx % 64);
+}
+
+size_t CommitFusionResult(
+    FusionResult* result, std::vector<FusedPixelMask>* fused_pixel_masks,
+    std::vector<PlyPoint>* fused_points,
+    std::vector<std::vector<int>>* fused_points_visibility) {
+  size_t num_discarded_points = 0;
+
+  auto pixels_begin = result->pixels.begin();
+  for (const auto& pixel_group : result->pixel_groups) {
+    const auto pixels_end = pixels_begin + pixel_group.num_pixels;
+
+    bool already_fused = false;
+    for (auto pixel = pixels_begin; pixel != pixels_end; ++pixel) {
+      if ((*fused_pixel_masks)[pixel->first].IsFused(pixel->second)) {
+        already_fused = true;
+        break;
+      }
+    }
+
+    if (already_fused) {
+      if (pixel_group.point_idx >= 0) {
+        num_discarded_points += 1;
+      }
+    } else {
+      for (auto pixel = pixels_begin; pixel != pixels_end; ++pixel) {
+        (*fused_pixel_masks)[pixel->first].SetFused(pixel->second);
+      }
+      if (pixel_group.point_idx >= 0) {
+        fused_points->push_back(result->points[pixel_group.point_idx]);
+        fused_points_visibility->push_back(
+            std::move(result->points_visibility[pixel_group.point_idx]));
+      }
+    }
+
+    pixels_begin = pixels_end;
+  }
+
+  return num_discarded_points;
+}
+
 }  // namespace internal
 
 void StereoFusionOptions::Print() const {
@@ -92,6 +201,7 @@ void StereoFusionOptions::Print() const {
   PrintOption(max_normal_error);
   PrintOption(check_num_images);
   PrintOption(cache_size);
+  PrintOption(num_threads);
 #undef PrintOption
 }
 
@@ -104,6 +214,8 @@ bool StereoFusionOptions::Check() const {
   CHECK_OPTION_GE(max_normal_error, 0);
   CHECK_OPTION_GT(check_num_images, 0);
   CHECK_OPTION_GT(cache_size, 0);
+  CHECK_OPTION_GE(num_threads, -1);
+  CHECK_OPTION_NE(num_threads, 0);
   return true;
 }
 
@@ -123,6 +235,11 @@ StereoFusion::StereoFusion(const StereoFusionOptions& options,
   CHECK(options_.Check());
 }
 
+size_t StereoFusion::CachedImage::NumBytes() const {
+  return bitmap->NumBytes() + depth_map->GetNumBytes() +
+         normal_map->GetNumBytes();
+}
+
 const std::vector<PlyPoint>& StereoFusion::GetFusedPoints() const {
   return fused_points_;
 }
@@ -159,6 +276,18 @@ void StereoFusion::Run() {
 
   workspace_.reset(new Workspace(workspace_options));
 
+  // The fusion threads share their own thread-safe cache instead of the cache
+  // of the workspace, which is only used to read the data from disk.
+  cache_.reset(new ShardedMemoryConstrainedLRUCache<int, CachedImage>(
+      1024 * 1024 * 1024 * options_.cache_size, kNumCacheShards,
+      [this](const int image_idx) {
+        CachedImage cached_image;
+        cached_image.bitmap = workspace_->ReadBitmap(image_idx);
+        cached_image.depth_map = workspace_->ReadDepthMap(image_idx);
+        cached_image.normal_map = workspace_->ReadNormalMap(image_idx);
+        return cached_image;
+      }));
+
   if (IsStopped()) {
     GetTimer().PrintMinutes();
     return;
@@ -201,81 +330,109 @@ void StereoFusion::Run() {
       continue;
     }
 
-    const auto& image = model.images.at(image_idx);
-    const auto& depth_map = workspace_->GetDepthMap(image_idx);
-
     used_images_.at(image_idx) = true;
-
-    fused_pixel_masks_.at(image_idx) =
-        Mat<bool>(depth_map.GetWidth(), depth_map.GetHeight(), 1);
-    fused_pixel_masks_.at(image_idx).Fill(false);
-
-    depth_map_sizes_.at(image_idx) =
-        std::make_pair(depth_map.GetWidth(), depth_map.GetHeight());
-
-    bitmap_scales_.at(image_idx) = std::make_pair(
-        static_cast<float>(depth_map.GetWidth()) / image.GetWidth(),
-        static_cast<float>(depth_map.GetHeight()) / image.GetHeight());
-
-    Eigen::Matrix<float, 3, 3, Eigen::RowMajor> K =
-        Eigen::Map<const Eigen::Matrix<float, 3, 3, Eigen::RowMajor>>(
-            image.GetK());
-    K(0, 0) *= bitmap_scales_.at(image_idx).first;
-    K(0, 2) *= bitmap_scales_.at(image_idx).first;
-    K(1, 1) *= bitmap_scales_.at(image_idx).second;
-    K(1, 2) *= bitmap_scales_.at(image_idx).second;
-
-    ComposeProjectionMatrix(K.data(), image.GetR(), image.GetT(),
-                            P_.at(image_idx).data());
-    ComposeInverseProjectionMatrix(K.data(), image.GetR(), image.GetT(),
-                                   inv_P_.at(image_idx).data());
-    inv_R_.at(image_idx) =
-        Eigen::Map<const Eigen::Matrix<float, 3, 3, Eigen::RowMajor>>(
-            image.GetR())
-            .transpose();
   }
 
-  size_t num_fused_images = 0;
-  for (int image_idx = 0; image_idx >= 0;
-       image_idx = internal::FindNextImage(overlapping_images_, used_images_,
-                                           fused_images_, image_idx)) {
-    if (IsStopped()) {
-      break;
+  ThreadPool thread_pool(options_.num_threads);
+
+  // Read the inputs of all images in parallel, which also warms up the cache.
+  for (size_t image_idx = 0; image_idx < model.images.size(); ++image_idx) {
+    if (!used_images_[image_idx]) {
+      continue;
     }
 
-    Timer timer;
-    timer.Start();
+    thread_pool.AddTask([this, &model, image_idx]() {
+      const auto& image = model.images.at(image_idx);
+      const auto depth_map = cache_->Get(image_idx).depth_map;
+
+      fused_pixel_masks_.at(image_idx) =
+          FusedPixelMask(depth_map->GetWidth(), depth_map->GetHeight());
+
+      depth_map_sizes_.at(image_idx) =
+          std::make_pair(depth_map->GetWidth(), depth_map->GetHeight());
+
+      bitmap_scales_.at(image_idx) = std::make_pair(
+          static_cast<float>(depth_map->GetWidth()) / image.GetWidth(),
+          static_cast<float>(depth_map->GetHeight()) / image.GetHeight());
+
+      Eigen::Matrix<float, 3, 3, Eigen::RowMajor> K =
+          Eigen::Map<const Eigen::Matrix<float, 3, 3, Eigen::RowMajor>>(
+              image.GetK());
+      K(0, 0) *= bitmap_scales_.at(image_idx).first;
+      K(0, 2) *= bitmap_scales_.at(image_idx).first;
+      K(1, 1) *= bitmap_scales_.at(image_idx).second;
+      K(1, 2) *= bitmap_scales_.at(image_idx).second;
+
+      ComposeProjectionMatrix(K.data(), image.GetR(), image.GetT(),
+                              P_.at(image_idx).data());
+      ComposeInverseProjectionMatrix(K.data(), image.GetR(), image.GetT(),
+                                     inv_P_.at(image_idx).data());
+      inv_R_.at(image_idx) =
+          Eigen::Map<const Eigen::Matrix<float, 3, 3, Eigen::RowMajor>>(
+              image.GetR())
+              .transpose();
+    });
+  }
 
-    std::cout << StringPrintf("Fusing image [%d/%d]", num_fused_images + 1,
-                              model.images.size())
-              << std::flush;
+  thread_pool.Wait();
 
-    const int width = depth_map_sizes_.at(image_idx).first;
-    const int height = depth_map_sizes_.at(image_idx).second;
-    const auto& fused_pixel_mask = fused_pixel_masks_.at(image_idx);
+  // Determine the order of reference images up front, such that concurrently
+  // fused reference images overlap and share their cached neighbors.
+  std::vector<int> ref_image_idxs;
+  std::vector<char> scheduled_images(model.images.size(), false);
+  for (int image_idx = 0; image_idx >= 0;
+       image_idx = internal::FindNextImage(overlapping_images_, used_images_,
+                                           scheduled_images, image_idx)) {
+    scheduled_images.at(image_idx) = true;
+    if (used_images_.at(image_idx)) {
+      ref_image_idxs.push_back(image_idx);
+    }
+  }
 
-    FusionData data;
-    data.image_idx = image_idx;
-    data.traversal_depth = 0;
+  Timer timer;
+  timer.Start();
 
-    for (data.row = 0; data.row < height; ++data.row) {
-      for (data.col = 0; data.col < width; ++data.col) {
-        if (fused_pixel_mask.Get(data.row, data.col)) {
-          continue;
-        }
+  // The reference images of a wave are fused concurrently against the fused
+  // pixels of the previous waves. Afterwards, their results are committed in
+  // the order of the wave, where earlier reference images take precedence for
+  // pixels that were fused by multiple reference images. The fused points
+  // thus neither depend on the number of threads nor on their scheduling.
+  const auto waves = internal::GroupImagesIntoWaves(
+      overlapping_images_, ref_image_idxs, kMaxNumImagesPerWave);
 
-        fusion_queue_.push_back(data);
+  size_t num_fused_images = 0;
+  size_t num_discarded_points = 0;
+  for (const auto& wave : waves) {
+    if (IsStopped()) {
+      break;
+    }
 
-        Fuse();
-      }
+    std::vector<std::future<FusionResult>> futures;
+    futures.reserve(wave.size());
+    for (const int ref_image_idx : wave) {
+      futures.push_back(thread_pool.AddTask(&StereoFusion::FuseImage, this,
+                                            ref_image_idx));
     }
 
-    num_fused_images += 1;
-    fused_images_.at(image_idx) = true;
+    std::vector<FusionResult> results;
+    results.reserve(futures.size());
+    for (auto& future : futures) {
+      results.push_back(future.get());
+    }
 
-    std::cout << StringPrintf(" in %.3fs (%d points)", timer.ElapsedSeconds(),
-                              fused_points_.size())
-              << std::endl;
+    for (size_t i = 0; i < wave.size(); ++i) {
+      num_discarded_points += internal::CommitFusionResult(
+          &results[i], &fused_pixel_masks_, &fused_points_,
+          &fused_points_visibility_);
+      fused_images_.at(wave[i]) = true;
+      num_fused_images += 1;
+
+      std::cout << StringPrintf("Fusing image [%d/%d] in %.3fs (%d points)",
+                                num_fused_images, model.images.size(),
+                                results[i].elapsed_seconds,
+                                fused_points_.size())
+                << std::endl;
+    }
   }
 
   fused_points_.shrink_to_fit();
@@ -288,44 +445,129 @@ void StereoFusion::Run() {
               << std::endl;
   }
 
+  const double elapsed_seconds = timer.ElapsedSeconds();
   std::cout << "Number of fused points: " << fused_points_.size() << std::endl;
+  std::cout << StringPrintf(
+                   "Discarded %d points fused concurrently in %d waves",
+                   num_discarded_points, waves.size())
+            << std::endl;
+  std::cout << StringPrintf(
+                   "Fusion throughput: %.1f points/s (%d threads, %.1f%% "
+                   "cache hits)",
+                   fused_points_.size() / std::max(elapsed_seconds, 1e-6),
+                   thread_pool.NumThreads(),
+                   100.0 * cache_->NumHits() /
+                       std::max<size_t>(
+                           1, cache_->NumHits() + cache_->NumMisses()))
+            << std::endl;
+
+  cache_.reset();
+
   GetTimer().PrintMinutes();
 }
 
-void StereoFusion::Fuse() {
-  CHECK_EQ(fusion_queue_.size(), 1);
+StereoFusion::FusionResult StereoFusion::FuseImage(const int ref_image_idx) {
+  FusionResult result;
+  if (IsStopped()) {
+    return result;
+  }
+
+  Timer timer;
+  timer.Start();
+
+  const int width = depth_map_sizes_.at(ref_image_idx).first;
+  const int height = depth_map_sizes_.at(ref_image_idx).second;
+  const auto& fused_pixel_mask = fused_pixel_masks_.at(ref_image_idx);
+
+  FusionState state;
+  const auto& ref_fused_pixel_mask =
+      state.fused_pixel_masks
+          .emplace(ref_image_idx, FusedPixelMask(width, height))
+          .first->second;
+
+  FusionData data;
+  data.image_idx = ref_image_idx;
+  data.traversal_depth = 0;
+
+  for (data.row = 0; data.row < height; ++data.row) {
+    for (data.col = 0; data.col < width; ++data.col) {
+      const int pixel_idx = data.row * width + data.col;
+      if (fused_pixel_mask.IsFused(pixel_idx) ||
+          ref_fused_pixel_mask.IsFused(pixel_idx)) {
+        continue;
+      }
+
+      state.fusion_queue.push_back(data);
+
+      Fuse(&state, &result);
+    }
+  }
+
+  result.elapsed_seconds = timer.ElapsedSeconds();
+
+  return result;
+}
+
+const StereoFusion::CachedImage& StereoFusion::GetImage(const int image_idx,
+                                                        FusionState* state) {
+  auto it = state->images.find(image_idx);
+  if (it == state->images.end()) {
+    it = state->images.emplace(image_idx, cache_->Get(image_idx)).first;
+  }
+  return it->second;
+}
+
+void StereoFusion::Fuse(FusionState* state, FusionResult* result) {
+  CHECK_EQ(state->fusion_queue.size(), 1);
 
   Eigen::Vector4f fused_ref_point = Eigen::Vector4f::Zero();
   Eigen::Vector3f fused_ref_normal = Eigen::Vector3f::Zero();
 
-  fused_point_x_.clear();
-  fused_point_y_.clear();
-  fused_point_z_.clear();
-  fused_point_nx_.clear();
-  fused_point_ny_.clear();
-  fused_point_nz_.clear();
-  fused_point_r_.clear();
-  fused_point_g_.clear();
-  fused_point_b_.clear();
-  fused_point_visibility_.clear();
-
-  while (!fusion_queue_.empty()) {
-    const auto data = fusion_queue_.back();
+  state->fused_point_x.clear();
+  state->fused_point_y.clear();
+  state->fused_point_z.clear();
+  state->fused_point_nx.clear();
+  state->fused_point_ny.clear();
+  state->fused_point_nz.clear();
+  state->fused_point_r.clear();
+  state->fused_point_g.clear();
+  state->fused_point_b.clear();
+  state->fused_point_visibility.clear();
+  state->fused_point_pixels.clear();
+
+  auto& fusion_queue = state->fusion_queue;
+
+  while (!fusion_queue.empty()) {
+    const auto data = fusion_queue.back();
     const int image_idx = data.image_idx;
     const int row = data.row;
     const int col = data.col;
     const int traversal_depth = data.traversal_depth;
 
-    fusion_queue_.pop_back();
+    fusion_queue.pop_back();
 
-    // Check if pixel already fused.
-    auto& fused_pixel_mask = fused_pixel_masks_.at(image_idx);
-    if (fused_pixel_mask.Get(row, col)) {
+    // Check if pixel already fused in a previous wave or by the current
+    // reference image.
+    const auto& depth_map_size = depth_map_sizes_.at(image_idx);
+    const int pixel_idx = row * depth_map_size.first + col;
+    if (fused_pixel_masks_.at(image_idx).IsFused(pixel_idx)) {
+      continue;
+    }
+    auto fused_pixel_mask_it = state->fused_pixel_masks.find(image_idx);
+    if (fused_pixel_mask_it == state->fused_pixel_masks.end()) {
+      fused_pixel_mask_it =
+          state->fused_pixel_masks
+              .emplace(image_idx, FusedPixelMask(depth_map_size.first,
+                                                 depth_map_size.second))
+              .first;
+    }
+    auto& fused_pixel_mask = fused_pixel_mask_it->second;
+    if (fused_pixel_mask.IsFused(pixel_idx)) {
       continue;
     }
 
-    const auto& depth_map = workspace_->GetDepthMap(image_idx);
-    const float depth = depth_map.Get(row, col);
+    const auto& image = GetImage(image_idx, state);
+    const float depth = image.depth_map->Get(row, col);
 
     // Pixels with negative depth are filtered.
     if (depth <= 0.0f) {
@@ -355,7 +597,7 @@ void StereoFusion::Fuse() {
     }
 
     // Determine normal direction in global reference frame.
-    const auto& normal_map = workspace_->GetNormalMap(image_idx);
+    const auto& normal_map = *image.normal_map;
     const Eigen::Vector3f normal =
         inv_R_.at(image_idx) * Eigen::Vector3f(normal_map.Get(row, col, 0),
                                                normal_map.Get(row, col, 1),
@@ -369,6 +611,10 @@ void StereoFusion::Fuse() {
       }
     }
 
+    // Set the current pixel as visited.
+    fused_pixel_mask.SetFused(pixel_idx);
+    state->fused_point_pixels.emplace_back(image_idx, pixel_idx);
+
     // Determine 3D location of current depth value.
     const Eigen::Vector3f xyz =
         inv_P_.at(image_idx) *
@@ -377,23 +623,20 @@ void StereoFusion::Fuse() {
     // Read the color of the pixel.
     BitmapColor<uint8_t> color;
     const auto& bitmap_scale = bitmap_scales_.at(image_idx);
-    workspace_->GetBitmap(image_idx).InterpolateNearestNeighbor(
+    image.bitmap->InterpolateNearestNeighbor(
         col / bitmap_scale.first, row / bitmap_scale.second, &color);
 
-    // Set the current pixel as visited.
-    fused_pixel_mask.Set(row, col, true);
-
     // Accumulate statistics for fused point.
-    fused_point_x_.push_back(xyz(0));
-    fused_point_y_.push_back(xyz(1));
-    fused_point_z_.push_back(xyz(2));
-    fused_point_nx_.push_back(normal(0));
-    fused_point_ny_.push_back(normal(1));
-    fused_point_nz_.push_back(normal(2));
-    fused_point_r_.push_back(color.r);
-    fused_point_g_.push_back(color.g);
-    fused_point_b_.push_back(color.b);
-    fused_point_visibility_.insert(image_idx);
+    state->fused_point_x.push_back(xyz(0));
+    state->fused_point_y.push_back(xyz(1));
+    state->fused_point_z.push_back(xyz(2));
+    state->fused_point_nx.push_back(normal(0));
+    state->fused_point_ny.push_back(normal(1));
+    state->fused_point_nz.push_back(normal(2));
+    state->fused_point_r.push_back(color.r);
+    state->fused_point_g.push_back(color.g);
+    state->fused_point_b.push_back(color.b);
+    state->fused_point_visibility.insert(image_idx);
 
     // Remember the first pixel as the reference.
     if (traversal_depth == 0) {
@@ -401,7 +644,8 @@ void StereoFusion::Fuse() {
       fused_ref_normal = normal;
     }
 
-    if (fused_point_x_.size() >= static_cast<size_t>(options_.max_num_pixels)) {
+    if (state->fused_point_x.size() >=
+        static_cast<size_t>(options_.max_num_pixels)) {
       break;
     }
 
@@ -413,8 +657,7 @@ void StereoFusion::Fuse() {
     }
 
     for (const auto next_image_idx : overlapping_images_.at(image_idx)) {
-      if (!used_images_.at(next_image_idx) ||
-          fused_images_.at(next_image_idx)) {
+      if (!used_images_.at(next_image_idx) || fused_images_[next_image_idx]) {
         continue;
       }
 
@@ -425,50 +668,70 @@ void StereoFusion::Fuse() {
       next_data.col = static_cast<int>(std::round(next_proj(0) / next_proj(2)));
       next_data.row = static_cast<int>(std::round(next_proj(1) / next_proj(2)));
 
-      const auto& depth_map_size = depth_map_sizes_.at(next_image_idx);
+      const auto& next_depth_map_size = depth_map_sizes_.at(next_image_idx);
       if (next_data.col < 0 || next_data.row < 0 ||
-          next_data.col >= depth_map_size.first ||
-          next_data.row >= depth_map_size.second) {
+          next_data.col >= next_depth_map_size.first ||
+          next_data.row >= next_depth_map_size.second) {
         continue;
       }
 
-      fusion_queue_.push_back(next_data);
+      fusion_queue.push_back(next_data);
     }
   }
 
-  fusion_queue_.clear();
+  fusion_queue.clear();
+
+  // Release the images of this point, such that evicted images do not stay
+  // in memory longer than necessary.
+  state->images.clear();
 
-  const size_t num_pixels = fused_point_x_.size();
+  if (state->fused_point_pixels.empty()) {
+    return;
+  }
+
+  // The pixels are also recorded if they do not produce a point, because they
+  // must not be fused again by later reference images.
+  FusedPixelGroup pixel_group;
+  pixel_group.num_pixels = state->fused_point_pixels.size();
+  result->pixels.insert(result->pixels.end(),
+                        state->fused_point_pixels.begin(),
+                        state->fused_point_pixels.end());
+  result->pixel_groups.push_back(pixel_group);
+
+  const size_t num_pixels = state->fused_point_x.size();
   if (num_pixels >= static_cast<size_t>(options_.min_num_pixels)) {
     PlyPoint fused_point;
 
     Eigen::Vector3f fused_normal;
-    fused_normal.x() = internal::Median(&fused_point_nx_);
-    fused_normal.y() = internal::Median(&fused_point_ny_);
-    fused_normal.z() = internal::Median(&fused_point_nz_);
+    fused_normal.x() = internal::Median(&state->fused_point_nx);
+    fused_normal.y() = internal::Median(&state->fused_point_ny);
+    fused_normal.z() = internal::Median(&state->fused_point_nz);
     const float fused_normal_norm = fused_normal.norm();
     if (fused_normal_norm < std::numeric_limits<float>::epsilon()) {
       return;
     }
 
-    fused_point.x = internal::Median(&fused_point_x_);
-    fused_point.y = internal::Median(&fused_point_y_);
-    fused_point.z = internal::Median(&fused_point_z_);
+    fused_point.x = internal::Median(&state->fused_point_x);
+    fused_point.y = internal::Median(&state->fused_point_y);
+    fused_point.z = internal::Median(&state->fused_point_z);
 
     fused_point.nx = fused_normal.x() / fused_normal_norm;
     fused_point.ny = fused_normal.y() / fused_normal_norm;
     fused_point.nz = fused_normal.z() / fused_normal_norm;
 
     fused_point.r = TruncateCast<float, uint8_t>(
-        std::round(internal::Median(&fused_point_r_)));
+        std::round(internal::Median(&state->fused_point_r)));
     fused_point.g = TruncateCast<float, uint8_t>(
-        std::round(internal::Median(&fused_point_g_)));
+        std::round(internal::Median(&state->fused_point_g)));
     fused_point.b = TruncateCast<float, uint8_t>(
-        std::round(internal::Median(&fused_point_b_)));
-
-    fused_points_.push_back(fused_point);
-    fused_points_visibility_.emplace_back(fused_point_visibility_.begin(),
-                                          fused_point_visibility_.end());
+        std::round(internal::Median(&state->fused_point_b)));
+
+    result->pixel_groups.back().point_idx =
+        static_cast<int>(result->points.size());
+    result->points.push_back(fused_point);
+    result->points_visibility.emplace_back(
+        state->fused_point_visibility.begin(),
+        state->fused_point_visibility.end());
   }
 }
 
@@ -32,6 +32,8 @@
 #ifndef COLMAP_SRC_MVS_FUSION_H_
 #define COLMAP_SRC_MVS_FUSION_H_
 
+#include <memory>
+#include <unordered_map>
 #include <unordered_set>
 #include <vector>
 
@@ -52,6 +54,55 @@
 namespace colmap {
 namespace mvs {
 
+namespace internal {
+
+// Mask of the already fused pixels of an image, indexed by the pixel index
+// `row * width + col`.
+class FusedPixelMask {
+ public:
+  FusedPixelMask() = default;
+  FusedPixelMask(const int width, const int height);
+
+  bool IsFused(const int pixel_idx) const;
+  void SetFused(const int pixel_idx);
+
+ private:
+  std::vector<uint64_t> words_;
+};
+
+// Pixels that were fused together, where `point_idx` is the index of the
+// resulting point or -1 if the pixels did not produce a point.
+struct FusedPixelGroup {
+  size_t num_pixels = 0;
+  int point_idx = -1;
+};
+
+// Fused points of a single reference image. The pixels of all groups are
+// stored consecutively as (image_idx, pixel_idx) in `pixels`.
+struct FusionResult {
+  std::vector<PlyPoint> points;
+  std::vector<std::vector<int>> points_visibility;
+  std::vector<std::pair<int, int>> pixels;
+  std::vector<FusedPixelGroup> pixel_groups;
+  double elapsed_seconds = 0;
+};
+
+// Split the reference images into waves, whose images are fused concurrently.
+// No image of a wave is an overlapping image of another image of the wave.
+std::vector<std::vector<int>> GroupImagesIntoWaves(
+    const std::vector<std::vector<int>>& overlapping_images,
+    const std::vector<int>& image_idxs, const size_t max_num_images_per_wave);
+
+// Mark the pixels of the result as fused and append its points to the fused
+// points. Groups with a pixel that was already fused by a reference image
+// committed before are discarded. Returns the number of discarded points.
+size_t CommitFusionResult(
+    FusionResult* result, std::vector<FusedPixelMask>* fused_pixel_masks,
+    std::vector<PlyPoint>* fused_points,
+    std::vector<std::vector<int>>* fused_points_visibility);
+
+}  // namespace internal
+
 struct StereoFusionOptions {
   // Maximum image size in either dimension.
   int max_image_size = -1;
@@ -84,6 +135,11 @@ struct StereoFusionOptions {
   // consume a lot of memory, if the consistency graph is dense.
   double cache_size = 32.0;
 
+  // The number of threads to use for fusion. Each thread fuses the pixels of a
+  // different reference image, while the cache is shared across all threads.
+  // The fused points do not depend on the number of threads.
+  int num_threads = -1;
+
   // Check the options for validity.
   bool Check() const;
 
@@ -105,8 +161,67 @@ class StereoFusion : public Thread {
   const std::vector<std::vector<int>>& GetFusedPointsVisibility() const;
 
  private:
+  typedef internal::FusedPixelMask FusedPixelMask;
+  typedef internal::FusedPixelGroup FusedPixelGroup;
+  typedef internal::FusionResult FusionResult;
+
+  struct FusionData {
+    int image_idx = kInvalidImageId;
+    int row = 0;
+    int col = 0;
+    int traversal_depth = -1;
+    bool operator()(const FusionData& data1, const FusionData& data2) {
+      return data1.image_idx > data2.image_idx;
+    }
+  };
+
+  // Input data of an image that is shared between the fusion threads. The
+  // data is kept alive by the threads using it, even after cache eviction.
+  struct CachedImage {
+    std::shared_ptr<const Bitmap> bitmap;
+    std::shared_ptr<const DepthMap> depth_map;
+    std::shared_ptr<const NormalMap> normal_map;
+    size_t NumBytes() const;
+  };
+
+  // Thread-local state of the consistency graph traversal.
+  struct FusionState {
+    // Next points to fuse.
+    std::vector<FusionData> fusion_queue;
+
+    // Images referenced during the fusion of the current point.
+    std::unordered_map<int, CachedImage> images;
+
+    // Pixels fused by the current reference image. The shared masks are only
+    // updated once all reference images of the current wave are fused.
+    std::unordered_map<int, FusedPixelMask> fused_pixel_masks;
+
+    // The (image_idx, pixel_idx) of the pixels of the current point.
+    std::vector<std::pair<int, int>> fused_point_pixels;
+
+    // Points of different pixels of the currently point to be fused.
+    std::vector<float> fused_point_x;
+    std::vector<float> fused_point_y;
+    std::vector<float> fused_point_z;
+    std::vector<float> fused_point_nx;
+    std::vector<float> fused_point_ny;
+    std::vector<float> fused_point_nz;
+    std::vector<uint8_t> fused_point_r;
+    std::vector<uint8_t> fused_point_g;
+    std::vector<uint8_t> fused_point_b;
+    std::unordered_set<int> fused_point_visibility;
+  };
+
+  static const size_t kNumCacheShards = 16;
+
+  // The maximum number of reference images that are fused concurrently.
+  static const size_t kMaxNumImagesPerWave = 32;
+
   void Run();
-  void Fuse();
+  FusionResult FuseImage(const int ref_image_idx);
+  void Fuse(FusionState* state, FusionResult* result);
+
+  const CachedImage& GetImage(const int image_idx, FusionState* state);
 
   const StereoFusionOptions options_;
   const std::string workspace_path_;
@@ -117,44 +232,20 @@ class StereoFusion : public Thread {
   const float min_cos_normal_error_;
 
   std::unique_ptr<Workspace> workspace_;
+  std::unique_ptr<ShardedMemoryConstrainedLRUCache<int, CachedImage>> cache_;
   std::vector<char> used_images_;
   std::vector<char> fused_images_;
   std::vector<std::vector<int>> overlapping_images_;
-  std::vector<Mat<bool>> fused_pixel_masks_;
+  std::vector<FusedPixelMask> fused_pixel_masks_;
   std::vector<std::pair<int, int>> depth_map_sizes_;
   std::vector<std::pair<float, float>> bitmap_scales_;
   std::vector<Eigen::Matrix<float, 3, 4, Eigen::RowMajor>> P_;
   std::vector<Eigen::Matrix<float, 3, 4, Eigen::RowMajor>> inv_P_;
   std::vector<Eigen::Matrix<float, 3, 3, Eigen::RowMajor>> inv_R_;
 
-  struct FusionData {
-    int image_idx = kInvalidImageId;
-    int row = 0;
-    int col = 0;
-    int traversal_depth = -1;
-    bool operator()(const FusionData& data1, const FusionData& data2) {
-      return data1.image_idx > data2.image_idx;
-    }
-  };
-
-  // Next points to fuse.
-  std::vector<FusionData> fusion_queue_;
-
   // Already fused points.
   std::vector<PlyPoint> fused_points_;
   std::vector<std::vector<int>> fused_points_visibility_;
-
-  // Points of different pixels of the currently point to be fused.
-  std::vector<float> fused_point_x_;
-  std::vector<float> fused_point_y_;
-  std::vector<float> fused_point_z_;
-  std::vector<float> fused_point_nx_;
-  std::vector<float> fused_point_ny_;
-  std::vector<float> fused_point_nz_;
-  std::vector<uint8_t> fused_point_r_;
-  std::vector<uint8_t> fused_point_g_;
-  std::vector<uint8_t> fused_point_b_;
-  std::unordered_set<int> fused_point_visibility_;
 };
 
 // Write the visiblity information into a binary file of the following format:
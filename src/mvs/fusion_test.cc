@@ -0,0 +1,317 @@
+// Copyright (c) 2018, ETH Zurich and UNC Chapel Hill.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//
+//     * Neither the name of ETH Zurich and UNC Chapel Hill nor the names of
+//       its contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+
+#define TEST_NAME "mvs/fusion_test"
+#include "util/testing.h"
+
+#include <algorithm>
+#include <numeric>
+#include <random>
+
+#include "mvs/fusion.h"
+
+using namespace colmap;
+using namespace colmap::mvs;
+using namespace colmap::mvs::internal;
+
+namespace {
+
+const int kWidth = 8;
+const int kHeight = 8;
+
+// Synthetic fusion of a reference image, which fuses every not yet fused pixel
+// of the reference image with the same pixel of its overlapping images, if the
+// pixel is not yet fused and consistent in the overlapping image.
+FusionResult FuseImage(const std::vector<std::vector<int>>& overlapping_images,
+                       const std::vector<FusedPixelMask>& fused_pixel_masks,
+                       const int ref_image_idx) {
+  FusionResult result;
+  for (int pixel_idx = 0; pixel_idx < kWidth * kHeight; ++pixel_idx) {
+    if (fused_pixel_masks[ref_image_idx].IsFused(pixel_idx)) {
+      continue;
+    }
+
+    std::vector<int> visibility = {ref_image_idx};
+    result.pixels.emplace_back(ref_image_idx, pixel_idx);
+    for (const int image_idx : overlapping_images[ref_image_idx]) {
+      if ((pixel_idx + image_idx) % 3 != 0 &&
+          !fused_pixel_masks[image_idx].IsFused(pixel_idx)) {
+        visibility.push_back(image_idx);
+        result.pixels.emplace_back(image_idx, pixel_idx);
+      }
+    }
+
+    FusedPixelGroup pixel_group;
+    pixel_group.num_pixels = visibility.size();
+    if (visibility.size() >= 2) {
+      pixel_group.point_idx = static_cast<int>(result.points.size());
+      PlyPoint point;
+      point.x = ref_image_idx;
+      point.y = pixel_idx;
+      point.z = visibility.size();
+      result.points.push_back(point);
+      result.points_visibility.push_back(visibility);
+    }
+    result.pixel_groups.push_back(pixel_group);
+  }
+  return result;
+}
+
+std::vector<FusedPixelMask> CreateFusedPixelMasks(const size_t num_images) {
+  return std::vector<FusedPixelMask>(num_images,
+                                     FusedPixelMask(kWidth, kHeight));
+}
+
+void CheckEqualFusedPixelMasks(const std::vector<FusedPixelMask>& masks1,
+                               const std::vector<FusedPixelMask>& masks2) {
+  BOOST_CHECK_EQUAL(masks1.size(), masks2.size());
+  for (size_t image_idx = 0; image_idx < masks1.size(); ++image_idx) {
+    for (int pixel_idx = 0; pixel_idx < kWidth * kHeight; ++pixel_idx) {
+      BOOST_CHECK_EQUAL(masks1[image_idx].IsFused(pixel_idx),
+                        masks2[image_idx].IsFused(pixel_idx));
+    }
+  }
+}
+
+}  // namespace
+
+BOOST_AUTO_TEST_CASE(TestFusedPixelMask) {
+  FusedPixelMask mask(10, 13);
+  for (int pixel_idx = 0; pixel_idx < 130; ++pixel_idx) {
+    BOOST_CHECK(!mask.IsFused(pixel_idx));
+  }
+  mask.SetFused(0);
+  mask.SetFused(63);
+  mask.SetFused(64);
+  mask.SetFused(129);
+  for (int pixel_idx = 0; pixel_idx < 130; ++pixel_idx) {
+    BOOST_CHECK_EQUAL(mask.IsFused(pixel_idx), pixel_idx == 0 ||
+                                                   pixel_idx == 63 ||
+                                                   pixel_idx == 64 ||
+                                                   pixel_idx == 129);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(TestGroupImagesIntoWavesChain) {
+  const std::vector<std::vector<int>> overlapping_images = {
+      {1}, {0, 2}, {1, 3}, {2}};
+  const auto waves =
+      GroupImagesIntoWaves(overlapping_images, {0, 1, 2, 3}, 32);
+  BOOST_CHECK_EQUAL(waves.size(), 2);
+  BOOST_CHECK(waves[0] == std::vector<int>({0, 2}));
+  BOOST_CHECK(waves[1] == std::vector<int>({1, 3}));
+
+  const auto limited_waves =
+      GroupImagesIntoWaves(overlapping_images, {0, 1, 2, 3}, 1);
+  BOOST_CHECK_EQUAL(limited_waves.size(), 4);
+  for (int i = 0; i < 4; ++i) {
+    BOOST_CHECK(limited_waves[i] == std::vector<int>({i}));
+  }
+
+  BOOST_CHECK(GroupImagesIntoWaves(overlapping_images, {}, 32).empty());
+}
+
+BOOST_AUTO_TEST_CASE(TestGroupImagesIntoWavesRandom) {
+  const int kNumImages = 100;
+  const size_t kMaxNumImagesPerWave = 8;
+
+  std::mt19937 prng(0);
+  std::vector<std::vector<int>> overlapping_images(kNumImages);
+  for (int image_idx = 0; image_idx < kNumImages; ++image_idx) {
+    for (int i = 0; i < 5; ++i) {
+      const int overlapping_image_idx = prng() % kNumImages;
+      if (overlapping_image_idx != image_idx) {
+        overlapping_images[image_idx].push_back(overlapping_image_idx);
+      }
+    }
+  }
+
+  std::vector<int> image_idxs;
+  for (int image_idx = 0; image_idx < kNumImages; image_idx += 2) {
+    image_idxs.push_back(image_idx);
+  }
+  for (int image_idx = 1; image_idx < kNumImages; image_idx += 2) {
+    image_idxs.push_back(image_idx);
+  }
+  std::shuffle(image_idxs.begin(), image_idxs.end(), prng);
+
+  const auto waves = GroupImagesIntoWaves(overlapping_images, image_idxs,
+                                          kMaxNumImagesPerWave);
+
+  // The waves only depend on the inputs.
+  BOOST_CHECK(waves == GroupImagesIntoWaves(overlapping_images, image_idxs,
+                                            kMaxNumImagesPerWave));
+
+  std::vector<int> num_waves_per_image(kNumImages, 0);
+  for (const auto& wave : waves) {
+    BOOST_CHECK(!wave.empty());
+    BOOST_CHECK_LE(wave.size(), kMaxNumImagesPerWave);
+
+    // Images of a wave keep their relative order.
+    std::vector<size_t> positions;
+    for (const int image_idx : wave) {
+      num_waves_per_image[image_idx] += 1;
+      positions.push_back(std::find(image_idxs.begin(), image_idxs.end(),
+                                    image_idx) -
+                          image_idxs.begin());
+    }
+    BOOST_CHECK(std::is_sorted(positions.begin(), positions.end()));
+
+    // No image of a wave overlaps with another image of the same wave.
+    for (const int image_idx1 : wave) {
+      for (const int image_idx2 : wave) {
+        const auto& overlapping_images1 = overlapping_images[image_idx1];
+        BOOST_CHECK(std::find(overlapping_images1.begin(),
+                              overlapping_images1.end(),
+                              image_idx2) == overlapping_images1.end());
+      }
+    }
+  }
+
+  for (const int num_waves : num_waves_per_image) {
+    BOOST_CHECK_EQUAL(num_waves, 1);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(TestCommitFusionResultEqualsSequentialFusion) {
+  const int kNumImages = 24;
+
+  // Groups of mutually overlapping images, such that images of the same wave
+  // never share an overlapping image.
+  std::mt19937 prng(1);
+  std::vector<std::vector<int>> overlapping_images(kNumImages);
+  for (int begin_idx = 0; begin_idx < kNumImages;) {
+    const int end_idx =
+        std::min(kNumImages, begin_idx + 1 + static_cast<int>(prng() % 5));
+    for (int image_idx1 = begin_idx; image_idx1 < end_idx; ++image_idx1) {
+      for (int image_idx2 = begin_idx; image_idx2 < end_idx; ++image_idx2) {
+        if (image_idx1 != image_idx2) {
+          overlapping_images[image_idx1].push_back(image_idx2);
+        }
+      }
+    }
+    begin_idx = end_idx;
+  }
+
+  std::vector<int> image_idxs(kNumImages);
+  std::iota(image_idxs.begin(), image_idxs.end(), 0);
+  std::shuffle(image_idxs.begin(), image_idxs.end(), prng);
+
+  const auto waves = GroupImagesIntoWaves(overlapping_images, image_idxs, 4);
+  BOOST_CHECK_GT(waves.size(), 1);
+  BOOST_CHECK_LT(waves.size(), kNumImages);
+
+  // Fuse the images of a wave against the fused pixels of the previous waves
+  // and commit their results in the order of the wave.
+  std::vector<FusedPixelMask> wave_masks = CreateFusedPixelMasks(kNumImages);
+  std::vector<PlyPoint> wave_points;
+  std::vector<std::vector<int>> wave_points_visibility;
+  std::vector<int> sequential_image_idxs;
+  for (const auto& wave : waves) {
+    std::vector<FusionResult> results;
+    for (const int image_idx : wave) {
+      results.push_back(
+          FuseImage(overlapping_images, wave_masks, image_idx));
+    }
+    for (auto& result : results) {
+      BOOST_CHECK_EQUAL(CommitFusionResult(&result, &wave_masks, &wave_points,
+                                           &wave_points_visibility),
+                        0);
+    }
+    sequential_image_idxs.insert(sequential_image_idxs.end(), wave.begin(),
+                                 wave.end());
+  }
+
+  // Fuse and commit the images one after the other in the same order.
+  std::vector<FusedPixelMask> sequential_masks =
+      CreateFusedPixelMasks(kNumImages);
+  std::vector<PlyPoint> sequential_points;
+  std::vector<std::vector<int>> sequential_points_visibility;
+  for (const int image_idx : sequential_image_idxs) {
+    FusionResult result =
+        FuseImage(overlapping_images, sequential_masks, image_idx);
+    BOOST_CHECK_EQUAL(
+        CommitFusionResult(&result, &sequential_masks, &sequential_points,
+                           &sequential_points_visibility),
+        0);
+  }
+
+  BOOST_CHECK_GT(sequential_points.size(), 0);
+  BOOST_CHECK_EQUAL(wave_points.size(), sequential_points.size());
+  for (size_t i = 0; i < wave_points.size(); ++i) {
+    BOOST_CHECK_EQUAL(wave_points[i].x, sequential_points[i].x);
+    BOOST_CHECK_EQUAL(wave_points[i].y, sequential_points[i].y);
+    BOOST_CHECK_EQUAL(wave_points[i].z, sequential_points[i].z);
+    BOOST_CHECK(wave_points_visibility[i] == sequential_points_visibility[i]);
+  }
+  CheckEqualFusedPixelMasks(wave_masks, sequential_masks);
+}
+
+BOOST_AUTO_TEST_CASE(TestCommitFusionResultDiscardsConflicts) {
+  // Images 0 and 2 do not overlap but both fuse pixels of image 1.
+  const std::vector<std::vector<int>> overlapping_images = {{1}, {}, {1}};
+  const auto waves = GroupImagesIntoWaves(overlapping_images, {0, 2, 1}, 32);
+  BOOST_CHECK_EQUAL(waves.size(), 2);
+  BOOST_CHECK(waves[0] == std::vector<int>({0, 2}));
+
+  std::vector<FusedPixelMask> masks = CreateFusedPixelMasks(3);
+  FusionResult result0 = FuseImage(overlapping_images, masks, 0);
+  FusionResult result2 = FuseImage(overlapping_images, masks, 2);
+  const size_t num_points0 = result0.points.size();
+  const size_t num_points2 = result2.points.size();
+
+  std::vector<PlyPoint> points;
+  std::vector<std::vector<int>> points_visibility;
+  BOOST_CHECK_EQUAL(
+      CommitFusionResult(&result0, &masks, &points, &points_visibility), 0);
+  BOOST_CHECK_EQUAL(points.size(), num_points0);
+
+  // Image 2 fuses the same pixels of image 1 exactly where image 0 did, so
+  // all of its points conflict with the earlier committed image 0.
+  BOOST_CHECK_EQUAL(
+      CommitFusionResult(&result2, &masks, &points, &points_visibility),
+      num_points2);
+  BOOST_CHECK_EQUAL(points.size(), num_points0);
+
+  // Committed pixels are fused by exactly one point.
+  int num_fused_pixels = 0;
+  for (const auto& mask : masks) {
+    for (int pixel_idx = 0; pixel_idx < kWidth * kHeight; ++pixel_idx) {
+      num_fused_pixels += mask.IsFused(pixel_idx);
+    }
+  }
+  size_t num_point_pixels = 0;
+  for (const auto& visibility : points_visibility) {
+    num_point_pixels += visibility.size();
+  }
+  const size_t num_single_pixels =
+      2 * kWidth * kHeight - num_points0 - num_points2;
+  BOOST_CHECK_EQUAL(num_fused_pixels, num_point_pixels + num_single_pixels);
+}
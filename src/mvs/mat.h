@@ -32,12 +32,17 @@
 #ifndef COLMAP_SRC_MVS_MAT_H_
 #define COLMAP_SRC_MVS_MAT_H_
 
+#include <cstring>
 #include <fstream>
+#include <memory>
+#include <sstream>
 #include <string>
+#include <type_traits>
 #include <vector>
 
 #include "util/endian.h"
 #include "util/logging.h"
+#include "util/mapped_file.h"
 
 namespace colmap {
 namespace mvs {
@@ -52,6 +57,8 @@ class Mat {
   size_t GetHeight() const;
   size_t GetDepth() const;
 
+  // The number of bytes allocated in memory. The data of a mapped matrix is
+  // not included, since its pages are managed by the operating system.
   size_t GetNumBytes() const;
 
   T Get(const size_t row, const size_t col, const size_t slice = 0) const;
@@ -59,24 +66,56 @@ class Mat {
   T* GetPtr();
   const T* GetPtr() const;
 
-  const std::vector<T>& GetData() const;
-
   void Set(const size_t row, const size_t col, const T value);
   void Set(const size_t row, const size_t col, const size_t slice,
            const T value);
 
   void Fill(const T value);
 
+  // Read the matrix from a file, which stores the elements either with their
+  // native type or, for float matrices, as 16-bit floating point numbers.
   void Read(const std::string& path);
-  void Write(const std::string& path) const;
+
+  // Read the matrix through a read-only memory mapping of the file. If the
+  // file stores the elements with their native type at an aligned offset, the
+  // matrix is a view of the mapped file and shares its pages with all other
+  // views and processes, otherwise the data is decoded into memory. Modifying
+  // a mapped matrix first copies its data into memory.
+  void ReadMapped(const std::string& path);
+
+  // Whether the matrix is a view of a memory-mapped file.
+  bool IsMapped() const;
+
+  // Write the matrix to a file. The header is padded such that the data is
+  // aligned for memory-mapped reading. Float matrices can optionally be stored
+  // as 16-bit floating point numbers at half the size and reduced precision.
+  void Write(const std::string& path, const bool float16 = false) const;
 
  protected:
+  // Copy the data of a mapped matrix into memory and release the mapping.
+  void Unmap();
+
   size_t width_ = 0;
   size_t height_ = 0;
   size_t depth_ = 0;
   std::vector<T> data_;
+  std::shared_ptr<const MappedFile> mapped_file_;
+  const T* mapped_data_ = nullptr;
 };
 
+namespace internal {
+
+// Convert between 32-bit and 16-bit IEEE-754 floating point numbers with
+// rounding to the nearest representable value.
+inline uint16_t FloatToHalf(const float value);
+inline float HalfToFloat(const uint16_t value);
+
+// Parse the text header of a matrix file and return the offset of the data.
+inline size_t ReadMatHeader(std::istream* stream, size_t* width,
+                            size_t* height, size_t* depth);
+
+}  // namespace internal
+
 ////////////////////////////////////////////////////////////////////////////////
 // Implementation
 ////////////////////////////////////////////////////////////////////////////////
@@ -112,7 +151,14 @@ size_t Mat<T>::GetNumBytes() const {
 
 template <typename T>
 T Mat<T>::Get(const size_t row, const size_t col, const size_t slice) const {
-  return data_.at(slice * width_ * height_ + row * width_ + col);
+  const size_t idx = slice * width_ * height_ + row * width_ + col;
+  if (mapped_data_ != nullptr) {
+    if (idx >= width_ * height_ * depth_) {
+      LOG(FATAL) << "Index out of range";
+    }
+    return mapped_data_[idx];
+  }
+  return data_.at(idx);
 }
 
 template <typename T>
@@ -124,19 +170,18 @@ void Mat<T>::GetSlice(const size_t row, const size_t col, T* values) const {
 
 template <typename T>
 T* Mat<T>::GetPtr() {
+  Unmap();
   return data_.data();
 }
 
 template <typename T>
 const T* Mat<T>::GetPtr() const {
+  if (mapped_data_ != nullptr) {
+    return mapped_data_;
+  }
   return data_.data();
 }
 
-template <typename T>
-const std::vector<T>& Mat<T>::GetData() const {
-  return data_;
-}
-
 template <typename T>
 void Mat<T>::Set(const size_t row, const size_t col, const T value) {
   Set(row, col, 0, value);
@@ -145,51 +190,233 @@ void Mat<T>::Set(const size_t row, const size_t col, const T value) {
 template <typename T>
 void Mat<T>::Set(const size_t row, const size_t col, const size_t slice,
                  const T value) {
+  Unmap();
   data_.at(slice * width_ * height_ + row * width_ + col) = value;
 }
 
 template <typename T>
 void Mat<T>::Fill(const T value) {
-  std::fill(data_.begin(), data_.end(), value);
+  mapped_file_.reset();
+  mapped_data_ = nullptr;
+  data_.assign(width_ * height_ * depth_, value);
 }
 
 template <typename T>
 void Mat<T>::Read(const std::string& path) {
-  std::fstream text_file(path, std::ios::in | std::ios::binary);
-  CHECK(text_file.is_open()) << path;
-
-  char unused_char;
-  text_file >> width_ >> unused_char >> height_ >> unused_char >> depth_ >>
-      unused_char;
-  std::streampos pos = text_file.tellg();
-  text_file.close();
+  mapped_file_.reset();
+  mapped_data_ = nullptr;
+
+  std::fstream file(path, std::ios::in | std::ios::binary);
+  CHECK(file.is_open()) << path;
+
+  const size_t offset =
+      internal::ReadMatHeader(&file, &width_, &height_, &depth_);
+  file.seekg(0, std::ios::end);
+  const size_t num_data_bytes = static_cast<size_t>(file.tellg()) - offset;
+  file.seekg(offset);
+
+  const size_t num_elems = width_ * height_ * depth_;
+  if (num_data_bytes == num_elems * sizeof(T)) {
+    data_.resize(num_elems);
+    ReadBinaryLittleEndian<T>(&file, &data_);
+  } else if (std::is_same<T, float>::value &&
+             num_data_bytes == num_elems * sizeof(uint16_t)) {
+    std::vector<uint16_t> half_data(num_elems);
+    ReadBinaryLittleEndian<uint16_t>(&file, &half_data);
+    data_.resize(num_elems);
+    for (size_t i = 0; i < num_elems; ++i) {
+      data_[i] = internal::HalfToFloat(half_data[i]);
+    }
+  } else {
+    LOG(FATAL) << "Invalid matrix file size: " << path;
+  }
+}
 
-  CHECK_GT(width_, 0);
-  CHECK_GT(height_, 0);
-  CHECK_GT(depth_, 0);
-  data_.resize(width_ * height_ * depth_);
+template <typename T>
+void Mat<T>::ReadMapped(const std::string& path) {
+  std::shared_ptr<const MappedFile> mapped_file =
+      std::make_shared<MappedFile>(path);
+  const char* data = reinterpret_cast<const char*>(mapped_file->Data());
+
+  // The header is short, such that it suffices to only parse its beginning.
+  const size_t kMaxNumHeaderBytes = 256;
+  std::istringstream header_stream(std::string(
+      data, std::min(mapped_file->NumBytes(), kMaxNumHeaderBytes)));
+  const size_t offset =
+      internal::ReadMatHeader(&header_stream, &width_, &height_, &depth_);
+  CHECK_LE(offset, mapped_file->NumBytes()) << path;
+
+  const size_t num_elems = width_ * height_ * depth_;
+  const size_t num_data_bytes = mapped_file->NumBytes() - offset;
+
+  mapped_file_.reset();
+  mapped_data_ = nullptr;
+
+  if (num_data_bytes == num_elems * sizeof(T)) {
+    if (IsLittleEndian() && offset % alignof(T) == 0) {
+      data_.clear();
+      data_.shrink_to_fit();
+      mapped_file_ = mapped_file;
+      mapped_data_ = reinterpret_cast<const T*>(data + offset);
+    } else {
+      data_.resize(num_elems);
+      std::memcpy(data_.data(), data + offset, num_data_bytes);
+      for (auto& value : data_) {
+        value = LittleEndianToNative(value);
+      }
+    }
+  } else if (std::is_same<T, float>::value &&
+             num_data_bytes == num_elems * sizeof(uint16_t)) {
+    data_.resize(num_elems);
+    for (size_t i = 0; i < num_elems; ++i) {
+      uint16_t half_value;
+      std::memcpy(&half_value, data + offset + i * sizeof(uint16_t),
+                  sizeof(uint16_t));
+      data_[i] = internal::HalfToFloat(LittleEndianToNative(half_value));
+    }
+  } else {
+    LOG(FATAL) << "Invalid matrix file size: " << path;
+  }
+}
 
-  std::fstream binary_file(path, std::ios::in | std::ios::binary);
-  CHECK(binary_file.is_open()) << path;
-  binary_file.seekg(pos);
-  ReadBinaryLittleEndian<T>(&binary_file, &data_);
-  binary_file.close();
+template <typename T>
+bool Mat<T>::IsMapped() const {
+  return mapped_data_ != nullptr;
 }
 
 template <typename T>
-void Mat<T>::Write(const std::string& path) const {
+void Mat<T>::Write(const std::string& path, const bool float16) const {
+  CHECK((!float16 || std::is_same<T, float>::value));
+
+  // Leading whitespace is skipped when parsing the header, which allows to
+  // align the data without breaking compatibility with existing readers.
+  const size_t kDataAlignment = 16;
+  std::ostringstream header;
+  header << width_ << "&" << height_ << "&" << depth_ << "&";
+  const size_t num_header_bytes = header.str().size();
+  const size_t num_padding_bytes =
+      (kDataAlignment - num_header_bytes % kDataAlignment) % kDataAlignment;
+
   std::fstream text_file(path, std::ios::out);
   CHECK(text_file.is_open()) << path;
-  text_file << width_ << "&" << height_ << "&" << depth_ << "&";
+  text_file << std::string(num_padding_bytes, ' ') << header.str();
   text_file.close();
 
   std::fstream binary_file(path,
                            std::ios::out | std::ios::binary | std::ios::app);
   CHECK(binary_file.is_open()) << path;
-  WriteBinaryLittleEndian<T>(&binary_file, data_);
+  const size_t num_elems = width_ * height_ * depth_;
+  const T* data = GetPtr();
+  if (float16) {
+    std::vector<uint16_t> half_data(num_elems);
+    for (size_t i = 0; i < num_elems; ++i) {
+      half_data[i] = internal::FloatToHalf(static_cast<float>(data[i]));
+    }
+    WriteBinaryLittleEndian<uint16_t>(&binary_file, half_data);
+  } else if (mapped_data_ != nullptr) {
+    WriteBinaryLittleEndian<T>(&binary_file,
+                               std::vector<T>(data, data + num_elems));
+  } else {
+    WriteBinaryLittleEndian<T>(&binary_file, data_);
+  }
   binary_file.close();
 }
 
+template <typename T>
+void Mat<T>::Unmap() {
+  if (mapped_data_ == nullptr) {
+    return;
+  }
+  data_.assign(mapped_data_, mapped_data_ + width_ * height_ * depth_);
+  mapped_file_.reset();
+  mapped_data_ = nullptr;
+}
+
+namespace internal {
+
+uint16_t FloatToHalf(const float value) {
+  uint32_t bits;
+  std::memcpy(&bits, &value, sizeof(float));
+  const uint16_t sign = static_cast<uint16_t>((bits >> 16) & 0x8000);
+  const uint32_t abs_bits = bits & 0x7FFFFFFF;
+
+  // Infinity and NaN.
+  if (abs_bits >= 0x7F800000) {
+    return sign | 0x7C00 | (abs_bits > 0x7F800000 ? 0x0200 : 0);
+  }
+
+  // Values that round to a magnitude above the largest half number.
+  if (abs_bits >= 0x477FF000) {
+    return sign | 0x7C00;
+  }
+
+  // Normal half numbers.
+  if (abs_bits >= 0x38800000) {
+    uint32_t half_bits = (abs_bits - 0x38000000) >> 13;
+    const uint32_t remainder = abs_bits & 0x1FFF;
+    if (remainder > 0x1000 || (remainder == 0x1000 && (half_bits & 1))) {
+      half_bits += 1;
+    }
+    return sign | static_cast<uint16_t>(half_bits);
+  }
+
+  // Values that round to zero.
+  if (abs_bits < 0x33000000) {
+    return sign;
+  }
+
+  // Subnormal half numbers.
+  const uint32_t mantissa = (abs_bits & 0x7FFFFF) | 0x800000;
+  const uint32_t shift = 126 - (abs_bits >> 23);
+  uint32_t half_bits = mantissa >> shift;
+  const uint32_t remainder = mantissa & ((1u << shift) - 1);
+  const uint32_t halfway = 1u << (shift - 1);
+  if (remainder > halfway || (remainder == halfway && (half_bits & 1))) {
+    half_bits += 1;
+  }
+  return sign | static_cast<uint16_t>(half_bits);
+}
+
+float HalfToFloat(const uint16_t value) {
+  const uint32_t sign = static_cast<uint32_t>(value & 0x8000) << 16;
+  const uint32_t exponent = (value >> 10) & 0x1F;
+  uint32_t mantissa = value & 0x3FF;
+
+  uint32_t bits;
+  if (exponent == 0x1F) {
+    bits = sign | 0x7F800000 | (mantissa << 13);
+  } else if (exponent > 0) {
+    bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+  } else if (mantissa == 0) {
+    bits = sign;
+  } else {
+    // Normalize the subnormal half number.
+    uint32_t float_exponent = 113;
+    while ((mantissa & 0x400) == 0) {
+      mantissa <<= 1;
+      float_exponent -= 1;
+    }
+    bits = sign | (float_exponent << 23) | ((mantissa & 0x3FF) << 13);
+  }
+
+  float result;
+  std::memcpy(&result, &bits, sizeof(float));
+  return result;
+}
+
+size_t ReadMatHeader(std::istream* stream, size_t* width, size_t* height,
+                     size_t* depth) {
+  char unused_char;
+  *stream >> *width >> unused_char >> *height >> unused_char >> *depth >>
+      unused_char;
+  CHECK(!stream->fail());
+  CHECK_GT(*width, 0);
+  CHECK_GT(*height, 0);
+  CHECK_GT(*depth, 0);
+  return static_cast<size_t>(stream->tellg());
+}
+
+}  // namespace internal
 }  // namespace mvs
 }  // namespace colmap
 
@@ -95,3 +95,151 @@ BOOST_AUTO_TEST_CASE(TestFill) {
   mat.Set(1, 0, 1, 10);
   mat.Set(1, 0, 2, 10);
 }
+
+BOOST_AUTO_TEST_CASE(TestReadWrite) {
+  const std::string path = "mat_test.bin";
+
+  Mat<float> mat(3, 4, 2);
+  for (size_t slice = 0; slice < 2; ++slice) {
+    for (size_t row = 0; row < 4; ++row) {
+      for (size_t col = 0; col < 3; ++col) {
+        mat.Set(row, col, slice, row * 100.0f + col * 10.0f + slice + 0.5f);
+      }
+    }
+  }
+  mat.Write(path);
+
+  Mat<float> read_mat;
+  read_mat.Read(path);
+  BOOST_CHECK(!read_mat.IsMapped());
+  BOOST_CHECK_EQUAL(read_mat.GetWidth(), 3);
+  BOOST_CHECK_EQUAL(read_mat.GetHeight(), 4);
+  BOOST_CHECK_EQUAL(read_mat.GetDepth(), 2);
+  for (size_t slice = 0; slice < 2; ++slice) {
+    for (size_t row = 0; row < 4; ++row) {
+      for (size_t col = 0; col < 3; ++col) {
+        BOOST_CHECK_EQUAL(read_mat.Get(row, col, slice),
+                          mat.Get(row, col, slice));
+      }
+    }
+  }
+
+  std::remove(path.c_str());
+}
+
+BOOST_AUTO_TEST_CASE(TestReadMapped) {
+  const std::string path = "mat_test_mapped.bin";
+
+  Mat<float> mat(3, 4, 2);
+  for (size_t slice = 0; slice < 2; ++slice) {
+    for (size_t row = 0; row < 4; ++row) {
+      for (size_t col = 0; col < 3; ++col) {
+        mat.Set(row, col, slice, row * 100.0f + col * 10.0f + slice + 0.5f);
+      }
+    }
+  }
+  mat.Write(path);
+
+  Mat<float> mapped_mat;
+  mapped_mat.ReadMapped(path);
+  BOOST_CHECK(mapped_mat.IsMapped());
+  BOOST_CHECK_EQUAL(mapped_mat.GetWidth(), 3);
+  BOOST_CHECK_EQUAL(mapped_mat.GetHeight(), 4);
+  BOOST_CHECK_EQUAL(mapped_mat.GetDepth(), 2);
+  BOOST_CHECK_EQUAL(mapped_mat.GetNumBytes(), 0);
+  for (size_t slice = 0; slice < 2; ++slice) {
+    for (size_t row = 0; row < 4; ++row) {
+      for (size_t col = 0; col < 3; ++col) {
+        BOOST_CHECK_EQUAL(mapped_mat.Get(row, col, slice),
+                          mat.Get(row, col, slice));
+      }
+    }
+  }
+
+  // Copies share the mapping, while modifications copy the data.
+  Mat<float> copied_mat = mapped_mat;
+  BOOST_CHECK(copied_mat.IsMapped());
+  copied_mat.Set(0, 0, 0, -1.0f);
+  BOOST_CHECK(!copied_mat.IsMapped());
+  BOOST_CHECK_EQUAL(copied_mat.GetNumBytes(), 96);
+  BOOST_CHECK_EQUAL(copied_mat.Get(0, 0, 0), -1.0f);
+  BOOST_CHECK_EQUAL(copied_mat.Get(3, 2, 1), mat.Get(3, 2, 1));
+  BOOST_CHECK_EQUAL(mapped_mat.Get(0, 0, 0), mat.Get(0, 0, 0));
+
+  std::remove(path.c_str());
+}
+
+BOOST_AUTO_TEST_CASE(TestReadMappedUnaligned) {
+  const std::string path = "mat_test_unaligned.bin";
+
+  // Files written without padding of the header cannot be referenced in place.
+  {
+    std::fstream file(path, std::ios::out | std::ios::binary);
+    file << "2&1&1&";
+    const float values[2] = {1.5f, -2.5f};
+    file.write(reinterpret_cast<const char*>(values), sizeof(values));
+  }
+
+  Mat<float> mapped_mat;
+  mapped_mat.ReadMapped(path);
+  BOOST_CHECK(!mapped_mat.IsMapped());
+  BOOST_CHECK_EQUAL(mapped_mat.Get(0, 0), 1.5f);
+  BOOST_CHECK_EQUAL(mapped_mat.Get(0, 1), -2.5f);
+
+  Mat<float> read_mat;
+  read_mat.Read(path);
+  BOOST_CHECK_EQUAL(read_mat.Get(0, 0), 1.5f);
+  BOOST_CHECK_EQUAL(read_mat.Get(0, 1), -2.5f);
+
+  std::remove(path.c_str());
+}
+
+BOOST_AUTO_TEST_CASE(TestReadWriteFloat16) {
+  const std::string path = "mat_test_float16.bin";
+
+  Mat<float> mat(5, 3, 1);
+  for (size_t row = 0; row < 3; ++row) {
+    for (size_t col = 0; col < 5; ++col) {
+      mat.Set(row, col, 0.1f * row + 2.0f * col - 1.0f);
+    }
+  }
+  mat.Write(path, /*float16=*/true);
+
+  Mat<float> read_mat;
+  read_mat.Read(path);
+  Mat<float> mapped_mat;
+  mapped_mat.ReadMapped(path);
+  BOOST_CHECK(!mapped_mat.IsMapped());
+  for (size_t row = 0; row < 3; ++row) {
+    for (size_t col = 0; col < 5; ++col) {
+      BOOST_CHECK_CLOSE(read_mat.Get(row, col), mat.Get(row, col), 0.1);
+      BOOST_CHECK_EQUAL(mapped_mat.Get(row, col), read_mat.Get(row, col));
+    }
+  }
+
+  std::remove(path.c_str());
+}
+
+BOOST_AUTO_TEST_CASE(TestFloatToHalf) {
+  using namespace colmap::mvs::internal;
+  BOOST_CHECK_EQUAL(FloatToHalf(0.0f), 0x0000);
+  BOOST_CHECK_EQUAL(FloatToHalf(-0.0f), 0x8000);
+  BOOST_CHECK_EQUAL(FloatToHalf(1.0f), 0x3C00);
+  BOOST_CHECK_EQUAL(FloatToHalf(-2.0f), 0xC000);
+  BOOST_CHECK_EQUAL(FloatToHalf(65504.0f), 0x7BFF);
+  BOOST_CHECK_EQUAL(FloatToHalf(1e6f), 0x7C00);
+  BOOST_CHECK_EQUAL(FloatToHalf(std::pow(2.0f, -24.0f)), 0x0001);
+  BOOST_CHECK_EQUAL(FloatToHalf(std::pow(2.0f, -26.0f)), 0x0000);
+  BOOST_CHECK_EQUAL(FloatToHalf(std::numeric_limits<float>::infinity()),
+                    0x7C00);
+  BOOST_CHECK_EQUAL(HalfToFloat(0x3C00), 1.0f);
+  BOOST_CHECK_EQUAL(HalfToFloat(0xC000), -2.0f);
+  BOOST_CHECK_EQUAL(HalfToFloat(0x7BFF), 65504.0f);
+  BOOST_CHECK_EQUAL(HalfToFloat(0x0001), std::pow(2.0f, -24.0f));
+  BOOST_CHECK_EQUAL(HalfToFloat(0x03FF), 1023 * std::pow(2.0f, -24.0f));
+  BOOST_CHECK(std::isinf(HalfToFloat(0x7C00)));
+  BOOST_CHECK(std::isnan(HalfToFloat(FloatToHalf(std::nanf("")))));
+  for (uint32_t bits = 0; bits < 0x7C00; ++bits) {
+    BOOST_CHECK_EQUAL(FloatToHalf(HalfToFloat(bits)), bits);
+  }
+}
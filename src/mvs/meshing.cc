@@ -32,11 +32,19 @@
 #include "mvs/meshing.h"
 
 #include <fstream>
+#include <future>
+#include <limits>
+#include <mutex>
 #include <unordered_map>
 #include <vector>
 
+#include <Eigen/Core>
+
 #ifdef CGAL_ENABLED
 #include <CGAL/Delaunay_triangulation_3.h>
+#ifdef CGAL_LINKED_WITH_TBB
+#include <CGAL/Delaunay_triangulation_cell_base_3.h>
+#endif  // CGAL_LINKED_WITH_TBB
 #include <CGAL/Exact_predicates_inexact_constructions_kernel.h>
 #endif  // CGAL_ENABLED
 
@@ -56,7 +64,19 @@
 #ifdef CGAL_ENABLED
 
 typedef CGAL::Exact_predicates_inexact_constructions_kernel K;
+
+#ifdef CGAL_LINKED_WITH_TBB
+// Concurrent triangulation data structure that supports parallel insertion
+// of points protected by a spatial lock grid. Note that the location policy
+// must be the default compact policy for parallel triangulations.
+typedef CGAL::Triangulation_data_structure_3<
+    CGAL::Triangulation_vertex_base_3<K>,
+    CGAL::Delaunay_triangulation_cell_base_3<K>, CGAL::Parallel_tag>
+    DelaunayDataStructure;
+typedef CGAL::Delaunay_triangulation_3<K, DelaunayDataStructure> Delaunay;
+#else
 typedef CGAL::Delaunay_triangulation_3<K, CGAL::Fast_location> Delaunay;
+#endif  // CGAL_LINKED_WITH_TBB
 
 namespace std {
 
@@ -102,6 +122,9 @@ bool PoissonMeshingOptions::Check() const {
   CHECK_OPTION_GE(trim, 0);
   CHECK_OPTION_GE(num_threads, -1);
   CHECK_OPTION_NE(num_threads, 0);
+  CHECK_OPTION_GE(block_max_num_points, 0);
+  CHECK_OPTION_GE(block_overlap, 0);
+  CHECK_OPTION_GT(block_chunk_size, 0);
   return true;
 }
 
@@ -120,11 +143,622 @@ bool DelaunayMeshingOptions::Check() const {
   return true;
 }
 
+namespace {
+
+// Maximum level of the octree used to partition the point cloud into blocks
+// for out-of-core Poisson meshing. Cells at this level are not subdivided
+// further, even if they contain more than the maximum number of points.
+const int kMaxBlockOctreeLevel = 7;
+
+// Minimum number of points in a block for it to be meshed. Blocks with fewer
+// points only contain stray points, which cannot be meshed robustly.
+const size_t kMinNumBlockPoints = 10;
+
+// Spatial block of the point cloud that is meshed independently.
+struct PoissonMeshingBlock {
+  // The level of the block's cell in the octree.
+  int level = 0;
+
+  // The number of points in the block without the overlap.
+  size_t num_points = 0;
+
+  // The bounds of the block without and with the overlap to its neighbors.
+  Eigen::Vector3f min_bound = Eigen::Vector3f::Zero();
+  Eigen::Vector3f max_bound = Eigen::Vector3f::Zero();
+  Eigen::Vector3f overlap_min_bound = Eigen::Vector3f::Zero();
+  Eigen::Vector3f overlap_max_bound = Eigen::Vector3f::Zero();
+
+  // The Poisson reconstruction depth of the block, which is chosen such that
+  // all blocks are reconstructed at the same resolution.
+  int depth = 0;
+};
+
+// Uniform grid over the cubic bounding box of the point cloud at the finest
+// level of the block octree.
+struct PoissonMeshingBlockGrid {
+  Eigen::Vector3f origin = Eigen::Vector3f::Zero();
+  float size = 1.0f;
+
+  int Resolution(const int level) const { return 1 << level; }
+
+  Eigen::Vector3i CellIndex(const PlyPoint& point, const int level) const {
+    const int resolution = Resolution(level);
+    const Eigen::Vector3f rel_position =
+        (Eigen::Vector3f(point.x, point.y, point.z) - origin) *
+        (resolution / size);
+    Eigen::Vector3i idx;
+    for (int d = 0; d < 3; ++d) {
+      idx(d) = std::min(
+          resolution - 1,
+          std::max(0, static_cast<int>(std::floor(rel_position(d)))));
+    }
+    return idx;
+  }
+
+  size_t LinearIndex(const Eigen::Vector3i& idx, const int level) const {
+    const size_t resolution = Resolution(level);
+    return (idx.z() * resolution + idx.y()) * resolution + idx.x();
+  }
+};
+
+// Mesh of a block clipped to the block's bounds without the overlap.
+struct ClippedBlockMesh {
+  PlyMesh mesh;
+  // Whether each vertex lies on an open boundary edge of the clipped mesh.
+  std::vector<bool> boundary_vertices;
+  // Maximum distance at which boundary vertices of neighboring blocks are
+  // welded together, which is the voxel size of the block's reconstruction.
+  float weld_distance = 0.0f;
+};
+
+// Partition the point cloud spatially into an octree of blocks, such that
+// every block contains at most the maximum number of points.
+std::vector<PoissonMeshingBlock> PartitionPoissonMeshingBlocks(
+    const PoissonMeshingOptions& options, const std::string& input_path,
+    PoissonMeshingBlockGrid* grid) {
+  // Determine the cubic bounding box of the point cloud.
+
+  Eigen::Vector3f min_bound =
+      Eigen::Vector3f::Constant(std::numeric_limits<float>::max());
+  Eigen::Vector3f max_bound =
+      Eigen::Vector3f::Constant(std::numeric_limits<float>::lowest());
+  ReadPlyInChunks(input_path, options.block_chunk_size,
+                  [&](std::vector<PlyPoint>* points) {
+                    for (const auto& point : *points) {
+                      const Eigen::Vector3f xyz(point.x, point.y, point.z);
+                      min_bound = min_bound.cwiseMin(xyz);
+                      max_bound = max_bound.cwiseMax(xyz);
+                    }
+                  });
+
+  if ((min_bound.array() > max_bound.array()).any()) {
+    return {};
+  }
+
+  grid->origin = min_bound;
+  grid->size = std::max((max_bound - min_bound).maxCoeff(), 1e-6f);
+
+  // Count the number of points in the cells of all octree levels.
+
+  std::vector<std::vector<size_t>> level_counts(kMaxBlockOctreeLevel + 1);
+  for (int level = 0; level <= kMaxBlockOctreeLevel; ++level) {
+    const size_t resolution = grid->Resolution(level);
+    level_counts[level].resize(resolution * resolution * resolution, 0);
+  }
+
+  ReadPlyInChunks(
+      input_path, options.block_chunk_size,
+      [&](std::vector<PlyPoint>* points) {
+        for (const auto& point : *points) {
+          const Eigen::Vector3i idx =
+              grid->CellIndex(point, kMaxBlockOctreeLevel);
+          level_counts[kMaxBlockOctreeLevel][grid->LinearIndex(
+              idx, kMaxBlockOctreeLevel)] += 1;
+        }
+      });
+
+  for (int level = kMaxBlockOctreeLevel - 1; level >= 0; --level) {
+    const int child_resolution = grid->Resolution(level + 1);
+    Eigen::Vector3i idx;
+    for (idx.z() = 0; idx.z() < child_resolution; ++idx.z()) {
+      for (idx.y() = 0; idx.y() < child_resolution; ++idx.y()) {
+        for (idx.x() = 0; idx.x() < child_resolution; ++idx.x()) {
+          const Eigen::Vector3i parent_idx(idx.x() / 2, idx.y() / 2,
+                                           idx.z() / 2);
+          level_counts[level][grid->LinearIndex(parent_idx, level)] +=
+              level_counts[level + 1][grid->LinearIndex(idx, level + 1)];
+        }
+      }
+    }
+  }
+
+  // Recursively subdivide the octree cells into blocks until they contain at
+  // most the maximum number of points.
+
+  std::vector<PoissonMeshingBlock> blocks;
+
+  std::vector<std::pair<int, Eigen::Vector3i>> cells;
+  cells.emplace_back(0, Eigen::Vector3i::Zero());
+  while (!cells.empty()) {
+    const int level = cells.back().first;
+    const Eigen::Vector3i idx = cells.back().second;
+    cells.pop_back();
+
+    const size_t num_points =
+        level_counts[level][grid->LinearIndex(idx, level)];
+    if (num_points == 0) {
+      continue;
+    }
+
+    if (num_points > static_cast<size_t>(options.block_max_num_points) &&
+        level < kMaxBlockOctreeLevel) {
+      for (int i = 0; i < 8; ++i) {
+        const Eigen::Vector3i child_offset(i & 1, (i >> 1) & 1, (i >> 2) & 1);
+        cells.emplace_back(level + 1, 2 * idx + child_offset);
+      }
+      continue;
+    }
+
+    const float cell_size = grid->size / grid->Resolution(level);
+    const float overlap = options.block_overlap * cell_size;
+
+    PoissonMeshingBlock block;
+    block.level = level;
+    block.num_points = num_points;
+    block.min_bound = grid->origin + cell_size * idx.cast<float>();
+    block.max_bound = block.min_bound + Eigen::Vector3f::Constant(cell_size);
+    block.overlap_min_bound =
+        block.min_bound - Eigen::Vector3f::Constant(overlap);
+    block.overlap_max_bound =
+        block.max_bound + Eigen::Vector3f::Constant(overlap);
+    // Do not fall below the default full depth of the Poisson reconstruction.
+    block.depth = std::max(options.depth - level, std::min(options.depth, 5));
+    blocks.push_back(block);
+  }
+
+  return blocks;
+}
+
+// Stream the point cloud into the blocks, whose overlapping bounds contain the
+// points, and write the points of each block to a separate file.
+std::vector<size_t> WritePoissonMeshingBlocks(
+    const PoissonMeshingOptions& options, const std::string& input_path,
+    const PoissonMeshingBlockGrid& grid,
+    const std::vector<PoissonMeshingBlock>& blocks,
+    const std::vector<std::string>& block_paths) {
+  CHECK_EQ(blocks.size(), block_paths.size());
+
+  // Map each cell at the finest octree level to the blocks, whose overlapping
+  // bounds intersect with the cell, in compressed row storage.
+
+  const int resolution = grid.Resolution(kMaxBlockOctreeLevel);
+  const size_t num_cells =
+      static_cast<size_t>(resolution) * resolution * resolution;
+
+  std::vector<std::pair<Eigen::Vector3i, Eigen::Vector3i>> block_cell_ranges;
+  block_cell_ranges.reserve(blocks.size());
+  for (const auto& block : blocks) {
+    PlyPoint min_point;
+    min_point.x = block.overlap_min_bound.x();
+    min_point.y = block.overlap_min_bound.y();
+    min_point.z = block.overlap_min_bound.z();
+    PlyPoint max_point;
+    max_point.x = block.overlap_max_bound.x();
+    max_point.y = block.overlap_max_bound.y();
+    max_point.z = block.overlap_max_bound.z();
+    block_cell_ranges.emplace_back(
+        grid.CellIndex(min_point, kMaxBlockOctreeLevel),
+        grid.CellIndex(max_point, kMaxBlockOctreeLevel));
+  }
+
+  std::vector<uint32_t> cell_block_offsets(num_cells + 1, 0);
+  std::vector<uint32_t> cell_block_idxs;
+  for (int pass = 0; pass < 2; ++pass) {
+    if (pass == 1) {
+      for (size_t i = 0; i < num_cells; ++i) {
+        cell_block_offsets[i + 1] += cell_block_offsets[i];
+      }
+      cell_block_idxs.resize(cell_block_offsets.back());
+    }
+
+    std::vector<uint32_t> cell_block_counts(pass == 1 ? num_cells : 0, 0);
+    for (size_t block_idx = 0; block_idx < blocks.size(); ++block_idx) {
+      const auto& range = block_cell_ranges[block_idx];
+      Eigen::Vector3i idx;
+      for (idx.z() = range.first.z(); idx.z() <= range.second.z(); ++idx.z()) {
+        for (idx.y() = range.first.y(); idx.y() <= range.second.y();
+             ++idx.y()) {
+          for (idx.x() = range.first.x(); idx.x() <= range.second.x();
+               ++idx.x()) {
+            const size_t cell_idx =
+                grid.LinearIndex(idx, kMaxBlockOctreeLevel);
+            if (pass == 0) {
+              cell_block_offsets[cell_idx + 1] += 1;
+            } else {
+              cell_block_idxs[cell_block_offsets[cell_idx] +
+                              cell_block_counts[cell_idx]] = block_idx;
+              cell_block_counts[cell_idx] += 1;
+            }
+          }
+        }
+      }
+    }
+  }
+
+  // Distribute the points chunk by chunk to the blocks in parallel.
+
+  std::vector<BinaryPlyPointsWriter> writers;
+  writers.reserve(blocks.size());
+  for (const auto& block_path : block_paths) {
+    writers.emplace_back(block_path);
+  }
+
+  ThreadPool thread_pool(options.num_threads);
+  const size_t num_tasks = thread_pool.NumThreads();
+
+  std::vector<std::vector<std::vector<PlyPoint>>> task_block_points(
+      num_tasks, std::vector<std::vector<PlyPoint>>(blocks.size()));
+
+  auto DistributePoints = [&](const std::vector<PlyPoint>& points,
+                              const size_t task_idx) {
+    auto& block_points = task_block_points[task_idx];
+    for (size_t i = task_idx; i < points.size(); i += num_tasks) {
+      const auto& point = points[i];
+      const Eigen::Vector3f xyz(point.x, point.y, point.z);
+      const size_t cell_idx = grid.LinearIndex(
+          grid.CellIndex(point, kMaxBlockOctreeLevel), kMaxBlockOctreeLevel);
+      for (uint32_t j = cell_block_offsets[cell_idx];
+           j < cell_block_offsets[cell_idx + 1]; ++j) {
+        const auto& block = blocks[cell_block_idxs[j]];
+        if ((xyz.array() >= block.overlap_min_bound.array()).all() &&
+            (xyz.array() <= block.overlap_max_bound.array()).all()) {
+          block_points[cell_block_idxs[j]].push_back(point);
+        }
+      }
+    }
+  };
+
+  std::vector<PlyPoint> block_points;
+  ReadPlyInChunks(input_path, options.block_chunk_size,
+                  [&](std::vector<PlyPoint>* points) {
+                    for (size_t task_idx = 0; task_idx < num_tasks;
+                         ++task_idx) {
+                      thread_pool.AddTask(DistributePoints, std::cref(*points),
+                                          task_idx);
+                    }
+                    thread_pool.Wait();
+
+                    for (size_t block_idx = 0; block_idx < blocks.size();
+                         ++block_idx) {
+                      block_points.clear();
+                      for (auto& task_points : task_block_points) {
+                        block_points.insert(block_points.end(),
+                                            task_points[block_idx].begin(),
+                                            task_points[block_idx].end());
+                        task_points[block_idx].clear();
+                      }
+                      writers[block_idx].Write(block_points);
+                    }
+                  });
+
+  std::vector<size_t> block_num_points;
+  block_num_points.reserve(writers.size());
+  for (const auto& writer : writers) {
+    block_num_points.push_back(writer.NumPoints());
+  }
+
+  return block_num_points;
+}
+
+// Read the mesh of a block and clip it to the block's bounds without overlap.
+// Blocks on the boundary of the point cloud are not clipped on that side, so
+// that no surface beyond the bounding box is lost.
+ClippedBlockMesh ClipBlockMesh(const std::string& path,
+                               const PoissonMeshingBlock& block,
+                               const PoissonMeshingBlockGrid& grid) {
+  const PlyMesh mesh = ReadPlyMesh(path);
+
+  Eigen::Vector3f clip_min_bound = block.min_bound;
+  Eigen::Vector3f clip_max_bound = block.max_bound;
+  const Eigen::Vector3f grid_max_bound =
+      grid.origin + Eigen::Vector3f::Constant(grid.size);
+  for (int d = 0; d < 3; ++d) {
+    if (block.min_bound(d) <= grid.origin(d)) {
+      clip_min_bound(d) = std::numeric_limits<float>::lowest();
+    }
+    if (block.max_bound(d) >= grid_max_bound(d)) {
+      clip_max_bound(d) = std::numeric_limits<float>::max();
+    }
+  }
+
+  auto VertexPosition = [&mesh](const size_t vertex_idx) {
+    const auto& vertex = mesh.vertices[vertex_idx];
+    return Eigen::Vector3f(vertex.x, vertex.y, vertex.z);
+  };
+
+  ClippedBlockMesh clipped_mesh;
+
+  // Keep the faces whose centroid lies inside the half-open block bounds, so
+  // that every face in the overlap is kept by exactly one block.
+  std::vector<size_t> vertex_idx_map(mesh.vertices.size(),
+                                     std::numeric_limits<size_t>::max());
+  std::unordered_map<uint64_t, int> edge_num_faces;
+  for (const auto& face : mesh.faces) {
+    const Eigen::Vector3f centroid = (VertexPosition(face.vertex_idx1) +
+                                      VertexPosition(face.vertex_idx2) +
+                                      VertexPosition(face.vertex_idx3)) /
+                                     3.0f;
+    if ((centroid.array() < clip_min_bound.array()).any() ||
+        (centroid.array() >= clip_max_bound.array()).any()) {
+      continue;
+    }
+
+    size_t clipped_vertex_idxs[3];
+    const size_t vertex_idxs[3] = {face.vertex_idx1, face.vertex_idx2,
+                                   face.vertex_idx3};
+    for (int i = 0; i < 3; ++i) {
+      size_t& clipped_vertex_idx = vertex_idx_map[vertex_idxs[i]];
+      if (clipped_vertex_idx == std::numeric_limits<size_t>::max()) {
+        clipped_vertex_idx = clipped_mesh.mesh.vertices.size();
+        clipped_mesh.mesh.vertices.push_back(mesh.vertices[vertex_idxs[i]]);
+      }
+      clipped_vertex_idxs[i] = clipped_vertex_idx;
+    }
+
+    for (int i = 0; i < 3; ++i) {
+      const uint64_t idx1 = clipped_vertex_idxs[i];
+      const uint64_t idx2 = clipped_vertex_idxs[(i + 1) % 3];
+      edge_num_faces[(std::min(idx1, idx2) << 32) | std::max(idx1, idx2)] += 1;
+    }
+
+    clipped_mesh.mesh.faces.emplace_back(
+        clipped_vertex_idxs[0], clipped_vertex_idxs[1], clipped_vertex_idxs[2]);
+  }
+
+  // Vertices of edges with only one adjacent face lie on the mesh boundary.
+  clipped_mesh.boundary_vertices.resize(clipped_mesh.mesh.vertices.size(),
+                                        false);
+  for (const auto& edge : edge_num_faces) {
+    if (edge.second == 1) {
+      clipped_mesh.boundary_vertices[edge.first >> 32] = true;
+      clipped_mesh.boundary_vertices[edge.first & 0xFFFFFFFF] = true;
+    }
+  }
+
+  // The Poisson reconstruction scales the bounding box of the input by 1.1.
+  const float overlap_size =
+      (block.overlap_max_bound - block.overlap_min_bound).maxCoeff();
+  clipped_mesh.weld_distance = 1.1f * overlap_size / (1 << block.depth);
+
+  return clipped_mesh;
+}
+
+// Merge the clipped block meshes into a single mesh and stitch the seams by
+// welding boundary vertices of neighboring blocks.
+PlyMesh StitchBlockMeshes(const std::vector<ClippedBlockMesh>& block_meshes) {
+  float max_weld_distance = 0.0f;
+  size_t num_vertices = 0;
+  size_t num_faces = 0;
+  for (const auto& block_mesh : block_meshes) {
+    max_weld_distance = std::max(max_weld_distance, block_mesh.weld_distance);
+    num_vertices += block_mesh.mesh.vertices.size();
+    num_faces += block_mesh.mesh.faces.size();
+  }
+
+  PlyMesh mesh;
+  mesh.vertices.reserve(num_vertices);
+  mesh.faces.reserve(num_faces);
+
+  if (max_weld_distance <= 0.0f) {
+    return mesh;
+  }
+
+  // Boundary vertices of all merged blocks in a hashed grid with a cell size
+  // equal to the maximum weld distance.
+  struct BoundaryVertex {
+    size_t vertex_idx;
+    size_t block_idx;
+  };
+  std::unordered_map<uint64_t, std::vector<BoundaryVertex>> boundary_grid;
+
+  auto GridCell = [max_weld_distance](const PlyMeshVertex& vertex) {
+    return Eigen::Vector3i(
+        static_cast<int>(std::floor(vertex.x / max_weld_distance)),
+        static_cast<int>(std::floor(vertex.y / max_weld_distance)),
+        static_cast<int>(std::floor(vertex.z / max_weld_distance)));
+  };
+
+  auto GridKey = [](const Eigen::Vector3i& cell) {
+    return (static_cast<uint64_t>(cell.x()) * 73856093) ^
+           (static_cast<uint64_t>(cell.y()) * 19349663) ^
+           (static_cast<uint64_t>(cell.z()) * 83492791);
+  };
+
+  std::vector<size_t> vertex_idx_map;
+  for (size_t block_idx = 0; block_idx < block_meshes.size(); ++block_idx) {
+    const auto& block_mesh = block_meshes[block_idx];
+    const float max_squared_weld_distance =
+        block_mesh.weld_distance * block_mesh.weld_distance;
+
+    vertex_idx_map.resize(block_mesh.mesh.vertices.size());
+    for (size_t i = 0; i < block_mesh.mesh.vertices.size(); ++i) {
+      const auto& vertex = block_mesh.mesh.vertices[i];
+
+      if (!block_mesh.boundary_vertices[i]) {
+        vertex_idx_map[i] = mesh.vertices.size();
+        mesh.vertices.push_back(vertex);
+        continue;
+      }
+
+      // Find the closest boundary vertex of another block within the weld
+      // distance in the neighboring grid cells.
+      const Eigen::Vector3i cell = GridCell(vertex);
+      size_t weld_vertex_idx = std::numeric_limits<size_t>::max();
+      float min_squared_distance = max_squared_weld_distance;
+      for (int dz = -1; dz <= 1; ++dz) {
+        for (int dy = -1; dy <= 1; ++dy) {
+          for (int dx = -1; dx <= 1; ++dx) {
+            const auto it =
+                boundary_grid.find(GridKey(cell + Eigen::Vector3i(dx, dy, dz)));
+            if (it == boundary_grid.end()) {
+              continue;
+            }
+            for (const auto& boundary_vertex : it->second) {
+              if (boundary_vertex.block_idx == block_idx) {
+                continue;
+              }
+              const auto& other_vertex =
+                  mesh.vertices[boundary_vertex.vertex_idx];
+              const float squared_distance =
+                  (Eigen::Vector3f(vertex.x, vertex.y, vertex.z) -
+                   Eigen::Vector3f(other_vertex.x, other_vertex.y,
+                                   other_vertex.z))
+                      .squaredNorm();
+              if (squared_distance <= min_squared_distance) {
+                min_squared_distance = squared_distance;
+                weld_vertex_idx = boundary_vertex.vertex_idx;
+              }
+            }
+          }
+        }
+      }
+
+      if (weld_vertex_idx != std::numeric_limits<size_t>::max()) {
+        vertex_idx_map[i] = weld_vertex_idx;
+      } else {
+        vertex_idx_map[i] = mesh.vertices.size();
+        boundary_grid[GridKey(cell)].push_back(
+            BoundaryVertex{mesh.vertices.size(), block_idx});
+        mesh.vertices.push_back(vertex);
+      }
+    }
+
+    for (const auto& face : block_mesh.mesh.faces) {
+      const size_t vertex_idx1 = vertex_idx_map[face.vertex_idx1];
+      const size_t vertex_idx2 = vertex_idx_map[face.vertex_idx2];
+      const size_t vertex_idx3 = vertex_idx_map[face.vertex_idx3];
+      // Skip faces that collapsed due to welding.
+      if (vertex_idx1 == vertex_idx2 || vertex_idx1 == vertex_idx3 ||
+          vertex_idx2 == vertex_idx3) {
+        continue;
+      }
+      mesh.faces.emplace_back(vertex_idx1, vertex_idx2, vertex_idx3);
+    }
+  }
+
+  return mesh;
+}
+
+bool OutOfCorePoissonMeshing(const PoissonMeshingOptions& options,
+                             const std::string& input_path,
+                             const std::string& output_path) {
+  Timer timer;
+  timer.Start();
+
+  const std::string block_dir = output_path + ".blocks";
+  CreateDirIfNotExists(block_dir);
+
+  std::cout << "Partitioning points into blocks..." << std::endl;
+
+  PoissonMeshingBlockGrid grid;
+  const auto blocks =
+      PartitionPoissonMeshingBlocks(options, input_path, &grid);
+
+  std::vector<std::string> block_points_paths;
+  std::vector<std::string> block_mesh_paths;
+  for (size_t block_idx = 0; block_idx < blocks.size(); ++block_idx) {
+    block_points_paths.push_back(
+        JoinPaths(block_dir, StringPrintf("points%d.ply", block_idx)));
+    block_mesh_paths.push_back(
+        JoinPaths(block_dir, StringPrintf("meshed%d.ply", block_idx)));
+  }
+
+  const auto block_num_points = WritePoissonMeshingBlocks(
+      options, input_path, grid, blocks, block_points_paths);
+
+  std::cout << StringPrintf("Partitioned points into %d blocks in %.3fs",
+                            blocks.size(), timer.ElapsedSeconds())
+            << std::endl;
+
+  // Mesh the blocks one after the other, since the Poisson reconstruction is
+  // not reentrant and is already parallelized internally. The meshed blocks
+  // are read and clipped in parallel, while the next block is meshed.
+
+  ThreadPool thread_pool(options.num_threads);
+  std::vector<std::future<ClippedBlockMesh>> block_mesh_futures;
+
+  PoissonMeshingOptions block_options = options;
+  block_options.block_max_num_points = 0;
+
+  bool success = true;
+  for (size_t block_idx = 0; block_idx < blocks.size(); ++block_idx) {
+    const auto& block = blocks[block_idx];
+    const auto& block_points_path = block_points_paths[block_idx];
+    const auto& block_mesh_path = block_mesh_paths[block_idx];
+
+    if (block_num_points[block_idx] < kMinNumBlockPoints) {
+      boost::filesystem::remove(block_points_path);
+      continue;
+    }
+
+    std::cout << StringPrintf("Meshing block [%d/%d] with %d points",
+                              block_idx + 1, blocks.size(),
+                              block_num_points[block_idx])
+              << std::endl;
+
+    block_options.depth = block.depth;
+    success = PoissonMeshing(block_options, block_points_path, block_mesh_path);
+    boost::filesystem::remove(block_points_path);
+    if (!success) {
+      break;
+    }
+
+    block_mesh_futures.push_back(thread_pool.AddTask(
+        [&grid, &block, &block_mesh_path]() {
+          auto clipped_mesh = ClipBlockMesh(block_mesh_path, block, grid);
+          boost::filesystem::remove(block_mesh_path);
+          return clipped_mesh;
+        }));
+  }
+
+  std::vector<ClippedBlockMesh> block_meshes;
+  block_meshes.reserve(block_mesh_futures.size());
+  for (auto& block_mesh_future : block_mesh_futures) {
+    block_meshes.push_back(block_mesh_future.get());
+  }
+
+  boost::filesystem::remove_all(block_dir);
+
+  if (!success) {
+    return false;
+  }
+
+  std::cout << "Stitching block meshes..." << std::endl;
+
+  const PlyMesh mesh = StitchBlockMeshes(block_meshes);
+
+  std::cout << StringPrintf("Stitched mesh has %d vertices and %d faces",
+                            mesh.vertices.size(), mesh.faces.size())
+            << std::endl;
+
+  WriteBinaryPlyMesh(output_path, mesh, /*write_rgb=*/options.color > 0);
+
+  timer.PrintMinutes();
+
+  return true;
+}
+
+}  // namespace
+
 bool PoissonMeshing(const PoissonMeshingOptions& options,
                     const std::string& input_path,
                     const std::string& output_path) {
   CHECK(options.Check());
 
+  if (options.block_max_num_points > 0) {
+    return OutOfCorePoissonMeshing(options, input_path, output_path);
+  }
+
   std::vector<std::string> args;
 
   args.push_back("./binary");
@@ -205,6 +839,27 @@ Eigen::Vector3f CGALToEigen(const K::Point_3& point) {
   return Eigen::Vector3f(point.x(), point.y(), point.z());
 }
 
+// Insert a batch of points into the triangulation. If CGAL is linked with TBB,
+// the points are inserted in parallel by locking a spatial grid of cells over
+// the bounding box of the points.
+void InsertDelaunayPoints(const std::vector<K::Point_3>& points,
+                          Delaunay* triangulation) {
+#ifdef CGAL_LINKED_WITH_TBB
+  if (points.size() > 1) {
+    CGAL::Bbox_3 bbox = points[0].bbox();
+    for (const auto& point : points) {
+      bbox += point.bbox();
+    }
+    Delaunay::Lock_data_structure lock_data_structure(bbox, 50);
+    triangulation->set_lock_data_structure(&lock_data_structure);
+    triangulation->insert(points.begin(), points.end());
+    triangulation->set_lock_data_structure(nullptr);
+    return;
+  }
+#endif  // CGAL_LINKED_WITH_TBB
+  triangulation->insert(points.begin(), points.end());
+}
+
 class DelaunayMeshingInput {
  public:
   struct Image {
@@ -306,17 +961,18 @@ class DelaunayMeshingInput {
   }
 
   Delaunay CreateDelaunayTriangulation() const {
-    std::vector<Delaunay::Point> delaunay_points(points.size());
+    std::vector<K::Point_3> delaunay_points(points.size());
     for (size_t i = 0; i < points.size(); ++i) {
-      delaunay_points[i] =
-          Delaunay::Point(points[i].position.x(), points[i].position.y(),
-                          points[i].position.z());
+      delaunay_points[i] = EigenToCGAL(points[i].position);
     }
-    return Delaunay(delaunay_points.begin(), delaunay_points.end());
+    Delaunay triangulation;
+    InsertDelaunayPoints(delaunay_points, &triangulation);
+    return triangulation;
   }
 
-  Delaunay CreateSubSampledDelaunayTriangulation(
-      const float max_proj_dist, const float max_depth_dist) const {
+  Delaunay CreateSubSampledDelaunayTriangulation(const float max_proj_dist,
+                                                 const float max_depth_dist,
+                                                 const int num_threads) const {
     CHECK_GE(max_proj_dist, 0);
 
     if (max_proj_dist == 0) {
@@ -340,31 +996,24 @@ class DelaunayMeshingInput {
     const float min_depth_ratio = 1.0f - max_depth_dist;
     const float max_depth_ratio = 1.0f + max_depth_dist;
 
-    for (const auto point_idx : point_idxs) {
+    // Determine whether the point is not sufficiently represented by the
+    // located cell of the current triangulation and must thus be inserted.
+    // Only reads the triangulation and can be evaluated concurrently.
+    auto IsInsertPoint = [&](const size_t point_idx) {
       const auto& point = points[point_idx];
       const auto& visible_image_idxs = points_visible_image_idxs[point_idx];
 
-      const K::Point_3 point_position = EigenToCGAL(point.position);
-
-      // Insert point into triangulation until there is one cell.
-      if (triangulation.number_of_vertices() < 4) {
-        triangulation.insert(point_position);
-        continue;
-      }
-
-      const Delaunay::Cell_handle cell = triangulation.locate(point_position);
+      const Delaunay::Cell_handle cell =
+          triangulation.locate(EigenToCGAL(point.position));
 
       // If the point is outside the current hull, then extend the hull.
       if (triangulation.is_infinite(cell)) {
-        triangulation.insert(point_position);
-        continue;
+        return true;
       }
 
       // Project point and located cell vertices to all visible images and
       // determine reprojection error.
 
-      bool insert_point = false;
-
       for (const auto& image_idx : visible_image_idxs) {
         const auto& image = images[image_idx];
         const auto& camera = cameras.at(image.camera_id);
@@ -380,15 +1029,13 @@ class DelaunayMeshingInput {
 
           // Ensure that both points are infront of camera.
           if (point_local.z() <= 0 || cell_point_local.z() <= 0) {
-            insert_point = true;
-            break;
+            return true;
           }
 
           // Check depth ratio between the two points.
           const float depth_ratio = point_local.z() / cell_point_local.z();
           if (depth_ratio < min_depth_ratio || depth_ratio > max_depth_ratio) {
-            insert_point = true;
-            break;
+            return true;
           }
 
           // Check reprojection error between the two points.
@@ -401,19 +1048,75 @@ class DelaunayMeshingInput {
           const float squared_proj_dist =
               (point_proj - cell_point_proj).squaredNorm();
           if (squared_proj_dist > max_squared_proj_dist) {
-            insert_point = true;
-            break;
+            return true;
           }
         }
+      }
 
-        if (insert_point) {
-          break;
+      return false;
+    };
+
+    ThreadPool thread_pool(num_threads);
+
+    // Points are tested in batches against the triangulation as it was before
+    // the batch, then the accepted points are inserted at once. Points within
+    // the same batch do not see each other, so the batch size grows with the
+    // triangulation to bound the number of redundantly inserted points. With a
+    // single thread, points are tested and inserted one by one.
+    const size_t kMinBatchSize = 256 * thread_pool.NumThreads();
+    const bool sequential = thread_pool.NumThreads() == 1;
+
+    std::vector<char> batch_insert_points;
+    std::vector<K::Point_3> batch_points;
+
+    size_t batch_begin = 0;
+    while (batch_begin < point_idxs.size()) {
+      // Insert points into triangulation until there is one cell.
+      if (triangulation.dimension() < 3) {
+        triangulation.insert(
+            EigenToCGAL(points[point_idxs[batch_begin]].position));
+        batch_begin += 1;
+        continue;
+      }
+
+      const size_t batch_size =
+          sequential ? 1
+                     : std::max(kMinBatchSize,
+                                triangulation.number_of_vertices() / 8);
+      const size_t batch_end =
+          std::min(point_idxs.size(), batch_begin + batch_size);
+
+      batch_insert_points.resize(batch_end - batch_begin);
+      if (sequential) {
+        batch_insert_points[0] = IsInsertPoint(point_idxs[batch_begin]);
+      } else {
+        const size_t num_chunks = thread_pool.NumThreads();
+        const size_t chunk_size =
+            (batch_end - batch_begin + num_chunks - 1) / num_chunks;
+        for (size_t chunk_begin = batch_begin; chunk_begin < batch_end;
+             chunk_begin += chunk_size) {
+          const size_t chunk_end =
+              std::min(batch_end, chunk_begin + chunk_size);
+          thread_pool.AddTask([&, chunk_begin, chunk_end]() {
+            for (size_t i = chunk_begin; i < chunk_end; ++i) {
+              batch_insert_points[i - batch_begin] =
+                  IsInsertPoint(point_idxs[i]);
+            }
+          });
         }
+        thread_pool.Wait();
       }
 
-      if (insert_point) {
-        triangulation.insert(point_position);
+      batch_points.clear();
+      for (size_t i = batch_begin; i < batch_end; ++i) {
+        if (batch_insert_points[i - batch_begin]) {
+          batch_points.push_back(EigenToCGAL(points[point_idxs[i]].position));
+        }
       }
+
+      InsertDelaunayPoints(batch_points, &triangulation);
+
+      batch_begin = batch_end;
     }
 
     std::cout << StringPrintf("Triangulation has %d using %d points.",
@@ -698,22 +1401,32 @@ PlyMesh DelaunayMeshing(const DelaunayMeshingOptions& options,
                         const DelaunayMeshingInput& input_data) {
   CHECK(options.Check());
 
+  const int num_threads = GetEffectiveNumThreads(options.num_threads);
+
+  // Timer to measure the elapsed time of the individual meshing stages.
+  Timer stage_timer;
+  stage_timer.Start();
+
   // Create a delaunay triangulation of all input points.
   std::cout << "Triangulating points..." << std::endl;
   const auto triangulation = input_data.CreateSubSampledDelaunayTriangulation(
-      options.max_proj_dist, options.max_depth_dist);
+      options.max_proj_dist, options.max_depth_dist, num_threads);
+  stage_timer.PrintSeconds();
 
   // Helper class to efficiently trace rays through the triangulation.
   std::cout << "Initializing ray tracer..." << std::endl;
+  stage_timer.Restart();
   const DelaunayTriangulationRayCaster ray_caster(triangulation);
 
   // Helper class to efficiently compute edge weights in the s-t graph.
   const DelaunayMeshingEdgeWeightComputer edge_weight_computer(
       triangulation, options.visibility_sigma, options.distance_sigma_factor);
+  stage_timer.PrintSeconds();
 
   // Initialize the s-t graph with cells as nodes and oriented facets as edges.
 
   std::cout << "Initializing graph optimization..." << std::endl;
+  stage_timer.Restart();
 
   typedef std::unordered_map<const Delaunay::Cell_handle, DelaunayCellData>
       CellGraphData;
@@ -725,14 +1438,50 @@ PlyMesh DelaunayMeshing(const DelaunayMeshingOptions& options,
     cell_graph_data.emplace(it, DelaunayCellData(cell_graph_data.size()));
   }
 
+  stage_timer.PrintSeconds();
+
   // Spawn threads for parallelized integration of images.
-  const int num_threads = GetEffectiveNumThreads(options.num_threads);
   ThreadPool thread_pool(num_threads);
-  JobQueue<CellGraphData> result_queue(num_threads);
+
+  // The weights of an image are accumulated into sparse cell weights, which
+  // are merged into the global graph once the image is integrated. The cells
+  // of the global graph are sharded by their index and every shard is guarded
+  // by its own mutex, so that threads rarely wait for each other. The memory
+  // of the sparse weights is thus bounded by the images currently integrated.
+  const size_t kNumCellGraphShards = 64;
+  std::vector<std::mutex> cell_graph_shard_mutexes(kNumCellGraphShards);
+
+  typedef std::vector<std::pair<DelaunayCellData*, const DelaunayCellData*>>
+      ShardCellData;
+
+  // Function that merges the weights of a single image into the global graph.
+  auto MergeImageCellGraphData = [&](const CellGraphData& image_data) {
+    // The lookups do not modify the global graph, whose cells are fixed.
+    std::vector<ShardCellData> shard_cell_data(kNumCellGraphShards);
+    for (const auto& image_cell_data : image_data) {
+      auto& cell_data = cell_graph_data.at(image_cell_data.first);
+      shard_cell_data[cell_data.index % kNumCellGraphShards].emplace_back(
+          &cell_data, &image_cell_data.second);
+    }
+
+    for (size_t shard_idx = 0; shard_idx < kNumCellGraphShards; ++shard_idx) {
+      if (shard_cell_data[shard_idx].empty()) {
+        continue;
+      }
+      std::unique_lock<std::mutex> lock(cell_graph_shard_mutexes[shard_idx]);
+      for (const auto& cell_data : shard_cell_data[shard_idx]) {
+        cell_data.first->sink_weight += cell_data.second->sink_weight;
+        cell_data.first->source_weight += cell_data.second->source_weight;
+        for (size_t j = 0; j < cell_data.first->edge_weights.size(); ++j) {
+          cell_data.first->edge_weights[j] += cell_data.second->edge_weights[j];
+        }
+      }
+    }
+  };
 
   // Function that accumulates edge weights in the s-t graph for a single image.
   auto IntegreateImage = [&](const size_t image_idx) {
-    // Accumulated weights for the current image only.
+    // Accumulated weights for the current image.
     CellGraphData image_cell_graph_data;
 
     // Image that is integrated into s-t graph.
@@ -821,54 +1570,25 @@ PlyMesh DelaunayMeshing(const DelaunayMeshingOptions& options,
       }
     }
 
-    CHECK(result_queue.Push(image_cell_graph_data));
+    MergeImageCellGraphData(image_cell_graph_data);
   };
 
-  // Add first batch of images to the thread job queue.
-  size_t image_idx = 0;
-  const size_t init_num_tasks =
-      std::min(input_data.images.size(), 2 * thread_pool.NumThreads());
-  for (; image_idx < init_num_tasks; ++image_idx) {
+  std::cout << "Integrating images..." << std::endl;
+  stage_timer.Restart();
+
+  for (size_t image_idx = 0; image_idx < input_data.images.size();
+       ++image_idx) {
     thread_pool.AddTask(IntegreateImage, image_idx);
   }
 
-  // Pop the integrated images from the thread job queue and integrate their
-  // accumulated weights into the global graph.
-  for (size_t i = 0; i < input_data.images.size(); ++i) {
-    Timer timer;
-    timer.Start();
-
-    std::cout << StringPrintf("Integrating image [%d/%d]", i + 1,
-                              input_data.images.size())
-              << std::flush;
-
-    // Push the next image to the queue.
-    if (image_idx < input_data.images.size()) {
-      thread_pool.AddTask(IntegreateImage, image_idx);
-      image_idx += 1;
-    }
+  thread_pool.Wait();
 
-    // Pop the next results from the queue.
-    const auto result = result_queue.Pop();
-    CHECK(result.IsValid());
-
-    // Accumulate the weights of the image into the global graph.
-    const auto& image_cell_graph_data = result.Data();
-    for (const auto& image_cell_data : image_cell_graph_data) {
-      auto& cell_data = cell_graph_data.at(image_cell_data.first);
-      cell_data.sink_weight += image_cell_data.second.sink_weight;
-      cell_data.source_weight += image_cell_data.second.source_weight;
-      for (size_t j = 0; j < cell_data.edge_weights.size(); ++j) {
-        cell_data.edge_weights[j] += image_cell_data.second.edge_weights[j];
-      }
-    }
-
-    std::cout << StringPrintf(" in %.3fs", timer.ElapsedSeconds()) << std::endl;
-  }
+  stage_timer.PrintSeconds();
 
   // Setup the min-cut (max-flow) graph optimization.
 
   std::cout << "Setting up optimization..." << std::endl;
+  stage_timer.Restart();
 
   // Each oriented facet in the Delaunay triangulation corresponds to a directed
   // edge and each cell corresponds to a node in the graph.
@@ -913,12 +1633,17 @@ PlyMesh DelaunayMeshing(const DelaunayMeshingOptions& options,
     }
   }
 
+  stage_timer.PrintSeconds();
+
   // Extract the surface facets as the oriented min-cut of the graph.
 
   std::cout << "Running graph-cut optimization..." << std::endl;
+  stage_timer.Restart();
   graph_cut.Compute();
+  stage_timer.PrintSeconds();
 
   std::cout << "Extracting surface as min-cut..." << std::endl;
+  stage_timer.Restart();
 
   std::unordered_set<Delaunay::Vertex_handle> surface_vertices;
   std::vector<Delaunay::Facet> surface_facets;
@@ -964,7 +1689,10 @@ PlyMesh DelaunayMeshing(const DelaunayMeshingOptions& options,
     }
   }
 
+  stage_timer.PrintSeconds();
+
   std::cout << "Creating surface mesh model..." << std::endl;
+  stage_timer.Restart();
 
   PlyMesh mesh;
 
@@ -1002,6 +1730,8 @@ PlyMesh DelaunayMeshing(const DelaunayMeshingOptions& options,
             triangulation.vertex_triple_index(facet.second, 2))));
   }
 
+  stage_timer.PrintSeconds();
+
   return mesh;
 }
 
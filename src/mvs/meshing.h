@@ -64,6 +64,20 @@ struct PoissonMeshingOptions {
   // The number of threads used for the Poisson reconstruction.
   int num_threads = -1;
 
+  // If positive, the point cloud is meshed out-of-core. The input is streamed
+  // into spatially partitioned, overlapping octree blocks with at most this
+  // many points (excluding the overlap). The blocks are meshed independently
+  // and their meshes are clipped and stitched together at the block seams.
+  int block_max_num_points = 0;
+
+  // The overlap of neighboring blocks relative to their size. A larger overlap
+  // reduces artifacts at the block seams at the cost of more points per block.
+  double block_overlap = 0.1;
+
+  // The maximum number of points that are kept in memory at once while
+  // streaming the input point cloud into the blocks.
+  int block_chunk_size = 10000000;
+
   bool Check() const;
 };
 
@@ -42,9 +42,8 @@ NormalMap::NormalMap(const size_t width, const size_t height)
     : Mat<float>(width, height, 3) {}
 
 NormalMap::NormalMap(const Mat<float>& mat)
-    : Mat<float>(mat.GetWidth(), mat.GetHeight(), mat.GetDepth()) {
+    : Mat<float>(mat) {
   CHECK_EQ(mat.GetDepth(), 3);
-  data_ = mat.GetData();
 }
 
 void NormalMap::Rescale(const float factor) {
@@ -52,6 +51,8 @@ void NormalMap::Rescale(const float factor) {
     return;
   }
 
+  Unmap();
+
   const size_t new_width = std::round(width_ * factor);
   const size_t new_height = std::round(height_ * factor);
   std::vector<float> new_data(new_width * new_height * 3);
@@ -35,7 +35,12 @@
 #include <unordered_set>
 
 #include "mvs/consistency_graph.h"
+#ifdef CUDA_ENABLED
 #include "mvs/patch_match_cuda.h"
+#include "util/cuda.h"
+#else
+#include "mvs/patch_match_cpu.h"
+#endif
 #include "mvs/workspace.h"
 #include "util/math.h"
 #include "util/misc.h"
@@ -54,6 +59,7 @@ void PatchMatchOptions::Print() const {
   PrintHeading2("PatchMatchOptions");
   PrintOption(max_image_size);
   PrintOption(gpu_index);
+  PrintOption(num_threads);
   PrintOption(depth_min);
   PrintOption(depth_max);
   PrintOption(window_radius);
@@ -74,6 +80,7 @@ void PatchMatchOptions::Print() const {
   PrintOption(filter_min_num_consistent);
   PrintOption(filter_geom_consistency_max_cost);
   PrintOption(write_consistency_graph);
+  PrintOption(write_float16_maps);
 }
 
 void PatchMatch::Problem::Print() const {
@@ -158,26 +165,48 @@ void PatchMatch::Run() {
 
   Check();
 
+#ifdef CUDA_ENABLED
   patch_match_cuda_.reset(new PatchMatchCuda(options_, problem_));
   patch_match_cuda_->Run();
+#else
+  patch_match_cpu_.reset(new PatchMatchCpu(options_, problem_));
+  patch_match_cpu_->Run();
+#endif
 }
 
 DepthMap PatchMatch::GetDepthMap() const {
+#ifdef CUDA_ENABLED
   return patch_match_cuda_->GetDepthMap();
+#else
+  return patch_match_cpu_->GetDepthMap();
+#endif
 }
 
 NormalMap PatchMatch::GetNormalMap() const {
+#ifdef CUDA_ENABLED
   return patch_match_cuda_->GetNormalMap();
+#else
+  return patch_match_cpu_->GetNormalMap();
+#endif
 }
 
 Mat<float> PatchMatch::GetSelProbMap() const {
+#ifdef CUDA_ENABLED
   return patch_match_cuda_->GetSelProbMap();
+#else
+  return patch_match_cpu_->GetSelProbMap();
+#endif
 }
 
 ConsistencyGraph PatchMatch::GetConsistencyGraph() const {
   const auto& ref_image = problem_.images->at(problem_.ref_image_idx);
+#ifdef CUDA_ENABLED
   return ConsistencyGraph(ref_image.GetWidth(), ref_image.GetHeight(),
                           patch_match_cuda_->GetConsistentImageIdxs());
+#else
+  return ConsistencyGraph(ref_image.GetWidth(), ref_image.GetHeight(),
+                          patch_match_cpu_->GetConsistentImageIdxs());
+#endif
 }
 
 PatchMatchController::PatchMatchController(const PatchMatchOptions& options,
@@ -393,6 +422,7 @@ void PatchMatchController::ReadProblems() {
 }
 
 void PatchMatchController::ReadGpuIndices() {
+#ifdef CUDA_ENABLED
   gpu_indices_ = CSVToVector<int>(options_.gpu_index);
   if (gpu_indices_.size() == 1 && gpu_indices_[0] == -1) {
     const int num_cuda_devices = GetNumCudaDevices();
@@ -400,6 +430,10 @@ void PatchMatchController::ReadGpuIndices() {
     gpu_indices_.resize(num_cuda_devices);
     std::iota(gpu_indices_.begin(), gpu_indices_.end(), 0);
   }
+#else
+  // The CPU implementation already uses all threads for a single problem.
+  gpu_indices_ = {-1};
+#endif
 }
 
 void PatchMatchController::ProcessProblem(const PatchMatchOptions& options,
@@ -502,8 +536,10 @@ void PatchMatchController::ProcessProblem(const PatchMatchOptions& options,
                             image_name.c_str())
             << std::endl;
 
-  patch_match.GetDepthMap().Write(depth_map_path);
-  patch_match.GetNormalMap().Write(normal_map_path);
+  patch_match.GetDepthMap().Write(depth_map_path,
+                                  options.write_float16_maps);
+  patch_match.GetNormalMap().Write(normal_map_path,
+                                   options.write_float16_maps);
   if (options.write_consistency_graph) {
     patch_match.GetConsistencyGraph().Write(consistency_graph_path);
   }
@@ -53,6 +53,7 @@ namespace mvs {
 const static size_t kMaxPatchMatchWindowRadius = 32;
 
 class ConsistencyGraph;
+class PatchMatchCpu;
 class PatchMatchCuda;
 class Workspace;
 
@@ -64,6 +65,10 @@ struct PatchMatchOptions {
   // you should separate multiple GPU indices by comma, e.g., "0,1,2,3".
   std::string gpu_index = "-1";
 
+  // The number of threads used by the CPU implementation, which is used if
+  // COLMAP is built without CUDA.
+  int num_threads = -1;
+
   // Depth range in which to randomly sample depth hypotheses.
   double depth_min = -1.0f;
   double depth_max = -1.0f;
@@ -137,6 +142,11 @@ struct PatchMatchOptions {
   // Whether to write the consistency graph.
   bool write_consistency_graph = false;
 
+  // Whether to store the depth and normal maps as 16-bit floating point
+  // numbers, which halves their size on disk at a relative precision of about
+  // 1e-3. Such maps can only be memory-mapped by decoding them into memory.
+  bool write_float16_maps = false;
+
   void Print() const;
   bool Check() const {
     if (depth_min != -1.0f || depth_max != -1.0f) {
@@ -170,7 +180,8 @@ struct PatchMatchOptions {
 
 // This is a wrapper class around the actual PatchMatchCuda implementation. This
 // class is necessary to hide Cuda code from any boost or Eigen code, since
-// NVCC/MSVC cannot compile complex C++ code.
+// NVCC/MSVC cannot compile complex C++ code. Without CUDA, the computations are
+// performed by the equivalent PatchMatchCpu implementation.
 class PatchMatch {
  public:
   struct Problem {
@@ -211,7 +222,11 @@ class PatchMatch {
  private:
   const PatchMatchOptions options_;
   const Problem problem_;
+#ifdef CUDA_ENABLED
   std::unique_ptr<PatchMatchCuda> patch_match_cuda_;
+#else
+  std::unique_ptr<PatchMatchCpu> patch_match_cpu_;
+#endif
 };
 
 // This thread processes all problems in a workspace. A workspace has the
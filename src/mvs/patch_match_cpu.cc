@@ -0,0 +1,1529 @@
+// Copyright (c) 2018, ETH Zurich and UNC Chapel Hill.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//
+//     * Neither the name of ETH Zurich and UNC Chapel Hill nor the names of
+//       its contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Author: Johannes L. Schoenberger (jsch-at-demuc-dot-de)
+
+#define _USE_MATH_DEFINES
+
+#include "mvs/patch_match_cpu.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <random>
+
+#include "util/logging.h"
+#include "util/math.h"
+#include "util/misc.h"
+#include "util/random.h"
+#include "util/timer.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define COLMAP_PATCH_MATCH_AVX2_KERNEL
+#include <immintrin.h>
+#endif
+
+namespace colmap {
+namespace mvs {
+namespace {
+
+// Number of parameters per source image in the poses as
+// [K(4), R(9), T(3), C(3), P(12), P^-1(12)].
+const size_t kNumTformParams = 4 + 9 + 3 + 3 + 12 + 12;
+const size_t kPoseKOffset = 0;
+const size_t kPoseROffset = 4;
+const size_t kPoseTOffset = 13;
+const size_t kPoseCOffset = 16;
+const size_t kPosePOffset = 19;
+const size_t kPoseInvPOffset = 31;
+
+// Number of columns swept by one task. Small enough to balance the load across
+// threads and large enough to amortize the per-task overhead.
+const int kTileWidth = 32;
+
+// The window samples are padded with zero weight samples to a multiple of the
+// number of samples processed at once by the vectorized kernels.
+const int kNumSamplesPerPacket = 8;
+
+inline void Mat33DotVec3(const float mat[9], const float vec[3],
+                         float result[3]) {
+  result[0] = mat[0] * vec[0] + mat[1] * vec[1] + mat[2] * vec[2];
+  result[1] = mat[3] * vec[0] + mat[4] * vec[1] + mat[5] * vec[2];
+  result[2] = mat[6] * vec[0] + mat[7] * vec[1] + mat[8] * vec[2];
+}
+
+inline void Mat33DotVec3Homogeneous(const float mat[9], const float vec[2],
+                                    float result[2]) {
+  const float inv_z = 1.0f / (mat[6] * vec[0] + mat[7] * vec[1] + mat[8]);
+  result[0] = inv_z * (mat[0] * vec[0] + mat[1] * vec[1] + mat[2]);
+  result[1] = inv_z * (mat[3] * vec[0] + mat[4] * vec[1] + mat[5]);
+}
+
+inline float DotProduct3(const float vec1[3], const float vec2[3]) {
+  return vec1[0] * vec2[0] + vec1[1] * vec2[1] + vec1[2] * vec2[2];
+}
+
+// Uniformly distributed random number in the range [0, 1).
+inline float RandomUniform(std::mt19937* prng) {
+  return std::uniform_real_distribution<float>(0.0f, 1.0f)(*prng);
+}
+
+inline float GenerateRandomDepth(const float depth_min, const float depth_max,
+                                 std::mt19937* prng) {
+  return RandomUniform(prng) * (depth_max - depth_min) + depth_min;
+}
+
+inline void GenerateRandomNormal(const float ref_inv_K[4], const int row,
+                                 const int col, std::mt19937* prng,
+                                 float normal[3]) {
+  // Unbiased sampling of normal, according to George Marsaglia, "Choosing a
+  // Point from the Surface of a Sphere", 1972.
+  float v1 = 0.0f;
+  float v2 = 0.0f;
+  float s = 2.0f;
+  while (s >= 1.0f) {
+    v1 = 2.0f * RandomUniform(prng) - 1.0f;
+    v2 = 2.0f * RandomUniform(prng) - 1.0f;
+    s = v1 * v1 + v2 * v2;
+  }
+
+  const float s_norm = std::sqrt(1.0f - s);
+  normal[0] = 2.0f * v1 * s_norm;
+  normal[1] = 2.0f * v2 * s_norm;
+  normal[2] = 1.0f - 2.0f * s;
+
+  // Make sure normal is looking away from camera.
+  const float view_ray[3] = {ref_inv_K[0] * col + ref_inv_K[1],
+                             ref_inv_K[2] * row + ref_inv_K[3], 1.0f};
+  if (DotProduct3(normal, view_ray) > 0) {
+    normal[0] = -normal[0];
+    normal[1] = -normal[1];
+    normal[2] = -normal[2];
+  }
+}
+
+inline float PerturbDepth(const float perturbation, const float depth,
+                          std::mt19937* prng) {
+  const float depth_min = (1.0f - perturbation) * depth;
+  const float depth_max = (1.0f + perturbation) * depth;
+  return GenerateRandomDepth(depth_min, depth_max, prng);
+}
+
+void PerturbNormal(const float ref_inv_K[4], const int row, const int col,
+                   const float perturbation, const float normal[3],
+                   std::mt19937* prng, float perturbed_normal[3],
+                   const int num_trials = 0) {
+  // Perturbation rotation angles.
+  const float a1 = (RandomUniform(prng) - 0.5f) * perturbation;
+  const float a2 = (RandomUniform(prng) - 0.5f) * perturbation;
+  const float a3 = (RandomUniform(prng) - 0.5f) * perturbation;
+
+  const float sin_a1 = std::sin(a1);
+  const float sin_a2 = std::sin(a2);
+  const float sin_a3 = std::sin(a3);
+  const float cos_a1 = std::cos(a1);
+  const float cos_a2 = std::cos(a2);
+  const float cos_a3 = std::cos(a3);
+
+  // R = Rx * Ry * Rz
+  float R[9];
+  R[0] = cos_a2 * cos_a3;
+  R[1] = -cos_a2 * sin_a3;
+  R[2] = sin_a2;
+  R[3] = cos_a1 * sin_a3 + cos_a3 * sin_a1 * sin_a2;
+  R[4] = cos_a1 * cos_a3 - sin_a1 * sin_a2 * sin_a3;
+  R[5] = -cos_a2 * sin_a1;
+  R[6] = sin_a1 * sin_a3 - cos_a1 * cos_a3 * sin_a2;
+  R[7] = cos_a3 * sin_a1 + cos_a1 * sin_a2 * sin_a3;
+  R[8] = cos_a1 * cos_a2;
+
+  // Perturb the normal vector.
+  Mat33DotVec3(R, normal, perturbed_normal);
+
+  // Make sure the perturbed normal is still looking in the same direction as
+  // the viewing direction, otherwise try again but with smaller perturbation.
+  const float view_ray[3] = {ref_inv_K[0] * col + ref_inv_K[1],
+                             ref_inv_K[2] * row + ref_inv_K[3], 1.0f};
+  if (DotProduct3(perturbed_normal, view_ray) >= 0.0f) {
+    const int kMaxNumTrials = 3;
+    if (num_trials < kMaxNumTrials) {
+      PerturbNormal(ref_inv_K, row, col, 0.5f * perturbation, normal, prng,
+                    perturbed_normal, num_trials + 1);
+      return;
+    } else {
+      perturbed_normal[0] = normal[0];
+      perturbed_normal[1] = normal[1];
+      perturbed_normal[2] = normal[2];
+      return;
+    }
+  }
+
+  // Make sure normal has unit norm.
+  const float inv_norm =
+      1.0f / std::sqrt(DotProduct3(perturbed_normal, perturbed_normal));
+  perturbed_normal[0] *= inv_norm;
+  perturbed_normal[1] *= inv_norm;
+  perturbed_normal[2] *= inv_norm;
+}
+
+inline void ComputePointAtDepth(const float ref_inv_K[4], const float row,
+                                const float col, const float depth,
+                                float point[3]) {
+  point[0] = depth * (ref_inv_K[0] * col + ref_inv_K[1]);
+  point[1] = depth * (ref_inv_K[2] * row + ref_inv_K[3]);
+  point[2] = depth;
+}
+
+// Transfer depth on plane from viewing ray at row1 to row2. The returned
+// depth is the intersection of the viewing ray through row2 with the plane
+// at row1 defined by the given depth and normal.
+inline float PropagateDepth(const float ref_inv_K[4], const float depth1,
+                            const float normal1[3], const float row1,
+                            const float row2) {
+  // Point along first viewing ray.
+  const float x1 = depth1 * (ref_inv_K[2] * row1 + ref_inv_K[3]);
+  const float y1 = depth1;
+  // Point on plane defined by point along first viewing ray and plane normal1.
+  const float x2 = x1 + normal1[2];
+  const float y2 = y1 - normal1[1];
+
+  // Point on second viewing ray through the origin.
+  const float x4 = ref_inv_K[2] * row2 + ref_inv_K[3];
+
+  // Intersection of the lines ((x1, y1), (x2, y2)) and ((0, 0), (x4, 1)).
+  const float denom = x2 - x1 + x4 * (y1 - y2);
+  const float kEps = 1e-5f;
+  if (std::abs(denom) < kEps) {
+    return depth1;
+  }
+  const float nom = y1 * x2 - x1 * y2;
+  return nom / denom;
+}
+
+// First, compute triangulation angle between reference and source image for 3D
+// point. Second, compute incident angle between viewing direction of source
+// image and normal direction of 3D point. Both angles are cosine distances.
+inline void ComputeViewingAngles(const float* pose, const float point[3],
+                                 const float normal[3],
+                                 float* cos_triangulation_angle,
+                                 float* cos_incident_angle) {
+  // Projection center of source image.
+  const float* C = pose + kPoseCOffset;
+
+  // Ray from point to camera.
+  const float SX[3] = {C[0] - point[0], C[1] - point[1], C[2] - point[2]};
+
+  // Length of ray from reference image to point.
+  const float RX_inv_norm = 1.0f / std::sqrt(DotProduct3(point, point));
+
+  // Length of ray from source image to point.
+  const float SX_inv_norm = 1.0f / std::sqrt(DotProduct3(SX, SX));
+
+  *cos_incident_angle = DotProduct3(SX, normal) * SX_inv_norm;
+  *cos_triangulation_angle = DotProduct3(SX, point) * RX_inv_norm * SX_inv_norm;
+}
+
+inline void ComposeHomography(const float ref_inv_K[4], const float* pose,
+                              const int row, const int col, const float depth,
+                              const float normal[3], float H[9]) {
+  const float* K = pose + kPoseKOffset;
+  const float* R = pose + kPoseROffset;
+  const float* T = pose + kPoseTOffset;
+
+  // Distance to the plane.
+  const float dist =
+      depth * (normal[0] * (ref_inv_K[0] * col + ref_inv_K[1]) +
+               normal[1] * (ref_inv_K[2] * row + ref_inv_K[3]) + normal[2]);
+  const float inv_dist = 1.0f / dist;
+
+  const float inv_dist_N0 = inv_dist * normal[0];
+  const float inv_dist_N1 = inv_dist * normal[1];
+  const float inv_dist_N2 = inv_dist * normal[2];
+
+  // Homography as H = K * (R - T * n' / d) * Kref^-1.
+  H[0] = ref_inv_K[0] * (K[0] * (R[0] + inv_dist_N0 * T[0]) +
+                         K[1] * (R[6] + inv_dist_N0 * T[2]));
+  H[1] = ref_inv_K[2] * (K[0] * (R[1] + inv_dist_N1 * T[0]) +
+                         K[1] * (R[7] + inv_dist_N1 * T[2]));
+  H[2] = K[0] * (R[2] + inv_dist_N2 * T[0]) +
+         K[1] * (R[8] + inv_dist_N2 * T[2]) +
+         ref_inv_K[1] * (K[0] * (R[0] + inv_dist_N0 * T[0]) +
+                         K[1] * (R[6] + inv_dist_N0 * T[2])) +
+         ref_inv_K[3] * (K[0] * (R[1] + inv_dist_N1 * T[0]) +
+                         K[1] * (R[7] + inv_dist_N1 * T[2]));
+  H[3] = ref_inv_K[0] * (K[2] * (R[3] + inv_dist_N0 * T[1]) +
+                         K[3] * (R[6] + inv_dist_N0 * T[2]));
+  H[4] = ref_inv_K[2] * (K[2] * (R[4] + inv_dist_N1 * T[1]) +
+                         K[3] * (R[7] + inv_dist_N1 * T[2]));
+  H[5] = K[2] * (R[5] + inv_dist_N2 * T[1]) +
+         K[3] * (R[8] + inv_dist_N2 * T[2]) +
+         ref_inv_K[1] * (K[2] * (R[3] + inv_dist_N0 * T[1]) +
+                         K[3] * (R[6] + inv_dist_N0 * T[2])) +
+         ref_inv_K[3] * (K[2] * (R[4] + inv_dist_N1 * T[1]) +
+                         K[3] * (R[7] + inv_dist_N1 * T[2]));
+  H[6] = ref_inv_K[0] * (R[6] + inv_dist_N0 * T[2]);
+  H[7] = ref_inv_K[2] * (R[7] + inv_dist_N1 * T[2]);
+  H[8] = R[8] + ref_inv_K[1] * (R[6] + inv_dist_N0 * T[2]) +
+         ref_inv_K[3] * (R[7] + inv_dist_N1 * T[2]) + inv_dist_N2 * T[2];
+}
+
+// Find index of minimum in given values.
+template <int kNumCosts>
+inline int FindMinCost(const float costs[kNumCosts]) {
+  float min_cost = costs[0];
+  int min_cost_idx = 0;
+  for (int idx = 1; idx < kNumCosts; ++idx) {
+    if (costs[idx] <= min_cost) {
+      min_cost = costs[idx];
+      min_cost_idx = idx;
+    }
+  }
+  return min_cost_idx;
+}
+
+inline void TransformPDFToCDF(float* probs, const int num_probs) {
+  float prob_sum = 0.0f;
+  for (int i = 0; i < num_probs; ++i) {
+    prob_sum += probs[i];
+  }
+  const float inv_prob_sum = 1.0f / prob_sum;
+
+  float cum_prob = 0.0f;
+  for (int i = 0; i < num_probs; ++i) {
+    const float prob = probs[i] * inv_prob_sum;
+    cum_prob += prob;
+    probs[i] = cum_prob;
+  }
+}
+
+class LikelihoodComputer {
+ public:
+  LikelihoodComputer(const float ncc_sigma,
+                     const float min_triangulation_angle,
+                     const float incident_angle_sigma)
+      : cos_min_triangulation_angle_(std::cos(min_triangulation_angle)),
+        inv_incident_angle_sigma_square_(
+            -0.5f / (incident_angle_sigma * incident_angle_sigma)),
+        inv_ncc_sigma_square_(-0.5f / (ncc_sigma * ncc_sigma)),
+        ncc_norm_factor_(ComputeNCCCostNormFactor(ncc_sigma)) {}
+
+  // Compute forward message from current cost and forward message of
+  // previous / neighboring pixel.
+  float ComputeForwardMessage(const float cost, const float prev) const {
+    return ComputeMessage<true>(cost, prev);
+  }
+
+  // Compute backward message from current cost and backward message of
+  // previous / neighboring pixel.
+  float ComputeBackwardMessage(const float cost, const float prev) const {
+    return ComputeMessage<false>(cost, prev);
+  }
+
+  // Compute the selection probability from the forward and backward message.
+  inline float ComputeSelProb(const float alpha, const float beta,
+                              const float prev, const float prev_weight) const {
+    const float zn0 = (1.0f - alpha) * (1.0f - beta);
+    const float zn1 = alpha * beta;
+    const float curr = zn1 / (zn0 + zn1);
+    return prev_weight * prev + (1.0f - prev_weight) * curr;
+  }
+
+  // Compute NCC probability. Note that cost = 1 - NCC.
+  inline float ComputeNCCProb(const float cost) const {
+    return std::exp(cost * cost * inv_ncc_sigma_square_) * ncc_norm_factor_;
+  }
+
+  // Compute the triangulation angle probability.
+  inline float ComputeTriProb(const float cos_triangulation_angle) const {
+    const float abs_cos_triangulation_angle =
+        std::abs(cos_triangulation_angle);
+    if (abs_cos_triangulation_angle > cos_min_triangulation_angle_) {
+      const float scaled = 1.0f - (1.0f - abs_cos_triangulation_angle) /
+                                      (1.0f - cos_min_triangulation_angle_);
+      const float likelihood = 1.0f - scaled * scaled;
+      return std::min(1.0f, std::max(0.0f, likelihood));
+    } else {
+      return 1.0f;
+    }
+  }
+
+  // Compute the incident angle probability.
+  inline float ComputeIncProb(const float cos_incident_angle) const {
+    const float x = 1.0f - std::max(0.0f, cos_incident_angle);
+    return std::exp(x * x * inv_incident_angle_sigma_square_);
+  }
+
+  // Compute the warping/resolution prior probability.
+  inline float ComputeResolutionProb(const int window_radius, const float H[9],
+                                     const float row, const float col) const {
+    // Warp corners of patch in reference image to source image.
+    float src1[2];
+    const float ref1[2] = {col - window_radius, row - window_radius};
+    Mat33DotVec3Homogeneous(H, ref1, src1);
+    float src2[2];
+    const float ref2[2] = {col - window_radius, row + window_radius};
+    Mat33DotVec3Homogeneous(H, ref2, src2);
+    float src3[2];
+    const float ref3[2] = {col + window_radius, row + window_radius};
+    Mat33DotVec3Homogeneous(H, ref3, src3);
+    float src4[2];
+    const float ref4[2] = {col + window_radius, row - window_radius};
+    Mat33DotVec3Homogeneous(H, ref4, src4);
+
+    // Compute area of patches in reference and source image.
+    const float window_size = 2 * window_radius + 1;
+    const float ref_area = window_size * window_size;
+    const float src_area = std::abs(
+        0.5f * (src1[0] * src2[1] - src2[0] * src1[1] - src1[0] * src4[1] +
+                src2[0] * src3[1] - src3[0] * src2[1] + src4[0] * src1[1] +
+                src3[0] * src4[1] - src4[0] * src3[1]));
+
+    if (ref_area > src_area) {
+      return src_area / ref_area;
+    } else {
+      return ref_area / src_area;
+    }
+  }
+
+ private:
+  // The normalization for the likelihood function, i.e. the normalization for
+  // the prior on the matching cost.
+  static inline float ComputeNCCCostNormFactor(const float ncc_sigma) {
+    // A = sqrt(2pi)*sigma/2*erf(sqrt(2)/sigma)
+    // erf(x) = 2/sqrt(pi) * integral from 0 to x of exp(-t^2) dt
+    return 2.0f / (std::sqrt(2.0f * static_cast<float>(M_PI)) * ncc_sigma *
+                   std::erf(2.0f / (ncc_sigma * 1.414213562f)));
+  }
+
+  // Compute the forward or backward message.
+  template <bool kForward>
+  inline float ComputeMessage(const float cost, const float prev) const {
+    const float kUniformProb = 0.5f;
+    const float kNoChangeProb = 0.99999f;
+    const float kChangeProb = 1.0f - kNoChangeProb;
+    const float emission = ComputeNCCProb(cost);
+
+    float zn0;  // Message for selection probability = 0.
+    float zn1;  // Message for selection probability = 1.
+    if (kForward) {
+      zn0 = (prev * kChangeProb + (1.0f - prev) * kNoChangeProb) * kUniformProb;
+      zn1 = (prev * kNoChangeProb + (1.0f - prev) * kChangeProb) * emission;
+    } else {
+      zn0 = prev * emission * kChangeProb +
+            (1.0f - prev) * kUniformProb * kNoChangeProb;
+      zn1 = prev * emission * kNoChangeProb +
+            (1.0f - prev) * kUniformProb * kChangeProb;
+    }
+
+    return zn1 / (zn0 + zn1);
+  }
+
+  float cos_min_triangulation_angle_;
+  float inv_incident_angle_sigma_square_;
+  float inv_ncc_sigma_square_;
+  float ncc_norm_factor_;
+};
+
+// Rotate the matrix by 90 degrees in counter-clockwise direction.
+template <typename T>
+Mat<T> RotateMat(const Mat<T>& input) {
+  const size_t width = input.GetWidth();
+  const size_t height = input.GetHeight();
+  const size_t slice_size = width * height;
+  Mat<T> output(height, width, input.GetDepth());
+  for (size_t slice = 0; slice < input.GetDepth(); ++slice) {
+    const T* input_data = input.GetPtr() + slice * slice_size;
+    T* output_data = output.GetPtr() + slice * slice_size;
+    for (size_t row = 0; row < height; ++row) {
+      for (size_t col = 0; col < width; ++col) {
+        output_data[(width - 1 - col) * height + row] =
+            input_data[row * width + col];
+      }
+    }
+  }
+  return output;
+}
+
+// Computes the bilaterally weighted sums of the source colors, the squared
+// source colors, and the products of the source and reference colors over the
+// window. The window samples are warped to the source image by the homography
+// H, whose last column is evaluated at the window center, so that it only needs
+// to be applied to the window offsets. As for the border address mode of the
+// Cuda textures, interpolated pixels outside the source image are black.
+typedef void (*WeightedSumsFunc)(const float* offsets, const float* window,
+                                 const int num_samples, const float H[9],
+                                 const uint8_t* image, const int width,
+                                 const int height, float sums[3]);
+
+void ComputeWeightedSumsScalar(const float* offsets, const float* window,
+                               const int num_samples, const float H[9],
+                               const uint8_t* image, const int width,
+                               const int height, float sums[3]) {
+  const float* col_offsets = offsets;
+  const float* row_offsets = offsets + num_samples;
+  const float* weights = window;
+  const float* ref_colors = window + num_samples;
+  const int stride = width + 2;
+  const float max_col = width - 1;
+  const float max_row = height - 1;
+
+  float src_color_sum = 0.0f;
+  float src_color_squared_sum = 0.0f;
+  float src_ref_color_sum = 0.0f;
+  for (int i = 0; i < num_samples; ++i) {
+    const float x = H[0] * col_offsets[i] + H[1] * row_offsets[i] + H[2];
+    const float y = H[3] * col_offsets[i] + H[4] * row_offsets[i] + H[5];
+    const float z = H[6] * col_offsets[i] + H[7] * row_offsets[i] + H[8];
+    const float inv_z = 1.0f / z;
+    const float col = inv_z * x;
+    const float row = inv_z * y;
+    const float col0 = std::floor(col);
+    const float row0 = std::floor(row);
+    // All four interpolated pixels are outside the image (or the coordinates
+    // are not finite), if the top-left pixel is not in the padded image.
+    if (!(col0 >= -1.0f && col0 <= max_col && row0 >= -1.0f &&
+          row0 <= max_row)) {
+      continue;
+    }
+
+    const uint8_t* top = image + (static_cast<int>(row0) + 1) * stride +
+                         static_cast<int>(col0) + 1;
+    const uint8_t* bottom = top + stride;
+    const float col_weight = col - col0;
+    const float row_weight = row - row0;
+    const float top_color = top[0] + col_weight * (top[1] - top[0]);
+    const float bottom_color = bottom[0] + col_weight * (bottom[1] - bottom[0]);
+    const float src_color =
+        (1.0f / 255.0f) *
+        (top_color + row_weight * (bottom_color - top_color));
+
+    const float weighted_src_color = weights[i] * src_color;
+    src_color_sum += weighted_src_color;
+    src_color_squared_sum += weighted_src_color * src_color;
+    src_ref_color_sum += weighted_src_color * ref_colors[i];
+  }
+
+  sums[0] = src_color_sum;
+  sums[1] = src_color_squared_sum;
+  sums[2] = src_ref_color_sum;
+}
+
+#ifdef COLMAP_PATCH_MATCH_AVX2_KERNEL
+
+__attribute__((target("avx2"))) inline float HorizontalSumAVX2(
+    const __m256 values) {
+  const __m128 sum4 = _mm_add_ps(_mm256_castps256_ps128(values),
+                                 _mm256_extractf128_ps(values, 1));
+  const __m128 sum2 = _mm_add_ps(sum4, _mm_movehl_ps(sum4, sum4));
+  return _mm_cvtss_f32(_mm_add_ss(sum2, _mm_shuffle_ps(sum2, sum2, 1)));
+}
+
+// Processes eight window samples at once. The two pixels of the top and the
+// bottom row of the bilinear interpolation are fetched with a single 32-bit
+// gather each, which is why the padded images have three bytes of slack.
+__attribute__((target("avx2"))) void ComputeWeightedSumsAVX2(
+    const float* offsets, const float* window, const int num_samples,
+    const float H[9], const uint8_t* image, const int width, const int height,
+    float sums[3]) {
+  const float* col_offsets = offsets;
+  const float* row_offsets = offsets + num_samples;
+  const float* weights = window;
+  const float* ref_colors = window + num_samples;
+  const int stride = width + 2;
+
+  __m256 H_ps[9];
+  for (int i = 0; i < 9; ++i) {
+    H_ps[i] = _mm256_set1_ps(H[i]);
+  }
+
+  const __m256 one = _mm256_set1_ps(1.0f);
+  const __m256 min_coord = _mm256_set1_ps(-1.0f);
+  const __m256 max_col = _mm256_set1_ps(width - 1);
+  const __m256 max_row = _mm256_set1_ps(height - 1);
+  const __m256 inv_max_color = _mm256_set1_ps(1.0f / 255.0f);
+  const __m256i stride_epi32 = _mm256_set1_epi32(stride);
+  const __m256i byte_mask = _mm256_set1_epi32(0xFF);
+  const int* top_base = reinterpret_cast<const int*>(image);
+  const int* bottom_base = reinterpret_cast<const int*>(image + stride);
+
+  __m256 src_color_sum = _mm256_setzero_ps();
+  __m256 src_color_squared_sum = _mm256_setzero_ps();
+  __m256 src_ref_color_sum = _mm256_setzero_ps();
+  for (int i = 0; i < num_samples; i += kNumSamplesPerPacket) {
+    const __m256 col_offset = _mm256_loadu_ps(col_offsets + i);
+    const __m256 row_offset = _mm256_loadu_ps(row_offsets + i);
+    const __m256 x = _mm256_add_ps(
+        _mm256_add_ps(_mm256_mul_ps(H_ps[0], col_offset),
+                      _mm256_mul_ps(H_ps[1], row_offset)),
+        H_ps[2]);
+    const __m256 y = _mm256_add_ps(
+        _mm256_add_ps(_mm256_mul_ps(H_ps[3], col_offset),
+                      _mm256_mul_ps(H_ps[4], row_offset)),
+        H_ps[5]);
+    const __m256 z = _mm256_add_ps(
+        _mm256_add_ps(_mm256_mul_ps(H_ps[6], col_offset),
+                      _mm256_mul_ps(H_ps[7], row_offset)),
+        H_ps[8]);
+    const __m256 inv_z = _mm256_div_ps(one, z);
+    const __m256 col = _mm256_mul_ps(inv_z, x);
+    const __m256 row = _mm256_mul_ps(inv_z, y);
+    __m256 col0 = _mm256_floor_ps(col);
+    __m256 row0 = _mm256_floor_ps(row);
+
+    // Ordered comparisons are false for non-finite coordinates.
+    const __m256 inside = _mm256_and_ps(
+        _mm256_and_ps(_mm256_cmp_ps(col0, min_coord, _CMP_GE_OQ),
+                      _mm256_cmp_ps(col0, max_col, _CMP_LE_OQ)),
+        _mm256_and_ps(_mm256_cmp_ps(row0, min_coord, _CMP_GE_OQ),
+                      _mm256_cmp_ps(row0, max_row, _CMP_LE_OQ)));
+
+    // Redirect samples outside the image to the padded top-left corner and
+    // zero their interpolated colors below.
+    col0 = _mm256_blendv_ps(min_coord, col0, inside);
+    row0 = _mm256_blendv_ps(min_coord, row0, inside);
+    const __m256i idxs = _mm256_add_epi32(
+        _mm256_mullo_epi32(_mm256_cvttps_epi32(_mm256_add_ps(row0, one)),
+                           stride_epi32),
+        _mm256_cvttps_epi32(_mm256_add_ps(col0, one)));
+
+    const __m256i top = _mm256_i32gather_epi32(top_base, idxs, 1);
+    const __m256i bottom = _mm256_i32gather_epi32(bottom_base, idxs, 1);
+    const __m256 top_left =
+        _mm256_cvtepi32_ps(_mm256_and_si256(top, byte_mask));
+    const __m256 top_right = _mm256_cvtepi32_ps(
+        _mm256_and_si256(_mm256_srli_epi32(top, 8), byte_mask));
+    const __m256 bottom_left =
+        _mm256_cvtepi32_ps(_mm256_and_si256(bottom, byte_mask));
+    const __m256 bottom_right = _mm256_cvtepi32_ps(
+        _mm256_and_si256(_mm256_srli_epi32(bottom, 8), byte_mask));
+
+    const __m256 col_weight = _mm256_sub_ps(col, col0);
+    const __m256 row_weight = _mm256_sub_ps(row, row0);
+    const __m256 top_color = _mm256_add_ps(
+        top_left,
+        _mm256_mul_ps(col_weight, _mm256_sub_ps(top_right, top_left)));
+    const __m256 bottom_color = _mm256_add_ps(
+        bottom_left,
+        _mm256_mul_ps(col_weight, _mm256_sub_ps(bottom_right, bottom_left)));
+    const __m256 color = _mm256_add_ps(
+        top_color,
+        _mm256_mul_ps(row_weight, _mm256_sub_ps(bottom_color, top_color)));
+    const __m256 src_color =
+        _mm256_and_ps(_mm256_mul_ps(inv_max_color, color), inside);
+
+    const __m256 weighted_src_color =
+        _mm256_mul_ps(_mm256_loadu_ps(weights + i), src_color);
+    src_color_sum = _mm256_add_ps(src_color_sum, weighted_src_color);
+    src_color_squared_sum = _mm256_add_ps(
+        src_color_squared_sum, _mm256_mul_ps(weighted_src_color, src_color));
+    src_ref_color_sum = _mm256_add_ps(
+        src_ref_color_sum,
+        _mm256_mul_ps(weighted_src_color, _mm256_loadu_ps(ref_colors + i)));
+  }
+
+  sums[0] = HorizontalSumAVX2(src_color_sum);
+  sums[1] = HorizontalSumAVX2(src_color_squared_sum);
+  sums[2] = HorizontalSumAVX2(src_ref_color_sum);
+}
+
+#endif  // COLMAP_PATCH_MATCH_AVX2_KERNEL
+
+WeightedSumsFunc GetWeightedSumsFunc() {
+#ifdef COLMAP_PATCH_MATCH_AVX2_KERNEL
+  if (__builtin_cpu_supports("avx2")) {
+    return &ComputeWeightedSumsAVX2;
+  }
+#endif
+  return &ComputeWeightedSumsScalar;
+}
+
+void PrintElapsedTime(const std::string& message, const Timer& timer) {
+  std::cout << StringPrintf("%s: %.4fs", message.c_str(),
+                            timer.ElapsedSeconds())
+            << std::endl;
+}
+
+}  // namespace
+
+PatchMatchCpu::PatchMatchCpu(const PatchMatchOptions& options,
+                             const PatchMatch::Problem& problem)
+    : options_(options),
+      problem_(problem),
+      ref_width_(0),
+      ref_height_(0),
+      rotation_in_half_pi_(0),
+      num_window_samples_(0) {
+  InitRefImage();
+  InitSourceImages();
+  InitTransforms();
+  InitWindow();
+  InitWorkspaceMemory();
+}
+
+void PatchMatchCpu::Run() {
+  Timer total_timer;
+  total_timer.Start();
+
+  ThreadPool thread_pool(GetEffectiveNumThreads(options_.num_threads));
+
+  Timer init_timer;
+  init_timer.Start();
+
+  ProcessTiles(&thread_pool, [this](const int col_begin, const int col_end) {
+    ComputeInitialCost(col_begin, col_end);
+  });
+
+  PrintElapsedTime("Initialization", init_timer);
+
+  const float total_num_steps = options_.num_iterations * 4;
+
+  SweepOptions sweep_options;
+  sweep_options.num_samples = options_.num_samples;
+  sweep_options.ncc_sigma = options_.ncc_sigma;
+  sweep_options.min_triangulation_angle =
+      DegToRad(options_.min_triangulation_angle);
+  sweep_options.incident_angle_sigma = options_.incident_angle_sigma;
+  sweep_options.geom_consistency_regularizer =
+      options_.geom_consistency_regularizer;
+  sweep_options.geom_consistency_max_cost = options_.geom_consistency_max_cost;
+  sweep_options.filter_min_ncc = options_.filter_min_ncc;
+  sweep_options.filter_min_triangulation_angle =
+      DegToRad(options_.filter_min_triangulation_angle);
+  sweep_options.filter_min_num_consistent = options_.filter_min_num_consistent;
+  sweep_options.filter_geom_consistency_max_cost =
+      options_.filter_geom_consistency_max_cost;
+  sweep_options.geom_consistency_term = options_.geom_consistency;
+
+  for (int iter = 0; iter < options_.num_iterations; ++iter) {
+    Timer iter_timer;
+    iter_timer.Start();
+
+    for (int sweep = 0; sweep < 4; ++sweep) {
+      Timer sweep_timer;
+      sweep_timer.Start();
+
+      // Expenentially reduce amount of perturbation during the optimization.
+      sweep_options.perturbation = 1.0f / std::pow(2.0f, iter + sweep / 4.0f);
+
+      // Linearly increase the influence of previous selection probabilities.
+      sweep_options.prev_sel_prob_weight =
+          static_cast<float>(iter * 4 + sweep) / total_num_steps;
+
+      const bool last_sweep = iter == options_.num_iterations - 1 && sweep == 3;
+
+      sweep_options.filter_photo_consistency = last_sweep && options_.filter;
+      sweep_options.filter_geom_consistency =
+          last_sweep && options_.filter && options_.geom_consistency;
+
+      if (last_sweep && options_.filter) {
+        consistency_mask_ =
+            Mat<uint8_t>(cost_map_.GetWidth(), cost_map_.GetHeight(),
+                         cost_map_.GetDepth());
+      }
+
+      // Seed the random number generator of each tile with the sweep and the
+      // first column of the tile, so that the result does not depend on the
+      // order in which the threads process the tiles.
+      const int seed = iter * 4 + sweep;
+      ProcessTiles(&thread_pool, [this, &sweep_options, seed](
+                                     const int col_begin, const int col_end) {
+        SweepFromTopToBottom(sweep_options, seed, col_begin, col_end);
+      });
+
+      Rotate();
+
+      // Rotate selected image map.
+      if (last_sweep && options_.filter) {
+        consistency_mask_ = RotateMat(consistency_mask_);
+      }
+
+      PrintElapsedTime(" Sweep " + std::to_string(sweep + 1), sweep_timer);
+    }
+
+    PrintElapsedTime("Iteration " + std::to_string(iter + 1), iter_timer);
+  }
+
+  PrintElapsedTime("Total", total_timer);
+}
+
+DepthMap PatchMatchCpu::GetDepthMap() const {
+  return DepthMap(depth_map_, options_.depth_min, options_.depth_max);
+}
+
+NormalMap PatchMatchCpu::GetNormalMap() const { return NormalMap(normal_map_); }
+
+Mat<float> PatchMatchCpu::GetSelProbMap() const { return prev_sel_prob_map_; }
+
+std::vector<int> PatchMatchCpu::GetConsistentImageIdxs() const {
+  const Mat<uint8_t>& mask = consistency_mask_;
+  std::vector<int> consistent_image_idxs;
+  std::vector<int> pixel_consistent_image_idxs;
+  pixel_consistent_image_idxs.reserve(mask.GetDepth());
+  for (size_t r = 0; r < mask.GetHeight(); ++r) {
+    for (size_t c = 0; c < mask.GetWidth(); ++c) {
+      pixel_consistent_image_idxs.clear();
+      for (size_t d = 0; d < mask.GetDepth(); ++d) {
+        if (mask.Get(r, c, d)) {
+          pixel_consistent_image_idxs.push_back(problem_.src_image_idxs[d]);
+        }
+      }
+      if (pixel_consistent_image_idxs.size() > 0) {
+        consistent_image_idxs.push_back(c);
+        consistent_image_idxs.push_back(r);
+        consistent_image_idxs.push_back(pixel_consistent_image_idxs.size());
+        consistent_image_idxs.insert(consistent_image_idxs.end(),
+                                     pixel_consistent_image_idxs.begin(),
+                                     pixel_consistent_image_idxs.end());
+      }
+    }
+  }
+  return consistent_image_idxs;
+}
+
+void PatchMatchCpu::InitRefImage() {
+  const Image& ref_image = problem_.images->at(problem_.ref_image_idx);
+
+  ref_width_ = ref_image.GetWidth();
+  ref_height_ = ref_image.GetHeight();
+
+  const std::vector<uint8_t> ref_image_array =
+      ref_image.GetBitmap().ConvertToRowMajorArray();
+  ref_image_ = Mat<float>(ref_width_, ref_height_, 1);
+  float* ref_image_data = ref_image_.GetPtr();
+  for (size_t i = 0; i < ref_image_array.size(); ++i) {
+    ref_image_data[i] = ref_image_array[i] / 255.0f;
+  }
+}
+
+void PatchMatchCpu::InitSourceImages() {
+  src_images_.resize(problem_.src_image_idxs.size());
+  for (size_t i = 0; i < problem_.src_image_idxs.size(); ++i) {
+    const Image& image = problem_.images->at(problem_.src_image_idxs[i]);
+    const Bitmap& bitmap = image.GetBitmap();
+    SourceImage& src_image = src_images_[i];
+    src_image.width = image.GetWidth();
+    src_image.height = image.GetHeight();
+    // One pixel border on each side plus slack for the 32-bit gathers.
+    const size_t stride = src_image.width + 2;
+    src_image.data.resize(stride * (src_image.height + 2) + 4, 0);
+    for (int r = 0; r < src_image.height; ++r) {
+      memcpy(src_image.data.data() + (r + 1) * stride + 1,
+             bitmap.GetScanline(r), src_image.width * sizeof(uint8_t));
+    }
+  }
+
+  if (options_.geom_consistency) {
+    src_depth_maps_.resize(problem_.src_image_idxs.size());
+    for (size_t i = 0; i < problem_.src_image_idxs.size(); ++i) {
+      src_depth_maps_[i] = &problem_.depth_maps->at(problem_.src_image_idxs[i]);
+    }
+  }
+}
+
+void PatchMatchCpu::InitTransforms() {
+  const Image& ref_image = problem_.images->at(problem_.ref_image_idx);
+
+  //////////////////////////////////////////////////////////////////////////////
+  // Generate rotated versions (counter-clockwise) of calibration matrix.
+  //////////////////////////////////////////////////////////////////////////////
+
+  for (size_t i = 0; i < 4; ++i) {
+    ref_K_[i][0] = ref_image.GetK()[0];
+    ref_K_[i][1] = ref_image.GetK()[2];
+    ref_K_[i][2] = ref_image.GetK()[4];
+    ref_K_[i][3] = ref_image.GetK()[5];
+  }
+
+  // Rotated by 90 degrees.
+  std::swap(ref_K_[1][0], ref_K_[1][2]);
+  std::swap(ref_K_[1][1], ref_K_[1][3]);
+  ref_K_[1][3] = ref_width_ - 1 - ref_K_[1][3];
+
+  // Rotated by 180 degrees.
+  ref_K_[2][1] = ref_width_ - 1 - ref_K_[2][1];
+  ref_K_[2][3] = ref_height_ - 1 - ref_K_[2][3];
+
+  // Rotated by 270 degrees.
+  std::swap(ref_K_[3][0], ref_K_[3][2]);
+  std::swap(ref_K_[3][1], ref_K_[3][3]);
+  ref_K_[3][1] = ref_height_ - 1 - ref_K_[3][1];
+
+  // Extract 1/fx, -cx/fx, fy, -cy/fy.
+  for (size_t i = 0; i < 4; ++i) {
+    ref_inv_K_[i][0] = 1.0f / ref_K_[i][0];
+    ref_inv_K_[i][1] = -ref_K_[i][1] / ref_K_[i][0];
+    ref_inv_K_[i][2] = 1.0f / ref_K_[i][2];
+    ref_inv_K_[i][3] = -ref_K_[i][3] / ref_K_[i][2];
+  }
+
+  //////////////////////////////////////////////////////////////////////////////
+  // Generate rotated versions of camera poses.
+  //////////////////////////////////////////////////////////////////////////////
+
+  float rotated_R[9];
+  memcpy(rotated_R, ref_image.GetR(), 9 * sizeof(float));
+
+  float rotated_T[3];
+  memcpy(rotated_T, ref_image.GetT(), 3 * sizeof(float));
+
+  // Matrix for 90deg rotation around Z-axis in counter-clockwise direction.
+  const float R_z90[9] = {0, 1, 0, -1, 0, 0, 0, 0, 1};
+
+  for (size_t i = 0; i < 4; ++i) {
+    poses_[i].resize(kNumTformParams * problem_.src_image_idxs.size());
+    float* pose = poses_[i].data();
+    for (const auto image_idx : problem_.src_image_idxs) {
+      const Image& image = problem_.images->at(image_idx);
+
+      const float K[4] = {image.GetK()[0], image.GetK()[2], image.GetK()[4],
+                          image.GetK()[5]};
+      memcpy(pose + kPoseKOffset, K, 4 * sizeof(float));
+
+      float* rel_R = pose + kPoseROffset;
+      float* rel_T = pose + kPoseTOffset;
+      ComputeRelativePose(rotated_R, rotated_T, image.GetR(), image.GetT(),
+                          rel_R, rel_T);
+      ComputeProjectionCenter(rel_R, rel_T, pose + kPoseCOffset);
+      ComposeProjectionMatrix(image.GetK(), rel_R, rel_T, pose + kPosePOffset);
+      ComposeInverseProjectionMatrix(image.GetK(), rel_R, rel_T,
+                                     pose + kPoseInvPOffset);
+
+      pose += kNumTformParams;
+    }
+
+    RotatePose(R_z90, rotated_R, rotated_T);
+  }
+}
+
+void PatchMatchCpu::InitWindow() {
+  std::vector<float> col_offsets;
+  std::vector<float> row_offsets;
+  for (int row = -options_.window_radius; row <= options_.window_radius;
+       row += options_.window_step) {
+    for (int col = -options_.window_radius; col <= options_.window_radius;
+         col += options_.window_step) {
+      col_offsets.push_back(col);
+      row_offsets.push_back(row);
+    }
+  }
+
+  num_window_samples_ =
+      (col_offsets.size() + kNumSamplesPerPacket - 1) / kNumSamplesPerPacket *
+      kNumSamplesPerPacket;
+  window_offsets_.resize(2 * num_window_samples_, 0.0f);
+  std::copy(col_offsets.begin(), col_offsets.end(), window_offsets_.begin());
+  std::copy(row_offsets.begin(), row_offsets.end(),
+            window_offsets_.begin() + num_window_samples_);
+}
+
+void PatchMatchCpu::InitWorkspaceMemory() {
+  std::mt19937 prng(kDefaultPRNGSeed);
+
+  if (options_.geom_consistency) {
+    depth_map_ = problem_.depth_maps->at(problem_.ref_image_idx);
+    normal_map_ = problem_.normal_maps->at(problem_.ref_image_idx);
+  } else {
+    depth_map_ = Mat<float>(ref_width_, ref_height_, 1);
+    normal_map_ = Mat<float>(ref_width_, ref_height_, 3);
+    const size_t num_pixels = ref_width_ * ref_height_;
+    float* depth_data = depth_map_.GetPtr();
+    float* normal_data = normal_map_.GetPtr();
+    for (size_t row = 0; row < ref_height_; ++row) {
+      for (size_t col = 0; col < ref_width_; ++col) {
+        const size_t pixel_idx = row * ref_width_ + col;
+        depth_data[pixel_idx] =
+            GenerateRandomDepth(options_.depth_min, options_.depth_max, &prng);
+        float normal[3];
+        GenerateRandomNormal(ref_inv_K_[0], row, col, &prng, normal);
+        for (size_t d = 0; d < 3; ++d) {
+          normal_data[d * num_pixels + pixel_idx] = normal[d];
+        }
+      }
+    }
+  }
+
+  sel_prob_map_ = Mat<float>(ref_width_, ref_height_,
+                             problem_.src_image_idxs.size());
+  prev_sel_prob_map_ = Mat<float>(ref_width_, ref_height_,
+                                  problem_.src_image_idxs.size());
+  prev_sel_prob_map_.Fill(0.5f);
+
+  cost_map_ =
+      Mat<float>(ref_width_, ref_height_, problem_.src_image_idxs.size());
+
+  consistency_mask_ = Mat<uint8_t>(0, 0, 0);
+}
+
+void PatchMatchCpu::ProcessTiles(ThreadPool* thread_pool,
+                                 const std::function<void(int, int)>& func) {
+  const int width = static_cast<int>(depth_map_.GetWidth());
+  for (int col_begin = 0; col_begin < width; col_begin += kTileWidth) {
+    const int col_end = std::min(width, col_begin + kTileWidth);
+    thread_pool->AddTask(func, col_begin, col_end);
+  }
+  thread_pool->Wait();
+}
+
+void PatchMatchCpu::ComputeInitialCost(const int col_begin,
+                                       const int col_end) {
+  const size_t width = depth_map_.GetWidth();
+  const size_t height = depth_map_.GetHeight();
+  const size_t num_pixels = width * height;
+  const int num_images = cost_map_.GetDepth();
+
+  const float* depth_data = depth_map_.GetPtr();
+  const float* normal_data = normal_map_.GetPtr();
+  float* cost_data = cost_map_.GetPtr();
+
+  std::vector<float> window(2 * num_window_samples_);
+
+  for (size_t row = 0; row < height; ++row) {
+    for (int col = col_begin; col < col_end; ++col) {
+      const size_t pixel_idx = row * width + col;
+
+      float ref_color_sum;
+      float ref_color_squared_sum;
+      ComputeRefWindow(row, col, window.data(), &ref_color_sum,
+                       &ref_color_squared_sum);
+
+      const float depth = depth_data[pixel_idx];
+      const float normal[3] = {normal_data[pixel_idx],
+                               normal_data[num_pixels + pixel_idx],
+                               normal_data[2 * num_pixels + pixel_idx]};
+
+      for (int image_idx = 0; image_idx < num_images; ++image_idx) {
+        cost_data[image_idx * num_pixels + pixel_idx] =
+            ComputePhotoConsistencyCost(window.data(), ref_color_sum,
+                                        ref_color_squared_sum, image_idx, row,
+                                        col, depth, normal);
+      }
+    }
+  }
+}
+
+void PatchMatchCpu::SweepFromTopToBottom(const SweepOptions& options,
+                                         const int seed, const int col_begin,
+                                         const int col_end) {
+  const int width = static_cast<int>(depth_map_.GetWidth());
+  const int height = static_cast<int>(depth_map_.GetHeight());
+  const size_t num_pixels = static_cast<size_t>(width) * height;
+  const int num_images = cost_map_.GetDepth();
+  const int tile_width = col_end - col_begin;
+
+  const float* ref_inv_K = ref_inv_K_[rotation_in_half_pi_];
+  const float* poses = poses_[rotation_in_half_pi_].data();
+
+  float* depth_data = depth_map_.GetPtr();
+  float* normal_data = normal_map_.GetPtr();
+  float* cost_data = cost_map_.GetPtr();
+  float* sel_prob_data = sel_prob_map_.GetPtr();
+  const float* prev_sel_prob_data = prev_sel_prob_map_.GetPtr();
+  uint8_t* consistency_mask_data = consistency_mask_.GetPtr();
+
+  // Probability for boundary pixels.
+  const float kUniformProb = 0.5f;
+
+  const LikelihoodComputer likelihood_computer(options.ncc_sigma,
+                                               options.min_triangulation_angle,
+                                               options.incident_angle_sigma);
+
+  //////////////////////////////////////////////////////////////////////////////
+  // Compute backward message for all rows. Note that the backward messages are
+  // temporarily stored in the sel_prob_map and replaced row by row as the
+  // updated forward messages are computed further below.
+  //////////////////////////////////////////////////////////////////////////////
+
+  for (int image_idx = 0; image_idx < num_images; ++image_idx) {
+    const float* image_cost_data = cost_data + image_idx * num_pixels;
+    float* image_sel_prob_data = sel_prob_data + image_idx * num_pixels;
+    for (int col = col_begin; col < col_end; ++col) {
+      float beta = kUniformProb;
+      for (int row = height - 1; row >= 0; --row) {
+        const size_t pixel_idx = static_cast<size_t>(row) * width + col;
+        beta = likelihood_computer.ComputeBackwardMessage(
+            image_cost_data[pixel_idx], beta);
+        image_sel_prob_data[pixel_idx] = beta;
+      }
+    }
+  }
+
+  //////////////////////////////////////////////////////////////////////////////
+  // Estimate parameters for remaining rows and compute selection probabilities.
+  //////////////////////////////////////////////////////////////////////////////
+
+  struct ParamState {
+    float depth = 0.0f;
+    float normal[3];
+  };
+
+  // Forward messages and parameters of the previous pixel in each column.
+  std::vector<float> forward_messages(tile_width * num_images, kUniformProb);
+  std::vector<ParamState> prev_param_states(tile_width);
+  for (int col = col_begin; col < col_end; ++col) {
+    ParamState& prev_param_state = prev_param_states[col - col_begin];
+    prev_param_state.depth = depth_data[col];
+    for (int d = 0; d < 3; ++d) {
+      prev_param_state.normal[d] = normal_data[d * num_pixels + col];
+    }
+  }
+
+  std::vector<float> sampling_probs(num_images);
+  std::vector<float> window(2 * num_window_samples_);
+
+  std::seed_seq seed_seq = {seed, col_begin};
+  std::mt19937 prng(seed_seq);
+
+  for (int row = 0; row < height; ++row) {
+    for (int col = col_begin; col < col_end; ++col) {
+      const size_t pixel_idx = static_cast<size_t>(row) * width + col;
+      float* forward_message =
+          forward_messages.data() + (col - col_begin) * num_images;
+      ParamState& prev_param_state = prev_param_states[col - col_begin];
+
+      float ref_color_sum;
+      float ref_color_squared_sum;
+      ComputeRefWindow(row, col, window.data(), &ref_color_sum,
+                       &ref_color_squared_sum);
+
+      // Propagate the depth at which the current ray intersects with the plane
+      // of the normal of the previous ray. This helps to better estimate
+      // the depth of very oblique structures, i.e. pixels whose normal
+      // direction is significantly different from their viewing direction.
+      prev_param_state.depth =
+          PropagateDepth(ref_inv_K, prev_param_state.depth,
+                         prev_param_state.normal, row - 1, row);
+
+      // Read parameters for current pixel from previous sweep.
+      ParamState curr_param_state;
+      curr_param_state.depth = depth_data[pixel_idx];
+      for (int d = 0; d < 3; ++d) {
+        curr_param_state.normal[d] = normal_data[d * num_pixels + pixel_idx];
+      }
+
+      // Generate random parameters.
+      ParamState rand_param_state;
+      rand_param_state.depth =
+          PerturbDepth(options.perturbation, curr_param_state.depth, &prng);
+      PerturbNormal(ref_inv_K, row, col, options.perturbation * M_PI,
+                    curr_param_state.normal, &prng, rand_param_state.normal);
+
+      // Read in the backward message, compute selection probabilities and
+      // modulate selection probabilities with priors.
+
+      float point[3];
+      ComputePointAtDepth(ref_inv_K, row, col, curr_param_state.depth, point);
+
+      for (int image_idx = 0; image_idx < num_images; ++image_idx) {
+        const size_t idx = image_idx * num_pixels + pixel_idx;
+        const float* pose = poses + image_idx * kNumTformParams;
+
+        const float alpha = likelihood_computer.ComputeForwardMessage(
+            cost_data[idx], forward_message[image_idx]);
+        const float sel_prob = likelihood_computer.ComputeSelProb(
+            alpha, sel_prob_data[idx], prev_sel_prob_data[idx],
+            options.prev_sel_prob_weight);
+
+        float cos_triangulation_angle;
+        float cos_incident_angle;
+        ComputeViewingAngles(pose, point, curr_param_state.normal,
+                             &cos_triangulation_angle, &cos_incident_angle);
+        const float tri_prob =
+            likelihood_computer.ComputeTriProb(cos_triangulation_angle);
+        const float inc_prob =
+            likelihood_computer.ComputeIncProb(cos_incident_angle);
+
+        float H[9];
+        ComposeHomography(ref_inv_K, pose, row, col, curr_param_state.depth,
+                          curr_param_state.normal, H);
+        const float res_prob = likelihood_computer.ComputeResolutionProb(
+            options_.window_radius, H, row, col);
+
+        sampling_probs[image_idx] = sel_prob * tri_prob * inc_prob * res_prob;
+      }
+
+      TransformPDFToCDF(sampling_probs.data(), num_images);
+
+      // Compute matching cost using Monte Carlo sampling of source images.
+      // Images with higher selection probability are more likely to be
+      // sampled. Hence, if only very few source images see the reference image
+      // pixel, the same source image is likely to be sampled many times.
+      // Instead of taking the best K probabilities, this sampling scheme has
+      // the advantage of being adaptive to any distribution of selection
+      // probabilities.
+
+      const int kNumCosts = 5;
+      float costs[kNumCosts] = {0.0f, 0.0f, 0.0f, 0.0f, 0.0f};
+      const float depths[kNumCosts] = {
+          curr_param_state.depth, prev_param_state.depth,
+          rand_param_state.depth, curr_param_state.depth,
+          rand_param_state.depth};
+      const float* normals[kNumCosts] = {
+          curr_param_state.normal, prev_param_state.normal,
+          rand_param_state.normal, rand_param_state.normal,
+          curr_param_state.normal};
+
+      for (int sample = 0; sample < options.num_samples; ++sample) {
+        const float rand_prob = RandomUniform(&prng) - FLT_EPSILON;
+
+        int src_image_idx = -1;
+        for (int image_idx = 0; image_idx < num_images; ++image_idx) {
+          if (sampling_probs[image_idx] > rand_prob) {
+            src_image_idx = image_idx;
+            break;
+          }
+        }
+
+        if (src_image_idx == -1) {
+          continue;
+        }
+
+        costs[0] += cost_data[src_image_idx * num_pixels + pixel_idx];
+        if (options.geom_consistency_term) {
+          costs[0] += options.geom_consistency_regularizer *
+                      ComputeGeomConsistencyCost(
+                          src_image_idx, row, col, depths[0],
+                          options.geom_consistency_max_cost);
+        }
+
+        for (int i = 1; i < kNumCosts; ++i) {
+          costs[i] += ComputePhotoConsistencyCost(
+              window.data(), ref_color_sum, ref_color_squared_sum,
+              src_image_idx, row, col, depths[i], normals[i]);
+          if (options.geom_consistency_term) {
+            costs[i] += options.geom_consistency_regularizer *
+                        ComputeGeomConsistencyCost(
+                            src_image_idx, row, col, depths[i],
+                            options.geom_consistency_max_cost);
+          }
+        }
+      }
+
+      // Find the parameters of the minimum cost.
+      const int min_cost_idx = FindMinCost<kNumCosts>(costs);
+      const float best_depth = depths[min_cost_idx];
+      float best_normal[3];
+      for (int d = 0; d < 3; ++d) {
+        best_normal[d] = normals[min_cost_idx][d];
+      }
+
+      // Save best new parameters.
+      depth_data[pixel_idx] = best_depth;
+      for (int d = 0; d < 3; ++d) {
+        normal_data[d * num_pixels + pixel_idx] = best_normal[d];
+      }
+
+      // Use the new cost to recompute the updated forward message and
+      // the selection probability.
+      for (int image_idx = 0; image_idx < num_images; ++image_idx) {
+        const size_t idx = image_idx * num_pixels + pixel_idx;
+
+        // Determine the cost for best depth.
+        if (min_cost_idx != 0) {
+          cost_data[idx] = ComputePhotoConsistencyCost(
+              window.data(), ref_color_sum, ref_color_squared_sum, image_idx,
+              row, col, best_depth, best_normal);
+        }
+
+        const float alpha = likelihood_computer.ComputeForwardMessage(
+            cost_data[idx], forward_message[image_idx]);
+        forward_message[image_idx] = alpha;
+        sel_prob_data[idx] = likelihood_computer.ComputeSelProb(
+            alpha, sel_prob_data[idx], prev_sel_prob_data[idx],
+            options.prev_sel_prob_weight);
+      }
+
+      if (options.filter_photo_consistency || options.filter_geom_consistency) {
+        int num_consistent = 0;
+
+        float best_point[3];
+        ComputePointAtDepth(ref_inv_K, row, col, best_depth, best_point);
+
+        const float min_ncc_prob =
+            likelihood_computer.ComputeNCCProb(1.0f - options.filter_min_ncc);
+        const float cos_min_triangulation_angle =
+            std::cos(options.filter_min_triangulation_angle);
+
+        for (int image_idx = 0; image_idx < num_images; ++image_idx) {
+          const size_t idx = image_idx * num_pixels + pixel_idx;
+
+          float cos_triangulation_angle;
+          float cos_incident_angle;
+          ComputeViewingAngles(poses + image_idx * kNumTformParams, best_point,
+                               best_normal, &cos_triangulation_angle,
+                               &cos_incident_angle);
+          if (cos_triangulation_angle > cos_min_triangulation_angle ||
+              cos_incident_angle <= 0.0f) {
+            continue;
+          }
+
+          if (options.filter_photo_consistency &&
+              sel_prob_data[idx] < min_ncc_prob) {
+            continue;
+          }
+
+          if (options.filter_geom_consistency &&
+              ComputeGeomConsistencyCost(image_idx, row, col, best_depth,
+                                         options.geom_consistency_max_cost) >
+                  options.filter_geom_consistency_max_cost) {
+            continue;
+          }
+
+          consistency_mask_data[idx] = 1;
+          num_consistent += 1;
+        }
+
+        if (num_consistent < options.filter_min_num_consistent) {
+          const float kFilterValue = 0.0f;
+          depth_data[pixel_idx] = kFilterValue;
+          for (int d = 0; d < 3; ++d) {
+            normal_data[d * num_pixels + pixel_idx] = kFilterValue;
+          }
+          for (int image_idx = 0; image_idx < num_images; ++image_idx) {
+            consistency_mask_data[image_idx * num_pixels + pixel_idx] = 0;
+          }
+        }
+      }
+
+      // Update previous depth for next row.
+      prev_param_state.depth = best_depth;
+      for (int d = 0; d < 3; ++d) {
+        prev_param_state.normal[d] = best_normal[d];
+      }
+    }
+  }
+}
+
+void PatchMatchCpu::ComputeRefWindow(const int row, const int col,
+                                     float* window, float* ref_color_sum,
+                                     float* ref_color_squared_sum) const {
+  const int width = static_cast<int>(ref_image_.GetWidth());
+  const int height = static_cast<int>(ref_image_.GetHeight());
+  const float* ref_image_data = ref_image_.GetPtr();
+
+  const float spatial_normalization =
+      1.0f / (2.0f * options_.sigma_spatial * options_.sigma_spatial);
+  const float color_normalization =
+      1.0f / (2.0f * options_.sigma_color * options_.sigma_color);
+
+  float* weights = window;
+  float* ref_colors = window + num_window_samples_;
+  std::fill(window, window + 2 * num_window_samples_, 0.0f);
+
+  const float center_color = ref_image_data[row * width + col];
+
+  int i = 0;
+  float weight_sum = 0.0f;
+  for (int window_row = -options_.window_radius;
+       window_row <= options_.window_radius;
+       window_row += options_.window_step) {
+    const int r = row + window_row;
+    for (int window_col = -options_.window_radius;
+         window_col <= options_.window_radius;
+         window_col += options_.window_step) {
+      const int c = col + window_col;
+      // Pixels outside the reference image are black.
+      const float color = (r >= 0 && r < height && c >= 0 && c < width)
+                              ? ref_image_data[r * width + c]
+                              : 0.0f;
+      const float spatial_dist_squared =
+          window_row * window_row + window_col * window_col;
+      const float color_dist = center_color - color;
+      const float weight =
+          std::exp(-spatial_dist_squared * spatial_normalization -
+                   color_dist * color_dist * color_normalization);
+      weights[i] = weight;
+      ref_colors[i] = color;
+      weight_sum += weight;
+      i += 1;
+    }
+  }
+
+  const float inv_weight_sum = 1.0f / weight_sum;
+  *ref_color_sum = 0.0f;
+  *ref_color_squared_sum = 0.0f;
+  for (int j = 0; j < i; ++j) {
+    weights[j] *= inv_weight_sum;
+    const float weighted_color = weights[j] * ref_colors[j];
+    *ref_color_sum += weighted_color;
+    *ref_color_squared_sum += weighted_color * ref_colors[j];
+  }
+}
+
+float PatchMatchCpu::ComputePhotoConsistencyCost(
+    const float* window, const float ref_color_sum,
+    const float ref_color_squared_sum, const int image_idx, const int row,
+    const int col, const float depth, const float normal[3]) const {
+  static const WeightedSumsFunc ComputeWeightedSums = GetWeightedSumsFunc();
+
+  // Maximum photo consistency cost as 1 - min(NCC).
+  const float kMaxCost = 2.0f;
+
+  float H[9];
+  ComposeHomography(ref_inv_K_[rotation_in_half_pi_],
+                    poses_[rotation_in_half_pi_].data() +
+                        image_idx * kNumTformParams,
+                    row, col, depth, normal, H);
+
+  // Evaluate the translational part at the window center.
+  H[2] += H[0] * col + H[1] * row;
+  H[5] += H[3] * col + H[4] * row;
+  H[8] += H[6] * col + H[7] * row;
+
+  const SourceImage& src_image = src_images_[image_idx];
+  float sums[3];
+  ComputeWeightedSums(window_offsets_.data(), window, num_window_samples_, H,
+                      src_image.data.data(), src_image.width,
+                      src_image.height, sums);
+  const float src_color_sum = sums[0];
+  const float src_color_squared_sum = sums[1];
+  const float src_ref_color_sum = sums[2];
+
+  const float ref_color_var =
+      ref_color_squared_sum - ref_color_sum * ref_color_sum;
+  const float src_color_var =
+      src_color_squared_sum - src_color_sum * src_color_sum;
+
+  // Based on Jensen's Inequality for convex functions, the variance
+  // should always be larger than 0. Do not make this threshold smaller.
+  const float kMinVar = 1e-5f;
+  if (ref_color_var < kMinVar || src_color_var < kMinVar) {
+    return kMaxCost;
+  } else {
+    const float src_ref_color_covar =
+        src_ref_color_sum - ref_color_sum * src_color_sum;
+    const float src_ref_color_var = std::sqrt(ref_color_var * src_color_var);
+    return std::max(0.0f, std::min(kMaxCost, 1.0f - src_ref_color_covar /
+                                                        src_ref_color_var));
+  }
+}
+
+float PatchMatchCpu::ComputeGeomConsistencyCost(const int image_idx,
+                                                const float row,
+                                                const float col,
+                                                const float depth,
+                                                const float max_cost) const {
+  const float* ref_K = ref_K_[rotation_in_half_pi_];
+  const float* pose =
+      poses_[rotation_in_half_pi_].data() + image_idx * kNumTformParams;
+
+  // Extract projection matrices for source image.
+  const float* P = pose + kPosePOffset;
+  const float* inv_P = pose + kPoseInvPOffset;
+
+  // Project point in reference image to world.
+  float forward_point[3];
+  ComputePointAtDepth(ref_inv_K_[rotation_in_half_pi_], row, col, depth,
+                      forward_point);
+
+  // Project world point to source image.
+  const float inv_forward_z =
+      1.0f / (P[8] * forward_point[0] + P[9] * forward_point[1] +
+              P[10] * forward_point[2] + P[11]);
+  float src_col =
+      inv_forward_z * (P[0] * forward_point[0] + P[1] * forward_point[1] +
+                       P[2] * forward_point[2] + P[3]);
+  float src_row =
+      inv_forward_z * (P[4] * forward_point[0] + P[5] * forward_point[1] +
+                       P[6] * forward_point[2] + P[7]);
+
+  // Extract depth in source image using nearest neighbor interpolation.
+  const DepthMap& src_depth_map = *src_depth_maps_[image_idx];
+  const float src_depth_col = std::floor(src_col + 0.5f);
+  const float src_depth_row = std::floor(src_row + 0.5f);
+  float src_depth = 0.0f;
+  if (src_depth_col >= 0.0f && src_depth_col < src_depth_map.GetWidth() &&
+      src_depth_row >= 0.0f && src_depth_row < src_depth_map.GetHeight()) {
+    src_depth = src_depth_map.GetPtr()[static_cast<size_t>(src_depth_row) *
+                                           src_depth_map.GetWidth() +
+                                       static_cast<size_t>(src_depth_col)];
+  }
+
+  // Projection outside of source image.
+  if (src_depth == 0.0f) {
+    return max_cost;
+  }
+
+  // Project point in source image to world.
+  src_col *= src_depth;
+  src_row *= src_depth;
+  const float backward_point_x =
+      inv_P[0] * src_col + inv_P[1] * src_row + inv_P[2] * src_depth + inv_P[3];
+  const float backward_point_y =
+      inv_P[4] * src_col + inv_P[5] * src_row + inv_P[6] * src_depth + inv_P[7];
+  const float backward_point_z = inv_P[8] * src_col + inv_P[9] * src_row +
+                                 inv_P[10] * src_depth + inv_P[11];
+  const float inv_backward_point_z = 1.0f / backward_point_z;
+
+  // Project world point back to reference image.
+  const float backward_col =
+      inv_backward_point_z *
+      (ref_K[0] * backward_point_x + ref_K[1] * backward_point_z);
+  const float backward_row =
+      inv_backward_point_z *
+      (ref_K[2] * backward_point_y + ref_K[3] * backward_point_z);
+
+  // Return truncated reprojection error between original observation and
+  // the forward-backward projected observation.
+  const float diff_col = col - backward_col;
+  const float diff_row = row - backward_row;
+  return std::min(max_cost,
+                  std::sqrt(diff_col * diff_col + diff_row * diff_row));
+}
+
+void PatchMatchCpu::Rotate() {
+  rotation_in_half_pi_ = (rotation_in_half_pi_ + 1) % 4;
+
+  depth_map_ = RotateMat(depth_map_);
+
+  // Rotate normals by 90deg around z-axis in counter-clockwise direction.
+  {
+    const size_t num_pixels = normal_map_.GetWidth() * normal_map_.GetHeight();
+    float* normal_data = normal_map_.GetPtr();
+    for (size_t i = 0; i < num_pixels; ++i) {
+      const float normal0 = normal_data[i];
+      normal_data[i] = normal_data[num_pixels + i];
+      normal_data[num_pixels + i] = -normal0;
+    }
+    normal_map_ = RotateMat(normal_map_);
+  }
+
+  ref_image_ = RotateMat(ref_image_);
+
+  // Rotate selection probability map.
+  prev_sel_prob_map_ = RotateMat(sel_prob_map_);
+  sel_prob_map_ =
+      Mat<float>(prev_sel_prob_map_.GetWidth(), prev_sel_prob_map_.GetHeight(),
+                 prev_sel_prob_map_.GetDepth());
+
+  cost_map_ = RotateMat(cost_map_);
+}
+
+}  // namespace mvs
+}  // namespace colmap
@@ -0,0 +1,173 @@
+// Copyright (c) 2018, ETH Zurich and UNC Chapel Hill.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//
+//     * Neither the name of ETH Zurich and UNC Chapel Hill nor the names of
+//       its contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Author: Johannes L. Schoenberger (jsch-at-demuc-dot-de)
+
+#ifndef COLMAP_SRC_MVS_PATCH_MATCH_CPU_H_
+#define COLMAP_SRC_MVS_PATCH_MATCH_CPU_H_
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include "mvs/depth_map.h"
+#include "mvs/image.h"
+#include "mvs/mat.h"
+#include "mvs/normal_map.h"
+#include "mvs/patch_match.h"
+#include "util/threading.h"
+
+namespace colmap {
+namespace mvs {
+
+// CPU implementation of the algorithm in PatchMatchCuda. The reference image
+// is swept in the same four rotated directions, where the columns of a sweep
+// are independent and are processed in tiles by a pool of threads. The cost,
+// likelihood, and filtering terms are the same as in the Cuda version, so that
+// the produced depth, normal, and selection probability maps as well as the
+// consistency graph can be used interchangeably.
+class PatchMatchCpu {
+ public:
+  PatchMatchCpu(const PatchMatchOptions& options,
+                const PatchMatch::Problem& problem);
+
+  void Run();
+
+  DepthMap GetDepthMap() const;
+  NormalMap GetNormalMap() const;
+  Mat<float> GetSelProbMap() const;
+  std::vector<int> GetConsistentImageIdxs() const;
+
+ private:
+  struct SweepOptions {
+    float perturbation = 1.0f;
+    int num_samples = 15;
+    float ncc_sigma = 0.6f;
+    float min_triangulation_angle = 0.5f;
+    float incident_angle_sigma = 0.9f;
+    float prev_sel_prob_weight = 0.0f;
+    float geom_consistency_regularizer = 0.1f;
+    float geom_consistency_max_cost = 5.0f;
+    float filter_min_ncc = 0.1f;
+    float filter_min_triangulation_angle = 3.0f;
+    int filter_min_num_consistent = 2;
+    float filter_geom_consistency_max_cost = 1.0f;
+    bool geom_consistency_term = false;
+    bool filter_photo_consistency = false;
+    bool filter_geom_consistency = false;
+  };
+
+  // Source image with a border of zeros of one pixel, such that all four
+  // pixels of a bilinear interpolation can be read without bounds checks.
+  struct SourceImage {
+    int width = 0;
+    int height = 0;
+    std::vector<uint8_t> data;
+  };
+
+  void InitRefImage();
+  void InitSourceImages();
+  void InitTransforms();
+  void InitWindow();
+  void InitWorkspaceMemory();
+
+  // Call the function for disjoint tiles of columns of the current reference
+  // image in parallel and wait for all tiles to finish.
+  void ProcessTiles(ThreadPool* thread_pool,
+                    const std::function<void(int, int)>& func);
+
+  void ComputeInitialCost(const int col_begin, const int col_end);
+  void SweepFromTopToBottom(const SweepOptions& options, const int seed,
+                            const int col_begin, const int col_end);
+
+  // Extract the bilateral weights and colors of the reference image window
+  // around the given pixel. The weights are normalized to sum to one and the
+  // samples beyond the window size have zero weight.
+  void ComputeRefWindow(const int row, const int col, float* window,
+                        float* ref_color_sum,
+                        float* ref_color_squared_sum) const;
+
+  // The return value is 1 - NCC, so the range is [0, 2], the smaller the
+  // value, the better the color consistency.
+  float ComputePhotoConsistencyCost(const float* window,
+                                    const float ref_color_sum,
+                                    const float ref_color_squared_sum,
+                                    const int image_idx, const int row,
+                                    const int col, const float depth,
+                                    const float normal[3]) const;
+
+  float ComputeGeomConsistencyCost(const int image_idx, const float row,
+                                   const float col, const float depth,
+                                   const float max_cost) const;
+
+  // Rotate reference image by 90 degrees in counter-clockwise direction.
+  void Rotate();
+
+  const PatchMatchOptions options_;
+  const PatchMatch::Problem problem_;
+
+  // Original (not rotated) dimension of reference image.
+  size_t ref_width_;
+  size_t ref_height_;
+
+  // Rotation of reference image in pi/2. This is equivalent to the number of
+  // calls to `rotate` mod 4.
+  int rotation_in_half_pi_;
+
+  std::vector<SourceImage> src_images_;
+  std::vector<const DepthMap*> src_depth_maps_;
+
+  // Relative poses from rotated versions of reference image to source images
+  // with the same layout as in PatchMatchCuda.
+  std::vector<float> poses_[4];
+
+  // Calibration matrix for rotated versions of reference image
+  // as {K[0, 0], K[0, 2], K[1, 1], K[1, 2]} corresponding to _rotationInHalfPi.
+  float ref_K_[4][4];
+  float ref_inv_K_[4][4];
+
+  // Column offsets followed by the row offsets of the samples in the window
+  // for the photometric consistency cost, padded to the SIMD width.
+  std::vector<float> window_offsets_;
+  int num_window_samples_;
+
+  // Data for reference image.
+  Mat<float> ref_image_;
+  Mat<float> depth_map_;
+  Mat<float> normal_map_;
+  Mat<float> sel_prob_map_;
+  Mat<float> prev_sel_prob_map_;
+  Mat<float> cost_map_;
+  Mat<uint8_t> consistency_mask_;
+};
+
+}  // namespace mvs
+}  // namespace colmap
+
+#endif  // COLMAP_SRC_MVS_PATCH_MATCH_CPU_H_
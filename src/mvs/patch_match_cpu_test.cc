@@ -0,0 +1,203 @@
+// Copyright (c) 2018, ETH Zurich and UNC Chapel Hill.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//
+//     * Neither the name of ETH Zurich and UNC Chapel Hill nor the names of
+//       its contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Author: Johannes L. Schoenberger (jsch-at-demuc-dot-de)
+
+#define TEST_NAME "mvs/patch_match_cpu_test"
+#include "util/testing.h"
+
+#include <cmath>
+
+#include "mvs/patch_match_cpu.h"
+
+using namespace colmap;
+using namespace colmap::mvs;
+
+namespace {
+
+const int kImageSize = 64;
+const float kPlaneDepth = 10.0f;
+
+// Renders a textured fronto-parallel plane at kPlaneDepth in front of the
+// reference camera, which is located at the origin. The other cameras are
+// shifted by the given baseline within the plane z = 0.
+Image CreateImage(const float baseline_x, const float baseline_y) {
+  const float focal_length = 100.0f;
+  const float principal_point = 0.5f * (kImageSize - 1);
+  const float K[9] = {focal_length, 0, principal_point, 0, focal_length,
+                      principal_point, 0, 0, 1};
+  const float R[9] = {1, 0, 0, 0, 1, 0, 0, 0, 1};
+  const float T[3] = {-baseline_x, -baseline_y, 0};
+  Image image("", kImageSize, kImageSize, K, R, T);
+
+  Bitmap bitmap;
+  bitmap.Allocate(kImageSize, kImageSize, false);
+  for (int r = 0; r < kImageSize; ++r) {
+    for (int c = 0; c < kImageSize; ++c) {
+      const float x =
+          baseline_x + kPlaneDepth * (c - principal_point) / focal_length;
+      const float y =
+          baseline_y + kPlaneDepth * (r - principal_point) / focal_length;
+      const float color = 127.0f + 60.0f * std::sin(9.0f * x + 4.0f * y) +
+                          50.0f * std::cos(5.0f * x - 11.0f * y);
+      bitmap.SetPixel(c, r, BitmapColor<uint8_t>(static_cast<uint8_t>(color)));
+    }
+  }
+  image.SetBitmap(bitmap);
+
+  return image;
+}
+
+std::vector<Image> CreateImages() {
+  std::vector<Image> images;
+  images.push_back(CreateImage(0, 0));
+  images.push_back(CreateImage(1, 0));
+  images.push_back(CreateImage(-1, 0));
+  images.push_back(CreateImage(0, 1));
+  images.push_back(CreateImage(0, -1));
+  return images;
+}
+
+PatchMatchOptions CreateOptions() {
+  PatchMatchOptions options;
+  options.depth_min = 5;
+  options.depth_max = 15;
+  options.window_radius = 3;
+  options.sigma_spatial = 3;
+  options.num_iterations = 3;
+  options.geom_consistency = false;
+  options.num_threads = 2;
+  return options;
+}
+
+// Fraction of pixels away from the image border whose depth and normal
+// agree with the rendered plane.
+double ComputeInlierRatio(const DepthMap& depth_map,
+                          const NormalMap& normal_map) {
+  const int kBorder = 8;
+  int num_pixels = 0;
+  int num_inliers = 0;
+  for (int r = kBorder; r < kImageSize - kBorder; ++r) {
+    for (int c = kBorder; c < kImageSize - kBorder; ++c) {
+      num_pixels += 1;
+      if (std::abs(depth_map.Get(r, c) - kPlaneDepth) < 0.25f &&
+          normal_map.Get(r, c, 2) < -0.8f) {
+        num_inliers += 1;
+      }
+    }
+  }
+  return static_cast<double>(num_inliers) / num_pixels;
+}
+
+}  // namespace
+
+BOOST_AUTO_TEST_CASE(TestPhotometric) {
+  std::vector<Image> images = CreateImages();
+
+  PatchMatch::Problem problem;
+  problem.ref_image_idx = 0;
+  problem.src_image_idxs = {1, 2, 3, 4};
+  problem.images = &images;
+
+  for (const int window_step : {1, 2}) {
+    PatchMatchOptions options = CreateOptions();
+    options.window_step = window_step;
+    PatchMatchCpu patch_match(options, problem);
+    patch_match.Run();
+
+    const DepthMap depth_map = patch_match.GetDepthMap();
+    const NormalMap normal_map = patch_match.GetNormalMap();
+    BOOST_CHECK_EQUAL(depth_map.GetWidth(), kImageSize);
+    BOOST_CHECK_EQUAL(depth_map.GetHeight(), kImageSize);
+    BOOST_CHECK_EQUAL(normal_map.GetWidth(), kImageSize);
+    BOOST_CHECK_EQUAL(normal_map.GetHeight(), kImageSize);
+    BOOST_CHECK_GT(ComputeInlierRatio(depth_map, normal_map), 0.9);
+
+    const Mat<float> sel_prob_map = patch_match.GetSelProbMap();
+    BOOST_CHECK_EQUAL(sel_prob_map.GetWidth(), kImageSize);
+    BOOST_CHECK_EQUAL(sel_prob_map.GetHeight(), kImageSize);
+    BOOST_CHECK_EQUAL(sel_prob_map.GetDepth(), 4);
+
+    // The consistency graph stores the column, the row, the number of
+    // consistent images, and their indices for each consistent pixel.
+    const std::vector<int> consistent_image_idxs =
+        patch_match.GetConsistentImageIdxs();
+    BOOST_CHECK_GT(consistent_image_idxs.size(), 0);
+    size_t num_consistent_pixels = 0;
+    for (size_t i = 0; i < consistent_image_idxs.size();) {
+      const int col = consistent_image_idxs[i];
+      const int row = consistent_image_idxs[i + 1];
+      const int num_images = consistent_image_idxs[i + 2];
+      BOOST_CHECK_GE(num_images, options.filter_min_num_consistent);
+      BOOST_CHECK_GT(depth_map.Get(row, col), 0);
+      for (int j = 0; j < num_images; ++j) {
+        BOOST_CHECK_GE(consistent_image_idxs[i + 3 + j], 1);
+        BOOST_CHECK_LE(consistent_image_idxs[i + 3 + j], 4);
+      }
+      i += 3 + num_images;
+      num_consistent_pixels += 1;
+    }
+    BOOST_CHECK_GT(num_consistent_pixels, kImageSize * kImageSize / 2);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(TestGeometric) {
+  std::vector<Image> images = CreateImages();
+  std::vector<DepthMap> depth_maps;
+  std::vector<NormalMap> normal_maps;
+  for (size_t i = 0; i < images.size(); ++i) {
+    depth_maps.emplace_back(kImageSize, kImageSize, 5, 15);
+    depth_maps.back().Fill(kPlaneDepth);
+    Mat<float> normals(kImageSize, kImageSize, 3);
+    for (int r = 0; r < kImageSize; ++r) {
+      for (int c = 0; c < kImageSize; ++c) {
+        normals.Set(r, c, 2, -1.0f);
+      }
+    }
+    normal_maps.emplace_back(normals);
+  }
+
+  PatchMatch::Problem problem;
+  problem.ref_image_idx = 0;
+  problem.src_image_idxs = {1, 2, 3, 4};
+  problem.images = &images;
+  problem.depth_maps = &depth_maps;
+  problem.normal_maps = &normal_maps;
+
+  PatchMatchOptions options = CreateOptions();
+  options.geom_consistency = true;
+  options.num_iterations = 1;
+  PatchMatchCpu patch_match(options, problem);
+  patch_match.Run();
+
+  BOOST_CHECK_GT(ComputeInlierRatio(patch_match.GetDepthMap(),
+                                    patch_match.GetNormalMap()),
+                 0.95);
+  BOOST_CHECK_GT(patch_match.GetConsistentImageIdxs().size(), 0);
+}
@@ -86,12 +86,7 @@ const Model& Workspace::GetModel() const { return model_; }
 const Bitmap& Workspace::GetBitmap(const int image_idx) {
   auto& cached_image = cache_.GetMutable(image_idx);
   if (!cached_image.bitmap) {
-    cached_image.bitmap.reset(new Bitmap());
-    cached_image.bitmap->Read(GetBitmapPath(image_idx), options_.image_as_rgb);
-    if (options_.max_image_size > 0) {
-      cached_image.bitmap->Rescale(model_.images.at(image_idx).GetWidth(),
-                                   model_.images.at(image_idx).GetHeight());
-    }
+    cached_image.bitmap = ReadBitmap(image_idx);
     cached_image.num_bytes += cached_image.bitmap->NumBytes();
     cache_.UpdateNumBytes(image_idx);
   }
@@ -101,12 +96,7 @@ const Bitmap& Workspace::GetBitmap(const int image_idx) {
 const DepthMap& Workspace::GetDepthMap(const int image_idx) {
   auto& cached_image = cache_.GetMutable(image_idx);
   if (!cached_image.depth_map) {
-    cached_image.depth_map.reset(new DepthMap());
-    cached_image.depth_map->Read(GetDepthMapPath(image_idx));
-    if (options_.max_image_size > 0) {
-      cached_image.depth_map->Downsize(model_.images.at(image_idx).GetWidth(),
-                                       model_.images.at(image_idx).GetHeight());
-    }
+    cached_image.depth_map = ReadDepthMap(image_idx);
     cached_image.num_bytes += cached_image.depth_map->GetNumBytes();
     cache_.UpdateNumBytes(image_idx);
   }
@@ -116,13 +106,7 @@ const DepthMap& Workspace::GetDepthMap(const int image_idx) {
 const NormalMap& Workspace::GetNormalMap(const int image_idx) {
   auto& cached_image = cache_.GetMutable(image_idx);
   if (!cached_image.normal_map) {
-    cached_image.normal_map.reset(new NormalMap());
-    cached_image.normal_map->Read(GetNormalMapPath(image_idx));
-    if (options_.max_image_size > 0) {
-      cached_image.normal_map->Downsize(
-          model_.images.at(image_idx).GetWidth(),
-          model_.images.at(image_idx).GetHeight());
-    }
+    cached_image.normal_map = ReadNormalMap(image_idx);
     cached_image.num_bytes += cached_image.normal_map->GetNumBytes();
     cache_.UpdateNumBytes(image_idx);
   }
@@ -153,6 +137,45 @@ bool Workspace::HasNormalMap(const int image_idx) const {
   return ExistsFile(GetNormalMapPath(image_idx));
 }
 
+std::unique_ptr<Bitmap> Workspace::ReadBitmap(const int image_idx) const {
+  std::unique_ptr<Bitmap> bitmap(new Bitmap());
+  bitmap->Read(GetBitmapPath(image_idx), options_.image_as_rgb);
+  if (options_.max_image_size > 0) {
+    bitmap->Rescale(model_.images.at(image_idx).GetWidth(),
+                    model_.images.at(image_idx).GetHeight());
+  }
+  return bitmap;
+}
+
+std::unique_ptr<DepthMap> Workspace::ReadDepthMap(const int image_idx) const {
+  std::unique_ptr<DepthMap> depth_map(new DepthMap());
+  if (options_.memory_map) {
+    depth_map->ReadMapped(GetDepthMapPath(image_idx));
+  } else {
+    depth_map->Read(GetDepthMapPath(image_idx));
+  }
+  if (options_.max_image_size > 0) {
+    depth_map->Downsize(model_.images.at(image_idx).GetWidth(),
+                        model_.images.at(image_idx).GetHeight());
+  }
+  return depth_map;
+}
+
+std::unique_ptr<NormalMap> Workspace::ReadNormalMap(
+    const int image_idx) const {
+  std::unique_ptr<NormalMap> normal_map(new NormalMap());
+  if (options_.memory_map) {
+    normal_map->ReadMapped(GetNormalMapPath(image_idx));
+  } else {
+    normal_map->Read(GetNormalMapPath(image_idx));
+  }
+  if (options_.max_image_size > 0) {
+    normal_map->Downsize(model_.images.at(image_idx).GetWidth(),
+                         model_.images.at(image_idx).GetHeight());
+  }
+  return normal_map;
+}
+
 std::string Workspace::GetFileName(const int image_idx) const {
   const auto& image_name = model_.GetImageName(image_idx);
   return StringPrintf("%s.%s.bin", image_name.c_str(),
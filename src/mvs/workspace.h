@@ -54,6 +54,11 @@ class Workspace {
     // Whether to read image as RGB or gray scale.
     bool image_as_rgb = true;
 
+    // Whether to memory-map the depth and normal maps. Mapped maps are not
+    // counted against the cache size, as their pages are managed by the
+    // operating system and shared across processes.
+    bool memory_map = true;
+
     // Location and type of workspace.
     std::string workspace_path;
     std::string workspace_format;
@@ -82,6 +87,12 @@ class Workspace {
   bool HasDepthMap(const int image_idx) const;
   bool HasNormalMap(const int image_idx) const;
 
+  // Read the bitmap, depth map, and normal map from disk without going through
+  // the cache. In contrast to the getters above, these methods are thread-safe.
+  std::unique_ptr<Bitmap> ReadBitmap(const int image_idx) const;
+  std::unique_ptr<DepthMap> ReadDepthMap(const int image_idx) const;
+  std::unique_ptr<NormalMap> ReadNormalMap(const int image_idx) const;
+
  private:
   std::string GetFileName(const int image_idx) const;
 
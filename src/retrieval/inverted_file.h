@@ -35,6 +35,7 @@
 #include <algorithm>
 #include <bitset>
 #include <cstdint>
+#include <cstring>
 #include <fstream>
 #include <unordered_map>
 #include <unordered_set>
@@ -70,13 +71,16 @@ class InvertedFile {
     USABLE = 0x03,
   };
 
+  // The number of bytes of the header written by WriteMappedHeader.
+  static const size_t kMappedHeaderNumBytes = 24 + 4 * kEmbeddingDim;
+
   InvertedFile();
 
   // The number of added entries.
   size_t NumEntries() const;
 
-  // Return all entries in the file.
-  const std::vector<EntryType>& GetEntries() const;
+  // Return the entry with the given index.
+  const EntryType& GetEntry(const size_t idx) const;
 
   // Whether the Hamming embedding was computed for this file.
   bool HasHammingEmbedding() const;
@@ -140,7 +144,26 @@ class InvertedFile {
   void Read(std::ifstream* ifs);
   void Write(std::ofstream* ofs) const;
 
+  // Write the inverted file in the memory-mapped format, which separates the
+  // fixed-size header from the entries. The header records the offset of the
+  // entries relative to the start of the mapped data.
+  void WriteMappedHeader(const uint64_t entries_offset,
+                         std::ostream* ofs) const;
+  void WriteMappedEntries(std::ostream* ofs) const;
+
+  // Read the inverted file from mapped data. If possible, the entries are
+  // referenced in place and only paged in on first access, otherwise they are
+  // copied. The mapped data must outlive the inverted file or any subsequent
+  // modification of its entries, which first copies the referenced entries.
+  void ReadMapped(const uint8_t* header, const uint8_t* data);
+
  private:
+  const EntryType* EntriesBegin() const;
+  const EntryType* EntriesEnd() const;
+
+  // Copy the referenced mapped entries, so that they can be modified.
+  void CopyMappedEntries();
+
   // Whether the inverted file is initialized.
   uint8_t status_;
 
@@ -150,6 +173,11 @@ class InvertedFile {
   // The entries of the inverted file system.
   std::vector<EntryType> entries_;
 
+  // The entries of the inverted file system, if they are referenced in mapped
+  // memory instead of being stored in entries_.
+  const EntryType* mapped_entries_;
+  size_t num_mapped_entries_;
+
   // The thresholds used for Hamming embedding.
   DescType thresholds_;
 
@@ -166,9 +194,15 @@ template <int kEmbeddingDim>
 const HammingDistWeightFunctor<kEmbeddingDim>
     InvertedFile<kEmbeddingDim>::hamming_dist_weight_functor_;
 
+template <int kEmbeddingDim>
+const size_t InvertedFile<kEmbeddingDim>::kMappedHeaderNumBytes;
+
 template <int kEmbeddingDim>
 InvertedFile<kEmbeddingDim>::InvertedFile()
-    : status_(UNUSABLE), idf_weight_(0.0f) {
+    : status_(UNUSABLE),
+      idf_weight_(0.0f),
+      mapped_entries_(nullptr),
+      num_mapped_entries_(0) {
   static_assert(kEmbeddingDim % 8 == 0,
                 "Dimensionality of projected space needs to"
                 " be a multiple of 8.");
@@ -181,13 +215,14 @@ InvertedFile<kEmbeddingDim>::InvertedFile()
 
 template <int kEmbeddingDim>
 size_t InvertedFile<kEmbeddingDim>::NumEntries() const {
-  return entries_.size();
+  return EntriesEnd() - EntriesBegin();
 }
 
 template <int kEmbeddingDim>
-const std::vector<typename InvertedFile<kEmbeddingDim>::EntryType>&
-InvertedFile<kEmbeddingDim>::GetEntries() const {
-  return entries_;
+const typename InvertedFile<kEmbeddingDim>::EntryType&
+InvertedFile<kEmbeddingDim>::GetEntry(const size_t idx) const {
+  CHECK_LT(idx, NumEntries());
+  return EntriesBegin()[idx];
 }
 
 template <int kEmbeddingDim>
@@ -217,12 +252,17 @@ void InvertedFile<kEmbeddingDim>::AddEntry(const int image_id,
   entry.feature_idx = feature_idx;
   entry.geometry = geometry;
   ConvertToBinaryDescriptor(descriptor, &entry.descriptor);
+  CopyMappedEntries();
   entries_.push_back(entry);
   status_ &= ~ENTRIES_SORTED;
 }
 
 template <int kEmbeddingDim>
 void InvertedFile<kEmbeddingDim>::SortEntries() {
+  if (EntriesSorted()) {
+    return;
+  }
+  CopyMappedEntries();
   std::sort(entries_.begin(), entries_.end(),
             [](const EntryType& entry1, const EntryType& entry2) {
               return entry1.image_id < entry2.image_id;
@@ -233,6 +273,8 @@ void InvertedFile<kEmbeddingDim>::SortEntries() {
 template <int kEmbeddingDim>
 void InvertedFile<kEmbeddingDim>::ClearEntries() {
   entries_.clear();
+  mapped_entries_ = nullptr;
+  num_mapped_entries_ = 0;
   status_ &= ~ENTRIES_SORTED;
 }
 
@@ -241,6 +283,8 @@ void InvertedFile<kEmbeddingDim>::Reset() {
   status_ = UNUSABLE;
   idf_weight_ = 0.0f;
   entries_.clear();
+  mapped_entries_ = nullptr;
+  num_mapped_entries_ = 0;
   thresholds_.setZero();
 }
 
@@ -256,7 +300,7 @@ void InvertedFile<kEmbeddingDim>::ConvertToBinaryDescriptor(
 
 template <int kEmbeddingDim>
 void InvertedFile<kEmbeddingDim>::ComputeIDFWeight(const int num_total_images) {
-  if (entries_.empty()) {
+  if (NumEntries() == 0) {
     return;
   }
 
@@ -302,7 +346,7 @@ void InvertedFile<kEmbeddingDim>::ScoreFeature(
     return;
   }
 
-  if (entries_.size() == 0) {
+  if (NumEntries() == 0) {
     return;
   }
 
@@ -312,13 +356,15 @@ void InvertedFile<kEmbeddingDim>::ScoreFeature(
   ConvertToBinaryDescriptor(descriptor, &bin_descriptor);
 
   ImageScore image_score;
-  image_score.image_id = entries_.front().image_id;
+  image_score.image_id = EntriesBegin()->image_id;
   image_score.score = 0.0f;
   int num_image_votes = 0;
 
   // Note that this assumes that the entries are sorted using SortEntries
   // according to their image identifiers.
-  for (const auto& entry : entries_) {
+  for (const EntryType* entry_it = EntriesBegin(); entry_it != EntriesEnd();
+       ++entry_it) {
+    const EntryType& entry = *entry_it;
     if (image_score.image_id < entry.image_id) {
       if (num_image_votes > 0) {
         // Finalizes the voting since we now know how many features from
@@ -358,8 +404,9 @@ void InvertedFile<kEmbeddingDim>::ScoreFeature(
 template <int kEmbeddingDim>
 void InvertedFile<kEmbeddingDim>::GetImageIds(
     std::unordered_set<int>* ids) const {
-  for (const EntryType& entry : entries_) {
-    ids->insert(entry.image_id);
+  for (const EntryType* entry = EntriesBegin(); entry != EntriesEnd();
+       ++entry) {
+    ids->insert(entry->image_id);
   }
 }
 
@@ -367,8 +414,9 @@ template <int kEmbeddingDim>
 void InvertedFile<kEmbeddingDim>::ComputeImageSelfSimilarities(
     std::unordered_map<int, double>* self_similarities) const {
   const double squared_idf_weight = idf_weight_ * idf_weight_;
-  for (const auto& entry : entries_) {
-    (*self_similarities)[entry.image_id] += squared_idf_weight;
+  for (const EntryType* entry = EntriesBegin(); entry != EntriesEnd();
+       ++entry) {
+    (*self_similarities)[entry->image_id] += squared_idf_weight;
   }
 }
 
@@ -385,6 +433,8 @@ void InvertedFile<kEmbeddingDim>::Read(std::ifstream* ifs) {
 
   uint32_t num_entries = 0;
   ifs->read(reinterpret_cast<char*>(&num_entries), sizeof(uint32_t));
+  mapped_entries_ = nullptr;
+  num_mapped_entries_ = 0;
   entries_.resize(num_entries);
 
   for (uint32_t i = 0; i < num_entries; ++i) {
@@ -403,12 +453,95 @@ void InvertedFile<kEmbeddingDim>::Write(std::ofstream* ofs) const {
     ofs->write(reinterpret_cast<const char*>(&thresholds_[i]), sizeof(float));
   }
 
-  const uint32_t num_entries = static_cast<uint32_t>(entries_.size());
+  const uint32_t num_entries = static_cast<uint32_t>(NumEntries());
   ofs->write(reinterpret_cast<const char*>(&num_entries), sizeof(uint32_t));
 
   for (uint32_t i = 0; i < num_entries; ++i) {
-    entries_[i].Write(ofs);
+    EntriesBegin()[i].Write(ofs);
+  }
+}
+
+template <int kEmbeddingDim>
+void InvertedFile<kEmbeddingDim>::WriteMappedHeader(
+    const uint64_t entries_offset, std::ostream* ofs) const {
+  const uint8_t padding[3] = {0, 0, 0};
+  ofs->write(reinterpret_cast<const char*>(&status_), sizeof(uint8_t));
+  ofs->write(reinterpret_cast<const char*>(padding), sizeof(padding));
+  ofs->write(reinterpret_cast<const char*>(&idf_weight_), sizeof(float));
+
+  for (int i = 0; i < kEmbeddingDim; ++i) {
+    ofs->write(reinterpret_cast<const char*>(&thresholds_[i]), sizeof(float));
+  }
+
+  const uint64_t num_entries = NumEntries();
+  ofs->write(reinterpret_cast<const char*>(&entries_offset), sizeof(uint64_t));
+  ofs->write(reinterpret_cast<const char*>(&num_entries), sizeof(uint64_t));
+}
+
+template <int kEmbeddingDim>
+void InvertedFile<kEmbeddingDim>::WriteMappedEntries(std::ostream* ofs) const {
+  for (const EntryType* entry = EntriesBegin(); entry != EntriesEnd();
+       ++entry) {
+    entry->Write(ofs);
+  }
+}
+
+template <int kEmbeddingDim>
+void InvertedFile<kEmbeddingDim>::ReadMapped(const uint8_t* header,
+                                             const uint8_t* data) {
+  std::memcpy(&status_, header, sizeof(uint8_t));
+  std::memcpy(&idf_weight_, header + 4, sizeof(float));
+  std::memcpy(thresholds_.data(), header + 8, kEmbeddingDim * sizeof(float));
+
+  uint64_t entries_offset = 0;
+  uint64_t num_entries = 0;
+  header += 8 + kEmbeddingDim * sizeof(float);
+  std::memcpy(&entries_offset, header, sizeof(uint64_t));
+  std::memcpy(&num_entries, header + 8, sizeof(uint64_t));
+
+  const uint8_t* entries_data = data + entries_offset;
+
+  entries_.clear();
+  if (EntryType::IsMappable() &&
+      reinterpret_cast<uintptr_t>(entries_data) % alignof(EntryType) == 0) {
+    mapped_entries_ = reinterpret_cast<const EntryType*>(entries_data);
+    num_mapped_entries_ = num_entries;
+  } else {
+    mapped_entries_ = nullptr;
+    num_mapped_entries_ = 0;
+    entries_.resize(num_entries);
+    for (uint64_t i = 0; i < num_entries; ++i) {
+      entries_[i].Read(entries_data + i * EntryType::kNumBytes);
+    }
+  }
+}
+
+template <int kEmbeddingDim>
+const typename InvertedFile<kEmbeddingDim>::EntryType*
+InvertedFile<kEmbeddingDim>::EntriesBegin() const {
+  if (mapped_entries_ != nullptr) {
+    return mapped_entries_;
+  }
+  return entries_.data();
+}
+
+template <int kEmbeddingDim>
+const typename InvertedFile<kEmbeddingDim>::EntryType*
+InvertedFile<kEmbeddingDim>::EntriesEnd() const {
+  if (mapped_entries_ != nullptr) {
+    return mapped_entries_ + num_mapped_entries_;
+  }
+  return entries_.data() + entries_.size();
+}
+
+template <int kEmbeddingDim>
+void InvertedFile<kEmbeddingDim>::CopyMappedEntries() {
+  if (mapped_entries_ == nullptr) {
+    return;
   }
+  entries_.assign(mapped_entries_, mapped_entries_ + num_mapped_entries_);
+  mapped_entries_ = nullptr;
+  num_mapped_entries_ = 0;
 }
 
 }  // namespace retrieval
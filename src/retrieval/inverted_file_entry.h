@@ -33,9 +33,13 @@
 #define COLMAP_SRC_RETRIEVAL_INVERTED_FILE_ENTRY_H_
 
 #include <bitset>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
 #include <fstream>
 
 #include "retrieval/geometry.h"
+#include "util/endian.h"
 
 namespace colmap {
 namespace retrieval {
@@ -45,9 +49,17 @@ namespace retrieval {
 // This class is based on an original implementation by Torsten Sattler.
 template <int N>
 struct InvertedFileEntry {
+  // The number of bytes of a serialized entry.
+  static const size_t kNumBytes = 32;
+
   void Read(std::istream* ifs);
+  void Read(const uint8_t* data);
   void Write(std::ostream* ofs) const;
 
+  // Whether serialized entries can be used in place, e.g. from a memory-mapped
+  // file, because the in-memory layout equals the serialized layout.
+  static bool IsMappable();
+
   // The identifier of the image this entry is associated with.
   int image_id = -1;
 
@@ -65,6 +77,9 @@ struct InvertedFileEntry {
 // Implementation
 ////////////////////////////////////////////////////////////////////////////////
 
+template <int N>
+const size_t InvertedFileEntry<N>::kNumBytes;
+
 template <int N>
 void InvertedFileEntry<N>::Read(std::istream* ifs) {
   static_assert(N <= 64, "Dimensionality too large");
@@ -87,6 +102,26 @@ void InvertedFileEntry<N>::Read(std::istream* ifs) {
   descriptor = std::bitset<N>(descriptor_data);
 }
 
+template <int N>
+void InvertedFileEntry<N>::Read(const uint8_t* data) {
+  static_assert(N <= 64, "Dimensionality too large");
+  static_assert(sizeof(FeatureGeometry) == 16, "Geometry type size mismatch");
+
+  int32_t image_id_data = 0;
+  std::memcpy(&image_id_data, data, sizeof(int32_t));
+  image_id = static_cast<int>(image_id_data);
+
+  int32_t feature_idx_data = 0;
+  std::memcpy(&feature_idx_data, data + 4, sizeof(int32_t));
+  feature_idx = static_cast<int>(feature_idx_data);
+
+  std::memcpy(&geometry, data + 8, sizeof(FeatureGeometry));
+
+  uint64_t descriptor_data = 0;
+  std::memcpy(&descriptor_data, data + 24, sizeof(uint64_t));
+  descriptor = std::bitset<N>(descriptor_data);
+}
+
 template <int N>
 void InvertedFileEntry<N>::Write(std::ostream* ofs) const {
   static_assert(N <= 64, "Dimensionality too large");
@@ -107,6 +142,25 @@ void InvertedFileEntry<N>::Write(std::ostream* ofs) const {
   ofs->write(reinterpret_cast<const char*>(&descriptor_data), sizeof(uint64_t));
 }
 
+template <int N>
+bool InvertedFileEntry<N>::IsMappable() {
+  if (!IsLittleEndian() || sizeof(InvertedFileEntry<N>) != kNumBytes ||
+      offsetof(InvertedFileEntry<N>, image_id) != 0 ||
+      offsetof(InvertedFileEntry<N>, feature_idx) != 4 ||
+      offsetof(InvertedFileEntry<N>, geometry) != 8 ||
+      offsetof(InvertedFileEntry<N>, descriptor) != 24 ||
+      sizeof(std::bitset<N>) != sizeof(uint64_t)) {
+    return false;
+  }
+
+  // The bit order of std::bitset is implementation-defined, so check that the
+  // bits are stored in the same order as in the serialized 64-bit word.
+  const uint64_t kPattern = 0xF0E1D2C3B4A59687ull;
+  const uint64_t pattern = N == 64 ? kPattern : kPattern & ((1ull << N) - 1);
+  const std::bitset<N> descriptor(pattern);
+  return std::memcmp(&descriptor, &pattern, sizeof(uint64_t)) == 0;
+}
+
 }  // namespace retrieval
 }  // namespace colmap
 
@@ -74,3 +74,39 @@ BOOST_AUTO_TEST_CASE(TestReadWrite) {
     BOOST_CHECK_EQUAL(entry.descriptor[i], read_entry.descriptor[i]);
   }
 }
+
+BOOST_AUTO_TEST_CASE(TestReadMapped) {
+  InvertedFileEntry<64> entry;
+  entry.image_id = 99;
+  entry.feature_idx = 100;
+  entry.geometry.x = 0.123;
+  entry.geometry.y = 0.456;
+  entry.geometry.scale = 0.789;
+  entry.geometry.orientation = -0.1;
+  for (size_t i = 0; i < entry.descriptor.size(); ++i) {
+    entry.descriptor[i] = (i % 3) == 0;
+  }
+  std::stringstream file;
+  entry.Write(&file);
+
+  const std::string data = file.str();
+  BOOST_CHECK_EQUAL(data.size(), InvertedFileEntry<64>::kNumBytes);
+
+  InvertedFileEntry<64> read_entry;
+  read_entry.Read(reinterpret_cast<const uint8_t*>(data.data()));
+  BOOST_CHECK_EQUAL(entry.image_id, read_entry.image_id);
+  BOOST_CHECK_EQUAL(entry.feature_idx, read_entry.feature_idx);
+  BOOST_CHECK_EQUAL(entry.geometry.x, read_entry.geometry.x);
+  BOOST_CHECK_EQUAL(entry.geometry.orientation,
+                    read_entry.geometry.orientation);
+  BOOST_CHECK(entry.descriptor == read_entry.descriptor);
+
+  if (InvertedFileEntry<64>::IsMappable()) {
+    InvertedFileEntry<64> mapped_entry;
+    std::memcpy(&mapped_entry, data.data(), data.size());
+    BOOST_CHECK_EQUAL(entry.image_id, mapped_entry.image_id);
+    BOOST_CHECK_EQUAL(entry.feature_idx, mapped_entry.feature_idx);
+    BOOST_CHECK_EQUAL(entry.geometry.scale, mapped_entry.geometry.scale);
+    BOOST_CHECK(entry.descriptor == mapped_entry.descriptor);
+  }
+}
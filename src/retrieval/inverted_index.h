@@ -35,6 +35,7 @@
 #include <algorithm>
 #include <bitset>
 #include <cstdint>
+#include <cstring>
 #include <fstream>
 #include <unordered_map>
 #include <unordered_set>
@@ -57,6 +58,8 @@ template <typename kDescType, int kDescDim, int kEmbeddingDim>
 class InvertedIndex {
  public:
   const static int kInvalidWordId;
+  // The alignment in bytes of the entries in the memory-mapped format.
+  const static size_t kMappedAlignment;
   typedef Eigen::Matrix<kDescType, Eigen::Dynamic, kDescDim, Eigen::RowMajor>
       DescType;
   typedef typename InvertedFile<kEmbeddingDim>::EntryType EntryType;
@@ -64,6 +67,15 @@ class InvertedIndex {
   typedef Eigen::Matrix<float, Eigen::Dynamic, kDescDim> ProjMatrixType;
   typedef Eigen::VectorXf ProjDescType;
 
+  // Scratch space for queries. Concurrent queries must use separate buffers,
+  // but a buffer can be reused across consecutive queries to avoid repeated
+  // allocations.
+  struct QueryBuffer {
+    std::unordered_map<int, int> score_map;
+    std::vector<ImageScore> inverted_file_scores;
+    ProjDescType proj_descriptor;
+  };
+
   InvertedIndex();
 
   // The number of visual words in the index.
@@ -76,6 +88,13 @@ class InvertedIndex {
   // entries are in ascending order of image ids.
   void Finalize();
 
+  // Finalizes only the inverted files modified since the last finalization and
+  // computes the normalization of the newly added images. The IDF weights of
+  // unmodified inverted files and the normalization of previously added images
+  // are refreshed lazily by a full finalization, once the number of images
+  // grew by more than the given ratio since the last full finalization.
+  void FinalizeIncremental(const double max_num_images_growth);
+
   // Generate projection matrix for Hamming embedding.
   void GenerateHammingEmbeddingProjection();
 
@@ -95,6 +114,8 @@ class InvertedIndex {
   // Query the inverted file and return a list of sorted images.
   void Query(const DescType& descriptors, const Eigen::MatrixXi& word_ids,
              std::vector<ImageScore>* image_scores) const;
+  void Query(const DescType& descriptors, const Eigen::MatrixXi& word_ids,
+             std::vector<ImageScore>* image_scores, QueryBuffer* buffer) const;
 
   void ConvertToBinaryDescriptor(
       const int word_id, const DescType& descriptor,
@@ -115,9 +136,24 @@ class InvertedIndex {
   void Read(std::ifstream* ifs);
   void Write(std::ofstream* ofs) const;
 
+  // Read/write the inverted index in the memory-mapped format. The written
+  // data must start at a multiple of kMappedAlignment in the file, so that the
+  // entries of the inverted files can be referenced in place after mapping
+  // the file. The mapped data must outlive the inverted index.
+  void ReadMapped(const uint8_t* data, const size_t num_bytes);
+  void WriteMapped(std::ostream* ofs) const;
+
+  // Get the identifiers of all images with normalization constants, which are
+  // all indexed images after the index was finalized. In contrast to
+  // GetImageIds, this does not iterate over all entries.
+  void GetNormalizedImageIds(std::unordered_set<int>* image_ids) const;
+
  private:
   void ComputeWeightsAndNormalizationConstants();
 
+  // The number of bytes of the memory-mapped format before the entries.
+  size_t MappedHeaderNumBytes(const size_t num_images) const;
+
   // The individual inverted indices.
   std::vector<InvertedFile<kEmbeddingDim>,
               Eigen::aligned_allocator<InvertedFile<kEmbeddingDim>>>
@@ -127,6 +163,12 @@ class InvertedIndex {
   // normalize the votes.
   std::unordered_map<int, float> normalization_constants_;
 
+  // The number of images at the last full finalization.
+  size_t num_refreshed_images_;
+
+  // The visual words with entries added since the last finalization.
+  std::unordered_set<int> modified_word_ids_;
+
   // The projection matrix used to project SIFT descriptors.
   ProjMatrixType proj_matrix_;
 };
@@ -140,7 +182,12 @@ const int InvertedIndex<kDescType, kDescDim, kEmbeddingDim>::kInvalidWordId =
     std::numeric_limits<int>::max();
 
 template <typename kDescType, int kDescDim, int kEmbeddingDim>
-InvertedIndex<kDescType, kDescDim, kEmbeddingDim>::InvertedIndex() {
+const size_t
+    InvertedIndex<kDescType, kDescDim, kEmbeddingDim>::kMappedAlignment = 4096;
+
+template <typename kDescType, int kDescDim, int kEmbeddingDim>
+InvertedIndex<kDescType, kDescDim, kEmbeddingDim>::InvertedIndex()
+    : num_refreshed_images_(0) {
   proj_matrix_.resize(kEmbeddingDim, kDescDim);
   proj_matrix_.setIdentity();
 }
@@ -158,6 +205,7 @@ void InvertedIndex<kDescType, kDescDim, kEmbeddingDim>::Initialize(
   for (auto& inverted_file : inverted_files_) {
     inverted_file.Reset();
   }
+  modified_word_ids_.clear();
 }
 
 template <typename kDescType, int kDescDim, int kEmbeddingDim>
@@ -169,6 +217,60 @@ void InvertedIndex<kDescType, kDescDim, kEmbeddingDim>::Finalize() {
   }
 
   ComputeWeightsAndNormalizationConstants();
+
+  num_refreshed_images_ = normalization_constants_.size();
+  modified_word_ids_.clear();
+}
+
+template <typename kDescType, int kDescDim, int kEmbeddingDim>
+void InvertedIndex<kDescType, kDescDim, kEmbeddingDim>::FinalizeIncremental(
+    const double max_num_images_growth) {
+  CHECK_GT(NumVisualWords(), 0);
+  CHECK_GE(max_num_images_growth, 0);
+
+  // All entries of newly added images are in the modified inverted files.
+  std::unordered_set<int> new_image_ids;
+  for (const int word_id : modified_word_ids_) {
+    auto& inverted_file = inverted_files_.at(word_id);
+    inverted_file.SortEntries();
+    std::unordered_set<int> image_ids;
+    inverted_file.GetImageIds(&image_ids);
+    for (const int image_id : image_ids) {
+      if (normalization_constants_.count(image_id) == 0) {
+        new_image_ids.insert(image_id);
+      }
+    }
+  }
+
+  const size_t num_images =
+      normalization_constants_.size() + new_image_ids.size();
+  if (num_refreshed_images_ == 0 ||
+      num_images > (1.0 + max_num_images_growth) * num_refreshed_images_) {
+    Finalize();
+    return;
+  }
+
+  for (const int word_id : modified_word_ids_) {
+    inverted_files_.at(word_id).ComputeIDFWeight(num_images);
+  }
+
+  std::unordered_map<int, double> self_similarities;
+  for (const int word_id : modified_word_ids_) {
+    inverted_files_.at(word_id).ComputeImageSelfSimilarities(
+        &self_similarities);
+  }
+
+  for (const int image_id : new_image_ids) {
+    const double self_similarity = self_similarities.at(image_id);
+    if (self_similarity > 0.0) {
+      normalization_constants_[image_id] =
+          static_cast<float>(1.0 / std::sqrt(self_similarity));
+    } else {
+      normalization_constants_[image_id] = 0.0f;
+    }
+  }
+
+  modified_word_ids_.clear();
 }
 
 template <typename kDescType, int kDescDim, int kEmbeddingDim>
@@ -226,6 +328,7 @@ void InvertedIndex<kDescType, kDescDim, kEmbeddingDim>::AddEntry(
       proj_matrix_ * descriptor.transpose().template cast<float>();
   inverted_files_.at(word_id)
       .AddEntry(image_id, feature_idx, proj_desc, geometry);
+  modified_word_ids_.insert(word_id);
 }
 
 template <typename kDescType, int kDescDim, int kEmbeddingDim>
@@ -233,13 +336,23 @@ void InvertedIndex<kDescType, kDescDim, kEmbeddingDim>::ClearEntries() {
   for (auto& inverted_file : inverted_files_) {
     inverted_file.ClearEntries();
   }
+  modified_word_ids_.clear();
 }
 
 template <typename kDescType, int kDescDim, int kEmbeddingDim>
 void InvertedIndex<kDescType, kDescDim, kEmbeddingDim>::Query(
     const DescType& descriptors, const Eigen::MatrixXi& word_ids,
     std::vector<ImageScore>* image_scores) const {
+  QueryBuffer buffer;
+  Query(descriptors, word_ids, image_scores, &buffer);
+}
+
+template <typename kDescType, int kDescDim, int kEmbeddingDim>
+void InvertedIndex<kDescType, kDescDim, kEmbeddingDim>::Query(
+    const DescType& descriptors, const Eigen::MatrixXi& word_ids,
+    std::vector<ImageScore>* image_scores, QueryBuffer* buffer) const {
   CHECK_EQ(descriptors.cols(), kDescDim);
+  CHECK_EQ(descriptors.rows(), word_ids.rows());
 
   image_scores->clear();
 
@@ -250,11 +363,14 @@ void InvertedIndex<kDescType, kDescDim, kEmbeddingDim>::Query(
     normalization_weight = 1.0f / std::sqrt(self_similarity);
   }
 
-  std::unordered_map<int, int> score_map;
-  std::vector<ImageScore> inverted_file_scores;
+  auto& score_map = buffer->score_map;
+  auto& inverted_file_scores = buffer->inverted_file_scores;
+  auto& proj_descriptor = buffer->proj_descriptor;
+  score_map.clear();
+  proj_descriptor.resize(proj_matrix_.rows());
 
   for (typename DescType::Index i = 0; i < descriptors.rows(); ++i) {
-    const ProjDescType proj_descriptor =
+    proj_descriptor.noalias() =
         proj_matrix_ * descriptors.row(i).transpose().template cast<float>();
     for (Eigen::MatrixXi::Index n = 0; n < word_ids.cols(); ++n) {
       const int word_id = word_ids(i, n);
@@ -309,8 +425,9 @@ void InvertedIndex<kDescType, kDescDim, kEmbeddingDim>::FindMatches(
     const int word_id, const std::unordered_set<int>& image_ids,
     std::vector<const EntryType*>* matches) const {
   matches->clear();
-  const auto& entries = inverted_files_.at(word_id).GetEntries();
-  for (const auto& entry : entries) {
+  const auto& inverted_file = inverted_files_.at(word_id);
+  for (size_t i = 0; i < inverted_file.NumEntries(); ++i) {
+    const auto& entry = inverted_file.GetEntry(i);
     if (image_ids.count(entry.image_id)) {
       matches->emplace_back(&entry);
     }
@@ -379,6 +496,8 @@ void InvertedIndex<kDescType, kDescDim, kEmbeddingDim>::Read(
     ifs->read(reinterpret_cast<char*>(&value), sizeof(float));
     normalization_constants_[image_id] = value;
   }
+
+  num_refreshed_images_ = normalization_constants_.size();
 }
 
 template <typename kDescType, int kDescDim, int kEmbeddingDim>
@@ -413,6 +532,132 @@ void InvertedIndex<kDescType, kDescDim, kEmbeddingDim>::Write(
   }
 }
 
+template <typename kDescType, int kDescDim, int kEmbeddingDim>
+void InvertedIndex<kDescType, kDescDim, kEmbeddingDim>::ReadMapped(
+    const uint8_t* data, const size_t num_bytes) {
+  CHECK_NOTNULL(data);
+  CHECK_EQ(reinterpret_cast<uintptr_t>(data) % kMappedAlignment, 0);
+
+  const uint8_t* ptr = data;
+  auto ReadValue = [&ptr](void* value, const size_t num_value_bytes) {
+    std::memcpy(value, ptr, num_value_bytes);
+    ptr += num_value_bytes;
+  };
+
+  int32_t num_words = 0;
+  int32_t N_t = 0;
+  int32_t desc_dim = 0;
+  int32_t num_images = 0;
+  int32_t num_refreshed_images = 0;
+  ReadValue(&num_words, sizeof(int32_t));
+  ReadValue(&N_t, sizeof(int32_t));
+  ReadValue(&desc_dim, sizeof(int32_t));
+  ReadValue(&num_images, sizeof(int32_t));
+  ReadValue(&num_refreshed_images, sizeof(int32_t));
+  CHECK_GT(num_words, 0);
+  CHECK_EQ(N_t, kEmbeddingDim)
+      << "The length of the binary strings should be " << kEmbeddingDim
+      << " but is " << N_t << ". The indices are not compatible!";
+  CHECK_EQ(desc_dim, kDescDim);
+  CHECK_GE(num_images, 0);
+  CHECK_GE(num_refreshed_images, 0);
+
+  // Only the headers of the inverted files are read, their entries are
+  // referenced in the mapped data.
+  Initialize(num_words);
+  CHECK_LE(MappedHeaderNumBytes(num_images), num_bytes);
+
+  for (int i = 0; i < kEmbeddingDim; ++i) {
+    for (int j = 0; j < kDescDim; ++j) {
+      ReadValue(&proj_matrix_(i, j), sizeof(float));
+    }
+  }
+
+  normalization_constants_.clear();
+  normalization_constants_.reserve(num_images);
+  for (int32_t i = 0; i < num_images; ++i) {
+    int32_t image_id;
+    float value;
+    ReadValue(&image_id, sizeof(int32_t));
+    ReadValue(&value, sizeof(float));
+    normalization_constants_[image_id] = value;
+  }
+
+  num_refreshed_images_ = num_refreshed_images;
+
+  for (auto& inverted_file : inverted_files_) {
+    inverted_file.ReadMapped(ptr, data);
+    ptr += InvertedFile<kEmbeddingDim>::kMappedHeaderNumBytes;
+  }
+}
+
+template <typename kDescType, int kDescDim, int kEmbeddingDim>
+void InvertedIndex<kDescType, kDescDim, kEmbeddingDim>::WriteMapped(
+    std::ostream* ofs) const {
+  const int32_t num_words = static_cast<int32_t>(NumVisualWords());
+  CHECK_GT(num_words, 0);
+  const int32_t N_t = static_cast<int32_t>(kEmbeddingDim);
+  const int32_t desc_dim = static_cast<int32_t>(kDescDim);
+  const int32_t num_images = normalization_constants_.size();
+  const int32_t num_refreshed_images = num_refreshed_images_;
+  ofs->write(reinterpret_cast<const char*>(&num_words), sizeof(int32_t));
+  ofs->write(reinterpret_cast<const char*>(&N_t), sizeof(int32_t));
+  ofs->write(reinterpret_cast<const char*>(&desc_dim), sizeof(int32_t));
+  ofs->write(reinterpret_cast<const char*>(&num_images), sizeof(int32_t));
+  ofs->write(reinterpret_cast<const char*>(&num_refreshed_images),
+             sizeof(int32_t));
+
+  for (int i = 0; i < kEmbeddingDim; ++i) {
+    for (int j = 0; j < kDescDim; ++j) {
+      ofs->write(reinterpret_cast<const char*>(&proj_matrix_(i, j)),
+                 sizeof(float));
+    }
+  }
+
+  for (const auto& constant : normalization_constants_) {
+    const int32_t image_id = constant.first;
+    ofs->write(reinterpret_cast<const char*>(&image_id), sizeof(int32_t));
+    ofs->write(reinterpret_cast<const char*>(&constant.second), sizeof(float));
+  }
+
+  // The entries of all inverted files are stored contiguously after the
+  // headers, starting at the next aligned offset.
+  const size_t header_num_bytes = MappedHeaderNumBytes(num_images);
+  const size_t entries_offset =
+      (header_num_bytes + kMappedAlignment - 1) / kMappedAlignment *
+      kMappedAlignment;
+
+  uint64_t inverted_file_entries_offset = entries_offset;
+  for (const auto& inverted_file : inverted_files_) {
+    inverted_file.WriteMappedHeader(inverted_file_entries_offset, ofs);
+    inverted_file_entries_offset +=
+        inverted_file.NumEntries() * EntryType::kNumBytes;
+  }
+
+  const std::vector<char> padding(entries_offset - header_num_bytes, 0);
+  ofs->write(padding.data(), padding.size());
+
+  for (const auto& inverted_file : inverted_files_) {
+    inverted_file.WriteMappedEntries(ofs);
+  }
+}
+
+template <typename kDescType, int kDescDim, int kEmbeddingDim>
+size_t InvertedIndex<kDescType, kDescDim, kEmbeddingDim>::MappedHeaderNumBytes(
+    const size_t num_images) const {
+  return 5 * sizeof(int32_t) + kEmbeddingDim * kDescDim * sizeof(float) +
+         num_images * (sizeof(int32_t) + sizeof(float)) +
+         NumVisualWords() * InvertedFile<kEmbeddingDim>::kMappedHeaderNumBytes;
+}
+
+template <typename kDescType, int kDescDim, int kEmbeddingDim>
+void InvertedIndex<kDescType, kDescDim, kEmbeddingDim>::GetNormalizedImageIds(
+    std::unordered_set<int>* image_ids) const {
+  for (const auto& constant : normalization_constants_) {
+    image_ids->insert(constant.first);
+  }
+}
+
 template <typename kDescType, int kDescDim, int kEmbeddingDim>
 void InvertedIndex<kDescType, kDescDim,
                    kEmbeddingDim>::ComputeWeightsAndNormalizationConstants() {
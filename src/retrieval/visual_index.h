@@ -32,6 +32,10 @@
 #ifndef COLMAP_SRC_RETRIEVAL_VISUAL_INDEX_H_
 #define COLMAP_SRC_RETRIEVAL_VISUAL_INDEX_H_
 
+#include <cstdio>
+#include <cstring>
+#include <memory>
+
 #include <boost/heap/fibonacci_heap.hpp>
 #include <Eigen/Core>
 
@@ -43,7 +47,9 @@
 #include "util/alignment.h"
 #include "util/endian.h"
 #include "util/logging.h"
+#include "util/mapped_file.h"
 #include "util/math.h"
+#include "util/threading.h"
 
 namespace colmap {
 namespace retrieval {
@@ -118,7 +124,6 @@ class VisualIndex {
   };
 
   VisualIndex();
-  ~VisualIndex();
 
   size_t NumVisualWords() const;
 
@@ -138,19 +143,51 @@ class VisualIndex {
              const DescType& descriptors,
              std::vector<ImageScore>* image_scores) const;
 
+  // Query for most similar images of multiple query images at once. The visual
+  // words of all query images are assigned in a single nearest neighbor search
+  // and the images are then scored in parallel. The results are identical to
+  // calling `Query` for each image separately.
+  void QueryBatch(const QueryOptions& options,
+                  const std::vector<DescType>& descriptors,
+                  std::vector<std::vector<ImageScore>>* image_scores) const;
+
+  // Query for most similar images of multiple query images at once.
+  void QueryBatch(const QueryOptions& options,
+                  const std::vector<GeomType>& geometries,
+                  const std::vector<DescType>& descriptors,
+                  std::vector<std::vector<ImageScore>>* image_scores) const;
+
   // Prepare the index after adding images and before querying.
   void Prepare();
 
+  // Prepare the index after adding images to a previously prepared index. The
+  // cost only depends on the visual words of the added images. The weights of
+  // the other visual words and the normalization of the previously indexed
+  // images are refreshed lazily, once the number of indexed images grew by
+  // more than the given ratio since the last full preparation.
+  void PrepareIncremental(const double max_num_images_growth = 0.1);
+
   // Build a visual index from a set of training descriptors by quantizing the
   // descriptor space into visual words and compute their Hamming embedding.
   void Build(const BuildOptions& options, const DescType& descriptors);
 
   // Read and write the visual index. This can be done for an index with and
-  // without indexed images.
+  // without indexed images. Indices are written in a page-aligned format that
+  // is memory-mapped on reading, so that the visual words and the inverted
+  // file entries are only loaded on demand and shared between processes.
+  // Indices in the previous stream format can still be read.
   void Read(const std::string& path);
   void Write(const std::string& path);
 
  private:
+  // The magic number and version of the memory-mapped file format.
+  static const char kMappedMagic[8];
+  static const uint32_t kMappedVersion = 1;
+
+  // Read the visual index in the memory-mapped or stream format.
+  void ReadMapped(const std::string& path);
+  void ReadStream(const std::string& path);
+
   // Quantize the descriptor space into visual words.
   void Quantize(const BuildOptions& options, const DescType& descriptors);
 
@@ -161,6 +198,18 @@ class VisualIndex {
                            std::vector<ImageScore>* image_scores,
                            Eigen::MatrixXi* word_ids) const;
 
+  // Score the images in the inverted index and keep the top-ranked images.
+  void ScoreImages(const QueryOptions& options, const DescType& descriptors,
+                   const Eigen::MatrixXi& word_ids,
+                   std::vector<ImageScore>* image_scores,
+                   typename InvertedIndexType::QueryBuffer* buffer) const;
+
+  // Re-rank the top-ranked images using spatial verification.
+  void VerifyImages(const QueryOptions& options, const GeomType& geometries,
+                    const DescType& descriptors,
+                    const Eigen::MatrixXi& word_ids,
+                    std::vector<ImageScore>* image_scores) const;
+
   // Find the nearest neighbor visual words for the given descriptors.
   Eigen::MatrixXi FindWordIds(const DescType& descriptors,
                               const int num_neighbors, const int num_checks,
@@ -169,8 +218,14 @@ class VisualIndex {
   // The search structure on the quantized descriptor space.
   flann::AutotunedIndex<flann::L2<kDescType>> visual_word_index_;
 
-  // The centroids of the visual words.
+  // The centroids of the visual words. The matrix either references the data
+  // in visual_words_data_ or in the memory-mapped file.
   flann::Matrix<kDescType> visual_words_;
+  std::vector<kDescType> visual_words_data_;
+
+  // The memory-mapped index file, which is referenced by the visual words and
+  // the inverted index, if the index was read in the memory-mapped format.
+  std::shared_ptr<MappedFile> mapped_file_;
 
   // The inverted index of the database.
   InvertedIndexType inverted_index_;
@@ -187,15 +242,15 @@ class VisualIndex {
 ////////////////////////////////////////////////////////////////////////////////
 
 template <typename kDescType, int kDescDim, int kEmbeddingDim>
-VisualIndex<kDescType, kDescDim, kEmbeddingDim>::VisualIndex()
-    : prepared_(false) {}
+const char VisualIndex<kDescType, kDescDim, kEmbeddingDim>::kMappedMagic[8] = {
+    'C', 'O', 'L', 'M', 'A', 'P', 'V', 'I'};
 
 template <typename kDescType, int kDescDim, int kEmbeddingDim>
-VisualIndex<kDescType, kDescDim, kEmbeddingDim>::~VisualIndex() {
-  if (visual_words_.ptr() != nullptr) {
-    delete[] visual_words_.ptr();
-  }
-}
+const uint32_t VisualIndex<kDescType, kDescDim, kEmbeddingDim>::kMappedVersion;
+
+template <typename kDescType, int kDescDim, int kEmbeddingDim>
+VisualIndex<kDescType, kDescDim, kEmbeddingDim>::VisualIndex()
+    : prepared_(false) {}
 
 template <typename kDescType, int kDescDim, int kEmbeddingDim>
 size_t VisualIndex<kDescType, kDescDim, kEmbeddingDim>::NumVisualWords() const {
@@ -268,6 +323,88 @@ void VisualIndex<kDescType, kDescDim, kEmbeddingDim>::Query(
     return;
   }
 
+  VerifyImages(options, geometries, descriptors, word_ids, image_scores);
+}
+
+template <typename kDescType, int kDescDim, int kEmbeddingDim>
+void VisualIndex<kDescType, kDescDim, kEmbeddingDim>::QueryBatch(
+    const QueryOptions& options, const std::vector<DescType>& descriptors,
+    std::vector<std::vector<ImageScore>>* image_scores) const {
+  const std::vector<GeomType> geometries;
+  QueryBatch(options, geometries, descriptors, image_scores);
+}
+
+template <typename kDescType, int kDescDim, int kEmbeddingDim>
+void VisualIndex<kDescType, kDescDim, kEmbeddingDim>::QueryBatch(
+    const QueryOptions& options, const std::vector<GeomType>& geometries,
+    const std::vector<DescType>& descriptors,
+    std::vector<std::vector<ImageScore>>* image_scores) const {
+  CHECK(prepared_);
+
+  const bool verify = options.num_images_after_verification > 0;
+  if (verify) {
+    CHECK_EQ(geometries.size(), descriptors.size());
+  }
+
+  image_scores->clear();
+  image_scores->resize(descriptors.size());
+
+  // Stack the descriptors of all query images to assign their visual words
+  // with a single nearest neighbor search.
+  std::vector<typename DescType::Index> row_offsets(descriptors.size() + 1, 0);
+  for (size_t i = 0; i < descriptors.size(); ++i) {
+    row_offsets[i + 1] = row_offsets[i] + descriptors[i].rows();
+  }
+
+  if (row_offsets.back() == 0) {
+    return;
+  }
+
+  DescType all_descriptors(row_offsets.back(), kDescDim);
+  for (size_t i = 0; i < descriptors.size(); ++i) {
+    all_descriptors.middleRows(row_offsets[i], descriptors[i].rows()) =
+        descriptors[i];
+  }
+
+  const Eigen::MatrixXi all_word_ids =
+      FindWordIds(all_descriptors, options.num_neighbors, options.num_checks,
+                  options.num_threads);
+
+  // Score and verify the query images in parallel. Every worker reuses its own
+  // query buffer across the images it processes.
+  ThreadPool thread_pool(std::min<int>(
+      GetEffectiveNumThreads(options.num_threads), descriptors.size()));
+  std::vector<typename InvertedIndexType::QueryBuffer> buffers(
+      thread_pool.NumThreads());
+
+  auto QueryFunc = [&](const size_t i) {
+    if (descriptors[i].rows() == 0) {
+      return;
+    }
+
+    const Eigen::MatrixXi word_ids =
+        all_word_ids.middleRows(row_offsets[i], descriptors[i].rows());
+    auto& buffer = buffers.at(thread_pool.GetThreadIndex());
+    ScoreImages(options, descriptors[i], word_ids, &(*image_scores)[i],
+                &buffer);
+    if (verify) {
+      VerifyImages(options, geometries[i], descriptors[i], word_ids,
+                   &(*image_scores)[i]);
+    }
+  };
+
+  for (size_t i = 0; i < descriptors.size(); ++i) {
+    thread_pool.AddTask(QueryFunc, i);
+  }
+
+  thread_pool.Wait();
+}
+
+template <typename kDescType, int kDescDim, int kEmbeddingDim>
+void VisualIndex<kDescType, kDescDim, kEmbeddingDim>::VerifyImages(
+    const QueryOptions& options, const GeomType& geometries,
+    const DescType& descriptors, const Eigen::MatrixXi& word_ids,
+    std::vector<ImageScore>* image_scores) const {
   CHECK_EQ(descriptors.rows(), geometries.size());
 
   // Extract top-ranked images to verify.
@@ -503,10 +640,25 @@ void VisualIndex<kDescType, kDescDim, kEmbeddingDim>::Query(
 
 template <typename kDescType, int kDescDim, int kEmbeddingDim>
 void VisualIndex<kDescType, kDescDim, kEmbeddingDim>::Prepare() {
+  // Avoid finalizing an unchanged index, which would page in all inverted file
+  // entries of a memory-mapped index.
+  if (prepared_) {
+    return;
+  }
   inverted_index_.Finalize();
   prepared_ = true;
 }
 
+template <typename kDescType, int kDescDim, int kEmbeddingDim>
+void VisualIndex<kDescType, kDescDim, kEmbeddingDim>::PrepareIncremental(
+    const double max_num_images_growth) {
+  if (prepared_) {
+    return;
+  }
+  inverted_index_.FinalizeIncremental(max_num_images_growth);
+  prepared_ = true;
+}
+
 template <typename kDescType, int kDescDim, int kEmbeddingDim>
 void VisualIndex<kDescType, kDescDim, kEmbeddingDim>::Build(
     const BuildOptions& options, const DescType& descriptors) {
@@ -524,6 +676,9 @@ void VisualIndex<kDescType, kDescDim, kEmbeddingDim>::Build(
   // Initialize a new inverted index.
   inverted_index_ = InvertedIndexType();
   inverted_index_.Initialize(NumVisualWords());
+  image_ids_.clear();
+  prepared_ = false;
+  mapped_file_.reset();
 
   // Generate descriptor projection matrix.
   inverted_index_.GenerateHammingEmbeddingProjection();
@@ -538,24 +693,129 @@ void VisualIndex<kDescType, kDescDim, kEmbeddingDim>::Build(
 template <typename kDescType, int kDescDim, int kEmbeddingDim>
 void VisualIndex<kDescType, kDescDim, kEmbeddingDim>::Read(
     const std::string& path) {
+  char magic[sizeof(kMappedMagic)] = {0};
+  {
+    std::ifstream file(path, std::ios::binary);
+    CHECK(file.is_open()) << path;
+    file.read(magic, sizeof(magic));
+  }
+
+  if (std::memcmp(magic, kMappedMagic, sizeof(kMappedMagic)) == 0) {
+    ReadMapped(path);
+  } else {
+    ReadStream(path);
+  }
+}
+
+template <typename kDescType, int kDescDim, int kEmbeddingDim>
+void VisualIndex<kDescType, kDescDim, kEmbeddingDim>::ReadMapped(
+    const std::string& path) {
+  std::shared_ptr<MappedFile> mapped_file =
+      std::make_shared<MappedFile>(path);
+  const uint8_t* data = mapped_file->Data();
+
+  const size_t kHeaderNumBytes =
+      sizeof(kMappedMagic) + 4 * sizeof(uint32_t) + 6 * sizeof(uint64_t) +
+      sizeof(uint8_t);
+  CHECK_GE(mapped_file->NumBytes(), kHeaderNumBytes) << path;
+
+  const uint8_t* ptr = data + sizeof(kMappedMagic);
+  auto ReadValue = [&ptr](void* value, const size_t num_bytes) {
+    std::memcpy(value, ptr, num_bytes);
+    ptr += num_bytes;
+  };
+
+  uint32_t version = 0;
+  uint32_t desc_type_size = 0;
+  uint32_t desc_dim = 0;
+  uint32_t embedding_dim = 0;
+  ReadValue(&version, sizeof(uint32_t));
+  ReadValue(&desc_type_size, sizeof(uint32_t));
+  ReadValue(&desc_dim, sizeof(uint32_t));
+  ReadValue(&embedding_dim, sizeof(uint32_t));
+  CHECK_EQ(version, kMappedVersion) << path;
+  CHECK_EQ(desc_type_size, sizeof(kDescType)) << path;
+  CHECK_EQ(desc_dim, kDescDim) << path;
+  CHECK_EQ(embedding_dim, kEmbeddingDim) << path;
+
+  uint64_t num_visual_words = 0;
+  uint64_t visual_words_offset = 0;
+  uint64_t flann_index_offset = 0;
+  uint64_t flann_index_num_bytes = 0;
+  uint64_t inverted_index_offset = 0;
+  uint64_t inverted_index_num_bytes = 0;
+  uint8_t prepared = 0;
+  ReadValue(&num_visual_words, sizeof(uint64_t));
+  ReadValue(&visual_words_offset, sizeof(uint64_t));
+  ReadValue(&flann_index_offset, sizeof(uint64_t));
+  ReadValue(&flann_index_num_bytes, sizeof(uint64_t));
+  ReadValue(&inverted_index_offset, sizeof(uint64_t));
+  ReadValue(&inverted_index_num_bytes, sizeof(uint64_t));
+  ReadValue(&prepared, sizeof(uint8_t));
+  CHECK_LE(inverted_index_offset + inverted_index_num_bytes,
+           mapped_file->NumBytes())
+      << path;
+
+  // Reference the visual words in the mapped file.
+
+  visual_words_data_.clear();
+  visual_words_ = flann::Matrix<kDescType>(
+      const_cast<kDescType*>(
+          reinterpret_cast<const kDescType*>(data + visual_words_offset)),
+      num_visual_words, kDescDim);
+
+  // Read the visual words search index.
+
+  visual_word_index_ =
+      flann::AutotunedIndex<flann::L2<kDescType>>(visual_words_);
+
+  {
+    FILE* fin = fopen(path.c_str(), "rb");
+    CHECK_NOTNULL(fin);
+    fseek(fin, flann_index_offset, SEEK_SET);
+    visual_word_index_.loadIndex(fin);
+    CHECK_EQ(ftell(fin), flann_index_offset + flann_index_num_bytes) << path;
+    fclose(fin);
+  }
+
+  // Reference the inverted index in the mapped file.
+
+  inverted_index_ = InvertedIndexType();
+  inverted_index_.ReadMapped(data + inverted_index_offset,
+                             inverted_index_num_bytes);
+
+  // Only a prepared index is guaranteed to have normalization constants for
+  // all indexed images. Otherwise, we must collect the image identifiers from
+  // all inverted file entries.
+  image_ids_.clear();
+  if (prepared) {
+    inverted_index_.GetNormalizedImageIds(&image_ids_);
+  } else {
+    inverted_index_.GetImageIds(&image_ids_);
+  }
+
+  prepared_ = prepared != 0;
+  mapped_file_ = mapped_file;
+}
+
+template <typename kDescType, int kDescDim, int kEmbeddingDim>
+void VisualIndex<kDescType, kDescDim, kEmbeddingDim>::ReadStream(
+    const std::string& path) {
   long int file_offset = 0;
 
   // Read the visual words.
 
   {
-    if (visual_words_.ptr() != nullptr) {
-      delete[] visual_words_.ptr();
-    }
-
     std::ifstream file(path, std::ios::binary);
     CHECK(file.is_open()) << path;
     const uint64_t rows = ReadBinaryLittleEndian<uint64_t>(&file);
     const uint64_t cols = ReadBinaryLittleEndian<uint64_t>(&file);
-    kDescType* visual_words_data = new kDescType[rows * cols];
+    visual_words_data_.resize(rows * cols);
     for (size_t i = 0; i < rows * cols; ++i) {
-      visual_words_data[i] = ReadBinaryLittleEndian<kDescType>(&file);
+      visual_words_data_[i] = ReadBinaryLittleEndian<kDescType>(&file);
     }
-    visual_words_ = flann::Matrix<kDescType>(visual_words_data, rows, cols);
+    visual_words_ =
+        flann::Matrix<kDescType>(visual_words_data_.data(), rows, cols);
     file_offset = file.tellg();
   }
 
@@ -584,39 +844,109 @@ void VisualIndex<kDescType, kDescDim, kEmbeddingDim>::Read(
 
   image_ids_.clear();
   inverted_index_.GetImageIds(&image_ids_);
+
+  prepared_ = false;
+  mapped_file_.reset();
 }
 
 template <typename kDescType, int kDescDim, int kEmbeddingDim>
 void VisualIndex<kDescType, kDescDim, kEmbeddingDim>::Write(
     const std::string& path) {
-  // Write the visual words.
+  CHECK_NOTNULL(visual_words_.ptr());
+
+  // The index references the mapped file, which must not be truncated while
+  // writing. Instead, write a new file and replace the mapped file, which
+  // stays mapped until the index is destroyed or read again.
+  if (mapped_file_ != nullptr && mapped_file_->Path() == path) {
+    const std::string tmp_path = path + ".tmp";
+    Write(tmp_path);
+    CHECK_EQ(std::rename(tmp_path.c_str(), path.c_str()), 0) << path;
+    return;
+  }
+
+  CHECK_EQ(visual_words_.cols, kDescDim);
+
+  // Pads the file with zeros to the next aligned offset and returns it.
+  const size_t kAlignment = InvertedIndexType::kMappedAlignment;
+  auto PadToAlignment = [kAlignment](std::ostream* file) {
+    const uint64_t offset = file->tellp();
+    const uint64_t aligned_offset =
+        (offset + kAlignment - 1) / kAlignment * kAlignment;
+    const std::vector<char> padding(aligned_offset - offset, 0);
+    file->write(padding.data(), padding.size());
+    return aligned_offset;
+  };
 
+  // Reserve the header, which is written last, and write the visual words.
+
+  const uint64_t visual_words_offset = kAlignment;
   {
-    CHECK_NOTNULL(visual_words_.ptr());
     std::ofstream file(path, std::ios::binary);
     CHECK(file.is_open()) << path;
-    WriteBinaryLittleEndian<uint64_t>(&file, visual_words_.rows);
-    WriteBinaryLittleEndian<uint64_t>(&file, visual_words_.cols);
-    for (size_t i = 0; i < visual_words_.rows * visual_words_.cols; ++i) {
-      WriteBinaryLittleEndian<kDescType>(&file, visual_words_.ptr()[i]);
-    }
+    const std::vector<char> header(kAlignment, 0);
+    file.write(header.data(), header.size());
+    file.write(reinterpret_cast<const char*>(visual_words_.ptr()),
+               visual_words_.rows * visual_words_.cols * sizeof(kDescType));
+    PadToAlignment(&file);
   }
 
   // Write the visual words search index.
 
+  uint64_t flann_index_offset = 0;
+  uint64_t flann_index_num_bytes = 0;
   {
     FILE* fout = fopen(path.c_str(), "ab");
     CHECK_NOTNULL(fout);
+    fseek(fout, 0, SEEK_END);
+    flann_index_offset = ftell(fout);
     visual_word_index_.saveIndex(fout);
+    flann_index_num_bytes = ftell(fout) - flann_index_offset;
     fclose(fout);
   }
 
   // Write the inverted index.
 
+  uint64_t inverted_index_offset = 0;
+  uint64_t inverted_index_num_bytes = 0;
   {
     std::ofstream file(path, std::ios::binary | std::ios::app);
     CHECK(file.is_open()) << path;
-    inverted_index_.Write(&file);
+    file.seekp(0, std::ios::end);
+    inverted_index_offset = PadToAlignment(&file);
+    inverted_index_.WriteMapped(&file);
+    inverted_index_num_bytes =
+        static_cast<uint64_t>(file.tellp()) - inverted_index_offset;
+  }
+
+  // Write the header.
+
+  {
+    std::fstream file(path, std::ios::binary | std::ios::in | std::ios::out);
+    CHECK(file.is_open()) << path;
+    file.seekp(0, std::ios::beg);
+
+    auto WriteValue = [&file](const void* value, const size_t num_bytes) {
+      file.write(reinterpret_cast<const char*>(value), num_bytes);
+    };
+
+    const uint32_t version = kMappedVersion;
+    const uint32_t desc_type_size = sizeof(kDescType);
+    const uint32_t desc_dim = kDescDim;
+    const uint32_t embedding_dim = kEmbeddingDim;
+    const uint64_t num_visual_words = visual_words_.rows;
+    const uint8_t prepared = prepared_ ? 1 : 0;
+    WriteValue(kMappedMagic, sizeof(kMappedMagic));
+    WriteValue(&version, sizeof(uint32_t));
+    WriteValue(&desc_type_size, sizeof(uint32_t));
+    WriteValue(&desc_dim, sizeof(uint32_t));
+    WriteValue(&embedding_dim, sizeof(uint32_t));
+    WriteValue(&num_visual_words, sizeof(uint64_t));
+    WriteValue(&visual_words_offset, sizeof(uint64_t));
+    WriteValue(&flann_index_offset, sizeof(uint64_t));
+    WriteValue(&flann_index_num_bytes, sizeof(uint64_t));
+    WriteValue(&inverted_index_offset, sizeof(uint64_t));
+    WriteValue(&inverted_index_num_bytes, sizeof(uint64_t));
+    WriteValue(&prepared, sizeof(uint8_t));
   }
 }
 
@@ -647,21 +977,17 @@ void VisualIndex<kDescType, kDescDim, kEmbeddingDim>::Quantize(
   CHECK_LE(num_centers, options.num_visual_words);
 
   const size_t visual_word_data_size = num_centers * descriptors.cols();
-  kDescType* visual_words_data = new kDescType[visual_word_data_size];
+  visual_words_data_.resize(visual_word_data_size);
   for (size_t i = 0; i < visual_word_data_size; ++i) {
     if (std::is_integral<kDescType>::value) {
-      visual_words_data[i] = std::round(centers_data[i]);
+      visual_words_data_[i] = std::round(centers_data[i]);
     } else {
-      visual_words_data[i] = centers_data[i];
+      visual_words_data_[i] = centers_data[i];
     }
   }
 
-  if (visual_words_.ptr() != nullptr) {
-    delete[] visual_words_.ptr();
-  }
-
-  visual_words_ = flann::Matrix<kDescType>(visual_words_data, num_centers,
-                                           descriptors.cols());
+  visual_words_ = flann::Matrix<kDescType>(visual_words_data_.data(),
+                                           num_centers, descriptors.cols());
 }
 
 template <typename kDescType, int kDescDim, int kEmbeddingDim>
@@ -677,7 +1003,17 @@ void VisualIndex<kDescType, kDescDim, kEmbeddingDim>::QueryAndFindWordIds(
 
   *word_ids = FindWordIds(descriptors, options.num_neighbors,
                           options.num_checks, options.num_threads);
-  inverted_index_.Query(descriptors, *word_ids, image_scores);
+
+  typename InvertedIndexType::QueryBuffer buffer;
+  ScoreImages(options, descriptors, *word_ids, image_scores, &buffer);
+}
+
+template <typename kDescType, int kDescDim, int kEmbeddingDim>
+void VisualIndex<kDescType, kDescDim, kEmbeddingDim>::ScoreImages(
+    const QueryOptions& options, const DescType& descriptors,
+    const Eigen::MatrixXi& word_ids, std::vector<ImageScore>* image_scores,
+    typename InvertedIndexType::QueryBuffer* buffer) const {
+  inverted_index_.Query(descriptors, word_ids, image_scores, buffer);
 
   auto SortFunc = [](const ImageScore& score1, const ImageScore& score2) {
     return score1.score > score2.score;
@@ -101,6 +101,74 @@ void TestVocabTreeType() {
     BOOST_CHECK_EQUAL(image_scores[0].image_id, 1);
     BOOST_CHECK_EQUAL(image_scores[1].image_id, 2);
     BOOST_CHECK_GT(image_scores[0].score, image_scores[1].score);
+
+    std::vector<typename VisualIndexType::DescType> batch_descriptors = {
+        descriptors1, typename VisualIndexType::DescType(0, kDescDim),
+        descriptors2};
+    std::vector<std::vector<ImageScore>> batch_image_scores;
+    visual_index.QueryBatch(query_options, batch_descriptors,
+                            &batch_image_scores);
+    BOOST_CHECK_EQUAL(batch_image_scores.size(), 3);
+    BOOST_CHECK_EQUAL(batch_image_scores[1].size(), 0);
+    for (const size_t i : {0, 2}) {
+      visual_index.Query(query_options, batch_descriptors[i], &image_scores);
+      BOOST_CHECK_EQUAL(batch_image_scores[i].size(), image_scores.size());
+      for (size_t j = 0; j < image_scores.size(); ++j) {
+        BOOST_CHECK_EQUAL(batch_image_scores[i][j].image_id,
+                          image_scores[j].image_id);
+        BOOST_CHECK_CLOSE(batch_image_scores[i][j].score,
+                          image_scores[j].score, 1e-3);
+      }
+    }
+    BOOST_CHECK_EQUAL(batch_image_scores[0][0].image_id, 1);
+    BOOST_CHECK_EQUAL(batch_image_scores[2][0].image_id, 2);
+
+    const std::string path = "visual_index_test.bin";
+    visual_index.Write(path);
+
+    {
+      VisualIndexType read_visual_index;
+      read_visual_index.Read(path);
+      BOOST_CHECK_EQUAL(read_visual_index.NumVisualWords(), 100);
+      BOOST_CHECK(read_visual_index.ImageIndexed(1));
+      BOOST_CHECK(read_visual_index.ImageIndexed(2));
+      BOOST_CHECK(!read_visual_index.ImageIndexed(3));
+
+      query_options.max_num_images = -1;
+      visual_index.Query(query_options, descriptors1, &image_scores);
+      std::vector<ImageScore> read_image_scores;
+      read_visual_index.Query(query_options, descriptors1, &read_image_scores);
+      BOOST_CHECK_EQUAL(read_image_scores.size(), image_scores.size());
+      for (size_t i = 0; i < image_scores.size(); ++i) {
+        BOOST_CHECK_EQUAL(read_image_scores[i].image_id,
+                          image_scores[i].image_id);
+        BOOST_CHECK_EQUAL(read_image_scores[i].score, image_scores[i].score);
+      }
+
+      // Adding an image copies the affected entries out of the mapped file,
+      // which can then be overwritten.
+      typename VisualIndexType::GeomType keypoints3(50);
+      typename VisualIndexType::DescType descriptors3 =
+          VisualIndexType::DescType::Random(50, kDescDim);
+      read_visual_index.Add(index_options, 3, keypoints3, descriptors3);
+      read_visual_index.Prepare();
+      read_visual_index.Write(path);
+
+      read_visual_index.Query(query_options, descriptors3, &read_image_scores);
+      BOOST_CHECK_EQUAL(read_image_scores.size(), 3);
+      BOOST_CHECK_EQUAL(read_image_scores[0].image_id, 3);
+    }
+
+    {
+      VisualIndexType read_visual_index;
+      read_visual_index.Read(path);
+      BOOST_CHECK(read_visual_index.ImageIndexed(3));
+      read_visual_index.Query(query_options, descriptors1, &image_scores);
+      BOOST_CHECK_EQUAL(image_scores.size(), 3);
+      BOOST_CHECK_EQUAL(image_scores[0].image_id, 1);
+    }
+
+    std::remove(path.c_str());
   }
 }
 
@@ -112,3 +180,84 @@ BOOST_AUTO_TEST_CASE(TestVocabTree) {
   TestVocabTreeType<float, 32, 16>();
   TestVocabTreeType<double, 32, 16>();
 }
+
+BOOST_AUTO_TEST_CASE(TestPrepareIncremental) {
+  typedef VisualIndex<uint8_t, 32, 16> VisualIndexType;
+
+  SetPRNGSeed(0);
+
+  VisualIndexType::DescType descriptors =
+      VisualIndexType::DescType::Random(1000, 32);
+  VisualIndexType::BuildOptions build_options;
+  build_options.num_visual_words = 100;
+  build_options.branching = 10;
+
+  // Build the vocabulary only once, since the clustering is randomized.
+  const std::string path = "visual_index_incremental_test.bin";
+  VisualIndexType visual_index;
+  visual_index.Build(build_options, descriptors);
+  visual_index.Write(path);
+  VisualIndexType incremental_visual_index;
+  incremental_visual_index.Read(path);
+
+  VisualIndexType::IndexOptions index_options;
+  std::vector<VisualIndexType::DescType> image_descriptors;
+  for (int image_id = 0; image_id < 22; ++image_id) {
+    const VisualIndexType::GeomType keypoints(50);
+    image_descriptors.push_back(VisualIndexType::DescType::Random(50, 32));
+    visual_index.Add(index_options, image_id, keypoints,
+                     image_descriptors.back());
+    incremental_visual_index.Add(index_options, image_id, keypoints,
+                                 image_descriptors.back());
+    if (image_id == 19) {
+      incremental_visual_index.PrepareIncremental();
+    }
+  }
+
+  // The index grew by less than the allowed ratio, so only the new images are
+  // normalized and the weights of the other visual words are stale.
+  visual_index.Prepare();
+  incremental_visual_index.PrepareIncremental(0.1);
+
+  VisualIndexType::QueryOptions query_options;
+  std::vector<ImageScore> image_scores;
+  std::vector<ImageScore> incremental_image_scores;
+  for (const int image_id : {0, 20, 21}) {
+    visual_index.Query(query_options, image_descriptors[image_id],
+                       &image_scores);
+    incremental_visual_index.Query(query_options, image_descriptors[image_id],
+                                   &incremental_image_scores);
+    BOOST_CHECK_EQUAL(incremental_image_scores.size(), image_scores.size());
+    BOOST_CHECK_EQUAL(incremental_image_scores[0].image_id, image_id);
+    BOOST_CHECK_EQUAL(image_scores[0].image_id, image_id);
+  }
+
+  // Adding more images than the allowed ratio refreshes the full index.
+  for (int image_id = 22; image_id < 25; ++image_id) {
+    const VisualIndexType::GeomType keypoints(50);
+    image_descriptors.push_back(VisualIndexType::DescType::Random(50, 32));
+    visual_index.Add(index_options, image_id, keypoints,
+                     image_descriptors.back());
+    incremental_visual_index.Add(index_options, image_id, keypoints,
+                                 image_descriptors.back());
+  }
+
+  visual_index.Prepare();
+  incremental_visual_index.PrepareIncremental(0.1);
+
+  for (const int image_id : {0, 20, 24}) {
+    visual_index.Query(query_options, image_descriptors[image_id],
+                       &image_scores);
+    incremental_visual_index.Query(query_options, image_descriptors[image_id],
+                                   &incremental_image_scores);
+    BOOST_CHECK_EQUAL(incremental_image_scores.size(), image_scores.size());
+    for (size_t i = 0; i < image_scores.size(); ++i) {
+      BOOST_CHECK_EQUAL(incremental_image_scores[i].image_id,
+                        image_scores[i].image_id);
+      BOOST_CHECK_CLOSE(incremental_image_scores[i].score,
+                        image_scores[i].score, 1e-4);
+    }
+  }
+
+  std::remove(path.c_str());
+}
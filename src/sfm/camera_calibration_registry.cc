@@ -0,0 +1,129 @@
+// Copyright (c) 2018, ETH Zurich and UNC Chapel Hill.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//
+//     * Neither the name of ETH Zurich and UNC Chapel Hill nor the names of
+//       its contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Author: Johannes L. Schoenberger (jsch-at-demuc-dot-de)
+
+
+#include "sfm/camera_calibration_registry.h"
+
+#include <cmath>
+
+namespace colmap {
+
+  size_t CameraCalibrationRegistry::Update(
+    const Reconstruction& reconstruction) {
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    size_t num_updated = 0;
+    for (const auto& camera : reconstruction.Cameras()) {
+      const double range = CalibratedRange(camera.second);
+      if (range <= 0) {
+        continue;
+      }
+
+      const auto registered = cameras_.find(camera.first);
+      if (registered == cameras_.end()) {
+        cameras_.emplace(camera.first, camera.second);
+        num_updated += 1;
+      }
+      else if (range > CalibratedRange(registered->second)) {
+        registered->second = camera.second;
+        num_updated += 1;
+      }
+    }
+
+    return num_updated;
+  }
+
+  size_t CameraCalibrationRegistry::WarmStart(
+    Reconstruction* reconstruction,
+    std::unordered_set<camera_t>* camera_ids) const {
+    const bool kReplaceCalibrated = false;
+    return Apply(kReplaceCalibrated, reconstruction, camera_ids);
+  }
+
+  size_t CameraCalibrationRegistry::Reconcile(
+    Reconstruction* reconstruction,
+    std::unordered_set<camera_t>* camera_ids) const {
+    const bool kReplaceCalibrated = true;
+    return Apply(kReplaceCalibrated, reconstruction, camera_ids);
+  }
+
+  size_t CameraCalibrationRegistry::NumCameras() const {
+    std::unique_lock<std::mutex> lock(mutex_);
+    return cameras_.size();
+  }
+
+  double CameraCalibrationRegistry::CalibratedRange(const Camera& camera) {
+    if (camera.ModelId() != ImplicitDistortionModel::model_id ||
+      !camera.IsCalibrated()) {
+      return 0;
+    }
+    // The first half of the parameters after the principal point are the
+    // sorted incidence angles of the control points.
+    const int num_control_points =
+      (ImplicitDistortionModel::kNumParams - 2) / 2;
+    return std::abs(camera.Params(1 + num_control_points) - camera.Params(2));
+  }
+
+  size_t CameraCalibrationRegistry::Apply(const bool replace_calibrated,
+    Reconstruction* reconstruction,
+    std::unordered_set<camera_t>* camera_ids) const {
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    size_t num_applied = 0;
+    for (const auto& registered : cameras_) {
+      if (!reconstruction->ExistsCamera(registered.first)) {
+        continue;
+      }
+
+      Camera& camera = reconstruction->Camera(registered.first);
+      if (camera.ModelId() != ImplicitDistortionModel::model_id ||
+        camera.Width() != registered.second.Width() ||
+        camera.Height() != registered.second.Height()) {
+        continue;
+      }
+
+      const double range = CalibratedRange(camera);
+      if ((range > 0 && !replace_calibrated) ||
+        range >= CalibratedRange(registered.second)) {
+        continue;
+      }
+
+      camera = registered.second;
+      num_applied += 1;
+      if (camera_ids != nullptr) {
+        camera_ids->insert(registered.first);
+      }
+    }
+
+    return num_applied;
+  }
+
+}  // namespace colmap
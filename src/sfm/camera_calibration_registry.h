@@ -0,0 +1,91 @@
+// Copyright (c) 2018, ETH Zurich and UNC Chapel Hill.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//
+//     * Neither the name of ETH Zurich and UNC Chapel Hill nor the names of
+//       its contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Author: Johannes L. Schoenberger (jsch-at-demuc-dot-de)
+
+
+#ifndef COLMAP_SRC_SFM_CAMERA_CALIBRATION_REGISTRY_H_
+#define COLMAP_SRC_SFM_CAMERA_CALIBRATION_REGISTRY_H_
+
+#include <mutex>
+#include <unordered_set>
+
+#include "base/camera.h"
+#include "base/reconstruction.h"
+#include "util/alignment.h"
+
+namespace colmap {
+
+  // Thread-safe registry of the camera calibrations estimated by multiple
+  // concurrent reconstructions of the same scene, e.g., the clusters of the
+  // hierarchical mapper. Only cameras with the IMPLICIT_DISTORTION model are
+  // shared, since all other models are calibrated from the start. Among the
+  // calibrations of the same camera, the one covering the largest calibrated
+  // range of incidence angles is kept.
+  class CameraCalibrationRegistry {
+  public:
+    // Publish the calibrated cameras of the reconstruction. Return the number
+    // of cameras whose registered calibration was updated.
+    size_t Update(const Reconstruction& reconstruction);
+
+    // Initialize the uncalibrated cameras of the reconstruction with the
+    // registered calibrations. Return the number of initialized cameras and
+    // optionally their identifiers.
+    size_t WarmStart(Reconstruction* reconstruction,
+      std::unordered_set<camera_t>* camera_ids = nullptr) const;
+
+    // Replace the cameras of the reconstruction with the registered
+    // calibrations if they cover a larger calibrated range, such that all
+    // reconstructions use the best available calibration of each camera.
+    // The poses and points of the reconstruction are not adjusted to the
+    // replaced calibrations. Return the number of replaced cameras and
+    // optionally their identifiers.
+    size_t Reconcile(Reconstruction* reconstruction,
+      std::unordered_set<camera_t>* camera_ids = nullptr) const;
+
+    // The number of cameras with a registered calibration.
+    size_t NumCameras() const;
+
+    // The calibrated range of incidence angles of an IMPLICIT_DISTORTION
+    // camera in radians, i.e., the span of the angles of its spline control
+    // points, zero if the camera is uncalibrated.
+    static double CalibratedRange(const Camera& camera);
+
+  private:
+    size_t Apply(const bool replace_calibrated,
+      Reconstruction* reconstruction,
+      std::unordered_set<camera_t>* camera_ids) const;
+
+    mutable std::mutex mutex_;
+    EIGEN_STL_UMAP(camera_t, Camera) cameras_;
+  };
+
+}  // namespace colmap
+
+#endif  // COLMAP_SRC_SFM_CAMERA_CALIBRATION_REGISTRY_H_
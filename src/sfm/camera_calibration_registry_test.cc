@@ -0,0 +1,163 @@
+// Copyright (c) 2018, ETH Zurich and UNC Chapel Hill.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//
+//     * Neither the name of ETH Zurich and UNC Chapel Hill nor the names of
+//       its contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Author: Johannes L. Schoenberger (jsch-at-demuc-dot-de)
+
+#define TEST_NAME "sfm/camera_calibration_registry"
+#include "util/testing.h"
+
+#include "sfm/camera_calibration_registry.h"
+
+using namespace colmap;
+
+namespace {
+
+// Create an IMPLICIT_DISTORTION camera, which is calibrated over the incidence
+// angles [0, range] if the range is positive.
+Camera CreateImplicitDistortionCamera(const camera_t camera_id,
+                                      const double range) {
+  Camera camera;
+  camera.SetCameraId(camera_id);
+  camera.SetModelId(ImplicitDistortionModel::model_id);
+  camera.SetWidth(100);
+  camera.SetHeight(100);
+  const int num_control_points = (ImplicitDistortionModel::kNumParams - 2) / 2;
+  for (int i = 0; i < num_control_points; ++i) {
+    camera.Params(2 + i) = range * i / (num_control_points - 1);
+    camera.Params(2 + num_control_points + i) = 5.0 * i;
+  }
+  camera.SetCalibrated(range > 0);
+  return camera;
+}
+
+}  // namespace
+
+BOOST_AUTO_TEST_CASE(TestCalibratedRange) {
+  BOOST_CHECK_EQUAL(CameraCalibrationRegistry::CalibratedRange(
+                        CreateImplicitDistortionCamera(1, 0)),
+                    0);
+  BOOST_CHECK_EQUAL(CameraCalibrationRegistry::CalibratedRange(
+                        CreateImplicitDistortionCamera(1, 2)),
+                    2);
+  Camera camera;
+  camera.InitializeWithName("SIMPLE_RADIAL", 1, 100, 100);
+  BOOST_CHECK_EQUAL(CameraCalibrationRegistry::CalibratedRange(camera), 0);
+}
+
+BOOST_AUTO_TEST_CASE(TestUpdate) {
+  CameraCalibrationRegistry registry;
+  BOOST_CHECK_EQUAL(registry.NumCameras(), 0);
+
+  Reconstruction reconstruction1;
+  reconstruction1.AddCamera(CreateImplicitDistortionCamera(1, 1));
+  reconstruction1.AddCamera(CreateImplicitDistortionCamera(2, 0));
+  BOOST_CHECK_EQUAL(registry.Update(reconstruction1), 1);
+  BOOST_CHECK_EQUAL(registry.NumCameras(), 1);
+
+  // The wider range replaces the registered calibration.
+  Reconstruction reconstruction2;
+  reconstruction2.AddCamera(CreateImplicitDistortionCamera(1, 3));
+  BOOST_CHECK_EQUAL(registry.Update(reconstruction2), 1);
+  BOOST_CHECK_EQUAL(registry.NumCameras(), 1);
+
+  // The narrower range does not replace the registered calibration.
+  BOOST_CHECK_EQUAL(registry.Update(reconstruction1), 0);
+  BOOST_CHECK_EQUAL(registry.NumCameras(), 1);
+
+  Reconstruction reconstruction3;
+  reconstruction3.AddCamera(CreateImplicitDistortionCamera(1, 2));
+  BOOST_CHECK_EQUAL(registry.Reconcile(&reconstruction3), 1);
+  BOOST_CHECK_EQUAL(CameraCalibrationRegistry::CalibratedRange(
+                        reconstruction3.Camera(1)),
+                    3);
+}
+
+BOOST_AUTO_TEST_CASE(TestWarmStart) {
+  CameraCalibrationRegistry registry;
+
+  Reconstruction reference;
+  reference.AddCamera(CreateImplicitDistortionCamera(1, 3));
+  reference.AddCamera(CreateImplicitDistortionCamera(2, 3));
+  BOOST_CHECK_EQUAL(registry.Update(reference), 2);
+
+  // Only the uncalibrated camera is initialized, whereas the calibrated camera
+  // keeps its narrower calibration and the unregistered camera stays
+  // uncalibrated.
+  Reconstruction reconstruction;
+  reconstruction.AddCamera(CreateImplicitDistortionCamera(1, 0));
+  reconstruction.AddCamera(CreateImplicitDistortionCamera(2, 1));
+  reconstruction.AddCamera(CreateImplicitDistortionCamera(3, 0));
+  std::unordered_set<camera_t> camera_ids;
+  BOOST_CHECK_EQUAL(registry.WarmStart(&reconstruction, &camera_ids), 1);
+  BOOST_CHECK_EQUAL(camera_ids.size(), 1);
+  BOOST_CHECK_EQUAL(camera_ids.count(1), 1);
+  BOOST_CHECK(reconstruction.Camera(1).IsCalibrated());
+  BOOST_CHECK_EQUAL(
+      CameraCalibrationRegistry::CalibratedRange(reconstruction.Camera(1)), 3);
+  BOOST_CHECK_EQUAL(
+      CameraCalibrationRegistry::CalibratedRange(reconstruction.Camera(2)), 1);
+  BOOST_CHECK(!reconstruction.Camera(3).IsCalibrated());
+
+  // Cameras of a different size are not initialized.
+  Reconstruction other_reconstruction;
+  Camera other_camera = CreateImplicitDistortionCamera(1, 0);
+  other_camera.SetWidth(200);
+  other_reconstruction.AddCamera(other_camera);
+  BOOST_CHECK_EQUAL(registry.WarmStart(&other_reconstruction), 0);
+  BOOST_CHECK(!other_reconstruction.Camera(1).IsCalibrated());
+}
+
+BOOST_AUTO_TEST_CASE(TestReconcile) {
+  CameraCalibrationRegistry registry;
+
+  Reconstruction reference;
+  reference.AddCamera(CreateImplicitDistortionCamera(1, 3));
+  reference.AddCamera(CreateImplicitDistortionCamera(2, 3));
+  BOOST_CHECK_EQUAL(registry.Update(reference), 2);
+
+  // Narrower and missing calibrations are replaced, whereas wider
+  // calibrations are kept.
+  Reconstruction reconstruction;
+  reconstruction.AddCamera(CreateImplicitDistortionCamera(1, 1));
+  reconstruction.AddCamera(CreateImplicitDistortionCamera(2, 4));
+  reconstruction.AddCamera(CreateImplicitDistortionCamera(3, 1));
+  std::unordered_set<camera_t> camera_ids;
+  BOOST_CHECK_EQUAL(registry.Reconcile(&reconstruction, &camera_ids), 1);
+  BOOST_CHECK_EQUAL(camera_ids.size(), 1);
+  BOOST_CHECK_EQUAL(camera_ids.count(1), 1);
+  BOOST_CHECK_EQUAL(
+      CameraCalibrationRegistry::CalibratedRange(reconstruction.Camera(1)), 3);
+  BOOST_CHECK_EQUAL(
+      CameraCalibrationRegistry::CalibratedRange(reconstruction.Camera(2)), 4);
+  BOOST_CHECK_EQUAL(
+      CameraCalibrationRegistry::CalibratedRange(reconstruction.Camera(3)), 1);
+
+  // Reconciling again has no effect.
+  BOOST_CHECK_EQUAL(registry.Reconcile(&reconstruction), 0);
+}
@@ -47,22 +47,6 @@
 namespace colmap {
   namespace {
 
-    void SortAndAppendNextImages(std::vector<std::pair<image_t, float>> image_ranks,
-      std::vector<image_t>* sorted_images_ids) {
-      std::sort(image_ranks.begin(), image_ranks.end(),
-        [](const std::pair<image_t, float>& image1,
-          const std::pair<image_t, float>& image2) {
-            return image1.second > image2.second;
-        });
-
-      sorted_images_ids->reserve(sorted_images_ids->size() + image_ranks.size());
-      for (const auto& image : image_ranks) {
-        sorted_images_ids->push_back(image.first);
-      }
-
-      image_ranks.clear();
-    }
-
     float RankNextImageMaxVisiblePointsNum(const Image& image) {
       return static_cast<float>(image.NumVisiblePoints3D());
     }
@@ -106,7 +90,8 @@ namespace colmap {
     triangulator_(nullptr),
     num_total_reg_images_(0),
     num_shared_reg_images_(0),
-    prev_init_image_pair_id_(kInvalidImagePairId) {
+    prev_init_image_pair_id_(kInvalidImagePairId),
+    next_image_index_valid_(false) {
   }
 
   void IncrementalMapper::BeginReconstruction(Reconstruction* reconstruction) {
@@ -132,6 +117,10 @@ namespace colmap {
 
     filtered_images_.clear();
     num_reg_trials_.clear();
+
+    next_image_index_.Clear();
+    next_image_index_valid_ = false;
+    next_image_ids_to_update_.clear();
   }
 
   void IncrementalMapper::EndReconstruction(const bool discard) {
@@ -240,64 +229,91 @@ namespace colmap {
     return init_tuples->size() > 0;
   }
 
-  std::vector<image_t> IncrementalMapper::FindNextImages(const Options& options) {
+  std::vector<image_t> IncrementalMapper::FindNextImages(const Options& options,
+    const size_t max_num_images) {
     CHECK_NOTNULL(reconstruction_);
     CHECK(options.Check());
 
-    std::function<float(const Image&)> rank_image_func;
-    switch (options.image_selection_method) {
-    case Options::ImageSelectionMethod::MAX_VISIBLE_POINTS_NUM:
-      rank_image_func = RankNextImageMaxVisiblePointsNum;
-      break;
-    case Options::ImageSelectionMethod::MAX_VISIBLE_POINTS_RATIO:
-      rank_image_func = RankNextImageMaxVisiblePointsRatio;
-      break;
-    case Options::ImageSelectionMethod::MIN_UNCERTAINTY:
-      rank_image_func = RankNextImageMinUncertainty;
-      break;
+    // Rebuild the index if it was not yet built for this reconstruction or if
+    // the candidates would be ranked or selected differently.
+    if (!next_image_index_valid_ ||
+      next_image_index_method_ != options.image_selection_method ||
+      next_image_index_min_num_inliers_ != options.abs_pose_min_num_inliers ||
+      next_image_index_max_reg_trials_ != options.max_reg_trials) {
+      next_image_index_.Clear();
+      for (const auto& image : reconstruction_->Images()) {
+        UpdateNextImageCandidate(options, image.first);
+      }
+      next_image_index_valid_ = true;
+      next_image_index_method_ = options.image_selection_method;
+      next_image_index_min_num_inliers_ = options.abs_pose_min_num_inliers;
+      next_image_index_max_reg_trials_ = options.max_reg_trials;
+    }
+    else {
+      for (const image_t image_id :
+        reconstruction_->ImagesWithChangedVisibility()) {
+        UpdateNextImageCandidate(options, image_id);
+      }
+      for (const image_t image_id : next_image_ids_to_update_) {
+        UpdateNextImageCandidate(options, image_id);
+      }
     }
 
-    std::vector<std::pair<image_t, float>> image_ranks;
-    std::vector<std::pair<image_t, float>> other_image_ranks;
+    reconstruction_->ClearImagesWithChangedVisibility();
+    next_image_ids_to_update_.clear();
 
-    // Append images that have not failed to register before.
-    for (const auto& image : reconstruction_->Images()) {
-      // Skip images that are already registered.
-      if (image.second.IsRegistered()) {
-        continue;
-      }
-      std::cout << image.second.NumVisiblePoints3D() << " ";
+    return next_image_index_.TopImages(max_num_images);
+  }
 
-      // Only consider images with a sufficient number of visible points.
-      if (image.second.NumVisiblePoints3D() <
-        static_cast<size_t>(options.abs_pose_min_num_inliers)) {
-        continue;
-      }
+  void IncrementalMapper::UpdateNextImageCandidate(const Options& options,
+    const image_t image_id) {
+    if (!reconstruction_->ExistsImage(image_id)) {
+      next_image_index_.Remove(image_id);
+      return;
+    }
 
-      // Only try registration for a certain maximum number of times.
-      const size_t num_reg_trials = num_reg_trials_[image.first];
-      if (num_reg_trials >= static_cast<size_t>(options.max_reg_trials)) {
-        continue;
-      }
+    const Image& image = reconstruction_->Image(image_id);
 
-      // If image has been filtered or failed to register, place it in the
-      // second bucket and prefer images that have not been tried before.
-      const float rank = rank_image_func(image.second);
-      if (filtered_images_.count(image.first) == 0 && num_reg_trials == 0) {
-        image_ranks.emplace_back(image.first, rank);
-      }
-      else {
-        other_image_ranks.emplace_back(image.first, rank);
-      }
+    // Skip images that are already registered.
+    if (image.IsRegistered()) {
+      next_image_index_.Remove(image_id);
+      return;
     }
 
-    std::cout << std::endl;
+    // Only consider images with a sufficient number of visible points.
+    if (image.NumVisiblePoints3D() <
+      static_cast<size_t>(options.abs_pose_min_num_inliers)) {
+      next_image_index_.Remove(image_id);
+      return;
+    }
 
-    std::vector<image_t> ranked_images_ids;
-    SortAndAppendNextImages(image_ranks, &ranked_images_ids);
-    SortAndAppendNextImages(other_image_ranks, &ranked_images_ids);
+    // Only try registration for a certain maximum number of times.
+    const auto num_reg_trials_it = num_reg_trials_.find(image_id);
+    const size_t num_reg_trials =
+      num_reg_trials_it == num_reg_trials_.end() ? 0 : num_reg_trials_it->second;
+    if (num_reg_trials >= static_cast<size_t>(options.max_reg_trials)) {
+      next_image_index_.Remove(image_id);
+      return;
+    }
 
-    return ranked_images_ids;
+    float rank = 0;
+    switch (options.image_selection_method) {
+    case Options::ImageSelectionMethod::MAX_VISIBLE_POINTS_NUM:
+      rank = RankNextImageMaxVisiblePointsNum(image);
+      break;
+    case Options::ImageSelectionMethod::MAX_VISIBLE_POINTS_RATIO:
+      rank = RankNextImageMaxVisiblePointsRatio(image);
+      break;
+    case Options::ImageSelectionMethod::MIN_UNCERTAINTY:
+      rank = RankNextImageMinUncertainty(image);
+      break;
+    }
+
+    // If image has been filtered or failed to register, place it in the
+    // second group and prefer images that have not been tried before.
+    const bool preferred =
+      filtered_images_.count(image_id) == 0 && num_reg_trials == 0;
+    next_image_index_.Update(image_id, preferred, rank);
   }
 
   bool IncrementalMapper::RegisterInitialImagePair(const Options& options,
@@ -312,6 +328,8 @@ namespace colmap {
     init_num_reg_trials_[image_id2] += 1;
     num_reg_trials_[image_id1] += 1;
     num_reg_trials_[image_id2] += 1;
+    next_image_ids_to_update_.insert(image_id1);
+    next_image_ids_to_update_.insert(image_id2);
 
     const image_pair_t pair_id =
       Database::ImagePairToPairId(image_id1, image_id2);
@@ -397,6 +415,7 @@ namespace colmap {
     for (int i = 0; i < 4; ++i) {
       init_num_reg_trials_[image_ids[i]] += 1;
       num_reg_trials_[image_ids[i]] += 1;
+      next_image_ids_to_update_.insert(image_ids[i]);
     }
 
 
@@ -443,6 +462,7 @@ namespace colmap {
     CHECK(!image.IsRegistered()) << "Image cannot be registered multiple times";
 
     num_reg_trials_[image_id] += 1;
+    next_image_ids_to_update_.insert(image_id);
 
     // Check if enough 2D-3D correspondences.
     if (image.NumVisiblePoints3D() <
@@ -533,8 +553,10 @@ namespace colmap {
     abs_pose_options.ransac_options.confidence = 0.99999;
 
     AbsolutePoseRefinementOptions abs_pose_refinement_options;
-    if (num_reg_images_per_camera_[image.CameraId()] > 0) {
-      // Camera already refined from another image with the same camera.
+    if (num_reg_images_per_camera_[image.CameraId()] > 0 ||
+      triangulator_->HasSharedCalibration(image.CameraId())) {
+      // Camera already refined from another image with the same camera or
+      // calibrated by another reconstruction.
       if (camera.HasBogusParams(options.min_focal_length_ratio,
         options.max_focal_length_ratio,
         options.max_extra_param)) {
@@ -579,12 +601,12 @@ namespace colmap {
     for (image_t img_id_this : reconstruction_->RegImageIds()) {
       camera_t cam_id = reconstruction_->Image(img_id_this).CameraId();
       // min_num_reg_images related
-      if (num_reg_images_per_camera_[cam_id] < 21) {
+      if (!IsCameraUpgraded(cam_id, 21)) {
         optimize_tz = false;
         break;
       }
     }
-    if (num_reg_images_per_camera_[camera.CameraId()] < 21) {
+    if (!IsCameraUpgraded(camera.CameraId(), 21)) {
       optimize_tz = false;
     }
 
@@ -642,7 +664,7 @@ namespace colmap {
       }
     }
 
-    if (num_reg_images_per_camera_[camera.CameraId()] >= MIN_NUM_IMAGES_FOR_UPGRADE) {
+    if (IsCameraUpgraded(camera.CameraId(), MIN_NUM_IMAGES_FOR_UPGRADE)) {
       AdjustCameraPose(options, image_id);
     }
 
@@ -663,7 +685,7 @@ namespace colmap {
     for (image_t img_id_this : reconstruction_->RegImageIds()) {
       camera_t cam_id = reconstruction_->Image(img_id_this).CameraId();
       // min_num_reg_images related
-      if (num_reg_images_per_camera_[cam_id] < tri_options.min_num_reg_images) {
+      if (!IsCameraUpgraded(cam_id, tri_options.min_num_reg_images)) {
         standard_triangulation = false;
       }
     }
@@ -710,9 +732,8 @@ namespace colmap {
 
     LocalBundleAdjustmentReport report;
     Camera& camera_reg = reconstruction_->Camera(reconstruction_->Image(image_id).CameraId());
-    size_t camera_reg_images = num_reg_images_per_camera_[camera_reg.CameraId()];
-
-    bool standard_triangulation = camera_reg_images >= tri_options.min_num_reg_images;
+    bool standard_triangulation =
+      IsCameraUpgraded(camera_reg.CameraId(), tri_options.min_num_reg_images);
 
     // Find images that have most 3D points with given image in common.
     const std::vector<image_t> local_bundle = FindLocalBundle(options, image_id);
@@ -931,7 +952,7 @@ namespace colmap {
       "bundle-adjustment";
 
     // Avoid degeneracies in bundle adjustment.
-    reconstruction_->FilterObservationsWithNegativeDepth();
+    reconstruction_->FilterObservationsWithNegativeDepth(options.num_threads);
     reconstruction_->Normalize();
 
     // Concerned camera_id
@@ -1047,6 +1068,18 @@ namespace colmap {
     return num_cam_calibrated;
   }
 
+  size_t IncrementalMapper::WarmStartCameras(
+    const CameraCalibrationRegistry& registry) {
+    CHECK_NOTNULL(reconstruction_);
+    std::unordered_set<camera_t> camera_ids;
+    const size_t num_warm_started =
+      registry.WarmStart(reconstruction_, &camera_ids);
+    for (const camera_t camera_id : camera_ids) {
+      triangulator_->AddSharedCalibration(camera_id);
+    }
+    return num_warm_started;
+  }
+
   bool IncrementalMapper::AdjustParallelGlobalBundle(
     const BundleAdjustmentOptions& ba_options,
     const ParallelBundleAdjuster::Options& parallel_ba_options, bool initial) {
@@ -1118,6 +1151,7 @@ namespace colmap {
     for (const image_t image_id : image_ids) {
       DeRegisterImageEvent(image_id);
       filtered_images_.insert(image_id);
+      next_image_ids_to_update_.insert(image_id);
     }
 
     return image_ids.size();
@@ -1127,7 +1161,7 @@ namespace colmap {
     CHECK_NOTNULL(reconstruction_);
     CHECK(options.Check());
     return reconstruction_->FilterAllPoints3D(options.filter_max_reproj_error,
-      options.filter_min_tri_angle);
+      options.filter_min_tri_angle, options.num_threads);
   }
 
   size_t IncrementalMapper::FilterPointsFinal(const Options& options) {
@@ -1504,6 +1538,16 @@ namespace colmap {
     }
   }
 
+  bool IncrementalMapper::IsCameraUpgraded(
+    const camera_t camera_id, const size_t min_num_reg_images) const {
+    if (triangulator_->HasSharedCalibration(camera_id)) {
+      return true;
+    }
+    const auto num_reg_images = num_reg_images_per_camera_.find(camera_id);
+    return num_reg_images != num_reg_images_per_camera_.end() &&
+      num_reg_images->second >= min_num_reg_images;
+  }
+
   bool IncrementalMapper::EstimateInitialTwoViewGeometry(
     const Options& options, const image_t image_id1, const image_t image_id2) {
     const image_pair_t image_pair_id =
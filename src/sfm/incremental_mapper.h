@@ -36,7 +36,9 @@
 #include "base/database_cache.h"
 #include "base/reconstruction.h"
 #include "optim/bundle_adjustment.h"
+#include "sfm/camera_calibration_registry.h"
 #include "sfm/incremental_triangulator.h"
+#include "sfm/next_image_index.h"
 #include "util/alignment.h"
 #include "estimators/implicit_bundle_adjustment.h"
 #include "estimators/implicit_local_bundle_adjustment.h"
@@ -167,7 +169,13 @@ namespace colmap {
     // Find best next image to register in the incremental reconstruction. The
     // images should be passed to `RegisterNextImage`. This function automatically
     // ignores images that failed to registered for `max_reg_trials`.
-    std::vector<image_t> FindNextImages(const Options& options);
+    //
+    // The candidates are kept in an index that is only updated for the images
+    // whose visibility or registration trials changed since the last call, so
+    // at most `max_num_images` of the best images are returned without
+    // re-ranking all images.
+    std::vector<image_t> FindNextImages(const Options& options,
+      const size_t max_num_images = std::numeric_limits<size_t>::max());
 
     // Attempt to seed the reconstruction from an image pair.
     bool RegisterInitialImagePair(const Options& options, const image_t image_id1,
@@ -223,6 +231,12 @@ namespace colmap {
     // Calibrate camera
     int CalibrateCamera(const Options& options, const IncrementalTriangulator::Options& tri_opt);
 
+    // Initialize the uncalibrated cameras with the calibrations shared by other
+    // reconstructions. These cameras leave the radial-1D phase immediately and
+    // their calibration is not re-estimated. Return the number of initialized
+    // cameras.
+    size_t WarmStartCameras(const CameraCalibrationRegistry& registry);
+
     // Adjust points only
     bool AdjustGlobalPoints(const Options& options);
 
@@ -275,6 +289,16 @@ namespace colmap {
     void RegisterImageEvent(const image_t image_id);
     void DeRegisterImageEvent(const image_t image_id);
 
+    // Whether a camera has left the radial-1D phase, i.e., it has at least the
+    // given number of registered images or a shared calibration.
+    bool IsCameraUpgraded(const camera_t camera_id,
+      const size_t min_num_reg_images) const;
+
+    // Update the rank of the given candidate image in the next image index or
+    // remove it from the index, if it is no longer a candidate.
+    void UpdateNextImageCandidate(const Options& options,
+      const image_t image_id);
+
     bool EstimateInitialTwoViewGeometry(const Options& options,
       const image_t image_id1,
       const image_t image_id2);
@@ -322,6 +346,19 @@ namespace colmap {
     // an upper bound to the number of trials to register an image.
     std::unordered_map<image_t, size_t> num_reg_trials_;
 
+    // Ranked candidate images for `FindNextImages`. The index is rebuilt from
+    // scratch for a new reconstruction or if the options used for ranking
+    // change, and otherwise only updated for the images that changed.
+    NextImageIndex next_image_index_;
+    bool next_image_index_valid_;
+    Options::ImageSelectionMethod next_image_index_method_;
+    int next_image_index_min_num_inliers_;
+    int next_image_index_max_reg_trials_;
+
+    // Images whose registration trials or filter state changed since the last
+    // update of the next image index.
+    std::unordered_set<image_t> next_image_ids_to_update_;
+
     // Images that were registered before beginning the reconstruction.
     // This image list will be non-empty, if the reconstruction is continued from
     // an existing reconstruction.
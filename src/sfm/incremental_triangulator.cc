@@ -43,16 +43,47 @@
 
 
 #include "base/projection.h"
+#include "base/triangulation_batch.h"
+#include "sfm/camera_calibration_registry.h"
 #include "estimators/triangulation.h"
 #include "estimators/implicit_camera_pose.h"
 #include "estimators/implicit_cost_matrix.h"
 #include "estimators/implicit_pose_refinement.h"
 #include "util/math.h"
 #include "util/misc.h"
+#include "util/threading.h"
 // include boost
 
 
 namespace colmap {
+  namespace {
+
+    // Key of an observation in the set of observations that were triangulated
+    // while applying the proposals of a parallel pass.
+    uint64_t ObservationKey(const image_t image_id,
+      const point2D_t point2D_idx) {
+      return (static_cast<uint64_t>(image_id) << 32) | point2D_idx;
+    }
+
+    // Minimum number of observations, correspondences, or tracks to estimate
+    // their triangulations in parallel.
+    const size_t kMinNumParallelEstimates = 64;
+
+  }  // namespace
+
+  struct IncrementalTriangulator::TriangulationProposal {
+    // The reference observation and all correspondences read during
+    // the estimation, together with whether they were triangulated.
+    CorrData ref_corr_data;
+    std::vector<CorrData> corrs_data;
+    std::vector<char> corrs_triangulated;
+
+    // Existing 3D point to which the reference observation is added.
+    point3D_t continued_point3D_id = kInvalidPoint3DId;
+
+    // New 3D points created from the correspondences.
+    std::vector<EstimatedPoint3D> points3D;
+  };
 
   bool IncrementalTriangulator::Options::Check() const {
     CHECK_OPTION_GE(max_transitivity, 0);
@@ -76,22 +107,37 @@ namespace colmap {
     reconstruction_(reconstruction) {
   }
 
+  template <typename func_t>
+  void IncrementalTriangulator::ParallelEstimate(const Options& options,
+    const size_t num_items, const size_t min_num_items,
+    const func_t& func) const {
+    const int num_threads = GetEffectiveNumThreads(options.num_threads);
+    if (num_threads == 1 || num_items < std::max<size_t>(min_num_items, 2)) {
+      for (size_t i = 0; i < num_items; ++i) {
+        func(i);
+      }
+      return;
+    }
+
+    if (!thread_pool_ ||
+      thread_pool_->NumThreads() != static_cast<size_t>(num_threads)) {
+      thread_pool_.reset(new ThreadPool(num_threads));
+    }
+
+    thread_pool_->ParallelFor(0, num_items, func);
+  }
+
   size_t IncrementalTriangulator::TriangulateImage(const Options& options,
     const image_t image_id, bool initial, bool standard_triangulation) {
     CHECK(options.Check());
 
-    size_t num_tris = 0;
-
     ClearCaches();
-    // std::cout<<"Entering triangulator::tiangulateImage: "<<std::endl;
-    // std::cout << "Initial in IncrementalTriangulator::Triangulateimage: " << initial << std::endl;
 
     const Image& image = reconstruction_->Image(image_id);
     if (!image.IsRegistered()) {
-      return num_tris;
+      return 0;
     }
 
-
     const Camera& camera = reconstruction_->Camera(image.CameraId());
     CorrData ref_corr_data;
     ref_corr_data.image_id = image_id;
@@ -100,42 +146,80 @@ namespace colmap {
 
     // Container for correspondences from reference observation to other images.
     std::vector<CorrData> corrs_data;
-    bool update_calibration = true;
-
-    // Try to triangulate all image observations.
-    for (point2D_t point2D_idx = 0; point2D_idx < image.NumPoints2D();
-      ++point2D_idx) {
 
-      if (camera.GetRawRadii().size() < 20) {
-        update_calibration = true;
-      }
+    // Triangulate an observation against the current state, which is used by
+    // the serial path and if a previously applied observation invalidated its
+    // estimated triangulation.
+    const auto triangulate_observation = [&](const size_t point2D_idx) {
       const size_t num_triangulated =
         Find(options, image_id, point2D_idx,
           static_cast<size_t>(options.max_transitivity), &corrs_data);
       if (corrs_data.empty()) {
-        continue;
+        return static_cast<size_t>(0);
       }
 
-      const Point2D& point2D = image.Point2D(point2D_idx);
       ref_corr_data.point2D_idx = point2D_idx;
-      ref_corr_data.point2D = &point2D;
-
-      if (num_triangulated == 0) {
-        corrs_data.push_back(ref_corr_data);
+      ref_corr_data.point2D = &image.Point2D(point2D_idx);
 
-        num_tris += Create(options, corrs_data, initial, standard_triangulation, update_calibration);
-      }
-      else {
+      size_t num_tris = 0;
+      if (num_triangulated > 0) {
         // Continue correspondences to existing 3D points.
         num_tris += Continue(options, ref_corr_data, corrs_data);
-        // Create points from correspondences that are not continued.
-        corrs_data.push_back(ref_corr_data);
-        num_tris += Create(options, corrs_data, initial, standard_triangulation, update_calibration);
       }
-      update_calibration = false;
+      // Create points from correspondences that are not continued.
+      corrs_data.push_back(ref_corr_data);
+      num_tris += Create(options, corrs_data, initial, standard_triangulation);
+      return num_tris;
+    };
+
+    // A single thread triangulates the observations one after another, which
+    // gives the same result as applying the estimated triangulations.
+    if (GetEffectiveNumThreads(options.num_threads) == 1) {
+      size_t num_tris = 0;
+      for (point2D_t point2D_idx = 0; point2D_idx < image.NumPoints2D();
+        ++point2D_idx) {
+        num_tris += triangulate_observation(point2D_idx);
+      }
+      return num_tris;
     }
 
-    return num_tris;
+    // Estimate the triangulations of all image observations in parallel.
+    std::vector<TriangulationProposal> proposals(image.NumPoints2D());
+    ParallelEstimate(options, proposals.size(), kMinNumParallelEstimates,
+      [&](const size_t point2D_idx) {
+      TriangulationProposal& proposal = proposals[point2D_idx];
+
+      const size_t num_triangulated =
+        Find(options, image_id, point2D_idx,
+          static_cast<size_t>(options.max_transitivity), &proposal.corrs_data);
+      if (proposal.corrs_data.empty()) {
+        return;
+      }
+
+      proposal.ref_corr_data = ref_corr_data;
+      proposal.ref_corr_data.point2D_idx = point2D_idx;
+      proposal.ref_corr_data.point2D = &image.Point2D(point2D_idx);
+
+      std::vector<CorrData> create_corrs_data = proposal.corrs_data;
+      if (num_triangulated > 0) {
+        // Continue correspondences to existing 3D points.
+        proposal.continued_point3D_id = EstimateContinue(
+          options, proposal.ref_corr_data, proposal.corrs_data);
+      }
+      // Create points from correspondences that are not continued.
+      if (proposal.continued_point3D_id == kInvalidPoint3DId) {
+        create_corrs_data.push_back(proposal.ref_corr_data);
+      }
+      EstimateCreate(options, create_corrs_data, initial, &proposal.points3D);
+
+      proposal.corrs_data.push_back(proposal.ref_corr_data);
+      proposal.corrs_triangulated.reserve(proposal.corrs_data.size());
+      for (const CorrData& corr_data : proposal.corrs_data) {
+        proposal.corrs_triangulated.push_back(corr_data.point2D->HasPoint3D());
+      }
+    });
+
+    return ApplyProposals(proposals, triangulate_observation);
   }
 
   size_t IncrementalTriangulator::CompleteImage(const Options& options,
@@ -294,29 +378,23 @@ namespace colmap {
     const Options& options, const std::unordered_set<point3D_t>& point3D_ids) {
     CHECK(options.Check());
 
-    size_t num_completed = 0;
-
     ClearCaches();
 
-    for (const point3D_t point3D_id : point3D_ids) {
-      num_completed += Complete(options, point3D_id);
-    }
-
-    return num_completed;
+    return CompletePoints3D(
+      options,
+      std::vector<point3D_t>(point3D_ids.begin(), point3D_ids.end()));
   }
 
   size_t IncrementalTriangulator::CompleteAllTracks(const Options& options) {
     CHECK(options.Check());
 
-    size_t num_completed = 0;
-
     ClearCaches();
 
-    for (const point3D_t point3D_id : reconstruction_->Point3DIds()) {
-      num_completed += Complete(options, point3D_id);
-    }
-
-    return num_completed;
+    const std::unordered_set<point3D_t> point3D_ids =
+      reconstruction_->Point3DIds();
+    return CompletePoints3D(
+      options,
+      std::vector<point3D_t>(point3D_ids.begin(), point3D_ids.end()));
   }
 
   size_t IncrementalTriangulator::MergeTracks(
@@ -362,7 +440,8 @@ namespace colmap {
       num_reg_images_per_camera[image.CameraId()] += 1;
     }
     for (const auto& pair : num_reg_images_per_camera) {
-      if (pair.second < options.min_num_reg_images) {
+      if (pair.second < options.min_num_reg_images &&
+        !HasSharedCalibration(pair.first)) {
         standard_triangulation = false;
         break;
       }
@@ -429,58 +508,96 @@ namespace colmap {
         correspondence_graph_->FindCorrespondencesBetweenImages(image_id1,
           image_id2);
 
-      // std::cout << "Correspondences found " << corrs.size() << std::endl;
-      for (const auto& corr : corrs) {
-        const Point2D& point2D1 = image1.Point2D(corr.point2D_idx1);
-        const Point2D& point2D2 = image2.Point2D(corr.point2D_idx2);
+      const auto make_corrs_data = [&](const FeatureMatch& corr,
+        CorrData* corr_data1, CorrData* corr_data2) {
+        corr_data1->image_id = image_id1;
+        corr_data1->point2D_idx = corr.point2D_idx1;
+        corr_data1->image = &image1;
+        corr_data1->camera = &camera1;
+        corr_data1->point2D = &image1.Point2D(corr.point2D_idx1);
+
+        corr_data2->image_id = image_id2;
+        corr_data2->point2D_idx = corr.point2D_idx2;
+        corr_data2->image = &image2;
+        corr_data2->camera = &camera2;
+        corr_data2->point2D = &image2.Point2D(corr.point2D_idx2);
+      };
+
+      // Estimate the retriangulation of all correspondences in parallel.
+      std::vector<TriangulationProposal> proposals(corrs.size());
+      std::vector<char> create_proposals(corrs.size(), 0);
+      ParallelEstimate(options, proposals.size(), kMinNumParallelEstimates,
+        [&](const size_t corr_idx) {
+        CorrData corr_data1;
+        CorrData corr_data2;
+        make_corrs_data(corrs[corr_idx], &corr_data1, &corr_data2);
 
         // Two cases are possible here: both points belong to the same 3D point
         // or to different 3D points. In the former case, there is nothing
         // to do. In the latter case, we do not attempt retriangulation,
         // as retriangulated correspondences are very likely bogus and
         // would therefore destroy both 3D points if merged.
-        if (point2D1.HasPoint3D() && point2D2.HasPoint3D()) {
-          continue;
+        const bool has_point3D1 = corr_data1.point2D->HasPoint3D();
+        const bool has_point3D2 = corr_data2.point2D->HasPoint3D();
+        if (has_point3D1 && has_point3D2) {
+          return;
         }
 
-        CorrData corr_data1;
-        corr_data1.image_id = image_id1;
-        corr_data1.point2D_idx = corr.point2D_idx1;
-        corr_data1.image = &image1;
-        corr_data1.camera = &camera1;
-        corr_data1.point2D = &point2D1;
+        TriangulationProposal& proposal = proposals[corr_idx];
+        if (has_point3D1) {
+          proposal.ref_corr_data = corr_data2;
+          proposal.continued_point3D_id =
+            EstimateContinue(re_options, corr_data2, { corr_data1 });
+        }
+        else if (has_point3D2) {
+          proposal.ref_corr_data = corr_data1;
+          proposal.continued_point3D_id =
+            EstimateContinue(re_options, corr_data1, { corr_data2 });
+        }
+        else {
+          // New points are estimated in batches below.
+          create_proposals[corr_idx] = 1;
+        }
+
+        proposal.corrs_data = { corr_data1, corr_data2 };
+        proposal.corrs_triangulated = { has_point3D1, has_point3D2 };
+      });
+
+      std::vector<size_t> create_proposal_idxs;
+      for (size_t corr_idx = 0; corr_idx < corrs.size(); ++corr_idx) {
+        if (create_proposals[corr_idx]) {
+          create_proposal_idxs.push_back(corr_idx);
+        }
+      }
+      // Do not use larger triangulation threshold as this causes
+      // significant drift when creating points (options vs. re_options).
+      EstimateCreatePairs(re_options, create_proposal_idxs, &proposals);
 
+      // Retriangulate a correspondence against the current state, if a
+      // previously applied correspondence invalidated its estimation.
+      const auto retriangulate_corr = [&](const size_t corr_idx) {
+        CorrData corr_data1;
         CorrData corr_data2;
-        corr_data2.image_id = image_id2;
-        corr_data2.point2D_idx = corr.point2D_idx2;
-        corr_data2.image = &image2;
-        corr_data2.camera = &camera2;
-        corr_data2.point2D = &point2D2;
-
-        if (point2D1.HasPoint3D() && !point2D2.HasPoint3D()) {
-          const std::vector<CorrData> corrs_data1 = { corr_data1 };
-          num_tris += Continue(re_options, corr_data2, corrs_data1);
+        make_corrs_data(corrs[corr_idx], &corr_data1, &corr_data2);
+
+        const bool has_point3D1 = corr_data1.point2D->HasPoint3D();
+        const bool has_point3D2 = corr_data2.point2D->HasPoint3D();
+        if (has_point3D1 && !has_point3D2) {
+          return Continue(re_options, corr_data2, { corr_data1 });
         }
-        else if (!point2D1.HasPoint3D() && point2D2.HasPoint3D()) {
-          const std::vector<CorrData> corrs_data2 = { corr_data2 };
-          num_tris += Continue(re_options, corr_data1, corrs_data2);
+        else if (!has_point3D1 && has_point3D2) {
+          return Continue(re_options, corr_data1, { corr_data2 });
         }
-        else if (!point2D1.HasPoint3D() && !point2D2.HasPoint3D()) {
-          const std::vector<CorrData> corrs_data = { corr_data1, corr_data2 };
-          // Do not use larger triangulation threshold as this causes
-          // significant drift when creating points (options vs. re_options).
-
-          bool update_calibration = false;
-          bool force_update = false;
-          if (standard_triangulation) {
-            update_calibration = true;
-            force_update = true;
-          }
-          num_tris += Create(re_options, corrs_data, false, false, false, false);
+        else if (!has_point3D1 && !has_point3D2) {
+          return Create(re_options, { corr_data1, corr_data2 }, false, false,
+            false, false);
         }
         // Else both points have a 3D point, but we do not want to
         // merge points in retriangulation.
-      }
+        return static_cast<size_t>(0);
+      };
+
+      num_tris += ApplyProposals(proposals, retriangulate_corr);
     }
 
     return num_tris;
@@ -509,6 +626,15 @@ namespace colmap {
     modified_point3D_ids_.clear();
   }
 
+  void IncrementalTriangulator::AddSharedCalibration(const camera_t camera_id) {
+    shared_calibration_camera_ids_.insert(camera_id);
+  }
+
+  bool IncrementalTriangulator::HasSharedCalibration(
+    const camera_t camera_id) const {
+    return shared_calibration_camera_ids_.count(camera_id) > 0;
+  }
+
   void IncrementalTriangulator::ClearCaches() {
     camera_has_bogus_params_.clear();
     merge_trials_.clear();
@@ -518,7 +644,7 @@ namespace colmap {
     const image_t image_id,
     const point2D_t point2D_idx,
     const size_t transitivity,
-    std::vector<CorrData>* corrs_data) {
+    std::vector<CorrData>* corrs_data) const {
     const std::vector<CorrespondenceGraph::Correspondence>& corrs =
       correspondence_graph_->FindTransitiveCorrespondences(
         image_id, point2D_idx, transitivity);
@@ -670,7 +796,10 @@ namespace colmap {
     PoseRefinementOptions pose_refinement_options;
     CostMatrixOptions cm_options;
     for (auto& [camera_id, camera_const] : reconstruction_->Cameras()) {
-      if (camera_images[camera_id].size() < options.min_num_reg_images) {
+      // A shared calibration is kept as is, so that the expensive estimation
+      // below is not repeated for the same camera.
+      if (camera_images[camera_id].size() < options.min_num_reg_images ||
+        HasSharedCalibration(camera_id)) {
         continue;
       }
       Camera& camera = reconstruction_->Camera(camera_id);
@@ -764,7 +893,8 @@ namespace colmap {
       std::vector<double> calibrated_area = IdentifyCalibratedArea(camera, theta, radii);
       std::vector<double> principal_point_new = { principal_point[0], principal_point[1] };
       // Check whether the calibrtion is wrong 
-      double original_calibrated_area = camera.Params()[11] - camera.Params()[2];
+      double original_calibrated_area =
+        CameraCalibrationRegistry::CalibratedRange(camera);
       bool use_new_calibration = !camera.IsCalibrated();
       use_new_calibration = use_new_calibration
         || (original_calibrated_area < calibrated_area[1] - calibrated_area[0]);
@@ -807,12 +937,9 @@ namespace colmap {
   }
 
 
-  size_t IncrementalTriangulator::Create(
-    const Options& options, const std::vector<CorrData>& corrs_data, bool initial, bool standard_triangulation, bool update_calibration, bool false_update) {
-    //  std::vector<image_t> img_ids;
-    bool full_error = true;
-    int debug_counter = 0;
-
+  void IncrementalTriangulator::EstimateCreate(
+    const Options& options, const std::vector<CorrData>& corrs_data,
+    const bool initial, std::vector<EstimatedPoint3D>* points3D) const {
     // Extract correspondences without an existing triangulated observation.
     std::vector<CorrData> create_corrs_data;
     create_corrs_data.reserve(corrs_data.size());
@@ -820,131 +947,267 @@ namespace colmap {
       if (!corr_data.point2D->HasPoint3D()) {
         create_corrs_data.push_back(corr_data);
       }
-
-    }
-    if (create_corrs_data.size() < 2) {
-      // Need at least two observations for triangulation.
-      return 0;
     }
-    else if (options.ignore_two_view_tracks && create_corrs_data.size() == 2) {
-      const CorrData& corr_data1 = create_corrs_data[0];
-      if (correspondence_graph_->IsTwoViewObservation(corr_data1.image_id,
-        corr_data1.point2D_idx)) {
-        return 0;
+
+    // Inlier observations of the created points, which are refit together
+    // once all points are created.
+    TriangulationBatch batch;
+
+    while (true) {
+      if (create_corrs_data.size() < 2) {
+        // Need at least two observations for triangulation.
+        break;
       }
-    }
-    // Setup data for triangulation estimation.
-    std::vector<TriangulationEstimator::PointData> point_data;
-    point_data.resize(create_corrs_data.size());
-    std::vector<TriangulationEstimator::PoseData> pose_data;
-    pose_data.resize(create_corrs_data.size());
-    int count = 0;
-    int radial_count = 0;
-    std::vector<Camera> cameras_temp(create_corrs_data.size());
-    bool is_calibrated = false;
-    for (size_t i = 0; i < create_corrs_data.size(); ++i) {
-
-      const CorrData& corr_data = create_corrs_data[i];
-      point_data[i].point = corr_data.point2D->XY();
-      point_data[i].point_normalized =
-        corr_data.camera->ImageToWorld(point_data[i].point);
-      pose_data[i].proj_matrix = corr_data.image->ProjectionMatrix();
-      pose_data[i].proj_center = corr_data.image->ProjectionCenter();
-
-      pose_data[i].camera = corr_data.camera;
-
-      pose_data[i].image = corr_data.image;
-      double radius = point_data[i].point_normalized.norm();
-      bool is_calibrated = corr_data.camera->IsFullyCalibrated(point_data[i].point);
-      if (!is_calibrated)
-        continue;
+      else if (options.ignore_two_view_tracks && create_corrs_data.size() == 2) {
+        const CorrData& corr_data1 = create_corrs_data[0];
+        if (correspondence_graph_->IsTwoViewObservation(corr_data1.image_id,
+          corr_data1.point2D_idx)) {
+          break;
+        }
+      }
+      // Setup data for triangulation estimation.
+      std::vector<TriangulationEstimator::PointData> point_data;
+      point_data.resize(create_corrs_data.size());
+      std::vector<TriangulationEstimator::PoseData> pose_data;
+      pose_data.resize(create_corrs_data.size());
+      std::vector<Camera> cameras_temp(create_corrs_data.size());
+      for (size_t i = 0; i < create_corrs_data.size(); ++i) {
+        const CorrData& corr_data = create_corrs_data[i];
+        point_data[i].point = corr_data.point2D->XY();
+        point_data[i].point_normalized =
+          corr_data.camera->ImageToWorld(point_data[i].point);
+        pose_data[i].proj_matrix = corr_data.image->ProjectionMatrix();
+        pose_data[i].proj_center = corr_data.image->ProjectionCenter();
 
-      double focal_length_splined = corr_data.camera->EvalFocalLength(radius);
-      point_data[i].focal_length = focal_length_splined;
+        pose_data[i].camera = corr_data.camera;
 
+        pose_data[i].image = corr_data.image;
+        double radius = point_data[i].point_normalized.norm();
+        bool is_calibrated = corr_data.camera->IsFullyCalibrated(point_data[i].point);
+        if (!is_calibrated)
+          continue;
 
-      point_data[i].point_normalized_standard = point_data[i].point_normalized / point_data[i].focal_length;
-      Eigen::Matrix3d K;
-      K << focal_length_splined, 0, pose_data[i].camera->PrincipalPointX(),
-        0, focal_length_splined, pose_data[i].camera->PrincipalPointY(),
-        0, 0, 1;
-      pose_data[i].proj_matrix_standard = K * pose_data[i].proj_matrix;
+        double focal_length_splined = corr_data.camera->EvalFocalLength(radius);
+        point_data[i].focal_length = focal_length_splined;
 
-      // Construct temporary camera for triangulation.
-      point_data[i].point_normalized = point_data[i].point_normalized_standard;
-      cameras_temp[i].SetModelId(SimplePinholeCameraModel::model_id);
-      cameras_temp[i].SetParams({ focal_length_splined, pose_data[i].camera->PrincipalPointX(), pose_data[i].camera->PrincipalPointY() });
+        point_data[i].point_normalized_standard = point_data[i].point_normalized / point_data[i].focal_length;
+        Eigen::Matrix3d K;
+        K << focal_length_splined, 0, pose_data[i].camera->PrincipalPointX(),
+          0, focal_length_splined, pose_data[i].camera->PrincipalPointY(),
+          0, 0, 1;
+        pose_data[i].proj_matrix_standard = K * pose_data[i].proj_matrix;
 
-      pose_data[i].camera = &cameras_temp[i];
+        // Construct temporary camera for triangulation.
+        point_data[i].point_normalized = point_data[i].point_normalized_standard;
+        cameras_temp[i].SetModelId(SimplePinholeCameraModel::model_id);
+        cameras_temp[i].SetParams({ focal_length_splined, pose_data[i].camera->PrincipalPointX(), pose_data[i].camera->PrincipalPointY() });
 
+        pose_data[i].camera = &cameras_temp[i];
+      }
 
+      EstimateTriangulationOptions tri_options;
+      tri_options.min_tri_angle = DegToRad(options.min_angle);
+      tri_options.residual_type =
+        TriangulationEstimator::ResidualType::ANGULAR_ERROR;
+      tri_options.ransac_options.max_error =
+        DegToRad(options.create_max_angle_error);
+      tri_options.ransac_options.confidence = 0.9999;
+      tri_options.ransac_options.min_inlier_ratio = 0.02;
+      tri_options.ransac_options.max_num_trials = 10000;
 
-    }
-    if (count > 0) {
-      full_error = false;
-    }
-    if (radial_count >= 0.5 * create_corrs_data.size()) {
-      standard_triangulation = false;
-    }
+      // Enforce exhaustive sampling for small track lengths.
+      const size_t kExhaustiveSamplingThreshold = 15;
+      if (point_data.size() <= kExhaustiveSamplingThreshold) {
+        tri_options.ransac_options.min_num_trials = NChooseK(point_data.size(), 3);
+      }
 
-    EstimateTriangulationOptions tri_options;
-    tri_options.min_tri_angle = DegToRad(options.min_angle);
-    tri_options.residual_type =
-      TriangulationEstimator::ResidualType::ANGULAR_ERROR;
-    tri_options.ransac_options.max_error =
-      DegToRad(options.create_max_angle_error);
-    tri_options.ransac_options.confidence = 0.9999;
-    tri_options.ransac_options.min_inlier_ratio = 0.02;
-    tri_options.ransac_options.max_num_trials = 10000;
+      // Estimate triangulation.
+      EstimatedPoint3D point3D;
+      std::vector<char> inlier_mask;
+      if (!EstimateTriangulation(tri_options, point_data, pose_data, &inlier_mask,
+        &point3D.xyz, initial, false)) {
+        break;
+      }
+      // Add inliers to estimated track and keep the outliers, which are
+      // used to recursively create another point.
+      int num_constraints = 0;
+      point3D.track.Reserve(create_corrs_data.size());
+      std::vector<CorrData> outlier_corrs_data;
+      for (size_t i = 0; i < inlier_mask.size(); ++i) {
+        const CorrData& corr_data = create_corrs_data[i];
+        if (inlier_mask[i]) {
+          point3D.track.AddElement(corr_data.image_id, corr_data.point2D_idx);
+          num_constraints += (pose_data[i].camera->IsFullyCalibrated(corr_data.point2D->XY())) ? 2 : 1;
+        }
+        else {
+          outlier_corrs_data.push_back(corr_data);
+        }
+      }
+      if (num_constraints < 4) {
+        // this is a underconstrained point, we do not add it to the reconstruction since it will get filtered later anyways
+        break;
+      }
+
+      points3D->push_back(point3D);
+
+      batch.AddPoint();
+      for (size_t i = 0; i < inlier_mask.size(); ++i) {
+        if (!inlier_mask[i]) {
+          continue;
+        }
+        const Camera& camera = *pose_data[i].camera;
+        if (camera.ModelId() == Radial1DCameraModel::model_id ||
+          camera.ModelId() == ImplicitDistortionModel::model_id) {
+          batch.AddRadialObservation(pose_data[i].proj_matrix,
+            pose_data[i].proj_center, point_data[i].point_normalized);
+        }
+        else {
+          batch.AddPointObservation(pose_data[i].proj_matrix,
+            pose_data[i].proj_center, point_data[i].point_normalized,
+            camera.FocalLength() > 0);
+        }
+      }
 
-    // Enforce exhaustive sampling for small track lengths.
-    const size_t kExhaustiveSamplingThreshold = 15;
-    if (point_data.size() <= kExhaustiveSamplingThreshold) {
-      tri_options.ransac_options.min_num_trials = NChooseK(point_data.size(), 3);
+      const size_t kMinRecursiveTrackLength = 3;
+      if (outlier_corrs_data.size() < kMinRecursiveTrackLength) {
+        break;
+      }
+      create_corrs_data = std::move(outlier_corrs_data);
     }
 
-    // Estimate triangulation.
-    Eigen::Vector3d xyz;
-    std::vector<char> inlier_mask;
-    if (!EstimateTriangulation(tri_options, point_data, pose_data, &inlier_mask,
-      &xyz, initial, false)) {
-      return 0;
+    if (batch.NumPoints() == 0) {
+      return;
     }
-    // Add inliers to estimated track.
-    int num_constraints = 0;
-    Track track;
-    track.Reserve(create_corrs_data.size());
-    for (size_t i = 0; i < inlier_mask.size(); ++i) {
-      if (inlier_mask[i]) {
-        const CorrData& corr_data = create_corrs_data[i];
-        track.AddElement(corr_data.image_id, corr_data.point2D_idx);
-        num_constraints += (pose_data[i].camera->IsFullyCalibrated(corr_data.point2D->XY())) ? 2 : 1;
+
+    // Refit every created point to all of its inliers with the non-minimal
+    // solver of `TriangulationEstimator`, batched over the points. A refit
+    // only replaces the RANSAC estimate if it passes the same checks and
+    // keeps all observations within the inlier threshold.
+    std::vector<Eigen::Vector3d> xyzs;
+    batch.Triangulate(&xyzs);
+
+    std::vector<char> valid;
+    batch.Check(xyzs, DegToRad(options.min_angle), &valid);
+
+    std::vector<double> residuals;
+    batch.Residuals(xyzs, &residuals);
+
+    const double max_squared_error =
+      DegToRad(options.create_max_angle_error) *
+      DegToRad(options.create_max_angle_error);
+    const size_t first_point_idx = points3D->size() - batch.NumPoints();
+    size_t residual_idx = 0;
+    for (size_t point_idx = 0; point_idx < batch.NumPoints(); ++point_idx) {
+      const size_t num_observations = batch.NumObservations(point_idx);
+      bool refit_ok = valid[point_idx] != 0;
+      for (size_t i = 0; i < num_observations; ++i) {
+        refit_ok &= residuals[residual_idx + i] <= max_squared_error;
+      }
+      residual_idx += num_observations;
+      if (refit_ok) {
+        (*points3D)[first_point_idx + point_idx].xyz = xyzs[point_idx];
       }
     }
-    if (num_constraints < 4) {
-      // this is a underconstrained point, we do not add it to the reconstruction since it will get filtered later anyways
-      return 0;
-    }
-    point3D_t point3D_id;
-    point3D_id = reconstruction_->AddPoint3D(xyz, track);
-    modified_point3D_ids_.insert(point3D_id);
+  }
 
-    const size_t kMinRecursiveTrackLength = 3;
-    // if(!used_full){
-    if (create_corrs_data.size() - track.Length() >= kMinRecursiveTrackLength) {
-      update_calibration = false;
-      return track.Length() + Create(options, create_corrs_data, initial, standard_triangulation, update_calibration);
+  void IncrementalTriangulator::EstimateCreatePairs(
+    const Options& options, const std::vector<size_t>& proposal_idxs,
+    std::vector<TriangulationProposal>* proposals) const {
+    const size_t kBatchSize = 256;
+    const size_t num_batches =
+      (proposal_idxs.size() + kBatchSize - 1) / kBatchSize;
+
+    const size_t kMinNumParallelBatches = 2;
+    ParallelEstimate(options, num_batches, kMinNumParallelBatches,
+      [&](const size_t batch_idx) {
+      const size_t begin = batch_idx * kBatchSize;
+      const size_t end = std::min(begin + kBatchSize, proposal_idxs.size());
+
+      TriangulationBatch batch;
+      batch.Reserve(end - begin, 2 * (end - begin));
+      std::vector<size_t> batch_proposal_idxs;
+      batch_proposal_idxs.reserve(end - begin);
+
+      for (size_t i = begin; i < end; ++i) {
+        const TriangulationProposal& proposal =
+          (*proposals)[proposal_idxs[i]];
+        CHECK_EQ(proposal.corrs_data.size(), 2);
+        const CorrData& corr_data1 = proposal.corrs_data[0];
+        const CorrData& corr_data2 = proposal.corrs_data[1];
+
+        if (options.ignore_two_view_tracks &&
+          correspondence_graph_->IsTwoViewObservation(corr_data1.image_id,
+            corr_data1.point2D_idx)) {
+          continue;
+        }
+
+        // An observation outside of the calibrated region only contributes
+        // its radial line, which leaves the point underconstrained.
+        if (!corr_data1.camera->IsFullyCalibrated(corr_data1.point2D->XY()) ||
+          !corr_data2.camera->IsFullyCalibrated(corr_data2.point2D->XY())) {
+          continue;
+        }
+
+        batch.AddPoint();
+        for (const CorrData& corr_data : proposal.corrs_data) {
+          const Eigen::Vector2d point_normalized =
+            corr_data.camera->ImageToWorld(corr_data.point2D->XY());
+          const double focal_length =
+            corr_data.camera->EvalFocalLength(point_normalized.norm());
+          batch.AddPointObservation(corr_data.image->ProjectionMatrix(),
+            corr_data.image->ProjectionCenter(),
+            point_normalized / focal_length, focal_length > 0);
+        }
+        batch_proposal_idxs.push_back(proposal_idxs[i]);
+      }
+
+      std::vector<Eigen::Vector3d> xyzs;
+      batch.Triangulate(&xyzs);
+
+      // Two-view triangulations are not subject to the minimum
+      // triangulation angle in `EstimateTriangulation`.
+      std::vector<char> valid;
+      batch.Check(xyzs, 0, &valid);
+
+      for (size_t i = 0; i < batch_proposal_idxs.size(); ++i) {
+        if (!valid[i]) {
+          continue;
+        }
+        TriangulationProposal& proposal =
+          (*proposals)[batch_proposal_idxs[i]];
+        EstimatedPoint3D point3D;
+        point3D.xyz = xyzs[i];
+        point3D.track.Reserve(2);
+        for (const CorrData& corr_data : proposal.corrs_data) {
+          point3D.track.AddElement(corr_data.image_id, corr_data.point2D_idx);
+        }
+        proposal.points3D.push_back(point3D);
+      }
+    });
+  }
+
+  size_t IncrementalTriangulator::Create(
+    const Options& options, const std::vector<CorrData>& corrs_data, bool initial, bool standard_triangulation, bool update_calibration, bool false_update) {
+    std::vector<EstimatedPoint3D> points3D;
+    EstimateCreate(options, corrs_data, initial, &points3D);
+
+    size_t num_tris = 0;
+    for (const EstimatedPoint3D& point3D : points3D) {
+      const point3D_t point3D_id =
+        reconstruction_->AddPoint3D(point3D.xyz, point3D.track);
+      modified_point3D_ids_.insert(point3D_id);
+      num_tris += point3D.track.Length();
     }
 
-    return track.Length();
+    return num_tris;
   }
 
-  size_t IncrementalTriangulator::Continue(
+  point3D_t IncrementalTriangulator::EstimateContinue(
     const Options& options, const CorrData& ref_corr_data,
-    const std::vector<CorrData>& corrs_data) {
+    const std::vector<CorrData>& corrs_data) const {
     // No need to continue, if the reference observation is triangulated.
     if (ref_corr_data.point2D->HasPoint3D()) {
-      return 0;
+      return kInvalidPoint3DId;
     }
 
     double best_angle_error = std::numeric_limits<double>::max();
@@ -971,15 +1234,26 @@ namespace colmap {
     const double max_angle_error = DegToRad(options.continue_max_angle_error);
     if (best_angle_error <= max_angle_error &&
       best_idx != std::numeric_limits<size_t>::max()) {
-      const CorrData& corr_data = corrs_data[best_idx];
-      const TrackElement track_el(ref_corr_data.image_id,
-        ref_corr_data.point2D_idx);
-      reconstruction_->AddObservation(corr_data.point2D->Point3DId(), track_el);
-      modified_point3D_ids_.insert(corr_data.point2D->Point3DId());
-      return 1;
+      return corrs_data[best_idx].point2D->Point3DId();
     }
 
-    return 0;
+    return kInvalidPoint3DId;
+  }
+
+  size_t IncrementalTriangulator::Continue(
+    const Options& options, const CorrData& ref_corr_data,
+    const std::vector<CorrData>& corrs_data) {
+    const point3D_t point3D_id =
+      EstimateContinue(options, ref_corr_data, corrs_data);
+    if (point3D_id == kInvalidPoint3DId) {
+      return 0;
+    }
+
+    const TrackElement track_el(ref_corr_data.image_id,
+      ref_corr_data.point2D_idx);
+    reconstruction_->AddObservation(point3D_id, track_el);
+    modified_point3D_ids_.insert(point3D_id);
+    return 1;
   }
 
   size_t IncrementalTriangulator::Merge(const Options& options,
@@ -1074,12 +1348,12 @@ namespace colmap {
     return 0;
   }
 
-  size_t IncrementalTriangulator::Complete(const Options& options,
-    const point3D_t point3D_id) {
-    size_t num_completed = 0;
+  void IncrementalTriangulator::EstimateComplete(const Options& options,
+    const point3D_t point3D_id, std::vector<TrackElement>* track_els) const {
+    track_els->clear();
 
     if (!reconstruction_->ExistsPoint3D(point3D_id)) {
-      return num_completed;
+      return;
     }
 
     const double max_squared_reproj_error =
@@ -1087,6 +1361,10 @@ namespace colmap {
 
     const Point3D& point3D = reconstruction_->Point3D(point3D_id);
 
+    // Observations that are added to the track, which count as triangulated
+    // for the remaining search.
+    std::unordered_set<uint64_t> completed_observations;
+
     std::vector<TrackElement> queue = point3D.Track().Elements();
 
     const int max_transitivity = options.complete_max_transitivity;
@@ -1110,7 +1388,9 @@ namespace colmap {
           }
 
           const Point2D& point2D = image.Point2D(corr.point2D_idx);
-          if (point2D.HasPoint3D()) {
+          if (point2D.HasPoint3D() ||
+            completed_observations.count(
+              ObservationKey(corr.image_id, corr.point2D_idx)) > 0) {
             continue;
           }
 
@@ -1124,23 +1404,134 @@ namespace colmap {
             camera) > max_squared_reproj_error) {
             continue;
           }
-          const TrackElement track_el(corr.image_id, corr.point2D_idx);
-          reconstruction_->AddObservation(point3D_id, track_el);
-          modified_point3D_ids_.insert(point3D_id);
+          track_els->emplace_back(corr.image_id, corr.point2D_idx);
+          completed_observations.insert(
+            ObservationKey(corr.image_id, corr.point2D_idx));
 
           // Recursively complete track for this new correspondence.
           if (transitivity < max_transitivity - 1) {
             queue.emplace_back(corr.image_id, corr.point2D_idx);
           }
+        }
+      }
+    }
+  }
+
+  size_t IncrementalTriangulator::Complete(const Options& options,
+    const point3D_t point3D_id) {
+    std::vector<TrackElement> track_els;
+    EstimateComplete(options, point3D_id, &track_els);
+
+    for (const TrackElement& track_el : track_els) {
+      reconstruction_->AddObservation(point3D_id, track_el);
+      modified_point3D_ids_.insert(point3D_id);
+    }
+
+    return track_els.size();
+  }
 
-          num_completed += 1;
+  size_t IncrementalTriangulator::CompletePoints3D(
+    const Options& options, const std::vector<point3D_t>& point3D_ids) {
+    // A single thread completes the tracks one after another, which gives the
+    // same result as applying the estimated completions.
+    if (GetEffectiveNumThreads(options.num_threads) == 1) {
+      size_t num_completed = 0;
+      for (const point3D_t point3D_id : point3D_ids) {
+        num_completed += Complete(options, point3D_id);
+      }
+      return num_completed;
+    }
+
+    // Estimate the completions of all tracks in parallel.
+    std::vector<std::vector<TrackElement>> track_els(point3D_ids.size());
+    ParallelEstimate(options, point3D_ids.size(), kMinNumParallelEstimates,
+      [&](const size_t i) {
+      EstimateComplete(options, point3D_ids[i], &track_els[i]);
+    });
+
+    // Apply the completions in order. A track only has to be completed again,
+    // if one of its estimated observations was added to a previous track,
+    // since the search is only blocked by triangulated observations.
+    std::unordered_set<uint64_t> completed_observations;
+    size_t num_completed = 0;
+    for (size_t i = 0; i < point3D_ids.size(); ++i) {
+      for (const TrackElement& track_el : track_els[i]) {
+        if (completed_observations.count(
+          ObservationKey(track_el.image_id, track_el.point2D_idx)) > 0) {
+          EstimateComplete(options, point3D_ids[i], &track_els[i]);
+          break;
         }
       }
+
+      for (const TrackElement& track_el : track_els[i]) {
+        reconstruction_->AddObservation(point3D_ids[i], track_el);
+        modified_point3D_ids_.insert(point3D_ids[i]);
+        completed_observations.insert(
+          ObservationKey(track_el.image_id, track_el.point2D_idx));
+      }
+
+      num_completed += track_els[i].size();
     }
 
     return num_completed;
   }
 
+  size_t IncrementalTriangulator::ApplyProposals(
+    const std::vector<TriangulationProposal>& proposals,
+    const std::function<size_t(const size_t)>& retriangulate) {
+    // Observations that were triangulated by the applied proposals.
+    std::unordered_set<uint64_t> triangulated_observations;
+
+    size_t num_tris = 0;
+    for (size_t i = 0; i < proposals.size(); ++i) {
+      const TriangulationProposal& proposal = proposals[i];
+      if (proposal.corrs_data.empty()) {
+        continue;
+      }
+
+      bool is_outdated = false;
+      for (const CorrData& corr_data : proposal.corrs_data) {
+        if (triangulated_observations.count(
+          ObservationKey(corr_data.image_id, corr_data.point2D_idx)) > 0) {
+          is_outdated = true;
+          break;
+        }
+      }
+
+      if (is_outdated) {
+        num_tris += retriangulate(i);
+      }
+      else {
+        if (proposal.continued_point3D_id != kInvalidPoint3DId) {
+          const TrackElement track_el(proposal.ref_corr_data.image_id,
+            proposal.ref_corr_data.point2D_idx);
+          reconstruction_->AddObservation(proposal.continued_point3D_id,
+            track_el);
+          modified_point3D_ids_.insert(proposal.continued_point3D_id);
+          num_tris += 1;
+        }
+
+        for (const EstimatedPoint3D& point3D : proposal.points3D) {
+          const point3D_t point3D_id =
+            reconstruction_->AddPoint3D(point3D.xyz, point3D.track);
+          modified_point3D_ids_.insert(point3D_id);
+          num_tris += point3D.track.Length();
+        }
+      }
+
+      for (size_t j = 0; j < proposal.corrs_data.size(); ++j) {
+        const CorrData& corr_data = proposal.corrs_data[j];
+        if (!proposal.corrs_triangulated[j] &&
+          corr_data.point2D->HasPoint3D()) {
+          triangulated_observations.insert(
+            ObservationKey(corr_data.image_id, corr_data.point2D_idx));
+        }
+      }
+    }
+
+    return num_tris;
+  }
+
   bool IncrementalTriangulator::HasCameraBogusParams(const Options& options,
     const Camera& camera) {
     const auto it = camera_has_bogus_params_.find(camera.CameraId());
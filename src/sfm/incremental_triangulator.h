@@ -32,9 +32,13 @@
 #ifndef COLMAP_SRC_SFM_INCREMENTAL_TRIANGULATOR_H_
 #define COLMAP_SRC_SFM_INCREMENTAL_TRIANGULATOR_H_
 
+#include <functional>
+#include <memory>
+
 #include "base/database_cache.h"
 #include "base/reconstruction.h"
 #include "util/alignment.h"
+#include "util/threading.h"
 
 namespace colmap {
 
@@ -81,6 +85,11 @@ namespace colmap {
       // Minimum number of registered images to start standard triangulation
       int min_num_reg_images = MIN_NUM_IMAGES_FOR_UPGRADE;
 
+      // Number of threads to estimate triangulations in `TriangulateImage`,
+      // `Retriangulate`, and track completion, -1 for all cores. The results
+      // do not depend on the number of threads.
+      int num_threads = -1;
+
 
       // Thresholds for bogus camera parameters. Images with bogus camera
       // parameters are ignored in triangulation.
@@ -103,6 +112,14 @@ namespace colmap {
     //
     // Note that the given image must be registered and its pose must be set
     // in the associated reconstruction.
+    //
+    // The triangulations of all observations are first estimated in parallel
+    // against the current state of the reconstruction and then applied
+    // serially in the order of the observations. Observations whose
+    // correspondences were triangulated by a previously applied observation
+    // are triangulated again against the updated state. This gives the same
+    // result as triangulating the observations one after another, which is
+    // done directly if `Options::num_threads` is 1.
     size_t TriangulateImage(const Options& options, const image_t image_id, bool initial = false, bool standard_triangulation = false);
 
     // size_t TriangulateImageInitial(const Options& options,
@@ -134,14 +151,24 @@ namespace colmap {
     // Returns the number of merged observations.
     size_t MergeAllTracks(const Options& options);
 
+    // Estimate the calibration of the IMPLICIT_DISTORTION cameras with enough
+    // registered images. Cameras with a shared calibration are skipped.
     int CalibrateCamera(const Options& options);
 
+    // Mark the calibration of a camera as shared by another reconstruction
+    // (see `CameraCalibrationRegistry::WarmStart`). It is not re-estimated and
+    // the camera is treated as calibrated, independent of its number of
+    // registered images.
+    void AddSharedCalibration(const camera_t camera_id);
+    bool HasSharedCalibration(const camera_t camera_id) const;
+
     // Perform retriangulation for under-reconstructed image pairs. Under-
     // reconstruction usually occurs in the case of a drifting reconstruction.
     //
     // Image pairs are under-reconstructed if less than `Options::tri_re_min_ratio
     // > tri_ratio`, where `tri_ratio` is the number of triangulated matches over
-    // inlier matches between the image pair.
+    // inlier matches between the image pair. The matches of an image pair are
+    // retriangulated in parallel in the same way as in `TriangulateImage`.
     size_t Retriangulate(const Options& options);
 
     // Indicate that a 3D point has been modified.
@@ -166,19 +193,71 @@ namespace colmap {
     };
 
   private:
+    // New 3D point estimated from a set of correspondences.
+    struct EstimatedPoint3D {
+      Eigen::Vector3d xyz;
+      Track track;
+    };
+
+    // Triangulation of a reference observation that is estimated against the
+    // state of the reconstruction at the beginning of a parallel pass and
+    // applied afterwards, if none of its correspondences changed in between.
+    // Defined in the source file, since it stores `CorrData` by value.
+    struct TriangulationProposal;
+
     // Clear cache of bogus camera parameters and merge trials.
     void ClearCaches();
 
+    // Call func(i) for all i in [0, num_items) on the thread pool of the
+    // triangulator, which is created on first use and reused by later calls.
+    // Fewer than `min_num_items` items are processed serially, since they do
+    // not outweigh the scheduling overhead. The calls must only read the
+    // reconstruction. The estimates are deterministic, since RANSAC samples
+    // the combinations of the correspondences in a fixed order with
+    // `CombinationSampler` and does not draw from the PRNG. The results thus
+    // do not depend on which thread estimates which item.
+    template <typename func_t>
+    void ParallelEstimate(const Options& options, const size_t num_items,
+      const size_t min_num_items, const func_t& func) const;
+
+    // Apply the proposals in order and return the number of added
+    // observations. Proposals that read an observation triangulated by a
+    // previous proposal are re-estimated by calling `retriangulate` with the
+    // index of the proposal.
+    size_t ApplyProposals(
+      const std::vector<TriangulationProposal>& proposals,
+      const std::function<size_t(const size_t)>& retriangulate);
+
     // Find (transitive) correspondences to other images.
     size_t Find(const Options& options, const image_t image_id,
       const point2D_t point2D_idx, const size_t transitivity,
-      std::vector<CorrData>* corrs_data);
+      std::vector<CorrData>* corrs_data) const;
+
+    // Estimate the new 3D points that `Create` would add for the given
+    // correspondences without modifying the reconstruction.
+    void EstimateCreate(const Options& options,
+      const std::vector<CorrData>& corrs_data, const bool initial,
+      std::vector<EstimatedPoint3D>* points3D) const;
+
+    // Estimate the new 3D points of the given proposals, whose two
+    // correspondences are both untriangulated, in batches of points. This is
+    // equivalent to `EstimateCreate` for two correspondences, which is solved
+    // directly without RANSAC.
+    void EstimateCreatePairs(const Options& options,
+      const std::vector<size_t>& proposal_idxs,
+      std::vector<TriangulationProposal>* proposals) const;
 
     // Try to create a new 3D point from the given correspondences.
     size_t Create(const Options& options,
       const std::vector<CorrData>& corrs_data, bool initial = false, bool standard_triangulation = false, bool update_calibration = false, bool false_update = false);
     // size_t CreateInitial(
     //   const Options& options, const std::vector<CorrData>& corrs_data);
+    // Find the 3D point of the correspondences that the reference observation
+    // would continue, or `kInvalidPoint3DId` if there is none.
+    point3D_t EstimateContinue(const Options& options,
+      const CorrData& ref_corr_data,
+      const std::vector<CorrData>& corrs_data) const;
+
     // Try to continue the 3D point with the given correspondences.
     size_t Continue(const Options& options, const CorrData& ref_corr_data,
       const std::vector<CorrData>& corrs_data);
@@ -186,9 +265,19 @@ namespace colmap {
     // Try to merge 3D point with any of its corresponding 3D points.
     size_t Merge(const Options& options, const point3D_t point3D_id);
 
+    // Find the observations that `Complete` would add to the track of a 3D
+    // point without modifying the reconstruction.
+    void EstimateComplete(const Options& options, const point3D_t point3D_id,
+      std::vector<TrackElement>* track_els) const;
+
     // Try to transitively complete the track of a 3D point.
     size_t Complete(const Options& options, const point3D_t point3D_id);
 
+    // Complete the tracks of the given 3D points in parallel and apply the
+    // completions in the given order.
+    size_t CompletePoints3D(const Options& options,
+      const std::vector<point3D_t>& point3D_ids);
+
     // Check if camera has bogus parameters and cache the result.
     bool HasCameraBogusParams(const Options& options, const Camera& camera);
 
@@ -211,6 +300,12 @@ namespace colmap {
     // Changed 3D points, i.e. if a 3D point is modified (created, continued,
     // deleted, merged, etc.). Cleared once `ModifiedPoints3D` is called.
     std::unordered_set<point3D_t> modified_point3D_ids_;
+
+    // Cameras whose calibration is shared by another reconstruction.
+    std::unordered_set<camera_t> shared_calibration_camera_ids_;
+
+    // Thread pool for the parallel estimation passes.
+    mutable std::unique_ptr<ThreadPool> thread_pool_;
   };
 
 }  // namespace colmap
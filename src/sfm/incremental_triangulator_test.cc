@@ -0,0 +1,226 @@
+// Copyright (c) 2018, ETH Zurich and UNC Chapel Hill.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//
+//     * Neither the name of ETH Zurich and UNC Chapel Hill nor the names of
+//       its contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Author: Johannes L. Schoenberger (jsch-at-demuc-dot-de)
+
+#define TEST_NAME "sfm/incremental_triangulator"
+#include "util/testing.h"
+
+#include <random>
+
+#include "base/database.h"
+#include "base/database_cache.h"
+#include "base/pose.h"
+#include "sfm/incremental_triangulator.h"
+
+using namespace colmap;
+
+namespace {
+
+const size_t kNumImages = 7;
+const size_t kNumPoints3D = 200;
+const size_t kNumClutterPoints2D = 20;
+const double kFocalLength = 1000;
+
+// Create an IMPLICIT_DISTORTION camera, which is calibrated as a pinhole
+// camera with the given focal length.
+Camera CreateCalibratedCamera() {
+  Camera camera;
+  camera.SetCameraId(1);
+  camera.SetModelId(ImplicitDistortionModel::model_id);
+  camera.SetWidth(1000);
+  camera.SetHeight(1000);
+  camera.Params(0) = 500;
+  camera.Params(1) = 500;
+  const int num_control_points = (ImplicitDistortionModel::kNumParams - 2) / 2;
+  for (int i = 0; i < num_control_points; ++i) {
+    const double theta = 0.6 * i / (num_control_points - 1);
+    camera.Params(2 + i) = theta;
+    camera.Params(2 + num_control_points + i) = kFocalLength * std::tan(theta);
+  }
+  camera.SetCalibrated(true);
+  camera.SetSplineFromParams();
+  return camera;
+}
+
+// Rotation and projection center of images on a circle around the points.
+void ImagePose(const image_t image_id, Eigen::Matrix3d* R,
+               Eigen::Vector3d* proj_center) {
+  const double angle = 0.15 * image_id;
+  *R << std::cos(angle), 0, std::sin(angle), 0, 1, 0, -std::sin(angle), 0,
+      std::cos(angle);
+  *proj_center = Eigen::Vector3d(8 * std::sin(angle), 0, -8 * std::cos(angle));
+}
+
+// Write images that observe all points with noise and some clutter to the
+// database. Every tenth pair of points is swapped in the matches between two
+// images, so that the estimated triangulations of different observations
+// share correspondences.
+void CreateDatabase(Database* database) {
+  std::mt19937 prng(42);
+  std::uniform_real_distribution<double> point_distribution(-1, 1);
+  std::uniform_real_distribution<double> clutter_distribution(0, 1000);
+  std::normal_distribution<double> noise_distribution(0, 0.5);
+
+  // Every odd point projects a few pixels next to its predecessor, such that
+  // the swapped points are distinguished by the triangulation but not by the
+  // track completion.
+  std::vector<Eigen::Vector3d> points3D(kNumPoints3D);
+  for (size_t i = 0; i < kNumPoints3D; ++i) {
+    points3D[i] = Eigen::Vector3d(point_distribution(prng),
+                                  point_distribution(prng),
+                                  point_distribution(prng));
+    if (i % 2 == 1) {
+      points3D[i] = points3D[i - 1] + 0.025 * points3D[i].normalized();
+    }
+  }
+
+  database->WriteCamera(CreateCalibratedCamera(), true);
+
+  const size_t num_points2D = kNumPoints3D + kNumClutterPoints2D;
+  for (image_t image_id = 1; image_id <= kNumImages; ++image_id) {
+    Eigen::Matrix3d R;
+    Eigen::Vector3d proj_center;
+    ImagePose(image_id, &R, &proj_center);
+
+    FeatureKeypoints keypoints;
+    keypoints.reserve(num_points2D);
+    for (const auto& xyz : points3D) {
+      const Eigen::Vector3d point = R * (xyz - proj_center);
+      keypoints.emplace_back(
+          kFocalLength * point.x() / point.z() + 500 + noise_distribution(prng),
+          kFocalLength * point.y() / point.z() + 500 +
+              noise_distribution(prng));
+    }
+    for (size_t i = 0; i < kNumClutterPoints2D; ++i) {
+      keypoints.emplace_back(clutter_distribution(prng),
+                             clutter_distribution(prng));
+    }
+
+    Image image;
+    image.SetImageId(image_id);
+    image.SetCameraId(1);
+    image.SetName(std::to_string(image_id));
+    database->WriteImage(image, true);
+    database->WriteKeypoints(image_id, keypoints);
+  }
+
+  for (image_t image_id1 = 1; image_id1 <= kNumImages; ++image_id1) {
+    for (image_t image_id2 = image_id1 + 1; image_id2 <= kNumImages;
+         ++image_id2) {
+      const point2D_t swap_offset = 2 * ((image_id1 + image_id2) % 5);
+      TwoViewGeometry two_view_geometry;
+      two_view_geometry.config = TwoViewGeometry::CALIBRATED;
+      for (point2D_t point2D_idx = 0; point2D_idx < num_points2D;
+           ++point2D_idx) {
+        point2D_t corr_point2D_idx = point2D_idx;
+        if (point2D_idx % 10 == swap_offset) {
+          corr_point2D_idx += 1;
+        } else if (point2D_idx % 10 == swap_offset + 1) {
+          corr_point2D_idx -= 1;
+        }
+        two_view_geometry.inlier_matches.emplace_back(point2D_idx,
+                                                      corr_point2D_idx);
+      }
+      database->WriteTwoViewGeometry(image_id1, image_id2, two_view_geometry);
+    }
+  }
+}
+
+// Register the images with their poses, triangulate them one after another
+// and complete the tracks. The last image is registered after the
+// triangulation, so that its observations are only added by the completion.
+void Triangulate(const int num_threads, const DatabaseCache& database_cache,
+                 Reconstruction* reconstruction) {
+  reconstruction->Load(database_cache);
+  // The calibration of the camera is not stored in the database.
+  reconstruction->Camera(1) = CreateCalibratedCamera();
+  for (image_t image_id = 1; image_id <= kNumImages; ++image_id) {
+    Eigen::Matrix3d R;
+    Eigen::Vector3d proj_center;
+    ImagePose(image_id, &R, &proj_center);
+    Image& image = reconstruction->Image(image_id);
+    image.SetQvec(RotationMatrixToQuaternion(R));
+    image.SetTvec(-R * proj_center);
+  }
+  reconstruction->SetUp(&database_cache.CorrespondenceGraph());
+
+  IncrementalTriangulator::Options options;
+  options.num_threads = num_threads;
+  // Transitive correspondences link the swapped points.
+  options.max_transitivity = 2;
+  options.create_max_angle_error = 0.1;
+  options.continue_max_angle_error = 0.1;
+  IncrementalTriangulator triangulator(&database_cache.CorrespondenceGraph(),
+                                       reconstruction);
+  for (image_t image_id = 1; image_id < kNumImages; ++image_id) {
+    reconstruction->RegisterImage(image_id);
+  }
+  for (image_t image_id = 1; image_id < kNumImages; ++image_id) {
+    triangulator.TriangulateImage(options, image_id);
+  }
+  reconstruction->RegisterImage(kNumImages);
+  triangulator.CompleteAllTracks(options);
+}
+
+}  // namespace
+
+BOOST_AUTO_TEST_CASE(TestParallelEqualsSerial) {
+  Database database(":memory:");
+  CreateDatabase(&database);
+  DatabaseCache database_cache;
+  database_cache.Load(database, 0, false, {});
+
+  Reconstruction ref_reconstruction;
+  Triangulate(1, database_cache, &ref_reconstruction);
+  // Enough points are triangulated to estimate the proposals in parallel.
+  BOOST_CHECK_GT(ref_reconstruction.NumPoints3D(), 64);
+
+  for (const int num_threads : {2, 4}) {
+    Reconstruction reconstruction;
+    Triangulate(num_threads, database_cache, &reconstruction);
+
+    BOOST_CHECK_EQUAL(reconstruction.NumPoints3D(),
+                      ref_reconstruction.NumPoints3D());
+    for (const auto& ref_point3D : ref_reconstruction.Points3D()) {
+      BOOST_REQUIRE(reconstruction.ExistsPoint3D(ref_point3D.first));
+      const Point3D& point3D = reconstruction.Point3D(ref_point3D.first);
+      BOOST_CHECK_LT((point3D.XYZ() - ref_point3D.second.XYZ()).norm(), 1e-9);
+
+      const auto& ref_track_els = ref_point3D.second.Track().Elements();
+      const auto& track_els = point3D.Track().Elements();
+      BOOST_REQUIRE_EQUAL(track_els.size(), ref_track_els.size());
+      for (size_t i = 0; i < track_els.size(); ++i) {
+        BOOST_CHECK_EQUAL(track_els[i].image_id, ref_track_els[i].image_id);
+        BOOST_CHECK_EQUAL(track_els[i].point2D_idx,
+                          ref_track_els[i].point2D_idx);
+      }
+    }
+  }
+}
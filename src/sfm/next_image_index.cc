@@ -0,0 +1,104 @@
+// Copyright (c) 2018, ETH Zurich and UNC Chapel Hill.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//
+//     * Neither the name of ETH Zurich and UNC Chapel Hill nor the names of
+//       its contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Author: Johannes L. Schoenberger (jsch-at-demuc-dot-de)
+
+
+#include "sfm/next_image_index.h"
+
+#include <algorithm>
+
+namespace colmap {
+
+  bool NextImageIndex::Entry::operator<(const Entry& other) const {
+    if (preferred != other.preferred) {
+      return preferred;
+    }
+    if (rank != other.rank) {
+      return rank > other.rank;
+    }
+    return image_id < other.image_id;
+  }
+
+  void NextImageIndex::Update(const image_t image_id, const bool preferred,
+    const float rank) {
+    Entry entry;
+    entry.preferred = preferred;
+    entry.rank = rank;
+    entry.image_id = image_id;
+
+    const auto it = entries_.find(image_id);
+    if (it == entries_.end()) {
+      entries_.emplace(image_id, entry);
+    }
+    else {
+      if (it->second.preferred == preferred && it->second.rank == rank) {
+        return;
+      }
+      ordered_entries_.erase(it->second);
+      it->second = entry;
+    }
+
+    ordered_entries_.insert(entry);
+  }
+
+  void NextImageIndex::Remove(const image_t image_id) {
+    const auto it = entries_.find(image_id);
+    if (it == entries_.end()) {
+      return;
+    }
+    ordered_entries_.erase(it->second);
+    entries_.erase(it);
+  }
+
+  void NextImageIndex::Clear() {
+    ordered_entries_.clear();
+    entries_.clear();
+  }
+
+  size_t NextImageIndex::NumImages() const { return entries_.size(); }
+
+  bool NextImageIndex::HasImage(const image_t image_id) const {
+    return entries_.count(image_id) > 0;
+  }
+
+  std::vector<image_t> NextImageIndex::TopImages(
+    const size_t max_num_images) const {
+    std::vector<image_t> image_ids;
+    image_ids.reserve(std::min(max_num_images, ordered_entries_.size()));
+    for (const auto& entry : ordered_entries_) {
+      if (image_ids.size() >= max_num_images) {
+        break;
+      }
+      image_ids.push_back(entry.image_id);
+    }
+    return image_ids;
+  }
+
+}  // namespace colmap
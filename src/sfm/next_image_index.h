@@ -0,0 +1,87 @@
+// Copyright (c) 2018, ETH Zurich and UNC Chapel Hill.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//
+//     * Neither the name of ETH Zurich and UNC Chapel Hill nor the names of
+//       its contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Author: Johannes L. Schoenberger (jsch-at-demuc-dot-de)
+
+
+#ifndef COLMAP_SRC_SFM_NEXT_IMAGE_INDEX_H_
+#define COLMAP_SRC_SFM_NEXT_IMAGE_INDEX_H_
+
+#include <limits>
+#include <set>
+#include <unordered_map>
+#include <vector>
+
+#include "util/types.h"
+
+namespace colmap {
+
+  // Ordered index of the candidate images for the next registration in the
+  // incremental mapper. Each image is ranked by a score and the images in the
+  // preferred group, i.e., images that have not been tried before, come before
+  // all other images. Updating the rank of an image takes O(log N) and
+  // querying the best k images takes O(log N + k), so that the candidates do
+  // not have to be re-ranked and sorted after every registration.
+  class NextImageIndex {
+  public:
+    // Insert an image or update its rank if it is already in the index.
+    void Update(const image_t image_id, const bool preferred, const float rank);
+
+    // Remove an image from the index, if it exists.
+    void Remove(const image_t image_id);
+
+    // Remove all images from the index.
+    void Clear();
+
+    size_t NumImages() const;
+    bool HasImage(const image_t image_id) const;
+
+    // Return the identifiers of the best images, first the preferred images in
+    // descending order of rank and then all other images in descending order
+    // of rank. Images of equal rank are ordered by their identifier.
+    std::vector<image_t> TopImages(
+      const size_t max_num_images =
+      std::numeric_limits<size_t>::max()) const;
+
+  private:
+    struct Entry {
+      bool preferred;
+      float rank;
+      image_t image_id;
+
+      bool operator<(const Entry& other) const;
+    };
+
+    std::set<Entry> ordered_entries_;
+    std::unordered_map<image_t, Entry> entries_;
+  };
+
+}  // namespace colmap
+
+#endif  // COLMAP_SRC_SFM_NEXT_IMAGE_INDEX_H_
@@ -0,0 +1,140 @@
+// Copyright (c) 2018, ETH Zurich and UNC Chapel Hill.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//
+//     * Neither the name of ETH Zurich and UNC Chapel Hill nor the names of
+//       its contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Author: Johannes L. Schoenberger (jsch-at-demuc-dot-de)
+
+#define TEST_NAME "sfm/next_image_index"
+#include "util/testing.h"
+
+#include "sfm/next_image_index.h"
+
+using namespace colmap;
+
+BOOST_AUTO_TEST_CASE(TestEmpty) {
+  NextImageIndex index;
+  BOOST_CHECK_EQUAL(index.NumImages(), 0);
+  BOOST_CHECK(!index.HasImage(1));
+  BOOST_CHECK(index.TopImages().empty());
+  BOOST_CHECK(index.TopImages(1).empty());
+}
+
+BOOST_AUTO_TEST_CASE(TestOrdering) {
+  NextImageIndex index;
+  index.Update(1, false, 10);
+  index.Update(2, true, 1);
+  index.Update(3, true, 5);
+  index.Update(4, false, 20);
+  index.Update(5, true, 5);
+  index.Update(6, false, 10);
+  BOOST_CHECK_EQUAL(index.NumImages(), 6);
+
+  // Preferred images first, then descending rank, then ascending identifier.
+  const std::vector<image_t> ref_image_ids = {3, 5, 2, 4, 1, 6};
+  const auto image_ids = index.TopImages();
+  BOOST_CHECK_EQUAL_COLLECTIONS(image_ids.begin(), image_ids.end(),
+                                ref_image_ids.begin(), ref_image_ids.end());
+}
+
+BOOST_AUTO_TEST_CASE(TestUpdate) {
+  NextImageIndex index;
+  index.Update(1, true, 1);
+  index.Update(2, true, 2);
+  index.Update(3, true, 3);
+
+  // Updating the rank moves the image.
+  index.Update(1, true, 4);
+  std::vector<image_t> ref_image_ids = {1, 3, 2};
+  auto image_ids = index.TopImages();
+  BOOST_CHECK_EQUAL_COLLECTIONS(image_ids.begin(), image_ids.end(),
+                                ref_image_ids.begin(), ref_image_ids.end());
+
+  // Leaving the preferred group moves the image behind all preferred images.
+  index.Update(1, false, 4);
+  ref_image_ids = {3, 2, 1};
+  image_ids = index.TopImages();
+  BOOST_CHECK_EQUAL_COLLECTIONS(image_ids.begin(), image_ids.end(),
+                                ref_image_ids.begin(), ref_image_ids.end());
+
+  // Updating with an unchanged rank does not duplicate the image.
+  index.Update(2, true, 2);
+  BOOST_CHECK_EQUAL(index.NumImages(), 3);
+  BOOST_CHECK_EQUAL(index.TopImages().size(), 3);
+}
+
+BOOST_AUTO_TEST_CASE(TestRemove) {
+  NextImageIndex index;
+  index.Update(1, true, 1);
+  index.Update(2, true, 2);
+  index.Update(3, false, 3);
+
+  index.Remove(2);
+  BOOST_CHECK_EQUAL(index.NumImages(), 2);
+  BOOST_CHECK(!index.HasImage(2));
+  std::vector<image_t> ref_image_ids = {1, 3};
+  auto image_ids = index.TopImages();
+  BOOST_CHECK_EQUAL_COLLECTIONS(image_ids.begin(), image_ids.end(),
+                                ref_image_ids.begin(), ref_image_ids.end());
+
+  // Removing a missing image has no effect.
+  index.Remove(2);
+  index.Remove(4);
+  BOOST_CHECK_EQUAL(index.NumImages(), 2);
+
+  // Removed images can be inserted again.
+  index.Update(2, false, 4);
+  ref_image_ids = {1, 2, 3};
+  image_ids = index.TopImages();
+  BOOST_CHECK_EQUAL_COLLECTIONS(image_ids.begin(), image_ids.end(),
+                                ref_image_ids.begin(), ref_image_ids.end());
+
+  index.Clear();
+  BOOST_CHECK_EQUAL(index.NumImages(), 0);
+  BOOST_CHECK(index.TopImages().empty());
+}
+
+BOOST_AUTO_TEST_CASE(TestTopImages) {
+  NextImageIndex index;
+  for (image_t image_id = 1; image_id <= 10; ++image_id) {
+    index.Update(image_id, image_id % 2 == 0, static_cast<float>(image_id));
+  }
+
+  BOOST_CHECK(index.TopImages(0).empty());
+
+  std::vector<image_t> ref_image_ids = {10, 8, 6};
+  auto image_ids = index.TopImages(3);
+  BOOST_CHECK_EQUAL_COLLECTIONS(image_ids.begin(), image_ids.end(),
+                                ref_image_ids.begin(), ref_image_ids.end());
+
+  ref_image_ids = {10, 8, 6, 4, 2, 9, 7};
+  image_ids = index.TopImages(7);
+  BOOST_CHECK_EQUAL_COLLECTIONS(image_ids.begin(), image_ids.end(),
+                                ref_image_ids.begin(), ref_image_ids.end());
+
+  BOOST_CHECK_EQUAL(index.TopImages(20).size(), 10);
+}
@@ -56,6 +56,7 @@ class StereoOptionsTab : public OptionsWidget {
     AddOptionInt(&options->patch_match_stereo->max_image_size, "max_image_size",
                  -1);
     AddOptionText(&options->patch_match_stereo->gpu_index, "gpu_index");
+    AddOptionInt(&options->patch_match_stereo->num_threads, "num_threads", -1);
     AddOptionDouble(&options->patch_match_stereo->depth_min, "depth_min", -1);
     AddOptionDouble(&options->patch_match_stereo->depth_max, "depth_max", -1);
     AddOptionInt(&options->patch_match_stereo->window_radius, "window_radius");
@@ -93,6 +94,8 @@ class StereoOptionsTab : public OptionsWidget {
                     std::numeric_limits<double>::max(), 0.1, 1);
     AddOptionBool(&options->patch_match_stereo->write_consistency_graph,
                   "write_consistency_graph");
+    AddOptionBool(&options->patch_match_stereo->write_float16_maps,
+                  "write_float16_maps");
   }
 };
 
@@ -116,6 +119,7 @@ class FusionOptionsTab : public OptionsWidget {
     AddOptionDouble(&options->stereo_fusion->cache_size,
                     "cache_size [gigabytes]", 0,
                     std::numeric_limits<double>::max(), 0.1, 1);
+    AddOptionInt(&options->stereo_fusion->num_threads, "num_threads", -1);
   }
 };
 
@@ -129,6 +133,12 @@ class MeshingOptionsTab : public OptionsWidget {
     AddOptionDouble(&options->poisson_meshing->color, "color", 0);
     AddOptionDouble(&options->poisson_meshing->trim, "trim", 0);
     AddOptionInt(&options->poisson_meshing->num_threads, "num_threads", -1);
+    AddOptionInt(&options->poisson_meshing->block_max_num_points,
+                 "block_max_num_points", 0);
+    AddOptionDouble(&options->poisson_meshing->block_overlap, "block_overlap",
+                    0);
+    AddOptionInt(&options->poisson_meshing->block_chunk_size,
+                 "block_chunk_size", 1);
 
     AddSection("Delaunay Meshing");
     AddOptionDouble(&options->delaunay_meshing->max_proj_dist, "max_proj_dist",
@@ -336,17 +346,11 @@ void DenseReconstructionWidget::Stereo() {
     return;
   }
 
-#ifdef CUDA_ENABLED
   mvs::PatchMatchController* processor = new mvs::PatchMatchController(
       *options_->patch_match_stereo, workspace_path, "COLMAP", "");
   processor->AddCallback(Thread::FINISHED_CALLBACK,
                          [this]() { refresh_workspace_action_->trigger(); });
   thread_control_widget_->StartThread("Stereo...", true, processor);
-#else
-  QMessageBox::critical(this, "",
-                        tr("Dense stereo reconstruction requires CUDA, which "
-                           "is not available on your system."));
-#endif
 }
 
 void DenseReconstructionWidget::Fusion() {
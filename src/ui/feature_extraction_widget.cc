@@ -100,6 +100,19 @@ SIFTExtractionWidget::SIFTExtractionWidget(QWidget* parent,
   AddOptionDouble(&options->sift_extraction->dsp_max_scale, "dsp_max_scale",
                   0.0, 1e7, 0.00001, 5);
   AddOptionInt(&options->sift_extraction->dsp_num_scales, "dsp_num_scales", 1);
+  AddOptionBool(&options->sift_extraction->write_descriptor_codes,
+                "write_descriptor_codes");
+  AddOptionBool(&options->sift_extraction->descriptor_codes_only,
+                "descriptor_codes_only");
+  AddOptionBool(&options->sift_extraction->split_views, "split_views");
+  AddOptionInt(&options->sift_extraction->split_num_views, "split_num_views",
+               2);
+  AddOptionDouble(&options->sift_extraction->split_min_radius,
+                  "split_min_radius");
+  AddOptionDouble(&options->sift_extraction->split_max_radius,
+                  "split_max_radius");
+  AddOptionDouble(&options->sift_extraction->split_max_duplicate_distance,
+                  "split_max_duplicate_distance");
 
   AddOptionInt(&options->sift_extraction->num_threads, "num_threads", -1);
   AddOptionBool(&options->sift_extraction->use_gpu, "use_gpu");
@@ -132,6 +132,17 @@ void FeatureMatchingTab::CreateGeneralOptions() {
                                  "multiple_models");
   options_widget_->AddOptionBool(&options_->sift_matching->guided_matching,
                                  "guided_matching");
+  options_widget_->AddOptionBool(
+      &options_->sift_matching->use_descriptor_codes, "use_descriptor_codes");
+  options_widget_->AddOptionInt(
+      &options_->sift_matching->num_descriptor_code_candidates,
+      "num_descriptor_code_candidates", 2);
+  options_widget_->AddOptionDouble(
+      &options_->sift_matching->descriptor_code_max_ratio,
+      "descriptor_code_max_ratio");
+  options_widget_->AddOptionDouble(&options_->sift_matching->cache_size,
+                                   "cache_size [gigabytes]", 0,
+                                   std::numeric_limits<double>::max(), 0.1, 1);
 
   options_widget_->AddSpacer();
 
@@ -229,6 +240,8 @@ VocabTreeMatchingTab::VocabTreeMatchingTab(QWidget* parent,
       &options_->vocab_tree_matching->max_num_features, "max_num_features", -1);
   options_widget_->AddOptionFilePath(
       &options_->vocab_tree_matching->vocab_tree_path, "vocab_tree_path");
+  options_widget_->AddOptionFilePath(
+      &options_->vocab_tree_matching->index_path, "index_path");
 
   CreateGeneralOptions();
 }
@@ -236,7 +249,8 @@ VocabTreeMatchingTab::VocabTreeMatchingTab(QWidget* parent,
 void VocabTreeMatchingTab::Run() {
   options_widget_->WriteOptions();
 
-  if (!ExistsFile(options_->vocab_tree_matching->vocab_tree_path)) {
+  if (!ExistsFile(options_->vocab_tree_matching->vocab_tree_path) &&
+      !ExistsFile(options_->vocab_tree_matching->index_path)) {
     QMessageBox::critical(this, "", tr("Invalid vocabulary tree path."));
     return;
   }
@@ -199,6 +199,12 @@ const uint8_t* Bitmap::GetScanline(const int y) const {
   return FreeImage_GetScanLine(data_.get(), height_ - 1 - y);
 }
 
+uint8_t* Bitmap::GetScanline(const int y) {
+  CHECK_GE(y, 0);
+  CHECK_LT(y, height_);
+  return FreeImage_GetScanLine(data_.get(), height_ - 1 - y);
+}
+
 void Bitmap::Fill(const BitmapColor<uint8_t>& color) {
   for (int y = 0; y < height_; ++y) {
     uint8_t* line = FreeImage_GetScanLine(data_.get(), height_ - 1 - y);
@@ -132,6 +132,7 @@ class Bitmap {
 
   // Get pointer to y-th scanline, where the 0-th scanline is at the top.
   const uint8_t* GetScanline(const int y) const;
+  uint8_t* GetScanline(const int y);
 
   // Fill entire bitmap with uniform color. For grayscale images, the first
   // element of the vector is used.
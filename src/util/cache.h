@@ -32,9 +32,15 @@
 #ifndef COLMAP_SRC_UTIL_CACHE_H_
 #define COLMAP_SRC_UTIL_CACHE_H_
 
+#include <algorithm>
+#include <atomic>
+#include <functional>
 #include <iostream>
 #include <list>
+#include <memory>
+#include <mutex>
 #include <unordered_map>
+#include <vector>
 
 #include "util/logging.h"
 
@@ -119,6 +125,57 @@ class MemoryConstrainedLRUCache : public LRUCache<key_t, value_t> {
   std::unordered_map<key_t, size_t> elems_num_bytes_;
 };
 
+// Thread-safe least recently used cache that is constrained by a maximum
+// memory limitation of its elements. The keys are distributed over multiple
+// independently locked shards, such that concurrent accesses to different keys
+// rarely contend, and missing values are computed without holding any lock.
+// Values are returned by copy and should thus be cheap to copy, e.g., by
+// wrapping large data in a `std::shared_ptr`, which also keeps the data valid
+// for the caller when the element is evicted from the cache.
+template <typename key_t, typename value_t>
+class ShardedMemoryConstrainedLRUCache {
+ public:
+  ShardedMemoryConstrainedLRUCache(
+      const size_t max_num_bytes, const size_t num_shards,
+      const std::function<value_t(const key_t&)>& getter_func);
+
+  size_t NumElems() const;
+  size_t NumBytes() const;
+  size_t MaxNumBytes() const;
+
+  // The number of calls to `Get` that found or did not find the element.
+  size_t NumHits() const;
+  size_t NumMisses() const;
+
+  // Check whether the element with the given key exists.
+  bool Exists(const key_t& key) const;
+
+  // Get the value of an element either from the cache or compute the new value.
+  // If multiple threads concurrently miss the same key, each of them computes
+  // the value, but only the first one is inserted into the cache.
+  value_t Get(const key_t& key);
+
+  // Clear all elements from cache.
+  void Clear();
+
+ private:
+  struct Shard {
+    Shard(const size_t max_num_bytes,
+          const std::function<value_t(const key_t&)>& getter_func)
+        : cache(max_num_bytes, getter_func) {}
+    std::mutex mutex;
+    MemoryConstrainedLRUCache<key_t, value_t> cache;
+  };
+
+  Shard& GetShard(const key_t& key) const;
+
+  const size_t max_num_bytes_;
+  const std::function<value_t(const key_t&)> getter_func_;
+  std::vector<std::unique_ptr<Shard>> shards_;
+  std::atomic<size_t> num_hits_;
+  std::atomic<size_t> num_misses_;
+};
+
 ////////////////////////////////////////////////////////////////////////////////
 // Implementation
 ////////////////////////////////////////////////////////////////////////////////
@@ -217,15 +274,19 @@ size_t MemoryConstrainedLRUCache<key_t, value_t>::MaxNumBytes() const {
 template <typename key_t, typename value_t>
 void MemoryConstrainedLRUCache<key_t, value_t>::Set(const key_t& key,
                                                     value_t&& value) {
+  // Note that the size must be queried before the value is moved.
+  const size_t num_bytes = value.NumBytes();
+
   auto it = elems_map_.find(key);
   elems_list_.push_front(key_value_pair_t(key, std::move(value)));
   if (it != elems_map_.end()) {
     elems_list_.erase(it->second);
     elems_map_.erase(it);
+    num_bytes_ -= elems_num_bytes_.at(key);
+    elems_num_bytes_.erase(key);
   }
   elems_map_[key] = elems_list_.begin();
 
-  const size_t num_bytes = value.NumBytes();
   num_bytes_ += num_bytes;
   elems_num_bytes_.emplace(key, num_bytes);
 
@@ -268,6 +329,109 @@ void MemoryConstrainedLRUCache<key_t, value_t>::Clear() {
   elems_num_bytes_.clear();
 }
 
+template <typename key_t, typename value_t>
+ShardedMemoryConstrainedLRUCache<key_t, value_t>::
+    ShardedMemoryConstrainedLRUCache(
+        const size_t max_num_bytes, const size_t num_shards,
+        const std::function<value_t(const key_t&)>& getter_func)
+    : max_num_bytes_(max_num_bytes),
+      getter_func_(getter_func),
+      num_hits_(0),
+      num_misses_(0) {
+  CHECK(getter_func);
+  CHECK_GT(max_num_bytes, 0);
+  CHECK_GT(num_shards, 0);
+  const size_t max_num_shard_bytes =
+      std::max<size_t>(1, max_num_bytes / num_shards);
+  shards_.reserve(num_shards);
+  for (size_t i = 0; i < num_shards; ++i) {
+    shards_.emplace_back(new Shard(max_num_shard_bytes, getter_func));
+  }
+}
+
+template <typename key_t, typename value_t>
+size_t ShardedMemoryConstrainedLRUCache<key_t, value_t>::NumElems() const {
+  size_t num_elems = 0;
+  for (const auto& shard : shards_) {
+    std::unique_lock<std::mutex> lock(shard->mutex);
+    num_elems += shard->cache.NumElems();
+  }
+  return num_elems;
+}
+
+template <typename key_t, typename value_t>
+size_t ShardedMemoryConstrainedLRUCache<key_t, value_t>::NumBytes() const {
+  size_t num_bytes = 0;
+  for (const auto& shard : shards_) {
+    std::unique_lock<std::mutex> lock(shard->mutex);
+    num_bytes += shard->cache.NumBytes();
+  }
+  return num_bytes;
+}
+
+template <typename key_t, typename value_t>
+size_t ShardedMemoryConstrainedLRUCache<key_t, value_t>::MaxNumBytes() const {
+  return max_num_bytes_;
+}
+
+template <typename key_t, typename value_t>
+size_t ShardedMemoryConstrainedLRUCache<key_t, value_t>::NumHits() const {
+  return num_hits_;
+}
+
+template <typename key_t, typename value_t>
+size_t ShardedMemoryConstrainedLRUCache<key_t, value_t>::NumMisses() const {
+  return num_misses_;
+}
+
+template <typename key_t, typename value_t>
+bool ShardedMemoryConstrainedLRUCache<key_t, value_t>::Exists(
+    const key_t& key) const {
+  Shard& shard = GetShard(key);
+  std::unique_lock<std::mutex> lock(shard.mutex);
+  return shard.cache.Exists(key);
+}
+
+template <typename key_t, typename value_t>
+value_t ShardedMemoryConstrainedLRUCache<key_t, value_t>::Get(
+    const key_t& key) {
+  Shard& shard = GetShard(key);
+
+  {
+    std::unique_lock<std::mutex> lock(shard.mutex);
+    if (shard.cache.Exists(key)) {
+      num_hits_ += 1;
+      return shard.cache.Get(key);
+    }
+  }
+
+  num_misses_ += 1;
+
+  value_t value = getter_func_(key);
+
+  std::unique_lock<std::mutex> lock(shard.mutex);
+  if (shard.cache.Exists(key)) {
+    return shard.cache.Get(key);
+  }
+  shard.cache.Set(key, value_t(value));
+  return value;
+}
+
+template <typename key_t, typename value_t>
+void ShardedMemoryConstrainedLRUCache<key_t, value_t>::Clear() {
+  for (auto& shard : shards_) {
+    std::unique_lock<std::mutex> lock(shard->mutex);
+    shard->cache.Clear();
+  }
+}
+
+template <typename key_t, typename value_t>
+typename ShardedMemoryConstrainedLRUCache<key_t, value_t>::Shard&
+ShardedMemoryConstrainedLRUCache<key_t, value_t>::GetShard(
+    const key_t& key) const {
+  return *shards_[std::hash<key_t>()(key) % shards_.size()];
+}
+
 }  // namespace colmap
 
 #endif  // COLMAP_SRC_UTIL_CACHE_H_
@@ -32,6 +32,8 @@
 #define TEST_NAME "util/cache"
 #include "util/testing.h"
 
+#include <thread>
+
 #include "util/cache.h"
 
 using namespace colmap;
@@ -271,3 +273,80 @@ BOOST_AUTO_TEST_CASE(TestMemoryConstrainedLRUCacheUpdateNumBytes) {
   BOOST_CHECK_EQUAL(cache.Get(2).NumBytes(), 2);
   BOOST_CHECK_EQUAL(cache.NumBytes(), 2);
 }
+
+BOOST_AUTO_TEST_CASE(TestMemoryConstrainedLRUCacheSet) {
+  MemoryConstrainedLRUCache<int, SizedElem> cache(
+      10, [](const int key) { return SizedElem(key); });
+  cache.Set(0, SizedElem(4));
+  BOOST_CHECK_EQUAL(cache.NumBytes(), 4);
+  cache.Set(0, SizedElem(2));
+  BOOST_CHECK_EQUAL(cache.NumElems(), 1);
+  BOOST_CHECK_EQUAL(cache.NumBytes(), 2);
+  cache.Set(1, SizedElem(9));
+  BOOST_CHECK_EQUAL(cache.NumElems(), 1);
+  BOOST_CHECK_EQUAL(cache.NumBytes(), 9);
+  BOOST_CHECK(!cache.Exists(0));
+  BOOST_CHECK(cache.Exists(1));
+}
+
+BOOST_AUTO_TEST_CASE(TestShardedMemoryConstrainedLRUCacheEmpty) {
+  ShardedMemoryConstrainedLRUCache<int, SizedElem> cache(
+      20, 2, [](const int key) { return SizedElem(key); });
+  BOOST_CHECK_EQUAL(cache.NumElems(), 0);
+  BOOST_CHECK_EQUAL(cache.NumBytes(), 0);
+  BOOST_CHECK_EQUAL(cache.MaxNumBytes(), 20);
+  BOOST_CHECK_EQUAL(cache.NumHits(), 0);
+  BOOST_CHECK_EQUAL(cache.NumMisses(), 0);
+}
+
+BOOST_AUTO_TEST_CASE(TestShardedMemoryConstrainedLRUCacheGet) {
+  ShardedMemoryConstrainedLRUCache<int, SizedElem> cache(
+      20, 2, [](const int key) { return SizedElem(key); });
+  for (int i = 0; i < 4; ++i) {
+    BOOST_CHECK_EQUAL(cache.Get(i).NumBytes(), i);
+    BOOST_CHECK(cache.Exists(i));
+  }
+  BOOST_CHECK_EQUAL(cache.NumElems(), 4);
+  BOOST_CHECK_EQUAL(cache.NumBytes(), 6);
+  BOOST_CHECK_EQUAL(cache.NumHits(), 0);
+  BOOST_CHECK_EQUAL(cache.NumMisses(), 4);
+
+  BOOST_CHECK_EQUAL(cache.Get(2).NumBytes(), 2);
+  BOOST_CHECK_EQUAL(cache.NumHits(), 1);
+  BOOST_CHECK_EQUAL(cache.NumMisses(), 4);
+
+  // Each shard holds at most 10 bytes, so the even keys evict each other.
+  BOOST_CHECK_EQUAL(cache.Get(10).NumBytes(), 10);
+  BOOST_CHECK(!cache.Exists(0));
+  BOOST_CHECK(!cache.Exists(2));
+  BOOST_CHECK(cache.Exists(1));
+  BOOST_CHECK(cache.Exists(3));
+  BOOST_CHECK(cache.Exists(10));
+  BOOST_CHECK_EQUAL(cache.NumBytes(), 14);
+
+  cache.Clear();
+  BOOST_CHECK_EQUAL(cache.NumElems(), 0);
+  BOOST_CHECK_EQUAL(cache.NumBytes(), 0);
+}
+
+BOOST_AUTO_TEST_CASE(TestShardedMemoryConstrainedLRUCacheMultiThreaded) {
+  ShardedMemoryConstrainedLRUCache<int, SizedElem> cache(
+      100, 4, [](const int key) { return SizedElem(key % 10); });
+  std::atomic<int> num_errors(0);
+  std::vector<std::thread> threads;
+  for (int i = 0; i < 4; ++i) {
+    threads.emplace_back([&cache, &num_errors]() {
+      for (int j = 0; j < 1000; ++j) {
+        if (cache.Get(j % 50).NumBytes() != static_cast<size_t>(j % 10)) {
+          num_errors += 1;
+        }
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  BOOST_CHECK_EQUAL(num_errors, 0);
+  BOOST_CHECK_EQUAL(cache.NumHits() + cache.NumMisses(), 4000);
+  BOOST_CHECK_LE(cache.NumBytes(), 100);
+}
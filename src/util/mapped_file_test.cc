@@ -0,0 +1,79 @@
+// Copyright (c) 2018, ETH Zurich and UNC Chapel Hill.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//
+//     * Neither the name of ETH Zurich and UNC Chapel Hill nor the names of
+//       its contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Author: Johannes L. Schoenberger (jsch-at-demuc-dot-de)
+
+
+#define TEST_NAME "util/mapped_file"
+#include "util/testing.h"
+
+#include <cstdio>
+#include <fstream>
+
+#include "util/mapped_file.h"
+
+using namespace colmap;
+
+BOOST_AUTO_TEST_CASE(TestMapFile) {
+  const std::string path = "mapped_file_test.bin";
+
+  {
+    std::ofstream file(path, std::ios::binary);
+    for (int i = 0; i < 10000; ++i) {
+      const uint8_t value = static_cast<uint8_t>(i % 256);
+      file.write(reinterpret_cast<const char*>(&value), sizeof(uint8_t));
+    }
+  }
+
+  {
+    MappedFile mapped_file(path);
+    BOOST_CHECK_EQUAL(mapped_file.Path(), path);
+    BOOST_CHECK_EQUAL(mapped_file.NumBytes(), 10000);
+    BOOST_CHECK(mapped_file.Data() != nullptr);
+    for (int i = 0; i < 10000; ++i) {
+      BOOST_CHECK_EQUAL(mapped_file.Data()[i], i % 256);
+    }
+  }
+
+  std::remove(path.c_str());
+}
+
+BOOST_AUTO_TEST_CASE(TestMapEmptyFile) {
+  const std::string path = "mapped_file_test_empty.bin";
+
+  { std::ofstream file(path, std::ios::binary); }
+
+  {
+    MappedFile mapped_file(path);
+    BOOST_CHECK_EQUAL(mapped_file.NumBytes(), 0);
+    BOOST_CHECK(mapped_file.Data() == nullptr);
+  }
+
+  std::remove(path.c_str());
+}
@@ -284,6 +284,20 @@ void OptionManager::AddExtractionOptions() {
                               &sift_extraction->dsp_max_scale);
   AddAndRegisterDefaultOption("SiftExtraction.dsp_num_scales",
                               &sift_extraction->dsp_num_scales);
+  AddAndRegisterDefaultOption("SiftExtraction.write_descriptor_codes",
+                              &sift_extraction->write_descriptor_codes);
+  AddAndRegisterDefaultOption("SiftExtraction.descriptor_codes_only",
+                              &sift_extraction->descriptor_codes_only);
+  AddAndRegisterDefaultOption("SiftExtraction.split_views",
+                              &sift_extraction->split_views);
+  AddAndRegisterDefaultOption("SiftExtraction.split_num_views",
+                              &sift_extraction->split_num_views);
+  AddAndRegisterDefaultOption("SiftExtraction.split_min_radius",
+                              &sift_extraction->split_min_radius);
+  AddAndRegisterDefaultOption("SiftExtraction.split_max_radius",
+                              &sift_extraction->split_max_radius);
+  AddAndRegisterDefaultOption("SiftExtraction.split_max_duplicate_distance",
+                              &sift_extraction->split_max_duplicate_distance);
 }
 
 void OptionManager::AddMatchingOptions() {
@@ -319,6 +333,14 @@ void OptionManager::AddMatchingOptions() {
                               &sift_matching->multiple_models);
   AddAndRegisterDefaultOption("SiftMatching.guided_matching",
                               &sift_matching->guided_matching);
+  AddAndRegisterDefaultOption("SiftMatching.use_descriptor_codes",
+                              &sift_matching->use_descriptor_codes);
+  AddAndRegisterDefaultOption("SiftMatching.num_descriptor_code_candidates",
+                              &sift_matching->num_descriptor_code_candidates);
+  AddAndRegisterDefaultOption("SiftMatching.descriptor_code_max_ratio",
+                              &sift_matching->descriptor_code_max_ratio);
+  AddAndRegisterDefaultOption("SiftMatching.cache_size",
+                              &sift_matching->cache_size);
 }
 
 void OptionManager::AddExhaustiveMatchingOptions() {
@@ -389,6 +411,8 @@ void OptionManager::AddVocabTreeMatchingOptions() {
                               &vocab_tree_matching->vocab_tree_path);
   AddAndRegisterDefaultOption("VocabTreeMatching.match_list_path",
                               &vocab_tree_matching->match_list_path);
+  AddAndRegisterDefaultOption("VocabTreeMatching.index_path",
+                              &vocab_tree_matching->index_path);
 }
 
 void OptionManager::AddSpatialMatchingOptions() {
@@ -596,6 +620,8 @@ void OptionManager::AddPatchMatchStereoOptions() {
                               &patch_match_stereo->max_image_size);
   AddAndRegisterDefaultOption("PatchMatchStereo.gpu_index",
                               &patch_match_stereo->gpu_index);
+  AddAndRegisterDefaultOption("PatchMatchStereo.num_threads",
+                              &patch_match_stereo->num_threads);
   AddAndRegisterDefaultOption("PatchMatchStereo.depth_min",
                               &patch_match_stereo->depth_min);
   AddAndRegisterDefaultOption("PatchMatchStereo.depth_max",
@@ -641,6 +667,8 @@ void OptionManager::AddPatchMatchStereoOptions() {
                               &patch_match_stereo->cache_size);
   AddAndRegisterDefaultOption("PatchMatchStereo.write_consistency_graph",
                               &patch_match_stereo->write_consistency_graph);
+  AddAndRegisterDefaultOption("PatchMatchStereo.write_float16_maps",
+                              &patch_match_stereo->write_float16_maps);
 }
 
 void OptionManager::AddStereoFusionOptions() {
@@ -667,6 +695,8 @@ void OptionManager::AddStereoFusionOptions() {
                               &stereo_fusion->check_num_images);
   AddAndRegisterDefaultOption("StereoFusion.cache_size",
                               &stereo_fusion->cache_size);
+  AddAndRegisterDefaultOption("StereoFusion.num_threads",
+                              &stereo_fusion->num_threads);
 }
 
 void OptionManager::AddPoissonMeshingOptions() {
@@ -682,6 +712,12 @@ void OptionManager::AddPoissonMeshingOptions() {
   AddAndRegisterDefaultOption("PoissonMeshing.trim", &poisson_meshing->trim);
   AddAndRegisterDefaultOption("PoissonMeshing.num_threads",
                               &poisson_meshing->num_threads);
+  AddAndRegisterDefaultOption("PoissonMeshing.block_max_num_points",
+                              &poisson_meshing->block_max_num_points);
+  AddAndRegisterDefaultOption("PoissonMeshing.block_overlap",
+                              &poisson_meshing->block_overlap);
+  AddAndRegisterDefaultOption("PoissonMeshing.block_chunk_size",
+                              &poisson_meshing->block_chunk_size);
 }
 
 void OptionManager::AddDelaunayMeshingOptions() {
@@ -32,6 +32,7 @@
 #include "util/ply.h"
 
 #include <fstream>
+#include <limits>
 
 #include <Eigen/Core>
 
@@ -41,6 +42,24 @@
 namespace colmap {
 
 std::vector<PlyPoint> ReadPly(const std::string& path) {
+  std::vector<PlyPoint> points;
+  ReadPlyInChunks(path, std::numeric_limits<size_t>::max(),
+                  [&points](std::vector<PlyPoint>* chunk_points) {
+                    if (points.empty()) {
+                      points = std::move(*chunk_points);
+                    } else {
+                      points.insert(points.end(), chunk_points->begin(),
+                                    chunk_points->end());
+                    }
+                  });
+  return points;
+}
+
+void ReadPlyInChunks(
+    const std::string& path, const size_t chunk_size,
+    const std::function<void(std::vector<PlyPoint>*)>& callback) {
+  CHECK_GT(chunk_size, 0);
+
   std::ifstream file(path, std::ios::binary);
   CHECK(file.is_open()) << path;
 
@@ -180,7 +199,16 @@ std::vector<PlyPoint> ReadPly(const std::string& path) {
   CHECK(X_index != -1 && Y_index != -1 && Z_index)
       << "Invalid PLY file format: x, y, z properties missing";
 
-  points.reserve(num_vertices);
+  points.reserve(std::min(num_vertices, chunk_size));
+
+  // Pass the current chunk of points to the callback, if it is full or if all
+  // points were read.
+  auto FlushPoints = [&](const bool force) {
+    if (points.size() >= chunk_size || (force && !points.empty())) {
+      callback(&points);
+      points.clear();
+    }
+  };
 
   if (is_binary) {
     std::vector<char> buffer(num_bytes_per_line);
@@ -242,6 +270,7 @@ std::vector<PlyPoint> ReadPly(const std::string& path) {
       }
 
       points.push_back(point);
+      FlushPoints(false);
     }
   } else {
     while (std::getline(file, line)) {
@@ -275,10 +304,235 @@ std::vector<PlyPoint> ReadPly(const std::string& path) {
       }
 
       points.push_back(point);
+      FlushPoints(false);
     }
   }
 
-  return points;
+  FlushPoints(true);
+}
+
+namespace {
+
+enum class PlyDataType {
+  INT8,
+  UINT8,
+  INT16,
+  UINT16,
+  INT32,
+  UINT32,
+  FLOAT32,
+  FLOAT64,
+};
+
+PlyDataType ParsePlyDataType(const std::string& type) {
+  if (type == "char" || type == "int8") {
+    return PlyDataType::INT8;
+  } else if (type == "uchar" || type == "uint8") {
+    return PlyDataType::UINT8;
+  } else if (type == "short" || type == "int16") {
+    return PlyDataType::INT16;
+  } else if (type == "ushort" || type == "uint16") {
+    return PlyDataType::UINT16;
+  } else if (type == "int" || type == "int32") {
+    return PlyDataType::INT32;
+  } else if (type == "uint" || type == "uint32") {
+    return PlyDataType::UINT32;
+  } else if (type == "float" || type == "float32") {
+    return PlyDataType::FLOAT32;
+  } else if (type == "double" || type == "float64") {
+    return PlyDataType::FLOAT64;
+  }
+  LOG(FATAL) << "Invalid data type: " << type;
+  return PlyDataType::FLOAT32;
+}
+
+template <typename T>
+double ReadBinaryPlyValue(std::istream* stream, const bool is_little_endian) {
+  T value;
+  stream->read(reinterpret_cast<char*>(&value), sizeof(T));
+  return is_little_endian ? LittleEndianToNative(value)
+                          : BigEndianToNative(value);
+}
+
+double ReadPlyValue(std::istream* stream, const PlyDataType type,
+                    const bool is_binary, const bool is_little_endian) {
+  if (!is_binary) {
+    double value;
+    *stream >> value;
+    return value;
+  }
+
+  switch (type) {
+    case PlyDataType::INT8:
+      return ReadBinaryPlyValue<int8_t>(stream, is_little_endian);
+    case PlyDataType::UINT8:
+      return ReadBinaryPlyValue<uint8_t>(stream, is_little_endian);
+    case PlyDataType::INT16:
+      return ReadBinaryPlyValue<int16_t>(stream, is_little_endian);
+    case PlyDataType::UINT16:
+      return ReadBinaryPlyValue<uint16_t>(stream, is_little_endian);
+    case PlyDataType::INT32:
+      return ReadBinaryPlyValue<int32_t>(stream, is_little_endian);
+    case PlyDataType::UINT32:
+      return ReadBinaryPlyValue<uint32_t>(stream, is_little_endian);
+    case PlyDataType::FLOAT32:
+      return ReadBinaryPlyValue<float>(stream, is_little_endian);
+    case PlyDataType::FLOAT64:
+      return ReadBinaryPlyValue<double>(stream, is_little_endian);
+  }
+
+  return 0;
+}
+
+}  // namespace
+
+PlyMesh ReadPlyMesh(const std::string& path) {
+  std::ifstream file(path, std::ios::binary);
+  CHECK(file.is_open()) << path;
+
+  struct Property {
+    std::string name;
+    PlyDataType type = PlyDataType::FLOAT32;
+    bool is_list = false;
+    PlyDataType list_size_type = PlyDataType::UINT8;
+  };
+
+  struct Element {
+    std::string name;
+    size_t count = 0;
+    std::vector<Property> properties;
+  };
+
+  std::vector<Element> elements;
+
+  bool is_binary = false;
+  bool is_little_endian = false;
+
+  std::string line;
+  while (std::getline(file, line)) {
+    StringTrim(&line);
+
+    if (line == "end_header") {
+      break;
+    }
+
+    const std::vector<std::string> line_elems = StringSplit(line, " ");
+
+    if (line_elems.size() >= 3 && line_elems[0] == "format") {
+      if (line_elems[1] == "ascii") {
+        is_binary = false;
+      } else if (line_elems[1] == "binary_little_endian") {
+        is_binary = true;
+        is_little_endian = true;
+      } else if (line_elems[1] == "binary_big_endian") {
+        is_binary = true;
+        is_little_endian = false;
+      } else {
+        LOG(FATAL) << "Invalid PLY format: " << line_elems[1];
+      }
+    } else if (line_elems.size() >= 3 && line_elems[0] == "element") {
+      Element element;
+      element.name = line_elems[1];
+      element.count = std::stoll(line_elems[2]);
+      elements.push_back(element);
+    } else if (line_elems.size() >= 3 && line_elems[0] == "property") {
+      CHECK(!elements.empty()) << "Invalid PLY file format: property "
+                                  "without element";
+      Property property;
+      if (line_elems[1] == "list") {
+        CHECK_EQ(line_elems.size(), 5);
+        property.is_list = true;
+        property.list_size_type = ParsePlyDataType(line_elems[2]);
+        property.type = ParsePlyDataType(line_elems[3]);
+        property.name = line_elems[4];
+      } else {
+        property.type = ParsePlyDataType(line_elems[1]);
+        property.name = line_elems[2];
+      }
+      elements.back().properties.push_back(property);
+    }
+  }
+
+  PlyMesh mesh;
+
+  std::vector<size_t> face_vertex_idxs;
+
+  for (const auto& element : elements) {
+    const bool is_vertex_element = element.name == "vertex";
+    const bool is_face_element = element.name == "face";
+
+    if (is_vertex_element) {
+      mesh.vertices.reserve(element.count);
+    } else if (is_face_element) {
+      mesh.faces.reserve(element.count);
+    }
+
+    for (size_t i = 0; i < element.count; ++i) {
+      PlyMeshVertex vertex;
+
+      for (const auto& property : element.properties) {
+        if (property.is_list) {
+          const size_t list_size = static_cast<size_t>(
+              ReadPlyValue(&file, property.list_size_type, is_binary,
+                           is_little_endian));
+          face_vertex_idxs.resize(list_size);
+          for (size_t j = 0; j < list_size; ++j) {
+            face_vertex_idxs[j] = static_cast<size_t>(ReadPlyValue(
+                &file, property.type, is_binary, is_little_endian));
+          }
+
+          if (is_face_element && (property.name == "vertex_indices" ||
+                                  property.name == "vertex_index")) {
+            // Triangulate polygonal faces as triangle fans.
+            for (size_t j = 2; j < list_size; ++j) {
+              mesh.faces.emplace_back(face_vertex_idxs[0],
+                                      face_vertex_idxs[j - 1],
+                                      face_vertex_idxs[j]);
+            }
+          }
+          continue;
+        }
+
+        const double value =
+            ReadPlyValue(&file, property.type, is_binary, is_little_endian);
+
+        if (!is_vertex_element) {
+          continue;
+        }
+
+        if (property.name == "x") {
+          vertex.x = static_cast<float>(value);
+        } else if (property.name == "y") {
+          vertex.y = static_cast<float>(value);
+        } else if (property.name == "z") {
+          vertex.z = static_cast<float>(value);
+        } else if (property.name == "r" || property.name == "red" ||
+                   property.name == "diffuse_red") {
+          vertex.r = static_cast<uint8_t>(value);
+        } else if (property.name == "g" || property.name == "green" ||
+                   property.name == "diffuse_green") {
+          vertex.g = static_cast<uint8_t>(value);
+        } else if (property.name == "b" || property.name == "blue" ||
+                   property.name == "diffuse_blue") {
+          vertex.b = static_cast<uint8_t>(value);
+        }
+      }
+
+      if (is_vertex_element) {
+        mesh.vertices.push_back(vertex);
+      }
+    }
+  }
+
+  CHECK(!file.fail()) << "Invalid PLY file format: unexpected end of file";
+
+  for (const auto& face : mesh.faces) {
+    CHECK_LT(face.vertex_idx1, mesh.vertices.size());
+    CHECK_LT(face.vertex_idx2, mesh.vertices.size());
+    CHECK_LT(face.vertex_idx3, mesh.vertices.size());
+  }
+
+  return mesh;
 }
 
 void WriteTextPlyPoints(const std::string& path,
@@ -381,7 +635,8 @@ void WriteBinaryPlyPoints(const std::string& path,
   binary_file.close();
 }
 
-void WriteTextPlyMesh(const std::string& path, const PlyMesh& mesh) {
+void WriteTextPlyMesh(const std::string& path, const PlyMesh& mesh,
+                      const bool write_rgb) {
   std::fstream file(path, std::ios::out);
   CHECK(file.is_open());
 
@@ -391,12 +646,22 @@ void WriteTextPlyMesh(const std::string& path, const PlyMesh& mesh) {
   file << "property float x" << std::endl;
   file << "property float y" << std::endl;
   file << "property float z" << std::endl;
+  if (write_rgb) {
+    file << "property uchar red" << std::endl;
+    file << "property uchar green" << std::endl;
+    file << "property uchar blue" << std::endl;
+  }
   file << "element face " << mesh.faces.size() << std::endl;
   file << "property list uchar int vertex_index" << std::endl;
   file << "end_header" << std::endl;
 
   for (const auto& vertex : mesh.vertices) {
-    file << vertex.x << " " << vertex.y << " " << vertex.z << std::endl;
+    file << vertex.x << " " << vertex.y << " " << vertex.z;
+    if (write_rgb) {
+      file << " " << static_cast<int>(vertex.r) << " "
+           << static_cast<int>(vertex.g) << " " << static_cast<int>(vertex.b);
+    }
+    file << std::endl;
   }
 
   for (const auto& face : mesh.faces) {
@@ -406,7 +671,8 @@ void WriteTextPlyMesh(const std::string& path, const PlyMesh& mesh) {
   }
 }
 
-void WriteBinaryPlyMesh(const std::string& path, const PlyMesh& mesh) {
+void WriteBinaryPlyMesh(const std::string& path, const PlyMesh& mesh,
+                        const bool write_rgb) {
   std::fstream text_file(path, std::ios::out);
   CHECK(text_file.is_open());
 
@@ -416,6 +682,11 @@ void WriteBinaryPlyMesh(const std::string& path, const PlyMesh& mesh) {
   text_file << "property float x" << std::endl;
   text_file << "property float y" << std::endl;
   text_file << "property float z" << std::endl;
+  if (write_rgb) {
+    text_file << "property uchar red" << std::endl;
+    text_file << "property uchar green" << std::endl;
+    text_file << "property uchar blue" << std::endl;
+  }
   text_file << "element face " << mesh.faces.size() << std::endl;
   text_file << "property list uchar int vertex_index" << std::endl;
   text_file << "end_header" << std::endl;
@@ -429,6 +700,11 @@ void WriteBinaryPlyMesh(const std::string& path, const PlyMesh& mesh) {
     WriteBinaryLittleEndian<float>(&binary_file, vertex.x);
     WriteBinaryLittleEndian<float>(&binary_file, vertex.y);
     WriteBinaryLittleEndian<float>(&binary_file, vertex.z);
+    if (write_rgb) {
+      WriteBinaryLittleEndian<uint8_t>(&binary_file, vertex.r);
+      WriteBinaryLittleEndian<uint8_t>(&binary_file, vertex.g);
+      WriteBinaryLittleEndian<uint8_t>(&binary_file, vertex.b);
+    }
   }
 
   for (const auto& face : mesh.faces) {
@@ -445,4 +721,85 @@ void WriteBinaryPlyMesh(const std::string& path, const PlyMesh& mesh) {
   binary_file.close();
 }
 
+BinaryPlyPointsWriter::BinaryPlyPointsWriter(const std::string& path,
+                                             const bool write_normal,
+                                             const bool write_rgb)
+    : path_(path),
+      write_normal_(write_normal),
+      write_rgb_(write_rgb),
+      num_points_(0),
+      num_points_pos_(0) {
+  std::fstream text_file(path_, std::ios::out);
+  CHECK(text_file.is_open()) << path_;
+
+  text_file << "ply" << std::endl;
+  text_file << "format binary_little_endian 1.0" << std::endl;
+  text_file << "element vertex ";
+  num_points_pos_ = text_file.tellp();
+  // Reserve a fixed number of digits for the number of points, which is
+  // updated in-place after each write. PLY readers accept leading zeros.
+  text_file << StringPrintf("%020d", 0) << std::endl;
+
+  text_file << "property float x" << std::endl;
+  text_file << "property float y" << std::endl;
+  text_file << "property float z" << std::endl;
+
+  if (write_normal_) {
+    text_file << "property float nx" << std::endl;
+    text_file << "property float ny" << std::endl;
+    text_file << "property float nz" << std::endl;
+  }
+
+  if (write_rgb_) {
+    text_file << "property uchar red" << std::endl;
+    text_file << "property uchar green" << std::endl;
+    text_file << "property uchar blue" << std::endl;
+  }
+
+  text_file << "end_header" << std::endl;
+  text_file.close();
+}
+
+void BinaryPlyPointsWriter::Write(const std::vector<PlyPoint>& points) {
+  if (points.empty()) {
+    return;
+  }
+
+  std::fstream binary_file(path_,
+                           std::ios::out | std::ios::binary | std::ios::app);
+  CHECK(binary_file.is_open()) << path_;
+
+  for (const auto& point : points) {
+    WriteBinaryLittleEndian<float>(&binary_file, point.x);
+    WriteBinaryLittleEndian<float>(&binary_file, point.y);
+    WriteBinaryLittleEndian<float>(&binary_file, point.z);
+
+    if (write_normal_) {
+      WriteBinaryLittleEndian<float>(&binary_file, point.nx);
+      WriteBinaryLittleEndian<float>(&binary_file, point.ny);
+      WriteBinaryLittleEndian<float>(&binary_file, point.nz);
+    }
+
+    if (write_rgb_) {
+      WriteBinaryLittleEndian<uint8_t>(&binary_file, point.r);
+      WriteBinaryLittleEndian<uint8_t>(&binary_file, point.g);
+      WriteBinaryLittleEndian<uint8_t>(&binary_file, point.b);
+    }
+  }
+
+  binary_file.close();
+
+  num_points_ += points.size();
+
+  std::fstream header_file(path_,
+                           std::ios::in | std::ios::out | std::ios::binary);
+  CHECK(header_file.is_open()) << path_;
+  header_file.seekp(num_points_pos_);
+  header_file << StringPrintf("%020llu",
+                              static_cast<unsigned long long>(num_points_));
+  header_file.close();
+}
+
+size_t BinaryPlyPointsWriter::NumPoints() const { return num_points_; }
+
 }  // namespace colmap
@@ -32,6 +32,7 @@
 #ifndef COLMAP_SRC_UTIL_PLY_H_
 #define COLMAP_SRC_UTIL_PLY_H_
 
+#include <functional>
 #include <string>
 #include <vector>
 
@@ -59,6 +60,9 @@ struct PlyMeshVertex {
   float x = 0.0f;
   float y = 0.0f;
   float z = 0.0f;
+  uint8_t r = 0;
+  uint8_t g = 0;
+  uint8_t b = 0;
 };
 
 struct PlyMeshFace {
@@ -82,6 +86,17 @@ struct PlyMesh {
 // Read PLY point cloud from text or binary file.
 std::vector<PlyPoint> ReadPly(const std::string& path);
 
+// Read PLY point cloud from text or binary file in chunks of at most the given
+// number of points, so that large point clouds can be processed without
+// loading them into memory at once. The callback may move the chunk's points.
+void ReadPlyInChunks(
+    const std::string& path, const size_t chunk_size,
+    const std::function<void(std::vector<PlyPoint>*)>& callback);
+
+// Read PLY mesh from text or binary file. Polygonal faces are triangulated and
+// vertex colors are read if present.
+PlyMesh ReadPlyMesh(const std::string& path);
+
 // Write PLY point cloud to text or binary file.
 void WriteTextPlyPoints(const std::string& path,
                         const std::vector<PlyPoint>& points,
@@ -93,8 +108,31 @@ void WriteBinaryPlyPoints(const std::string& path,
                           const bool write_rgb = true);
 
 // Write PLY mesh to text or binary file.
-void WriteTextPlyMesh(const std::string& path, const PlyMesh& mesh);
-void WriteBinaryPlyMesh(const std::string& path, const PlyMesh& mesh);
+void WriteTextPlyMesh(const std::string& path, const PlyMesh& mesh,
+                      const bool write_rgb = false);
+void WriteBinaryPlyMesh(const std::string& path, const PlyMesh& mesh,
+                        const bool write_rgb = false);
+
+// Incrementally write a binary PLY point cloud whose number of points is not
+// known in advance. The number of points in the header is updated after each
+// write, so that the file is a valid PLY file in between writes. The file is
+// only opened during writes, which allows to write many files concurrently.
+class BinaryPlyPointsWriter {
+ public:
+  BinaryPlyPointsWriter(const std::string& path, const bool write_normal = true,
+                        const bool write_rgb = true);
+
+  void Write(const std::vector<PlyPoint>& points);
+
+  size_t NumPoints() const;
+
+ private:
+  std::string path_;
+  bool write_normal_;
+  bool write_rgb_;
+  size_t num_points_;
+  size_t num_points_pos_;
+};
 
 }  // namespace colmap
 
@@ -0,0 +1,204 @@
+// Copyright (c) 2018, ETH Zurich and UNC Chapel Hill.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//
+//     * Neither the name of ETH Zurich and UNC Chapel Hill nor the names of
+//       its contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Author: Johannes L. Schoenberger (jsch-at-demuc-dot-de)
+
+
+#define TEST_NAME "util/ply"
+#include "util/testing.h"
+
+#include <cstdio>
+
+#include "util/ply.h"
+
+using namespace colmap;
+
+namespace {
+
+std::vector<PlyPoint> CreateTestPoints(const size_t num_points) {
+  std::vector<PlyPoint> points(num_points);
+  for (size_t i = 0; i < num_points; ++i) {
+    points[i].x = i;
+    points[i].y = 2.0f * i;
+    points[i].z = 3.0f * i;
+    points[i].nx = 1.0f;
+    points[i].r = static_cast<uint8_t>(i % 256);
+  }
+  return points;
+}
+
+void CheckEqualPoints(const std::vector<PlyPoint>& points1,
+                      const std::vector<PlyPoint>& points2) {
+  BOOST_REQUIRE_EQUAL(points1.size(), points2.size());
+  for (size_t i = 0; i < points1.size(); ++i) {
+    BOOST_CHECK_EQUAL(points1[i].x, points2[i].x);
+    BOOST_CHECK_EQUAL(points1[i].y, points2[i].y);
+    BOOST_CHECK_EQUAL(points1[i].z, points2[i].z);
+    BOOST_CHECK_EQUAL(points1[i].nx, points2[i].nx);
+    BOOST_CHECK_EQUAL(points1[i].r, points2[i].r);
+  }
+}
+
+}  // namespace
+
+BOOST_AUTO_TEST_CASE(TestReadWritePoints) {
+  const std::string path = "ply_test_points.ply";
+  const auto points = CreateTestPoints(100);
+
+  WriteTextPlyPoints(path, points);
+  CheckEqualPoints(ReadPly(path), points);
+
+  WriteBinaryPlyPoints(path, points);
+  CheckEqualPoints(ReadPly(path), points);
+
+  std::remove(path.c_str());
+}
+
+BOOST_AUTO_TEST_CASE(TestReadInChunks) {
+  const std::string path = "ply_test_chunks.ply";
+  const auto points = CreateTestPoints(100);
+  WriteBinaryPlyPoints(path, points);
+
+  std::vector<size_t> chunk_sizes;
+  std::vector<PlyPoint> read_points;
+  ReadPlyInChunks(path, 30, [&](std::vector<PlyPoint>* chunk_points) {
+    chunk_sizes.push_back(chunk_points->size());
+    read_points.insert(read_points.end(), chunk_points->begin(),
+                       chunk_points->end());
+  });
+
+  BOOST_CHECK_EQUAL(chunk_sizes.size(), 4);
+  BOOST_CHECK_EQUAL(chunk_sizes[0], 30);
+  BOOST_CHECK_EQUAL(chunk_sizes[1], 30);
+  BOOST_CHECK_EQUAL(chunk_sizes[2], 30);
+  BOOST_CHECK_EQUAL(chunk_sizes[3], 10);
+  CheckEqualPoints(read_points, points);
+
+  std::remove(path.c_str());
+}
+
+BOOST_AUTO_TEST_CASE(TestBinaryPointsWriter) {
+  const std::string path = "ply_test_writer.ply";
+  const auto points = CreateTestPoints(100);
+
+  BinaryPlyPointsWriter writer(path);
+  BOOST_CHECK_EQUAL(writer.NumPoints(), 0);
+  BOOST_CHECK_EQUAL(ReadPly(path).size(), 0);
+
+  writer.Write(std::vector<PlyPoint>(points.begin(), points.begin() + 40));
+  BOOST_CHECK_EQUAL(writer.NumPoints(), 40);
+  BOOST_CHECK_EQUAL(ReadPly(path).size(), 40);
+
+  writer.Write(std::vector<PlyPoint>(points.begin() + 40, points.end()));
+  BOOST_CHECK_EQUAL(writer.NumPoints(), 100);
+  CheckEqualPoints(ReadPly(path), points);
+
+  std::remove(path.c_str());
+}
+
+BOOST_AUTO_TEST_CASE(TestReadWriteMesh) {
+  const std::string path = "ply_test_mesh.ply";
+
+  PlyMesh mesh;
+  mesh.vertices.emplace_back(0, 0, 0);
+  mesh.vertices.emplace_back(1, 0, 0);
+  mesh.vertices.emplace_back(0, 1, 0);
+  mesh.vertices.emplace_back(0, 0, 1);
+  mesh.vertices[3].r = 1;
+  mesh.vertices[3].g = 2;
+  mesh.vertices[3].b = 3;
+  mesh.faces.emplace_back(0, 1, 2);
+  mesh.faces.emplace_back(0, 1, 3);
+
+  for (const bool write_rgb : {false, true}) {
+    for (const bool write_binary : {false, true}) {
+      if (write_binary) {
+        WriteBinaryPlyMesh(path, mesh, write_rgb);
+      } else {
+        WriteTextPlyMesh(path, mesh, write_rgb);
+      }
+
+      const PlyMesh read_mesh = ReadPlyMesh(path);
+      BOOST_REQUIRE_EQUAL(read_mesh.vertices.size(), mesh.vertices.size());
+      BOOST_REQUIRE_EQUAL(read_mesh.faces.size(), mesh.faces.size());
+      for (size_t i = 0; i < mesh.vertices.size(); ++i) {
+        BOOST_CHECK_EQUAL(read_mesh.vertices[i].x, mesh.vertices[i].x);
+        BOOST_CHECK_EQUAL(read_mesh.vertices[i].y, mesh.vertices[i].y);
+        BOOST_CHECK_EQUAL(read_mesh.vertices[i].z, mesh.vertices[i].z);
+        BOOST_CHECK_EQUAL(read_mesh.vertices[i].b,
+                          write_rgb ? mesh.vertices[i].b : 0);
+      }
+      for (size_t i = 0; i < mesh.faces.size(); ++i) {
+        BOOST_CHECK_EQUAL(read_mesh.faces[i].vertex_idx1,
+                          mesh.faces[i].vertex_idx1);
+        BOOST_CHECK_EQUAL(read_mesh.faces[i].vertex_idx2,
+                          mesh.faces[i].vertex_idx2);
+        BOOST_CHECK_EQUAL(read_mesh.faces[i].vertex_idx3,
+                          mesh.faces[i].vertex_idx3);
+      }
+    }
+  }
+
+  std::remove(path.c_str());
+}
+
+BOOST_AUTO_TEST_CASE(TestReadPolygonMesh) {
+  const std::string path = "ply_test_polygon_mesh.ply";
+
+  {
+    std::ofstream file(path);
+    file << "ply" << std::endl;
+    file << "format ascii 1.0" << std::endl;
+    file << "element vertex 4" << std::endl;
+    file << "property float x" << std::endl;
+    file << "property float y" << std::endl;
+    file << "property float z" << std::endl;
+    file << "property float value" << std::endl;
+    file << "element face 1" << std::endl;
+    file << "property list uchar int vertex_indices" << std::endl;
+    file << "end_header" << std::endl;
+    file << "0 0 0 1" << std::endl;
+    file << "1 0 0 1" << std::endl;
+    file << "1 1 0 1" << std::endl;
+    file << "0 1 0 1" << std::endl;
+    file << "4 0 1 2 3" << std::endl;
+  }
+
+  const PlyMesh mesh = ReadPlyMesh(path);
+  BOOST_CHECK_EQUAL(mesh.vertices.size(), 4);
+  BOOST_REQUIRE_EQUAL(mesh.faces.size(), 2);
+  BOOST_CHECK_EQUAL(mesh.faces[0].vertex_idx1, 0);
+  BOOST_CHECK_EQUAL(mesh.faces[0].vertex_idx2, 1);
+  BOOST_CHECK_EQUAL(mesh.faces[0].vertex_idx3, 2);
+  BOOST_CHECK_EQUAL(mesh.faces[1].vertex_idx1, 0);
+  BOOST_CHECK_EQUAL(mesh.faces[1].vertex_idx2, 2);
+  BOOST_CHECK_EQUAL(mesh.faces[1].vertex_idx3, 3);
+
+  std::remove(path.c_str());
+}
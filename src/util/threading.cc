@@ -183,9 +183,24 @@ void Thread::RunFunc() {
   Callback(FINISHED_CALLBACK);
 }
 
+namespace {
+
+// The thread pool and worker index of the current thread, if it is a worker.
+thread_local const ThreadPool* tls_thread_pool = nullptr;
+thread_local int tls_thread_index = -1;
+
+}  // namespace
+
 ThreadPool::ThreadPool(const int num_threads)
-    : stopped_(false), num_active_workers_(0) {
+    : stopped_(false),
+      num_queued_tasks_(0),
+      num_unfinished_tasks_(0),
+      num_sleeping_workers_(0),
+      next_queue_index_(0) {
   const int num_effective_threads = GetEffectiveNumThreads(num_threads);
+  for (int index = 0; index < num_effective_threads; ++index) {
+    queues_.emplace_back(new WorkerQueue());
+  }
   for (int index = 0; index < num_effective_threads; ++index) {
     std::function<void(void)> worker =
         std::bind(&ThreadPool::WorkerFunc, this, index);
@@ -204,9 +219,13 @@ void ThreadPool::Stop() {
     }
 
     stopped_ = true;
+  }
 
-    std::queue<std::function<void()>> empty_tasks;
-    std::swap(tasks_, empty_tasks);
+  for (auto& queue : queues_) {
+    std::unique_lock<std::mutex> lock(queue->mutex);
+    num_queued_tasks_ -= queue->tasks.size();
+    num_unfinished_tasks_ -= queue->tasks.size();
+    queue->tasks.clear();
   }
 
   task_condition_.notify_all();
@@ -215,45 +234,92 @@ void ThreadPool::Stop() {
     worker.join();
   }
 
-  finished_condition_.notify_all();
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    finished_condition_.notify_all();
+  }
 }
 
 void ThreadPool::Wait() {
   std::unique_lock<std::mutex> lock(mutex_);
-  if (!tasks_.empty() || num_active_workers_ > 0) {
-    finished_condition_.wait(
-        lock, [this]() { return tasks_.empty() && num_active_workers_ == 0; });
+  finished_condition_.wait(lock,
+                           [this]() { return num_unfinished_tasks_ == 0; });
+}
+
+bool ThreadPool::PushTask(std::function<void()> task) {
+  const size_t index =
+      tls_thread_pool == this
+          ? static_cast<size_t>(tls_thread_index)
+          : next_queue_index_.fetch_add(1) % queues_.size();
+
+  {
+    std::unique_lock<std::mutex> lock(queues_[index]->mutex);
+    if (stopped_) {
+      return false;
+    }
+    num_unfinished_tasks_ += 1;
+    queues_[index]->tasks.push_back(std::move(task));
+  }
+
+  num_queued_tasks_ += 1;
+
+  // Sleeping workers register themselves while holding the mutex and before
+  // checking for queued tasks, so the notification cannot get lost.
+  if (num_sleeping_workers_ > 0) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    task_condition_.notify_one();
   }
+
+  return true;
 }
 
-void ThreadPool::WorkerFunc(const int index) {
+bool ThreadPool::PopTask(const int index, std::function<void()>* task) {
   {
-    std::lock_guard<std::mutex> lock(mutex_);
-    thread_id_to_index_.emplace(GetThreadId(), index);
+    WorkerQueue& queue = *queues_[index];
+    std::unique_lock<std::mutex> lock(queue.mutex);
+    if (!queue.tasks.empty()) {
+      *task = std::move(queue.tasks.front());
+      queue.tasks.pop_front();
+      num_queued_tasks_ -= 1;
+      return true;
+    }
+  }
+
+  for (size_t i = 1; i < queues_.size(); ++i) {
+    WorkerQueue& queue = *queues_[(index + i) % queues_.size()];
+    std::unique_lock<std::mutex> lock(queue.mutex);
+    if (!queue.tasks.empty()) {
+      *task = std::move(queue.tasks.back());
+      queue.tasks.pop_back();
+      num_queued_tasks_ -= 1;
+      return true;
+    }
   }
 
-  while (true) {
+  return false;
+}
+
+void ThreadPool::WorkerFunc(const int index) {
+  tls_thread_pool = this;
+  tls_thread_index = index;
+
+  while (!stopped_) {
     std::function<void()> task;
-    {
+    if (!PopTask(index, &task)) {
       std::unique_lock<std::mutex> lock(mutex_);
-      task_condition_.wait(lock,
-                           [this] { return stopped_ || !tasks_.empty(); });
-      if (stopped_ && tasks_.empty()) {
-        return;
-      }
-      task = std::move(tasks_.front());
-      tasks_.pop();
-      num_active_workers_ += 1;
+      num_sleeping_workers_ += 1;
+      task_condition_.wait(
+          lock, [this] { return stopped_ || num_queued_tasks_ > 0; });
+      num_sleeping_workers_ -= 1;
+      continue;
     }
 
     task();
 
-    {
+    if (num_unfinished_tasks_.fetch_sub(1) == 1) {
       std::unique_lock<std::mutex> lock(mutex_);
-      num_active_workers_ -= 1;
+      finished_condition_.notify_all();
     }
-
-    finished_condition_.notify_all();
   }
 }
 
@@ -262,8 +328,10 @@ std::thread::id ThreadPool::GetThreadId() const {
 }
 
 int ThreadPool::GetThreadIndex() {
-  std::unique_lock<std::mutex> lock(mutex_);
-  return thread_id_to_index_.at(GetThreadId());
+  if (tls_thread_pool != this) {
+    throw std::out_of_range("Current thread is not a worker of the pool.");
+  }
+  return tls_thread_index;
 }
 
 int GetEffectiveNumThreads(const int num_threads) {
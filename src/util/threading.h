@@ -32,12 +32,19 @@
 #ifndef COLMAP_SRC_UTIL_THREADING_
 #define COLMAP_SRC_UTIL_THREADING_
 
+#include <algorithm>
 #include <atomic>
 #include <climits>
+#include <condition_variable>
+#include <deque>
+#include <exception>
 #include <functional>
 #include <future>
 #include <list>
+#include <memory>
+#include <mutex>
 #include <queue>
+#include <thread>
 #include <unordered_map>
 
 #include "util/timer.h"
@@ -205,6 +212,15 @@ class Thread {
 //    }
 //    thread_pool.Wait();
 //
+// Fine-grained loops should rather use ParallelFor, which schedules chunks of
+// iterations instead of individual tasks:
+//
+//    thread_pool.ParallelFor(0, 1000, [](const size_t i) { /* Do work */ });
+//
+// Each worker has its own task queue. Tasks added by a worker are pushed to
+// its own queue and tasks added by other threads are distributed round-robin
+// over the queues. Idle workers steal tasks from the other queues, such that
+// there is no single lock contended by all workers.
 class ThreadPool {
  public:
   static const int kMaxNumThreads = -1;
@@ -219,6 +235,16 @@ class ThreadPool {
   auto AddTask(func_t&& f, args_t&&... args)
       -> std::future<typename std::result_of<func_t(args_t...)>::type>;
 
+  // Call func(i) for all i in [begin, end) and block until all calls are
+  // finished. The range is split into chunks of grain_size iterations, which
+  // are dynamically distributed over the workers and the calling thread. The
+  // calling thread processes chunks itself, so it is safe to call ParallelFor
+  // from within a task of the same thread pool, i.e., nested parallelism.
+  // The first exception thrown by func is rethrown in the calling thread.
+  template <class func_t>
+  void ParallelFor(const size_t begin, const size_t end, const func_t& func,
+                   const size_t grain_size = 1);
+
   // Stop the execution of all workers.
   void Stop();
 
@@ -234,19 +260,33 @@ class ThreadPool {
   int GetThreadIndex();
 
  private:
+  struct WorkerQueue {
+    std::mutex mutex;
+    std::deque<std::function<void()>> tasks;
+  };
+
+  // Push a task to the queue of the current worker or to the next queue in
+  // round-robin order. Return false if the thread pool was stopped.
+  bool PushTask(std::function<void()> task);
+
+  // Pop a task from the front of the own queue or steal from the back of the
+  // other queues. Return false if all queues are empty.
+  bool PopTask(const int index, std::function<void()>* task);
+
   void WorkerFunc(const int index);
 
   std::vector<std::thread> workers_;
-  std::queue<std::function<void()>> tasks_;
+  std::vector<std::unique_ptr<WorkerQueue>> queues_;
 
   std::mutex mutex_;
   std::condition_variable task_condition_;
   std::condition_variable finished_condition_;
 
-  bool stopped_;
-  int num_active_workers_;
-
-  std::unordered_map<std::thread::id, int> thread_id_to_index_;
+  std::atomic<bool> stopped_;
+  std::atomic<int64_t> num_queued_tasks_;
+  std::atomic<int64_t> num_unfinished_tasks_;
+  std::atomic<int> num_sleeping_workers_;
+  std::atomic<size_t> next_queue_index_;
 };
 
 // A job queue class for the producer-consumer paradigm.
@@ -342,17 +382,77 @@ auto ThreadPool::AddTask(func_t&& f, args_t&&... args)
 
   std::future<return_t> result = task->get_future();
 
-  {
-    std::unique_lock<std::mutex> lock(mutex_);
-    if (stopped_) {
-      throw std::runtime_error("Cannot add task to stopped thread pool.");
+  if (!PushTask([task]() { (*task)(); })) {
+    throw std::runtime_error("Cannot add task to stopped thread pool.");
+  }
+
+  return result;
+}
+
+template <class func_t>
+void ThreadPool::ParallelFor(const size_t begin, const size_t end,
+                             const func_t& func, const size_t grain_size) {
+  if (begin >= end) {
+    return;
+  }
+
+  const size_t chunk_size = std::max<size_t>(1, grain_size);
+  const size_t num_chunks = (end - begin + chunk_size - 1) / chunk_size;
+
+  struct State {
+    std::atomic<size_t> next_chunk{0};
+    std::atomic<size_t> num_finished_chunks{0};
+    std::mutex mutex;
+    std::condition_variable finished_condition;
+    std::exception_ptr exception;
+  };
+
+  // The state is shared with the helper tasks, which may only start after all
+  // chunks are finished and ParallelFor has returned. The function is only
+  // accessed for unfinished chunks, i.e., before ParallelFor returns.
+  auto state = std::make_shared<State>();
+  auto ProcessChunks = [state, begin, end, chunk_size, num_chunks, &func]() {
+    size_t chunk;
+    while ((chunk = state->next_chunk.fetch_add(1)) < num_chunks) {
+      const size_t chunk_begin = begin + chunk * chunk_size;
+      const size_t chunk_end = std::min(end, chunk_begin + chunk_size);
+      try {
+        for (size_t i = chunk_begin; i < chunk_end; ++i) {
+          func(i);
+        }
+      } catch (...) {
+        std::unique_lock<std::mutex> lock(state->mutex);
+        if (!state->exception) {
+          state->exception = std::current_exception();
+        }
+      }
+      if (state->num_finished_chunks.fetch_add(1) + 1 == num_chunks) {
+        std::unique_lock<std::mutex> lock(state->mutex);
+        state->finished_condition.notify_all();
+      }
+    }
+  };
+
+  // The calling thread processes chunks as well, hence one helper less.
+  const size_t num_helpers = std::min(num_chunks - 1, NumThreads());
+  for (size_t i = 0; i < num_helpers; ++i) {
+    if (!PushTask(ProcessChunks)) {
+      break;
     }
-    tasks_.emplace([task]() { (*task)(); });
   }
 
-  task_condition_.notify_one();
+  ProcessChunks();
 
-  return result;
+  {
+    std::unique_lock<std::mutex> lock(state->mutex);
+    state->finished_condition.wait(lock, [&state, num_chunks]() {
+      return state->num_finished_chunks == num_chunks;
+    });
+  }
+
+  if (state->exception) {
+    std::rethrow_exception(state->exception);
+  }
 }
 
 template <typename T>
@@ -0,0 +1,122 @@
+// Copyright (c) 2018, ETH Zurich and UNC Chapel Hill.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//
+//     * Neither the name of ETH Zurich and UNC Chapel Hill nor the names of
+//       its contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Author: Johannes L. Schoenberger (jsch-at-demuc-dot-de)
+
+
+// Benchmark of the thread pool scalability for fine-grained tasks. For an
+// increasing number of threads, it measures the throughput of many small
+// tasks submitted individually through AddTask and of the same work as a
+// ParallelFor with different grain sizes:
+//
+//    threading_benchmark [num_iterations] [max_num_threads]
+//
+
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+#include "util/misc.h"
+#include "util/threading.h"
+#include "util/timer.h"
+
+using namespace colmap;
+
+namespace {
+
+// Small amount of work, comparable to checking one observation.
+double Work(const size_t i) {
+  double value = static_cast<double>(i);
+  for (int k = 0; k < 16; ++k) {
+    value = std::sqrt(value + k);
+  }
+  return value;
+}
+
+double BenchmarkAddTask(ThreadPool* thread_pool, const size_t num_iterations,
+                        std::vector<double>* results) {
+  Timer timer;
+  timer.Start();
+  for (size_t i = 0; i < num_iterations; ++i) {
+    thread_pool->AddTask([results, i]() { (*results)[i] = Work(i); });
+  }
+  thread_pool->Wait();
+  return timer.ElapsedSeconds();
+}
+
+double BenchmarkParallelFor(ThreadPool* thread_pool,
+                            const size_t num_iterations,
+                            const size_t grain_size,
+                            std::vector<double>* results) {
+  Timer timer;
+  timer.Start();
+  thread_pool->ParallelFor(
+      0, num_iterations,
+      [results](const size_t i) { (*results)[i] = Work(i); }, grain_size);
+  return timer.ElapsedSeconds();
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  const size_t num_iterations =
+      argc > 1 ? std::stoul(argv[1]) : static_cast<size_t>(1000000);
+  const int max_num_threads =
+      argc > 2 ? std::stoi(argv[2]) : GetEffectiveNumThreads(-1);
+
+  std::vector<double> results(num_iterations);
+
+  std::cout << "Throughput in million iterations per second" << std::endl;
+  std::cout << StringPrintf("%8s %10s %10s %10s %10s", "threads", "AddTask",
+                            "For(1)", "For(64)", "For(1024)")
+            << std::endl;
+  for (int num_threads = 1; num_threads <= max_num_threads;
+       num_threads *= 2) {
+    ThreadPool thread_pool(num_threads);
+    const double add_task_time =
+        BenchmarkAddTask(&thread_pool, num_iterations, &results);
+    const double for1_time =
+        BenchmarkParallelFor(&thread_pool, num_iterations, 1, &results);
+    const double for64_time =
+        BenchmarkParallelFor(&thread_pool, num_iterations, 64, &results);
+    const double for1024_time =
+        BenchmarkParallelFor(&thread_pool, num_iterations, 1024, &results);
+    const double scale = 1e-6 * num_iterations;
+    std::cout << StringPrintf("%8d %10.2f %10.2f %10.2f %10.2f",
+                              num_threads, scale / add_task_time,
+                              scale / for1_time, scale / for64_time,
+                              scale / for1024_time)
+              << std::endl;
+    if (num_threads < max_num_threads && 2 * num_threads > max_num_threads) {
+      num_threads = max_num_threads / 2;
+    }
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -638,6 +638,101 @@ BOOST_AUTO_TEST_CASE(TestThreadPoolGetThreadIndex) {
   }
 }
 
+BOOST_AUTO_TEST_CASE(TestThreadPoolAddTaskFromTask) {
+  std::vector<uint8_t> results(100, 0);
+  ThreadPool pool(4);
+
+  std::function<void(int)> Func = [&](const int num) {
+    results[num] = 1;
+    if (num + 1 < static_cast<int>(results.size())) {
+      pool.AddTask(Func, num + 1);
+    }
+  };
+
+  pool.AddTask(Func, 0);
+  pool.Wait();
+
+  for (const auto result : results) {
+    BOOST_CHECK_EQUAL(result, 1);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(TestThreadPoolParallelFor) {
+  ThreadPool pool(4);
+
+  for (const size_t grain_size : {1, 7, 1000, 5000}) {
+    std::vector<int> results(1000, 0);
+    pool.ParallelFor(0, results.size(),
+                     [&](const size_t i) { results[i] += 1; }, grain_size);
+    for (const auto result : results) {
+      BOOST_CHECK_EQUAL(result, 1);
+    }
+  }
+
+  std::vector<int> results(10, 0);
+  pool.ParallelFor(5, 5, [&](const size_t i) { results[i] += 1; });
+  pool.ParallelFor(3, 7, [&](const size_t i) { results[i] += 1; });
+  for (size_t i = 0; i < results.size(); ++i) {
+    BOOST_CHECK_EQUAL(results[i], i >= 3 && i < 7 ? 1 : 0);
+  }
+
+  pool.Wait();
+}
+
+BOOST_AUTO_TEST_CASE(TestThreadPoolParallelForNested) {
+  ThreadPool pool(2);
+
+  std::vector<std::atomic<int>> results(100);
+  for (auto& result : results) {
+    result = 0;
+  }
+
+  pool.ParallelFor(0, 10, [&](const size_t i) {
+    pool.ParallelFor(0, 10,
+                     [&](const size_t j) { results[i * 10 + j] += 1; });
+  });
+
+  std::vector<std::future<void>> futures;
+  for (size_t i = 0; i < 4; ++i) {
+    futures.push_back(pool.AddTask([&]() {
+      pool.ParallelFor(0, results.size(),
+                       [&](const size_t j) { results[j] += 1; });
+    }));
+  }
+  for (auto& future : futures) {
+    future.get();
+  }
+
+  for (const auto& result : results) {
+    BOOST_CHECK_EQUAL(result, 5);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(TestThreadPoolParallelForException) {
+  ThreadPool pool(4);
+  std::atomic<int> num_calls(0);
+  BOOST_CHECK_THROW(pool.ParallelFor(0, 100,
+                                     [&](const size_t i) {
+                                       num_calls += 1;
+                                       if (i == 50) {
+                                         throw std::runtime_error("");
+                                       }
+                                     }),
+                    std::runtime_error);
+  BOOST_CHECK_EQUAL(num_calls, 100);
+  pool.Wait();
+}
+
+BOOST_AUTO_TEST_CASE(TestThreadPoolParallelForStopped) {
+  ThreadPool pool(4);
+  pool.Stop();
+  std::vector<int> results(100, 0);
+  pool.ParallelFor(0, results.size(), [&](const size_t i) { results[i] = 1; });
+  for (const auto result : results) {
+    BOOST_CHECK_EQUAL(result, 1);
+  }
+}
+
 BOOST_AUTO_TEST_CASE(TestJobQueueSingleProducerSingleConsumer) {
   JobQueue<int> job_queue;
 